@@ -0,0 +1,112 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cstddef>
+#include <new>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Allocator.h"
+#include "Disallowcopying.h"
+
+namespace lessdb {
+
+namespace {
+
+// The mapping of a chunk starts with a header holding its length, followed
+// by the chunk, which is kept as aligned as malloc would.
+constexpr size_t kHeaderSize = alignof(std::max_align_t);
+constexpr size_t kHugePageSize = 2 << 20;
+
+// From <linux/mempolicy.h>.
+constexpr int kMpolBind = 2;
+
+class NumaAllocator final : public Allocator {
+  __DISALLOW_COPYING__(NumaAllocator);
+
+ public:
+  NumaAllocator(int numa_node, bool huge_pages)
+      : huge_pages_(huge_pages),
+        page_size_(static_cast<size_t>(sysconf(_SC_PAGESIZE))) {
+    if (numa_node >= 0) {
+      const size_t bits = sizeof(unsigned long) * 8;
+      node_mask_.resize(numa_node / bits + 1);
+      node_mask_[numa_node / bits] |= 1UL << (numa_node % bits);
+    }
+  }
+
+  void *Allocate(size_t size) override {
+    size_t len = size + kHeaderSize;
+    size_t align = (huge_pages_ && len >= kHugePageSize) ? kHugePageSize
+                                                         : page_size_;
+    len = (len + align - 1) / align * align;
+
+    void *p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+    if (align == kHugePageSize)
+      madvise(p, len, MADV_HUGEPAGE);
+#endif
+
+#ifdef SYS_mbind
+    // The pages are not faulted in yet, they are all placed on the node. A
+    // failure, e.g on a kernel without NUMA, leaves the chunk usable under
+    // the default policy.
+    if (!node_mask_.empty()) {
+      syscall(SYS_mbind, p, len, kMpolBind, node_mask_.data(),
+              node_mask_.size() * sizeof(unsigned long) * 8 + 1, 0);
+    }
+#endif
+
+    *static_cast<size_t *>(p) = len;
+    return static_cast<char *>(p) + kHeaderSize;
+  }
+
+  void Deallocate(void *p) override {
+    if (p == nullptr)
+      return;
+    char *base = static_cast<char *>(p) - kHeaderSize;
+    munmap(base, *reinterpret_cast<size_t *>(base));
+  }
+
+  const char *Name() const override {
+    return "lessdb.NumaAllocator";
+  }
+
+ private:
+  const bool huge_pages_;
+  const size_t page_size_;
+  std::vector<unsigned long> node_mask_;  // empty if not bound
+};
+
+}  // anonymous namespace
+
+Allocator *NewNumaAllocator(int numa_node, bool huge_pages) {
+  return new NumaAllocator(numa_node, huge_pages);
+}
+
+}  // namespace lessdb
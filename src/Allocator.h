@@ -0,0 +1,63 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace lessdb {
+
+// Allocator provides the memory the database holds for long: the blocks of
+// the memtable arenas, and the buffers of the sstable blocks read from file,
+// which stay in the block cache. By default they come from the heap, an
+// Allocator set in Options::allocator places them instead, e.g on the NUMA
+// node the database is pinned to, or on huge pages.
+//
+// Must be thread-safe.
+class Allocator {
+ public:
+  virtual ~Allocator() = default;
+
+  // Returns a chunk of at least "size" bytes, aligned for any type like
+  // malloc. Throws std::bad_alloc if out of memory.
+  virtual void *Allocate(size_t size) = 0;
+
+  // Frees a chunk returned by Allocate.
+  virtual void Deallocate(void *p) = 0;
+
+  // The name of the allocator, for logging.
+  virtual const char *Name() const = 0;
+};
+
+// Returns an allocator mapping every chunk by mmap, bound to NUMA node
+// "numa_node" by mbind(MPOL_BIND) before it's first touched, or left to the
+// default policy if numa_node is negative. If huge_pages is set, chunks of
+// 2MB or more are advised to be backed by transparent huge pages.
+//
+// Each chunk is a mapping of its own, which costs a system call to allocate
+// and free, so it suits large chunks: memtable arena blocks are 2MB when an
+// allocator is set, and sstable blocks should be sized accordingly.
+//
+// The caller should delete the result when it's no longer needed.
+Allocator *NewNumaAllocator(int numa_node, bool huge_pages);
+
+}  // namespace lessdb
@@ -0,0 +1,123 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "BlobFile.h"
+#include "CacheStrategy.h"
+#include "Coding.h"
+#include "DataView.h"
+#include "FileName.h"
+#include "FileUtils.h"
+#include "LogReader.h"
+#include "LogWriter.h"
+
+namespace lessdb {
+
+void BlobIndex::EncodeTo(std::string *dst) const {
+  coding::AppendVar64(dst, file_number);
+  coding::AppendVar64(dst, offset);
+  coding::AppendVar64(dst, size);
+}
+
+bool BlobIndex::DecodeFrom(Slice input) {
+  return coding::ParseVar64(&input, &file_number) &&
+         coding::ParseVar64(&input, &offset) &&
+         coding::ParseVar64(&input, &size) && input.Empty();
+}
+
+BlobFileBuilder::BlobFileBuilder(uint64_t number, WritableFile *file)
+    : number_(number), writer_(new log::Writer(file)), num_blobs_(0) {}
+
+BlobFileBuilder::~BlobFileBuilder() = default;
+
+Status BlobFileBuilder::Add(const Slice &value, BlobIndex *index) {
+  index->file_number = number_;
+  index->offset = writer_->Offset();
+  Status s = writer_->WriteRecord(value);
+  index->size = writer_->Offset() - index->offset;
+  if (s)
+    num_blobs_++;
+  return s;
+}
+
+uint64_t BlobFileBuilder::FileSize() const {
+  return writer_->Offset();
+}
+
+BlobFileCache::BlobFileCache(const std::string &dbname, FileFactory *factory,
+                             int entries)
+    : dbname_(dbname),
+      factory_(factory),
+      cache_(CacheStrategy::LRU(entries, 0)) {}
+
+BlobFileCache::~BlobFileCache() = default;
+
+Status BlobFileCache::Get(const ReadOptions &options, const BlobIndex &index,
+                          std::string *value) {
+  char key_buf[sizeof(index.file_number)];
+  DataView(key_buf).WriteNum(index.file_number);
+  const Slice key(key_buf, sizeof(key_buf));
+
+  Status s;
+  std::shared_ptr<RandomAccessFile> file;
+  CacheStrategy::HANDLE handle = cache_->Lookup(key);
+  if (handle) {
+    file = *static_cast<std::shared_ptr<RandomAccessFile> *>(
+        cache_->Value(handle));
+    cache_->Release(handle);
+  } else {
+    file.reset(factory_->NewRandomAccessFile(
+        BlobFileName(dbname_, index.file_number), &s));
+    if (!s)
+      return s;
+    cache_->Release(cache_->Insert(
+        key, new std::shared_ptr<RandomAccessFile>(file), 1,
+        &DeleteCacheValue<std::shared_ptr<RandomAccessFile>>));
+  }
+
+  std::string buf;
+  if (!file->HasStableContents())
+    buf.resize(index.size);
+  Slice extent;
+  s = file->Read(index.size, index.offset, &buf[0], &extent);
+  if (!s)
+    return s;
+  if (extent.Len() != index.size)
+    return Status::Corruption("truncated blob in file ") << index.file_number;
+
+  Slice record;
+  std::string scratch;
+  s = log::ReadRecordAt(extent.RawData(), extent.Len(), index.offset,
+                        options.verify_checksums, &record, &scratch);
+  if (!s)
+    return s << " in blob file " << index.file_number;
+  value->assign(record.RawData(), record.Len());
+  return s;
+}
+
+void BlobFileCache::Evict(uint64_t number) {
+  char key_buf[sizeof(number)];
+  DataView(key_buf).WriteNum(number);
+  cache_->Erase(Slice(key_buf, sizeof(key_buf)));
+}
+
+}  // namespace lessdb
@@ -0,0 +1,124 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "Disallowcopying.h"
+#include "Options.h"
+#include "Slice.h"
+#include "Status.h"
+
+namespace lessdb {
+
+class CacheStrategy;
+class FileFactory;
+class WritableFile;
+
+namespace log {
+class Writer;
+}  // namespace log
+
+// BlobIndex is the value of a kTypeBlobIndex entry of an sstable, which
+// refers to the actual value stored in a blob file: the extent of its record
+// in the file. @see Options::min_blob_size
+struct BlobIndex {
+  uint64_t file_number;
+  uint64_t offset;
+  uint64_t size;
+
+  BlobIndex() : file_number(0), offset(0), size(0) {}
+
+  // index := file_number offset size, each a varint64.
+  void EncodeTo(std::string *dst) const;
+
+  // Returns false if "input" is not a BlobIndex.
+  bool DecodeFrom(Slice input);
+};
+
+// BlobFileBuilder appends values to a blob file, each one as a record in the
+// log format (@see LogFormat.h), which checksums the value and splits it into
+// fragments at the block boundaries.
+class BlobFileBuilder {
+  __DISALLOW_COPYING__(BlobFileBuilder);
+
+ public:
+  // Builds the blob file numbered "number" into *file, which must remain live
+  // while this builder is in use. The file is neither synced nor closed by
+  // the builder.
+  BlobFileBuilder(uint64_t number, WritableFile *file);
+
+  ~BlobFileBuilder();
+
+  // Appends "value", and stores its reference into *index.
+  Status Add(const Slice &value, BlobIndex *index);
+
+  uint64_t number() const {
+    return number_;
+  }
+
+  // Number of blobs added so far.
+  uint64_t NumBlobs() const {
+    return num_blobs_;
+  }
+
+  // Size of the file written so far.
+  uint64_t FileSize() const;
+
+ private:
+  const uint64_t number_;
+  std::unique_ptr<log::Writer> writer_;
+  uint64_t num_blobs_;
+};
+
+// BlobFileCache keeps a bounded set of the blob files of a database open, keyed
+// by file number in an LRU CacheStrategy, like TableCache does for the
+// sstables, and reads the values referenced by BlobIndexes from them.
+//
+// Thread-safe.
+class BlobFileCache {
+  __DISALLOW_COPYING__(BlobFileCache);
+
+ public:
+  // *factory must remain live while this BlobFileCache is in use.
+  BlobFileCache(const std::string &dbname, FileFactory *factory, int entries);
+
+  ~BlobFileCache();
+
+  // Reads the value referenced by "index" into *value. The record is
+  // verified if options.verify_checksums is set.
+  Status Get(const ReadOptions &options, const BlobIndex &index,
+             std::string *value);
+
+  // Closes the blob file "number", e.g once the file is deleted.
+  void Evict(uint64_t number);
+
+ private:
+  const std::string dbname_;
+  FileFactory *const factory_;
+  std::unique_ptr<CacheStrategy> cache_;
+};
+
+}  // namespace lessdb
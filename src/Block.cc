@@ -20,30 +20,155 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <folly/Likely.h>
+
 #include "Block.h"
+#include "BlockHashIndex.h"
 #include "TableFormat.h"
 #include "Coding.h"
 #include "DataView.h"
 #include "Comparator.h"
+#include "InternalKey.h"
 
 namespace lessdb {
 
+// Decodes the header of the entry at p, the shared, unshared and value
+// lengths, returns the pointer to the key delta, or NULL if the header is
+// malformed. The three lengths are most often under 128, i.e 1 byte each,
+// which is decoded at once.
+static inline const char *DecodeEntry(const char *p, const char *limit,
+                                      uint32_t *shared, uint32_t *unshared,
+                                      uint32_t *value_len) {
+  if (LIKELY(limit - p >= 3)) {
+    const uint8_t *q = reinterpret_cast<const uint8_t *>(p);
+    if (((q[0] | q[1] | q[2]) & 128) == 0) {
+      *shared = q[0];
+      *unshared = q[1];
+      *value_len = q[2];
+      return p + 3;
+    }
+  }
+  if ((p = coding::GetVar32Ptr(p, limit, shared)) == nullptr ||
+      (p = coding::GetVar32Ptr(p, limit, unshared)) == nullptr ||
+      (p = coding::GetVar32Ptr(p, limit, value_len)) == nullptr)
+    return nullptr;
+  return p;
+}
+
 Block::Block(const BlockContent &content, const Comparator *comp)
-    : data_(content.data.RawData()), size_(content.data.Len()), comp_(comp) {
+    : data_(content.data.RawData()),
+      size_(content.data.Len()),
+      comp_(comp),
+      buckets_(nullptr),
+      num_buckets_(0),
+      owned_(content.heap_allocated),
+      allocator_(content.allocator),
+      order_(keyOrderOf(comp)) {
   num_restart_ = ConstDataView(data_ + size_ - 4).ReadNum<uint32_t>();
-  assert(size_ >= 4 * (num_restart_ + 1));
-  data_end_ = data_ + size_ - 4 * (num_restart_ + 1);
+  const char *restarts = data_ + size_ - 4;
+  if (num_restart_ & block_hash_index::kHashIndexFlag) {
+    num_restart_ &= ~block_hash_index::kHashIndexFlag;
+    num_buckets_ = ConstDataView(restarts - sizeof(uint16_t))
+                       .ReadNum<uint16_t>();
+    assert(size_ >= 4 * (num_restart_ + 1) + sizeof(uint16_t) + num_buckets_);
+    restarts -= sizeof(uint16_t) + num_buckets_;
+    buckets_ = reinterpret_cast<const uint8_t *>(restarts);
+  }
+  assert(restarts - data_ >= 4 * num_restart_);
+  data_end_ = restarts - 4 * num_restart_;
+}
+
+Block::KeyOrder Block::keyOrderOf(const Comparator *comp) {
+  if (comp == NewBytewiseComparator())
+    return kBytewiseOrder;
+  // The blocks of the sstables built from memtables are keyed by internal
+  // keys, checked once per block rather than once per comparison.
+  auto icmp = dynamic_cast<const InternalKeyComparator *>(comp);
+  if (icmp && icmp->IsBytewise())
+    return kInternalBytewiseOrder;
+  return kCustomOrder;
+}
+
+uint64_t Block::keyPrefix(const Slice &key) const {
+  if (order_ == kInternalBytewiseOrder) {
+    assert(key.Len() >= 8);
+    return BytewiseKeyPrefix(Slice(key.RawData(), key.Len() - 8));
+  }
+  return BytewiseKeyPrefix(key);
+}
+
+template <Block::KeyOrder kOrder>
+inline int Block::compare(const Slice &a, const Slice &b) const {
+  PERF_COUNTER_ADD(user_key_comparison_count, 1);
+  switch (kOrder) {
+    case kBytewiseOrder:
+      return a.Compare(b);
+    case kInternalBytewiseOrder:
+      return InternalKeyComparator::BytewiseCompare(a, b);
+    default:
+      return comp_->Compare(a, b);
+  }
 }
 
 Block::ConstIterator Block::find(const Slice &target) const {
+  if (buckets_) {
+    uint8_t restart =
+        buckets_[block_hash_index::Hash(target) % num_buckets_];
+    if (restart == block_hash_index::kNoEntry)
+      return end();
+    if (restart != block_hash_index::kCollision && restart < num_restart_) {
+      switch (order_) {
+        case kBytewiseOrder:
+          return findInRestartInterval<kBytewiseOrder>(restart, target);
+        case kInternalBytewiseOrder:
+          return findInRestartInterval<kInternalBytewiseOrder>(restart,
+                                                               target);
+        default:
+          return findInRestartInterval<kCustomOrder>(restart, target);
+      }
+    }
+  }
+
   auto it = lower_bound(target);
-  return comp_->Compare(it.Key(), target) != 0 ? end() : it;
+  if (it == end())
+    return it;
+  int r;
+  switch (order_) {
+    case kBytewiseOrder:
+      r = compare<kBytewiseOrder>(it.Key(), target);
+      break;
+    case kInternalBytewiseOrder:
+      r = compare<kInternalBytewiseOrder>(it.Key(), target);
+      break;
+    default:
+      r = compare<kCustomOrder>(it.Key(), target);
+  }
+  return r == 0 ? it : end();
 }
 
 Block::ConstIterator Block::begin() const {
   return ConstIterator(data_, this, 0);
 }
 
+Block::ConstIterator Block::RestartPointOf(const ConstIterator &it) const {
+  assert(it.block_ == this);
+  // Restart points are offsets of entries, it.buf_ is past the header of
+  // its entry.
+  const uint32_t pos = static_cast<uint32_t>(it.buf_ - data_);
+  int lb = 0, rb = num_restart_;
+  while (rb - lb > 1) {
+    int mid = (lb + rb) / 2;
+    if (restartPoint(mid) < pos) {
+      lb = mid;
+    } else {
+      rb = mid;
+    }
+  }
+  uint32_t restart = restartPoint(lb);
+  return ConstIterator(data_ + restart, this, restart);
+}
+
 Block::ConstIterator Block::end() const {
   // TODO: restart_pos of end iterator.
   return ConstIterator(data_end_, this, 0);
@@ -51,8 +176,7 @@ Block::ConstIterator Block::end() const {
 
 uint32_t Block::restartPoint(int id) const {
   assert(id <= num_restart_);
-  uint32_t r = ConstDataView(data_)
-                   .ReadNum<uint32_t>(size_ - 4 * (num_restart_ - id + 1));
+  uint32_t r = ConstDataView(data_end_).ReadNum<uint32_t>(4 * id);
   assert(r <= data_end_ - data_);
   return r;
 }
@@ -61,73 +185,156 @@ Slice Block::keyAtRestartPoint(int id) const {
   uint32_t shared, unshared, value_len;
   uint32_t pos = restartPoint(id);
 
-  Slice buf(data_ + pos, data_end_ - data_ - pos);
-  coding::GetVar32(&buf, &shared);
+  const char *p = DecodeEntry(data_ + pos, data_end_, &shared, &unshared,
+                              &value_len);
+  assert(p != nullptr);
   assert(shared == 0);  // no shared bytes at restart point
-  coding::GetVar32(&buf, &unshared);
-  coding::GetVar32(&buf, &value_len);
-  return Slice(buf.RawData(), unshared);
+  return Slice(p, unshared);
+}
+
+void Block::BuildRestartPrefixes() {
+  if (restart_prefixes_ || order_ == kCustomOrder)
+    return;
+
+  restart_prefixes_.reset(new uint64_t[num_restart_]);
+  for (uint32_t i = 0; i < num_restart_; i++)
+    restart_prefixes_[i] = keyPrefix(keyAtRestartPoint(i));
+}
+
+template <Block::KeyOrder kOrder>
+inline bool Block::restartKeyNotLess(int id, const Slice &target,
+                                     uint64_t prefix) const {
+  if (restart_prefixes_) {
+    // Resolved without touching the entry unless the prefixes tie.
+    if (restart_prefixes_[id] != prefix)
+      return restart_prefixes_[id] > prefix;
+  }
+  return compare<kOrder>(keyAtRestartPoint(id), target) >= 0;
 }
 
 Block::ConstIterator Block::lower_bound(const Slice &target) const {
+  switch (order_) {
+    case kBytewiseOrder:
+      return lowerBound<kBytewiseOrder>(target);
+    case kInternalBytewiseOrder:
+      return lowerBound<kInternalBytewiseOrder>(target);
+    default:
+      return lowerBound<kCustomOrder>(target);
+  }
+}
+
+template <Block::KeyOrder kOrder>
+Block::ConstIterator Block::lowerBound(const Slice &target) const {
   // Binary search in restart array to find the lastest restart point
   // with a key < target
 
+  uint64_t prefix = restart_prefixes_ ? keyPrefix(target) : 0;
+
   // in range [0, num_restart)
   int lb = 0, rb = num_restart_, mid = lb;
   while (rb - lb > 1) {
     mid = (lb + rb) / 2;
-    if (comp_->Compare(keyAtRestartPoint(mid), target) >= 0) {
+    if (restartKeyNotLess<kOrder>(mid, target, prefix)) {
       rb = mid;
     } else {
       lb = mid;
     }
   }
 
-  if (comp_->Compare(keyAtRestartPoint(lb), target) > 0) {
-    assert(lb == 0 && rb == lb + 1);
-    return end();
-  }
+  // If target is less than the key at restart point 0, the lower bound is
+  // begin(), which is found by the linear search below as well.
 
   // Searches from the restart point.
 
   uint32_t pos = restartPoint(lb);
   auto it = ConstIterator(data_ + pos, this, pos);
   for (; it != end(); it++) {
-    if (comp_->Compare(it.Key(), target) >= 0)
+    if (compare<kOrder>(it.Key(), target) >= 0)
       break;
   }
   return it;
 }
 
+template <Block::KeyOrder kOrder>
+Block::ConstIterator Block::findInRestartInterval(uint32_t restart,
+                                                  const Slice &target) const {
+  // The entries of the interval end at the next restart point.
+  const char *limit =
+      restart + 1 < num_restart_ ? data_ + restartPoint(restart + 1)
+                                 : data_end_;
+  uint32_t pos = restartPoint(restart);
+  for (auto it = ConstIterator(data_ + pos, this, pos); it.buf_ < limit;
+       it++) {
+    int r = compare<kOrder>(it.Key(), target);
+    if (r >= 0)
+      return r == 0 ? it : end();
+  }
+  return end();
+}
+
 // After construction, buf_ must points at the start of key_delta.
 // @param p points at the start of the entry.
 BlockConstIterator::BlockConstIterator(const char *p, const Block *block,
                                        uint32_t restart)
-    : last_key_(nullptr), restart_pos_(restart), block_(block) {
+    : block_(block), restart_pos_(restart), key_in_buf_(false) {
   init(p);
+  if (buf_ == block_->data_end_ || shared_ == 0)
+    return;
+
+  // The entry shares a prefix with its previous one, rebuild the key by
+  // scanning from the restart point.
+  init(block_->data_ + restart_pos_);
+  while (buf_ != block_->data_end_ && buf_ + unshared_ + value_len_ <= p)
+    increment();
+  assert(buf_ == block_->data_end_ || buf_ > p);
+}
+
+BlockConstIterator::BlockConstIterator()
+    : buf_(nullptr),
+      buf_len_(0),
+      shared_(0),
+      unshared_(0),
+      value_len_(0),
+      block_(nullptr),
+      restart_pos_(0),
+      key_in_buf_(false) {}
+
+BlockConstIterator::BlockConstIterator(const BlockConstIterator &rhs)
+    : buf_(rhs.buf_),
+      buf_len_(rhs.buf_len_),
+      shared_(rhs.shared_),
+      unshared_(rhs.unshared_),
+      value_len_(rhs.value_len_),
+      block_(rhs.block_),
+      restart_pos_(rhs.restart_pos_),
+      stat_(rhs.stat_),
+      key_in_buf_(rhs.key_in_buf_) {
+  if (key_in_buf_)
+    key_buf_ = rhs.key_buf_;
+}
+
+BlockConstIterator &BlockConstIterator::operator=(
+    const BlockConstIterator &rhs) {
+  buf_ = rhs.buf_;
+  buf_len_ = rhs.buf_len_;
+  shared_ = rhs.shared_;
+  unshared_ = rhs.unshared_;
+  value_len_ = rhs.value_len_;
+  block_ = rhs.block_;
+  restart_pos_ = rhs.restart_pos_;
+  stat_ = rhs.stat_;
+  key_in_buf_ = rhs.key_in_buf_;
+  if (key_in_buf_ && this != &rhs)
+    key_buf_.assign(rhs.key_buf_);
+  return *this;
 }
 
-// lazy construction of key, concatenate the shared part and unshared part only
-// when necessary.
 Slice BlockConstIterator::Key() const {
   // must not an end iterator.
   assert(buf_ != block_->data_end_);
-  if (!key_.empty())
-    return key_;
-
-  if (!last_key_) {
-    auto it =
-        BlockConstIterator(block_->data_ + restart_pos_, block_, restart_pos_);
-    while (it.buf_ < buf_)
-      it++;
-    assert(it.buf_ == buf_);
-  }
-
-  key_.reserve(shared_ + unshared_);
-  key_.append(last_key_, shared_);
-  key_.append(buf_, unshared_);
-  return key_;
+  if (key_in_buf_)
+    return Slice(key_buf_.data(), key_buf_.size());
+  return Slice(buf_, unshared_);
 }
 
 Slice BlockConstIterator::Value() const {
@@ -135,12 +342,34 @@ Slice BlockConstIterator::Value() const {
 }
 
 void BlockConstIterator::increment() {
-  Slice buf(buf_, buf_len_);
-  last_key_ = buf_;
-  buf.Skip(unshared_);
-  buf.Skip(value_len_);
-  init(buf.RawData());
-  key_.clear();
+  bool prev_in_buf = key_in_buf_;
+  Slice prev_key(buf_, unshared_);
+
+  init(buf_ + unshared_ + value_len_);
+  if (buf_ != block_->data_end_)
+    buildKey(prev_in_buf, prev_key);
+}
+
+void BlockConstIterator::buildKey(bool prev_in_buf, const Slice &prev_key) {
+  if (shared_ == 0) {
+    // fast path: the key is stored contiguously in the block.
+    key_in_buf_ = false;
+    return;
+  }
+
+  size_t prev_len = prev_in_buf ? key_buf_.size() : prev_key.Len();
+  if (UNLIKELY(shared_ > prev_len)) {
+    stat_ = Status::Corruption("BlockConstIterator: bad shared length");
+    shared_ = static_cast<uint32_t>(prev_len);
+  }
+
+  if (prev_in_buf) {
+    key_buf_.resize(shared_);
+  } else {
+    key_buf_.assign(prev_key.RawData(), shared_);
+  }
+  key_buf_.append(buf_, unshared_);
+  key_in_buf_ = true;
 }
 
 bool BlockConstIterator::equal(const Block::ConstIterator &other) const {
@@ -151,24 +380,23 @@ void BlockConstIterator::init(const char *p) {
   size_t len = (block_->data_end_ - p);
   assert(len >= 0);
   if (len > 0) {
-    Slice buf(p, len);
-    try {
-      coding::GetVar32(&buf, &shared_);
-      coding::GetVar32(&buf, &unshared_);
-      coding::GetVar32(&buf, &value_len_);
-    } catch (std::exception &e) {
-      stat_ = Status::Corruption("BlockConstIterator::init(): ")
-              << std::string(e.what());
+    const char *q = DecodeEntry(p, block_->data_end_, &shared_, &unshared_,
+                                &value_len_);
+    if (UNLIKELY(q == nullptr)) {
+      stat_ = Status::Corruption("BlockConstIterator::init(): bad entry");
+      // Stop iterating at a corrupted entry.
+      buf_ = block_->data_end_;
+      buf_len_ = 0;
       return;
     }
 
-    // buf is now pointed at key_delta
-    buf_ = buf.RawData();
-    buf_len_ = buf.Len();
+    // q is now pointed at key_delta
+    buf_ = q;
+    buf_len_ = static_cast<size_t>(block_->data_end_ - q);
 
     // restart_pos doesn't have to be exactly pointing at a restart point, if
-    // the unshared is 0, then a traversal can start from here.
-    if (unshared_ == 0) {
+    // the shared is 0, then a traversal can start from here.
+    if (shared_ == 0) {
       // restart position is the start of the entry
       restart_pos_ = static_cast<uint32_t>(p - block_->data_);
     }
@@ -23,16 +23,19 @@
 #pragma once
 
 #include <cstddef>
+#include <memory>
 #include <boost/smart_ptr/intrusive_ref_counter.hpp>
 
+#include "Comparator.h"
 #include "IteratorFacade.h"
+#include "PerfContext.h"
 #include "Status.h"
+#include "TableFormat.h"
 #include "Disallowcopying.h"
 
 namespace lessdb {
 
 class BlockContent;
-class Comparator;
 class Block;
 
 class BlockConstIterator;
@@ -44,6 +47,21 @@ class BlockConstIterator : public BlockConstIteratorFacade {
   friend class Block;
 
  public:
+  // A singular iterator of no block, which may only be assigned to or
+  // destroyed.
+  BlockConstIterator();
+
+  // Copying an iterator copies the key buffer only if the key is not
+  // referenced from the block in-place.
+  BlockConstIterator(const BlockConstIterator& rhs);
+
+  BlockConstIterator& operator=(const BlockConstIterator& rhs);
+
+  BlockConstIterator(BlockConstIterator&&) = default;
+
+  BlockConstIterator& operator=(BlockConstIterator&&) = default;
+
+  // The returned slice is valid until the iterator is modified.
   Slice Key() const;
 
   Slice Value() const;
@@ -66,12 +84,16 @@ class BlockConstIterator : public BlockConstIteratorFacade {
   // @param restart: index of the nearest restart point before p.
   BlockConstIterator(const char* p, const Block* block, uint32_t restart);
 
+  // Decodes the entry header at p.
   void init(const char* p);
 
+  // Reconstructs the key of the current entry, the key of the previous entry
+  // is key_buf_ if prev_in_buf is true, otherwise prev_key.
+  void buildKey(bool prev_in_buf, const Slice& prev_key);
+
  private:
   const char* buf_;
   size_t buf_len_;
-  const char* last_key_;
   uint32_t shared_;
   uint32_t unshared_;
   uint32_t value_len_;
@@ -79,14 +101,21 @@ class BlockConstIterator : public BlockConstIteratorFacade {
   uint32_t restart_pos_;
   Status stat_;  // TODO: Store errors into stat_.
 
-  mutable std::string key_;
+  // The full key of the current entry is built in key_buf_ incrementally as
+  // the iterator advances, the buffer is reused across entries. For an entry
+  // shares nothing with its previous one (e.g at a restart point), the key is
+  // referenced in-place in the block, i.e key_in_buf_ is false.
+  std::string key_buf_;
+  bool key_in_buf_;
 };
 
 // Use reference counting to share Blocks between block cache and SSTable.
+// The counter is atomic, since a cached block is shared by the iterators of
+// all the reader threads.
 // @see TwoLevelIterator::~TwoLevelIterator
 // @see SSTable::ObtainBlockByIndexIterator
 using BlockRefCounterMixin =
-    boost::intrusive_ref_counter<Block, boost::thread_unsafe_counter>;
+    boost::intrusive_ref_counter<Block, boost::thread_safe_counter>;
 
 /// Block represents a block in SSTable, it provides read-only operation
 /// (declaring Block without const specifier is fine).
@@ -97,18 +126,30 @@ class Block : public BlockRefCounterMixin {
   Block(const BlockContent& content, const Comparator* comp);
 
   // empty block
-  Block() = default;
-
-  // Block data is allocated by new[].
+  Block()
+      : data_(nullptr),
+        comp_(nullptr),
+        size_(0),
+        num_restart_(0),
+        buckets_(nullptr),
+        num_buckets_(0),
+        owned_(false),
+        allocator_(nullptr),
+        order_(kCustomOrder) {}
+
+  // Block data read from file is allocated by new[], or Options::allocator.
   // @see ReadBlockFromFile in BlockUtils.h
   ~Block() {
-    if (!data_)
-      delete[] data_;
+    if (owned_)
+      BlockDeleter{allocator_}(data_);
   }
 
   friend class BlockConstIterator;
   typedef BlockConstIterator ConstIterator;
 
+  // Returns an iterator to the entry of "key", or end() if there's none.
+  // A block with a hash index looks the key up there first, and searches
+  // just the restart interval it points to.
   ConstIterator find(const Slice& key) const;
 
   ConstIterator begin() const;
@@ -120,21 +161,92 @@ class Block : public BlockRefCounterMixin {
   // not considered to go before val.
   ConstIterator lower_bound(const Slice& key) const;
 
+  // Returns an iterator to the last restart point at or before "it", from
+  // which the entries up to "it" can be decoded in order, e.g the
+  // delta-encoded values of an index block.
+  // REQUIRES: "it" is an iterator of this block.
+  ConstIterator RestartPointOf(const ConstIterator& it) const;
+
   const char* RawData() const {
     return data_;
   }
 
+  // Size of the block contents, excluding the block trailer.
+  size_t Size() const {
+    return size_;
+  }
+
+  // Builds an array of the first 8 bytes of every restart key, so that most
+  // steps of the binary search in lower_bound compare integers instead of
+  // decoding the restart entry and calling the comparator. The array costs 8
+  // bytes per restart point, and is only built for the bytewise comparator,
+  // whose order agrees with the integer order of the prefixes, or for the
+  // internal keys of bytewise user keys, whose prefixes are taken from the
+  // user keys (the keys minus their 8-byte tags).
+  // It's worth building for blocks that are searched repeatedly, e.g blocks
+  // in the block cache.
+  // REQUIRES: the block is not yet shared with other threads.
+  void BuildRestartPrefixes();
+
+ public:
+  bool TEST_HasRestartPrefixes() const {
+    return restart_prefixes_ != nullptr;
+  }
+
  private:
+  // The order of the keys, which picks the search path and how the prefixes
+  // of the keys are taken.
+  enum KeyOrder {
+    kCustomOrder,            // any other comparator
+    kBytewiseOrder,          // NewBytewiseComparator()
+    kInternalBytewiseOrder,  // InternalKeyComparator of a bytewise user order
+  };
+
+  static KeyOrder keyOrderOf(const Comparator* comp);
+
+  // Returns the prefix of key as stored in restart_prefixes_.
+  uint64_t keyPrefix(const Slice& key) const;
+
   uint32_t restartPoint(int id) const;
 
   Slice keyAtRestartPoint(int id) const;
 
+  // Search paths are instantiated once per KeyOrder: the bytewise orders
+  // inline the comparison of the keys, kCustomOrder calls the virtual
+  // comp_->Compare. The public methods pick one by order_.
+
+  template <KeyOrder kOrder>
+  int compare(const Slice& a, const Slice& b) const;
+
+  // Returns true if key at restart point "id" >= target, prefix is the prefix
+  // of target encoded as in restart_prefixes_.
+  template <KeyOrder kOrder>
+  bool restartKeyNotLess(int id, const Slice& target, uint64_t prefix) const;
+
+  template <KeyOrder kOrder>
+  ConstIterator lowerBound(const Slice& target) const;
+
+  // Searches the restart interval "restart" for the entry of target.
+  template <KeyOrder kOrder>
+  ConstIterator findInRestartInterval(uint32_t restart,
+                                      const Slice& target) const;
+
  private:
   const char* const data_;
   const char* data_end_;  // points at the first byte of the trailer
   const Comparator* comp_;
   size_t size_;
   uint32_t num_restart_;
+  const uint8_t* buckets_;  // Buckets of the hash index, NULL if none.
+  uint32_t num_buckets_;
+  bool owned_;  // Whether data_ is owned by this block.
+  Allocator* allocator_;  // Which allocated data_, NULL for new[].
+  KeyOrder order_;
+
+  // restart_prefixes_[i] is keyPrefix of the key at restart point i, i.e its
+  // first 8 bytes zero-padded and read as a big-endian integer. NULL if not
+  // built.
+  std::unique_ptr<uint64_t[]> restart_prefixes_;
 };
 
 }  // namespace lessdb
\ No newline at end of file
@@ -22,12 +22,21 @@
 
 #pragma once
 
-#include <vector>
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "Disallowcopying.h"
 #include "Slice.h"
 #include "BlockBuilder.h"
+#include "BlockHashIndex.h"
 #include "Options.h"
 #include "DataView.h"
 #include "Coding.h"
@@ -51,38 +60,73 @@ struct Options;
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+// A block built with a hash index has it between restarts and num_restarts.
+// @see BlockHashIndex.h
 //
 class BlockBuilder {
   __DISALLOW_COPYING__(BlockBuilder);
 
  public:
   BlockBuilder(const Options *option)
-      : finished_(false), option_(option), count_(0) {
+      : BlockBuilder(option, option->block_restart_interval) {}
+
+  // Builds a block with a restart point every restart_interval keys instead
+  // of option->block_restart_interval, e.g an index block. If hash_ratio > 0,
+  // the block has a hash index of hash_ratio keys per bucket.
+  BlockBuilder(const Options *option, int restart_interval,
+               double hash_ratio = 0)
+      : finished_(false),
+        option_(option),
+        restart_interval_(restart_interval),
+        hash_ratio_(hash_ratio),
+        count_(0) {
+    // The contents are mostly flushed once they reach block_size, a block
+    // then grows its buffer once at most, for the entry and the trailer
+    // crossing the limit.
+    buf_.reserve(option->block_size);
     restarts_.push_back(0);
   }
 
   void Add(const Slice &key, const Slice &value) {
+    Add(key, value, value);
+  }
+
+  // Adds an entry whose value is delta_value, unless the entry starts a
+  // restart point, where value is stored in full. The entries can then be
+  // decoded from any restart point on.
+  // @see BlockHandle::EncodeDeltaToString
+  void Add(const Slice &key, const Slice &value, const Slice &delta_value) {
     assert(!finished_);
 
     size_t shared = 0;
-    if (count_ < option_->block_restart_interval) {
+    bool restart = buf_.empty();
+    if (count_ < restart_interval_) {
       shared = sharedPrefix(last_key_, key);
     } else {
       count_ = 0;
       restarts_.push_back(static_cast<uint32_t>(buf_.size()));
+      restart = true;
     }
 
     size_t unshared = key.Len() - shared;
+    const Slice &v = restart ? value : delta_value;
 
-    // append a new entry into buffer.
-    coding::AppendVar32(&buf_, static_cast<uint32_t>(shared));
-    coding::AppendVar32(&buf_, static_cast<uint32_t>(unshared));
-    coding::AppendVar32(&buf_, static_cast<uint32_t>(value.Len()));
+    // append a new entry into buffer, the three lengths are encoded at once.
+    char header[15];
+    char *p = coding::EncodeVar32(header, static_cast<uint32_t>(shared));
+    p = coding::EncodeVar32(p, static_cast<uint32_t>(unshared));
+    p = coding::EncodeVar32(p, static_cast<uint32_t>(v.Len()));
+    buf_.append(header, static_cast<size_t>(p - header));
     buf_.append(key.RawData() + shared, unshared);  // non-shared key_delta
-    buf_.append(value.RawData(), value.Len());      // value data
+    buf_.append(v.RawData(), v.Len());              // value data
+
+    if (hash_ratio_ > 0) {
+      hashes_.emplace_back(block_hash_index::Hash(key),
+                           static_cast<uint32_t>(restarts_.size() - 1));
+    }
 
     // update state
-    last_key_ = (key.RawData() + shared);
+    last_key_.assign(key.RawData(), key.Len());
     count_++;
   }
 
@@ -97,13 +141,21 @@ class BlockBuilder {
     // append the trailer of the block
 
     // append offset of restart points
-    for (int i = 0; i < restarts_.size(); ++i) {
-      DataView(ibuf).WriteNum(restarts_[i]);
-      buf_.append(ibuf, sizeof(uint32_t));
+    size_t pos = buf_.size();
+    buf_.resize(pos + restarts_.size() * sizeof(uint32_t));
+    for (size_t i = 0; i < restarts_.size(); ++i) {
+      DataView(&buf_[pos]).WriteNum(restarts_[i]);
+      pos += sizeof(uint32_t);
+    }
+
+    uint32_t num_restarts = static_cast<uint32_t>(restarts_.size());
+    if (hashIndexed()) {
+      appendHashIndex();
+      num_restarts |= block_hash_index::kHashIndexFlag;
     }
 
     // append num_restarts
-    DataView(ibuf).WriteNum(static_cast<uint32_t>(restarts_.size()));
+    DataView(ibuf).WriteNum(num_restarts);
     buf_.append(ibuf, sizeof(uint32_t));
 
     finished_ = true;
@@ -112,7 +164,10 @@ class BlockBuilder {
 
   // Current size of the block including the size of trailer.
   size_t Size() const {
-    return buf_.size() + (restarts_.size() + 1) * 4;
+    size_t size = buf_.size() + (restarts_.size() + 1) * 4;
+    if (hashIndexed())
+      size += numBuckets() + sizeof(uint16_t);
+    return size;
   }
 
   int Count() const {
@@ -125,17 +180,74 @@ class BlockBuilder {
     buf_.clear();
     last_key_.clear();
     restarts_.clear();
+    hashes_.clear();
     count_ = 0;
     restarts_.push_back(0);
   }
 
  private:
+  bool hashIndexed() const {
+    return !hashes_.empty() &&
+           restarts_.size() <= block_hash_index::kMaxRestarts;
+  }
+
+  size_t numBuckets() const {
+    double buckets = static_cast<double>(hashes_.size()) / hash_ratio_;
+    size_t n = static_cast<size_t>(buckets) + 1;
+    return std::min<size_t>(n, UINT16_MAX);
+  }
+
+  // Appends the buckets mapping the hashes of the keys to their restart
+  // points, followed by num_buckets.
+  void appendHashIndex() {
+    const size_t num_buckets = numBuckets();
+    std::string buckets(num_buckets,
+                        static_cast<char>(block_hash_index::kNoEntry));
+    for (const auto &h : hashes_) {
+      char &bucket = buckets[h.first % num_buckets];
+      uint8_t restart = static_cast<uint8_t>(bucket);
+      if (restart == block_hash_index::kNoEntry) {
+        bucket = static_cast<char>(h.second);
+      } else if (restart != h.second) {
+        bucket = static_cast<char>(block_hash_index::kCollision);
+      }
+    }
+    buf_.append(buckets);
+
+    char ibuf[sizeof(uint16_t)];
+    DataView(ibuf).WriteNum(static_cast<uint16_t>(num_buckets));
+    buf_.append(ibuf, sizeof(uint16_t));
+  }
+
   // Returns the length of identical prefix in k1, k2.
   // Returns 0 iff no shared prefix is found.
+  // The keys of a block share long prefixes, which are compared 16 bytes a
+  // step with SSE2, then 8 bytes a step, before the last few bytes.
   static inline size_t sharedPrefix(const Slice &k1, const Slice &k2) {
+    const char *a = k1.RawData();
+    const char *b = k2.RawData();
+    const size_t min_len = std::min(k1.Len(), k2.Len());
     size_t i = 0;
-    size_t min_len = std::min(k1.Len(), k2.Len());
-    while (i < min_len && k1[i] == k2[i])
+#if defined(__SSE2__)
+    for (; i + 16 <= min_len; i += 16) {
+      __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+      __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+      unsigned mask =
+          static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)));
+      if (mask != 0xffff)
+        return i + static_cast<size_t>(__builtin_ctz(~mask));
+    }
+#endif
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; i + 8 <= min_len; i += 8) {
+      uint64_t x, y;
+      memcpy(&x, a + i, sizeof(x));
+      memcpy(&y, b + i, sizeof(y));
+      if (x != y)
+        return i + static_cast<size_t>(__builtin_ctzll(x ^ y) / 8);
+    }
+#endif
+    while (i < min_len && a[i] == b[i])
       i++;
     return i;
   }
@@ -144,6 +256,11 @@ class BlockBuilder {
   // In use:
   // option->block_restart_interval
   const Options *option_;
+  int restart_interval_;
+  double hash_ratio_;  // Keys per bucket of the hash index, 0 if none.
+
+  // (hash, restart point) of the keys, if the block has a hash index.
+  std::vector<std::pair<uint32_t, uint32_t>> hashes_;
 
   std::string buf_;                 // Destination buffer.
   std::string last_key_;            // The last key that's added into block.
@@ -0,0 +1,89 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "Slice.h"
+
+namespace lessdb {
+
+// A data block built with Options::data_block_hash_ratio has a hash index of
+// its keys between the restart array and num_restarts:
+//     buckets:     uint8[num_buckets]
+//     num_buckets: uint16
+// and kHashIndexFlag set in num_restarts. buckets[Hash(key) % num_buckets] is
+// the restart point whose interval holds key, kNoEntry if no key of the block
+// hashes there, or kCollision if keys of different intervals do.
+// @see BlockBuilder::Finish
+// @see Block::find
+namespace block_hash_index {
+
+static const uint8_t kNoEntry = 255;
+static const uint8_t kCollision = 254;
+
+// The restart points are indexed by a byte, the blocks with more of them are
+// built without the hash index.
+static const uint32_t kMaxRestarts = 253;
+
+static const uint32_t kHashIndexFlag = 1u << 31;
+
+// Similar to murmur hash, with a fixed seed.
+inline uint32_t Hash(const Slice &key) {
+  const uint32_t seed = 0x5bd1e995;
+  const uint32_t m = 0xc6a4a793;
+  const char *data = key.RawData();
+  const char *limit = data + key.Len();
+  uint32_t h = static_cast<uint32_t>(seed ^ (key.Len() * m));
+
+  // Pick up four bytes at a time
+  while (data + 4 <= limit) {
+    uint32_t w;
+    memcpy(&w, data, sizeof(w));
+    data += 4;
+    h += w;
+    h *= m;
+    h ^= (h >> 16);
+  }
+
+  // Pick up remaining bytes
+  switch (limit - data) {
+    case 3:
+      h += static_cast<uint8_t>(data[2]) << 16;
+    // fall through
+    case 2:
+      h += static_cast<uint8_t>(data[1]) << 8;
+    // fall through
+    case 1:
+      h += static_cast<uint8_t>(data[0]);
+      h *= m;
+      h ^= (h >> 24);
+      break;
+  }
+  return h;
+}
+
+}  // namespace block_hash_index
+
+}  // namespace lessdb
@@ -22,65 +22,160 @@
 
 #pragma once
 
-#include <boost/crc.hpp>
+#include <memory>
 
-#include "BlockUtils.h"
+#include "Compression.h"
+#include "Crc32c.h"
 #include "FileUtils.h"
 #include "TableFormat.h"
 #include "Status.h"
 #include "DataView.h"
 #include "Options.h"
+#include "PerfContext.h"
 #include "Block.h"
 
 namespace lessdb {
 
-// Read the block identified by "handle" from "file".  On failure return non-OK.
-// On success read the data and return OK.
-// NOTE: The Block pointer returned should be deleted when it's not needed.
-inline Block *ReadBlockFromFile(RandomAccessFile *file,
-                                const ReadOptions &options,
-                                const Comparator *cmp,
-                                const BlockHandle &handle, Status &s) {
-  assert(handle.size > kBlockTrailerSize);
-
-  std::unique_ptr<char[]> p_block_buf(new char[handle.size]);
-  char *block_buf = p_block_buf.get();
+// Replace *content, the stored contents of a block compressed by "type",
+// with the uncompressed contents, allocated on heap.
+inline Status UncompressBlockContent(CompressionType type, const Slice &dict,
+                                     BlockContent *content) {
+  if (type == kNoCompression)
+    return Status::OK();
 
-  Slice data;
-  s = file->Read(handle.size, handle.offset - handle.size, block_buf, &data);
-
-  if (s) {
-    if (data.Len() < handle.size) {
-      s = Status::Corruption("ReadBlockFromFile: Truncated block size");
-    }
+  std::unique_ptr<char[]> uncompressed;
+  size_t n;
+  PerfTimer timer(&perf_context.block_decompress_nanos);
+  timer.Start();
+  Status s =
+      compression::Uncompress(type, dict, content->data, &uncompressed, &n);
+  timer.Stop();
+  if (content->heap_allocated)
+    BlockDeleter(content->allocator)(content->data.RawData());
+  content->allocator = nullptr;
+  if (!s) {
+    content->data = Slice();
+    content->heap_allocated = false;
+    return s;
   }
+  content->data = Slice(uncompressed.release(), n);
+  content->heap_allocated = true;
+  PERF_COUNTER_ADD(block_decompress_byte, n);
+  return Status::OK();
+}
 
-  if (!s) {
-    return nullptr;
+// Check "data", which was read from the file region identified by "handle"
+// into "*buf", and store the block contents excluding the trailer in
+// *content. If data points into "*buf", the ownership of "*buf" is moved to
+// content, i.e content->heap_allocated is set, along with the allocator of
+// "*buf". A compressed block is
+// uncompressed, with "dict" for a data block of a table that has a
+// compression dictionary, into a heap allocated content, unless "type" is
+// non-NULL, in which case the contents are left as stored, and the type of
+// their compression is stored in *type (see UncompressBlockContent).
+// On failure return non-OK.
+inline Status ParseBlockContent(const ReadOptions &options,
+                                const BlockHandle &handle, const Slice &data,
+                                BlockBuffer *buf, BlockContent *content,
+                                const Slice &dict = Slice(),
+                                CompressionType *type = nullptr) {
+  if (data.Len() < handle.size) {
+    return Status::Corruption("ReadBlockFromFile: Truncated block size");
   }
 
   uint64_t block_size = handle.size - kBlockTrailerSize;
+  const char *trailer = data.RawData() + block_size;
 
   if (options.verify_checksums) {
-    boost::crc_32_type crc32;
-
-    crc32.process_bytes(block_buf, block_size);
+    PERF_TIMER_GUARD(block_checksum_nanos);
+    uint32_t expected_crc =
+        ConstDataView(trailer + sizeof(uint8_t)).ReadNum<uint32_t>();
     uint32_t actual_crc =
-        ConstDataView(block_buf + block_size + sizeof(uint8_t))
-            .ReadNum<uint32_t>();
-    if (crc32.checksum() != actual_crc) {
-      s = Status::Corruption("ReadBlockFromFile: Block checksum mismatch");
-      return nullptr;
+        (static_cast<uint8_t>(trailer[0]) & kBlockTrailerCrc32cFlag)
+            ? crc32c::Value(data.RawData(), block_size)
+            : LegacyCrc32(data.RawData(), block_size);
+    if (actual_crc != expected_crc) {
+      return Status::Corruption("ReadBlockFromFile: Block checksum mismatch");
     }
   }
 
-  BlockContent blck_content;
-  blck_content.data = Slice(data.RawData(), data.Len() - kBlockTrailerSize);
-  Block *ret = new Block(blck_content, cmp);
+  content->data = Slice(data.RawData(), block_size);
+  content->heap_allocated = false;
+  content->allocator = nullptr;
+  if (*buf && data.RawData() == buf->get()) {
+    // The caller takes the ownership of *buf.
+    content->heap_allocated = true;
+    content->allocator = buf->get_deleter().allocator;
+    buf->release();
+  }
+
+  CompressionType compression = static_cast<CompressionType>(
+      static_cast<uint8_t>(trailer[0]) & kBlockTrailerCompressionMask);
+  if (type) {
+    *type = compression;
+    return Status::OK();
+  }
+  return UncompressBlockContent(compression, dict, content);
+}
 
-  p_block_buf.release();
-  s = Status::OK();
-  return ret;
+// Read the contents of the block identified by "handle" from "file" into
+// *content, excluding the block trailer, uncompressed by "dict" if needed
+// (see ParseBlockContent for "type"). On failure return non-OK.
+// The block is read into a buffer allocated by "allocator", or by new[] if
+// NULL. If content->heap_allocated is set, the caller takes the ownership of
+// content->data, which should be freed by BlockDeleter(content->allocator).
+// Otherwise content->data points into memory owned by "file".
+inline Status ReadBlockContent(RandomAccessFile *file,
+                               const ReadOptions &options,
+                               const BlockHandle &handle,
+                               BlockContent *content,
+                               const Slice &dict = Slice(),
+                               CompressionType *type = nullptr,
+                               Allocator *allocator = nullptr) {
+  assert(handle.size >= kBlockTrailerSize);
+
+  // Files handing out pointers into stable memory need no buffer, the block
+  // is then used in-place without being copied.
+  BlockBuffer p_block_buf;
+  if (!file->HasStableContents()) {
+    p_block_buf = NewBlockBuffer(handle.size, allocator);
+  }
+
+  Slice data;
+  Status s;
+  {
+    PERF_TIMER_GUARD(block_read_nanos);
+    s = file->Read(handle.size, handle.offset - handle.size,
+                   p_block_buf.get(), &data);
+  }
+  if (!s) {
+    return s;
+  }
+  PERF_COUNTER_ADD(block_read_count, 1);
+  PERF_COUNTER_ADD(block_read_byte, handle.size);
+  return ParseBlockContent(options, handle, data, &p_block_buf, content, dict,
+                           type);
+}
+
+// Read the block identified by "handle" from "file", into memory allocated by
+// "allocator" if non-NULL.  On failure return non-OK.
+// On success read the data and return OK.
+// NOTE: The Block pointer returned should be deleted when it's not needed.
+inline Block *ReadBlockFromFile(RandomAccessFile *file,
+                                const ReadOptions &options,
+                                const Comparator *cmp,
+                                const BlockHandle &handle, Status &s,
+                                const Slice &dict = Slice(),
+                                Allocator *allocator = nullptr) {
+  assert(handle.size > kBlockTrailerSize);
+
+  BlockContent blck_content;
+  s = ReadBlockContent(file, options, handle, &blck_content, dict, nullptr,
+                       allocator);
+  if (!s) {
+    return nullptr;
+  }
+  return new Block(blck_content, cmp);
 }
 
 }  // namespace lessdb
\ No newline at end of file
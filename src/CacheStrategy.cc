@@ -20,8 +20,11 @@
  * SOFTWARE.
  */
 
-#include <boost/any.hpp>
-#include <list>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <boost/functional/hash.hpp>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 
@@ -30,102 +33,767 @@
 
 namespace lessdb {
 
-class LRUCacheStrategy final : public CacheStrategy {
-  // Slice points at the data of key.
-  // NOTE: Iterator of std::list remains alive only until the element removed or
-  // the list destructed.
-  typedef std::list<Slice> CacheList;
+namespace {
+
+// An entry is a variable length heap-allocated structure. Entries are kept in
+// a circular doubly linked list ordered by access time, hits only relink the
+// entry to the front of the list, without any reallocation.
+//
+// An entry is referenced by the cache while it's in the cache, and by every
+// handle returned by Insert() and Lookup() until the handle is released, the
+// entry is deleted once it's unreferenced. The references are counted under
+// the mutex of the shard.
+struct LRUHandle {
+  void *value;
+  CacheStrategy::Deleter deleter;
+  LRUHandle *next;
+  LRUHandle *prev;
+  size_t charge;
+  uint32_t refs;
+  std::string key;
 
-  struct LRUHandle {
-    boost::any value;
-    CacheList::const_iterator where;
-  };
+  LRUHandle()
+      : value(nullptr),
+        deleter(nullptr),
+        next(this),
+        prev(this),
+        charge(0),
+        refs(0) {}
 
-  // key => LRUHandle mapping
-  typedef std::unordered_map<std::string, LRUHandle> HandleTable;
+  ~LRUHandle() {
+    if (deleter)
+      deleter(Slice(key), value);
+  }
+};
+
+struct SliceHasher {
+  size_t operator()(const Slice &s) const {
+    return boost::hash_range(s.RawData(), s.RawData() + s.Len());
+  }
+};
+
+inline size_t HashSlice(const Slice &s) {
+  return SliceHasher()(s);
+}
+
+// A single shard of the sharded cache.
+class LRUShard {
+  // key => LRUHandle mapping, the key Slice points at LRUHandle::key.
+  typedef std::unordered_map<Slice, LRUHandle *, SliceHasher> HandleTable;
 
  public:
-  ~LRUCacheStrategy() override = default;
+  LRUShard() : capacity_(0), usage_(0), reserved_(0) {}
 
-  LRUCacheStrategy(size_t capacity)
-      : CacheStrategy(capacity), capacity_(capacity) {}
+  // All the handles must have been released.
+  ~LRUShard() {
+    for (LRUHandle *e = lru_.next; e != &lru_;) {
+      LRUHandle *next = e->next;
+      assert(e->refs == 1);
+      delete e;
+      e = next;
+    }
+  }
 
-  HANDLE Insert(const Slice &key, const boost::any &value) override {
+  void SetCapacity(size_t capacity) {
+    capacity_ = capacity;
+  }
+
+  // The part of the capacity reserved by CacheStrategy::Reserve.
+  void SetReserved(size_t reserved) {
     std::lock_guard<std::mutex> guard(mu_);
+    reserved_ = reserved;
+    evict(nullptr);
+  }
 
-    assert(cache_.size() <= capacity_);
-    assert(handleTable_.size() == cache_.size());
+  LRUHandle *Insert(const Slice &key, void *value, size_t charge,
+                    CacheStrategy::Deleter deleter) {
+    LRUHandle *e = new LRUHandle();
+    e->value = value;
+    e->deleter = deleter;
+    e->charge = charge;
+    e->refs = 2;  // one for the cache, one for the returned handle
+    e->key.assign(key.RawData(), key.Len());
 
-    auto it = handleTable_.find(key.ToString());
-    if (it != handleTable_.end()) {
-      // cache hit: remove from cache
-      cache_.erase(it->second.where);
-      handleTable_.erase(it);
-    } else if (cache_.size() == capacity_) {
-      // cache full: remove least recently used
-      handleTable_.erase(cache_.rbegin()->ToString());
-      cache_.erase(std::prev(cache_.end()));
+    std::lock_guard<std::mutex> guard(mu_);
+
+    auto it = table_.find(key);
+    if (it != table_.end()) {
+      // replace the existing entry
+      remove(it->second);
+      table_.erase(it);
     }
+    table_.emplace(Slice(e->key), e);
+    link(e);
+    usage_ += charge;
 
-    // insert new entry;
-    it = handleTable_
-             .emplace(std::make_pair<std::string, LRUHandle>(key.ToString(),
-                                                             {value}))
-             .first;
-    cache_.push_front(it->first);
-    it->second.where = cache_.begin();
-    return reinterpret_cast<Handle *>(&it->second);
+    evict(e);
+    return e;
   }
 
-  void Erase(const Slice &key) override {
+  LRUHandle *Lookup(const Slice &key) {
+    std::lock_guard<std::mutex> guard(mu_);
+
+    auto it = table_.find(key);
+    if (it == table_.end())
+      return nullptr;
+
+    // cache hit, move to the front
+    LRUHandle *e = it->second;
+    unlink(e);
+    link(e);
+    e->refs++;
+    return e;
+  }
+
+  void Release(LRUHandle *e) {
+    std::lock_guard<std::mutex> guard(mu_);
+    unref(e);
+  }
+
+  void Erase(const Slice &key) {
     std::lock_guard<std::mutex> guard(mu_);
 
-    auto it = handleTable_.find(key.ToString());
-    if (it != handleTable_.end()) {
-      cache_.erase(it->second.where);
-      handleTable_.erase(it);
+    auto it = table_.find(key);
+    if (it != table_.end()) {
+      remove(it->second);
+      table_.erase(it);
     }
   }
 
-  HANDLE Lookup(const Slice &key) override {
+  size_t TotalCharge() const {
     std::lock_guard<std::mutex> guard(mu_);
+    return usage_;
+  }
+
+  void VisitKeys(const std::function<void(const Slice &)> &fn) const {
+    std::lock_guard<std::mutex> guard(mu_);
+    for (const LRUHandle *e = lru_.next; e != &lru_; e = e->next) {
+      fn(Slice(e->key));
+    }
+  }
+
+ private:
+  // Evict the least recently used entries, but never "keep", e.g the one just
+  // inserted. The evicted entries that are still referenced by handles live
+  // on until the handles are released.
+  void evict(LRUHandle *keep) {
+    while (usage_ + reserved_ > capacity_ && lru_.prev != &lru_ &&
+           lru_.prev != keep) {
+      LRUHandle *old = lru_.prev;
+      table_.erase(Slice(old->key));
+      remove(old);
+    }
+  }
+
+  static void unlink(LRUHandle *e) {
+    e->next->prev = e->prev;
+    e->prev->next = e->next;
+  }
+
+  // Make e the newest entry by inserting it just after lru_.
+  void link(LRUHandle *e) {
+    e->next = lru_.next;
+    e->prev = &lru_;
+    e->next->prev = e;
+    e->prev->next = e;
+  }
+
+  // Unlink e from the list and drop the reference of the cache. The caller is
+  // responsible for removing it from table_.
+  void remove(LRUHandle *e) {
+    unlink(e);
+    usage_ -= e->charge;
+    unref(e);
+  }
+
+  static void unref(LRUHandle *e) {
+    assert(e->refs > 0);
+    if (--e->refs == 0)
+      delete e;
+  }
+
+ private:
+  size_t capacity_;
+  size_t usage_;
+  size_t reserved_;
+
+  // Dummy head of the LRU list.
+  // lru_.prev is the oldest entry, lru_.next is the newest entry.
+  LRUHandle lru_;
+  HandleTable table_;
+
+  mutable std::mutex mu_;
+};
 
-    auto it = handleTable_.find(key.ToString());
-    if (it == handleTable_.end())
-      return NULL;
+}  // anonymous namespace
 
-    // cache hit, remove from cache
-    cache_.erase(it->second.where);
-    LRUHandle value = std::move(it->second);
-    handleTable_.erase(it);
+class LRUCacheStrategy final : public CacheStrategy {
+ public:
+  ~LRUCacheStrategy() override = default;
+
+  LRUCacheStrategy(size_t capacity, int num_shard_bits)
+      : CacheStrategy(capacity),
+        shard_bits_(num_shard_bits),
+        shards_(new LRUShard[1 << num_shard_bits]),
+        unique_id_(0),
+        reserved_(0) {
+    assert(num_shard_bits >= 0 && num_shard_bits < 20);
+    const size_t num_shards = 1u << num_shard_bits;
+    const size_t per_shard = (capacity + (num_shards - 1)) / num_shards;
+    for (size_t i = 0; i < num_shards; i++) {
+      shards_[i].SetCapacity(per_shard);
+    }
+  }
 
-    // push in the front
-    it = handleTable_.emplace(std::make_pair(key.ToString(), std::move(value)))
-             .first;
-    cache_.push_front(it->first);
-    it->second.where = cache_.begin();
-    return reinterpret_cast<Handle *>(&it->second);
+  HANDLE Insert(const Slice &key, void *value, size_t charge,
+                Deleter deleter) override {
+    return reinterpret_cast<Handle *>(
+        shardOf(key).Insert(key, value, charge, deleter));
+  }
+
+  void Erase(const Slice &key) override {
+    shardOf(key).Erase(key);
+  }
+
+  HANDLE Lookup(const Slice &key) override {
+    return reinterpret_cast<Handle *>(shardOf(key).Lookup(key));
   }
 
-  boost::any &Value(HANDLE handle) const override {
+  void Release(HANDLE handle) override {
+    LRUHandle *e = reinterpret_cast<LRUHandle *>(handle);
+    shardOf(e->key).Release(e);
+  }
+
+  void *Value(HANDLE handle) const override {
     return reinterpret_cast<LRUHandle *>(handle)->value;
   }
 
   uint64_t NewId() override {
+    return unique_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  size_t TotalCharge() const override {
+    size_t total = 0;
+    for (size_t i = 0; i < (1u << shard_bits_); i++) {
+      total += shards_[i].TotalCharge();
+    }
+    return total;
+  }
+
+  void VisitKeys(
+      const std::function<void(const Slice &)> &fn) const override {
+    for (size_t i = 0; i < (1u << shard_bits_); i++) {
+      shards_[i].VisitKeys(fn);
+    }
+  }
+
+  void Reserve(size_t charge) override {
+    std::lock_guard<std::mutex> guard(reserve_mu_);
+    reserved_ += charge;
+    spreadReservation();
+  }
+
+  void Unreserve(size_t charge) override {
+    std::lock_guard<std::mutex> guard(reserve_mu_);
+    assert(charge <= reserved_);
+    reserved_ -= charge;
+    spreadReservation();
+  }
+
+ private:
+  // Each shard gives up an equal part of the reservation, as they own equal
+  // parts of the capacity.
+  // REQUIRES: reserve_mu_ is held.
+  void spreadReservation() {
+    const size_t num_shards = 1u << shard_bits_;
+    const size_t per_shard = (reserved_ + (num_shards - 1)) / num_shards;
+    for (size_t i = 0; i < num_shards; i++) {
+      shards_[i].SetReserved(per_shard);
+    }
+  }
+
+  // Use the high bits of hash to select a shard, leaving the low bits to the
+  // hash table inside the shard.
+  LRUShard &shardOf(const Slice &key) {
+    if (shard_bits_ == 0)
+      return shards_[0];
+    size_t h = HashSlice(key);
+    return shards_[h >> (sizeof(size_t) * 8 - shard_bits_)];
+  }
+
+ private:
+  const int shard_bits_;
+  std::unique_ptr<LRUShard[]> shards_;
+  std::atomic<uint64_t> unique_id_;
+
+  std::mutex reserve_mu_;
+  size_t reserved_;  // guarded by reserve_mu_
+};
+
+namespace {
+
+// The CLOCK cache keeps its entries in the slots of an open addressing hash
+// table per shard. A hit takes a reference to the entry and sets its clock
+// counter by atomic operations on the slot, lookups take no lock, while the
+// inserts, the erases and the evictions are serialized by the mutex of the
+// shard. The clock hand sweeps the slots, counting the clock counters down,
+// and evicts the entries whose counters are down to zero. New entries start
+// with the counter of one, so those never hit again go first.
+//
+// An entry is owned by its slot, which is reused once the entry is removed
+// from the cache and unreferenced, and is never freed before the shard, so
+// that lookups may probe the slots while their entries are replaced.
+//
+// "meta" of a slot packs the state of the slot, the clock counter of the
+// entry and the number of references to it:
+//   meta  := refs clock state
+//   refs  := bits [0, 30)
+//   clock := bits [30, 32)
+//   state := bits [32, 34)
+// A lookup takes a reference first, which keeps the slot from being reused,
+// and then checks the state and the key, giving the reference back if the
+// slot doesn't hold the key, so the references of a slot may be
+// transiently off while it's empty or being filled.
+// HashSlice mixed further, as the probes of the slots depend on the low bits
+// and the shards on the high ones.
+inline uint64_t HashClockKey(const Slice &key) {
+  uint64_t h = HashSlice(key);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+const uint64_t kRefsMask = (uint64_t(1) << 30) - 1;
+const int kClockShift = 30;
+const uint64_t kClockUnit = uint64_t(1) << kClockShift;
+const uint64_t kClockMask = uint64_t(3) << kClockShift;
+const uint64_t kMaxClock = 3;
+const int kStateShift = 32;
+const uint64_t kStateUnit = uint64_t(1) << kStateShift;
+
+enum SlotState : uint64_t {
+  kSlotEmpty = 0,
+  // Being filled or emptied by the holder of the mutex of the shard.
+  kSlotConstruction = 1,
+  // Holds an entry of the cache.
+  kSlotVisible = 2,
+  // Holds an entry removed from the cache, which is still referenced.
+  kSlotInvisible = 3,
+};
+
+inline uint64_t StateOf(uint64_t meta) {
+  return meta >> kStateShift;
+}
+
+inline uint64_t ClockOf(uint64_t meta) {
+  return (meta & kClockMask) >> kClockShift;
+}
+
+inline uint64_t RefsOf(uint64_t meta) {
+  return meta & kRefsMask;
+}
+
+struct ClockSlot {
+  std::atomic<uint64_t> meta;
+  // The number of entries whose probe sequences pass this slot, a probe for
+  // a key missing from the cache ends at a slot of none.
+  std::atomic<uint32_t> displacements;
+  // The fields of the entry are only written in kSlotConstruction state.
+  uint64_t hash;
+  size_t charge;
+  std::string key;
+  void *value;
+  CacheStrategy::Deleter deleter;
+  // Set on the entries inserted while the table has no free slot, which are
+  // never in the cache, and deleted once released.
+  bool detached;
+
+  ClockSlot()
+      : meta(0),
+        displacements(0),
+        hash(0),
+        charge(0),
+        value(nullptr),
+        deleter(nullptr),
+        detached(false) {}
+
+  ~ClockSlot() {
+    Clear();
+  }
+
+  // Gives the value of the entry to its deleter.
+  void Clear() {
+    if (deleter)
+      deleter(Slice(key), value);
+    key.clear();
+    value = nullptr;
+    deleter = nullptr;
+  }
+};
+
+// A single shard of the CLOCK cache.
+class ClockShard {
+ public:
+  ClockShard()
+      : mask_(0), max_occupied_(0), capacity_(0), usage_(0), reserved_(0),
+        occupied_(0), hand_(0) {}
+
+  // All the handles must have been released.
+  ~ClockShard() = default;
+
+  // The shard holds up to "num_slots" (a power of 2) entries of "capacity"
+  // combined charges.
+  void Init(size_t capacity, size_t num_slots) {
+    assert((num_slots & (num_slots - 1)) == 0);
+    slots_.reset(new ClockSlot[num_slots]);
+    mask_ = num_slots - 1;
+    // Probes grow long as the table fills up.
+    max_occupied_ = num_slots - num_slots / 8;
+    capacity_ = capacity;
+  }
+
+  void SetReserved(size_t reserved) {
+    std::lock_guard<std::mutex> guard(mu_);
+    reserved_ = reserved;
+    evict(0);
+  }
+
+  ClockSlot *Insert(const Slice &key, uint64_t hash, void *value,
+                    size_t charge, CacheStrategy::Deleter deleter) {
+    std::lock_guard<std::mutex> guard(mu_);
+
+    // replace the existing entry
+    ClockSlot *s = find(key, hash);
+    if (s)
+      remove(s);
+    evict(charge);
+
+    s = nullptr;
+    if (occupied_ < max_occupied_) {
+      for (size_t i = 0; i <= mask_; i++) {
+        ClockSlot &slot = slots_[probe(hash, i)];
+        uint64_t meta = slot.meta.load(std::memory_order_relaxed);
+        if (StateOf(meta) != kSlotEmpty)
+          continue;
+        // Only the lookups touch an empty slot meanwhile, on its references.
+        while (!slot.meta.compare_exchange_weak(
+            meta, meta + kSlotConstruction * kStateUnit,
+            std::memory_order_acquire)) {
+        }
+        for (size_t j = 0; j < i; j++) {
+          slots_[probe(hash, j)].displacements.fetch_add(
+              1, std::memory_order_relaxed);
+        }
+        s = &slot;
+        break;
+      }
+    }
+    if (!s) {
+      s = new ClockSlot();
+      s->detached = true;
+    }
+
+    s->hash = hash;
+    s->charge = charge;
+    s->key.assign(key.RawData(), key.Len());
+    s->value = value;
+    s->deleter = deleter;
+    if (s->detached) {
+      s->meta.store(kSlotInvisible * kStateUnit + 1, std::memory_order_relaxed);
+    } else {
+      // One reference for the returned handle.
+      s->meta.fetch_add(
+          (kSlotVisible - kSlotConstruction) * kStateUnit + kClockUnit + 1,
+          std::memory_order_release);
+      usage_ += charge;
+      occupied_++;
+    }
+    return s;
+  }
+
+  ClockSlot *Lookup(const Slice &key, uint64_t hash) {
+    for (size_t i = 0; i <= mask_; i++) {
+      ClockSlot &slot = slots_[probe(hash, i)];
+      if (StateOf(slot.meta.load(std::memory_order_relaxed)) == kSlotVisible) {
+        uint64_t meta = slot.meta.fetch_add(1, std::memory_order_acquire);
+        if (StateOf(meta) == kSlotVisible && slot.hash == hash &&
+            Slice(slot.key) == key) {
+          // cache hit, set the clock counter to the top
+          if (ClockOf(meta) != kMaxClock)
+            slot.meta.fetch_or(kClockMask, std::memory_order_relaxed);
+          return &slot;
+        }
+        Release(&slot);
+      }
+      if (slot.displacements.load(std::memory_order_relaxed) == 0)
+        return nullptr;
+    }
+    return nullptr;
+  }
+
+  void Release(ClockSlot *s) {
+    if (s->detached) {
+      if (RefsOf(s->meta.fetch_sub(1, std::memory_order_acq_rel)) == 1)
+        delete s;
+      return;
+    }
+    uint64_t meta = s->meta.fetch_sub(1, std::memory_order_acq_rel);
+    if (RefsOf(meta) == 1 && StateOf(meta) == kSlotInvisible) {
+      std::lock_guard<std::mutex> guard(mu_);
+      tryFree(s);
+    }
+  }
+
+  void Erase(const Slice &key, uint64_t hash) {
     std::lock_guard<std::mutex> guard(mu_);
-    return unique_id_++;
+    ClockSlot *s = find(key, hash);
+    if (s)
+      remove(s);
+  }
+
+  size_t TotalCharge() const {
+    std::lock_guard<std::mutex> guard(mu_);
+    return usage_;
+  }
+
+  void VisitKeys(const std::function<void(const Slice &)> &fn) const {
+    std::lock_guard<std::mutex> guard(mu_);
+    for (size_t i = 0; i <= mask_; i++) {
+      const ClockSlot &slot = slots_[i];
+      if (StateOf(slot.meta.load(std::memory_order_relaxed)) == kSlotVisible)
+        fn(Slice(slot.key));
+    }
+  }
+
+ private:
+  // The i-th slot of the probe sequence of "hash", which visits every slot
+  // as the step is odd.
+  size_t probe(uint64_t hash, size_t i) const {
+    return static_cast<size_t>(hash + i * ((hash >> 32) | 1)) & mask_;
+  }
+
+  // Returns the slot holding the entry of "key" in the cache, or NULL.
+  // REQUIRES: mu_ is held, which keeps the entries in the cache unchanged.
+  ClockSlot *find(const Slice &key, uint64_t hash) {
+    for (size_t i = 0; i <= mask_; i++) {
+      ClockSlot &slot = slots_[probe(hash, i)];
+      if (StateOf(slot.meta.load(std::memory_order_relaxed)) == kSlotVisible &&
+          slot.hash == hash && Slice(slot.key) == key)
+        return &slot;
+      if (slot.displacements.load(std::memory_order_relaxed) == 0)
+        return nullptr;
+    }
+    return nullptr;
+  }
+
+  // Removes the entry of "s" from the cache, which is freed at once unless
+  // it's referenced, then by the last Release.
+  // REQUIRES: mu_ is held, "s" is visible.
+  void remove(ClockSlot *s) {
+    uint64_t meta =
+        s->meta.fetch_add((kSlotInvisible - kSlotVisible) * kStateUnit,
+                          std::memory_order_acq_rel);
+    usage_ -= s->charge;
+    if (RefsOf(meta) == 0)
+      tryFree(s);
+  }
+
+  // Empties "s" if it holds an unreferenced entry removed from the cache. A
+  // lookup may have taken a reference meanwhile, or another Release freed it.
+  // REQUIRES: mu_ is held.
+  void tryFree(ClockSlot *s) {
+    uint64_t meta = s->meta.load(std::memory_order_acquire);
+    if (StateOf(meta) != kSlotInvisible || RefsOf(meta) != 0 ||
+        !s->meta.compare_exchange_strong(
+            meta, meta - (kSlotInvisible - kSlotConstruction) * kStateUnit,
+            std::memory_order_acquire)) {
+      return;
+    }
+
+    s->Clear();
+    const size_t index = static_cast<size_t>(s - slots_.get());
+    for (size_t i = 0; probe(s->hash, i) != index; i++) {
+      slots_[probe(s->hash, i)].displacements.fetch_sub(
+          1, std::memory_order_relaxed);
+    }
+    s->meta.fetch_sub(kSlotConstruction * kStateUnit + (meta & kClockMask),
+                      std::memory_order_release);
+    occupied_--;
+  }
+
+  // Sweeps the clock hand until there is room for "charge", and a free slot.
+  // An entry is passed over at most kMaxClock times before it's evicted. The
+  // evicted entries that are still referenced by handles live on until the
+  // handles are released, they are only evicted to make room for the charge
+  // as their slots stay taken.
+  // REQUIRES: mu_ is held.
+  void evict(size_t charge) {
+    const size_t max_steps = (kMaxClock + 1) * (mask_ + 1);
+    for (size_t step = 0; step < max_steps; step++) {
+      const bool over_capacity = usage_ + reserved_ + charge > capacity_;
+      if (!over_capacity && occupied_ < max_occupied_)
+        return;
+      ClockSlot &slot = slots_[hand_];
+      hand_ = (hand_ + 1) & mask_;
+      uint64_t meta = slot.meta.load(std::memory_order_relaxed);
+      if (StateOf(meta) != kSlotVisible)
+        continue;
+      if (ClockOf(meta) > 0) {
+        // Fails if a hit sets the counter meanwhile.
+        slot.meta.compare_exchange_strong(meta, meta - kClockUnit,
+                                          std::memory_order_relaxed);
+        continue;
+      }
+      if (RefsOf(meta) == 0 || over_capacity)
+        remove(&slot);
+    }
   }
 
  private:
-  HandleTable handleTable_;
-  CacheList cache_;
-  const size_t capacity_;
-  uint64_t unique_id_;
+  std::unique_ptr<ClockSlot[]> slots_;
+  size_t mask_;
+  size_t max_occupied_;
+  size_t capacity_;
+
+  // The following are guarded by mu_.
+  size_t usage_;
+  size_t reserved_;
+  size_t occupied_;  // the slots not empty
+  size_t hand_;
   mutable std::mutex mu_;
 };
 
+}  // anonymous namespace
+
+class ClockCacheStrategy final : public CacheStrategy {
+ public:
+  ~ClockCacheStrategy() override = default;
+
+  ClockCacheStrategy(size_t capacity, size_t estimated_entry_charge,
+                     int num_shard_bits)
+      : CacheStrategy(capacity),
+        shard_bits_(num_shard_bits),
+        shards_(new ClockShard[1 << num_shard_bits]),
+        unique_id_(0),
+        reserved_(0) {
+    assert(num_shard_bits >= 0 && num_shard_bits < 20);
+    const size_t num_shards = 1u << num_shard_bits;
+    const size_t per_shard = (capacity + (num_shards - 1)) / num_shards;
+    // The table of a shard is filled to about 70% by the estimated number of
+    // entries.
+    const size_t entries =
+        per_shard / std::max<size_t>(estimated_entry_charge, 1) + 1;
+    size_t num_slots = 16;
+    while (num_slots * 7 / 10 < entries)
+      num_slots *= 2;
+    for (size_t i = 0; i < num_shards; i++) {
+      shards_[i].Init(per_shard, num_slots);
+    }
+  }
+
+  HANDLE Insert(const Slice &key, void *value, size_t charge,
+                Deleter deleter) override {
+    const uint64_t hash = HashClockKey(key);
+    return reinterpret_cast<Handle *>(
+        shardOf(hash).Insert(key, hash, value, charge, deleter));
+  }
+
+  void Erase(const Slice &key) override {
+    const uint64_t hash = HashClockKey(key);
+    shardOf(hash).Erase(key, hash);
+  }
+
+  HANDLE Lookup(const Slice &key) override {
+    const uint64_t hash = HashClockKey(key);
+    return reinterpret_cast<Handle *>(shardOf(hash).Lookup(key, hash));
+  }
+
+  void Release(HANDLE handle) override {
+    ClockSlot *s = reinterpret_cast<ClockSlot *>(handle);
+    shardOf(s->hash).Release(s);
+  }
+
+  void *Value(HANDLE handle) const override {
+    return reinterpret_cast<ClockSlot *>(handle)->value;
+  }
+
+  uint64_t NewId() override {
+    return unique_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  size_t TotalCharge() const override {
+    size_t total = 0;
+    for (size_t i = 0; i < (1u << shard_bits_); i++) {
+      total += shards_[i].TotalCharge();
+    }
+    return total;
+  }
+
+  void VisitKeys(
+      const std::function<void(const Slice &)> &fn) const override {
+    for (size_t i = 0; i < (1u << shard_bits_); i++) {
+      shards_[i].VisitKeys(fn);
+    }
+  }
+
+  void Reserve(size_t charge) override {
+    std::lock_guard<std::mutex> guard(reserve_mu_);
+    reserved_ += charge;
+    spreadReservation();
+  }
+
+  void Unreserve(size_t charge) override {
+    std::lock_guard<std::mutex> guard(reserve_mu_);
+    assert(charge <= reserved_);
+    reserved_ -= charge;
+    spreadReservation();
+  }
+
+ private:
+  // REQUIRES: reserve_mu_ is held.
+  void spreadReservation() {
+    const size_t num_shards = 1u << shard_bits_;
+    const size_t per_shard = (reserved_ + (num_shards - 1)) / num_shards;
+    for (size_t i = 0; i < num_shards; i++) {
+      shards_[i].SetReserved(per_shard);
+    }
+  }
+
+  // As in LRUCacheStrategy, the high bits of hash select a shard, the low
+  // bits are left to the probes inside the shard.
+  ClockShard &shardOf(uint64_t hash) {
+    if (shard_bits_ == 0)
+      return shards_[0];
+    return shards_[hash >> (64 - shard_bits_)];
+  }
+
+ private:
+  const int shard_bits_;
+  std::unique_ptr<ClockShard[]> shards_;
+  std::atomic<uint64_t> unique_id_;
+
+  std::mutex reserve_mu_;
+  size_t reserved_;  // guarded by reserve_mu_
+};
+
+static const int kDefaultNumShardBits = 4;
+
 CacheStrategy *CacheStrategy::Default(size_t capacity) {
-  return new LRUCacheStrategy(capacity);
+  return new LRUCacheStrategy(capacity, kDefaultNumShardBits);
+}
+
+CacheStrategy *CacheStrategy::LRU(size_t capacity, int num_shard_bits) {
+  return new LRUCacheStrategy(capacity, num_shard_bits);
+}
+
+CacheStrategy *CacheStrategy::Clock(size_t capacity,
+                                    size_t estimated_entry_charge,
+                                    int num_shard_bits) {
+  return new ClockCacheStrategy(capacity, estimated_entry_charge,
+                                num_shard_bits);
 }
 
-}  // namespace lessdb
\ No newline at end of file
+}  // namespace lessdb
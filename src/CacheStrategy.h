@@ -22,21 +22,20 @@
 
 #pragma once
 
-#include "Disallowcopying.h"
-#include "SliceFwd.h"
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 
-namespace boost {
-class any;
-}  // namespace boost
+#include "Disallowcopying.h"
+#include "SliceFwd.h"
 
 namespace lessdb {
 
-// TODO: Concurrency in CacheStrategy.
 // A CacheStrategy is an interface that maps keys to values.  It has
 // internal synchronization and may be safely accessed concurrently from
 // multiple threads.  It may automatically evict entries to make room
-// for new entries.
+// for new entries. Each entry is charged against the capacity of the cache
+// by a caller-specified amount, typically the size in bytes of the value.
 
 // LessDB allows users to specify the internal cache strategy in Options.
 class CacheStrategy {
@@ -48,23 +47,40 @@ class CacheStrategy {
   // Rename Handle* to HANDLE so that users will not attempt to delete it.
   typedef Handle *HANDLE;
 
+  // Called with the key and the value of an entry once the entry is removed
+  // from the cache and all the handles to it are released, e.g to delete the
+  // value. NULL for the values not owned by the cache. @see DeleteCacheValue
+  typedef void (*Deleter)(const Slice &key, void *value);
+
   CacheStrategy(size_t capacity){};
 
   virtual ~CacheStrategy() = default;
 
-  // Insert a mapping from key->value into the cache.
-  // Else return a handle that corresponds to the mapping.
-  virtual HANDLE Insert(const Slice &key, const boost::any &value) = 0;
+  // Insert a mapping from key->value into the cache and assign it the
+  // specified charge against the total cache capacity. The cache owns value
+  // from then on, which is passed to "deleter" when it's no longer needed.
+  // Returns a handle that corresponds to the mapping. The caller must call
+  // Release(handle) when the returned mapping is no longer needed.
+  virtual HANDLE Insert(const Slice &key, void *value, size_t charge,
+                        Deleter deleter) = 0;
 
+  // If the cache contains entry for key, erase it. The entry is kept until
+  // all the handles to it have been released.
   virtual void Erase(const Slice &key) = 0;
 
   // If the cache has no mapping for "key", returns NULL.
-  // NOTE: the underlying data of Cache is not guaranteed to be unchanged after
-  // calling of Lookup.
+  // Else return a handle that corresponds to the mapping. The caller must
+  // call Release(handle) when the returned mapping is no longer needed.
   virtual HANDLE Lookup(const Slice &key) = 0;
 
-  // Return the value encapsulated in a valid handle.
-  virtual boost::any &Value(HANDLE handle) const = 0;
+  // Release a mapping returned by a previous Lookup() or Insert().
+  // REQUIRES: handle must not have been released yet.
+  virtual void Release(HANDLE handle) = 0;
+
+  // Return the value encapsulated in a handle that has not been released.
+  // The value stays unchanged until the handle is released, even if the
+  // entry is evicted, erased or replaced meanwhile.
+  virtual void *Value(HANDLE handle) const = 0;
 
   // Return a new numeric id.  May be used by multiple clients who are
   // sharing the same cache to partition the key space.  Typically the
@@ -72,10 +88,48 @@ class CacheStrategy {
   // its cache keys.
   virtual uint64_t NewId() = 0;
 
+  // Return the combined charges of all the entries stored in the cache, the
+  // entries removed from the cache that are still referenced by handles are
+  // not counted.
+  virtual size_t TotalCharge() const = 0;
+
+  // Reserve "charge" of the capacity for memory held outside of the cache,
+  // e.g memtables (see WriteBufferManager), evicting entries to make room
+  // for it. Unreserve gives it back.
+  virtual void Reserve(size_t charge) = 0;
+  virtual void Unreserve(size_t charge) = 0;
+
+  // Call fn with the key of every entry stored in the cache, in the order of
+  // the implementation, e.g most recently used first within a shard of LRU.
+  // fn is called with internal locks held, it must not call back into the
+  // cache.
+  virtual void VisitKeys(
+      const std::function<void(const Slice &)> &fn) const = 0;
+
   // Default implementation of CacheStrategy uses a least-recently-used eviction
-  // policy. Clients should delete the CacheStrategy(smart pointer is
-  // recommended) when it's no needed.
+  // policy, with the key space partitioned into 16 shards. Clients should
+  // delete the CacheStrategy(smart pointer is recommended) when it's no needed.
   static CacheStrategy *Default(size_t capacity);
+
+  // LRU cache strategy with 2^num_shard_bits shards, each of which is guarded
+  // by its own lock and owns an equal part of the capacity.
+  static CacheStrategy *LRU(size_t capacity, int num_shard_bits);
+
+  // CLOCK cache strategy with 2^num_shard_bits shards. A hit only sets the
+  // clock counter of the entry by an atomic operation, the lookups take no
+  // lock, which suits the caches of many concurrent readers. The entries
+  // live in hash tables sized by the number of entries the capacity holds
+  // at about "estimated_entry_charge" each, e.g Options::block_size for a
+  // block cache: a table full of smaller entries evicts before the capacity
+  // is used up.
+  static CacheStrategy *Clock(size_t capacity, size_t estimated_entry_charge,
+                              int num_shard_bits = 4);
 };
 
+// The deleter of the cache values allocated by new T.
+template <typename T>
+void DeleteCacheValue(const Slice &key, void *value) {
+  delete static_cast<T *>(value);
+}
+
 }  // namespace lessdb
\ No newline at end of file
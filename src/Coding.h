@@ -22,8 +22,12 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <silly/Coding.h>
 
+#include "Slice.h"
+
 namespace lessdb {
 
 namespace coding {
@@ -39,6 +43,123 @@ using silly::coding::GetVar64;
 using silly::coding::GetVar32;
 using silly::coding::GetVarString;
 
+// Returns the number of bytes v takes encoded as a varint.
+inline size_t VarintLength(uint64_t v) {
+  size_t len = 1;
+  while (v >= 128) {
+    v >>= 7;
+    len++;
+  }
+  return len;
+}
+
+// Encodes v as a varint into dst, which must have at least VarintLength(v)
+// bytes, returns the pointer just past the last written byte.
+inline char *EncodeVar32(char *dst, uint32_t v) {
+  uint8_t *p = reinterpret_cast<uint8_t *>(dst);
+  while (v >= 128) {
+    *(p++) = static_cast<uint8_t>(v | 128);
+    v >>= 7;
+  }
+  *(p++) = static_cast<uint8_t>(v);
+  return reinterpret_cast<char *>(p);
+}
+
+// Decodes a varint32 starting at p into *v, returns the pointer just past
+// the varint. The input must be a well-formed varint produced by
+// EncodeVar32, no bounds checking is performed.
+inline const char *DecodeVar32(const char *p, uint32_t *v) {
+  const uint8_t *q = reinterpret_cast<const uint8_t *>(p);
+  if ((*q & 128) == 0) {
+    *v = *q;
+    return p + 1;
+  }
+  uint32_t result = 0;
+  for (uint32_t shift = 0; shift <= 28; shift += 7, q++) {
+    uint32_t byte = *q;
+    result |= (byte & 127) << shift;
+    if ((byte & 128) == 0) break;
+  }
+  *v = result;
+  return reinterpret_cast<const char *>(q + 1);
+}
+
+// Decodes a varint32 in [p, limit) into *v, returns the pointer just past the
+// varint, or NULL if the varint is truncated or longer than 5 bytes.
+// Unlike silly::coding::GetVar32, nothing is thrown, so the callers in the
+// innermost loops (block entries, memtable and batch records) stay
+// inlinable, and the common 1-byte varint takes a single branch.
+inline const char *GetVar32Ptr(const char *p, const char *limit,
+                               uint32_t *v) {
+  if (p < limit) {
+    uint32_t byte = *reinterpret_cast<const uint8_t *>(p);
+    if ((byte & 128) == 0) {
+      *v = byte;
+      return p + 1;
+    }
+  }
+  uint32_t result = 0;
+  for (uint32_t shift = 0; shift <= 28 && p < limit; shift += 7) {
+    uint32_t byte = *reinterpret_cast<const uint8_t *>(p++);
+    result |= (byte & 127) << shift;
+    if ((byte & 128) == 0) {
+      *v = result;
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+// The varint64 counterpart of GetVar32Ptr.
+inline const char *GetVar64Ptr(const char *p, const char *limit,
+                               uint64_t *v) {
+  uint64_t result = 0;
+  for (uint32_t shift = 0; shift <= 63 && p < limit; shift += 7) {
+    uint64_t byte = *reinterpret_cast<const uint8_t *>(p++);
+    result |= (byte & 127) << shift;
+    if ((byte & 128) == 0) {
+      *v = result;
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+// Decodes a varint32 from the front of *input into *v and skips it. Returns
+// false, leaving *input untouched, if the varint is malformed.
+inline bool ParseVar32(Slice *input, uint32_t *v) {
+  const char *p = input->RawData();
+  const char *q = GetVar32Ptr(p, p + input->Len(), v);
+  if (q == nullptr)
+    return false;
+  input->Skip(static_cast<size_t>(q - p));
+  return true;
+}
+
+inline bool ParseVar64(Slice *input, uint64_t *v) {
+  const char *p = input->RawData();
+  const char *q = GetVar64Ptr(p, p + input->Len(), v);
+  if (q == nullptr)
+    return false;
+  input->Skip(static_cast<size_t>(q - p));
+  return true;
+}
+
+// Decodes a varstring, a varint32 length followed by as many bytes, from the
+// front of *input into *str, pointing into *input. Returns false if the
+// varstring is malformed.
+inline bool ParseVarString(Slice *input, Slice *str) {
+  const char *p = input->RawData();
+  const char *limit = p + input->Len();
+  uint32_t len;
+  const char *q = GetVar32Ptr(p, limit, &len);
+  if (q == nullptr || static_cast<size_t>(limit - q) < len)
+    return false;
+  *str = Slice(q, len);
+  input->Skip(static_cast<size_t>(q - p) + len);
+  return true;
+}
+
 }  // namespace coding
 
 }  // namespace lessdb
\ No newline at end of file
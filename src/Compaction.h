@@ -0,0 +1,150 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Config.h"
+#include "Disallowcopying.h"
+#include "FileMetaData.h"
+#include "SliceFwd.h"
+#include "VersionEdit.h"
+
+namespace lessdb {
+
+struct Options;
+class Version;
+
+// A Compaction encapsulates information about a compaction, which merges the
+// files inputs_[0] of level() and the overlapping files inputs_[1] of
+// level()+1 into new files of level()+1.
+class Compaction {
+  __DISALLOW_COPYING__(Compaction);
+
+ public:
+  ~Compaction();
+
+  // The progress of a scan over the inputs in increasing key order, as
+  // tracked by IsBaseLevelForKey and ShouldStopBefore. The subcompactions,
+  // which scan disjoint key ranges at the same time, have a cursor each.
+  struct Cursor {
+    Cursor();
+
+    size_t grandparent_index;  // Index in grandparents_
+    bool seen_key;             // Some output key has been seen
+    uint64_t overlapped_bytes;  // Bytes of overlap between current output
+                                // and grandparent files
+
+    // level_ptrs holds indices into input_version_->files_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L >= level_ + 2).
+    size_t level_ptrs[config::kNumLevels];
+  };
+
+  // Return the level that is being compacted. Inputs from "level"
+  // and "level+1" will be merged to produce a set of "level+1" files.
+  int level() const {
+    return level_;
+  }
+
+  // Return the object that holds the edits to the descriptor done
+  // by this compaction.
+  VersionEdit *edit() {
+    return &edit_;
+  }
+
+  // "which" must be either 0 or 1
+  int num_input_files(int which) const {
+    return static_cast<int>(inputs_[which].size());
+  }
+
+  // Return the ith input file at "level()+which" ("which" must be 0 or 1).
+  FileMetaData *input(int which, int i) const {
+    return inputs_[which][i];
+  }
+
+  // Maximum size of files to build during this compaction.
+  uint64_t MaxOutputFileSize() const {
+    return max_output_file_size_;
+  }
+
+  // Is this a trivial compaction that can be implemented by just
+  // moving a single input file to the next level (no merging or splitting)
+  bool IsTrivialMove() const;
+
+  // Add all inputs to this compaction as delete operations to *edit.
+  void AddInputDeletions(VersionEdit *edit);
+
+  // Returns true if the information we have available guarantees that
+  // the compaction is producing data in "level+1" for which no data exists
+  // in levels greater than "level+1". A deletion of such a user key can be
+  // dropped. The keys passed with the same cursor must be increasing.
+  bool IsBaseLevelForKey(const Slice &user_key, Cursor *cursor) const;
+
+  bool IsBaseLevelForKey(const Slice &user_key) {
+    return IsBaseLevelForKey(user_key, &cursor_);
+  }
+
+  // The range counterpart of IsBaseLevelForKey: no data exists in levels
+  // greater than "level+1" for the user keys in [begin, end]. A range
+  // tombstone of such a range can be dropped.
+  bool IsBaseLevelForRange(const Slice &begin, const Slice &end) const;
+
+  // Returns true iff we should stop building the current output
+  // before processing "internal_key", since the output would overlap too
+  // much of level()+2, making its future compaction expensive.
+  bool ShouldStopBefore(const Slice &internal_key, Cursor *cursor) const;
+
+  bool ShouldStopBefore(const Slice &internal_key) {
+    return ShouldStopBefore(internal_key, &cursor_);
+  }
+
+  // Release the input version for the compaction, once the compaction
+  // is successful.
+  void ReleaseInputs();
+
+ private:
+  friend class VersionSet;
+
+  Compaction(const Options *options, int level);
+
+  int level_;
+  uint64_t max_output_file_size_;
+  uint64_t max_grandparent_overlap_bytes_;
+  Version *input_version_;
+  VersionEdit edit_;
+
+  // Each compaction reads inputs from "level_" and "level_+1"
+  std::vector<FileMetaData *> inputs_[2];
+
+  // State used to check for number of overlapping grandparent files
+  // (parent == level_ + 1, grandparent == level_ + 2)
+  std::vector<FileMetaData *> grandparents_;
+
+  // The cursor of a compaction scanning all of its inputs at once.
+  Cursor cursor_;
+};
+
+}  // namespace lessdb
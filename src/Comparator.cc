@@ -20,8 +20,10 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
 #include <mutex>
-#include <numeric>
 
 #include "Comparator.h"
 #include "Slice.h"
@@ -40,27 +42,42 @@ class BytewiseComparator final : public Comparator {
 
   void FindShortestSeparator(std::string *start,
                              const Slice &limit) const override {
-    // if start < limit, start and limit must share same prefix (the prefix can
-    // be null), assume i is the smallest index where start.length < i ||
-    // start[i] < limit[i]
-    // then start[i] = max(start[i]+1, 0xff);
-    size_t sep = start->length();
-    for (size_t i = 0; i < start->length(); i++) {
-      assert(i < limit.Len());
-      if ((*start)[i] == limit[i])
-        continue;
-      assert((*start)[i] < limit[i]);
-      if ((*start)[i] < std::numeric_limits<char>::max())
-        (*start)[i] = static_cast<char>((*start)[i] + 1);
-      sep = i;
-      break;
+    // Find length of common prefix
+    size_t min_length = std::min(start->size(), limit.Len());
+    size_t diff_index = 0;
+    while ((diff_index < min_length) &&
+           ((*start)[diff_index] == limit[diff_index])) {
+      diff_index++;
     }
 
-    if (sep == start->length()) {
-      assert(limit.Len() > sep);
-      assert(limit[sep] != 0);
-      start->push_back(static_cast<char>(limit[sep] - 1));
+    if (diff_index >= min_length) {
+      // Do not shorten if one string is a prefix of the other
+      return;
     }
+
+    // if start[i] + 1 < limit[i], where i is the first index that start and
+    // limit differ, then start[0..i] with start[i] incremented is a shorter
+    // separator in [start, limit).
+    uint8_t diff_byte = static_cast<uint8_t>((*start)[diff_index]);
+    if (diff_byte < static_cast<uint8_t>(0xff) &&
+        diff_byte + 1 < static_cast<uint8_t>(limit[diff_index])) {
+      (*start)[diff_index] = static_cast<char>(diff_byte + 1);
+      start->resize(diff_index + 1);
+      assert(Compare(*start, limit) < 0);
+    }
+  }
+
+  void FindShortSuccessor(std::string *key) const override {
+    // Find first character that can be incremented
+    for (size_t i = 0; i < key->size(); i++) {
+      uint8_t byte = static_cast<uint8_t>((*key)[i]);
+      if (byte != static_cast<uint8_t>(0xff)) {
+        (*key)[i] = static_cast<char>(byte + 1);
+        key->resize(i + 1);
+        return;
+      }
+    }
+    // *key is a run of 0xffs, leave it alone.
   }
 };
 
@@ -77,4 +94,14 @@ const Comparator *NewBytewiseComparator() {
   return byteWiseComparator;
 }
 
+uint64_t BytewiseKeyPrefix(const Slice &key) {
+  uint64_t prefix = 0;
+  size_t n = std::min(key.Len(), sizeof(uint64_t));
+  for (size_t i = 0; i < n; i++) {
+    uint64_t byte = static_cast<uint8_t>(key[i]);
+    prefix |= byte << (56 - 8 * i);
+  }
+  return prefix;
+}
+
 }  // namespace lessdb
\ No newline at end of file
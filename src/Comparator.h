@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <iosfwd>
 
 #include "SliceFwd.h"
@@ -55,6 +56,12 @@ class Comparator {
   virtual void FindShortestSeparator(std::string *start,
                                      const Slice &limit) const = 0;
 
+  // Changes *key to a short string >= *key.
+  // Simple comparator implementations may return with *key unchanged,
+  // i.e., an implementation of this method that does nothing is correct.
+  // @see SSTableBuilder::Finish
+  virtual void FindShortSuccessor(std::string *key) const = 0;
+
  protected:
   Comparator() = default;
 };
@@ -62,4 +69,10 @@ class Comparator {
 // builtin Comparator, which uses lexicographic byte-wise ordering.
 extern const Comparator *NewBytewiseComparator();
 
+// The first 8 bytes of key, zero-padded and read as a big-endian integer.
+// For the bytewise ordering, BytewiseKeyPrefix(a) < BytewiseKeyPrefix(b)
+// implies a < b, so the prefixes resolve most comparisons with an integer
+// compare.
+extern uint64_t BytewiseKeyPrefix(const Slice &key);
+
 }  // namespace lessdb
\ No newline at end of file
@@ -0,0 +1,180 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifdef LESSDB_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef LESSDB_HAVE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+#include "Coding.h"
+#include "Compression.h"
+
+namespace lessdb {
+
+namespace compression {
+
+#ifdef LESSDB_HAVE_ZSTD
+
+// Contexts are reused by the calls of a thread, creating one allocates
+// several hundred KB.
+struct ZstdContexts {
+  ZSTD_CCtx *cctx;
+  ZSTD_DCtx *dctx;
+
+  ZstdContexts() : cctx(ZSTD_createCCtx()), dctx(ZSTD_createDCtx()) {}
+
+  ~ZstdContexts() {
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+  }
+};
+
+static ZstdContexts &ThreadZstdContexts() {
+  static thread_local ZstdContexts contexts;
+  return contexts;
+}
+
+#endif
+
+bool IsSupported(CompressionType type) {
+  switch (type) {
+    case kNoCompression:
+      return true;
+#ifdef LESSDB_HAVE_LZ4
+    case kLZ4Compression:
+      return true;
+#endif
+#ifdef LESSDB_HAVE_ZSTD
+    case kZstdCompression:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+bool Compress(CompressionType type, int level, const Slice &dict,
+              const Slice &input, std::string *output) {
+  output->clear();
+  coding::AppendVar32(output, static_cast<uint32_t>(input.Len()));
+
+  switch (type) {
+#ifdef LESSDB_HAVE_LZ4
+    case kLZ4Compression: {
+      const size_t header = output->size();
+      int bound = LZ4_compressBound(static_cast<int>(input.Len()));
+      output->resize(header + static_cast<size_t>(bound));
+      int n = LZ4_compress_default(input.RawData(), &(*output)[header],
+                                   static_cast<int>(input.Len()), bound);
+      if (n <= 0)
+        return false;
+      output->resize(header + static_cast<size_t>(n));
+      return true;
+    }
+#endif
+#ifdef LESSDB_HAVE_ZSTD
+    case kZstdCompression: {
+      const size_t header = output->size();
+      size_t bound = ZSTD_compressBound(input.Len());
+      output->resize(header + bound);
+      size_t n = ZSTD_compress_usingDict(
+          ThreadZstdContexts().cctx, &(*output)[header], bound,
+          input.RawData(), input.Len(), dict.RawData(), dict.Len(), level);
+      if (ZSTD_isError(n))
+        return false;
+      output->resize(header + n);
+      return true;
+    }
+#endif
+    default:
+      (void)level;
+      (void)dict;
+      return false;
+  }
+}
+
+Status Uncompress(CompressionType type, const Slice &dict, const Slice &input,
+                  std::unique_ptr<char[]> *output, size_t *n) {
+  Slice data = input;
+  uint32_t len;
+  if (!coding::ParseVar32(&data, &len)) {
+    return Status::Corruption("Uncompress: bad uncompressed length");
+  }
+
+  output->reset(new char[len]);
+  *n = len;
+  switch (type) {
+#ifdef LESSDB_HAVE_LZ4
+    case kLZ4Compression: {
+      int r = LZ4_decompress_safe(data.RawData(), output->get(),
+                                  static_cast<int>(data.Len()),
+                                  static_cast<int>(len));
+      if (r < 0 || static_cast<uint32_t>(r) != len)
+        return Status::Corruption("Uncompress: corrupted lz4 block");
+      return Status::OK();
+    }
+#endif
+#ifdef LESSDB_HAVE_ZSTD
+    case kZstdCompression: {
+      size_t r = ZSTD_decompress_usingDict(
+          ThreadZstdContexts().dctx, output->get(), len, data.RawData(),
+          data.Len(), dict.RawData(), dict.Len());
+      if (ZSTD_isError(r) || r != len)
+        return Status::Corruption("Uncompress: corrupted zstd block");
+      return Status::OK();
+    }
+#endif
+    default:
+      (void)dict;
+      output->reset();
+      return Status::NotSupported("Uncompress: compression type ")
+             << static_cast<int>(type);
+  }
+}
+
+std::string TrainDictionary(const std::string &samples,
+                            const std::vector<size_t> &sizes,
+                            size_t max_bytes) {
+  std::string dict;
+#ifdef LESSDB_HAVE_ZSTD
+  dict.resize(max_bytes);
+  size_t n = ZDICT_trainFromBuffer(&dict[0], max_bytes, samples.data(),
+                                   sizes.data(),
+                                   static_cast<unsigned>(sizes.size()));
+  if (ZDICT_isError(n))
+    n = 0;
+  dict.resize(n);
+#else
+  (void)samples;
+  (void)sizes;
+  (void)max_bytes;
+#endif
+  return dict;
+}
+
+}  // namespace compression
+
+}  // namespace lessdb
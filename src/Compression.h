@@ -0,0 +1,65 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Options.h"
+#include "Slice.h"
+#include "Status.h"
+
+namespace lessdb {
+
+namespace compression {
+
+// Returns true iff the library of "type" is compiled in. kNoCompression is
+// always supported.
+bool IsSupported(CompressionType type);
+
+// Compresses "input" by "type" into *output, which is the varint32 length of
+// "input" followed by the compressed data. A non-empty "dict" is a
+// dictionary trained by TrainDictionary(), it's only used by
+// kZstdCompression, as is "level".
+// Returns false if "type" is not supported or the compression failed.
+bool Compress(CompressionType type, int level, const Slice &dict,
+              const Slice &input, std::string *output);
+
+// Uncompresses "input", which was produced by Compress() with the same
+// "type" and "dict", into a buffer allocated by new[], which is stored in
+// *output along with its length in *n.
+Status Uncompress(CompressionType type, const Slice &dict, const Slice &input,
+                  std::unique_ptr<char[]> *output, size_t *n);
+
+// Trains a zstd dictionary of at most "max_bytes" from the samples
+// concatenated in "samples", the length of each is given by "sizes".
+// Returns an empty dictionary if zstd is not supported or the samples are
+// too few to train on.
+std::string TrainDictionary(const std::string &samples,
+                            const std::vector<size_t> &sizes,
+                            size_t max_bytes);
+
+}  // namespace compression
+
+}  // namespace lessdb
@@ -0,0 +1,138 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "Allocator.h"
+#include "Disallowcopying.h"
+
+namespace lessdb {
+
+// ConcurrentArena is a bump allocator guarded by a spin lock, so that
+// multiple threads may allocate from it at the same time. The critical
+// section is only the pointer bump (or a new block once in a while), which
+// makes the lock hardly contended.
+//
+// The blocks come from the heap, or from "allocator" if non-NULL, e.g to
+// place a memtable on a NUMA node. An allocation larger than a quarter of
+// the block size gets a block of its own, so that little of a block is
+// wasted.
+//
+// ConcurrentArena provides the same allocation interface as folly::SysArena,
+// for SkipList.
+class ConcurrentArena {
+  __DISALLOW_COPYING__(ConcurrentArena);
+
+ public:
+  static constexpr size_t kDefaultBlockSize = 4096;
+
+  explicit ConcurrentArena(Allocator *allocator = nullptr,
+                           size_t block_size = kDefaultBlockSize)
+      : allocator_(allocator),
+        block_size_(block_size),
+        ptr_(nullptr),
+        remaining_(0),
+        bytes_used_(0) {
+    lock_.clear();
+  }
+
+  ~ConcurrentArena() {
+    for (void *block : blocks_) {
+      if (allocator_)
+        allocator_->Deallocate(block);
+      else
+        free(block);
+    }
+  }
+
+  void *allocate(size_t size) {
+    // Every allocation is kept aligned for any type, like malloc.
+    size = (size + kAlign - 1) & ~(kAlign - 1);
+    while (lock_.test_and_set(std::memory_order_acquire)) {
+      // spin
+    }
+    char *mem;
+    if (size <= remaining_) {
+      mem = ptr_;
+      ptr_ += size;
+      remaining_ -= size;
+    } else {
+      mem = allocateFallback(size);
+    }
+    bytes_used_.store(bytes_used_.load(std::memory_order_relaxed) + size,
+                      std::memory_order_relaxed);
+    lock_.clear(std::memory_order_release);
+    return mem;
+  }
+
+  void deallocate(void *) {}
+
+  // The bytes handed out by allocate. Safe to be called concurrently with
+  // allocate.
+  size_t bytesUsed() const {
+    return bytes_used_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static constexpr size_t kAlign = alignof(std::max_align_t);
+
+  // REQUIRES: lock_ is held.
+  char *allocateFallback(size_t size) {
+    if (size > block_size_ / 4) {
+      return newBlock(size);
+    }
+    ptr_ = newBlock(block_size_);
+    remaining_ = block_size_ - size;
+    char *mem = ptr_;
+    ptr_ += size;
+    return mem;
+  }
+
+  // REQUIRES: lock_ is held.
+  char *newBlock(size_t size) {
+    void *block = allocator_ ? allocator_->Allocate(size) : malloc(size);
+    if (block == nullptr)
+      throw std::bad_alloc();
+    blocks_.push_back(block);
+    return static_cast<char *>(block);
+  }
+
+ private:
+  Allocator *const allocator_;
+  const size_t block_size_;
+
+  // The free space of the current block.
+  char *ptr_;
+  size_t remaining_;
+  std::vector<void *> blocks_;
+
+  std::atomic_flag lock_;
+  std::atomic<size_t> bytes_used_;
+};
+
+}  // namespace lessdb
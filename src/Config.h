@@ -0,0 +1,68 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace lessdb {
+
+// Grouping of constants. We may want to make some of these parameters set
+// via options.
+namespace config {
+
+static constexpr int kNumLevels = 7;
+
+// Level-0 compaction is started when we hit this many files.
+static constexpr int kL0_CompactionTrigger = 4;
+
+// Soft limit on number of level-0 files. We slow down writes at this point.
+static constexpr int kL0_SlowdownWritesTrigger = 8;
+
+// Maximum number of level-0 files. We stop writes at this point.
+static constexpr int kL0_StopWritesTrigger = 12;
+
+// The size target of each level is this many times of the previous one,
+// @see Options::max_bytes_for_level_base.
+static constexpr int kLevelSizeMultiplier = 10;
+
+// The files besides the tables a database keeps open: the log, the manifest,
+// and a few more, which are left out of Options::max_open_files for the
+// TableCache.
+static constexpr int kNumNonTableCacheFiles = 10;
+
+// Compactions read their input tables ahead up to this many bytes, see
+// ReadOptions::readahead_size.
+static constexpr size_t kCompactionReadaheadSize = 2 << 20;
+
+// SSTable::Open reads up to this many bytes off the end of a table at once,
+// which usually covers the footer, the index, the meta index and the meta
+// blocks, instead of reading them one after another.
+static constexpr size_t kTableTailPrefetchSize = 64 << 10;
+
+// A read thread serves up to about this many keys of the queued lookups of
+// DB::MultiGetAsync at once.
+static constexpr size_t kMaxAsyncReadBatch = 256;
+
+}  // namespace config
+
+}  // namespace lessdb
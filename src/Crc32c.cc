@@ -0,0 +1,177 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <boost/crc.hpp>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define LESSDB_CRC32C_X86 1
+#elif defined(__aarch64__) && defined(__linux__)
+#include <arm_acle.h>
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#define LESSDB_CRC32C_ARM64 1
+#endif
+
+#include "Crc32c.h"
+
+namespace lessdb {
+namespace crc32c {
+
+namespace {
+
+// Castagnoli polynomial, bit-reversed.
+const uint32_t kPolynomial = 0x82f63b78;
+
+// tables[k][b] is the crc of byte b followed by k zero bytes, which lets the
+// portable implementation process 8 bytes per step (slicing-by-8).
+struct Tables {
+  uint32_t t[8][256];
+
+  Tables() {
+    for (uint32_t b = 0; b < 256; b++) {
+      uint32_t crc = b;
+      for (int i = 0; i < 8; i++) {
+        crc = (crc >> 1) ^ ((crc & 1) ? kPolynomial : 0);
+      }
+      t[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+      for (int k = 1; k < 8; k++) {
+        t[k][b] = (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xff];
+      }
+    }
+  }
+};
+
+const Tables kTables;
+
+inline uint64_t LoadUnaligned64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+uint32_t ExtendPortable(uint32_t crc, const uint8_t *p, size_t n) {
+  const uint32_t(*t)[256] = kTables.t;
+  for (; n >= 8; n -= 8, p += 8) {
+    // Little-endian load of the next 8 bytes.
+    uint32_t lo = crc ^ (static_cast<uint32_t>(p[0]) |
+                         static_cast<uint32_t>(p[1]) << 8 |
+                         static_cast<uint32_t>(p[2]) << 16 |
+                         static_cast<uint32_t>(p[3]) << 24);
+    uint32_t hi = static_cast<uint32_t>(p[4]) |
+                  static_cast<uint32_t>(p[5]) << 8 |
+                  static_cast<uint32_t>(p[6]) << 16 |
+                  static_cast<uint32_t>(p[7]) << 24;
+    crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^
+          t[4][lo >> 24] ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+          t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+  }
+  for (; n > 0; n--, p++) {
+    crc = t[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(LESSDB_CRC32C_X86)
+
+__attribute__((target("sse4.2"))) uint32_t ExtendHardware(uint32_t crc,
+                                                          const uint8_t *p,
+                                                          size_t n) {
+#if defined(__x86_64__)
+  uint64_t crc64 = crc;
+  for (; n >= 8; n -= 8, p += 8) {
+    crc64 = _mm_crc32_u64(crc64, LoadUnaligned64(p));
+  }
+  crc = static_cast<uint32_t>(crc64);
+#endif
+  for (; n > 0; n--, p++) {
+    crc = _mm_crc32_u8(crc, *p);
+  }
+  return crc;
+}
+
+bool DetectHardware() {
+  return __builtin_cpu_supports("sse4.2");
+}
+
+#elif defined(LESSDB_CRC32C_ARM64)
+
+__attribute__((target("+crc"))) uint32_t ExtendHardware(uint32_t crc,
+                                                        const uint8_t *p,
+                                                        size_t n) {
+  for (; n >= 8; n -= 8, p += 8) {
+    crc = __crc32cd(crc, LoadUnaligned64(p));
+  }
+  for (; n > 0; n--, p++) {
+    crc = __crc32cb(crc, *p);
+  }
+  return crc;
+}
+
+bool DetectHardware() {
+  return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+
+#else
+
+uint32_t ExtendHardware(uint32_t crc, const uint8_t *p, size_t n) {
+  return ExtendPortable(crc, p, n);
+}
+
+bool DetectHardware() {
+  return false;
+}
+
+#endif
+
+const bool kHardware = DetectHardware();
+
+}  // namespace
+
+uint32_t Extend(uint32_t init_crc, const char *data, size_t n) {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+  uint32_t crc = init_crc ^ 0xffffffffu;
+  crc = kHardware ? ExtendHardware(crc, p, n) : ExtendPortable(crc, p, n);
+  return crc ^ 0xffffffffu;
+}
+
+bool IsHardwareAccelerated() {
+  return kHardware;
+}
+
+uint32_t TEST_ExtendPortable(uint32_t init_crc, const char *data, size_t n) {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+  return ExtendPortable(init_crc ^ 0xffffffffu, p, n) ^ 0xffffffffu;
+}
+
+}  // namespace crc32c
+
+uint32_t LegacyCrc32(const char *data, size_t n) {
+  boost::crc_32_type crc;
+  crc.process_bytes(data, n);
+  return static_cast<uint32_t>(crc.checksum());
+}
+
+}  // namespace lessdb
@@ -0,0 +1,57 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace lessdb {
+namespace crc32c {
+
+// Returns the crc32c of concat(A, data[0,n-1]) where init_crc is the crc32c of
+// some string A. Extend() is often used to maintain the crc32c of a stream of
+// data.
+//
+// The crc32 instruction of SSE4.2 or ARMv8 is used when the CPU supports it,
+// otherwise a table-driven implementation that processes 8 bytes at a time.
+uint32_t Extend(uint32_t init_crc, const char *data, size_t n);
+
+// Returns the crc32c of data[0,n-1].
+inline uint32_t Value(const char *data, size_t n) {
+  return Extend(0, data, n);
+}
+
+// Whether Extend() runs on the crc32 instruction of the CPU.
+bool IsHardwareAccelerated();
+
+// Extend() by the table-driven implementation regardless of the CPU.
+uint32_t TEST_ExtendPortable(uint32_t init_crc, const char *data, size_t n);
+
+}  // namespace crc32c
+
+// The checksum used by the file formats before crc32c was adopted, i.e the
+// crc32 (IEEE 802.3) computed by boost::crc_32_type. Only used to verify old
+// files.
+uint32_t LegacyCrc32(const char *data, size_t n);
+
+}  // namespace lessdb
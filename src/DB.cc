@@ -3,3 +3,89 @@
 //
 
 #include "DB.h"
+#include "DBImpl.h"
+#include "Status.h"
+#include "WriteBatch.h"
+
+namespace lessdb {
+
+Status DB::Open(const Options &options, const std::string &name,
+                DB **dbptr) {
+  *dbptr = nullptr;
+
+  std::unique_ptr<DBImpl> impl(new DBImpl(options, name));
+  Status s = impl->Recover();
+  if (s) {
+    *dbptr = new DB(impl.release());
+  }
+  return s;
+}
+
+DB::DB(DBImpl *impl) : pImpl_(impl) {}
+
+DB::~DB() = default;
+
+Status DB::Put(const WriteOptions &options, const Slice &key,
+               const Slice &value) {
+  WriteBatch batch;
+  batch.Put(key, value);
+  return Write(options, &batch);
+}
+
+Status DB::Delete(const WriteOptions &options, const Slice &key) {
+  WriteBatch batch;
+  batch.Delete(key);
+  return Write(options, &batch);
+}
+
+Status DB::DeleteRange(const WriteOptions &options, const Slice &begin,
+                       const Slice &end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  return Write(options, &batch);
+}
+
+Status DB::Write(const WriteOptions &options, WriteBatch *updates) {
+  return pImpl_->Write(options, updates);
+}
+
+Status DB::Get(const ReadOptions &options, const Slice &key,
+               std::string *value) {
+  return pImpl_->Get(options, key, value);
+}
+
+std::vector<Status> DB::MultiGet(const ReadOptions &options,
+                                 const std::vector<Slice> &keys,
+                                 std::vector<std::string> *values) {
+  return pImpl_->MultiGet(options, keys, values);
+}
+
+void DB::GetAsync(const ReadOptions &options, const Slice &key,
+                  GetCallback callback) {
+  pImpl_->GetAsync(options, key, std::move(callback));
+}
+
+void DB::MultiGetAsync(const ReadOptions &options,
+                       const std::vector<Slice> &keys,
+                       MultiGetCallback callback) {
+  pImpl_->MultiGetAsync(options, keys, std::move(callback));
+}
+
+const Snapshot *DB::GetSnapshot() {
+  return pImpl_->GetSnapshot();
+}
+
+void DB::ReleaseSnapshot(const Snapshot *snapshot) {
+  pImpl_->ReleaseSnapshot(snapshot);
+}
+
+DBIterator *DB::NewIterator(const ReadOptions &options, const Slice &start) {
+  return pImpl_->NewIterator(options, start);
+}
+
+Status DB::IngestExternalFile(const IngestExternalFileOptions &options,
+                              const std::vector<std::string> &files) {
+  return pImpl_->IngestExternalFile(options, files);
+}
+
+}  // namespace lessdb
@@ -4,17 +4,136 @@
 
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "Disallowcopying.h"
+#include "SliceFwd.h"
+
+namespace lessdb {
 
-class Status;
 class DBImpl;
+class DBIterator;
+class Snapshot;
+class Status;
+class WriteBatch;
+struct IngestExternalFileOptions;
+struct Options;
+struct ReadOptions;
+struct WriteOptions;
 
+// Called by DB::GetAsync with the status and the value of the key, as
+// DB::Get would return them.
+typedef std::function<void(const Status &status, const std::string &value)>
+    GetCallback;
+
+// Called by DB::MultiGetAsync with the statuses and the values of the keys,
+// as DB::MultiGet would return them.
+typedef std::function<void(const std::vector<Status> &statuses,
+                           const std::vector<std::string> &values)>
+    MultiGetCallback;
+
+// A DB is a persistent ordered map from keys to values.
+// A DB is safe for concurrent access from multiple threads without any
+// external synchronization.
 class DB {
   __DISALLOW_COPYING__(DB);
 
  public:
+  // Opens the database with the specified "name", replaying the updates in
+  // its log files that are not yet persisted elsewhere.
+  // Stores a pointer to a heap-allocated database in *dbptr and returns OK
+  // on success. Stores nullptr in *dbptr and returns a non-OK status on
+  // error. Caller should delete *dbptr when it is no longer needed.
+  static Status Open(const Options &options, const std::string &name,
+                     DB **dbptr);
+
+  ~DB();
+
+  // Set the database entry for "key" to "value".
+  Status Put(const WriteOptions &options, const Slice &key,
+             const Slice &value);
+
+  // Remove the database entry (if any) for "key". It is not an error if
+  // "key" did not exist in the database.
+  Status Delete(const WriteOptions &options, const Slice &key);
+
+  // Remove the database entries (if any) for the keys in ["begin", "end"),
+  // by a single range tombstone whatever the number of keys.
+  Status DeleteRange(const WriteOptions &options, const Slice &begin,
+                     const Slice &end);
+
+  // Apply the specified updates to the database atomically.
+  Status Write(const WriteOptions &options, WriteBatch *updates);
+
+  // If the database contains an entry for "key" store the
+  // corresponding value in *value and return OK.
+  //
+  // If there is no entry for "key" leave *value unchanged and return
+  // a status for which Status::IsNotFound() returns true.
+  //
+  // May return some other Status on an error.
+  Status Get(const ReadOptions &options, const Slice &key,
+             std::string *value);
+
+  // Looks up all the "keys" at once, as of the same state. Stores the value
+  // of keys[i] in (*values)[i] and returns its status, as Get does for a
+  // single key. The data blocks that several keys are looked up in are read
+  // from each sstable in one batch.
+  std::vector<Status> MultiGet(const ReadOptions &options,
+                               const std::vector<Slice> &keys,
+                               std::vector<std::string> *values);
+
+  // Looks up "key" as Get does, without blocking on reads from file:
+  // "callback" is called on the calling thread before returning if the key
+  // is found in memory, otherwise later by a read thread of
+  // Options::thread_pool, once its blocks are read. The lookups queued
+  // meanwhile are served together as by MultiGet, so that a few read
+  // threads keep many reads in flight.
+  // REQUIRES: options.snapshot, if any, is not released before "callback"
+  // is called. Deleting the DB waits for the pending callbacks.
+  void GetAsync(const ReadOptions &options, const Slice &key,
+                GetCallback callback);
+
+  // The asynchronous MultiGet, as GetAsync is to Get.
+  void MultiGetAsync(const ReadOptions &options,
+                     const std::vector<Slice> &keys,
+                     MultiGetCallback callback);
+
+  // Return a handle to the current DB state.  Iterators created with
+  // this handle will all observe a stable snapshot of the current DB
+  // state.  The caller must call ReleaseSnapshot(result) when the
+  // snapshot is no longer needed.
+  const Snapshot *GetSnapshot();
+
+  // Release a previously acquired snapshot.  The caller must not
+  // use "snapshot" after this call.
+  void ReleaseSnapshot(const Snapshot *snapshot);
+
+  // Returns a heap-allocated iterator over the contents of the database as
+  // of options.snapshot, or the current state if it's NULL, from the first
+  // key >= "start". The caller should delete the iterator before the DB.
+  DBIterator *NewIterator(const ReadOptions &options, const Slice &start);
+
+  // Adds the sstables "files", built outside of the database by
+  // SSTableBuilder, to the database as if their entries were written by a
+  // single batch, newer than every previous write. The tables must be keyed
+  // by InternalKeys, with InternalKeyComparator as Options::comparator, and
+  // with every sequence 0: e.g. InternalKeyBuf(key, 0, kTypeValue) for a
+  // key-value pair, or kTypeDeletion for a deletion. Each user key may only
+  // appear once, and the key ranges of the files must not overlap.
+  //
+  // The files are linked into the lowest level that doesn't overlap them,
+  // without being rewritten.
+  Status IngestExternalFile(const IngestExternalFileOptions &options,
+                            const std::vector<std::string> &files);
+
  private:
+  explicit DB(DBImpl *impl);
+
   std::unique_ptr<DBImpl> pImpl_;
 };
+
+}  // namespace lessdb
@@ -30,6 +30,21 @@ typedef uint64_t SequenceNumber;
 
 static constexpr SequenceNumber kMaxSequenceNumber = ((1ull << 56) - 1);
 
-enum ValueType { kTypeDeletion = 0x00, kTypeValue = 0x01 };
+// kTypeBlobIndex is only found in sstables, whose value is then a BlobIndex
+// to the actual value in a blob file. @see Options::min_blob_size
+// kTypeRangeDeletion is the type of a range tombstone, whose key is the
+// begin key of the range and value the end key. The tombstones are kept
+// apart from the other entries, @see RangeTombstone.h
+enum ValueType {
+  kTypeDeletion = 0x00,
+  kTypeValue = 0x01,
+  kTypeBlobIndex = 0x02,
+  kTypeRangeDeletion = 0x03
+};
+
+// The trailing 8 bytes of an InternalKey.
+inline uint64_t PackSequenceAndType(SequenceNumber sequence, ValueType type) {
+  return static_cast<uint64_t>((sequence << 8) | static_cast<uint8_t>(type));
+}
 
 }  // namespace lessdb
\ No newline at end of file
@@ -20,16 +20,2498 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <vector>
+
+#include "BlobFile.h"
+#include "Block.h"
+#include "CacheStrategy.h"
+#include "Coding.h"
+#include "Compaction.h"
+#include "Config.h"
 #include "DBImpl.h"
+#include "DBIterator.h"
+#include "FileName.h"
+#include "FileUtils.h"
+#include "LogReader.h"
+#include "LogWriter.h"
+#include "MemTable.h"
+#include "MergingIterator.h"
+#include "RangeTombstone.h"
+#include "RateLimiter.h"
+#include "SSTable.h"
+#include "SSTableBuilder.h"
+#include "Statistics.h"
+#include "ThreadPool.h"
+#include "Version.h"
+#include "VersionEdit.h"
+#include "VersionSet.h"
+#include "WriteBatchImpl.h"
+#include "WriteBufferManager.h"
 
 namespace lessdb {
 
 struct DBImpl::Writer {
   std::condition_variable cv;
   Status status;
+  WriteBatch *batch;
   bool sync;  // WriteOptions.sync
+  bool done;
+
+  // Set by the group leader when the writer should insert its own batch into
+  // the memtable, which is assigned with the starting sequence "sequence".
+  bool insert_in_parallel;
+  SequenceNumber sequence;
+
+  explicit Writer(WriteBatch *b)
+      : batch(b),
+        sync(false),
+        done(false),
+        insert_in_parallel(false),
+        sequence(0) {}
+};
+
+static FileFactory *GetFileFactory(const Options &options) {
+  return options.file_factory ? options.file_factory : FileFactory::Default();
+}
+
+static ThreadPool *GetThreadPool(const Options &options) {
+  return options.thread_pool ? options.thread_pool : ThreadPool::Default();
+}
+
+DBImpl::DBImpl(const Options &options, WritableFile *logfile)
+    : options_(options),
+      internal_comparator_(options.comparator),
+      internal_prefix_extractor_(options.prefix_extractor),
+      file_factory_(GetFileFactory(options)),
+      logfile_(logfile),
+      logfile_number_(0),
+      log_(new log::Writer(logfile, options.wal_bytes_per_sync)),
+      mem_(new MemTable(internal_comparator_, options_.allocator,
+                        options_.memtable_rep)),
+      mem_reserved_(0),
+      imm_reserved_(0),
+      thread_pool_(GetThreadPool(options)),
+      flush_scheduled_(false),
+      compaction_scheduled_(false),
+      ingesting_(false),
+      flush_job_(0),
+      compaction_job_(0),
+      shutting_down_(false),
+      last_sequence_(0),
+      async_jobs_(0),
+      pending_parallel_inserts_(0) {}
+
+DBImpl::DBImpl(const Options &options, const std::string &dbname)
+    : options_(options),
+      internal_comparator_(options.comparator),
+      internal_prefix_extractor_(options.prefix_extractor),
+      dbname_(dbname),
+      file_factory_(GetFileFactory(options)),
+      logfile_(nullptr),
+      logfile_number_(0),
+      mem_(new MemTable(internal_comparator_, options_.allocator,
+                        options_.memtable_rep)),
+      mem_reserved_(0),
+      imm_reserved_(0),
+      versions_(new VersionSet(dbname_, &options_, &internal_comparator_,
+                               file_factory_)),
+      thread_pool_(GetThreadPool(options)),
+      flush_scheduled_(false),
+      compaction_scheduled_(false),
+      ingesting_(false),
+      flush_job_(0),
+      compaction_job_(0),
+      shutting_down_(false),
+      last_sequence_(0),
+      async_jobs_(0),
+      pending_parallel_inserts_(0) {}
+
+DBImpl::~DBImpl() {
+  // A flush or compaction not started yet is canceled, a running one is
+  // waited for, while an immutable memtable not yet flushed is left to the
+  // next recovery, its log is still there.
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    shutting_down_ = true;
+    bg_cv_.notify_all();
+    if (flush_scheduled_ && thread_pool_->Cancel(flush_job_))
+      flush_scheduled_ = false;
+    if (compaction_scheduled_ && thread_pool_->Cancel(compaction_job_))
+      compaction_scheduled_ = false;
+    // The queued lookups are still served, their callbacks are waiting.
+    while (flush_scheduled_ || compaction_scheduled_ || async_jobs_ > 0) {
+      bg_cv_.wait(lock);
+    }
+  }
+  if (dump_thread_.joinable()) {
+    dump_thread_.join();
+    DumpBlockCache();
+  }
+
+  if (owned_logfile_) {
+    owned_logfile_->Close();
+  }
+  if (options_.write_buffer_manager) {
+    options_.write_buffer_manager->ScheduleFreeMem(mem_reserved_);
+    options_.write_buffer_manager->FreeMem(mem_reserved_ + imm_reserved_);
+  }
+}
+
+Status DBImpl::newDB() {
+  VersionEdit new_db;
+  new_db.SetComparatorName(options_.comparator->Name());
+  new_db.SetLogNumber(0);
+  new_db.SetNextFile(2);
+  new_db.SetLastSequence(0);
+
+  const std::string manifest = DescriptorFileName(dbname_, 1);
+  Status s;
+  std::unique_ptr<WritableFile> file(
+      file_factory_->NewWritableFile(manifest, &s));
+  if (!s)
+    return s;
+  {
+    log::Writer log(file.get());
+    std::string record;
+    new_db.EncodeTo(&record);
+    s = log.WriteRecord(record);
+    if (s)
+      s = log.Sync();
+  }
+  Status close = file->Close();
+  if (s)
+    s = close;
+
+  if (s) {
+    // Make "CURRENT" file that points to the new manifest file.
+    s = SetCurrentFile(file_factory_, dbname_, 1);
+  }
+  if (!s) {
+    file_factory_->DeleteFile(manifest);
+  }
+  return s;
+}
+
+Status DBImpl::Recover() {
+  assert(!dbname_.empty() && !log_);
+
+  Status s;
+  if (!file_factory_->FileExists(dbname_)) {
+    if (!options_.create_if_missing) {
+      return Status::IOError(dbname_)
+             << ": does not exist (create_if_missing is false)";
+    }
+    s = file_factory_->CreateDirIfMissing(dbname_);
+    if (!s)
+      return s;
+  }
+
+  if (!file_factory_->FileExists(CurrentFileName(dbname_))) {
+    if (!options_.create_if_missing) {
+      return Status::InvalidArgument(dbname_)
+             << ": does not exist (create_if_missing is false)";
+    }
+    s = newDB();
+    if (!s)
+      return s;
+  }
+
+  s = versions_->Recover();
+  if (!s)
+    return s;
+  last_sequence_ = versions_->LastSequence();
+  if (options_.table_loading_threads > 0 ||
+      (options_.block_cache_dump_period_sec > 0 && options_.block_cache))
+    loadTables();
+
+  std::vector<std::string> filenames;
+  s = file_factory_->GetChildren(dbname_, &filenames);
+  if (!s)
+    return s;
+
+  // The logs older than versions_->LogNumber() have been flushed to the
+  // sstables.
+  std::vector<uint64_t> logs;
+  for (const std::string &filename : filenames) {
+    uint64_t number;
+    FileType type;
+    if (ParseFileName(filename, &number, &type) &&
+        type == FileType::kLogFile && number >= versions_->LogNumber()) {
+      logs.push_back(number);
+    }
+  }
+
+  // The sequence numbers increase across the logs in the order they were
+  // created.
+  std::sort(logs.begin(), logs.end());
+  for (uint64_t number : logs) {
+    s = recoverLogFile(number);
+    if (!s)
+      return s;
+    versions_->MarkFileNumberUsed(number);
+  }
+
+  // The recovered logs are kept until the memtable is flushed, since the
+  // updates in them only live in the memtable.
+  s = newLogFile(versions_->NewFileNumber());
+  if (!s)
+    return s;
+
+  {
+    // Starts a new manifest, which the CURRENT file is switched to, so the
+    // recovered one can be deleted.
+    std::unique_lock<std::mutex> lock(mutex_);
+    VersionEdit edit;
+    versions_->SetLastSequence(last_sequence_);
+    s = versions_->LogAndApply(&edit, &lock);
+    if (!s)
+      return s;
+    deleteObsoleteFiles(lock);
+    maybeScheduleWork();
+  }
+  if (options_.block_cache_dump_period_sec > 0 && options_.block_cache)
+    dump_thread_ = std::thread(&DBImpl::dumpBlockCachePeriodically, this);
+  return s;
+}
+
+// The BLOCKCACHE file is in the log format, with a record for each sstable:
+// record := file_number num_offsets (offset_delta)*
+// file_number, num_offsets and offset_delta are varint64, the offsets are
+// sorted and each is encoded as the delta from the previous one.
+Status DBImpl::DumpBlockCache() {
+  CacheStrategy *cache = options_.block_cache;
+  if (!cache)
+    return Status::OK();
+
+  // The blocks are keyed by the cache ids of the tables, which are only
+  // known for the open tables, and change as a table is opened again.
+  std::map<uint64_t, uint64_t> tables;  // cache id -> file number
+  versions_->table_cache()->VisitTables(
+      [&tables](uint64_t number, const SSTable &table) {
+        tables[table.BlockCacheId()] = number;
+      });
+  std::map<uint64_t, std::vector<uint64_t>> blocks;  // file number -> offsets
+  cache->VisitKeys([&](const Slice &key) {
+    uint64_t cache_id, offset;
+    if (!SSTable::DecodeBlockCacheKey(key, &cache_id, &offset))
+      return;
+    auto it = tables.find(cache_id);
+    if (it != tables.end())
+      blocks[it->second].push_back(offset);
+  });
+
+  uint64_t number;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    number = versions_->NewFileNumber();
+    pending_outputs_.insert(number);
+  }
+  const std::string tmp = TempFileName(dbname_, number);
+  Status s;
+  std::unique_ptr<WritableFile> file(file_factory_->NewWritableFile(tmp, &s));
+  if (s) {
+    log::Writer log(file.get());
+    std::string record;
+    for (auto &table : blocks) {
+      std::vector<uint64_t> &offsets = table.second;
+      std::sort(offsets.begin(), offsets.end());
+      record.clear();
+      coding::AppendVar64(&record, table.first);
+      coding::AppendVar64(&record, offsets.size());
+      uint64_t last = 0;
+      for (uint64_t offset : offsets) {
+        coding::AppendVar64(&record, offset - last);
+        last = offset;
+      }
+      s = log.WriteRecord(record);
+      if (!s)
+        break;
+    }
+    if (s)
+      s = log.Sync();
+    Status close = file->Close();
+    if (s)
+      s = close;
+    if (s)
+      s = file_factory_->RenameFile(tmp, BlockCacheDumpFileName(dbname_));
+    if (!s)
+      file_factory_->DeleteFile(tmp);
+  }
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  pending_outputs_.erase(number);
+  return s;
+}
+
+void DBImpl::loadTables() {
+  // A corrupted record is skipped.
+  std::map<uint64_t, std::vector<uint64_t>> blocks;  // file number -> offsets
+  Status s;
+  std::unique_ptr<SequentialFile> file;
+  if (options_.block_cache_dump_period_sec > 0 && options_.block_cache) {
+    file.reset(file_factory_->NewSequentialFile(
+        BlockCacheDumpFileName(dbname_), &s));
+  }
+  if (file) {
+    log::Reader reader(file.get(), nullptr, true);
+    std::string scratch;
+    Slice record;
+    while (reader.ReadRecord(&record, &scratch)) {
+      uint64_t number, count;
+      if (!coding::ParseVar64(&record, &number) ||
+          !coding::ParseVar64(&record, &count))
+        continue;
+      std::vector<uint64_t> offsets;
+      uint64_t offset = 0, delta;
+      while (offsets.size() < count && coding::ParseVar64(&record, &delta)) {
+        offset += delta;
+        offsets.push_back(offset);
+      }
+      if (offsets.size() == count)
+        blocks[number] = std::move(offsets);
+    }
+  }
+
+  // The blocks of the tables compacted away since the dump are gone. The
+  // tables beyond the capacity of the table cache would only evict each
+  // other.
+  const size_t max_tables = static_cast<size_t>(std::max(
+      options_.max_open_files - config::kNumNonTableCacheFiles, 1));
+  std::vector<const FileMetaData *> files;
+  const Version *current = versions_->current();
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (const FileMetaData *f : current->Files(level)) {
+      if (files.size() < max_tables &&
+          (options_.table_loading_threads > 0 || blocks.count(f->number)))
+        files.push_back(f);
+    }
+  }
+
+  std::atomic<size_t> next(0);
+  auto load = [&]() {
+    for (size_t i; (i = next.fetch_add(1)) < files.size();) {
+      Status status;
+      std::shared_ptr<SSTable> table = versions_->table_cache()->Get(
+          files[i]->number, files[i]->file_size, &status);
+      auto it = blocks.find(files[i]->number);
+      if (table && it != blocks.end())
+        table->WarmUp(ReadOptions(), it->second);
+    }
+  };
+
+  // Like the subcompactions, on threads of their own, the tables are mostly
+  // waiting for their reads.
+  size_t num_threads = std::min(
+      files.size(),
+      static_cast<size_t>(std::max(options_.table_loading_threads, 1)));
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; i++) {
+    threads.emplace_back(load);
+  }
+  load();
+  for (std::thread &t : threads) {
+    t.join();
+  }
+}
+
+void DBImpl::dumpBlockCachePeriodically() {
+  const std::chrono::seconds period(options_.block_cache_dump_period_sec);
+  std::unique_lock<std::mutex> lock(mutex_);
+  // bg_cv_ is also signaled by every flush and compaction.
+  auto next = std::chrono::steady_clock::now() + period;
+  while (!shutting_down_) {
+    if (bg_cv_.wait_until(lock, next) == std::cv_status::timeout &&
+        !shutting_down_) {
+      lock.unlock();
+      DumpBlockCache();
+      lock.lock();
+      next = std::chrono::steady_clock::now() + period;
+    }
+  }
+}
+
+Status DBImpl::newLogFile(uint64_t number) {
+  Status s;
+  WritableFile *file =
+      file_factory_->NewWritableFile(LogFileName(dbname_, number), &s);
+  if (!s)
+    return s;
+
+  if (owned_logfile_) {
+    // Every update in the old log has been flushed by its writer.
+    s = owned_logfile_->Close();
+  }
+  owned_logfile_.reset(file);
+  logfile_ = file;
+  logfile_number_ = number;
+  log_.reset(new log::Writer(file, options_.wal_bytes_per_sync));
+  return s;
+}
+
+Status DBImpl::recoverLogFile(uint64_t number) {
+  struct LogReporter : public log::Reader::Reporter {
+    Status status;  // The first corruption reported.
+
+    void Corruption(size_t bytes, const Status &s) override {
+      if (status)
+        status = s;
+    }
+  };
+
+  const std::string fname = LogFileName(dbname_, number);
+  Status s;
+  std::unique_ptr<SequentialFile> file(
+      file_factory_->NewSequentialFile(fname, &s));
+  if (!s)
+    return s;
+
+  LogReporter reporter;
+  log::Reader reader(file.get(), &reporter, true,
+                     options_.wal_recovery_threads);
+  std::string scratch;
+  Slice record;
+  WriteBatch batch;
+
+  while (reader.ReadRecord(&record, &scratch)) {
+    if (record.Len() < WriteBatchImpl::HeaderSize()) {
+      reporter.Corruption(record.Len(),
+                          Status::Corruption("log record too small"));
+    } else {
+      batch.pImpl_->SetContents(record);
+      Status insert = batch.InsertInto(mem_.get());
+      if (!insert) {
+        reporter.Corruption(record.Len(), insert);
+      }
+      SequenceNumber last =
+          batch.pImpl_->Sequence() + batch.pImpl_->Count() - 1;
+      if (last > last_sequence_)
+        last_sequence_ = last;
+    }
+
+    if (options_.paranoid_checks && !reporter.status) {
+      return Status(reporter.status) << " in " << fname.c_str();
+    }
+  }
+  return s;
+}
+
+Status DBImpl::Write(const WriteOptions &options, WriteBatch *batch) {
+  StopWatch sw(options_.statistics, kWriteMicros);
+  Writer w(batch);
+  w.sync = options.sync;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!bg_error_) {
+    return bg_error_;
+  }
+  writers_.push_back(&w);
+  while (!w.done && !w.insert_in_parallel && &w != writers_.front()) {
+    w.cv.wait(lock);
+  }
+
+  if (w.insert_in_parallel) {
+    // The group leader has committed our updates to the log, insert them
+    // into the memtable along with the other writers of the group.
+    lock.unlock();
+    w.status = insertInto(w.batch, true);
+    lock.lock();
+
+    if (--pending_parallel_inserts_ == 0) {
+      writers_.front()->cv.notify_one();  // the leader
+    }
+    while (!w.done) {
+      w.cv.wait(lock);
+    }
+  }
+
+  // Some group leader has already committed our updates.
+  if (w.done) {
+    return w.status;
+  }
+
+  // w is now the leader of a write group.
+  Status s = makeRoomForWrite(lock);
+  if (!s) {
+    // Fails alone, the next leader will find out the error by itself.
+    writers_.pop_front();
+    if (!writers_.empty()) {
+      writers_.front()->cv.notify_one();
+    }
+    return s;
+  }
+
+  Writer *last_writer = &w;
+  buildBatchGroup(&last_writer);
+  SequenceNumber last_sequence = last_sequence_;
+  int count = 0;
+  for (Writer *writer : group_) {
+    writer->sequence = last_sequence + 1 + count;
+    writer->batch->pImpl_->SetSequence(writer->sequence);
+    count += writer->batch->pImpl_->Count();
+  }
+
+  // The group is logged as a single record, a batch header followed by the
+  // records of every batch, which are handed to the log in place instead of
+  // being merged into one batch.
+  log_pieces_.clear();
+  if (group_.size() == 1) {
+    log_pieces_.push_back(w.batch->pImpl_->Contents());
+  } else {
+    static_assert(sizeof(group_header_) == WriteBatchImpl::HeaderSize(),
+                  "group_header_ holds a batch header");
+    WriteBatchImpl::EncodeHeader(group_header_, last_sequence + 1, count);
+    log_pieces_.push_back(Slice(group_header_, sizeof(group_header_)));
+    for (Writer *writer : group_) {
+      log_pieces_.push_back(writer->batch->pImpl_->Records());
+    }
+  }
+  last_sequence += count;
+
+  bool parallel =
+      options_.allow_concurrent_memtable_write && group_.size() > 1;
+
+  bool log_failed = false;
+  {
+    // The log and memtable are only ever touched by the writers of the
+    // current group, so it's safe to release the lock here, which allows the
+    // following writers to queue up their batches into the next group.
+    lock.unlock();
+
+    {
+      StopWatch log_sw(options_.statistics, kWalWriteMicros);
+      s = log_->WriteRecord(log_pieces_.data(), log_pieces_.size());
+      size_t bytes = 0;
+      for (const Slice &piece : log_pieces_)
+        bytes += piece.Len();
+      RecordTick(options_.statistics, kWalWrites);
+      RecordTick(options_.statistics, kWalBytes, bytes);
+    }
+    if (s && w.sync) {
+      StopWatch sync_sw(options_.statistics, kWalSyncMicros);
+      s = log_->Sync();
+      RecordTick(options_.statistics, kWalSyncs);
+    }
+    log_failed = !s;
+    if (s && !parallel) {
+      for (Writer *writer : group_) {
+        s = insertInto(writer->batch, false);
+        if (!s)
+          break;
+      }
+    }
+
+    lock.lock();
+  }
+
+  if (log_failed) {
+    // The log may end with a part of the group's record, past which the
+    // records of later groups could not be recovered, so every write fails
+    // from now on, and the group is not made visible.
+    bg_error_ = s;
+  }
+
+  if (s && parallel) {
+    // Every writer of the group inserts its own batch concurrently, readers
+    // are not aware of the new records until last_sequence_ is updated.
+    for (Writer *writer : group_) {
+      if (writer != &w) {
+        writer->insert_in_parallel = true;
+        pending_parallel_inserts_++;
+        writer->cv.notify_one();
+      }
+    }
+
+    lock.unlock();
+    s = insertInto(w.batch, true);
+    lock.lock();
+
+    while (pending_parallel_inserts_ > 0) {
+      w.cv.wait(lock);
+    }
+  }
+
+  if (!log_failed)
+    last_sequence_ = last_sequence;
+
+  // Wake up all the writers whose updates are committed by this group.
+  while (true) {
+    Writer *ready = writers_.front();
+    writers_.pop_front();
+    if (ready != &w) {
+      // Keep the error of a failed parallel insertion.
+      if (ready->status)
+        ready->status = s;
+      ready->done = true;
+      ready->cv.notify_one();
+    }
+    if (ready == last_writer)
+      break;
+  }
+
+  // Notify the new head of the write queue.
+  if (!writers_.empty()) {
+    writers_.front()->cv.notify_one();
+  }
+  return s;
+}
+
+Status DBImpl::insertInto(WriteBatch *batch, bool concurrently) {
+  StopWatch sw(options_.statistics, kMemtableInsertMicros);
+  RecordTick(options_.statistics, kMemtableInserts, batch->pImpl_->Count());
+  return batch->InsertInto(mem_.get(), concurrently);
+}
+
+Status DBImpl::Get(const ReadOptions &options, const Slice &key,
+                   std::string *value) {
+  StopWatch sw(options_.statistics, kGetMicros);
+  LatencyReporter reporter(options_.rate_limiter);
+  std::unique_lock<std::mutex> lock(mutex_);
+  const SequenceNumber snapshot =
+      options.snapshot ? options.snapshot->sequence() : last_sequence_;
+  std::shared_ptr<MemTable> mem = mem_;
+  std::shared_ptr<MemTable> imm = imm_;
+  Version *current = versions_ ? versions_->current() : nullptr;
+  if (current)
+    current->Ref();
+  lock.unlock();
+
+  // The memtables and the version are taken at once, so every update up to
+  // the snapshot is in one of them, even if a flush is done meanwhile.
+  Status s;
+  if (mem->Get(key, snapshot, value, &s)) {
+    // Done
+  } else if (imm && imm->Get(key, snapshot, value, &s)) {
+    // Done
+  } else if (current) {
+    InternalKeyBuf lookup(key, snapshot, kTypeValue);
+    s = current->Get(options, lookup.Data(), value);
+  } else {
+    s = Status::NotFound(Slice());
+  }
+
+  if (current) {
+    lock.lock();
+    current->Unref();
+  }
+  return s;
+}
+
+std::vector<Status> DBImpl::MultiGet(const ReadOptions &options,
+                                     const std::vector<Slice> &keys,
+                                     std::vector<std::string> *values) {
+  SequenceNumber snapshot;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    snapshot = options.snapshot ? options.snapshot->sequence() : last_sequence_;
+  }
+  std::vector<SequenceNumber> sequences(keys.size(), snapshot);
+  std::vector<Status> statuses(keys.size());
+  values->resize(keys.size());
+  lookup(options, keys.data(), sequences.data(), keys.size(), values->data(),
+         statuses.data());
+  return statuses;
+}
+
+void DBImpl::lookup(const ReadOptions &options, const Slice *keys,
+                    const SequenceNumber *sequences, size_t n,
+                    std::string *values, Status *statuses) {
+  // Every update up to the sequences is in one of them, as in Get.
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::shared_ptr<MemTable> mem = mem_;
+  std::shared_ptr<MemTable> imm = imm_;
+  Version *current = versions_ ? versions_->current() : nullptr;
+  if (current)
+    current->Ref();
+  lock.unlock();
+
+  std::vector<size_t> missing;
+  for (size_t i = 0; i < n; i++) {
+    if (!mem->Get(keys[i], sequences[i], &values[i], &statuses[i]) &&
+        !(imm && imm->Get(keys[i], sequences[i], &values[i], &statuses[i])))
+      missing.push_back(i);
+  }
+  if (!current) {
+    for (size_t i : missing)
+      statuses[i] = Status::NotFound(Slice());
+    return;
+  }
+
+  if (!missing.empty()) {
+    std::vector<InternalKeyBuf> bufs;
+    bufs.reserve(missing.size());
+    std::vector<Slice> lookups;
+    for (size_t i : missing) {
+      bufs.emplace_back(keys[i], sequences[i], kTypeValue);
+      lookups.push_back(bufs.back().Data());
+    }
+    std::vector<std::string> found(missing.size());
+    std::vector<Status> found_statuses(missing.size());
+    current->MultiGet(options, lookups.data(), lookups.size(), found.data(),
+                      found_statuses.data());
+    for (size_t j = 0; j < missing.size(); j++) {
+      values[missing[j]].swap(found[j]);
+      statuses[missing[j]] = found_statuses[j];
+    }
+  }
+
+  lock.lock();
+  current->Unref();
+}
+
+struct DBImpl::AsyncRead {
+  ReadOptions options;
+  // The snapshot held by the lookup itself, if options.snapshot was NULL.
+  const Snapshot *snapshot;
+  std::vector<std::string> keys;
+  // The indexes of the keys missing from the memtables.
+  std::vector<size_t> missing;
+  std::vector<Status> statuses;
+  std::vector<std::string> values;
+  MultiGetCallback callback;
+
+  AsyncRead() : snapshot(nullptr) {}
+};
+
+void DBImpl::GetAsync(const ReadOptions &options, const Slice &key,
+                      GetCallback callback) {
+  MultiGetAsync(options, std::vector<Slice>(1, key),
+                [callback](const std::vector<Status> &statuses,
+                           const std::vector<std::string> &values) {
+                  callback(statuses[0], values[0]);
+                });
+}
+
+void DBImpl::MultiGetAsync(const ReadOptions &options,
+                           const std::vector<Slice> &keys,
+                           MultiGetCallback callback) {
+  const size_t n = keys.size();
+  std::unique_ptr<AsyncRead> read(new AsyncRead);
+  read->options = options;
+  read->statuses.resize(n);
+  read->values.resize(n);
+  read->callback = std::move(callback);
+
+  // A snapshot is taken along with the memtables, so that the keys looked up
+  // later on a read thread are read as of the same state, whose entries the
+  // compactions keep meanwhile.
+  std::unique_lock<std::mutex> lock(mutex_);
+  const SequenceNumber snapshot =
+      options.snapshot ? options.snapshot->sequence() : last_sequence_;
+  std::shared_ptr<MemTable> mem = mem_;
+  std::shared_ptr<MemTable> imm = imm_;
+  if (!options.snapshot && versions_) {
+    read->snapshot = snapshots_.New(snapshot);
+    read->options.snapshot = read->snapshot;
+  }
+  lock.unlock();
+
+  for (size_t i = 0; i < n; i++) {
+    if (!mem->Get(keys[i], snapshot, &read->values[i], &read->statuses[i]) &&
+        !(imm && imm->Get(keys[i], snapshot, &read->values[i],
+                          &read->statuses[i])))
+      read->missing.push_back(i);
+  }
+  if (read->missing.empty() || !versions_) {
+    for (size_t i : read->missing)
+      read->statuses[i] = Status::NotFound(Slice());
+    if (read->snapshot)
+      ReleaseSnapshot(read->snapshot);
+    read->callback(read->statuses, read->values);
+    return;
+  }
+
+  read->keys.reserve(read->missing.size());
+  for (size_t i : read->missing)
+    read->keys.push_back(keys[i].ToString());
+  lock.lock();
+  async_reads_.push_back(std::move(read));
+  if (async_jobs_ < thread_pool_->NumThreads(ThreadPool::kRead)) {
+    async_jobs_++;
+    thread_pool_->Schedule([this] { serveAsyncReads(); }, ThreadPool::kRead);
+  }
+}
+
+void DBImpl::serveAsyncReads() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!async_reads_.empty()) {
+    // The lookups queued while the previous batch was being read are taken
+    // together, as long as they read the blocks the same way.
+    std::vector<std::unique_ptr<AsyncRead>> batch;
+    const ReadOptions options = async_reads_.front()->options;
+    size_t n = 0;
+    while (!async_reads_.empty() && n < config::kMaxAsyncReadBatch) {
+      const ReadOptions &o = async_reads_.front()->options;
+      if (o.fill_cache != options.fill_cache ||
+          o.verify_checksums != options.verify_checksums)
+        break;
+      n += async_reads_.front()->keys.size();
+      batch.push_back(std::move(async_reads_.front()));
+      async_reads_.pop_front();
+    }
+    lock.unlock();
+
+    std::vector<Slice> keys;
+    std::vector<SequenceNumber> sequences;
+    for (const auto &read : batch) {
+      for (const std::string &key : read->keys) {
+        keys.push_back(key);
+        sequences.push_back(read->options.snapshot->sequence());
+      }
+    }
+    std::vector<std::string> values(keys.size());
+    std::vector<Status> statuses(keys.size());
+    lookup(options, keys.data(), sequences.data(), keys.size(), values.data(),
+           statuses.data());
+
+    size_t k = 0;
+    for (const auto &read : batch) {
+      for (size_t i : read->missing) {
+        read->values[i].swap(values[k]);
+        read->statuses[i] = statuses[k];
+        k++;
+      }
+      read->callback(read->statuses, read->values);
+    }
+
+    lock.lock();
+    for (const auto &read : batch) {
+      if (read->snapshot)
+        snapshots_.Delete(read->snapshot);
+    }
+  }
+  async_jobs_--;
+  bg_cv_.notify_all();
+}
+
+const Snapshot *DBImpl::GetSnapshot() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return snapshots_.New(last_sequence_);
+}
+
+void DBImpl::ReleaseSnapshot(const Snapshot *snapshot) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  snapshots_.Delete(snapshot);
+}
+
+namespace {
+
+// The entries of a run of disjoint sstables from the first one >= "start",
+// i.e a level-0 file, or the files of a level > 0 from the one that may hold
+// "start". The tables are obtained from the table cache one after another as
+// the iteration gets there, and an error stops the source and is stored in
+// *s.
+class TableSource final : public MergeSource {
+ public:
+  TableSource(TableCache *table_cache, const ReadOptions &read_options,
+              std::vector<const FileMetaData *> files, const Slice &start,
+              Status *s)
+      : table_cache_(table_cache),
+        read_options_(read_options),
+        files_(std::move(files)),
+        index_(0),
+        s_(s) {
+    open(&start);
+  }
+
+  bool Valid() const override {
+    return table_ != nullptr;
+  }
+
+  Slice Key() const override {
+    return files_[index_]->global_sequence ? Slice(key_) : it_->Key();
+  }
+
+  Slice Value() const override {
+    return it_->Value();
+  }
+
+  void Next() override {
+    ++*it_;
+    if (*it_ == table_->end()) {
+      Status s = it_->Stat();
+      if (!s) {
+        *s_ = s;
+        close();
+        return;
+      }
+      index_++;
+      open(nullptr);
+    } else {
+      load();
+    }
+  }
+
+ private:
+  // Opens the files from files_[index_] on until one has an entry from
+  // "start", or from its beginning if "start" is NULL.
+  void open(const Slice *start) {
+    Status s;
+    for (; index_ < files_.size(); index_++) {
+      close();
+      const FileMetaData *f = files_[index_];
+      table_ = table_cache_->Get(f->number, f->file_size, &s);
+      if (!s)
+        break;
+      it_.reset(new SSTable::ConstIterator(
+          start ? table_->lower_bound(read_options_, *start)
+                : table_->begin(read_options_)));
+      if (!(s = it_->Stat()))
+        break;
+      if (*it_ != table_->end()) {
+        load();
+        return;
+      }
+      start = nullptr;
+    }
+    if (!s)
+      *s_ = s;
+    close();
+  }
+
+  // Rewrites the key of an ingested table as of its global sequence.
+  void load() {
+    const SequenceNumber sequence = files_[index_]->global_sequence;
+    if (sequence)
+      ReplaceSequence(it_->Key(), sequence, &key_);
+  }
+
+  // Releases the current table.
+  void close() {
+    it_.reset();
+    table_.reset();
+  }
+
+  TableCache *const table_cache_;
+  const ReadOptions read_options_;
+  const std::vector<const FileMetaData *> files_;
+  size_t index_;
+  std::shared_ptr<SSTable> table_;
+  std::unique_ptr<SSTable::ConstIterator> it_;
+  std::string key_;
+  Status *s_;
+};
+
+// The entries of a compaction input table in [first, last). The iterator
+// stops at an error reading the table, which is then stored in *s.
+class CompactionInputSource final : public MergeSource {
+ public:
+  CompactionInputSource(SSTable::ConstIterator first,
+                        SSTable::ConstIterator last, Status *s)
+      : first_(std::move(first)), last_(std::move(last)), s_(s) {
+    check();
+  }
+
+  bool Valid() const override {
+    return !(first_ == last_);
+  }
+
+  Slice Key() const override {
+    return first_.Key();
+  }
+
+  Slice Value() const override {
+    return first_.Value();
+  }
+
+  void Next() override {
+    ++first_;
+    check();
+  }
+
+ private:
+  void check() {
+    if (*s_ && !first_.Stat())
+      *s_ = first_.Stat();
+  }
+
+  SSTable::ConstIterator first_;
+  SSTable::ConstIterator last_;
+  Status *s_;
+};
+
+class DBIteratorImpl final : public DBIterator {
+ public:
+  // "release" is called on destruction to unreference the version.
+  DBIteratorImpl(std::shared_ptr<MemTable> mem, std::shared_ptr<MemTable> imm,
+                 std::function<void()> release)
+      : mem_(std::move(mem)),
+        imm_(std::move(imm)),
+        release_(std::move(release)) {}
+
+  ~DBIteratorImpl() override {
+    input_.reset();
+    if (release_)
+      release_();
+  }
+
+  // Starts merging "sources", which may store their errors in stat_, less
+  // the keys deleted by "tombstones". The separated values are read from
+  // "blob_cache" with "options".
+  void Init(const InternalKeyComparator *icmp,
+            std::vector<std::unique_ptr<MergeSource>> sources,
+            SequenceNumber snapshot,
+            std::shared_ptr<const FragmentedRangeTombstones> tombstones,
+            BlobFileCache *blob_cache, const ReadOptions &options) {
+    input_.reset(new MergingIterator(icmp, std::move(sources), snapshot,
+                                     std::move(tombstones)));
+    blob_cache_ = blob_cache;
+    options_ = options;
+  }
+
+  Status *MutableStat() {
+    return &stat_;
+  }
+
+  // Ends the iteration at the first key without "prefix", as extracted by
+  // "extractor".
+  void SetPrefix(const PrefixExtractor *extractor, const Slice &prefix) {
+    prefix_extractor_ = extractor;
+    prefix_.assign(prefix.RawData(), prefix.Len());
+  }
+
+  bool Valid() const override {
+    if (!stat_ || !input_->Valid())
+      return false;
+    if (!prefix_extractor_)
+      return true;
+    const Slice key = Key();
+    return prefix_extractor_->InDomain(key) &&
+           prefix_extractor_->Transform(key) == Slice(prefix_);
+  }
+
+  Slice Key() const override {
+    Slice key = input_->Key();
+    return Slice(key.RawData(), key.Len() - 8);
+  }
+
+  // A separated value is read from its blob file only once it's asked for,
+  // so scanning the keys costs no blob reads.
+  Slice Value() const override {
+    if (InternalKey(input_->Key()).type != kTypeBlobIndex)
+      return input_->Value();
+    BlobIndex index;
+    if (!index.DecodeFrom(input_->Value())) {
+      stat_ = Status::Corruption("bad blob index");
+      return Slice();
+    }
+    Status s = blob_cache_->Get(options_, index, &blob_value_);
+    if (!s) {
+      stat_ = s;
+      return Slice();
+    }
+    return Slice(blob_value_);
+  }
+
+  void Next() override {
+    input_->Next();
+  }
+
+  Status Stat() const override {
+    return stat_;
+  }
+
+ private:
+  std::shared_ptr<MemTable> mem_;
+  std::shared_ptr<MemTable> imm_;
+  std::function<void()> release_;
+  mutable Status stat_;
+  std::unique_ptr<MergingIterator> input_;
+  BlobFileCache *blob_cache_ = nullptr;
+  ReadOptions options_;
+  mutable std::string blob_value_;
+  const PrefixExtractor *prefix_extractor_ = nullptr;
+  std::string prefix_;
+};
+
+}  // namespace
+
+DBIterator *DBImpl::NewIterator(const ReadOptions &options,
+                                const Slice &start) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  const SequenceNumber snapshot =
+      options.snapshot ? options.snapshot->sequence() : last_sequence_;
+  std::shared_ptr<MemTable> mem = mem_;
+  std::shared_ptr<MemTable> imm = imm_;
+  Version *current = versions_ ? versions_->current() : nullptr;
+  if (current)
+    current->Ref();
+  lock.unlock();
+
+  std::function<void()> release;
+  if (current) {
+    release = [this, current]() {
+      std::lock_guard<std::mutex> guard(mutex_);
+      current->Unref();
+    };
+  }
+
+  std::unique_ptr<DBIteratorImpl> iter(
+      new DBIteratorImpl(mem, imm, std::move(release)));
+
+  InternalKeyBuf lookup(start, snapshot, kTypeValue);
+  const Slice key = lookup.Data();
+
+  // A prefix seek ends at the prefix of "start", and skips the tables whose
+  // filters rule the prefix out.
+  const PrefixExtractor *extractor = options_.prefix_extractor;
+  const bool prefix_seek = options.prefix_same_as_start && extractor &&
+                           extractor->InDomain(start);
+  if (prefix_seek)
+    iter->SetPrefix(extractor, extractor->Transform(start));
+  auto may_match = [&](const FileMetaData *f) {
+    if (!prefix_seek)
+      return true;
+    // An error opening the table is met again by its TableSource.
+    Status s;
+    std::shared_ptr<SSTable> table =
+        versions_->table_cache()->Get(f->number, f->file_size, &s);
+    return !s || table->PrefixMayMatch(options, key);
+  };
+  auto past_prefix = [&](const FileMetaData *f) {
+    const Slice smallest = InternalKey(f->smallest).user_key;
+    return !extractor->InDomain(smallest) ||
+           !(extractor->Transform(smallest) == extractor->Transform(start));
+  };
+
+  // The range tombstones of every source are fragmented together, those of
+  // a table ending before "start" delete nothing iterated.
+  const Comparator *ucmp = internal_comparator_.user_comparator();
+  std::vector<RangeTombstone> tombstones;
+  if (mem->NumRangeTombstones() > 0)
+    mem->RangeTombstones()->AppendTo(&tombstones);
+  if (imm && imm->NumRangeTombstones() > 0)
+    imm->RangeTombstones()->AppendTo(&tombstones);
+  for (int level = 0; current && level < config::kNumLevels; level++) {
+    for (const FileMetaData *f : current->Files(level)) {
+      if (f->num_range_tombstones == 0 ||
+          internal_comparator_.Compare(Slice(f->largest), key) < 0)
+        continue;
+      Status s;
+      std::shared_ptr<SSTable> table =
+          versions_->table_cache()->Get(f->number, f->file_size, &s);
+      if (!s) {
+        *iter->MutableStat() = s;
+        continue;
+      }
+      auto fragmented = table->FragmentedTombstones(ucmp);
+      if (fragmented)
+        fragmented->AppendTo(&tombstones);
+    }
+  }
+  std::shared_ptr<const FragmentedRangeTombstones> fragmented;
+  if (!tombstones.empty())
+    fragmented = std::make_shared<FragmentedRangeTombstones>(ucmp, tombstones);
+
+  std::vector<std::unique_ptr<MergeSource>> sources;
+  sources.push_back(NewRangeSource(mem->lower_bound(key), mem->end()));
+  if (imm)
+    sources.push_back(NewRangeSource(imm->lower_bound(key), imm->end()));
+  if (current) {
+    for (const FileMetaData *f : current->Files(0)) {
+      if (!may_match(f))
+        continue;
+      sources.emplace_back(new TableSource(
+          versions_->table_cache(), options,
+          std::vector<const FileMetaData *>(1, f), key, iter->MutableStat()));
+    }
+    for (int level = 1; level < config::kNumLevels; level++) {
+      const std::vector<FileMetaData *> &files = current->Files(level);
+      std::vector<const FileMetaData *> inputs;
+      const size_t index = FindFile(internal_comparator_, files, key);
+      for (size_t i = index; i < files.size(); i++) {
+        // The files after the one of "start" are past the prefix once
+        // their smallest keys are.
+        if (prefix_seek && i > index && past_prefix(files[i]))
+          break;
+        if (may_match(files[i]))
+          inputs.push_back(files[i]);
+      }
+      if (inputs.empty())
+        continue;
+      sources.emplace_back(new TableSource(versions_->table_cache(), options,
+                                           std::move(inputs), key,
+                                           iter->MutableStat()));
+    }
+  }
+  iter->Init(&internal_comparator_, std::move(sources), snapshot,
+             std::move(fragmented),
+             versions_ ? versions_->blob_cache() : nullptr, options);
+  return iter.release();
+}
+
+struct DBImpl::ExternalFile {
+  std::string path;
+  uint64_t file_size;
+  // The number of the file once linked into the database.
+  uint64_t number;
+  // The first and the last keys of the table, with sequence 0.
+  std::string smallest;
+  std::string largest;
+
+  explicit ExternalFile(const std::string &p)
+      : path(p), file_size(0), number(0) {}
 };
 
-Status DBImpl::Write(const WriteOptions &options, WriteBatch *batch) {}
+Status DBImpl::readExternalFile(ExternalFile *ext) {
+  Status s = file_factory_->GetFileSize(ext->path, &ext->file_size);
+  if (!s)
+    return s;
+  std::unique_ptr<RandomAccessFile> file(
+      file_factory_->NewRandomAccessFile(ext->path, &s));
+  if (!s)
+    return s;
+  const Options options = tableOptions();
+  std::unique_ptr<SSTable> table(
+      SSTable::Open(options, file.get(), ext->file_size, s));
+  if (!s)
+    return s;
+
+  // An empty table has a single index entry, keyed by the empty string, to
+  // its empty data block.
+  std::vector<std::string> index_keys;
+  table->IndexKeys(&index_keys);
+  if (index_keys.empty() || index_keys[0].empty())
+    return Status::InvalidArgument(ext->path) << ": empty external file";
+  // They would take the global sequence of the file, yet delete the entries
+  // of the other files and levels.
+  if (!table->RangeTombstones().empty())
+    return Status::InvalidArgument(ext->path)
+           << ": range tombstones in external file";
+
+  const Comparator *ucmp = internal_comparator_.user_comparator();
+  ReadOptions read_options;
+  read_options.fill_cache = false;
+  auto it = table->begin(read_options);
+  for (; it != table->end(); ++it) {
+    const Slice key = it.Key();
+    if (key.Len() < 8) {
+      return Status::InvalidArgument(ext->path)
+             << ": not keyed by internal keys";
+    }
+    InternalKey ikey(key);
+    if (ikey.sequence != 0 ||
+        (ikey.type != kTypeValue && ikey.type != kTypeDeletion)) {
+      return Status::InvalidArgument(ext->path)
+             << ": keys must have sequence 0";
+    }
+    if (!ext->largest.empty() &&
+        ucmp->Compare(InternalKey(ext->largest).user_key, ikey.user_key) >=
+            0) {
+      return Status::InvalidArgument(ext->path)
+             << ": keys are not sorted, or not unique";
+    }
+    if (ext->smallest.empty())
+      ext->smallest = key.ToString();
+    ext->largest.assign(key.RawData(), key.Len());
+  }
+  return it.Stat();
+}
+
+Status DBImpl::linkExternalFile(const IngestExternalFileOptions &options,
+                                const ExternalFile &ext) {
+  const std::string fname = TableFileName(dbname_, ext.number);
+  if (options.move_files)
+    return file_factory_->RenameFile(ext.path, fname);
+
+  Status s;
+  std::unique_ptr<SequentialFile> src(
+      file_factory_->NewSequentialFile(ext.path, &s));
+  if (!s)
+    return s;
+  std::unique_ptr<WritableFile> dst(file_factory_->NewWritableFile(fname, &s));
+  if (!s)
+    return s;
+  std::unique_ptr<char[]> buf(new char[1 << 20]);
+  while (s) {
+    Slice data;
+    s = src->Read(1 << 20, buf.get(), &data);
+    if (!s || data.Empty())
+      break;
+    s = dst->Append(data);
+  }
+  if (s)
+    s = dst->Sync();
+  Status close = dst->Close();
+  if (s)
+    s = close;
+  if (!s)
+    file_factory_->DeleteFile(fname);
+  return s;
+}
+
+Status DBImpl::IngestExternalFile(const IngestExternalFileOptions &options,
+                                  const std::vector<std::string> &files) {
+  assert(versions_);
+  std::vector<ExternalFile> exts;
+  for (const std::string &path : files) {
+    exts.emplace_back(path);
+    Status s = readExternalFile(&exts.back());
+    if (!s)
+      return s;
+  }
+  if (exts.empty())
+    return Status::OK();
+
+  // The files are committed as a single write, their key ranges must not
+  // overlap.
+  std::sort(exts.begin(), exts.end(),
+            [this](const ExternalFile &a, const ExternalFile &b) {
+              return internal_comparator_.Compare(Slice(a.smallest),
+                                                  Slice(b.smallest)) < 0;
+            });
+  const Comparator *ucmp = internal_comparator_.user_comparator();
+  for (size_t i = 1; i < exts.size(); i++) {
+    if (ucmp->Compare(InternalKey(exts[i - 1].largest).user_key,
+                      InternalKey(exts[i].smallest).user_key) >= 0) {
+      return Status::InvalidArgument("overlapping external files ")
+             << exts[i - 1].path << " and " << exts[i].path;
+    }
+  }
+
+  // Committed as a write of its own, the head of writers_ while no other
+  // write goes on.
+  std::unique_lock<std::mutex> lock(mutex_);
+  Writer w(nullptr);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.wait(lock);
+  }
+
+  // The levels of the files are picked while no compaction is changing
+  // them, and once the immutable memtable is in level 0.
+  ingesting_ = true;
+  while (bg_error_ && (imm_ || compaction_scheduled_)) {
+    bg_cv_.wait(lock);
+  }
+  Status s = bg_error_;
+
+  // The entries and range tombstones of mem_ in the ranges of the files are
+  // older than them, mem_ is flushed so that they are not read instead. The
+  // files are numbered after the flushed table then, which level 0 orders
+  // them by.
+  std::shared_ptr<const FragmentedRangeTombstones> mem_tombstones;
+  if (mem_->NumRangeTombstones() > 0)
+    mem_tombstones = mem_->RangeTombstones();
+  bool overlap = false;
+  for (const ExternalFile &ext : exts) {
+    const Slice smallest = InternalKey(ext.smallest).user_key;
+    const Slice largest = InternalKey(ext.largest).user_key;
+    InternalKeyBuf start(smallest, kMaxSequenceNumber, kTypeValue);
+    auto it = mem_->lower_bound(start.Data());
+    if (it != mem_->end() &&
+        ucmp->Compare(InternalKey(it->first).user_key, largest) <= 0) {
+      overlap = true;
+      break;
+    }
+    if (mem_tombstones) {
+      for (const auto &f : mem_tombstones->Fragments()) {
+        if (ucmp->Compare(f.begin, largest) <= 0 &&
+            ucmp->Compare(f.end, smallest) > 0) {
+          overlap = true;
+          break;
+        }
+      }
+      if (overlap)
+        break;
+    }
+  }
+  if (s && overlap) {
+    s = switchMemTable();
+    while (s && bg_error_ && imm_) {
+      bg_cv_.wait(lock);
+    }
+    if (s)
+      s = bg_error_;
+  }
+
+  // The files are linked without holding the lock, protected from
+  // deleteObsoleteFiles() by pending_outputs_.
+  for (ExternalFile &ext : exts) {
+    ext.number = versions_->NewFileNumber();
+    pending_outputs_.insert(ext.number);
+  }
+  size_t linked = 0;
+  if (s) {
+    lock.unlock();
+    for (; linked < exts.size(); linked++) {
+      s = linkExternalFile(options, exts[linked]);
+      if (!s)
+        break;
+    }
+    lock.lock();
+  }
+
+  if (s) {
+    const SequenceNumber sequence = last_sequence_ + 1;
+    Version *current = versions_->current();
+    VersionEdit edit;
+    for (const ExternalFile &ext : exts) {
+      const Slice smallest = InternalKey(ext.smallest).user_key;
+      const Slice largest = InternalKey(ext.largest).user_key;
+      int level = 0;
+      if (!current->OverlapInLevel(0, smallest, largest)) {
+        while (level + 1 < config::kNumLevels &&
+               !current->OverlapInLevel(level + 1, smallest, largest))
+          level++;
+      }
+      std::string first, last;
+      ReplaceSequence(ext.smallest, sequence, &first);
+      ReplaceSequence(ext.largest, sequence, &last);
+      edit.AddFile(level, ext.number, ext.file_size, first, last, sequence);
+    }
+    versions_->SetLastSequence(sequence);
+    s = versions_->LogAndApply(&edit, &lock);
+    if (s)
+      last_sequence_ = sequence;
+  }
+
+  if (!s) {
+    lock.unlock();
+    for (size_t i = 0; i < linked; i++) {
+      const std::string fname = TableFileName(dbname_, exts[i].number);
+      if (options.move_files) {
+        file_factory_->RenameFile(fname, exts[i].path);
+      } else {
+        file_factory_->DeleteFile(fname);
+      }
+    }
+    lock.lock();
+  }
+  for (const ExternalFile &ext : exts) {
+    pending_outputs_.erase(ext.number);
+  }
+
+  ingesting_ = false;
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.notify_one();
+  }
+  maybeScheduleWork();
+  return s;
+}
+
+void DBImpl::reserveMemTable() {
+  WriteBufferManager *manager = options_.write_buffer_manager;
+  if (manager == nullptr)
+    return;
+  const size_t used = mem_->BytesUsed();
+  if (used > mem_reserved_) {
+    manager->ReserveMem(used - mem_reserved_);
+    mem_reserved_ = used;
+  }
+}
+
+Status DBImpl::makeRoomForWrite(std::unique_lock<std::mutex> &lock) {
+  WriteBufferManager *manager = options_.write_buffer_manager;
+  bool allow_delay = true;
+  while (true) {
+    if (!bg_error_) {
+      return bg_error_;
+    }
+    // The memtable grows by the previous write groups, it's accounted before
+    // the next one.
+    reserveMemTable();
+    if (dbname_.empty()) {
+      return Status::OK();
+    }
+    if (allow_delay &&
+        versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger) {
+      // We are getting close to hitting a hard limit on the number of
+      // L0 files. Rather than delaying a single write by several
+      // seconds when we hit the hard limit, start delaying each
+      // individual write by 1ms to reduce latency variance. Also,
+      // this delay hands over some CPU to the compaction thread in
+      // case it is sharing the same core as the writer.
+      lock.unlock();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      allow_delay = false;  // Do not delay a single write more than once
+      lock.lock();
+      continue;
+    }
+    if (manager && manager->ShouldStall()) {
+      // The memtables of the databases sharing the manager are full, wait
+      // for some flushes to finish.
+      lock.unlock();
+      manager->MaybeStall();
+      lock.lock();
+      continue;
+    }
+    const size_t used = mem_->BytesUsed();
+    if (used < options_.write_buffer_size &&
+        !(manager && manager->ShouldFlush() &&
+          used >= options_.write_buffer_size / 8)) {
+      // A memtable too small is not flushed on behalf of the manager, that
+      // would only make tiny level-0 files.
+      return Status::OK();
+    }
+    if (imm_ ||
+        versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+      // The memtable is full while the previous one is still being
+      // flushed, or there are too many level-0 files.
+      bg_cv_.wait(lock);
+      continue;
+    }
+
+    // No writer is touching the log or the memtable, the previous group has
+    // finished before w became the head of writers_.
+    Status s = switchMemTable();
+    if (!s) {
+      return s;
+    }
+  }
+}
+
+Status DBImpl::switchMemTable() {
+  assert(!imm_);
+  Status s = newLogFile(versions_->NewFileNumber());
+  if (!s) {
+    return s;
+  }
+  imm_ = std::move(mem_);
+  mem_.reset(new MemTable(internal_comparator_, options_.allocator,
+                          options_.memtable_rep));
+  if (options_.write_buffer_manager) {
+    options_.write_buffer_manager->ScheduleFreeMem(mem_reserved_);
+    imm_reserved_ = mem_reserved_;
+    mem_reserved_ = 0;
+  }
+  maybeScheduleWork();
+  return s;
+}
+
+void DBImpl::maybeScheduleWork() {
+  if (shutting_down_ || !bg_error_)
+    return;
+  if (imm_ && !flush_scheduled_) {
+    flush_scheduled_ = true;
+    flush_job_ = thread_pool_->Schedule([this] { backgroundFlush(); },
+                                        ThreadPool::kHigh);
+  }
+  if (!compaction_scheduled_ && !ingesting_ && versions_->NeedsCompaction()) {
+    compaction_scheduled_ = true;
+    compaction_job_ = thread_pool_->Schedule(
+        [this] { backgroundCompaction(); }, ThreadPool::kLow);
+  }
+}
+
+void DBImpl::backgroundFlush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  assert(flush_scheduled_);
+  if (!shutting_down_ && bg_error_ && imm_) {
+    Status s = compactMemTable(lock);
+    if (!s && !shutting_down_) {
+      bg_error_ = s;
+    }
+  }
+  flush_scheduled_ = false;
+  // The new level-0 file may need a compaction.
+  maybeScheduleWork();
+  bg_cv_.notify_all();
+}
+
+void DBImpl::backgroundCompaction() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  assert(compaction_scheduled_);
+  if (!shutting_down_ && bg_error_) {
+    std::unique_ptr<Compaction> c(versions_->PickCompaction());
+    Status s = doCompaction(c.get(), lock);
+    if (!s && !shutting_down_) {
+      bg_error_ = s;
+    }
+  }
+  compaction_scheduled_ = false;
+  // The compaction may have made another level too large.
+  maybeScheduleWork();
+  bg_cv_.notify_all();
+}
+
+// A blob file being written by a flush or a subcompaction, created along
+// with its first blob, so that a job separating no value leaves no file.
+struct DBImpl::BlobOutput {
+  uint64_t number;  // 0 until the file is created
+  RateLimiter::Priority priority;
+  std::unique_ptr<WritableFile> file;
+  std::unique_ptr<BlobFileBuilder> builder;
+
+  explicit BlobOutput(RateLimiter::Priority pri) : number(0), priority(pri) {}
+};
+
+Options DBImpl::tableOptions() const {
+  Options options = options_;
+  options.comparator = &internal_comparator_;
+  if (options_.prefix_extractor)
+    options.prefix_extractor = &internal_prefix_extractor_;
+  return options;
+}
+
+Status DBImpl::compactMemTable(std::unique_lock<std::mutex> &lock) {
+  assert(imm_);
+
+  FileMetaData meta;
+  meta.number = versions_->NewFileNumber();
+  pending_outputs_.insert(meta.number);
+  MemTable *imm = imm_.get();
+  BlobOutput blob(RateLimiter::kHigh);
+  lock.unlock();
+  Status s = writeLevel0Table(imm, &meta, &blob);
+  lock.lock();
+
+  if (s && shutting_down_) {
+    s = Status::IOError("Deleting DB during memtable compaction");
+  }
+
+  if (s) {
+    VersionEdit edit;
+    if (meta.file_size > 0) {
+      edit.AddFile(0, meta.number, meta.file_size, meta.smallest,
+                   meta.largest, 0, meta.num_range_tombstones);
+    }
+    if (blob.builder) {
+      edit.AddBlobFile(blob.number, blob.builder->NumBlobs(),
+                       blob.builder->FileSize());
+    }
+    // The updates in the logs older than that of mem_ are all in the new
+    // table.
+    edit.SetLogNumber(logfile_number_);
+    versions_->SetLastSequence(last_sequence_);
+    s = versions_->LogAndApply(&edit, &lock);
+  }
+  // Only now the table is live in versions_, until then it's protected from
+  // a compaction running along, while LogAndApply releases the lock.
+  pending_outputs_.erase(meta.number);
+  pending_outputs_.erase(blob.number);
+
+  if (s) {
+    imm_.reset();
+    if (options_.write_buffer_manager) {
+      options_.write_buffer_manager->FreeMem(imm_reserved_);
+      imm_reserved_ = 0;
+    }
+    deleteObsoleteFiles(lock);
+  }
+  return s;
+}
+
+Status DBImpl::addBlob(BlobOutput *out, const Slice &value, BlobIndex *index) {
+  if (!out->builder) {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      out->number = versions_->NewFileNumber();
+      pending_outputs_.insert(out->number);
+    }
+    Status s;
+    out->file.reset(file_factory_->NewWritableFile(
+        BlobFileName(dbname_, out->number), &s));
+    if (!s)
+      return s;
+    if (options_.rate_limiter) {
+      out->file.reset(NewRateLimitedFile(out->file.release(),
+                                         options_.rate_limiter, out->priority));
+    }
+    out->builder.reset(new BlobFileBuilder(out->number, out->file.get()));
+  }
+  return out->builder->Add(value, index);
+}
+
+Status DBImpl::finishBlobFile(BlobOutput *out) {
+  if (!out->file)
+    return Status::OK();
+  Status s = out->file->Sync();
+  Status close = out->file->Close();
+  if (s)
+    s = close;
+  out->file.reset();
+  return s;
+}
+
+// Adds "tombstones" to "builder", and extends the key range of its table,
+// [*smallest, *largest] or empty, over them: from the begin key of the first
+// one, to the end key of the last one with the largest tag, which sorts
+// before every entry of the end key, as it isn't deleted.
+static void AddRangeTombstones(const InternalKeyComparator &icmp,
+                               const std::vector<RangeTombstone> &tombstones,
+                               SSTableBuilder *builder, std::string *smallest,
+                               std::string *largest) {
+  for (const RangeTombstone &t : tombstones) {
+    builder->AddRangeTombstone(t.begin, t.end, t.sequence);
+    InternalKeyBuf begin(t.begin, t.sequence, kTypeRangeDeletion);
+    InternalKeyBuf end(t.end, kMaxSequenceNumber, kTypeRangeDeletion);
+    if (smallest->empty() || icmp.Compare(begin.Data(), *smallest) < 0)
+      *smallest = begin.Data().ToString();
+    if (largest->empty() || icmp.Compare(end.Data(), *largest) > 0)
+      *largest = end.Data().ToString();
+  }
+}
+
+Status DBImpl::writeLevel0Table(MemTable *mem, FileMetaData *meta,
+                                BlobOutput *blob) {
+  meta->file_size = 0;
+  std::shared_ptr<const FragmentedRangeTombstones> tombstones;
+  if (mem->NumRangeTombstones() > 0)
+    tombstones = mem->RangeTombstones();
+  if (mem->begin() == mem->end() && !tombstones)
+    return Status::OK();
+
+  const std::string fname = TableFileName(dbname_, meta->number);
+  Status s;
+  std::unique_ptr<WritableFile> file(file_factory_->NewWritableFile(fname, &s));
+  if (!s)
+    return s;
+  if (options_.rate_limiter) {
+    file.reset(NewRateLimitedFile(file.release(), options_.rate_limiter,
+                                  RateLimiter::kHigh));
+  }
+
+  // The keys in the table are the internal keys of the memtable, but for
+  // those of the separated values, which become kTypeBlobIndex.
+  const Options options = tableOptions();
+  SSTableBuilder builder(&options, file.get());
+  std::string blob_key, blob_index;
+  for (const MemTable::Entry &entry : *mem) {
+    Slice key = entry.first;
+    Slice value = entry.second;
+    if (options_.min_blob_size > 0 && value.Len() >= options_.min_blob_size) {
+      InternalKey ikey(key);
+      if (ikey.type == kTypeValue) {
+        BlobIndex index;
+        s = addBlob(blob, value, &index);
+        if (!s)
+          break;
+        blob_key = InternalKeyBuf(ikey.user_key, ikey.sequence,
+                                  kTypeBlobIndex).Data().ToString();
+        blob_index.clear();
+        index.EncodeTo(&blob_index);
+        key = blob_key;
+        value = blob_index;
+      }
+    }
+    if (builder.NumEntries() == 0)
+      meta->smallest = key.ToString();
+    meta->largest.assign(key.RawData(), key.Len());
+    s = builder.Add(key, value);
+    if (!s)
+      break;
+  }
+  if (s && tombstones) {
+    std::vector<RangeTombstone> fragments;
+    tombstones->AppendTo(&fragments);
+    AddRangeTombstones(internal_comparator_, fragments, &builder,
+                       &meta->smallest, &meta->largest);
+    meta->num_range_tombstones = builder.NumRangeTombstones();
+  }
+  if (s)
+    s = builder.Finish();
+  if (s)
+    s = file->Sync();
+  Status close = file->Close();
+  if (s)
+    s = close;
+  // The blob file is complete before the table referencing it is installed.
+  Status blob_status = finishBlobFile(blob);
+  if (s)
+    s = blob_status;
+
+  if (s) {
+    meta->file_size = builder.FileSize();
+  } else {
+    file_factory_->DeleteFile(fname);
+    if (blob->builder)
+      file_factory_->DeleteFile(BlobFileName(dbname_, blob->number));
+  }
+  return s;
+}
+
+// The state of a compaction that is merging its inputs.
+// Files produced by compaction
+struct DBImpl::CompactionOutput {
+  uint64_t number;
+  uint64_t file_size;
+  std::string smallest, largest;
+  uint64_t num_range_tombstones;
+};
+
+// A key range of a compaction, whose inputs are merged into outputs of its
+// own, along with the other subcompactions.
+struct DBImpl::SubcompactionState {
+  // The user keys the range is bounded by, [*start, *end), NULL for an
+  // unbounded side.
+  const std::string *start;
+  const std::string *end;
+
+  Compaction::Cursor cursor;
+
+  std::vector<CompactionOutput> outputs;
+
+  // The range tombstones of the next output are clipped to start at
+  // lower, unless lower_unbounded, i.e the first user key of the output,
+  // or *start for the first one.
+  std::string lower;
+  bool lower_unbounded;
+
+  // State kept for output being generated
+  std::unique_ptr<WritableFile> outfile;
+  std::unique_ptr<SSTableBuilder> builder;
+
+  // The blob file the relocated blobs are rewritten into, and the blobs of
+  // the inputs no longer referenced, keyed by blob file number.
+  BlobOutput blob;
+  std::map<uint64_t, BlobFileMetaData> blob_garbage;
+
+  Status status;
+
+  SubcompactionState()
+      : start(nullptr),
+        end(nullptr),
+        lower_unbounded(true),
+        blob(RateLimiter::kLow) {}
+
+  void AddBlobGarbage(const BlobIndex &index) {
+    BlobFileMetaData &g = blob_garbage[index.file_number];
+    g.garbage_count++;
+    g.garbage_bytes += index.size;
+  }
+
+  CompactionOutput *current_output() {
+    return &outputs.back();
+  }
+};
+
+struct DBImpl::CompactionState {
+  Compaction *const compaction;
+
+  // The sequences of the live snapshots, in increasing order. They cut the
+  // entries of each user key into stripes: the entries in stripe i are seen
+  // by snapshots[i] and no older snapshot, the ones newer than every
+  // snapshot only by the latest state. Nothing but the newest entry of each
+  // stripe is ever read, so the older ones are dropped.
+  std::vector<SequenceNumber> snapshots;
+
+  // The options of the output tables, whose keys are internal keys.
+  Options table_options;
+
+  // The user keys the key ranges of subs are split at, in increasing order.
+  std::vector<std::string> boundaries;
+  std::vector<SubcompactionState> subs;
+
+  // The blobs of the blob files numbered less than this are relocated.
+  // @see Options::blob_garbage_collection_age_cutoff
+  uint64_t blob_cutoff;
+
+  // The range tombstones of the inputs, NULL if there's none.
+  std::shared_ptr<const FragmentedRangeTombstones> tombstones;
+
+  explicit CompactionState(Compaction *c) : compaction(c), blob_cutoff(0) {}
+
+  // The stripe of the entries with sequence number "sequence".
+  size_t stripe(SequenceNumber sequence) const {
+    return static_cast<size_t>(
+        std::lower_bound(snapshots.begin(), snapshots.end(), sequence) -
+        snapshots.begin());
+  }
+
+  // Whether a range tombstone of the inputs deletes the entry of "ikey",
+  // for every snapshot that sees the entry: a tombstone covering it in the
+  // same stripe.
+  bool DeletedByRange(const InternalKey &ikey) const {
+    if (!tombstones)
+      return false;
+    const FragmentedRangeTombstones::Fragment *f =
+        tombstones->Find(ikey.user_key);
+    if (f == nullptr)
+      return false;
+    // The oldest tombstone newer than the entry.
+    auto it = std::upper_bound(f->sequences.rbegin(), f->sequences.rend(),
+                               ikey.sequence);
+    return it != f->sequences.rend() &&
+           stripe(*it) == stripe(ikey.sequence);
+  }
+
+  // Stores in *out the range tombstones of the inputs clipped to
+  // [lower, upper), either NULL if unbounded, but for those that are never
+  // read: the older ones of a stripe, whose newest tombstone covers as much,
+  // and those seen by every snapshot where no older data lies underneath.
+  void RangeTombstonesIn(const Comparator *ucmp, const Slice *lower,
+                         const Slice *upper,
+                         std::vector<RangeTombstone> *out) const {
+    if (!tombstones)
+      return;
+    for (const auto &f : tombstones->Fragments()) {
+      if (upper && ucmp->Compare(f.begin, *upper) >= 0)
+        break;
+      if (lower && ucmp->Compare(f.end, *lower) <= 0)
+        continue;
+      Slice begin = f.begin, end = f.end;
+      if (lower && ucmp->Compare(begin, *lower) < 0)
+        begin = *lower;
+      if (upper && ucmp->Compare(end, *upper) > 0)
+        end = *upper;
+      if (ucmp->Compare(begin, end) >= 0)
+        continue;
+
+      bool has_stripe = false;
+      size_t last_stripe = 0;
+      for (SequenceNumber sequence : f.sequences) {
+        const size_t s = stripe(sequence);
+        if (has_stripe && s == last_stripe)
+          continue;
+        has_stripe = true;
+        last_stripe = s;
+        if (s == 0 && compaction->IsBaseLevelForRange(begin, end))
+          continue;
+        out->emplace_back(begin, end, sequence);
+      }
+    }
+  }
+};
+
+Status DBImpl::doCompaction(Compaction *c, std::unique_lock<std::mutex> &lock) {
+  if (c == nullptr) {
+    return Status::OK();
+  }
+
+  Status s;
+  if (c->IsTrivialMove()) {
+    // Move file to next level
+    assert(c->num_input_files(0) == 1);
+    FileMetaData *f = c->input(0, 0);
+    c->edit()->RemoveFile(c->level(), f->number);
+    c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
+                       f->largest, f->global_sequence,
+                       f->num_range_tombstones);
+    s = versions_->LogAndApply(c->edit(), &lock);
+  } else {
+    CompactionState compact(c);
+    s = doCompactionWork(&compact, lock);
+    for (const SubcompactionState &sub : compact.subs) {
+      for (const CompactionOutput &out : sub.outputs) {
+        pending_outputs_.erase(out.number);
+      }
+      pending_outputs_.erase(sub.blob.number);
+    }
+  }
+  c->ReleaseInputs();
+  deleteObsoleteFiles(lock);
+  return s;
+}
+
+Status DBImpl::openCompactionOutputFile(CompactionState *compact,
+                                        SubcompactionState *sub) {
+  assert(!sub->builder);
+  uint64_t file_number;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    file_number = versions_->NewFileNumber();
+    pending_outputs_.insert(file_number);
+  }
+  CompactionOutput out;
+  out.number = file_number;
+  out.file_size = 0;
+  out.num_range_tombstones = 0;
+  sub->outputs.push_back(out);
+
+  // Make the output file
+  Status s;
+  sub->outfile.reset(file_factory_->NewWritableFile(
+      TableFileName(dbname_, file_number), &s));
+  if (s && options_.rate_limiter) {
+    sub->outfile.reset(NewRateLimitedFile(
+        sub->outfile.release(), options_.rate_limiter, RateLimiter::kLow));
+  }
+  if (s) {
+    sub->builder.reset(
+        new SSTableBuilder(&compact->table_options, sub->outfile.get()));
+  }
+  return s;
+}
+
+Status DBImpl::finishCompactionOutputFile(CompactionState *compact,
+                                          SubcompactionState *sub,
+                                          const Slice *upper) {
+  assert(sub->outfile);
+  assert(sub->builder);
+
+  Slice lower(sub->lower);
+  std::vector<RangeTombstone> tombstones;
+  compact->RangeTombstonesIn(internal_comparator_.user_comparator(),
+                             sub->lower_unbounded ? nullptr : &lower, upper,
+                             &tombstones);
+  CompactionOutput *out = sub->current_output();
+  AddRangeTombstones(internal_comparator_, tombstones, sub->builder.get(),
+                     &out->smallest, &out->largest);
+  out->num_range_tombstones = sub->builder->NumRangeTombstones();
+  if (upper) {
+    sub->lower = upper->ToString();
+    sub->lower_unbounded = false;
+  }
+  assert(sub->builder->NumEntries() > 0 || out->num_range_tombstones > 0);
+
+  Status s = sub->builder->Finish();
+  sub->current_output()->file_size = sub->builder->FileSize();
+  sub->builder.reset();
+
+  // Finish and check for file errors
+  if (s) {
+    s = sub->outfile->Sync();
+  }
+  Status close = sub->outfile->Close();
+  if (s) {
+    s = close;
+  }
+  sub->outfile.reset();
+  return s;
+}
+
+void DBImpl::splitCompaction(
+    CompactionState *compact,
+    const std::vector<std::shared_ptr<SSTable>> &tables) {
+  const Comparator *user_cmp = internal_comparator_.user_comparator();
+  std::vector<std::string> index_keys;
+  if (options_.max_subcompactions > 1) {
+    for (const std::shared_ptr<SSTable> &table : tables) {
+      table->IndexKeys(&index_keys);
+    }
+  }
+  std::vector<std::string> keys;
+  keys.reserve(index_keys.size());
+  for (const std::string &key : index_keys) {
+    keys.push_back(InternalKey(key).user_key.ToString());
+  }
+  std::sort(keys.begin(), keys.end(),
+            [user_cmp](const std::string &a, const std::string &b) {
+              return user_cmp->Compare(a, b) < 0;
+            });
+  keys.erase(std::unique(keys.begin(), keys.end(),
+                         [user_cmp](const std::string &a,
+                                    const std::string &b) {
+                           return user_cmp->Compare(a, b) == 0;
+                         }),
+             keys.end());
+
+  // The ranges hold about as many blocks each, their boundaries are
+  // distinct as there are at least as many keys as ranges.
+  const size_t n = std::min(
+      static_cast<size_t>(std::max(options_.max_subcompactions, 1)),
+      std::max<size_t>(keys.size(), 1));
+  for (size_t i = 1; i < n; i++) {
+    compact->boundaries.push_back(std::move(keys[i * keys.size() / n]));
+  }
+  compact->subs.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    if (i > 0)
+      compact->subs[i].start = &compact->boundaries[i - 1];
+    if (i + 1 < n)
+      compact->subs[i].end = &compact->boundaries[i];
+  }
+}
+
+void DBImpl::processKeyRange(
+    CompactionState *compact, SubcompactionState *sub,
+    const std::vector<std::shared_ptr<SSTable>> &tables) {
+  Compaction *c = compact->compaction;
+  const Comparator *user_cmp = internal_comparator_.user_comparator();
+
+  // Level-0 files may overlap each other, while the files of a level > 0
+  // are disjoint, but are merged the same way. The tables entirely out of
+  // the range are skipped. The inputs are scanned only once, their blocks
+  // would just evict the working set of reads from the cache.
+  ReadOptions read_options;
+  read_options.fill_cache = false;
+  read_options.readahead_size = config::kCompactionReadaheadSize;
+  std::unique_ptr<InternalKeyBuf> seek_key;
+  if (sub->start) {
+    seek_key.reset(new InternalKeyBuf(*sub->start, kMaxSequenceNumber,
+                                      kTypeValue));
+    sub->lower = *sub->start;
+    sub->lower_unbounded = false;
+  }
+  // The first error reading the inputs of this key range, the tables are
+  // shared with the other subcompactions and the readers of the DB.
+  Status input_status;
+  std::vector<std::unique_ptr<MergeSource>> inputs;
+  size_t index = 0;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < c->num_input_files(which); i++, index++) {
+      const FileMetaData *f = c->input(which, i);
+      const SSTable *table = tables[index].get();
+      if (sub->start &&
+          user_cmp->Compare(InternalKey(f->largest).user_key, *sub->start) < 0)
+        continue;
+      if (sub->end &&
+          user_cmp->Compare(InternalKey(f->smallest).user_key, *sub->end) >= 0)
+        continue;
+      std::unique_ptr<MergeSource> source(new CompactionInputSource(
+          seek_key ? table->lower_bound(read_options, seek_key->Data())
+                   : table->begin(read_options),
+          table->end(), &input_status));
+      if (f->global_sequence) {
+        source.reset(
+            new GlobalSequenceSource(std::move(source), f->global_sequence));
+      }
+      inputs.push_back(std::move(source));
+    }
+  }
+
+  Status s;
+  MergingIterator input(&internal_comparator_, std::move(inputs));
+  std::string current_user_key;
+  std::string blob_value, blob_index;
+  bool has_current_user_key = false;
+  bool has_stripe_for_key = false;
+  size_t last_stripe_for_key = 0;
+  // imm_ is flushed meanwhile on the high-priority threads.
+  for (; s && input_status && input.Valid() && !shutting_down_;
+       input.Next()) {
+    Slice key = input.Key();
+    InternalKey ikey(key);
+    if (sub->end && user_cmp->Compare(ikey.user_key, *sub->end) >= 0)
+      break;
+
+    // Handle key/value, add to state, etc.
+    bool drop = false;
+    if (!has_current_user_key ||
+        user_cmp->Compare(ikey.user_key, Slice(current_user_key)) != 0) {
+      // First occurrence of this user key. The outputs are cut only here,
+      // so that the entries of a user key, and the range tombstones
+      // clipped at it, don't span two files of the level.
+      if (sub->builder && (c->ShouldStopBefore(key, &sub->cursor) ||
+                           sub->builder->FileSize() >= c->MaxOutputFileSize())) {
+        s = finishCompactionOutputFile(compact, sub, &ikey.user_key);
+        if (!s)
+          break;
+      }
+      current_user_key.assign(ikey.user_key.RawData(), ikey.user_key.Len());
+      has_current_user_key = true;
+      has_stripe_for_key = false;
+    }
+
+    const size_t stripe = compact->stripe(ikey.sequence);
+    if (has_stripe_for_key && last_stripe_for_key == stripe) {
+      // Hidden by an newer entry for same user key, which is seen by every
+      // snapshot that sees this one.
+      drop = true;  // (A)
+    } else if (ikey.type == kTypeDeletion && stripe == 0 &&
+               c->IsBaseLevelForKey(ikey.user_key, &sub->cursor)) {
+      // For this user key:
+      // (1) there is no data in higher levels
+      // (2) data in lower levels will have larger sequence numbers
+      // (3) data in layers that are being compacted here and have
+      //     smaller sequence numbers will be dropped in the next
+      //     few iterations of this loop (by rule (A) above).
+      // (4) no snapshot sees the data older than the deletion.
+      // Therefore this deletion marker is obsolete and can be dropped.
+      drop = true;
+    } else if (compact->DeletedByRange(ikey)) {
+      // Deleted by a range tombstone for every snapshot that sees it, and
+      // the older entries of the stripe are dropped by rule (A).
+      drop = true;
+    }
+
+    has_stripe_for_key = true;
+    last_stripe_for_key = stripe;
+
+    Slice value = input.Value();
+    if (ikey.type == kTypeBlobIndex) {
+      BlobIndex index;
+      if (!index.DecodeFrom(value)) {
+        s = Status::Corruption("bad blob index in compaction");
+        break;
+      }
+      if (drop) {
+        sub->AddBlobGarbage(index);
+      } else if (index.file_number < compact->blob_cutoff) {
+        // Relocates the blob out of an old blob file.
+        BlobIndex relocated;
+        s = versions_->blob_cache()->Get(read_options, index, &blob_value);
+        if (s)
+          s = addBlob(&sub->blob, blob_value, &relocated);
+        if (!s)
+          break;
+        sub->AddBlobGarbage(index);
+        blob_index.clear();
+        relocated.EncodeTo(&blob_index);
+        value = blob_index;
+      }
+    }
+
+    if (!drop) {
+      // Open output file if necessary
+      if (!sub->builder) {
+        s = openCompactionOutputFile(compact, sub);
+        if (!s)
+          break;
+      }
+      if (sub->builder->NumEntries() == 0) {
+        sub->current_output()->smallest = key.ToString();
+      }
+      sub->current_output()->largest = key.ToString();
+      s = sub->builder->Add(key, value);
+      if (!s)
+        break;
+    }
+  }
+
+  if (s)
+    s = input_status;
+  if (s && shutting_down_) {
+    s = Status::IOError("Deleting DB during compaction");
+  }
+  std::unique_ptr<Slice> end;
+  if (sub->end)
+    end.reset(new Slice(*sub->end));
+  if (s && !sub->builder) {
+    // The range tombstones past the last entry still get an output.
+    Slice lower(sub->lower);
+    std::vector<RangeTombstone> tombstones;
+    compact->RangeTombstonesIn(user_cmp,
+                               sub->lower_unbounded ? nullptr : &lower,
+                               end.get(), &tombstones);
+    if (!tombstones.empty())
+      s = openCompactionOutputFile(compact, sub);
+  }
+  if (s && sub->builder) {
+    s = finishCompactionOutputFile(compact, sub, end.get());
+  } else if (sub->builder) {
+    sub->builder.reset();
+    sub->outfile->Close();
+    sub->outfile.reset();
+  }
+  Status blob_status = finishBlobFile(&sub->blob);
+  if (s)
+    s = blob_status;
+  sub->status = s;
+}
+
+Status DBImpl::doCompactionWork(CompactionState *compact,
+                                std::unique_lock<std::mutex> &lock) {
+  Compaction *c = compact->compaction;
+  assert(versions_->NumLevelFiles(c->level()) > 0);
+  snapshots_.GetAll(&compact->snapshots);
+  compact->table_options = tableOptions();
+  // The blobs of the oldest blob files are relocated, so that the files
+  // are freed even if the rest of their blobs are never overwritten.
+  const std::map<uint64_t, BlobFileMetaData> &blob_files =
+      versions_->current()->BlobFiles();
+  const size_t num_old_blob_files = std::min(
+      blob_files.size(),
+      static_cast<size_t>(static_cast<double>(blob_files.size()) *
+                          options_.blob_garbage_collection_age_cutoff));
+  if (num_old_blob_files > 0) {
+    auto it = blob_files.begin();
+    std::advance(it, num_old_blob_files - 1);
+    compact->blob_cutoff = it->first + 1;
+  }
+
+  // Release mutex while we're actually doing the compaction work
+  lock.unlock();
+
+  Status s;
+  std::vector<std::shared_ptr<SSTable>> tables;
+  for (int which = 0; which < 2 && s; which++) {
+    for (int i = 0; i < c->num_input_files(which) && s; i++) {
+      const FileMetaData *f = c->input(which, i);
+      tables.push_back(
+          versions_->table_cache()->Get(f->number, f->file_size, &s));
+    }
+  }
+
+  // The range tombstones of the inputs, which delete entries of the other
+  // inputs, and are rewritten into the outputs.
+  std::vector<RangeTombstone> tombstones;
+  for (int which = 0, index = 0; which < 2 && s; which++) {
+    for (int i = 0; i < c->num_input_files(which); i++, index++) {
+      if (c->input(which, i)->num_range_tombstones > 0) {
+        const std::vector<RangeTombstone> &t =
+            tables[index]->RangeTombstones();
+        tombstones.insert(tombstones.end(), t.begin(), t.end());
+      }
+    }
+  }
+  if (!tombstones.empty()) {
+    compact->tombstones = std::make_shared<FragmentedRangeTombstones>(
+        internal_comparator_.user_comparator(), tombstones);
+  }
+
+  if (s) {
+    // The first key range is merged on this thread, the others each on a
+    // thread of its own, rather than on the threads of thread_pool_, which
+    // this compaction may be holding the only one of.
+    splitCompaction(compact, tables);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < compact->subs.size(); i++) {
+      threads.emplace_back(&DBImpl::processKeyRange, this, compact,
+                           &compact->subs[i], std::cref(tables));
+    }
+    processKeyRange(compact, &compact->subs[0], tables);
+    for (std::thread &t : threads) {
+      t.join();
+    }
+    for (const SubcompactionState &sub : compact->subs) {
+      if (s)
+        s = sub.status;
+    }
+  }
+
+  lock.lock();
+  if (s) {
+    // Install the results: the inputs are replaced by the outputs of all the
+    // key ranges in the next level, at once.
+    c->AddInputDeletions(c->edit());
+    const int level = c->level();
+    for (const SubcompactionState &sub : compact->subs) {
+      for (const CompactionOutput &out : sub.outputs) {
+        c->edit()->AddFile(level + 1, out.number, out.file_size, out.smallest,
+                           out.largest, 0, out.num_range_tombstones);
+      }
+      if (sub.blob.builder) {
+        c->edit()->AddBlobFile(sub.blob.number, sub.blob.builder->NumBlobs(),
+                               sub.blob.builder->FileSize());
+      }
+      for (const auto &p : sub.blob_garbage) {
+        c->edit()->AddBlobGarbage(p.first, p.second.garbage_count,
+                                  p.second.garbage_bytes);
+      }
+    }
+    s = versions_->LogAndApply(c->edit(), &lock);
+  }
+  return s;
+}
+
+void DBImpl::deleteObsoleteFiles(std::unique_lock<std::mutex> &lock) {
+  if (!bg_error_) {
+    // After a background error, we don't know whether a new version may
+    // or may not have been committed, so we cannot safely garbage collect.
+    return;
+  }
+
+  // Make a set of all of the live files
+  std::set<uint64_t> live = pending_outputs_;
+  versions_->AddLiveFiles(&live);
+  const uint64_t log_number = versions_->LogNumber();
+  const uint64_t manifest_number = versions_->ManifestFileNumber();
+  // A flush or a compaction running along may create new files once the
+  // lock is dropped, their numbers are all from this one on.
+  const uint64_t next_number = versions_->NextFileNumber();
+
+  lock.unlock();
+  std::vector<std::string> filenames;
+  file_factory_->GetChildren(dbname_, &filenames);
+  for (const std::string &filename : filenames) {
+    uint64_t number;
+    FileType type;
+    if (!ParseFileName(filename, &number, &type))
+      continue;
+
+    bool keep = true;
+    switch (type) {
+      case FileType::kLogFile:
+        keep = (number >= log_number);
+        break;
+      case FileType::kDescriptorFile:
+        // Keep my manifest file, and any newer incarnations'
+        // (in case there is a race that allows other incarnations)
+        keep = (number >= manifest_number);
+        break;
+      case FileType::kTableFile:
+      case FileType::kBlobFile:
+      case FileType::kTempFile:
+        // Any temp files that are currently being written to must
+        // be recorded in pending_outputs_, which is inserted into "live"
+        keep = (number >= next_number || live.find(number) != live.end());
+        break;
+      case FileType::kCurrentFile:
+      case FileType::kBlockCacheDumpFile:
+        keep = true;
+        break;
+    }
+
+    if (!keep) {
+      if (type == FileType::kTableFile)
+        versions_->table_cache()->Evict(number);
+      else if (type == FileType::kBlobFile)
+        versions_->blob_cache()->Evict(number);
+      file_factory_->DeleteFile(dbname_ + "/" + filename);
+    }
+  }
+  lock.lock();
+}
+
+MemTable *DBImpl::TEST_GetMemTable() const {
+  return mem_.get();
+}
+
+SequenceNumber DBImpl::TEST_GetLastSequence() const {
+  return last_sequence_;
+}
+
+MemTable *DBImpl::TEST_GetImmutableMemTable() const {
+  return imm_.get();
+}
+
+VersionSet *DBImpl::TEST_GetVersionSet() const {
+  return versions_.get();
+}
+
+Status DBImpl::TEST_WaitForFlush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (imm_ && bg_error_) {
+    bg_cv_.wait(lock);
+  }
+  return bg_error_;
+}
+
+Status DBImpl::TEST_WaitForCompaction() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while ((imm_ || versions_->NeedsCompaction()) && bg_error_) {
+    bg_cv_.wait(lock);
+  }
+  return bg_error_;
+}
+
+void DBImpl::buildBatchGroup(Writer **last_writer) {
+  assert(!writers_.empty());
+  Writer *first = writers_.front();
+  assert(first->batch != nullptr);
+  group_.clear();
+  group_.push_back(first);
+
+  size_t size = first->batch->pImpl_->ByteSize();
+
+  // Allow the group to grow up to a maximum size, but if the
+  // original write is small, limit the growth so we do not slow
+  // down the small write too much.
+  size_t max_size = 1 << 20;
+  if (size <= (128 << 10)) {
+    max_size = size + (128 << 10);
+  }
+
+  *last_writer = first;
+  auto iter = writers_.begin();
+  ++iter;  // Advance past "first"
+  for (; iter != writers_.end(); ++iter) {
+    Writer *w = *iter;
+    if (w->batch == nullptr) {
+      // An ingestion, which is committed alone.
+      break;
+    }
+    if (w->sync && !first->sync) {
+      // Do not include a sync write into a batch handled by a non-sync write.
+      break;
+    }
+
+    size += w->batch->pImpl_->ByteSize();
+    if (size > max_size) {
+      // Do not make batch too big
+      break;
+    }
+
+    group_.push_back(w);
+    *last_writer = w;
+  }
+}
 
 }  // namespace lessdb
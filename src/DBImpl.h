@@ -22,23 +22,370 @@
 
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
 #include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "DB.h"
+#include "DBFormat.h"
+#include "Disallowcopying.h"
+#include "InternalKey.h"
+#include "Options.h"
+#include "Snapshot.h"
 #include "Status.h"
+#include "WriteBatch.h"
 
 namespace lessdb {
 
-class WriteOptions;
-class WriteBatch;
+class Compaction;
+class DBIterator;
+class FileFactory;
+class MemTable;
+class SSTable;
+class ThreadPool;
+class VersionEdit;
+class VersionSet;
+class WritableFile;
+struct BlobIndex;
+struct FileMetaData;
+
+namespace log {
+class Writer;
+}  // namespace log
 
 class DBImpl {
+  __DISALLOW_COPYING__(DBImpl);
+
  public:
+  // Updates are appended to logfile before they are applied to the memtable.
+  // *logfile must remain live while this DBImpl is in use.
+  // Without a database directory, the memtable is never flushed.
+  DBImpl(const Options &options, WritableFile *logfile);
+
+  // Creates a DBImpl for the database stored under the directory "dbname",
+  // which must be recovered by Recover() before use.
+  DBImpl(const Options &options, const std::string &dbname);
+
+  ~DBImpl();
+
+  // Recovers the sstables of the database from its manifest, replays the log
+  // files not yet flushed into the memtable in the order of their numbers,
+  // and starts a new log file for the following updates.
+  // Creates the database if it's missing and options.create_if_missing is
+  // true. Starts scheduling the memtable flushes and the compactions on
+  // Options::thread_pool.
+  // REQUIRES: Constructed with a dbname, and called once before any Write.
+  Status Recover();
+
+  // Apply the specified updates to the database.
+  // Concurrent writers are combined into a single group which is committed
+  // with only one log record, and at most one WritableFile::Sync(). Once a
+  // log write or sync fails, the error is kept, and fails every later Write.
   Status Write(const WriteOptions &options, WriteBatch *batch);
 
+  // Looks up "key" as of options.snapshot, or the latest state if it's NULL,
+  // in the memtable, the immutable memtable and then the sstables. Stores the
+  // value in *value and returns OK if found, returns NotFound if "key" is
+  // missing or deleted.
+  Status Get(const ReadOptions &options, const Slice &key,
+             std::string *value);
+
+  // Looks up "keys" as of options.snapshot, or the latest state if it's
+  // NULL, as DB::MultiGet describes.
+  std::vector<Status> MultiGet(const ReadOptions &options,
+                               const std::vector<Slice> &keys,
+                               std::vector<std::string> *values);
+
+  // The lookups of DB::GetAsync and DB::MultiGetAsync. The keys missing
+  // from the memtables are queued to async_reads_, with a snapshot to be
+  // read as of unless options.snapshot is set, and served by
+  // serveAsyncReads() on the read threads of Options::thread_pool.
+  void GetAsync(const ReadOptions &options, const Slice &key,
+                GetCallback callback);
+  void MultiGetAsync(const ReadOptions &options,
+                     const std::vector<Slice> &keys,
+                     MultiGetCallback callback);
+
+  // Returns a snapshot of the current state, which is kept readable by
+  // ReadOptions::snapshot until released by ReleaseSnapshot.
+  const Snapshot *GetSnapshot();
+
+  void ReleaseSnapshot(const Snapshot *snapshot);
+
+  // Returns an iterator over the memtable, the immutable memtable and the
+  // sstables of the current version as of options.snapshot, or the latest
+  // state if it's NULL, from the first key >= "start". The memtables and the
+  // version are referenced until the iterator is deleted.
+  DBIterator *NewIterator(const ReadOptions &options, const Slice &start);
+
+  // Adds the sstables "files" built outside of the database, as described by
+  // DB::IngestExternalFile. Every file is read through and checked first.
+  // The ingestion is then committed as a write of its own, with the next
+  // sequence as the global sequence of the files: the memtable is flushed if
+  // it overlaps them, the files are linked, and each of them is placed into
+  // the lowest level above any overlapping file, while no compaction runs.
+  // The writes wait meanwhile, moving the files keeps that short.
+  // REQUIRES: Constructed with a dbname, and recovered.
+  Status IngestExternalFile(const IngestExternalFileOptions &options,
+                            const std::vector<std::string> &files);
+
+  // Lists the blocks of the open sstables found in Options::block_cache in
+  // the BLOCKCACHE file, which replaces the previous one atomically by a
+  // rename. Done every Options::block_cache_dump_period_sec seconds, and as
+  // the database is closed. Does nothing without a block cache.
+  // REQUIRES: Constructed with a dbname, and recovered.
+  Status DumpBlockCache();
+
+ public:
+  MemTable *TEST_GetMemTable() const;
+
+  SequenceNumber TEST_GetLastSequence() const;
+
+  MemTable *TEST_GetImmutableMemTable() const;
+
+  VersionSet *TEST_GetVersionSet() const;
+
+  // Waits until the immutable memtable, if any, has been flushed. Returns the
+  // error of the background work.
+  Status TEST_WaitForFlush();
+
+  // Waits until the immutable memtable is flushed, and no level needs to be
+  // compacted. Returns the error of the background work.
+  Status TEST_WaitForCompaction();
+
+ private:
   // Information kept for every writer.
   struct Writer;
+
+  // Collects the writers at the front of writers_ whose batches are committed
+  // together into group_. *last_writer is set to the last writer of group_.
+  // REQUIRES: mutex_ is held, writers_ is not empty.
+  void buildBatchGroup(Writer **last_writer);
+
+  // Looks up keys[i] as of sequences[i] into values[i] and statuses[i], in
+  // the memtables and the version taken at once. The keys missing from the
+  // memtables are looked up together by Version::MultiGet.
+  void lookup(const ReadOptions &options, const Slice *keys,
+              const SequenceNumber *sequences, size_t n, std::string *values,
+              Status *statuses);
+
+  // Opens the sstables of the current version ahead of their first access,
+  // on Options::table_loading_threads threads, and reads the blocks listed
+  // in the BLOCKCACHE file by DumpBlockCache() back into
+  // Options::block_cache. Loading is best effort, the errors are ignored.
+  void loadTables();
+
+  // The job of dump_thread_: calls DumpBlockCache() every
+  // Options::block_cache_dump_period_sec seconds until shutting down.
+  void dumpBlockCachePeriodically();
+
+  // A queued lookup of MultiGetAsync.
+  struct AsyncRead;
+
+  // The job of the read threads: serves the lookups of async_reads_ in
+  // batches, until none is left.
+  void serveAsyncReads();
+
+  // Inserts the updates of batch into mem_, timed into Options::statistics.
+  // REQUIRES: the caller is a writer of the current write group.
+  Status insertInto(WriteBatch *batch, bool concurrently);
+
+  // Creates the manifest of an empty database.
+  Status newDB();
+
+  // Replays the updates in the log file numbered "number" into mem_.
+  Status recoverLogFile(uint64_t number);
+
+  // Switches the following writes to a new log file numbered "number".
+  // REQUIRES: mutex_ is held, or no write is going on.
+  Status newLogFile(uint64_t number);
+
+  // Switches mem_ to imm_ to be flushed in background, and the following
+  // writes to a new log file.
+  // REQUIRES: mutex_ is held, imm_ is NULL, and no writer is touching the
+  // log or mem_.
+  Status switchMemTable();
+
+  // An sstable being ingested.
+  struct ExternalFile;
+
+  // Reads the sstable ext->path through, checks that it's a valid external
+  // file and stores its size and key range into *ext.
+  Status readExternalFile(ExternalFile *ext);
+
+  // Moves or copies the file of "ext" into the database.
+  Status linkExternalFile(const IngestExternalFileOptions &options,
+                          const ExternalFile &ext);
+
+  // Reports the growth of mem_ to options_.write_buffer_manager.
+  // REQUIRES: mutex_ is held.
+  void reserveMemTable();
+
+  // Makes sure mem_ has room for the next write group. A full mem_ is
+  // switched to imm_ to be flushed in background, unless the previous imm_ is
+  // still being flushed, in which case the write waits for it.
+  // REQUIRES: mutex_ is held by "lock", and the calling writer is the head of
+  // writers_.
+  Status makeRoomForWrite(std::unique_lock<std::mutex> &lock);
+
+  // Schedules the flush of imm_ on the high-priority threads of
+  // thread_pool_, and a compaction on the low-priority ones if versions_
+  // needs one, unless they're scheduled already. The flushes and the
+  // compactions of a database run one at a time each, but a flush runs
+  // along with a compaction.
+  // REQUIRES: mutex_ is held.
+  void maybeScheduleWork();
+
+  // The jobs scheduled by maybeScheduleWork(): flushes imm_, or runs the
+  // compaction picked by versions_.
+  void backgroundFlush();
+  void backgroundCompaction();
+
+  // The options of the sstables of the database, keyed by internal keys.
+  Options tableOptions() const;
+
+  // Flushes imm_ to a level-0 sstable, and records it in versions_ along
+  // with the log number of mem_.
+  // REQUIRES: mutex_ is held by "lock", imm_ is not NULL.
+  Status compactMemTable(std::unique_lock<std::mutex> &lock);
+
+  // Builds the sstable *meta from the contents of "mem", along with its range
+  // tombstones, meta->number must be set. file_size is 0 if "mem" is empty,
+  // in which case no file is left.
+  // The values of at least options_.min_blob_size bytes are separated into
+  // the blob file of *blob.
+  struct BlobOutput;
+  Status writeLevel0Table(MemTable *mem, FileMetaData *meta,
+                          BlobOutput *blob);
+
+  // Appends "value" to the blob file of *out, which is created, and its
+  // number added to pending_outputs_, by the first call. Stores the
+  // reference to the value in *index.
+  // REQUIRES: mutex_ is not held.
+  Status addBlob(BlobOutput *out, const Slice &value, BlobIndex *index);
+
+  // Syncs and closes the blob file of *out, if any.
+  Status finishBlobFile(BlobOutput *out);
+
+  // Runs the compaction "c" and installs its results.
+  // REQUIRES: mutex_ is held by "lock".
+  Status doCompaction(Compaction *c, std::unique_lock<std::mutex> &lock);
+
+  // Merges the inputs of "c" into the new sstables of c->level()+1.
+  struct CompactionOutput;
+  struct CompactionState;
+  struct SubcompactionState;
+  Status doCompactionWork(CompactionState *compact,
+                          std::unique_lock<std::mutex> &lock);
+  Status openCompactionOutputFile(CompactionState *compact,
+                                  SubcompactionState *sub);
+  // Finishes the current output of "sub", along with the range tombstones
+  // of the inputs clipped to its range, which ends before "upper", the first
+  // user key of the next output, or NULL if it's the last one.
+  Status finishCompactionOutputFile(CompactionState *compact,
+                                    SubcompactionState *sub,
+                                    const Slice *upper);
+
+  // Splits the key range of the compaction into compact->subs, up to
+  // options_.max_subcompactions of them, cut at the index keys of the input
+  // "tables" so that they hold about as many blocks each.
+  void splitCompaction(CompactionState *compact,
+                       const std::vector<std::shared_ptr<SSTable>> &tables);
+
+  // Merges the entries of the input "tables" in the key range of "sub" into
+  // its outputs, and stores the result in sub->status, along with the first
+  // error reading the inputs, which the key ranges merged meanwhile on the
+  // other threads don't see.
+  void processKeyRange(CompactionState *compact, SubcompactionState *sub,
+                       const std::vector<std::shared_ptr<SSTable>> &tables);
+
+  // Deletes the files that are neither live in versions_ nor being written.
+  // REQUIRES: mutex_ is held by "lock".
+  void deleteObsoleteFiles(std::unique_lock<std::mutex> &lock);
+
+ private:
+  const Options options_;
+  const InternalKeyComparator internal_comparator_;
+  const InternalKeyPrefixExtractor internal_prefix_extractor_;
+  const std::string dbname_;
+  FileFactory *const file_factory_;
+
+  WritableFile *logfile_;
+  std::unique_ptr<WritableFile> owned_logfile_;  // NULL if not owned.
+  uint64_t logfile_number_;
+  std::unique_ptr<log::Writer> log_;
+  // Readers take a reference to the memtables under mutex_, so that they
+  // outlive a flush going on along with the read.
+  std::shared_ptr<MemTable> mem_;
+
+  // Protects the following states.
+  std::mutex mutex_;
+
+  // The memtable being flushed, whose updates are in the logs older than
+  // logfile_number_. It's only replaced after the flush is done, so the
+  // flush reads it without mutex_.
+  std::shared_ptr<MemTable> imm_;
+
+  // The memory of mem_ and imm_ accounted to options_.write_buffer_manager.
+  size_t mem_reserved_;
+  size_t imm_reserved_;
+
+  // NULL if not constructed with a dbname.
+  std::unique_ptr<VersionSet> versions_;
+
+  // The numbers of the sstables and blob files being written by the flushes
+  // and the compactions, to be protected from deleteObsoleteFiles().
+  std::set<uint64_t> pending_outputs_;
+
+  // Signaled when a flush or a compaction is done.
+  std::condition_variable bg_cv_;
+  ThreadPool *const thread_pool_;
+  // Whether a flush or a compaction is scheduled or running, and the ids of
+  // their jobs in thread_pool_, to be canceled on shutdown.
+  bool flush_scheduled_;
+  bool compaction_scheduled_;
+  // Set while an ingestion picks the levels of its files, which no
+  // compaction is scheduled to change meanwhile.
+  bool ingesting_;
+  uint64_t flush_job_;
+  uint64_t compaction_job_;
+  std::atomic<bool> shutting_down_;
+  // The error of the background work or of the log, fails later writes.
+  Status bg_error_;
+
+  SequenceNumber last_sequence_;
   std::deque<Writer *> writers_;
+
+  // The lookups of MultiGetAsync waiting for a read thread, and the number
+  // of serveAsyncReads() jobs scheduled, at most one per read thread. Both
+  // guarded by mutex_, bg_cv_ is signaled as a job ends.
+  std::deque<std::unique_ptr<AsyncRead>> async_reads_;
+  int async_jobs_;
+
+  // Runs dumpBlockCachePeriodically() if Options::block_cache_dump_period_sec
+  // is set, woken up by bg_cv_ on shutdown.
+  std::thread dump_thread_;
+
+  // The snapshots held by readers, whose versions of keys are kept by
+  // compactions.
+  SnapshotList snapshots_;
+
+  // Number of followers of the current write group that are inserting their
+  // batches into the memtable.
+  int pending_parallel_inserts_;
+
+  // The writers of the current write group, and the pieces of its log
+  // record: the group header followed by the records of each batch. Only
+  // touched by the group leader.
+  std::vector<Writer *> group_;
+  std::vector<Slice> log_pieces_;
+  char group_header_[12];  // WriteBatchImpl::HeaderSize()
 };
 
-}  // namespace lessdb
\ No newline at end of file
+}  // namespace lessdb
@@ -0,0 +1,55 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "Disallowcopying.h"
+#include "Slice.h"
+#include "Status.h"
+
+namespace lessdb {
+
+// An iterator over the key-value pairs of a DB in the order of keys, as of
+// the snapshot it's created at. @see DB::NewIterator
+class DBIterator {
+  __DISALLOW_COPYING__(DBIterator);
+
+ public:
+  DBIterator() = default;
+  virtual ~DBIterator() = default;
+
+  virtual bool Valid() const = 0;
+
+  // REQUIRES: Valid()
+  virtual Slice Key() const = 0;
+
+  // REQUIRES: Valid()
+  virtual Slice Value() const = 0;
+
+  // REQUIRES: Valid()
+  virtual void Next() = 0;
+
+  // The error that has stopped the iterator, if any.
+  virtual Status Stat() const = 0;
+};
+
+}  // namespace lessdb
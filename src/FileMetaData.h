@@ -0,0 +1,81 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "DBFormat.h"
+
+namespace lessdb {
+
+// Metadata of an sstable in the version set.
+struct FileMetaData {
+  int refs;  // Number of Versions that contain this file.
+  uint64_t number;
+  uint64_t file_size;  // File size in bytes
+
+  // Smallest and largest encoded internal keys served by the table.
+  std::string smallest;
+  std::string largest;
+
+  // Non-zero if the table was ingested by DBImpl::IngestExternalFile: its
+  // keys are stored with sequence 0, and are read as of this sequence
+  // instead (see ReplaceSequence), which smallest and largest carry already.
+  SequenceNumber global_sequence;
+
+  // Number of range tombstones in the table, whose ranges smallest and
+  // largest cover. The reads look for the tombstones of the tables that have
+  // some, without opening the others.
+  uint64_t num_range_tombstones;
+
+  FileMetaData()
+      : refs(0),
+        number(0),
+        file_size(0),
+        global_sequence(0),
+        num_range_tombstones(0) {}
+};
+
+// Metadata of a blob file in the version set. The file is live until all its
+// blobs are garbage, i.e. their references are dropped by compactions.
+struct BlobFileMetaData {
+  uint64_t number;
+  uint64_t total_count;  // Number of blobs in the file
+  uint64_t total_bytes;  // File size in bytes
+  uint64_t garbage_count;
+  uint64_t garbage_bytes;
+
+  BlobFileMetaData()
+      : number(0),
+        total_count(0),
+        total_bytes(0),
+        garbage_count(0),
+        garbage_bytes(0) {}
+
+  bool IsObsolete() const {
+    return garbage_count >= total_count;
+  }
+};
+
+}  // namespace lessdb
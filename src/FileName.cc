@@ -0,0 +1,164 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cstdio>
+#include <memory>
+
+#include "FileName.h"
+#include "FileUtils.h"
+#include "Status.h"
+
+namespace lessdb {
+
+static std::string MakeFileName(const std::string &dbname, uint64_t number,
+                                const char *suffix) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "/%06llu.%s",
+           static_cast<unsigned long long>(number), suffix);
+  return dbname + buf;
+}
+
+std::string LogFileName(const std::string &dbname, uint64_t number) {
+  return MakeFileName(dbname, number, "log");
+}
+
+std::string TableFileName(const std::string &dbname, uint64_t number) {
+  return MakeFileName(dbname, number, "sst");
+}
+
+std::string BlobFileName(const std::string &dbname, uint64_t number) {
+  return MakeFileName(dbname, number, "blob");
+}
+
+std::string DescriptorFileName(const std::string &dbname, uint64_t number) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "/MANIFEST-%06llu",
+           static_cast<unsigned long long>(number));
+  return dbname + buf;
+}
+
+std::string CurrentFileName(const std::string &dbname) {
+  return dbname + "/CURRENT";
+}
+
+std::string BlockCacheDumpFileName(const std::string &dbname) {
+  return dbname + "/BLOCKCACHE";
+}
+
+std::string TempFileName(const std::string &dbname, uint64_t number) {
+  return MakeFileName(dbname, number, "dbtmp");
+}
+
+// Parses the decimal number starting at s[pos] into *number, returns the
+// number of digits consumed, or 0 if there is no number there that fits
+// in uint64_t.
+static size_t ConsumeDecimalNumber(const std::string &s, size_t pos,
+                                   uint64_t *number) {
+  uint64_t num = 0;
+  size_t i = pos;
+  for (; i < s.size() && s[i] >= '0' && s[i] <= '9'; i++) {
+    uint64_t delta = static_cast<uint64_t>(s[i] - '0');
+    if (num > (UINT64_MAX - delta) / 10) {
+      return 0;  // overflow
+    }
+    num = num * 10 + delta;
+  }
+  *number = num;
+  return i - pos;
+}
+
+// Owned filenames have the form:
+//    dbname/CURRENT
+//    dbname/BLOCKCACHE
+//    dbname/MANIFEST-[0-9]+
+//    dbname/[0-9]+.(log|sst|dbtmp|blob)
+bool ParseFileName(const std::string &filename, uint64_t *number,
+                   FileType *type) {
+  static const std::string kManifestPrefix = "MANIFEST-";
+  if (filename == "CURRENT") {
+    *number = 0;
+    *type = FileType::kCurrentFile;
+    return true;
+  }
+  if (filename == "BLOCKCACHE") {
+    *number = 0;
+    *type = FileType::kBlockCacheDumpFile;
+    return true;
+  }
+
+  uint64_t num = 0;
+  if (filename.compare(0, kManifestPrefix.size(), kManifestPrefix) == 0) {
+    size_t n = ConsumeDecimalNumber(filename, kManifestPrefix.size(), &num);
+    if (n == 0 || kManifestPrefix.size() + n != filename.size()) {
+      return false;
+    }
+    *type = FileType::kDescriptorFile;
+    *number = num;
+    return true;
+  }
+
+  size_t i = ConsumeDecimalNumber(filename, 0, &num);
+  if (i == 0) {
+    return false;
+  }
+
+  std::string suffix = filename.substr(i);
+  if (suffix == ".log") {
+    *type = FileType::kLogFile;
+  } else if (suffix == ".sst") {
+    *type = FileType::kTableFile;
+  } else if (suffix == ".dbtmp") {
+    *type = FileType::kTempFile;
+  } else if (suffix == ".blob") {
+    *type = FileType::kBlobFile;
+  } else {
+    return false;
+  }
+  *number = num;
+  return true;
+}
+
+Status SetCurrentFile(FileFactory *factory, const std::string &dbname,
+                      uint64_t descriptor_number) {
+  // Remove leading "dbname/" and add newline to manifest file name
+  std::string manifest = DescriptorFileName(dbname, descriptor_number);
+  std::string contents = manifest.substr(dbname.size() + 1) + "\n";
+  std::string tmp = TempFileName(dbname, descriptor_number);
+
+  Status s;
+  std::unique_ptr<WritableFile> file(factory->NewWritableFile(tmp, &s));
+  if (!s)
+    return s;
+  s = file->Append(contents);
+  if (s)
+    s = file->Sync();
+  Status close = file->Close();
+  if (s)
+    s = close;
+  if (s)
+    s = factory->RenameFile(tmp, CurrentFileName(dbname));
+  if (!s)
+    factory->DeleteFile(tmp);
+  return s;
+}
+
+}  // namespace lessdb
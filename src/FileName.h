@@ -0,0 +1,86 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace lessdb {
+
+class FileFactory;
+class Status;
+
+// Kinds of the files under the database directory.
+enum class FileType {
+  kLogFile,
+  kTableFile,
+  kDescriptorFile,
+  kCurrentFile,
+  kTempFile,
+  kBlobFile,
+  kBlockCacheDumpFile,
+};
+
+// Returns the name of the log file with the specified number in the db named
+// by "dbname". The result will be prefixed with "dbname".
+std::string LogFileName(const std::string &dbname, uint64_t number);
+
+// Returns the name of the sstable with the specified number in the db named
+// by "dbname". The result will be prefixed with "dbname".
+std::string TableFileName(const std::string &dbname, uint64_t number);
+
+// Returns the name of the blob file with the specified number in the db named
+// by "dbname". The result will be prefixed with "dbname".
+std::string BlobFileName(const std::string &dbname, uint64_t number);
+
+// Returns the name of the descriptor file (MANIFEST) with the specified
+// number in the db named by "dbname". The result will be prefixed with
+// "dbname".
+std::string DescriptorFileName(const std::string &dbname, uint64_t number);
+
+// Returns the name of the current file, which contains the name of the
+// current manifest file. The result will be prefixed with "dbname".
+std::string CurrentFileName(const std::string &dbname);
+
+// Returns the name of the file the blocks of the db named "dbname" in the
+// block cache are listed in, to be read back into the block cache on open.
+// The result will be prefixed with "dbname".
+std::string BlockCacheDumpFileName(const std::string &dbname);
+
+// Returns the name of a temporary file owned by the db named "dbname".
+// The result will be prefixed with "dbname".
+std::string TempFileName(const std::string &dbname, uint64_t number);
+
+// If filename is a lessdb file, stores the type of the file in *type and the
+// number encoded in the filename in *number, and returns true. Otherwise
+// returns false.
+// "filename" is relative to the database directory.
+bool ParseFileName(const std::string &filename, uint64_t *number,
+                   FileType *type);
+
+// Makes the CURRENT file point to the descriptor file with the specified
+// number. The file is replaced atomically by a rename.
+Status SetCurrentFile(FileFactory *factory, const std::string &dbname,
+                      uint64_t descriptor_number);
+
+}  // namespace lessdb
@@ -20,18 +20,37 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <climits>  // IOV_MAX
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
 #include <string>
 #include <system_error>
+#include <thread>
 #include <sys/mman.h>
+#include <sys/uio.h>  // writev, pwritev
 #include <fcntl.h>  // open
+#include <unistd.h>
 #include <folly/Likely.h>
 #include <boost/filesystem.hpp>
 
+#ifdef LESSDB_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
 #include "FileUtils.h"
 #include "Status.h"
 
 namespace lessdb {
 
+// Maximum number of read-only files to mmap.
+// See FileFactory::TEST_SetMmapLimit.
+static int mmap_limit = 1000;
+
 static inline std::string ErrnoToString(int error_number) {
   return Slice(strerror(error_number)).ToString();
 }
@@ -40,6 +59,269 @@ static inline Status FileError(const std::string &fname, int error_number) {
   return Status::IOError(ErrnoToString(error_number) + ": " + fname);
 }
 
+void RandomAccessFile::MultiRead(ReadRequest *reqs, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    reqs[i].status =
+        Read(reqs[i].len, reqs[i].offset, reqs[i].scratch, &reqs[i].result);
+  }
+}
+
+// Writes iov[0..n-1] at "offset" by pwritev, or at the file position by
+// writev if offset is negative, resuming after partial writes. Writes at
+// most IOV_MAX buffers a call. The iovecs are modified.
+static Status WriteIov(const std::string &fname, int fd, struct iovec *iov,
+                       size_t n, off_t offset) {
+  while (n > 0) {
+    const int cnt = static_cast<int>(std::min<size_t>(n, IOV_MAX));
+    ssize_t r =
+        offset < 0 ? writev(fd, iov, cnt) : pwritev(fd, iov, cnt, offset);
+    if (UNLIKELY(r < 0)) {
+      if (errno == EINTR)
+        continue;
+      return FileError(fname, errno);
+    }
+    if (offset >= 0)
+      offset += r;
+    // Skips the buffers written.
+    size_t written = static_cast<size_t>(r);
+    while (n > 0 && written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      n--;
+    }
+    if (n > 0) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + written;
+      iov->iov_len -= written;
+    }
+  }
+  return Status::OK();
+}
+
+static void ToIovecs(const Slice *data, size_t n,
+                     std::vector<struct iovec> *iov) {
+  for (size_t i = 0; i < n; i++) {
+    if (data[i].Len() == 0)
+      continue;
+    struct iovec v;
+    v.iov_base = const_cast<char *>(data[i].RawData());
+    v.iov_len = data[i].Len();
+    iov->push_back(v);
+  }
+}
+
+#ifdef LESSDB_HAVE_IO_URING
+
+// A minimal io_uring submission/completion ring, driven by raw system calls.
+// An IoUring is not thread-safe, every thread owns one of its own.
+// See PosixRandomAccessFile::MultiRead.
+class IoUring {
+  __DISALLOW_COPYING__(IoUring);
+
+  static const unsigned kEntries = 64;
+
+  // io_uring_enter is retried up to this many times in a row when it's
+  // interrupted, or short of resources.
+  static const int kMaxEnterRetries = 16;
+
+ public:
+  IoUring()
+      : broken_(false),
+        ring_fd_(-1),
+        sq_ptr_(MAP_FAILED),
+        cq_ptr_(MAP_FAILED),
+        sqes_(static_cast<io_uring_sqe *>(MAP_FAILED)) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, kEntries, &p));
+    if (fd < 0)
+      return;
+    ring_fd_ = fd;
+
+    sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap)
+      sq_len_ = cq_len_ = std::max(sq_len_, cq_len_);
+
+    sq_ptr_ = mmap(nullptr, sq_len_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED)
+      return;
+    cq_ptr_ = single_mmap
+                  ? sq_ptr_
+                  : mmap(nullptr, cq_len_, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cq_ptr_ == MAP_FAILED)
+      return;
+    sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(
+        mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED)
+      return;
+
+    char *sq = static_cast<char *>(sq_ptr_);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    sq_entries_ = p.sq_entries;
+
+    char *cq = static_cast<char *>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+  }
+
+  ~IoUring() {
+    if (sqes_ != MAP_FAILED)
+      munmap(sqes_, sqes_len_);
+    if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_)
+      munmap(cq_ptr_, cq_len_);
+    if (sq_ptr_ != MAP_FAILED)
+      munmap(sq_ptr_, sq_len_);
+    if (ring_fd_ >= 0)
+      close(ring_fd_);
+  }
+
+  // Whether the ring is set up successfully. The kernel may not support
+  // io_uring, or it may be forbidden in a sandbox.
+  bool Valid() const {
+    return sqes_ != MAP_FAILED && !broken_;
+  }
+
+  // Reads reqs[0, n-1] from the file "fname" opened as fd, submitting up to
+  // sq_entries_ reads with a single system call, and waits for all of them
+  // to complete.
+  // Returns false if the ring itself failed, in which case the reads of the
+  // failed batch not completed fail with its error, the requests of the
+  // later batches are not completed, and the ring is no longer valid.
+  bool Read(int fd, const std::string &fname, ReadRequest *reqs, size_t n) {
+    for (size_t start = 0; start < n; start += sq_entries_) {
+      size_t batch = std::min(n - start, static_cast<size_t>(sq_entries_));
+      if (!submitAndWait(fd, fname, reqs + start,
+                         static_cast<unsigned>(batch))) {
+        broken_ = true;
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  bool submitAndWait(int fd, const std::string &fname, ReadRequest *reqs,
+                     unsigned n) {
+    assert(n <= kEntries);
+    // We are the only producer of the submission queue.
+    unsigned tail = *sq_tail_;
+    for (unsigned i = 0; i < n; i++) {
+      unsigned idx = tail & sq_mask_;
+      io_uring_sqe *sqe = &sqes_[idx];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = fd;
+      sqe->addr = reinterpret_cast<uint64_t>(reqs[i].scratch);
+      sqe->len = static_cast<uint32_t>(reqs[i].len);
+      sqe->off = reqs[i].offset;
+      sqe->user_data = i;
+      sq_array_[idx] = idx;
+      tail++;
+    }
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+    bool done[kEntries] = {};
+    unsigned to_submit = n, completed = 0;
+    while (completed < n) {
+      long r = enter(to_submit, n - completed);
+      if (r < 0) {
+        const int err = errno;
+        // No more reads are submitted, while those in flight still write
+        // into their buffers, so they are waited for before the requests are
+        // given back.
+        unsigned in_flight = n - to_submit - completed;
+        while (in_flight > 0 && enter(0, in_flight) >= 0) {
+          completed += reap(fname, reqs, done);
+          in_flight = n - to_submit - completed;
+        }
+        for (unsigned i = 0; i < n; i++) {
+          if (!done[i]) {
+            reqs[i].result = Slice();
+            reqs[i].status = FileError(fname, err);
+          }
+        }
+        return false;
+      }
+      to_submit -= std::min(to_submit, static_cast<unsigned>(r));
+      completed += reap(fname, reqs, done);
+    }
+    return true;
+  }
+
+  // io_uring_enter, retried a bounded number of times if it's interrupted
+  // or short of resources. Returns the number of entries submitted, or -1
+  // with errno set.
+  long enter(unsigned to_submit, unsigned min_complete) {
+    for (int retries = 0;; retries++) {
+      long r = syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete,
+                       IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (r >= 0)
+        return r;
+      const int err = errno;
+      if ((err != EINTR && err != EAGAIN) || retries == kMaxEnterRetries)
+        return r;
+      if (err == EAGAIN)
+        std::this_thread::yield();  // Back off while the kernel catches up.
+      errno = err;
+    }
+  }
+
+  // Stores the results of the completions in the completion queue into
+  // reqs, and marks them in done. Returns the number of completions.
+  unsigned reap(const std::string &fname, ReadRequest *reqs, bool *done) {
+    unsigned reaped = 0;
+    unsigned head = *cq_head_;
+    unsigned cq_tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != cq_tail; head++) {
+      const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+      ReadRequest &req = reqs[cqe.user_data];
+      if (cqe.res >= 0) {
+        req.result = Slice(req.scratch, static_cast<size_t>(cqe.res));
+        req.status = Status::OK();
+      } else {
+        req.result = Slice();
+        req.status = FileError(fname, -cqe.res);
+      }
+      done[cqe.user_data] = true;
+      reaped++;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return reaped;
+  }
+
+ private:
+  bool broken_;
+  int ring_fd_;
+
+  void *sq_ptr_;
+  size_t sq_len_;
+  unsigned *sq_tail_;
+  unsigned sq_mask_;
+  unsigned *sq_array_;
+  unsigned sq_entries_;
+
+  void *cq_ptr_;
+  size_t cq_len_;
+  unsigned *cq_head_;
+  unsigned *cq_tail_;
+  unsigned cq_mask_;
+  io_uring_cqe *cqes_;
+
+  io_uring_sqe *sqes_;
+  size_t sqes_len_;
+};
+
+#endif  // LESSDB_HAVE_IO_URING
+
 class PosixRandomAccessFile : public RandomAccessFile {
  public:
   // PosixRandomAccessFile doesn't create the connection to file in its
@@ -60,13 +342,26 @@ class PosixRandomAccessFile : public RandomAccessFile {
   virtual Status Read(size_t n, uint64_t offset, char *dst,
                       Slice *result) override {
     ssize_t r = pread(fd_, dst, n, static_cast<off_t>(offset));
-    *result = Slice(dst, static_cast<size_t>(r < 0 ? 0 : n));
+    *result = Slice(dst, static_cast<size_t>(r < 0 ? 0 : r));
     if (UNLIKELY(r < 0)) {
       return FileError(filename_, errno);
     }
     return Status::OK();
   }
 
+#ifdef LESSDB_HAVE_IO_URING
+  // Submits the whole batch through the calling thread's io_uring, falls back
+  // to one pread per request if io_uring is not available.
+  void MultiRead(ReadRequest *reqs, size_t n) override {
+    if (n > 1) {
+      thread_local IoUring ring;
+      if (ring.Valid() && ring.Read(fd_, filename_, reqs, n))
+        return;
+    }
+    RandomAccessFile::MultiRead(reqs, n);
+  }
+#endif
+
  private:
   int fd_;                // the file descriptor
   std::string filename_;  // name of the file, used for error message(Status).
@@ -81,8 +376,8 @@ class MmapLimiter {
   __DISALLOW_COPYING__(MmapLimiter);
 
  public:
-  // Up to 1000 mmaps for 64-bit binaries; none for smaller pointer sizes.
-  MmapLimiter() : allowed_(1000) {}
+  // Up to "allowed" mmaps, 1000 by default.
+  explicit MmapLimiter(int allowed) : allowed_(allowed) {}
 
   // If another mmap slot is available, acquire it and return true.
   // Else return false.
@@ -125,19 +420,27 @@ class PosixMmapReadableFile : public RandomAccessFile {
         limiter_(limiter) {}
 
   ~PosixMmapReadableFile() {
+    munmap(mmaped_region_, len_);
     limiter_->Release();
   }
 
+  // Points "*result" directly into the mapped region, "dst" is unused.
   Status Read(size_t n, uint64_t offset, char *dst, Slice *result) override {
-    // invalid argument
-    assert(offset + n < len_);
+    if (UNLIKELY(offset > len_)) {
+      *result = Slice();
+      return FileError(filename_, EINVAL);
+    }
 
-    char *s = reinterpret_cast<char *>(mmaped_region_);
-    memcpy(dst, s + offset, n);
-    (*result) = Slice(dst);
+    n = std::min(n, static_cast<size_t>(len_ - offset));
+    const char *s = reinterpret_cast<const char *>(mmaped_region_);
+    (*result) = Slice(s + offset, n);
     return Status::OK();
   }
 
+  bool HasStableContents() const override {
+    return true;
+  }
+
  private:
   std::string filename_;
   void *mmaped_region_;
@@ -158,11 +461,12 @@ class PosixSequentialFile : public SequentialFile {
   }
 
   Status Read(size_t n, char *dst, Slice *result) override {
-    size_t r;
-    if ((r = fread(dst, n, 1, file_)) == 0) {
+    size_t r = fread(dst, 1, n, file_);
+    (*result) = Slice(dst, r);
+    if (r < n && ferror(file_)) {
+      // A short read is not an error at the end of file.
       return FileError(filename_, errno);
     }
-    (*result) = Slice(dst, r);
     return Status::OK();
   }
 
@@ -185,7 +489,7 @@ class PosixWritableFile : public WritableFile {
       : filename_(fname), file_(f) {}
 
   virtual ~PosixWritableFile() override {
-    if (!file_) {
+    if (file_) {
       fclose(file_);
       file_ = nullptr;
     }
@@ -210,6 +514,16 @@ class PosixWritableFile : public WritableFile {
     return Status::OK();
   }
 
+  // The data buffered by the FILE* is flushed first, then the pieces go to
+  // the file descriptor by a single writev.
+  Status Appendv(const Slice *data, size_t n) override {
+    if (fflush(file_) != 0)
+      return FileError(filename_, errno);
+    iov_.clear();
+    ToIovecs(data, n, &iov_);
+    return WriteIov(filename_, fileno(file_), iov_.data(), iov_.size(), -1);
+  }
+
   virtual Status Flush() override {
     if (fflush(file_) != 0) {
       // flush_unlocked is exclusive on linux
@@ -229,10 +543,225 @@ class PosixWritableFile : public WritableFile {
  private:
   FILE *file_;
   std::string filename_;
+  std::vector<struct iovec> iov_;
+};
+
+// A WritableFile on a raw file descriptor with a user-space buffer, see
+// FdWriteOptions. Unlike PosixWritableFile, the data is copied only once
+// before it's handed to the kernel (or the device with O_DIRECT).
+class PosixFdWritableFile : public WritableFile {
+  static const size_t kAlign = FdWriteOptions::kDirectIOAlignment;
+
+  struct FreeDeleter {
+    void operator()(char *p) const {
+      free(p);
+    }
+  };
+
+ public:
+  // See PosixFdWriteFileFactory::NewWritableFile
+  PosixFdWritableFile(const std::string &fname, int fd, bool direct,
+                      const FdWriteOptions &options)
+      : filename_(fname),
+        fd_(fd),
+        direct_(direct),
+        preallocation_size_(options.preallocation_size),
+        bytes_per_sync_(options.bytes_per_sync),
+        capacity_(options.buffer_size <= kAlign
+                      ? kAlign
+                      : (options.buffer_size + kAlign - 1) / kAlign * kAlign),
+        buf_len_(0),
+        file_offset_(0),
+        preallocated_(0),
+        range_synced_(0) {
+    void *p = nullptr;
+    if (posix_memalign(&p, kAlign, capacity_) != 0) {
+      throw std::bad_alloc();
+    }
+    buf_.reset(static_cast<char *>(p));
+  }
+
+  ~PosixFdWritableFile() override {
+    if (fd_ >= 0) {
+      Close();
+    }
+  }
+
+  Status Append(const Slice &data) override {
+    const char *p = data.RawData();
+    size_t n = data.Len();
+    while (n > 0) {
+      size_t copy = std::min(n, capacity_ - buf_len_);
+      memcpy(buf_.get() + buf_len_, p, copy);
+      buf_len_ += copy;
+      p += copy;
+      n -= copy;
+      if (buf_len_ == capacity_) {
+        Status s = flushBuffer();
+        if (!s)
+          return s;
+      }
+    }
+    return Status::OK();
+  }
+
+  // Without O_DIRECT, the buffered data and the pieces are written by one
+  // pwritev, unless they all fit in the buffer. With O_DIRECT, the pieces
+  // are copied into the aligned buffer like Append.
+  Status Appendv(const Slice *data, size_t n) override {
+    size_t total = 0;
+    for (size_t i = 0; i < n; i++)
+      total += data[i].Len();
+    if (direct_ || buf_len_ + total < capacity_)
+      return WritableFile::Appendv(data, n);
+
+    iov_.clear();
+    if (buf_len_ > 0) {
+      struct iovec v;
+      v.iov_base = buf_.get();
+      v.iov_len = buf_len_;
+      iov_.push_back(v);
+    }
+    ToIovecs(data, n, &iov_);
+    const uint64_t end = file_offset_ + buf_len_ + total;
+    preallocate(end);
+    Status s = WriteIov(filename_, fd_, iov_.data(), iov_.size(),
+                        static_cast<off_t>(file_offset_));
+    if (!s)
+      return s;
+    file_offset_ = end;
+    buf_len_ = 0;
+    rangeSync();
+    return s;
+  }
+
+  Status Flush() override {
+    return flushBuffer();
+  }
+
+  Status Sync() override {
+    Status s = flushBuffer();
+    if (s && fdatasync(fd_) != 0) {
+      s = FileError(filename_, errno);
+    }
+    return s;
+  }
+
+  Status Close() override {
+    Status s = flushBuffer();
+    // Drops the zero padding of the last block written by O_DIRECT.
+    if (s && direct_ &&
+        ftruncate(fd_, static_cast<off_t>(file_offset_ + buf_len_)) != 0) {
+      s = FileError(filename_, errno);
+    }
+    if (close(fd_) != 0 && s) {
+      s = FileError(filename_, errno);
+    }
+    fd_ = -1;
+    return s;
+  }
+
+ private:
+  // Writes the buffer to the file. With O_DIRECT, the partial block at the
+  // end of the buffer is written with zero padding and kept in the buffer,
+  // to be written again along with the following data.
+  Status flushBuffer() {
+    if (buf_len_ == 0)
+      return Status::OK();
+
+    size_t keep = direct_ ? buf_len_ % kAlign : 0;
+    size_t n = buf_len_;
+    if (keep != 0) {
+      n = buf_len_ - keep + kAlign;
+      memset(buf_.get() + buf_len_, 0, n - buf_len_);
+    }
+
+    preallocate(file_offset_ + n);
+    Status s = writeAt(buf_.get(), n, file_offset_);
+    if (!s)
+      return s;
+
+    size_t written = buf_len_ - keep;
+    file_offset_ += written;
+    if (keep != 0 && written != 0) {
+      memmove(buf_.get(), buf_.get() + written, keep);
+    }
+    buf_len_ = keep;
+    rangeSync();
+    return s;
+  }
+
+  Status writeAt(const char *p, size_t n, uint64_t offset) {
+    while (n > 0) {
+      ssize_t r = pwrite(fd_, p, n, static_cast<off_t>(offset));
+      if (UNLIKELY(r < 0)) {
+        if (errno == EINTR)
+          continue;
+        return FileError(filename_, errno);
+      }
+      p += r;
+      n -= static_cast<size_t>(r);
+      offset += static_cast<uint64_t>(r);
+    }
+    return Status::OK();
+  }
+
+  // Makes sure the space up to "end" is allocated, in extents of
+  // preallocation_size_. The file size is left unchanged.
+  void preallocate(uint64_t end) {
+#ifdef __linux__
+    if (preallocation_size_ == 0 || end <= preallocated_)
+      return;
+    uint64_t new_end = (end + preallocation_size_ - 1) / preallocation_size_ *
+                       preallocation_size_;
+    if (fallocate(fd_, FALLOC_FL_KEEP_SIZE,
+                  static_cast<off_t>(preallocated_),
+                  static_cast<off_t>(new_end - preallocated_)) != 0) {
+      // Not supported by the file system, writes still allocate the space.
+      preallocation_size_ = 0;
+      return;
+    }
+    preallocated_ = new_end;
+#endif
+  }
+
+  // Starts the writeback of the dirty pages written since the last call,
+  // once there are bytes_per_sync_ of them. It doesn't wait for the
+  // writeback, errors are reported by the following Sync().
+  void rangeSync() {
+#ifdef __linux__
+    if (bytes_per_sync_ == 0 || direct_ ||
+        file_offset_ - range_synced_ < bytes_per_sync_)
+      return;
+    sync_file_range(fd_, static_cast<off_t>(range_synced_),
+                    static_cast<off_t>(file_offset_ - range_synced_),
+                    SYNC_FILE_RANGE_WRITE);
+    range_synced_ = file_offset_;
+#endif
+  }
+
+ private:
+  std::string filename_;
+  int fd_;
+  const bool direct_;
+  size_t preallocation_size_;
+  const size_t bytes_per_sync_;
+
+  std::unique_ptr<char, FreeDeleter> buf_;
+  const size_t capacity_;
+  size_t buf_len_;
+
+  uint64_t file_offset_;  // Where buf_ is written to.
+  uint64_t preallocated_;
+  uint64_t range_synced_;
+
+  std::vector<struct iovec> iov_;  // Reused by Appendv.
 };
 
 class PosixFileFactory : public FileFactory {
  public:
+  PosixFileFactory() : pLimiter_(new MmapLimiter(mmap_limit)) {}
+
   virtual RandomAccessFile *NewRandomAccessFile(const std::string &fname,
                                                 Status *s) override {
     int fd = open(fname.c_str(), O_RDONLY);
@@ -242,6 +771,7 @@ class PosixFileFactory : public FileFactory {
       return nullptr;
     }
 
+    *s = Status::OK();
     if (pLimiter_->Acquire()) {
       boost::system::error_code ec;
       void *region = nullptr;
@@ -265,7 +795,6 @@ class PosixFileFactory : public FileFactory {
       return new PosixMmapReadableFile(fname, region, size, pLimiter_.get());
     }
 
-    *s = Status::OK();
     return new PosixRandomAccessFile(fname, fd);
   }
 
@@ -281,7 +810,7 @@ class PosixFileFactory : public FileFactory {
   }
 
   WritableFile *NewWritableFile(const std::string &fname, Status *s) override {
-    FILE *f = fopen(fname.c_str(), "r");
+    FILE *f = fopen(fname.c_str(), "w");
     if (UNLIKELY(f == nullptr)) {
       *s = FileError(fname, errno);
       return nullptr;
@@ -290,11 +819,101 @@ class PosixFileFactory : public FileFactory {
     return new PosixWritableFile(fname, f);
   }
 
+  Status GetChildren(const std::string &dir,
+                     std::vector<std::string> *result) override {
+    result->clear();
+    boost::system::error_code ec;
+    boost::filesystem::directory_iterator it(dir, ec), end;
+    for (; !ec && it != end; it.increment(ec)) {
+      result->push_back(it->path().filename().string());
+    }
+    if (ec) {
+      return Status::IOError(dir + ": " + ec.message());
+    }
+    return Status::OK();
+  }
+
+  Status CreateDirIfMissing(const std::string &dirname) override {
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(dirname, ec);
+    if (ec) {
+      return Status::IOError(dirname + ": " + ec.message());
+    }
+    return Status::OK();
+  }
+
+  bool FileExists(const std::string &fname) override {
+    boost::system::error_code ec;
+    return boost::filesystem::exists(fname, ec);
+  }
+
+  Status DeleteFile(const std::string &fname) override {
+    if (UNLIKELY(unlink(fname.c_str()) != 0)) {
+      return FileError(fname, errno);
+    }
+    return Status::OK();
+  }
+
+  Status GetFileSize(const std::string &fname, uint64_t *size) override {
+    boost::system::error_code ec;
+    *size = boost::filesystem::file_size(fname, ec);
+    if (ec) {
+      *size = 0;
+      return Status::IOError(fname + ": " + ec.message());
+    }
+    return Status::OK();
+  }
+
+  Status RenameFile(const std::string &src,
+                    const std::string &target) override {
+    if (UNLIKELY(rename(src.c_str(), target.c_str()) != 0)) {
+      return FileError(src, errno);
+    }
+    return Status::OK();
+  }
+
  private:
   // Used to limit mmap file usage.
   std::unique_ptr<MmapLimiter> pLimiter_;
 };
 
+// Same as PosixFileFactory, except that writable files are
+// PosixFdWritableFiles.
+class PosixFdWriteFileFactory : public PosixFileFactory {
+ public:
+  explicit PosixFdWriteFileFactory(const FdWriteOptions &options)
+      : options_(options) {}
+
+  WritableFile *NewWritableFile(const std::string &fname, Status *s) override {
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    bool direct = options_.use_direct_writes;
+    int fd = -1;
+#ifdef O_DIRECT
+    if (direct) {
+      fd = open(fname.c_str(), flags | O_DIRECT, 0644);
+      if (fd < 0 && errno == EINVAL) {
+        // O_DIRECT is not supported by the file system, e.g tmpfs.
+        direct = false;
+      }
+    }
+#else
+    direct = false;
+#endif
+    if (!direct) {
+      fd = open(fname.c_str(), flags, 0644);
+    }
+    if (UNLIKELY(fd < 0)) {
+      *s = FileError(fname, errno);
+      return nullptr;
+    }
+    *s = Status::OK();
+    return new PosixFdWritableFile(fname, fd, direct, options_);
+  }
+
+ private:
+  const FdWriteOptions options_;
+};
+
 FileFactory *FileFactory::Default() {
   static std::once_flag flag;
   static PosixFileFactory *instance_ = nullptr;
@@ -302,4 +921,32 @@ FileFactory *FileFactory::Default() {
   return instance_;
 }
 
+Status FileFactory::ReadFileToString(const std::string &fname,
+                                     std::string *data) {
+  data->clear();
+  Status s;
+  std::unique_ptr<SequentialFile> file(NewSequentialFile(fname, &s));
+  if (!s)
+    return s;
+
+  static const size_t kBufferSize = 8192;
+  std::unique_ptr<char[]> space(new char[kBufferSize]);
+  while (true) {
+    Slice fragment;
+    s = file->Read(kBufferSize, space.get(), &fragment);
+    if (!s || fragment.Empty())
+      break;
+    data->append(fragment.RawData(), fragment.Len());
+  }
+  return s;
+}
+
+FileFactory *FileFactory::NewFdWriteFactory(const FdWriteOptions &options) {
+  return new PosixFdWriteFileFactory(options);
+}
+
+void FileFactory::TEST_SetMmapLimit(int limit) {
+  mmap_limit = limit;
+}
+
 }  // namespace lessdb
\ No newline at end of file
@@ -22,17 +22,36 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include "Disallowcopying.h"
-#include "SliceFwd.h"
+#include "Slice.h"
+#include "Status.h"
 
 namespace lessdb {
 
-class Status;
-
 ///
 /// Interfaces under this file provide platform-independent file abstractions.
 ///
 
+// A single read in a batch submitted to RandomAccessFile::MultiRead.
+struct ReadRequest {
+  // Input: read up to "len" bytes starting at "offset" into "scratch".
+  uint64_t offset;
+  size_t len;
+  char *scratch;
+
+  // Output: the same as "*result" and the returned status of
+  // RandomAccessFile::Read.
+  Slice result;
+  Status status;
+
+  ReadRequest() : offset(0), len(0), scratch(nullptr) {}
+};
+
 // A file abstraction for randomly reading the contents of a file.
 class RandomAccessFile {
   __DISALLOW_COPYING__(RandomAccessFile);
@@ -51,6 +70,22 @@ class RandomAccessFile {
   //
   // Safe for concurrent use by multiple threads.
   virtual Status Read(size_t n, uint64_t offset, char *dst, Slice *result) = 0;
+
+  // Returns true if Read sets "*result" to point at memory owned by the file
+  // itself (e.g. a mmaped region), which stays valid until the file is
+  // destroyed. In that case "dst" is never written, and callers may pass
+  // nullptr as "dst" to skip allocating a buffer altogether.
+  virtual bool HasStableContents() const {
+    return false;
+  }
+
+  // Performs the reads of reqs[0, n-1], each as if by Read. Implementations
+  // may keep all of them in flight at once, so that a batch of lookups costs
+  // about one device round trip rather than n. The status of every request
+  // is stored in its "status".
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual void MultiRead(ReadRequest *reqs, size_t n);
 };
 
 // A file abstraction for reading sequentially through a file.
@@ -95,6 +130,19 @@ class WritableFile {
  public:
   virtual Status Append(const Slice &data) = 0;
 
+  // Appends the concatenation of data[0..n-1]. The default appends them one
+  // by one, the posix files gather them into a single writev/pwritev, so
+  // that the pieces of a log record (e.g the batches of a write group) are
+  // written without being copied into one buffer first.
+  virtual Status Appendv(const Slice *data, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      Status s = Append(data[i]);
+      if (!s)
+        return s;
+    }
+    return Status::OK();
+  }
+
   virtual Status Sync() = 0;
 
   virtual Status Close() = 0;
@@ -102,6 +150,42 @@ class WritableFile {
   virtual Status Flush() = 0;
 };
 
+// Options of the writable files created by FileFactory::NewFdWriteFactory.
+struct FdWriteOptions {
+  // If true, writes bypass the page cache by O_DIRECT, falling back to
+  // buffered writes if the file system doesn't support it. The data is then
+  // written in multiples of kDirectIOAlignment bytes from an aligned buffer,
+  // a partial tail block being rewritten by the following flushes.
+  // Default: false
+  bool use_direct_writes;
+
+  // Size of the user-space buffer of each file, Append only makes a write
+  // syscall when the buffer is full. Rounded up to kDirectIOAlignment.
+  // Default: 1MB
+  size_t buffer_size;
+
+  // If non-zero, the space of a file is allocated (by fallocate) in extents
+  // of this size ahead of the writes, so that a growing file doesn't make
+  // every fsync update the extent tree.
+  // Default: 4MB
+  size_t preallocation_size;
+
+  // If non-zero, the data written since the last call is handed to the
+  // device (by sync_file_range) every time this many bytes are written,
+  // instead of leaving a large amount of dirty pages to the final sync,
+  // e.g of a table build.
+  // Default: 0
+  size_t bytes_per_sync;
+
+  static const size_t kDirectIOAlignment = 4096;
+
+  FdWriteOptions()
+      : use_direct_writes(false),
+        buffer_size(1 << 20),
+        preallocation_size(4 << 20),
+        bytes_per_sync(0) {}
+};
+
 class FileFactory {
   __DISALLOW_COPYING__(FileFactory);
 
@@ -137,7 +221,41 @@ class FileFactory {
   virtual WritableFile *NewWritableFile(const std::string &fname,
                                         Status *s) = 0;
 
+  // Stores in *result the names of the children of the specified directory.
+  // The names are relative to "dir".
+  virtual Status GetChildren(const std::string &dir,
+                             std::vector<std::string> *result) = 0;
+
+  // Creates the specified directory if it doesn't exist yet.
+  virtual Status CreateDirIfMissing(const std::string &dirname) = 0;
+
+  // Returns true iff the named file or directory exists.
+  virtual bool FileExists(const std::string &fname) = 0;
+
+  // Deletes the named file.
+  virtual Status DeleteFile(const std::string &fname) = 0;
+
+  // Stores the size of the named file in *size.
+  virtual Status GetFileSize(const std::string &fname, uint64_t *size) = 0;
+
+  // Renames file src to target, replacing target if it exists.
+  virtual Status RenameFile(const std::string &src,
+                            const std::string &target) = 0;
+
+  // Reads the whole contents of the named file into *data.
+  Status ReadFileToString(const std::string &fname, std::string *data);
+
   static FileFactory *Default();
+
+  // Returns a factory of the same files as Default(), except that writable
+  // files are written through a raw file descriptor instead of stdio, as
+  // configured by "options". Their Sync() is fdatasync.
+  // The caller should delete the result when it's no longer needed.
+  static FileFactory *NewFdWriteFactory(const FdWriteOptions &options);
+
+  // Sets the maximum number of read-only files that Default() will mmap.
+  // Must be called before the first call to Default().
+  static void TEST_SetMmapLimit(int limit);
 };
 
 }  // namespace lessdb
@@ -0,0 +1,148 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "FilterBlock.h"
+#include "DataView.h"
+#include "FilterStrategy.h"
+#include "PrefixExtractor.h"
+
+namespace lessdb {
+
+FilterBlockBuilder::FilterBlockBuilder(const FilterStrategy *strategy,
+                                       const PrefixExtractor *prefix_extractor)
+    : strategy_(strategy),
+      prefix_extractor_(prefix_extractor),
+      has_last_prefix_(false) {}
+
+void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
+  uint64_t filter_index = (block_offset / kFilterBase);
+  assert(filter_index >= filter_offsets_.size());
+  while (filter_index > filter_offsets_.size()) {
+    generateFilter();
+  }
+}
+
+void FilterBlockBuilder::AddKey(const Slice &key) {
+  addEntry(key);
+  if (prefix_extractor_ && prefix_extractor_->InDomain(key)) {
+    // The keys are sorted, so the keys of a prefix are adjacent, and their
+    // prefix is added once per filter.
+    const Slice prefix = prefix_extractor_->Transform(key);
+    if (!has_last_prefix_ || !(prefix == Slice(last_prefix_))) {
+      addEntry(prefix);
+      last_prefix_.assign(prefix.RawData(), prefix.Len());
+      has_last_prefix_ = true;
+    }
+  }
+}
+
+void FilterBlockBuilder::addEntry(const Slice &entry) {
+  start_.push_back(keys_.size());
+  keys_.append(entry.RawData(), entry.Len());
+}
+
+Slice FilterBlockBuilder::Finish() {
+  if (!start_.empty()) {
+    generateFilter();
+  }
+
+  char ibuf[sizeof(uint32_t)];
+
+  // Append array of per-filter offsets
+  const uint32_t array_offset = static_cast<uint32_t>(result_.size());
+  for (size_t i = 0; i < filter_offsets_.size(); i++) {
+    DataView(ibuf).WriteNum(filter_offsets_[i]);
+    result_.append(ibuf, sizeof(uint32_t));
+  }
+
+  DataView(ibuf).WriteNum(array_offset);
+  result_.append(ibuf, sizeof(uint32_t));
+  result_.push_back(static_cast<char>(kFilterBaseLg));
+  return Slice(result_);
+}
+
+void FilterBlockBuilder::generateFilter() {
+  const size_t num_keys = start_.size();
+  if (num_keys == 0) {
+    // Fast path if there are no keys for this filter
+    filter_offsets_.push_back(static_cast<uint32_t>(result_.size()));
+    return;
+  }
+
+  // Make list of keys from flattened key structure
+  start_.push_back(keys_.size());  // Simplify length computation
+  tmp_keys_.resize(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    const char *base = keys_.data() + start_[i];
+    size_t length = start_[i + 1] - start_[i];
+    tmp_keys_[i] = Slice(base, length);
+  }
+
+  // Generate filter for current set of keys and append to result_.
+  filter_offsets_.push_back(static_cast<uint32_t>(result_.size()));
+  strategy_->CreateFilter(&tmp_keys_[0], num_keys, &result_);
+
+  tmp_keys_.clear();
+  keys_.clear();
+  start_.clear();
+  has_last_prefix_ = false;
+}
+
+FilterBlockReader::FilterBlockReader(const FilterStrategy *strategy,
+                                     const Slice &contents)
+    : strategy_(strategy),
+      data_(nullptr),
+      offset_(nullptr),
+      num_(0),
+      base_lg_(0) {
+  size_t n = contents.Len();
+  if (n < 5)
+    return;  // 1 byte for base_lg_ and 4 for start of offset array
+  base_lg_ = static_cast<uint8_t>(contents[n - 1]);
+  uint32_t last_word = ConstDataView(contents.RawData() + n - 5)
+                           .ReadNum<uint32_t>();
+  if (last_word > n - 5)
+    return;
+  data_ = contents.RawData();
+  offset_ = data_ + last_word;
+  num_ = (n - 5 - last_word) / 4;
+}
+
+bool FilterBlockReader::MightContain(uint64_t block_offset,
+                                     const Slice &key) const {
+  uint64_t index = block_offset >> base_lg_;
+  if (index < num_) {
+    uint32_t start = ConstDataView(offset_ + index * 4).ReadNum<uint32_t>();
+    uint32_t limit =
+        ConstDataView(offset_ + index * 4 + 4).ReadNum<uint32_t>();
+    if (start <= limit && limit <= static_cast<size_t>(offset_ - data_)) {
+      Slice filter = Slice(data_ + start, limit - start);
+      return strategy_->MightContain(key, filter);
+    } else if (start == limit) {
+      // Empty filters do not match any keys
+      return false;
+    }
+  }
+  return true;  // Errors are treated as potential matches
+}
+
+}  // namespace lessdb
@@ -0,0 +1,114 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Disallowcopying.h"
+#include "Slice.h"
+
+namespace lessdb {
+
+class FilterStrategy;
+class PrefixExtractor;
+
+// A filter block is stored near the end of an SSTable. It contains filters
+// (e.g., bloom filters) for all data blocks in the table combined into a
+// single filter block, in the format of:
+//     filter_block := filter[num_filters] offsets offset_array_start base_lg
+//     offsets := uint32[num_filters]
+//     offset_array_start := uint32
+//     base_lg := uint8
+//
+// offsets[i] contains the offset within the filter block of the ith filter.
+// The ith filter summarizes the keys of the data blocks that start in the
+// range of [i*base, (i+1)*base) of the file, where base = 2^base_lg.
+//
+
+// Generate new filter every 2KB of data.
+static const size_t kFilterBaseLg = 11;
+static const size_t kFilterBase = 1 << kFilterBaseLg;
+
+// FilterBlockBuilder is used to construct all of the filters for a
+// particular SSTable. It generates a single string which is stored as
+// a special block in the table.
+//
+// The sequence of calls to FilterBlockBuilder must match the regexp:
+//      (StartBlock AddKey*)* Finish
+class FilterBlockBuilder {
+  __DISALLOW_COPYING__(FilterBlockBuilder);
+
+ public:
+  // If prefix_extractor is not NULL, the prefixes of the keys are added to
+  // the filters along with the keys.
+  explicit FilterBlockBuilder(const FilterStrategy *strategy,
+                              const PrefixExtractor *prefix_extractor = nullptr);
+
+  // Called before the keys of a data block starting at block_offset is added.
+  void StartBlock(uint64_t block_offset);
+
+  void AddKey(const Slice &key);
+
+  // Returns a Slice that refers to the underlying filter block contents.
+  Slice Finish();
+
+ private:
+  void generateFilter();
+
+  void addEntry(const Slice &entry);
+
+ private:
+  const FilterStrategy *strategy_;
+  const PrefixExtractor *prefix_extractor_;
+  std::string last_prefix_;      // Last prefix added to the current filter
+  bool has_last_prefix_;
+  std::string keys_;             // Flattened key contents
+  std::vector<size_t> start_;    // Starting index in keys_ of each key
+  std::string result_;           // Filter data computed so far
+  std::vector<Slice> tmp_keys_;  // strategy_->CreateFilter() argument
+  std::vector<uint32_t> filter_offsets_;
+};
+
+class FilterBlockReader {
+  __DISALLOW_COPYING__(FilterBlockReader);
+
+ public:
+  // REQUIRES: "contents" and *strategy must stay live while *this is live.
+  FilterBlockReader(const FilterStrategy *strategy, const Slice &contents);
+
+  // Returns false iff the key definitely does not exist in the data block
+  // starting at block_offset.
+  bool MightContain(uint64_t block_offset, const Slice &key) const;
+
+ private:
+  const FilterStrategy *strategy_;
+  const char *data_;    // Pointer to filter data (at block-start)
+  const char *offset_;  // Pointer to beginning of offset array (at block-end)
+  size_t num_;          // Number of entries in offset array
+  size_t base_lg_;      // Encoding parameter (see kFilterBaseLg)
+};
+
+}  // namespace lessdb
@@ -20,8 +20,10 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <cstdint>
 #include <string>
-#include <boost/functional/hash.hpp>
+#include <cstring>
 #include "FilterStrategy.h"
 #include "Slice.h"
 
@@ -39,41 +41,244 @@ class BloomFilterStrategy : public FilterStrategy {
   // See analysis in [Kirsch,Mitzenmacher 2006].
   // The double-hashing functions is of the form gi(x) = h1(x) + i*h2(x).
   //
+  // The filter is in the format of:
+  //     bits:          uint8[m/8]
+  //     k:             uint8
+  //
 
-  const size_t kMinBloomFilterLength = 64;
+  static const size_t kMinBloomFilterBits = 64;
 
  public:
-  BloomFilterStrategy(size_t bits_per_key) : bits_per_byte_(bits_per_key) {
+  BloomFilterStrategy(size_t bits_per_key) : bits_per_key_(bits_per_key) {
     k_ = static_cast<size_t>(bits_per_key * 0.69);  // ln2 ~= 0.69
+    if (k_ < 1)
+      k_ = 1;
+    if (k_ > 30)
+      k_ = 30;
+  }
+
+  const char *Name() const override {
+    return "lessdb.BuiltinBloomFilter";
+  }
+
+  void CreateFilter(const Slice *keys, size_t n,
+                    std::string *dst) const override {
+    size_t bits = std::max(n * bits_per_key_, kMinBloomFilterBits);
+    size_t bytes = (bits + 7) / 8;
+    bits = bytes * 8;
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + bytes, 0);
+    dst->push_back(static_cast<char>(k_));  // Remember # of probes in filter
+    char *array = &(*dst)[init_size];
+    for (size_t i = 0; i < n; i++) {
+      uint32_t h = hash(keys[i]);
+      const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
+      for (size_t j = 0; j < k_; ++j) {
+        const uint32_t g = static_cast<uint32_t>(h % bits);
+        array[g / 8] |= static_cast<char>(1 << (g % 8));
+        h += delta;
+      }
+    }
+  }
+
+  bool MightContain(const Slice &key, const Slice &filter) const override {
+    if (filter.Len() < 2)
+      return false;
+
+    const char *array = filter.RawData();
+    const size_t bits = (filter.Len() - 1) * 8;
+
+    // Use the encoded k so that we can read filters generated by
+    // bloom filters created using different parameters.
+    const size_t k = static_cast<uint8_t>(array[filter.Len() - 1]);
+    if (k > 30) {
+      // Reserved for potentially new encodings for short bloom filters.
+      // Consider it a match.
+      return true;
+    }
+
+    uint32_t h = hash(key);
+    const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
+    for (size_t i = 0; i < k; ++i) {
+      const uint32_t g = static_cast<uint32_t>(h % bits);
+      if (!(array[g / 8] & (1 << (g % 8))))
+        return false;
+      h += delta;
+    }
+    return true;
+  }
+
+ private:
+  // Similar to murmur hash, with a fixed seed.
+  static uint32_t hash(const Slice &key) {
+    const uint32_t seed = 0xbc9f1d34;
+    const uint32_t m = 0xc6a4a793;
+    const uint32_t r = 24;
+    const char *data = key.RawData();
+    size_t n = key.Len();
+    const char *limit = data + n;
+    uint32_t h = static_cast<uint32_t>(seed ^ (n * m));
+
+    // Pick up four bytes at a time
+    while (data + 4 <= limit) {
+      uint32_t w;
+      memcpy(&w, data, sizeof(w));
+      data += 4;
+      h += w;
+      h *= m;
+      h ^= (h >> 16);
+    }
+
+    // Pick up remaining bytes
+    switch (limit - data) {
+      case 3:
+        h += static_cast<uint8_t>(data[2]) << 16;
+      // fall through
+      case 2:
+        h += static_cast<uint8_t>(data[1]) << 8;
+      // fall through
+      case 1:
+        h += static_cast<uint8_t>(data[0]);
+        h *= m;
+        h ^= (h >> r);
+        break;
+    }
+    return h;
+  }
+
+ private:
+  size_t bits_per_key_;
+  size_t k_;
+};
+
+class BlockedBloomFilterStrategy : public FilterStrategy {
+  //
+  // The bits are divided into cache lines of 512 bits. A key is mapped to
+  // one of the lines by the high bits of its hash, and all of its k probes
+  // are set within that line.
+  //
+  // The filter is in the format of:
+  //     lines:         uint8[num_lines * 64]
+  //     k:             uint8
+  //
+
+  static const size_t kCacheLineSize = 64;
+  static const size_t kCacheLineBits = kCacheLineSize * 8;
+
+ public:
+  BlockedBloomFilterStrategy(size_t bits_per_key)
+      : bits_per_key_(bits_per_key) {
+    // ln2 ~= 0.69
+    k_ = static_cast<size_t>(static_cast<double>(bits_per_key) * 0.69);
+    if (k_ < 1)
+      k_ = 1;
+    if (k_ > 30)
+      k_ = 30;
+  }
+
+  const char *Name() const override {
+    return "lessdb.BlockedBloomFilter";
   }
 
-  inline void Put(const Slice &key, Slice &bits) override {
-    size_t h1 = boost::hash_range(key.RawData(), key.RawData() + key.Len());
-    size_t h2 = (h1 >> 17) | (h1 << 15);  // Rotate right 17 bits
-    for (size_t i = 0; i < k_; ++i) {
-      size_t g = (h1 + i * h2) % bits.Len();
-      bits[g / 8] |= (1 << (g % 8));
+  void CreateFilter(const Slice *keys, size_t n,
+                    std::string *dst) const override {
+    size_t num_lines =
+        (n * bits_per_key_ + kCacheLineBits - 1) / kCacheLineBits;
+    if (num_lines == 0)
+      num_lines = 1;
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + num_lines * kCacheLineSize, 0);
+    dst->push_back(static_cast<char>(k_));  // Remember # of probes in filter
+    char *array = &(*dst)[init_size];
+    for (size_t i = 0; i < n; i++) {
+      uint64_t h = hash(keys[i]);
+      char *line = array + lineOf(h, num_lines) * kCacheLineSize;
+      uint32_t h32 = static_cast<uint32_t>(h);
+      for (size_t j = 0; j < k_; ++j) {
+        const uint32_t bit = h32 >> 23;  // 9 bits, [0, 512)
+        line[bit >> 3] |= static_cast<char>(1 << (bit & 7));
+        h32 *= 0x9e3779b9;
+      }
     }
   }
 
-  inline bool MightContain(const Slice &key, const Slice &bits) const override {
-    size_t h1 = boost::hash_range(key.RawData(), key.RawData() + key.Len());
-    size_t h2 = (h1 >> 17) | (h1 << 15);  // Rotate right 17 bits
-    for (size_t i = 0; i < k_; ++i) {
-      size_t g = (h1 + i * h2) % bits.Len();
-      if (!(bits[g / 8] & (1 << (g % 8))))
+  bool MightContain(const Slice &key, const Slice &filter) const override {
+    if (filter.Len() < 2)
+      return false;
+
+    const char *array = filter.RawData();
+    const size_t k = static_cast<uint8_t>(array[filter.Len() - 1]);
+    const size_t num_lines = (filter.Len() - 1) / kCacheLineSize;
+    if (k > 30 || num_lines == 0) {
+      // Not a filter of ours. Consider it a match.
+      return true;
+    }
+
+    uint64_t h = hash(key);
+    const char *line = array + lineOf(h, num_lines) * kCacheLineSize;
+    uint32_t h32 = static_cast<uint32_t>(h);
+    for (size_t i = 0; i < k; ++i) {
+      const uint32_t bit = h32 >> 23;
+      if (!(line[bit >> 3] & (1 << (bit & 7))))
         return false;
+      h32 *= 0x9e3779b9;
     }
     return true;
   }
 
  private:
-  size_t bits_per_byte_;
+  // Maps the high 32 bits of h onto [0, num_lines) by multiply-shift,
+  // which avoids a division per lookup.
+  static size_t lineOf(uint64_t h, size_t num_lines) {
+    return static_cast<size_t>(((h >> 32) * num_lines) >> 32);
+  }
+
+  // A 64-bit hash that consumes eight bytes per round, finalized with the
+  // murmur3 fmix64 avalanche.
+  static uint64_t hash(const Slice &key) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const char *data = key.RawData();
+    size_t n = key.Len();
+    const char *limit = data + n;
+    uint64_t h = 0x9ae16a3b2f90404fULL ^ (n * m);
+
+    while (data + 8 <= limit) {
+      uint64_t w;
+      memcpy(&w, data, sizeof(w));
+      data += 8;
+      w *= m;
+      w ^= w >> 47;
+      w *= m;
+      h ^= w;
+      h *= m;
+    }
+
+    uint64_t w = 0;
+    memcpy(&w, data, static_cast<size_t>(limit - data));
+    h ^= w;
+    h *= m;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+ private:
+  size_t bits_per_key_;
   size_t k_;
 };
 
-FilterStrategy *FilterStrategy::Default(size_t bits_per_bytes) {
-  return new BloomFilterStrategy(bits_per_bytes);
+FilterStrategy *FilterStrategy::Default(size_t bits_per_key) {
+  return new BloomFilterStrategy(bits_per_key);
+}
+
+FilterStrategy *FilterStrategy::Blocked(size_t bits_per_key) {
+  return new BlockedBloomFilterStrategy(bits_per_key);
 }
 
 }  // namespace lessdb
@@ -22,27 +22,51 @@
 
 #pragma once
 
+#include <cstddef>
+#include <string>
+
 #include "Disallowcopying.h"
 #include "SliceFwd.h"
 
 namespace lessdb {
 
+// A FilterStrategy summarizes a set of keys into a small filter, which allows
+// SSTable to skip reading a data block that definitely does not contain a
+// given key.
+// FilterStrategy is an option that can be customized by users.(@see Options.h)
 class FilterStrategy {
   __DISALLOW_COPYING__(FilterStrategy);
 
  public:
   virtual ~FilterStrategy() = default;
 
-  // Put a key into this filter.
-  virtual void Put(const Slice& key, Slice& bits) = 0;
+  // The name of the filter strategy, which is persisted in the meta index
+  // block of an SSTable. A table whose filter is built by a strategy with a
+  // different name will not have its filter consulted.
+  virtual const char* Name() const = 0;
+
+  // Append a filter that summarizes keys[0,n-1] to *dst.
+  virtual void CreateFilter(const Slice* keys, size_t n,
+                            std::string* dst) const = 0;
 
   // Queries the given bits array if the key is set.
+  // The bits array must be created by CreateFilter of this strategy.
+  // Returns false iff the key is definitely not in the key set.
   virtual bool MightContain(const Slice& key, const Slice& bits) const = 0;
 
-  static FilterStrategy* Default(size_t bits_per_bytes);
+  // Default FilterStrategy is a bloom filter with approximately the specified
+  // number of bits per key. A good value for bits_per_key is 10, which yields
+  // a filter with ~1% false positive rate.
+  static FilterStrategy* Default(size_t bits_per_key);
+
+  // Blocked FilterStrategy is a bloom filter whose probes for a key all fall
+  // into one 64-byte cache line, so that a negative lookup costs a single
+  // cache miss. It's slightly less accurate than Default for the same
+  // bits_per_key.
+  static FilterStrategy* Blocked(size_t bits_per_key);
 
  protected:
   FilterStrategy() = default;
 };
 
-}  // namespace lessdb
\ No newline at end of file
+}  // namespace lessdb
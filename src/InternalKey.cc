@@ -31,14 +31,17 @@ namespace lessdb {
 
 /// InternalKeyBuf
 
-static inline uint64_t packSequenceAndType(SequenceNumber sequence,
-                                           ValueType type) {
-  return static_cast<uint64_t>((sequence << 8) | static_cast<uint8_t>(type));
-}
-
 InternalKeyBuf::InternalKeyBuf(Slice key, SequenceNumber seq, ValueType type) {
   bytes_.append(key.RawData(), key.Len());
-  coding::AppendFixed64(&bytes_, packSequenceAndType(seq, type));
+  coding::AppendFixed64(&bytes_, PackSequenceAndType(seq, type));
+}
+
+void ReplaceSequence(const Slice &key, SequenceNumber sequence,
+                     std::string *dst) {
+  assert(key.Len() >= 8);
+  InternalKey ikey(key);
+  dst->assign(key.RawData(), key.Len() - 8);
+  coding::AppendFixed64(dst, PackSequenceAndType(sequence, ikey.type));
 }
 
 /// InternalKeyComparator
@@ -47,8 +50,8 @@ int InternalKeyComparator::Compare(const InternalKey &lhs,
                                    const InternalKey &rhs) const {
   int r = comparator_->Compare(lhs.user_key, rhs.user_key);
   if (r == 0) {
-    uint64_t l_num = packSequenceAndType(lhs.sequence, lhs.type);
-    uint64_t r_num = packSequenceAndType(rhs.sequence, rhs.type);
+    uint64_t l_num = PackSequenceAndType(lhs.sequence, lhs.type);
+    uint64_t r_num = PackSequenceAndType(rhs.sequence, rhs.type);
     if (l_num < r_num)
       r = +1;
     else if (l_num > r_num)
@@ -57,6 +60,36 @@ int InternalKeyComparator::Compare(const InternalKey &lhs,
   return r;
 }
 
+void InternalKeyComparator::FindShortestSeparator(std::string *start,
+                                                  const Slice &limit) const {
+  Slice user_start(start->data(), start->size() - 8);
+  Slice user_limit(limit.RawData(), limit.Len() - 8);
+  std::string tmp(user_start.RawData(), user_start.Len());
+  comparator_->FindShortestSeparator(&tmp, user_limit);
+  if (tmp.size() < user_start.Len() &&
+      comparator_->Compare(user_start, tmp) < 0) {
+    // The user key became shorter physically, but larger logically.
+    coding::AppendFixed64(&tmp,
+                          PackSequenceAndType(kMaxSequenceNumber, kTypeValue));
+    assert(Compare(Slice(*start), Slice(tmp)) < 0);
+    assert(Compare(Slice(tmp), limit) < 0);
+    start->swap(tmp);
+  }
+}
+
+void InternalKeyComparator::FindShortSuccessor(std::string *key) const {
+  Slice user_key(key->data(), key->size() - 8);
+  std::string tmp(user_key.RawData(), user_key.Len());
+  comparator_->FindShortSuccessor(&tmp);
+  if (tmp.size() < user_key.Len() && comparator_->Compare(user_key, tmp) < 0) {
+    // The user key became shorter physically, but larger logically.
+    coding::AppendFixed64(&tmp,
+                          PackSequenceAndType(kMaxSequenceNumber, kTypeValue));
+    assert(Compare(Slice(*key), Slice(tmp)) < 0);
+    key->swap(tmp);
+  }
+}
+
 /// InternalKey
 
 InternalKey::InternalKey(const Slice &key) {
@@ -22,10 +22,14 @@
 
 #pragma once
 
+#include <cassert>
+
 #include "Slice.h"
 #include "DBFormat.h"
 #include "Disallowcopying.h"
 #include "Comparator.h"
+#include "DataView.h"
+#include "PrefixExtractor.h"
 
 namespace lessdb {
 
@@ -56,25 +60,122 @@ struct InternalKey {
   ValueType type;
 };
 
-class InternalKeyComparator {
+// Stores into *dst the encoded internal "key" with its sequence replaced by
+// "sequence", e.g. the entry of an ingested sstable as of the global sequence
+// of the table. @see FileMetaData::global_sequence
+void ReplaceSequence(const Slice &key, SequenceNumber sequence,
+                     std::string *dst);
+
+// InternalKeyComparator is also a Comparator of encoded internal keys, which
+// sorts the sstables built from memtables. It's final, so that the calls
+// through an InternalKeyComparator are not virtual.
+class InternalKeyComparator final : public Comparator {
  public:
   //
   // InternalKeyComparator uses user_comparator to compares the
   // user_keys of two InternalKey objects.
   //
   explicit InternalKeyComparator(const Comparator *user_comparator)
-      : comparator_(user_comparator) {}
+      : comparator_(user_comparator),
+        bytewise_(user_comparator == NewBytewiseComparator()) {}
 
   InternalKeyComparator(const InternalKeyComparator &) = default;
 
   int Compare(const InternalKey &lhs, const InternalKey &rhs) const;
 
-  int Compare(const Slice &lhs, const Slice &rhs) const {
-    return Compare(InternalKey(lhs), InternalKey(rhs));
+  // Compares two encoded internal keys without decoding them into
+  // InternalKey objects. When the user comparator is the builtin bytewise
+  // comparator, the user keys are compared inline instead of through the
+  // virtual Comparator::Compare.
+  int Compare(const Slice &lhs, const Slice &rhs) const override {
+    assert(lhs.Len() >= 8 && rhs.Len() >= 8);
+    Slice l_user(lhs.RawData(), lhs.Len() - 8);
+    Slice r_user(rhs.RawData(), rhs.Len() - 8);
+    int r = bytewise_ ? l_user.Compare(r_user)
+                      : comparator_->Compare(l_user, r_user);
+    return r != 0 ? r : compareTags(lhs, rhs);
+  }
+
+  // Compare(lhs, rhs) of a comparator that IsBytewise(), for the callers
+  // that know the user order at compile time, e.g the block search.
+  static int BytewiseCompare(const Slice &lhs, const Slice &rhs) {
+    assert(lhs.Len() >= 8 && rhs.Len() >= 8);
+    int r = Slice(lhs.RawData(), lhs.Len() - 8)
+                .Compare(Slice(rhs.RawData(), rhs.Len() - 8));
+    return r != 0 ? r : compareTags(lhs, rhs);
+  }
+
+  const char *Name() const override {
+    return "lessdb.InternalKeyComparator";
+  }
+
+  // Shortens the user key of *start by the user comparator, appending the
+  // largest tag, which sorts first among the entries of that user key.
+  void FindShortestSeparator(std::string *start,
+                             const Slice &limit) const override;
+
+  // Shortens the user key of *key by the user comparator, appending the
+  // largest tag as FindShortestSeparator does.
+  void FindShortSuccessor(std::string *key) const override;
+
+  const Comparator *user_comparator() const {
+    return comparator_;
+  }
+
+  // Whether the user comparator is the one returned by
+  // NewBytewiseComparator().
+  bool IsBytewise() const {
+    return bytewise_;
+  }
+
+ private:
+  // Tags are ordered decreasingly, the newest entry comes first.
+  static int compareTags(const Slice &lhs, const Slice &rhs) {
+    uint64_t l_num =
+        ConstDataView(lhs.RawData() + lhs.Len() - 8).ReadNum<uint64_t>();
+    uint64_t r_num =
+        ConstDataView(rhs.RawData() + rhs.Len() - 8).ReadNum<uint64_t>();
+    if (l_num < r_num)
+      return +1;
+    if (l_num > r_num)
+      return -1;
+    return 0;
   }
 
  private:
   const Comparator *comparator_;
+  bool bytewise_;
+};
+
+// InternalKeyPrefixExtractor extracts the prefixes of the user keys of
+// encoded internal keys by the user extractor, for the filters of the
+// sstables built from memtables. It keeps the name of the user extractor,
+// which is what the tables record.
+class InternalKeyPrefixExtractor final : public PrefixExtractor {
+ public:
+  explicit InternalKeyPrefixExtractor(const PrefixExtractor *user_extractor)
+      : extractor_(user_extractor) {}
+
+  const char *Name() const override {
+    return extractor_->Name();
+  }
+
+  bool InDomain(const Slice &key) const override {
+    assert(key.Len() >= 8);
+    return extractor_->InDomain(Slice(key.RawData(), key.Len() - 8));
+  }
+
+  Slice Transform(const Slice &key) const override {
+    assert(key.Len() >= 8);
+    return extractor_->Transform(Slice(key.RawData(), key.Len() - 8));
+  }
+
+  const PrefixExtractor *user_extractor() const {
+    return extractor_;
+  }
+
+ private:
+  const PrefixExtractor *extractor_;
 };
 
 }  // namespace lessdb
\ No newline at end of file
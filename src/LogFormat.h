@@ -23,6 +23,8 @@
 
 #pragma once
 
+#include <cstdint>
+
 namespace lessdb {
 namespace log {
 
@@ -31,9 +33,10 @@ namespace log {
 // Each block consists of a sequence of records:
 // block := record* trailer?
 // record :=
-//    checksum: uint32	    // crc32c of type and data[] ; little-endian
-//    length:   uint16		// little-endian
-//    type:     uint8		// One of FULL, FIRST, MIDDLE, LAST
+//    checksum: uint32	    // checksum of data[]
+//    length:   uint16
+//    type:     uint8		// One of FULL, FIRST, MIDDLE, LAST, possibly
+//                          // with kRecordTypeCrc32cFlag set
 //    data:     uint8[length]
 
 static constexpr int kBlockSize = 32768;
@@ -58,5 +61,10 @@ enum class RecordType : uint8_t {
   kLast
 };
 
+// Set in the type byte of the records whose checksum is crc32c. The records
+// without it are written by older versions, whose checksum is LegacyCrc32.
+// @see Crc32c.h
+static constexpr uint8_t kRecordTypeCrc32cFlag = 0x80;
+
 }  // namespace log
 }  // namespace lessdb
\ No newline at end of file
@@ -0,0 +1,342 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <thread>
+
+#include "Crc32c.h"
+#include "DataView.h"
+#include "FileUtils.h"
+#include "LogReader.h"
+#include "Status.h"
+
+namespace lessdb {
+namespace log {
+
+// Number of blocks read at a time when the checksums are verified in
+// parallel, large enough to keep every thread busy for a while.
+static constexpr size_t kParallelReadBlocks = 128;
+
+// The checksum of a fragment, chosen by the type byte in its header.
+static inline uint32_t FragmentChecksum(uint8_t raw_type, const char *data,
+                                        size_t n) {
+  return (raw_type & kRecordTypeCrc32cFlag) ? crc32c::Value(data, n)
+                                            : LegacyCrc32(data, n);
+}
+
+Reader::Reader(SequentialFile *file, Reporter *reporter, bool checksum,
+               int num_threads)
+    : file_(file),
+      reporter_(reporter),
+      checksum_(checksum),
+      num_threads_(std::max(num_threads, 1)),
+      blocks_per_read_((checksum && num_threads > 1) ? kParallelReadBlocks
+                                                     : 1),
+      backing_store_(new char[kBlockSize * blocks_per_read_]),
+      buffer_(backing_store_.get(), 0),
+      eof_(false) {}
+
+Reader::~Reader() = default;
+
+bool Reader::ReadRecord(Slice *record, std::string *scratch) {
+  scratch->clear();
+  *record = Slice();
+  bool in_fragmented_record = false;
+
+  while (true) {
+    Slice fragment;
+    const int record_type = readPhysicalRecord(&fragment);
+    switch (record_type) {
+      case static_cast<int>(RecordType::kFull):
+        if (in_fragmented_record && !scratch->empty()) {
+          reportCorruption(scratch->size(),
+                           Status::Corruption("partial record without end"));
+        }
+        scratch->clear();
+        *record = fragment;
+        return true;
+
+      case static_cast<int>(RecordType::kFirst):
+        if (in_fragmented_record && !scratch->empty()) {
+          reportCorruption(scratch->size(),
+                           Status::Corruption("partial record without end"));
+        }
+        scratch->assign(fragment.RawData(), fragment.Len());
+        in_fragmented_record = true;
+        break;
+
+      case static_cast<int>(RecordType::kMiddle):
+        if (!in_fragmented_record) {
+          reportCorruption(
+              fragment.Len(),
+              Status::Corruption("missing start of fragmented record"));
+        } else {
+          scratch->append(fragment.RawData(), fragment.Len());
+        }
+        break;
+
+      case static_cast<int>(RecordType::kLast):
+        if (!in_fragmented_record) {
+          reportCorruption(
+              fragment.Len(),
+              Status::Corruption("missing start of fragmented record"));
+        } else {
+          scratch->append(fragment.RawData(), fragment.Len());
+          *record = Slice(*scratch);
+          return true;
+        }
+        break;
+
+      case kEof:
+        // The writer may have died in the middle of a fragmented record,
+        // which is not reported as a corruption.
+        scratch->clear();
+        return false;
+
+      case kBadRecord:
+        if (in_fragmented_record) {
+          reportCorruption(scratch->size(),
+                           Status::Corruption("error in middle of record"));
+          in_fragmented_record = false;
+          scratch->clear();
+        }
+        break;
+
+      default:
+        reportCorruption(
+            fragment.Len() + (in_fragmented_record ? scratch->size() : 0),
+            Status::Corruption("unknown record type") << record_type);
+        in_fragmented_record = false;
+        scratch->clear();
+        break;
+    }
+  }
+}
+
+int Reader::readPhysicalRecord(Slice *result) {
+  while (true) {
+    size_t offset =
+        static_cast<size_t>(buffer_.RawData() - backing_store_.get());
+    size_t block_offset = offset % kBlockSize;
+    size_t left_in_block = kBlockSize - block_offset;
+
+    if (left_in_block < kHeaderSize && !buffer_.Empty()) {
+      // Skip the trailer of a block in the middle of the batch.
+      buffer_.Skip(std::min(left_in_block, buffer_.Len()));
+      continue;
+    }
+
+    if (buffer_.Len() < kHeaderSize) {
+      if (!eof_ && readBatch())
+        continue;
+      // Either a clean end of file, or a truncated header at the end of
+      // file, which is the result of the writer crashing in the middle of
+      // writing the header. Neither of them is a corruption.
+      buffer_ = Slice(backing_store_.get(), 0);
+      return kEof;
+    }
+
+    const char *header = buffer_.RawData();
+    const uint32_t expected_crc = ConstDataView(header).ReadNum<uint32_t>();
+    const size_t length = ConstDataView(header + 4).ReadNum<uint16_t>();
+    const uint8_t raw_type = ConstDataView(header + 6).ReadNum<uint8_t>();
+    const int type = raw_type & ~kRecordTypeCrc32cFlag;
+
+    const size_t avail = std::min(buffer_.Len(), left_in_block);
+    if (expected_crc == 0 && length == 0 && raw_type == 0) {
+      // Zeroes are the padding of direct I/O or the preallocated space left
+      // by a crashed writer, the writer never writes them as a header since
+      // kRecordTypeCrc32cFlag is set. (Only an empty legacy record looks the
+      // same, and the DB never writes empty records.)
+      buffer_.Skip(avail);
+      continue;
+    }
+    if (kHeaderSize + length > avail) {
+      if (eof_ && kHeaderSize + length <= left_in_block) {
+        // The writer died in the middle of writing the fragment.
+        buffer_ = Slice(backing_store_.get(), 0);
+        return kEof;
+      }
+      // Drop the rest of the block, the next block begins with a fragment.
+      buffer_.Skip(avail);
+      reportCorruption(avail, Status::Corruption("bad record length"));
+      return kBadRecord;
+    }
+
+    bool verified = !verified_end_.empty() &&
+                    block_offset < verified_end_[offset / kBlockSize];
+    if (checksum_ && !verified &&
+        FragmentChecksum(raw_type, header + kHeaderSize, length) !=
+            expected_crc) {
+      // The length itself may have been corrupted, drop the rest of the
+      // block for safety.
+      buffer_.Skip(avail);
+      reportCorruption(avail, Status::Corruption("checksum mismatch"));
+      return kBadRecord;
+    }
+
+    buffer_.Skip(kHeaderSize + length);
+    *result = Slice(header + kHeaderSize, length);
+    return type;
+  }
+}
+
+bool Reader::readBatch() {
+  const size_t n = kBlockSize * blocks_per_read_;
+  Status s = file_->Read(n, backing_store_.get(), &buffer_);
+  if (!s) {
+    buffer_ = Slice(backing_store_.get(), 0);
+    reportCorruption(kBlockSize, s);
+    eof_ = true;
+    return false;
+  }
+  assert(buffer_.RawData() == backing_store_.get());
+  if (buffer_.Len() < n) {
+    eof_ = true;
+  }
+  verifyBatch();
+  return !buffer_.Empty();
+}
+
+void Reader::verifyBatch() {
+  verified_end_.clear();
+  if (!checksum_ || num_threads_ <= 1 || buffer_.Empty())
+    return;
+
+  const size_t num_blocks = (buffer_.Len() + kBlockSize - 1) / kBlockSize;
+  const size_t num_threads =
+      std::min(static_cast<size_t>(num_threads_), num_blocks);
+  verified_end_.resize(num_blocks);
+
+  // Thread t verifies the blocks t, t + num_threads, ...
+  auto verify = [this, num_blocks, num_threads](size_t t) {
+    for (size_t i = t; i < num_blocks; i += num_threads) {
+      const size_t start = i * kBlockSize;
+      const size_t n = std::min(static_cast<size_t>(kBlockSize),
+                                buffer_.Len() - start);
+      verified_end_[i] =
+          static_cast<uint32_t>(VerifyBlock(buffer_.RawData() + start, n));
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < num_threads; t++) {
+    threads.emplace_back(verify, t);
+  }
+  verify(0);
+  for (auto &th : threads) {
+    th.join();
+  }
+}
+
+size_t Reader::VerifyBlock(const char *block, size_t n) {
+  size_t offset = 0;
+  while (n - offset >= kHeaderSize) {
+    const char *header = block + offset;
+    const uint32_t expected_crc = ConstDataView(header).ReadNum<uint32_t>();
+    const size_t length = ConstDataView(header + 4).ReadNum<uint16_t>();
+    const uint8_t raw_type = ConstDataView(header + 6).ReadNum<uint8_t>();
+    if (kHeaderSize + length > n - offset ||
+        FragmentChecksum(raw_type, header + kHeaderSize, length) !=
+            expected_crc) {
+      break;
+    }
+    offset += kHeaderSize + length;
+  }
+  return offset;
+}
+
+void Reader::reportCorruption(size_t bytes, const Status &reason) {
+  if (reporter_ != nullptr) {
+    reporter_->Corruption(bytes, reason);
+  }
+}
+
+Status ReadRecordAt(const char *data, size_t n, uint64_t offset,
+                    bool checksum, Slice *record, std::string *scratch) {
+  const char *p = data;
+  const char *const limit = data + n;
+  size_t block_offset = static_cast<size_t>(offset % kBlockSize);
+  bool in_fragmented_record = false;
+  scratch->clear();
+  while (true) {
+    const size_t left_in_block = kBlockSize - block_offset;
+    if (left_in_block < kHeaderSize) {
+      // Skip the trailer, the record goes on in the next block.
+      if (static_cast<size_t>(limit - p) < left_in_block)
+        break;
+      p += left_in_block;
+      block_offset = 0;
+      continue;
+    }
+    if (limit - p < kHeaderSize)
+      break;
+
+    const uint32_t expected_crc = ConstDataView(p).ReadNum<uint32_t>();
+    const size_t length = ConstDataView(p + 4).ReadNum<uint16_t>();
+    const uint8_t raw_type = ConstDataView(p + 6).ReadNum<uint8_t>();
+    const RecordType type =
+        static_cast<RecordType>(raw_type & ~kRecordTypeCrc32cFlag);
+    if (kHeaderSize + length > left_in_block ||
+        kHeaderSize + length > static_cast<size_t>(limit - p)) {
+      return Status::Corruption("bad record length");
+    }
+    const Slice fragment(p + kHeaderSize, length);
+    if (checksum &&
+        FragmentChecksum(raw_type, fragment.RawData(), length) !=
+            expected_crc) {
+      return Status::Corruption("checksum mismatch");
+    }
+    p += kHeaderSize + length;
+    block_offset += kHeaderSize + length;
+
+    switch (type) {
+      case RecordType::kFull:
+        if (in_fragmented_record)
+          return Status::Corruption("partial record without end");
+        *record = fragment;
+        return Status::OK();
+      case RecordType::kFirst:
+        if (in_fragmented_record)
+          return Status::Corruption("partial record without end");
+        scratch->assign(fragment.RawData(), fragment.Len());
+        in_fragmented_record = true;
+        break;
+      case RecordType::kMiddle:
+      case RecordType::kLast:
+        if (!in_fragmented_record)
+          return Status::Corruption("missing start of fragmented record");
+        scratch->append(fragment.RawData(), fragment.Len());
+        if (type == RecordType::kLast) {
+          *record = Slice(*scratch);
+          return Status::OK();
+        }
+        break;
+      default:
+        return Status::Corruption("unknown record type");
+    }
+  }
+  return Status::Corruption("truncated record");
+}
+
+}  // namespace log
+}  // namespace lessdb
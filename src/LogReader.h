@@ -0,0 +1,140 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Disallowcopying.h"
+#include "LogFormat.h"
+#include "Slice.h"
+
+namespace lessdb {
+
+class SequentialFile;
+class Status;
+
+namespace log {
+
+class Reader {
+  __DISALLOW_COPYING__(Reader);
+
+ public:
+  // Interface for reporting errors.
+  class Reporter {
+   public:
+    virtual ~Reporter() = default;
+
+    // Some corruption was detected. "bytes" is the approximate number
+    // of bytes dropped due to the corruption.
+    virtual void Corruption(size_t bytes, const Status &status) = 0;
+  };
+
+  // Creates a reader that returns the records from "*file", which must remain
+  // live while this Reader is in use.
+  //
+  // If "reporter" is non-NULL, it is notified whenever some data is dropped
+  // due to a detected corruption. "*reporter" must remain live while this
+  // Reader is in use.
+  //
+  // If "checksum" is true, verifies checksums.
+  //
+  // With num_threads > 1, the reader reads a batch of blocks at a time, and
+  // the checksums of a batch are verified by num_threads threads in
+  // parallel before its records are handed out in order. Fragments never
+  // cross block boundaries, so the blocks can be verified independently.
+  Reader(SequentialFile *file, Reporter *reporter, bool checksum,
+         int num_threads = 1);
+
+  ~Reader();
+
+  // Reads the next record into *record. Returns true if read successfully,
+  // false if we hit end of the input. May use "*scratch" as temporary
+  // storage. The contents filled in *record will only be valid until the
+  // next mutating operation on this reader or the next mutation to *scratch.
+  bool ReadRecord(Slice *record, std::string *scratch);
+
+ private:
+  // Extends RecordType with special values returned by readPhysicalRecord.
+  enum {
+    kEof = static_cast<int>(RecordType::kLast) + 1,
+
+    // Returned whenever we find an invalid physical record.
+    kBadRecord
+  };
+
+  // Reads the next fragment into *result, returns its type or one of the
+  // special values above.
+  int readPhysicalRecord(Slice *result);
+
+  // Reads the next batch of blocks from file_ into buffer_, returns false on
+  // the end of file or a read error.
+  bool readBatch();
+
+  // Verifies the checksums of the blocks in buffer_ just read, by
+  // num_threads_ threads, and fills verified_end_.
+  void verifyBatch();
+
+  // Returns the offset of the first fragment in block[0, n-1] that fails
+  // the checks of readPhysicalRecord, or where the trailer starts.
+  static size_t VerifyBlock(const char *block, size_t n);
+
+  // Reports "bytes" dropped due to "reason".
+  void reportCorruption(size_t bytes, const Status &reason);
+
+ private:
+  SequentialFile *const file_;
+  Reporter *const reporter_;
+  const bool checksum_;
+  const int num_threads_;
+
+  // Number of blocks read from file_ at a time.
+  const size_t blocks_per_read_;
+
+  std::unique_ptr<char[]> backing_store_;
+
+  // The unread part of the last read.
+  Slice buffer_;
+
+  // Last Read() indicated EOF by returning < blocks_per_read_ blocks.
+  bool eof_;
+
+  // verified_end_[i] is the offset in block i of the last read before which
+  // every fragment has been verified by verifyBatch. Empty if the blocks are
+  // verified one fragment at a time by readPhysicalRecord.
+  std::vector<uint32_t> verified_end_;
+};
+
+// Decodes the single record stored in the "n" bytes of "data", read from
+// "offset" of a log file: the fragments of the record, along with the block
+// trailers in between, e.g. the extent of a blob (@see BlobIndex). The
+// checksums are verified if "checksum" is true. *record points into "data"
+// if the record is a single fragment, into *scratch otherwise.
+Status ReadRecordAt(const char *data, size_t n, uint64_t offset,
+                    bool checksum, Slice *record, std::string *scratch);
+
+}  // namespace log
+}  // namespace lessdb
@@ -20,22 +20,39 @@
  * SOFTWARE.
  */
 
-#include <boost/crc.hpp>
+#include <algorithm>
+#include <cstring>
 
+#include "Crc32c.h"
 #include "LogWriter.h"
-#include "Files.h"
+#include "FileUtils.h"
 #include "DataView.h"
+#include "Status.h"
 
 namespace lessdb {
 namespace log {
 
-// WriteRecord splits a user record into multiple fragments.
 Status Writer::WriteRecord(const Slice &record) {
+  return WriteRecord(&record, 1);
+}
+
+// WriteRecord splits a user record into multiple fragments.
+Status Writer::WriteRecord(const Slice *pieces, size_t n) {
   Status s;
-  size_t left = record.Len();
-  const char *p = record.RawData();
+  size_t left = 0;
+  for (size_t i = 0; i < n; i++)
+    left += pieces[i].Len();
+  size_t piece = 0, piece_offset = 0;
   bool begin = true;
 
+  // Each fragment costs a header, and possibly the trailer (less than a
+  // header) of the block before it. The slices point into headers_, which
+  // must not be reallocated meanwhile.
+  headers_.resize((left / (kBlockSize - kHeaderSize) + 2) * (2 * kHeaderSize));
+  char *h = &headers_[0];
+  slices_.clear();
+  size_t total = 0;
+
   // for each iteration we deal with one fragment
   do {
     assert(block_offset_ <= kBlockSize);
@@ -43,9 +60,12 @@ Status Writer::WriteRecord(const Slice &record) {
     size_t avail = kBlockSize - block_offset_;
     if (avail < kHeaderSize) {
       // trailer, consists entirely zero bytes.
-      s = file_->Append(Slice("\0\0\0\0\0\0", avail));
-      if (!s)
-        return s;
+      if (avail > 0) {
+        memset(h, 0, avail);
+        slices_.push_back(Slice(h, avail));
+        h += avail;
+        total += avail;
+      }
       block_offset_ = 0;
     }
 
@@ -65,21 +85,62 @@ Status Writer::WriteRecord(const Slice &record) {
     }
 
     size_t fragment_length = (left < avail) ? left : avail;
-    s = writeFragment(p, fragment_length, type);
-    if (!s)
-      return s;
+
+    // The header goes before the data of the fragment, which may span
+    // several pieces, its checksum is filled in once they're gathered.
+    char *header = h;
+    h += kHeaderSize;
+    slices_.push_back(Slice(header, kHeaderSize));
+    uint32_t crc = 0;
+    for (size_t remaining = fragment_length; remaining > 0;) {
+      const Slice &p = pieces[piece];
+      size_t take = std::min(remaining, p.Len() - piece_offset);
+      if (take > 0) {
+        crc = crc32c::Extend(crc, p.RawData() + piece_offset, take);
+        slices_.push_back(Slice(p.RawData() + piece_offset, take));
+        piece_offset += take;
+        remaining -= take;
+      }
+      if (piece_offset == p.Len()) {
+        piece++;
+        piece_offset = 0;
+      }
+    }
+    encodeHeader(header, crc, fragment_length, type);
+    total += kHeaderSize + fragment_length;
 
     left -= fragment_length;
-    p += fragment_length;
-    block_offset_ += fragment_length;
+    block_offset_ += kHeaderSize + fragment_length;
 
     begin = false;
   } while (left > 0);
+  assert(h <= &headers_[0] + headers_.size());
+  offset_ += total;
+
+  s = file_->Appendv(slices_.data(), slices_.size());
+  if (s) {
+    s = file_->Flush();
+  }
+  if (s && bytes_per_sync_ != 0) {
+    bytes_since_sync_ += total;
+    if (bytes_since_sync_ >= bytes_per_sync_) {
+      s = Sync();
+    }
+  }
 
-  assert(s);
+  // Don't hold on to the memory of an unusually large record.
+  if (slices_.capacity() > (1 << 14)) {
+    std::string().swap(headers_);
+    std::vector<Slice>().swap(slices_);
+  }
   return s;
 }
 
+Status Writer::Sync() {
+  bytes_since_sync_ = 0;
+  return file_->Sync();
+}
+
 //
 // record :=
 //    checksum: uint32	    // crc32c of type and data[] ; little-endian
@@ -87,26 +148,12 @@ Status Writer::WriteRecord(const Slice &record) {
 //    type:     uint8		// One of FULL, FIRST, MIDDLE, LAST
 //    data:     uint8[length]
 //
-Status Writer::writeFragment(const char *fragment, size_t l, RecordType type) {
-  Status s;
-  char buf[7];
-  boost::crc_32_type crc;
-
-  crc.process_bytes(fragment, l);
-  DataView(buf).WriteNum(static_cast<uint32_t>(crc.checksum()));
+void Writer::encodeHeader(char *buf, uint32_t crc, size_t l,
+                          RecordType type) {
+  DataView(buf).WriteNum(crc);
   DataView(buf + 4).WriteNum(static_cast<uint16_t>(l));
-  DataView(buf + 6).WriteNum(static_cast<uint8_t>(type));
-
-  s = file_->Append(Slice(buf, kHeaderSize));
-  if (!s)
-    return s;
-
-  s = file_->Append(Slice(fragment, l));
-  if (!s)
-    return s;
-
-  s = file_->Flush();
-  return s;
+  DataView(buf + 6).WriteNum(
+      static_cast<uint8_t>(static_cast<uint8_t>(type) | kRecordTypeCrc32cFlag));
 }
 
 }  // namespace log
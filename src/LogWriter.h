@@ -22,8 +22,14 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include "Disallowcopying.h"
 #include "LogFormat.h"
+#include "Slice.h"
 
 namespace lessdb {
 
@@ -36,17 +42,52 @@ class Writer {
   __DISALLOW_COPYING__(Writer);
 
  public:
-  Writer(WritableFile *file) : file_(file), block_offset_(0) {}
+  // If bytes_per_sync is non-zero, the file is synced every time that many
+  // bytes have been written since the last sync.
+  explicit Writer(WritableFile *file, uint64_t bytes_per_sync = 0)
+      : file_(file),
+        block_offset_(0),
+        offset_(0),
+        bytes_per_sync_(bytes_per_sync),
+        bytes_since_sync_(0) {}
 
+  // Writes a record into the file. The fragments of the record are handed
+  // to the file with one Appendv and one Flush, i.e one write syscall per
+  // record (e.g a write group) for the posix files.
   Status WriteRecord(const Slice &record);
 
+  // Writes the concatenation of pieces[0..n-1] as a single record, e.g the
+  // header and the batches of a write group. The pieces are not copied, the
+  // file gathers them along with the fragment headers.
+  Status WriteRecord(const Slice *pieces, size_t n);
+
+  // Syncs the file to the storage.
+  Status Sync();
+
+  // The offset in the file, which the writer started empty, where the next
+  // record is written, possibly after the trailer of the current block.
+  // @see ReadRecordAt
+  uint64_t Offset() const {
+    return offset_;
+  }
+
  private:
-  // Write a single fragment to the WritableFile.
-  Status writeFragment(const char *fragment, size_t n, RecordType type);
+  // Encodes the header of a fragment of n bytes into buf.
+  static void encodeHeader(char *buf, uint32_t crc, size_t n, RecordType type);
 
  private:
   WritableFile *file_;
   size_t block_offset_;
+  uint64_t offset_;
+
+  const uint64_t bytes_per_sync_;
+  uint64_t bytes_since_sync_;
+
+  // Hold the fragment headers and block trailers of the record being
+  // written, and the slices of the record handed to the file, reused across
+  // records.
+  std::string headers_;
+  std::vector<Slice> slices_;
 };
 
 }  // namespace log
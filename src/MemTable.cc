@@ -20,49 +20,204 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <thread>
+
 #include "MemTable.h"
 #include "Coding.h"
 #include "Comparator.h"
+#include "DataView.h"
 #include "InternalKey.h"
+#include "PerfContext.h"
 
 namespace lessdb {
 
-// TODO: do optimization.
 void MemTable::Add(SequenceNumber sequence, ValueType type, const Slice &key,
                    const Slice &value) {
+  const char *entry = encodeEntry(sequence, type, key, value);
+  if (type == kTypeRangeDeletion)
+    addRangeTombstone(entry);
+  else if (vector_)
+    append(entry);
+  else
+    table_.Insert(entry);
+}
+
+void MemTable::AddConcurrently(SequenceNumber sequence, ValueType type,
+                               const Slice &key, const Slice &value) {
+  const char *entry = encodeEntry(sequence, type, key, value);
+  if (type == kTypeRangeDeletion)
+    addRangeTombstone(entry);
+  else if (vector_)
+    append(entry);
+  else
+    table_.InsertConcurrently(entry);
+}
+
+void MemTable::addRangeTombstone(const char *entry) {
+  std::lock_guard<std::mutex> guard(range_del_mutex_);
+  range_tombstones_.push_back(entry);
+  num_range_tombstones_.fetch_add(1, std::memory_order_release);
+}
+
+void MemTable::append(const char *entry) {
+  std::lock_guard<std::mutex> guard(vector_mutex_);
+  entries_.push_back(entry);
+  num_entries_.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Fewer entries than this are sorted by the calling thread alone.
+static constexpr size_t kParallelSortThreshold = 64 << 10;
+static constexpr size_t kMaxSortThreads = 8;
+
+// Sorts "entries" with up to kMaxSortThreads threads, each sorting a run of
+// them, then merges the runs pairwise.
+template <class Compare>
+static void SortEntries(std::vector<const char *> *entries, Compare less) {
+  const size_t n = entries->size();
+  size_t num_threads = std::min<size_t>(std::thread::hardware_concurrency(),
+                                        kMaxSortThreads);
+  if (n < kParallelSortThreshold || num_threads < 2) {
+    std::sort(entries->begin(), entries->end(), less);
+    return;
+  }
+
+  std::vector<size_t> bounds;
+  for (size_t i = 0; i <= num_threads; i++)
+    bounds.push_back(n * i / num_threads);
+  auto at = [&](size_t i) { return entries->begin() + bounds[i]; };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; i++)
+    threads.emplace_back([&, i]() { std::sort(at(i), at(i + 1), less); });
+  for (std::thread &t : threads)
+    t.join();
+
+  for (size_t width = 1; width < num_threads; width *= 2) {
+    threads.clear();
+    for (size_t i = 0; i + width < num_threads; i += 2 * width) {
+      size_t last = std::min(i + 2 * width, num_threads);
+      threads.emplace_back([&, i, width, last]() {
+        std::inplace_merge(at(i), at(i + width), at(last), less);
+      });
+    }
+    for (std::thread &t : threads)
+      t.join();
+  }
+}
+
+std::shared_ptr<const MemTable::SortedEntries> MemTable::sortedEntries()
+    const {
+  std::lock_guard<std::mutex> guard(sort_mutex_);
+  size_t sorted = sorted_ ? sorted_->size() : 0;
+
+  std::vector<const char *> added;
+  {
+    std::lock_guard<std::mutex> vector_guard(vector_mutex_);
+    if (sorted_ && sorted == entries_.size())
+      return sorted_;
+    added.assign(entries_.begin() + sorted, entries_.end());
+  }
+
+  KeyComparator cmp(&comparator_);
+  auto less = [&cmp](const char *a, const char *b) { return cmp(a, b) < 0; };
+  SortEntries(&added, less);
+
+  auto merged = std::make_shared<SortedEntries>();
+  merged->reserve(sorted + added.size());
+  if (sorted_)
+    merged->assign(sorted_->begin(), sorted_->end());
+  merged->insert(merged->end(), added.begin(), added.end());
+  std::inplace_merge(merged->begin(), merged->begin() + sorted, merged->end(),
+                     less);
+  sorted_ = merged;
+  return sorted_;
+}
+
+const char *MemTable::encodeEntry(SequenceNumber sequence, ValueType type,
+                                  const Slice &key, const Slice &value) {
   // Format of an entry in MemTable
   // entry := key value
   // key   := varstring of InternalKeyBuf
   // value := varstring of value
+  //
+  // The entry is encoded in one pass directly into the arena.
 
-  std::string buf;
-  coding::AppendVarString(&buf, InternalKeyBuf(key, sequence, type).Data());
-  coding::AppendVarString(&buf, value);
+  const uint32_t internal_key_len = static_cast<uint32_t>(key.Len() + 8);
+  const uint32_t value_len = static_cast<uint32_t>(value.Len());
+  const size_t encoded_len = coding::VarintLength(internal_key_len) +
+                             internal_key_len +
+                             coding::VarintLength(value_len) + value_len;
 
-  char *entry = (char *)arena_.allocate(buf.length());
-  memcpy(entry, buf.data(), buf.length());
-  table_.Insert(entry);
+  char *entry = static_cast<char *>(arena_.allocate(encoded_len));
+  char *p = coding::EncodeVar32(entry, internal_key_len);
+  memcpy(p, key.RawData(), key.Len());
+  p += key.Len();
+  DataView(p).WriteNum(PackSequenceAndType(sequence, type));
+  p += 8;
+  p = coding::EncodeVar32(p, value_len);
+  memcpy(p, value.RawData(), value_len);
+  assert(p + value_len == entry + encoded_len);
+  return entry;
 }
 
 static inline Slice GetVarString(const char *s) {
-  Slice tmp(s, 5);
   uint32_t len;
-  coding::GetVar32(&tmp, &len);
-  return Slice(tmp.RawData(), len);
+  const char *p = coding::DecodeVar32(s, &len);
+  return Slice(p, len);
+}
+
+int MemTable::KeyComparator::operator()(const char *a_buf,
+                                        const char *b_buf) const {
+  // InternalKeys are encoded as varstrings.
+  PERF_COUNTER_ADD(user_key_comparison_count, 1);
+  return comparator->Compare(GetVarString(a_buf), GetVarString(b_buf));
 }
 
-MemTable::MemTable(const InternalKeyComparator &comparator)
+uint64_t MemTable::KeyComparator::KeyPrefix(const char *buf) const {
+  if (!comparator->IsBytewise())
+    return 0;
+  Slice internal_key = GetVarString(buf);
+  return BytewiseKeyPrefix(
+      Slice(internal_key.RawData(), internal_key.Len() - 8));
+}
+
+// The arena blocks taken from an Allocator are as large as a huge page, as
+// such an allocator typically maps each block on its own.
+static constexpr size_t kAllocatorArenaBlockSize = 2 << 20;
+
+MemTable::MemTable(const InternalKeyComparator &comparator,
+                   Allocator *allocator, MemTableRep rep)
     : comparator_(comparator),
-      table_(&arena_, [this](const char *a_buf, const char *b_buf) -> int {
-        // InternalKeys are encoded as varstrings.
-        Slice a = GetVarString(a_buf);
-        Slice b = GetVarString(b_buf);
-        return this->comparator_.Compare(a, b);
-      }) {}
+      arena_(allocator, allocator ? kAllocatorArenaBlockSize
+                                  : ConcurrentArena::kDefaultBlockSize),
+      table_(&arena_, KeyComparator(&comparator_)),
+      vector_(rep == kVectorRep),
+      num_entries_(0),
+      fragmented_count_(0),
+      num_range_tombstones_(0) {}
+
+std::shared_ptr<const FragmentedRangeTombstones> MemTable::RangeTombstones()
+    const {
+  std::lock_guard<std::mutex> guard(range_del_mutex_);
+  if (fragmented_count_ < range_tombstones_.size()) {
+    std::vector<RangeTombstone> tombstones;
+    for (const char *entry : range_tombstones_) {
+      Slice key = GetVarString(entry);
+      Slice end = GetVarString(key.RawData() + key.Len());
+      InternalKey ikey(key);
+      tombstones.emplace_back(ikey.user_key, end, ikey.sequence);
+    }
+    fragmented_ = std::make_shared<FragmentedRangeTombstones>(
+        comparator_.user_comparator(), tombstones);
+    fragmented_count_ = range_tombstones_.size();
+  }
+  return fragmented_;
+}
 
 void MemTable::ConstIterator::update() const {
-  if (iter_.Valid()) {
-    e_.first = GetVarString(*iter_);
+  if (!atEnd()) {
+    e_.first = GetVarString(entry());
 
     const char *value_buf = e_.first.RawData() + e_.first.Len();
     e_.second = GetVarString(value_buf);
@@ -70,9 +225,60 @@ void MemTable::ConstIterator::update() const {
 }
 
 MemTable::ConstIterator MemTable::find(const Slice &key) {
+  PERF_TIMER_GUARD(memtable_search_nanos);
+  if (vector_) {
+    auto it = lower_bound(key);
+    if (it != end() && comparator_.Compare(it.Key(), key) == 0)
+      return it;
+    return end();
+  }
   std::string s;
   coding::AppendVarString(&s, key);
   return MemTable::ConstIterator(table_.Find(s.data()));
 }
 
+MemTable::ConstIterator MemTable::lower_bound(const Slice &key) const {
+  PERF_TIMER_GUARD(memtable_search_nanos);
+  std::string s;
+  coding::AppendVarString(&s, key);
+  if (vector_) {
+    auto entries = sortedEntries();
+    KeyComparator cmp(&comparator_);
+    auto pos = std::lower_bound(
+        entries->begin(), entries->end(), s.data(),
+        [&cmp](const char *a, const char *b) { return cmp(a, b) < 0; });
+    size_t i = static_cast<size_t>(pos - entries->begin());
+    return MemTable::ConstIterator(table_.End(), std::move(entries), i);
+  }
+  return MemTable::ConstIterator(table_.LowerBound(s.data()));
+}
+
+bool MemTable::Get(const Slice &user_key, SequenceNumber sequence,
+                   std::string *value, Status *s) const {
+  SequenceNumber covering = 0;
+  if (NumRangeTombstones() > 0)
+    covering = RangeTombstones()->MaxCoveringSequence(user_key, sequence);
+
+  // The largest type sorts first among the entries of the same sequence.
+  InternalKeyBuf lookup(user_key, sequence, kTypeValue);
+  auto it = lower_bound(lookup.Data());
+  if (it == end() ||
+      comparator_.user_comparator()->Compare(InternalKey(it->first).user_key,
+                                             user_key) != 0) {
+    if (covering == 0)
+      return false;
+    *s = Status::NotFound(Slice());
+    return true;
+  }
+
+  InternalKey ikey(it->first);
+  if (ikey.type == kTypeDeletion || ikey.sequence < covering) {
+    *s = Status::NotFound(Slice());
+  } else {
+    value->assign(it->second.RawData(), it->second.Len());
+    *s = Status::OK();
+  }
+  return true;
+}
+
 }  // namespace lessdb
\ No newline at end of file
@@ -22,39 +22,80 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <vector>
 
+#include "ConcurrentArena.h"
 #include "DBFormat.h"
 #include "Disallowcopying.h"
 #include "InternalKey.h"
+#include "Options.h"
+#include "RangeTombstone.h"
 #include "SkipList.h"
 #include "Slice.h"
+#include "Status.h"
 
 namespace lessdb {
 
+class Allocator;
 class InternalKeyComparator;
 
 class MemTable {
   __DISALLOW_COPYING__(MemTable);
 
  private:
-  typedef std::function<int(const char *, const char *)> Compare;
-  typedef SkipList<const char *, Compare> Table;
+  // Compares two memtable entries by their varstring-encoded InternalKeys.
+  // A plain functor lets SkipList inline the comparison instead of calling
+  // through std::function.
+  struct KeyComparator {
+    const InternalKeyComparator *comparator;
+
+    explicit KeyComparator(const InternalKeyComparator *c) : comparator(c) {}
+
+    int operator()(const char *a_buf, const char *b_buf) const;
+
+    // The prefix of the user key cached in skiplist nodes, see SkipList.h.
+    // All prefixes are 0 for a custom user comparator, whose order is unknown
+    // to us.
+    uint64_t KeyPrefix(const char *buf) const;
+  };
+
+  typedef SkipList<const char *, KeyComparator, ConcurrentArena> Table;
+
+  // The entries of a kVectorRep memtable, sorted.
+  typedef std::vector<const char *> SortedEntries;
 
  public:
-  explicit MemTable(const InternalKeyComparator &comparator);
+  // The arena of the memtable takes its blocks from "allocator" if non-NULL,
+  // see Options::allocator. The entries are indexed by "rep", see
+  // Options::memtable_rep.
+  explicit MemTable(const InternalKeyComparator &comparator,
+                    Allocator *allocator = nullptr,
+                    MemTableRep rep = kSkipListRep);
 
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
   // Typically value will be empty if type==kTypeDeletion.
+  // A kTypeRangeDeletion entry, whose key and value are the begin and end
+  // keys of the range, is kept apart as a range tombstone, which the
+  // iterators don't yield. @see RangeTombstones()
   //
   // @see DBFormat.h for the definition of ValueType.
   //
   void Add(SequenceNumber sequence, ValueType type, const Slice &key,
            const Slice &value);
 
+  // Same as Add, but safe with other threads calling AddConcurrently at the
+  // same time.
+  // REQUIRES: No concurrent calls to Add.
+  void AddConcurrently(SequenceNumber sequence, ValueType type,
+                       const Slice &key, const Slice &value);
+
   size_t BytesUsed() const {
-    return arena_.bytesUsed();
+    return arena_.bytesUsed() +
+           num_entries_.load(std::memory_order_relaxed) * sizeof(const char *);
   }
 
  public:
@@ -68,15 +109,72 @@ class MemTable {
 
   ConstIterator find(const Slice &key);
 
+  // Returns an iterator to the first entry whose InternalKey is not less
+  // than "key", e.g the newest entry of a user key with a sequence no greater
+  // than that of "key".
+  ConstIterator lower_bound(const Slice &key) const;
+
+  // If the memtable has an entry of "user_key" with a sequence no greater
+  // than "sequence", returns true with the newest such entry: its value is
+  // stored in *value with *s set OK, or *s is set NotFound if it's a
+  // deletion. Otherwise returns false.
+  // A range tombstone of the memtable with a sequence no greater than
+  // "sequence" covering "user_key" counts as a deletion, unless the entry is
+  // newer than the tombstone.
+  bool Get(const Slice &user_key, SequenceNumber sequence, std::string *value,
+           Status *s) const;
+
+  size_t NumRangeTombstones() const {
+    return num_range_tombstones_.load(std::memory_order_acquire);
+  }
+
+  // The range tombstones added so far, fragmented, or NULL if there's none.
+  // The fragments are built again only once more tombstones are added.
+  std::shared_ptr<const FragmentedRangeTombstones> RangeTombstones() const;
+
   ConstIterator begin() const;
 
   ConstIterator end() const;
 
  private:
-  SysArena arena_;
-  Table table_;
-  std::mutex mtx_;
+  // Encodes an entry into the arena, returns the start of the entry.
+  const char *encodeEntry(SequenceNumber sequence, ValueType type,
+                          const Slice &key, const Slice &value);
+
+  // Appends "entry" to the entries of a kVectorRep memtable.
+  void append(const char *entry);
+
+  // Adds "entry", a kTypeRangeDeletion entry, to the range tombstones.
+  void addRangeTombstone(const char *entry);
+
+  // Returns the entries of a kVectorRep memtable added so far, sorted. The
+  // sorted entries are shared by the readers until more are added, then the
+  // next reader sorts the new ones and merges them in.
+  std::shared_ptr<const SortedEntries> sortedEntries() const;
+
+ private:
   InternalKeyComparator comparator_;
+  ConcurrentArena arena_;
+  Table table_;  // Unused if vector_
+
+  const bool vector_;
+  // The entries of a kVectorRep memtable in insertion order, guarded by
+  // vector_mutex_, and the last sorted copy of a prefix of them, guarded by
+  // sort_mutex_, which a reader holds while sorting.
+  mutable std::mutex vector_mutex_;
+  std::vector<const char *> entries_;
+  mutable std::mutex sort_mutex_;
+  mutable std::shared_ptr<const SortedEntries> sorted_;
+  // Number of the entries of a kVectorRep memtable, charged to BytesUsed().
+  std::atomic<size_t> num_entries_;
+
+  // The kTypeRangeDeletion entries, and the fragments of the first
+  // fragmented_count_ of them, guarded by range_del_mutex_.
+  mutable std::mutex range_del_mutex_;
+  std::vector<const char *> range_tombstones_;
+  mutable std::shared_ptr<const FragmentedRangeTombstones> fragmented_;
+  mutable size_t fragmented_count_;
+  std::atomic<size_t> num_range_tombstones_;
 };
 
 class MemTable::ConstIterator
@@ -85,12 +183,41 @@ class MemTable::ConstIterator
   friend class MemTable;
   friend class IteratorCoreAccess;
 
+ public:
+  // The InternalKey and the value of the entry, the same as Entry.first and
+  // Entry.second, like the Key() and Value() of the sstable iterators.
+  Slice Key() const {
+    return dereference().first;
+  }
+
+  Slice Value() const {
+    return dereference().second;
+  }
+
  private:
   // Constructor of ConstIterator must be hidden from user.
-  explicit ConstIterator(Table::ConstIterator iter) : iter_(iter) {
+  explicit ConstIterator(Table::ConstIterator iter) : iter_(iter), pos_(0) {
     update();
   }
 
+  // An iterator at entries[pos] of a kVectorRep memtable, which it keeps
+  // alive. "end" is the end of the unused skiplist.
+  ConstIterator(Table::ConstIterator end,
+                std::shared_ptr<const SortedEntries> entries, size_t pos)
+      : iter_(end), entries_(std::move(entries)), pos_(pos) {
+    update();
+  }
+
+  // The end of a kVectorRep memtable is equal to the end of any of its
+  // sorted copies.
+  bool atEnd() const {
+    return entries_ ? pos_ == entries_->size() : !iter_.Valid();
+  }
+
+  const char *entry() const {
+    return entries_ ? (*entries_)[pos_] : *iter_;
+  }
+
   // Updates the value of e_ each time iter_ changes.
   // udpate() only makes changes on e_, so const specifier is safe here.
   void update() const;
@@ -104,23 +231,36 @@ class MemTable::ConstIterator
   }
 
   void increment() {
-    iter_++;
+    if (entries_)
+      pos_++;
+    else
+      iter_++;
   }
 
   bool equal(const ConstIterator &other) const {
-    return iter_ == other.iter_;
+    if (!entries_ && !other.entries_)
+      return iter_ == other.iter_;
+    const bool at_end = atEnd();
+    if (at_end || other.atEnd())
+      return at_end == other.atEnd();
+    return entries_ == other.entries_ && pos_ == other.pos_;
   }
 
  private:
   Table::ConstIterator iter_;
+  std::shared_ptr<const SortedEntries> entries_;  // NULL for kSkipListRep
+  size_t pos_;
   mutable Entry e_;
 };
 
 inline MemTable::ConstIterator MemTable::begin() const {
+  if (vector_)
+    return MemTable::ConstIterator(table_.End(), sortedEntries(), 0);
   return MemTable::ConstIterator(table_.Begin());
 }
 
 inline MemTable::ConstIterator MemTable::end() const {
+  // For kVectorRep too, an iterator without entries is at the end.
   return MemTable::ConstIterator(table_.End());
 }
 
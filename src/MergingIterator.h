@@ -0,0 +1,310 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "DBFormat.h"
+#include "Disallowcopying.h"
+#include "InternalKey.h"
+#include "RangeTombstone.h"
+#include "Slice.h"
+
+namespace lessdb {
+
+// A sorted sequence of entries keyed by encoded InternalKeys, one of the
+// inputs merged by MergingIterator.
+class MergeSource {
+  __DISALLOW_COPYING__(MergeSource);
+
+ public:
+  MergeSource() = default;
+  virtual ~MergeSource() = default;
+
+  virtual bool Valid() const = 0;
+
+  // REQUIRES: Valid()
+  virtual Slice Key() const = 0;
+
+  // REQUIRES: Valid()
+  virtual Slice Value() const = 0;
+
+  // REQUIRES: Valid()
+  virtual void Next() = 0;
+};
+
+// The entries in [first, last) of a forward iterator with Key() and Value(),
+// e.g SSTable::ConstIterator or MemTable::ConstIterator.
+template <class Iter>
+class RangeSource final : public MergeSource {
+ public:
+  RangeSource(Iter first, Iter last)
+      : first_(std::move(first)), last_(std::move(last)) {}
+
+  bool Valid() const override {
+    return !(first_ == last_);
+  }
+
+  Slice Key() const override {
+    return first_.Key();
+  }
+
+  Slice Value() const override {
+    return first_.Value();
+  }
+
+  void Next() override {
+    ++first_;
+  }
+
+ private:
+  Iter first_;
+  Iter last_;
+};
+
+template <class Iter>
+inline std::unique_ptr<MergeSource> NewRangeSource(Iter first, Iter last) {
+  return std::unique_ptr<MergeSource>(
+      new RangeSource<Iter>(std::move(first), std::move(last)));
+}
+
+// The entries of "source", a sequence read from an ingested sstable, with
+// their sequences replaced by the global sequence of the table.
+// @see FileMetaData::global_sequence
+class GlobalSequenceSource final : public MergeSource {
+ public:
+  GlobalSequenceSource(std::unique_ptr<MergeSource> source,
+                       SequenceNumber sequence)
+      : source_(std::move(source)), sequence_(sequence) {
+    load();
+  }
+
+  bool Valid() const override {
+    return source_->Valid();
+  }
+
+  Slice Key() const override {
+    return key_;
+  }
+
+  Slice Value() const override {
+    return source_->Value();
+  }
+
+  void Next() override {
+    source_->Next();
+    load();
+  }
+
+ private:
+  void load() {
+    if (source_->Valid())
+      ReplaceSequence(source_->Key(), sequence_, &key_);
+  }
+
+  std::unique_ptr<MergeSource> source_;
+  const SequenceNumber sequence_;
+  std::string key_;
+};
+
+// MergingIterator yields the entries of several sorted sequences in sorted
+// order, by a k-way merge on a tournament tree of losers. Each internal node
+// of the tree keeps the child that lost the match played there, so that
+// moving to the next entry replays only the matches on the path of the
+// previous winner: about log2(k) comparisons, against the cached current
+// keys of the children, through the non-virtual InternalKeyComparator.
+//
+// Entries with equal keys are yielded in the order of their sequences.
+class MergingIterator {
+  __DISALLOW_COPYING__(MergingIterator);
+
+ public:
+  // Merges every entry of "children", each of which is sorted by
+  // *comparator. Used by compactions, which decide what to drop themselves.
+  MergingIterator(const InternalKeyComparator *comparator,
+                  std::vector<std::unique_ptr<MergeSource>> children)
+      : MergingIterator(comparator, std::move(children), false,
+                        kMaxSequenceNumber, nullptr) {}
+
+  // Merges "children" as above, but yields only the newest entry of each
+  // user key among the ones with a sequence <= "snapshot", and skips the
+  // user key if that entry is a deletion, or is older than a tombstone of
+  // "tombstones" (if non-NULL) with a sequence <= "snapshot" covering it.
+  // i.e the view of the key-value pairs as of "snapshot", that reads are
+  // served from.
+  MergingIterator(
+      const InternalKeyComparator *comparator,
+      std::vector<std::unique_ptr<MergeSource>> children,
+      SequenceNumber snapshot,
+      std::shared_ptr<const FragmentedRangeTombstones> tombstones = nullptr)
+      : MergingIterator(comparator, std::move(children), true, snapshot,
+                        std::move(tombstones)) {}
+
+  bool Valid() const {
+    return !children_.empty() && children_[tree_[0]].source;
+  }
+
+  // The encoded InternalKey of the current entry.
+  // REQUIRES: Valid()
+  Slice Key() const {
+    return children_[tree_[0]].key;
+  }
+
+  // REQUIRES: Valid()
+  Slice Value() const {
+    return children_[tree_[0]].source->Value();
+  }
+
+  // REQUIRES: Valid()
+  void Next() {
+    if (!resolve_) {
+      step();
+      return;
+    }
+    // Skip the older entries of the current user key.
+    Slice user_key = InternalKey(Key()).user_key;
+    skipped_.assign(user_key.RawData(), user_key.Len());
+    step();
+    findVisible(true);
+  }
+
+ private:
+  struct Child {
+    // NULL once the child is exhausted, which loses to any other.
+    std::unique_ptr<MergeSource> source;
+    Slice key;  // cached source->Key()
+  };
+
+  MergingIterator(const InternalKeyComparator *comparator,
+                  std::vector<std::unique_ptr<MergeSource>> children,
+                  bool resolve, SequenceNumber snapshot,
+                  std::shared_ptr<const FragmentedRangeTombstones> tombstones)
+      : comparator_(comparator),
+        resolve_(resolve),
+        snapshot_(snapshot),
+        tombstones_(std::move(tombstones)) {
+    const size_t k = children.size();
+    children_.resize(k);
+    for (size_t i = 0; i < k; i++) {
+      children_[i].source = std::move(children[i]);
+      load(i);
+    }
+
+    // Every node starts with the virtual child k, which precedes all the
+    // others. Replaying child k-1 down to 0 fills the tree bottom-up, and the
+    // virtual child is out of the tree once all the matches are played.
+    tree_.assign(k, k);
+    for (size_t i = k; i-- > 0;) {
+      replay(i);
+    }
+    if (resolve_)
+      findVisible(false);
+  }
+
+  // Caches the current key of children_[i], or marks it exhausted.
+  void load(size_t i) {
+    Child &child = children_[i];
+    if (child.source->Valid())
+      child.key = child.source->Key();
+    else
+      child.source.reset();
+  }
+
+  // Whether children_[a] goes before children_[b].
+  bool before(size_t a, size_t b) const {
+    const size_t k = children_.size();
+    if (a == k || b == k)
+      return a == k;
+    if (!children_[a].source || !children_[b].source)
+      return children_[a].source != nullptr;
+    int r = comparator_->Compare(children_[a].key, children_[b].key);
+    return r < 0 || (r == 0 && a < b);
+  }
+
+  // Plays the matches from the leaf of children_[i] up to the root, after
+  // the current entry of children_[i] changed.
+  void replay(size_t i) {
+    size_t winner = i;
+    for (size_t node = (i + children_.size()) / 2; node > 0; node /= 2) {
+      if (before(tree_[node], winner))
+        std::swap(tree_[node], winner);
+    }
+    tree_[0] = winner;
+  }
+
+  // Moves to the next entry in sorted order.
+  void step() {
+    size_t i = tree_[0];
+    children_[i].source->Next();
+    load(i);
+    replay(i);
+  }
+
+  // Whether a range tombstone visible to the snapshot deletes "ikey".
+  bool deletedByRange(const InternalKey &ikey) const {
+    return tombstones_ &&
+           tombstones_->MaxCoveringSequence(ikey.user_key, snapshot_) >
+               ikey.sequence;
+  }
+
+  // Steps forward to the first visible entry, if the current one isn't.
+  // "skipping" tells whether the entries of user key skipped_ are hidden.
+  void findVisible(bool skipping) {
+    const Comparator *user_comparator = comparator_->user_comparator();
+    for (; Valid(); step()) {
+      InternalKey ikey(Key());
+      if (ikey.sequence > snapshot_)
+        continue;  // too new for the snapshot
+      if (skipping &&
+          user_comparator->Compare(ikey.user_key, Slice(skipped_)) <= 0)
+        continue;  // hidden by a newer entry
+      if (ikey.type != kTypeDeletion && !deletedByRange(ikey))
+        return;  // a value, or the index of a blob
+      // A deletion hides the older entries of the same user key.
+      skipped_.assign(ikey.user_key.RawData(), ikey.user_key.Len());
+      skipping = true;
+    }
+  }
+
+ private:
+  const InternalKeyComparator *comparator_;
+  std::vector<Child> children_;
+
+  // tree_[0] is the child of the current entry, tree_[n] for n in [1, k) is
+  // the loser of the match at internal node n. The leaf of child i is node
+  // i + k, whose parent is node (i + k) / 2.
+  std::vector<size_t> tree_;
+
+  // Whether only the newest visible entry of each user key is yielded.
+  bool resolve_;
+  SequenceNumber snapshot_;
+  std::shared_ptr<const FragmentedRangeTombstones> tombstones_;
+
+  // The last user key whose older entries are to be skipped.
+  std::string skipped_;
+};
+
+}  // namespace lessdb
@@ -27,8 +27,40 @@ namespace lessdb {
 
 Options::Options()
     : block_restart_interval(16),
+      index_block_restart_interval(1),
+      data_block_hash_ratio(0),
+      comparator(NewBytewiseComparator()),
       block_cache(nullptr),
+      block_cache_compressed(nullptr),
+      row_cache(nullptr),
+      block_cache_dump_period_sec(0),
+      filter_strategy(nullptr),
+      prefix_extractor(nullptr),
       block_size(4 * 1024),
-      comparator(NewBytewiseComparator()) {}
+      index_partition_size(0),
+      compression(kNoCompression),
+      compression_level(0),
+      zstd_max_dict_bytes(0),
+      parallel_compression_threads(0),
+      allow_concurrent_memtable_write(true),
+      memtable_rep(kSkipListRep),
+      create_if_missing(false),
+      paranoid_checks(false),
+      max_open_files(1000),
+      table_loading_threads(0),
+      file_factory(nullptr),
+      statistics(nullptr),
+      allocator(nullptr),
+      wal_recovery_threads(4),
+      wal_bytes_per_sync(0),
+      write_buffer_size(4 << 20),
+      write_buffer_manager(nullptr),
+      thread_pool(nullptr),
+      rate_limiter(nullptr),
+      max_file_size(2 << 20),
+      max_bytes_for_level_base(10 << 20),
+      max_subcompactions(1),
+      min_blob_size(0),
+      blob_garbage_collection_age_cutoff(0.25) {}
 
 }  // namespace lessdb
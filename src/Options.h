@@ -23,11 +23,39 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+
 namespace lessdb {
 
+class Allocator;
 class Comparator;
 class CacheStrategy;
 class FilterStrategy;
+class FileFactory;
+class PrefixExtractor;
+class RateLimiter;
+class Snapshot;
+class Statistics;
+class ThreadPool;
+class WriteBufferManager;
+
+// The compression applied to each block of an sstable. The type is stored in
+// the trailer of the block.
+// NOTE: do not change the values of existing entries, as these are part of
+// the persistent format on disk.
+enum CompressionType {
+  kNoCompression = 0x0,
+  kLZ4Compression = 0x1,
+  kZstdCompression = 0x2
+};
+
+// The representations of a memtable. @see Options::memtable_rep
+enum MemTableRep {
+  // A concurrent skiplist, kept sorted as the entries are inserted.
+  kSkipListRep = 0x0,
+  // An append-only vector of the entries, sorted only when it's read.
+  kVectorRep = 0x1
+};
 
 // TODO: Singleton
 struct Options {
@@ -35,6 +63,22 @@ struct Options {
   // Default: 16
   int block_restart_interval;
 
+  // The number of keys between restart points of the index blocks. An index
+  // block is searched far more often than it's scanned, with a restart point
+  // at every key the search is a pure binary search, and the keys are not
+  // prefix-compressed.
+  // Default: 1
+  int index_block_restart_interval;
+
+  // If > 0, each data block is built with a hash index of its keys of this
+  // many keys per bucket, which SSTable::find looks up to go straight to
+  // the restart interval holding the key, or to tell that the key is absent,
+  // instead of a binary search. Costs about 1/data_block_hash_ratio byte per
+  // key. The hash requires the equal keys of the comparator to be equal
+  // bytes, as in the builtin comparators.
+  // Default: 0
+  double data_block_hash_ratio;
+
   // Comparators define the way of comparison between user keys.
   // Default: Byte-wise comparison (memcmp)
   const Comparator *comparator;
@@ -44,10 +88,46 @@ struct Options {
   // Default: NULL
   CacheStrategy *block_cache;
 
+  // If non-NULL, use the specified cache for compressed blocks, as they are
+  // stored in the file. A data block missing from block_cache is looked up
+  // here before it is read from file, which only costs uncompressing it.
+  // The compressed blocks take a fraction of the space of the blocks in
+  // block_cache, so this cache holds more of the data in the same memory.
+  // Blocks that are stored uncompressed are never inserted.
+  // Default: NULL
+  CacheStrategy *block_cache_compressed;
+
+  // If non-NULL, use the specified cache for rows: the newest entry of a
+  // user key in an sstable, found by a Get, is kept here by the number of
+  // the table and the user key, so the next Get of the key finds it by a
+  // single lookup of the cache rather than by searching the index and the
+  // data block. Worth it for the small sets of hot keys, the cache is
+  // charged the sizes of the keys and values.
+  // Default: NULL
+  CacheStrategy *row_cache;
+
+  // If positive, the blocks of the database in block_cache are listed every
+  // block_cache_dump_period_sec seconds, and as the database is closed, in
+  // the BLOCKCACHE file of the database directory: by the number of their
+  // sstables and their offsets, not their contents. As the database is
+  // opened again, the listed blocks of the live sstables are read back into
+  // block_cache, in the order of their offsets in each file, before the
+  // first read is served, so the cache is as warm as it was before the
+  // restart. Requires a block_cache.
+  // Default: 0
+  int block_cache_dump_period_sec;
+
   // If non-NULL, use the specified filter strategy to reduce disk reads.
   // Default: NULL
   const FilterStrategy *filter_strategy;
 
+  // If non-NULL, the filters also hold the prefixes of the keys extracted by
+  // prefix_extractor, which lets a prefix seek skip the tables that hold no
+  // key of the prefix (@see ReadOptions::prefix_same_as_start). The
+  // prefixes are checked on Get too. Requires a filter_strategy.
+  // Default: NULL
+  const PrefixExtractor *prefix_extractor;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -56,6 +136,197 @@ struct Options {
   // Default: 4K
   size_t block_size;
 
+  // If non-zero, the index of an sstable is partitioned into blocks of about
+  // this size, which are read on demand through the block cache like the
+  // data blocks, and only a small top-level index over the partitions is
+  // held by an open table. Large tables keep most of their index out of
+  // memory then, at the cost of an extra block lookup per read.
+  //
+  // Default: 0
+  size_t index_partition_size;
+
+  // Compress blocks using the specified compression algorithm.  This
+  // parameter can be changed dynamically.
+  //
+  // A block is stored uncompressed if it doesn't shrink by at least 1/8
+  // when compressed, or if the library of the algorithm is not compiled in
+  // (see compression::IsSupported).
+  //
+  // Default: kNoCompression
+  CompressionType compression;
+
+  // The level passed to zstd, 0 is the library default.
+  // Default: 0
+  int compression_level;
+
+  // If non-zero and compression is kZstdCompression, each sstable trains a
+  // zstd dictionary of at most this many bytes on the first data blocks
+  // (about 100 times as many bytes), and compresses all its data blocks
+  // with it. The dictionary is stored in the table, which helps blocks of
+  // small, similar values that have too little context to compress well on
+  // their own.
+  //
+  // Default: 0
+  size_t zstd_max_dict_bytes;
+
+  // If positive, an sstable being built has this many threads compressing
+  // and checksumming its data blocks, and one more thread writing them out
+  // in order, so that compressing a block overlaps building the next ones.
+  // Worth it for the expensive algorithms, e.g zstd at a high level. The
+  // threads are started by each SSTableBuilder.
+  // Default: 0
+  int parallel_compression_threads;
+
+  // If true, the writers of a write group insert their own batches into the
+  // memtable in parallel, after the group has been committed to the log by
+  // its leader. Otherwise the leader inserts the whole group by itself.
+  //
+  // Default: true
+  bool allow_concurrent_memtable_write;
+
+  // The representation of the memtables. kVectorRep suits bulk loads, whose
+  // writes are mostly unordered and rarely read back: an insert is a pointer
+  // append instead of a skiplist descent. The vector is sorted, in parallel,
+  // once it's flushed or first read, but a read after more writes sorts the
+  // new entries again and merges them in, so frequent reads of the mutable
+  // memtable are slower than with kSkipListRep.
+  // Default: kSkipListRep
+  MemTableRep memtable_rep;
+
+  // If true, the database will be created if it is missing.
+  // Default: false
+  bool create_if_missing;
+
+  // If true, the implementation will do aggressive checking of the
+  // data it is processing and will stop early if it detects any
+  // errors, e.g a corrupted log record found during recovery fails
+  // DB::Open instead of being dropped.
+  // Default: false
+  bool paranoid_checks;
+
+  // Number of open files that can be used by the DB. You may need to
+  // increase this if your database has a large working set (budget one open
+  // file per 2MB of working set). The tables beyond are closed, and opened
+  // again on their next access.
+  // Default: 1000
+  int max_open_files;
+
+  // If positive, the sstables of the database, up to max_open_files of them
+  // with the newest levels first, are opened as the database is opened, on
+  // this many threads, so the first reads of every table don't pay for
+  // reading its footer, index and filter. The blocks listed in the
+  // BLOCKCACHE file, see block_cache_dump_period_sec, are read back on the
+  // same threads. Otherwise the tables are opened on their first access.
+  // Default: 0
+  int table_loading_threads;
+
+  // Used to access the files of the database.
+  // If NULL, FileFactory::Default() is used.
+  // Default: NULL
+  FileFactory *file_factory;
+
+  // If non-NULL, the tickers and latency histograms of the database are
+  // recorded into it, e.g block cache hits and misses, bytes read and
+  // written, filter efficiency and the latencies of Get, Write and the log.
+  // Recording costs a relaxed atomic add per event, and two clock reads per
+  // timed operation.
+  // Default: NULL
+  Statistics *statistics;
+
+  // If non-NULL, the memtable arenas and the buffers of the sstable blocks
+  // read from file (which the block cache holds on to) are allocated from
+  // it instead of the heap, e.g NewNumaAllocator to keep the memory of a
+  // database pinned to a socket on the local NUMA node.
+  // Default: NULL
+  Allocator *allocator;
+
+  // Number of threads that verify the checksums of the log blocks while
+  // recovering a log file on DB::Open. The batches in the log are still
+  // replayed in order, by the opening thread.
+  // Default: 4
+  int wal_recovery_threads;
+
+  // Writes to the log are flushed to the operating system once per write
+  // group, and synced to the storage only for WriteOptions::sync writes. If
+  // wal_bytes_per_sync is non-zero, the log is also synced every time that
+  // many bytes have been written since the last sync, which bounds the
+  // updates lost on a machine crash without paying a sync per write.
+  // Default: 0
+  size_t wal_bytes_per_sync;
+
+  // Amount of data to build up in memory (backed by an unsorted log
+  // on disk) before converting to a sorted on-disk file.
+  //
+  // Once the memtable reaches this size, it's switched to an immutable
+  // memtable along with a new log file, and flushed to an sstable by a
+  // background thread, while the writes go on with a fresh memtable. The
+  // writes only stall if the memtable fills up again before the flush is
+  // done.
+  //
+  // Up to two write buffers may be held in memory at the same time.
+  // Default: 4MB
+  size_t write_buffer_size;
+
+  // If non-NULL, the memory of the memtables and of the index and filter
+  // blocks of the open tables is accounted for by it, and the memtables of
+  // all the databases sharing it are bounded together, see
+  // WriteBufferManager. Typically shared by the databases of a process to
+  // cap their memory as a whole.
+  // Default: NULL
+  WriteBufferManager *write_buffer_manager;
+
+  // The pool running the memtable flushes (high priority), the compactions
+  // (low priority) and the asynchronous lookups (read priority) of the
+  // database, typically shared by the databases of a process to bound their
+  // background threads together.
+  // If NULL, ThreadPool::Default() is used.
+  // Default: NULL
+  ThreadPool *thread_pool;
+
+  // If non-NULL, the sstables written by the flushes and the compactions
+  // are throttled by it, the flushes taking precedence, while the log
+  // writes are never throttled. Typically shared by the databases on the
+  // same device.
+  // Default: NULL
+  RateLimiter *rate_limiter;
+
+  // lessdb will write up to this amount of bytes to a file before
+  // switching to a new one during a compaction.
+  // Default: 2MB
+  size_t max_file_size;
+
+  // The size target of level-1, each following level is
+  // config::kLevelSizeMultiplier times larger. A level larger than its
+  // target is compacted into the next level. Level-0 is bounded by its
+  // number of files instead, see config::kL0_CompactionTrigger.
+  // Default: 10MB
+  uint64_t max_bytes_for_level_base;
+
+  // A compaction is split into up to this many disjoint key ranges, cut at
+  // the index keys of its input tables, which are merged at the same time
+  // on threads of their own, and installed together. Speeds up the
+  // catch-up of large compactions, e.g after a bulk load, on hosts with
+  // idle cores.
+  // Default: 1
+  int max_subcompactions;
+
+  // If non-zero, the values of at least this many bytes are separated from
+  // their keys as the memtable is flushed: they are appended to a blob file,
+  // and the sstable keeps a BlobIndex to the value instead, which is all
+  // the compactions then rewrite. Reading such a value costs a read of the
+  // blob file.
+  // Default: 0
+  size_t min_blob_size;
+
+  // The blob files are garbage collected by the compactions. A blob file is
+  // deleted once the compactions have dropped the references to all its
+  // blobs, overwritten or deleted. Besides, the compactions rewrite the
+  // blobs of the oldest blob files, this fraction of them, into new blob
+  // files, so that the old ones end up deleted even if their remaining blobs
+  // are never overwritten. 0 disables the rewrite.
+  // Default: 0.25
+  double blob_garbage_collection_age_cutoff;
+
   Options();
 };
 
@@ -88,7 +359,56 @@ struct ReadOptions {
   // Default: false
   bool verify_checksums;
 
-  ReadOptions() : verify_checksums(false) {}
+  // Should the data read for this iteration be cached in memory?
+  // Callers may wish to set this field to false for bulk scans, so that
+  // the blocks they go through don't evict the working set of the point
+  // lookups from the block caches.
+  // Default: true
+  bool fill_cache;
+
+  // If non-zero, an iterator reads ahead up to this many bytes of data
+  // blocks when it moves from one data block to the next. The readahead is
+  // adaptive: it starts with the single block being read, and doubles the
+  // number of blocks read at once on every block the iterator has to read
+  // from file, until the window reaches readahead_size. The blocks of a
+  // window are read in one batch (see RandomAccessFile::MultiRead), i.e.
+  // asynchronously where the file supports it. Blocks found in cache are
+  // never read again.
+  //
+  // Useful for long sequential scans, e.g. compactions or exports.
+  // Default: 0
+  size_t readahead_size;
+
+  // If non-NULL, read as of the supplied snapshot (which must belong to the
+  // DB that is being read and which must not have been released). If NULL,
+  // use an implicit snapshot of the state at the beginning of this read
+  // operation.
+  // Default: NULL
+  const Snapshot *snapshot;
+
+  // If true, an iterator of the DB only yields the keys of the prefix of its
+  // start key, as extracted by Options::prefix_extractor, and ends at the
+  // first key of another prefix. The sstables whose filters rule the prefix
+  // out are never seeked. Ignored if there's no prefix_extractor, or the
+  // start key has no prefix.
+  // Default: false
+  bool prefix_same_as_start;
+
+  ReadOptions()
+      : verify_checksums(false),
+        fill_cache(true),
+        readahead_size(0),
+        snapshot(nullptr),
+        prefix_same_as_start(false) {}
+};
+
+struct IngestExternalFileOptions {
+  // If true, the files are moved (renamed) into the database instead of
+  // being copied, which requires them to be on the same file system.
+  // Default: false
+  bool move_files;
+
+  IngestExternalFileOptions() : move_files(false) {}
 };
 
 }  // namespace lessdb
\ No newline at end of file
@@ -0,0 +1,63 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cstdio>
+
+#include "PerfContext.h"
+
+namespace lessdb {
+
+thread_local PerfLevel perf_level = kPerfDisable;
+
+thread_local PerfContext perf_context;
+
+void PerfContext::Reset() {
+  *this = PerfContext();
+}
+
+std::string PerfContext::ToString() const {
+  std::string r;
+  char buf[64];
+  auto append = [&](const char *name, uint64_t value) {
+    if (value == 0)
+      return;
+    snprintf(buf, sizeof(buf), "%s = %llu, ", name,
+             static_cast<unsigned long long>(value));
+    r.append(buf);
+  };
+  append("user_key_comparison_count", user_key_comparison_count);
+  append("block_cache_hit_count", block_cache_hit_count);
+  append("block_read_count", block_read_count);
+  append("block_read_byte", block_read_byte);
+  append("block_decompress_byte", block_decompress_byte);
+  append("memtable_search_nanos", memtable_search_nanos);
+  append("index_seek_nanos", index_seek_nanos);
+  append("filter_probe_nanos", filter_probe_nanos);
+  append("block_read_nanos", block_read_nanos);
+  append("block_checksum_nanos", block_checksum_nanos);
+  append("block_decompress_nanos", block_decompress_nanos);
+  if (!r.empty())
+    r.resize(r.size() - 2);
+  return r;
+}
+
+}  // namespace lessdb
@@ -0,0 +1,153 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "Disallowcopying.h"
+
+namespace lessdb {
+
+// How much of the PerfContext of a thread is collected.
+enum PerfLevel {
+  // Nothing at all, the default.
+  kPerfDisable = 0,
+  // The counters only.
+  kPerfEnableCount,
+  // The counters and the timers, the timers read the clock twice per timed
+  // step of an operation.
+  kPerfEnableTime
+};
+
+// PerfContext breaks down the work of the operations of a single thread,
+// e.g where one slow Get spends its time. Unlike Statistics, it's neither
+// shared nor aggregated: every thread has its own, enabled by SetPerfLevel,
+// which the thread resets before the operation and reads after it.
+//
+//   SetPerfLevel(kPerfEnableTime);
+//   GetPerfContext()->Reset();
+//   db->Get(options, key, &value);
+//   fprintf(stderr, "%s\n", GetPerfContext()->ToString().c_str());
+//
+// The times are in nanoseconds.
+struct PerfContext {
+  // Calls of the comparator by the memtables and the blocks.
+  uint64_t user_key_comparison_count;
+  // Blocks found in Options::block_cache.
+  uint64_t block_cache_hit_count;
+  // Blocks and bytes (including the trailers) read from the sstables.
+  uint64_t block_read_count;
+  uint64_t block_read_byte;
+  // Bytes of the blocks uncompressed after being read.
+  uint64_t block_decompress_byte;
+
+  // Searching the memtables.
+  uint64_t memtable_search_nanos;
+  // Seeking the index blocks, including the top-level index of a
+  // partitioned index.
+  uint64_t index_seek_nanos;
+  // Probing the filters.
+  uint64_t filter_probe_nanos;
+  // Reading the blocks from the files.
+  uint64_t block_read_nanos;
+  // Verifying the checksums of the blocks read.
+  uint64_t block_checksum_nanos;
+  // Uncompressing the blocks read.
+  uint64_t block_decompress_nanos;
+
+  // Sets all the counters and timers to zero.
+  void Reset();
+
+  // A human-readable dump of the non-zero counters and timers.
+  std::string ToString() const;
+};
+
+// The perf level of the calling thread.
+extern thread_local PerfLevel perf_level;
+
+// The PerfContext of the calling thread.
+extern thread_local PerfContext perf_context;
+
+inline void SetPerfLevel(PerfLevel level) {
+  perf_level = level;
+}
+
+inline PerfLevel GetPerfLevel() {
+  return perf_level;
+}
+
+inline PerfContext *GetPerfContext() {
+  return &perf_context;
+}
+
+// PerfTimer adds the time between Start and Stop to a timer of the calling
+// thread's PerfContext, if its perf level is kPerfEnableTime. A timer that
+// has been started is stopped by the destructor.
+class PerfTimer {
+  __DISALLOW_COPYING__(PerfTimer);
+
+ public:
+  explicit PerfTimer(uint64_t *metric) : metric_(metric), started_(false) {}
+
+  ~PerfTimer() {
+    Stop();
+  }
+
+  void Start() {
+    if (perf_level >= kPerfEnableTime) {
+      start_ = std::chrono::steady_clock::now();
+      started_ = true;
+    }
+  }
+
+  void Stop() {
+    if (started_) {
+      *metric_ += static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start_)
+              .count());
+      started_ = false;
+    }
+  }
+
+ private:
+  uint64_t *metric_;
+  bool started_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Adds value to the counter "metric" of the calling thread's PerfContext.
+#define PERF_COUNTER_ADD(metric, value)        \
+  do {                                         \
+    if (perf_level >= kPerfEnableCount)        \
+      perf_context.metric += (value);          \
+  } while (0)
+
+// Times the rest of the enclosing scope into the timer "metric".
+#define PERF_TIMER_GUARD(metric)                     \
+  PerfTimer perf_timer_##metric(&perf_context.metric); \
+  perf_timer_##metric.Start()
+
+}  // namespace lessdb
@@ -0,0 +1,67 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include "Disallowcopying.h"
+#include "SliceFwd.h"
+
+namespace lessdb {
+
+// A PrefixExtractor maps a key to its prefix, e.g. the tenant id in front of
+// the keys of a tenant. The prefixes are added to the filters of the tables
+// along with the keys (@see FilterStrategy), so that a prefix seek skips the
+// tables holding no key of the prefix. @see ReadOptions::prefix_same_as_start
+//
+// The keys of a prefix must be contiguous in the order of the comparator,
+// e.g. a fixed-length prefix under the bytewise comparator.
+// PrefixExtractor is an option that can be customized by users.
+// (@see Options.h)
+class PrefixExtractor {
+  __DISALLOW_COPYING__(PrefixExtractor);
+
+ public:
+  virtual ~PrefixExtractor() = default;
+
+  // The name of the extractor, which is persisted in the meta index block of
+  // an SSTable. The prefixes in the filter of a table built with a different
+  // extractor are not consulted.
+  virtual const char *Name() const = 0;
+
+  // Whether "key" has a prefix, e.g. it's long enough.
+  virtual bool InDomain(const Slice &key) const = 0;
+
+  // Returns the prefix of "key", which points into "key".
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice &key) const = 0;
+
+  // The prefixes of the keys of at least prefix_len bytes are their first
+  // prefix_len bytes, the shorter keys have no prefix.
+  static PrefixExtractor *Fixed(size_t prefix_len);
+
+ protected:
+  PrefixExtractor() = default;
+};
+
+}  // namespace lessdb
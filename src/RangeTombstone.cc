@@ -0,0 +1,127 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+
+#include "Comparator.h"
+#include "RangeTombstone.h"
+
+namespace lessdb {
+
+FragmentedRangeTombstones::FragmentedRangeTombstones(
+    const Comparator *user_comparator,
+    const std::vector<RangeTombstone> &tombstones)
+    : user_comparator_(user_comparator) {
+  auto less = [user_comparator](const std::string &a, const std::string &b) {
+    return user_comparator->Compare(a, b) < 0;
+  };
+
+  // The fragments are the ranges between consecutive boundaries, swept from
+  // left to right with the tombstones covering the current one.
+  std::vector<const RangeTombstone *> sorted;
+  std::vector<const std::string *> bounds;
+  for (const RangeTombstone &t : tombstones) {
+    if (!less(t.begin, t.end))
+      continue;
+    sorted.push_back(&t);
+    bounds.push_back(&t.begin);
+    bounds.push_back(&t.end);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [&less](const RangeTombstone *a, const RangeTombstone *b) {
+              return less(a->begin, b->begin);
+            });
+  std::sort(bounds.begin(), bounds.end(),
+            [&less](const std::string *a, const std::string *b) {
+              return less(*a, *b);
+            });
+  bounds.erase(std::unique(bounds.begin(), bounds.end(),
+                           [&less](const std::string *a, const std::string *b) {
+                             return !less(*a, *b);
+                           }),
+               bounds.end());
+
+  std::vector<const RangeTombstone *> active;
+  size_t next = 0;
+  for (size_t i = 0; i + 1 < bounds.size(); i++) {
+    const std::string &lo = *bounds[i];
+    while (next < sorted.size() && !less(lo, sorted[next]->begin))
+      active.push_back(sorted[next++]);
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [&](const RangeTombstone *t) {
+                                  return !less(lo, t->end);
+                                }),
+                 active.end());
+    if (active.empty())
+      continue;
+
+    // Every active tombstone ends at or after the next boundary.
+    Fragment f;
+    f.begin = lo;
+    f.end = *bounds[i + 1];
+    for (const RangeTombstone *t : active)
+      f.sequences.push_back(t->sequence);
+    std::sort(f.sequences.begin(), f.sequences.end(),
+              std::greater<SequenceNumber>());
+    f.sequences.erase(std::unique(f.sequences.begin(), f.sequences.end()),
+                      f.sequences.end());
+    fragments_.push_back(std::move(f));
+  }
+}
+
+const FragmentedRangeTombstones::Fragment *FragmentedRangeTombstones::Find(
+    const Slice &user_key) const {
+  // The last fragment beginning at or before user_key.
+  auto it = std::upper_bound(
+      fragments_.begin(), fragments_.end(), user_key,
+      [this](const Slice &key, const Fragment &f) {
+        return user_comparator_->Compare(key, f.begin) < 0;
+      });
+  if (it == fragments_.begin())
+    return nullptr;
+  --it;
+  if (user_comparator_->Compare(user_key, it->end) >= 0)
+    return nullptr;
+  return &*it;
+}
+
+SequenceNumber FragmentedRangeTombstones::MaxCoveringSequence(
+    const Slice &user_key, SequenceNumber snapshot) const {
+  const Fragment *f = Find(user_key);
+  if (f == nullptr)
+    return 0;
+  for (SequenceNumber sequence : f->sequences) {
+    if (sequence <= snapshot)
+      return sequence;
+  }
+  return 0;
+}
+
+void FragmentedRangeTombstones::AppendTo(
+    std::vector<RangeTombstone> *tombstones) const {
+  for (const Fragment &f : fragments_) {
+    for (SequenceNumber sequence : f.sequences)
+      tombstones->emplace_back(f.begin, f.end, sequence);
+  }
+}
+
+}  // namespace lessdb
@@ -0,0 +1,92 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "DBFormat.h"
+#include "Slice.h"
+
+namespace lessdb {
+
+class Comparator;
+
+// A range deletion written by WriteBatch::DeleteRange: it deletes the entries
+// of the user keys in [begin, end) older than its sequence.
+struct RangeTombstone {
+  std::string begin;
+  std::string end;
+  SequenceNumber sequence;
+
+  RangeTombstone(const Slice &b, const Slice &e, SequenceNumber seq)
+      : begin(b.RawData(), b.Len()), end(e.RawData(), e.Len()), sequence(seq) {}
+};
+
+// FragmentedRangeTombstones cuts a set of possibly overlapping range
+// tombstones at all their begin and end keys, into disjoint fragments sorted
+// by user key. Each fragment keeps the sequences of the tombstones covering
+// it, so a lookup is a binary search for the fragment of the user key,
+// whatever the number of tombstones overlapping there.
+//
+// Immutable once built, thus thread-safe.
+class FragmentedRangeTombstones {
+ public:
+  struct Fragment {
+    std::string begin;  // [begin, end) of user keys
+    std::string end;
+    std::vector<SequenceNumber> sequences;  // in decreasing order
+  };
+
+  // The user keys are ordered by "user_comparator", which must remain live
+  // while this object is in use. Empty ranges are ignored.
+  FragmentedRangeTombstones(const Comparator *user_comparator,
+                            const std::vector<RangeTombstone> &tombstones);
+
+  bool Empty() const {
+    return fragments_.empty();
+  }
+
+  const std::vector<Fragment> &Fragments() const {
+    return fragments_;
+  }
+
+  // Returns the fragment covering "user_key", or NULL if no tombstone does.
+  const Fragment *Find(const Slice &user_key) const;
+
+  // Returns the largest sequence no greater than "snapshot" of the
+  // tombstones covering "user_key", i.e the entries of the user key older
+  // than that are deleted as of "snapshot". Returns 0 if there's none.
+  SequenceNumber MaxCoveringSequence(const Slice &user_key,
+                                     SequenceNumber snapshot) const;
+
+  // Appends the fragments to *tombstones, a tombstone for each sequence of
+  // each fragment, which cover what the original tombstones do.
+  void AppendTo(std::vector<RangeTombstone> *tombstones) const;
+
+ private:
+  const Comparator *user_comparator_;
+  std::vector<Fragment> fragments_;
+};
+
+}  // namespace lessdb
@@ -0,0 +1,207 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <memory>
+
+#include "FileUtils.h"
+#include "RateLimiter.h"
+
+namespace lessdb {
+
+RateLimiter::RateLimiter(int64_t bytes_per_second, int64_t refill_period_us,
+                         bool auto_tuned)
+    : refill_period_(std::max<int64_t>(refill_period_us, 1)),
+      auto_tuned_(auto_tuned),
+      max_bytes_per_second_(bytes_per_second),
+      available_bytes_(0),
+      next_refill_(Clock::now()),
+      num_refills_(0),
+      window_micros_(0),
+      window_samples_(0),
+      baseline_micros_(0) {
+  std::fill(total_bytes_, total_bytes_ + kNumPriorities, 0);
+  setRate(bytes_per_second);
+}
+
+RateLimiter::~RateLimiter() = default;
+
+void RateLimiter::Request(size_t bytes, Priority pri) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  total_bytes_[pri] += bytes;
+  while (bytes > 0) {
+    const size_t n = std::min(bytes, refill_bytes_);
+    bytes -= n;
+
+    Clock::time_point now = Clock::now();
+    if (now >= next_refill_)
+      refill(now);
+    if (queues_[kHigh].empty() && queues_[kLow].empty() &&
+        available_bytes_ >= n) {
+      available_bytes_ -= n;
+      continue;
+    }
+
+    // Granted by the refill of whichever waiter wakes up first.
+    Req req{n, false};
+    queues_[pri].push_back(&req);
+    while (!req.granted) {
+      now = Clock::now();
+      if (now >= next_refill_) {
+        refill(now);
+      } else {
+        cv_.wait_until(lock, next_refill_);
+      }
+    }
+  }
+}
+
+void RateLimiter::refill(Clock::time_point now) {
+  available_bytes_ = std::min(available_bytes_ + refill_bytes_, refill_bytes_);
+  next_refill_ = now + refill_period_;
+  num_refills_++;
+
+  const bool low_first = num_refills_ % kFairness == 0;
+  for (int i = 0; i < kNumPriorities; i++) {
+    std::deque<Req *> &queue = queues_[low_first ? kNumPriorities - 1 - i : i];
+    while (!queue.empty()) {
+      // A request queued before the rate was lowered may be larger than a
+      // refill, it's granted a full bucket.
+      Req *req = queue.front();
+      const size_t n = std::min(req->bytes, refill_bytes_);
+      if (n > available_bytes_) {
+        // The order of the requests is kept across the priorities too.
+        cv_.notify_all();
+        return;
+      }
+      available_bytes_ -= n;
+      req->granted = true;
+      queue.pop_front();
+    }
+  }
+  cv_.notify_all();
+}
+
+size_t RateLimiter::GetSingleBurstBytes() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return refill_bytes_;
+}
+
+void RateLimiter::SetBytesPerSecond(int64_t bytes_per_second) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  max_bytes_per_second_ = bytes_per_second;
+  setRate(bytes_per_second);
+}
+
+int64_t RateLimiter::GetBytesPerSecond() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return max_bytes_per_second_;
+}
+
+int64_t RateLimiter::GetCurrentBytesPerSecond() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return bytes_per_second_;
+}
+
+void RateLimiter::setRate(int64_t bytes_per_second) {
+  bytes_per_second_ = std::max<int64_t>(bytes_per_second, 1);
+  refill_bytes_ = static_cast<size_t>(std::max<int64_t>(
+      bytes_per_second_ * refill_period_.count() / 1000000, 1));
+}
+
+void RateLimiter::ReportForegroundLatency(uint64_t micros) {
+  if (!auto_tuned_)
+    return;
+  std::lock_guard<std::mutex> guard(mutex_);
+  window_micros_ += micros;
+  if (++window_samples_ < kTuneSamples)
+    return;
+  const double mean = static_cast<double>(window_micros_) / window_samples_;
+  window_micros_ = 0;
+  window_samples_ = 0;
+
+  if (baseline_micros_ <= 0 || mean < baseline_micros_) {
+    baseline_micros_ = mean;
+  } else {
+    baseline_micros_ *= 1.01;
+  }
+  const double baseline = std::max(baseline_micros_, 1.0);
+  const int64_t min_rate = std::max<int64_t>(max_bytes_per_second_ / 20, 1);
+  if (mean > 2 * baseline) {
+    setRate(std::max(bytes_per_second_ * 3 / 4, min_rate));
+  } else if (mean < 1.25 * baseline) {
+    setRate(std::min(bytes_per_second_ + min_rate, max_bytes_per_second_));
+  }
+}
+
+uint64_t RateLimiter::GetTotalBytesThrough(Priority pri) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return total_bytes_[pri];
+}
+
+namespace {
+
+class RateLimitedFile final : public WritableFile {
+ public:
+  RateLimitedFile(WritableFile *file, RateLimiter *limiter,
+                  RateLimiter::Priority pri)
+      : file_(file), limiter_(limiter), pri_(pri) {}
+
+  Status Append(const Slice &data) override {
+    limiter_->Request(data.Len(), pri_);
+    return file_->Append(data);
+  }
+
+  Status Appendv(const Slice *data, size_t n) override {
+    size_t bytes = 0;
+    for (size_t i = 0; i < n; i++)
+      bytes += data[i].Len();
+    limiter_->Request(bytes, pri_);
+    return file_->Appendv(data, n);
+  }
+
+  Status Sync() override {
+    return file_->Sync();
+  }
+
+  Status Close() override {
+    return file_->Close();
+  }
+
+  Status Flush() override {
+    return file_->Flush();
+  }
+
+ private:
+  std::unique_ptr<WritableFile> file_;
+  RateLimiter *const limiter_;
+  const RateLimiter::Priority pri_;
+};
+
+}  // anonymous namespace
+
+WritableFile *NewRateLimitedFile(WritableFile *file, RateLimiter *limiter,
+                                 RateLimiter::Priority pri) {
+  return new RateLimitedFile(file, limiter, pri);
+}
+
+}  // namespace lessdb
@@ -0,0 +1,171 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "Disallowcopying.h"
+
+namespace lessdb {
+
+class WritableFile;
+
+// RateLimiter is a token bucket bounding the bytes per second written by the
+// background work of the databases sharing it through Options::rate_limiter,
+// i.e. the sstables built by their flushes and compactions, so that they
+// don't saturate the device at the expense of the foreground reads and log
+// syncs. The log writes never go through it.
+//
+// The bucket is refilled every refill period, and the requests waiting for
+// it are granted in FIFO order, those of kHigh (flushes) before those of
+// kLow (compactions), except that every kFairness-th refill serves kLow
+// first, so that the compactions are not starved.
+//
+// If auto-tuned, the rate is adapted to the foreground latency reported
+// by ReportForegroundLatency (DBImpl::Get reports its own): it backs off
+// when the latency rises well over its baseline, down to 1/20 of the
+// configured rate, and goes back up while the latency is normal.
+//
+// Thread-safe.
+class RateLimiter {
+  __DISALLOW_COPYING__(RateLimiter);
+
+ public:
+  enum Priority {
+    kHigh = 0,  // Memtable flushes.
+    kLow = 1,   // Compactions.
+    kNumPriorities = 2
+  };
+
+  explicit RateLimiter(int64_t bytes_per_second,
+                       int64_t refill_period_us = 100 * 1000,
+                       bool auto_tuned = false);
+
+  ~RateLimiter();
+
+  // Waits until "bytes" may be written. A request larger than the bytes of
+  // a refill period is split.
+  void Request(size_t bytes, Priority pri);
+
+  // The largest request granted at once, i.e. the bytes of a refill period.
+  size_t GetSingleBurstBytes() const;
+
+  // Sets the configured rate, which an auto-tuned limiter stays under.
+  void SetBytesPerSecond(int64_t bytes_per_second);
+
+  // The configured rate.
+  int64_t GetBytesPerSecond() const;
+
+  // The rate in effect, below the configured rate while an auto-tuned
+  // limiter backs off.
+  int64_t GetCurrentBytesPerSecond() const;
+
+  bool IsAutoTuned() const {
+    return auto_tuned_;
+  }
+
+  // Reports the latency of a foreground operation to an auto-tuned limiter,
+  // which adapts its rate once every kTuneSamples reports.
+  void ReportForegroundLatency(uint64_t micros);
+
+  // The total bytes granted to the requests of priority "pri".
+  uint64_t GetTotalBytesThrough(Priority pri) const;
+
+  static const int kFairness = 10;
+  static const int kTuneSamples = 100;
+
+ private:
+  struct Req {
+    size_t bytes;
+    bool granted;
+  };
+
+  typedef std::chrono::steady_clock Clock;
+
+  // Refills the bucket and grants the waiting requests it covers.
+  // REQUIRES: mutex_ is held.
+  void refill(Clock::time_point now);
+
+  // REQUIRES: mutex_ is held.
+  void setRate(int64_t bytes_per_second);
+
+  const std::chrono::microseconds refill_period_;
+  const bool auto_tuned_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  int64_t max_bytes_per_second_;
+  int64_t bytes_per_second_;
+  size_t refill_bytes_;  // per refill period
+  size_t available_bytes_;
+  Clock::time_point next_refill_;
+  uint64_t num_refills_;
+  std::deque<Req *> queues_[kNumPriorities];
+  uint64_t total_bytes_[kNumPriorities];
+
+  // The state of the auto-tuning: the latency reported in the current
+  // window of kTuneSamples reports, and the baseline it is compared with,
+  // the lowest window mean seen, drifting up slowly to follow the workload.
+  uint64_t window_micros_;
+  int window_samples_;
+  double baseline_micros_;
+};
+
+// Returns a file writing through "file", whose appends first wait for
+// "limiter" at priority "pri". Takes the ownership of "file".
+WritableFile *NewRateLimitedFile(WritableFile *file, RateLimiter *limiter,
+                                 RateLimiter::Priority pri);
+
+// LatencyReporter measures the lifetime of its scope into
+// RateLimiter::ReportForegroundLatency, or does nothing at all (not even
+// reading the clock) if limiter is NULL or not auto-tuned.
+class LatencyReporter {
+  __DISALLOW_COPYING__(LatencyReporter);
+
+ public:
+  explicit LatencyReporter(RateLimiter *limiter)
+      : limiter_(limiter && limiter->IsAutoTuned() ? limiter : nullptr) {
+    if (limiter_)
+      start_ = std::chrono::steady_clock::now();
+  }
+
+  ~LatencyReporter() {
+    if (limiter_) {
+      limiter_->ReportForegroundLatency(static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - start_)
+              .count()));
+    }
+  }
+
+ private:
+  RateLimiter *limiter_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace lessdb
@@ -20,23 +20,80 @@
  * SOFTWARE.
  */
 
-#include <boost/any.hpp>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include "SSTable.h"
 #include "FileUtils.h"
 #include "TableFormat.h"
 #include "BlockUtils.h"
 #include "CacheStrategy.h"
+#include "WriteBufferManager.h"
 #include "Block.h"
+#include "DataView.h"
+#include "FilterBlock.h"
+#include "FilterStrategy.h"
+#include "InternalKey.h"
+#include "PrefixExtractor.h"
+#include "Comparator.h"
+#include "PerfContext.h"
+#include "Statistics.h"
+#include "Config.h"
 
 namespace lessdb {
 
+namespace {
+
+// Serves the reads falling into the last bytes of a file, read at once when
+// it's constructed, out of memory, and passes the others through.
+class TailPrefetchedFile final : public RandomAccessFile {
+ public:
+  TailPrefetchedFile(RandomAccessFile *file, uint64_t file_size, size_t n,
+                     Status &s)
+      : file_(file), buf_(new char[n]) {
+    tail_offset_ = file_size - n;
+    s = file_->Read(n, tail_offset_, buf_.get(), &tail_);
+  }
+
+  Status Read(size_t n, uint64_t offset, char *dst, Slice *result) override {
+    if (offset < tail_offset_ || offset + n > tail_offset_ + tail_.Len())
+      return file_->Read(n, offset, dst, result);
+    memcpy(dst, tail_.RawData() + (offset - tail_offset_), n);
+    *result = Slice(dst, n);
+    return Status::OK();
+  }
+
+ private:
+  RandomAccessFile *file_;
+  std::unique_ptr<char[]> buf_;
+  uint64_t tail_offset_;
+  Slice tail_;
+};
+
+}  // namespace
+
 SSTable *SSTable::Open(const Options &options, RandomAccessFile *file,
                        uint64_t file_size, Status &s) {
   // Read the footer of the file, obtain a block handle for index block. Read
   // the index block identified by the handle.
   std::unique_ptr<SSTable> table;
 
+  // Everything read here, but the dictionary and the filter of a huge table,
+  // is written at the end of the file. A mmaped file has nothing to gain.
+  RandomAccessFile *table_file = file;
+  std::unique_ptr<TailPrefetchedFile> tail;
+  if (!file->HasStableContents() && file_size > Footer::kEncodedLength) {
+    size_t n = static_cast<size_t>(
+        std::min<uint64_t>(file_size, config::kTableTailPrefetchSize));
+    tail.reset(new TailPrefetchedFile(table_file, file_size, n, s));
+    if (!s)
+      return nullptr;
+    file = tail.get();
+  }
+
   Slice footer_content;
   char footer_buf[Footer::kEncodedLength];
   s = file->Read(Footer::kEncodedLength, file_size - Footer::kEncodedLength,
@@ -57,158 +114,1028 @@ SSTable *SSTable::Open(const Options &options, RandomAccessFile *file,
 
   ReadOptions read_options;
   table->index_block_.reset(ReadBlockFromFile(
-      file, read_options, options.comparator, footer.index_handle, s));
+      file, read_options, options.comparator, footer.index_handle, s, Slice(),
+      options.allocator));
   if (!s)
     return nullptr;
 
+  // The index block, or the top-level index if the index is partitioned, is
+  // searched by every lookup during the whole lifetime of the table.
+  table->index_block_->BuildRestartPrefixes();
+
   table->file_ = file;
+  table->options_ = options;
+  table->cache_id_ = options.block_cache ? options.block_cache->NewId() : 0;
+  table->compressed_cache_id_ = options.block_cache_compressed
+                                    ? options.block_cache_compressed->NewId()
+                                    : 0;
+  if (footer.mataindex_handle.size > kBlockTrailerSize) {
+    s = table->readMetaIndex(footer.mataindex_handle);
+    if (!s)
+      return nullptr;
+  }
+  table->file_ = table_file;
+
+  table->memory_usage_ += table->index_block_->Size();
+  if (options.write_buffer_manager)
+    options.write_buffer_manager->ReserveTableMem(table->memory_usage_);
   return table.release();
 }
 
+SSTable::SSTable()
+    : file_(nullptr),
+      partitioned_index_(false),
+      delta_encoded_index_(false),
+      prefix_filtered_(false),
+      cache_id_(0),
+      compressed_cache_id_(0),
+      memory_usage_(0) {}
+
+SSTable::~SSTable() {
+  // Reserved at the end of a successful Open.
+  if (options_.write_buffer_manager && memory_usage_ > 0)
+    options_.write_buffer_manager->FreeTableMem(memory_usage_);
+}
+
+Status SSTable::readMetaIndex(const BlockHandle &meta_index_handle) {
+  ReadOptions read_options;
+  Status s;
+  std::unique_ptr<Block> meta(ReadBlockFromFile(
+      file_, read_options, NewBytewiseComparator(), meta_index_handle, s));
+  if (!s)
+    return s;
+
+  // The data blocks can't be read without their dictionary.
+  auto it = meta->find(kCompressionDictKey);
+  if (it != meta->end()) {
+    BlockHandle dict_handle;
+    Slice handle_buf = it.Value();
+    s = BlockHandle::DecodeFrom(&handle_buf, &dict_handle);
+    if (!s)
+      return s;
+    BlockContent content;
+    s = ReadBlockContent(file_, read_options, dict_handle, &content);
+    if (!s)
+      return s;
+    compression_dict_.assign(content.data.RawData(), content.data.Len());
+    if (content.heap_allocated)
+      delete[] content.data.RawData();
+  }
+
+  partitioned_index_ = meta->find(kPartitionedIndexKey) != meta->end();
+  delta_encoded_index_ = meta->find(kDeltaEncodedIndexKey) != meta->end();
+
+  if (options_.filter_strategy)
+    readFilter(meta.get());
+
+  // The range tombstones delete keys, they are as needed as the data blocks.
+  it = meta->find(kRangeDelBlockKey);
+  if (it != meta->end())
+    s = readRangeTombstones(it);
+  return s;
+}
+
+Status SSTable::readRangeTombstones(const BlockConstIterator& it) {
+  BlockHandle handle;
+  Slice handle_buf = it.Value();
+  Status s = BlockHandle::DecodeFrom(&handle_buf, &handle);
+  if (!s)
+    return s;
+  std::unique_ptr<Block> block(ReadBlockFromFile(file_, ReadOptions(),
+                                                 options_.comparator, handle,
+                                                 s));
+  if (!s)
+    return s;
+  for (auto entry = block->begin(); entry != block->end(); ++entry) {
+    Slice key = entry.Key();
+    if (key.Len() < 8)
+      return Status::Corruption("bad range tombstone in sstable");
+    InternalKey ikey(key);
+    range_tombstones_.emplace_back(ikey.user_key, entry.Value(),
+                                   ikey.sequence);
+  }
+  memory_usage_ += block->Size();
+  return s;
+}
+
+std::shared_ptr<const FragmentedRangeTombstones> SSTable::FragmentedTombstones(
+    const Comparator* user_comparator) const {
+  if (range_tombstones_.empty())
+    return nullptr;
+  std::call_once(fragmented_once_, [&]() {
+    fragmented_ = std::make_shared<FragmentedRangeTombstones>(
+        user_comparator, range_tombstones_);
+  });
+  return fragmented_;
+}
+
+void SSTable::readFilter(const Block *meta) {
+  ReadOptions read_options;
+  std::string key = "filter.";
+  key.append(options_.filter_strategy->Name());
+  auto it = meta->find(key);
+  if (it == meta->end())
+    return;
+
+  BlockHandle filter_handle;
+  Slice handle_buf = it.Value();
+  if (!BlockHandle::DecodeFrom(&handle_buf, &filter_handle))
+    return;
+
+  BlockContent content;
+  if (!ReadBlockContent(file_, read_options, filter_handle, &content))
+    return;
+  if (content.heap_allocated) {
+    filter_data_.reset(content.data.RawData());
+  }
+  filter_.reset(new FilterBlockReader(options_.filter_strategy, content.data));
+  memory_usage_ += content.data.Len();
+
+  if (options_.prefix_extractor) {
+    std::string prefix_key = "prefix.";
+    prefix_key.append(options_.prefix_extractor->Name());
+    prefix_filtered_ = meta->find(prefix_key) != meta->end();
+  }
+}
+
 SSTable::ConstIterator SSTable::begin() const {
-  auto block = ObtainBlockByIndexIterator(index_block_->begin());
+  return begin(ReadOptions());
+}
+
+SSTable::ConstIterator SSTable::begin(const ReadOptions &options) const {
+  Status s;
+  boost::intrusive_ptr<Block> partition;
+  const Block *index = index_block_.get();
+  if (partitioned_index_) {
+    partition = obtainIndexPartition(index_block_->begin(), options, &s);
+    if (!partition)
+      return TwoLevelIterator(this, options, s);
+    index = partition.get();
+  }
+
+  auto block = ObtainBlockByIndexIterator(index->begin(), options, &s);
   if (!block) {
-    return end();
+    return TwoLevelIterator(this, options, s);
   }
-  return TwoLevelIterator(new BlockConstIterator(block->begin()),
-                          new BlockConstIterator(index_block_->begin()), this);
+  return TwoLevelIterator(
+      block->begin(), index->begin(), this,
+      partition ? index_block_->begin() : BlockConstIterator(), partition,
+      options);
 }
 
 SSTable::ConstIterator SSTable::end() const {
-  return TwoLevelIterator();
+  return TwoLevelIterator(this, ReadOptions());
+}
+
+void SSTable::IndexKeys(std::vector<std::string> *keys) const {
+  for (auto it = index_block_->begin(); it != index_block_->end(); it++) {
+    keys->push_back(it.Key().ToString());
+  }
 }
 
 SSTable::ConstIterator SSTable::find(const Slice &key) const {
-  auto idx_it = index_block_->lower_bound(key);
-  if (idx_it == index_block_->end()) {
+  return find(ReadOptions(), key);
+}
+
+SSTable::ConstIterator SSTable::find(const ReadOptions &options,
+                                     const Slice &key) const {
+  Status s;
+  boost::intrusive_ptr<Block> partition;
+  const Block *index = index_block_.get();
+  // The partition read, if any, is timed as a block read.
+  PerfTimer index_timer(&perf_context.index_seek_nanos);
+  index_timer.Start();
+  auto top_it = index_block_->lower_bound(key);
+  if (partitioned_index_) {
+    if (top_it == index_block_->end())
+      return TwoLevelIterator(this, options);
+    index_timer.Stop();
+    partition = obtainIndexPartition(top_it, options, &s);
+    if (!partition)
+      return TwoLevelIterator(this, options, s);
+    index = partition.get();
+    index_timer.Start();
+  }
+
+  auto idx_it = index->lower_bound(key);
+  index_timer.Stop();
+  if (idx_it == index->end()) {
     // index < key
-    fprintf(stderr, "this 1\n");
-    fprintf(stderr, "%s\n", key.RawData());
-    for(auto it = index_block_->begin(); it!=index_block_->end(); it++) {
-      fprintf(stderr, "[%s,%s] ", it.Key().RawData(), it.Value().RawData());
-    }
-    fprintf(stderr, "\n");
-    return end();
+    return TwoLevelIterator(this, options);
   }
   // index >= key
-  auto block = ObtainBlockByIndexIterator(idx_it);
+
+  if (filter_) {
+    BlockHandle handle;
+    if (decodeIndexHandle(idx_it, &handle) && filteredOut(handle, key)) {
+      // Not found
+      return TwoLevelIterator(this, options);
+    }
+  }
+
+  auto block = ObtainBlockByIndexIterator(idx_it, options, &s);
   if (!block) {
-    fprintf(stderr, "this 2\n");
-    return end();
+    return TwoLevelIterator(this, options, s);
   }
   auto blck_it = block->find(key);
   if (blck_it == block->end()) {
-    fprintf(stderr, "this 3\n");
-    return end();
+    if (filter_)
+      RecordTick(options_.statistics, kFilterFalsePositive);
+    return TwoLevelIterator(this, options);
   }
-  return TwoLevelIterator(new BlockConstIterator(blck_it),
-                          new BlockConstIterator(idx_it), this);
+  return TwoLevelIterator(blck_it, idx_it, this,
+                          partition ? top_it : BlockConstIterator(), partition,
+                          options);
+}
+
+SSTable::ConstIterator SSTable::lower_bound(const ReadOptions &options,
+                                            const Slice &key) const {
+  TwoLevelIterator it(this, options);
+  it.Seek(key);
+  return it;
 }
 
-Block *SSTable::ObtainBlockByIndexIterator(const BlockConstIterator &it) const {
+Status SSTable::MultiGet(const Slice *keys, size_t n,
+                         ConstIterator *results) const {
+  ReadOptions read_options;
+  Status s;
+
+  // Visit the keys in sorted order, so that keys in the same data block are
+  // adjacent, and the index block is walked forward only once.
+  std::vector<size_t> order(n);
+  for (size_t i = 0; i < n; i++) {
+    order[i] = i;
+    results[i] = end();
+  }
+  const Comparator *cmp = options_.comparator;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return cmp->Compare(keys[a], keys[b]) < 0;
+  });
+
+  // A data block to be searched, together with keys order[begin, end) that
+  // fall into it.
+  // With a partitioned index, "partition" is the index partition of idx_it,
+  // pointed by top_it.
+  struct BlockGroup {
+    BlockGroup(const BlockConstIterator &it, const BlockConstIterator &top,
+               const boost::intrusive_ptr<Block> &p)
+        : idx_it(it), top_it(top), partition(p), begin(0), end(0) {}
+
+    BlockConstIterator idx_it;
+    BlockConstIterator top_it;
+    boost::intrusive_ptr<Block> partition;
+    BlockHandle handle;
+    size_t begin;
+    size_t end;
+    boost::intrusive_ptr<Block> block;
+  };
+  std::vector<BlockGroup> groups;
+
+  boost::intrusive_ptr<Block> partition;
+  const Block *index = index_block_.get();
+  auto top_it = index_block_->end();
+  auto idx_it = index_block_->end();
+  for (size_t i = 0; i < n; i++) {
+    const Slice &key = keys[order[i]];
+    if (idx_it == index->end() || cmp->Compare(idx_it.Key(), key) < 0) {
+      if (partitioned_index_ &&
+          (!partition || cmp->Compare(top_it.Key(), key) < 0)) {
+        top_it = index_block_->lower_bound(key);
+        if (top_it == index_block_->end())
+          break;
+        partition = obtainIndexPartition(top_it, read_options, &s);
+        if (!partition)
+          return s;
+        index = partition.get();
+      }
+      idx_it = index->lower_bound(key);
+      if (idx_it == index->end()) {
+        // All the remaining keys are greater than the last key in table.
+        break;
+      }
+    }
+
+    if (groups.empty() || !(groups.back().idx_it == idx_it)) {
+      BlockGroup group(idx_it, top_it, partition);
+      s = decodeIndexHandle(idx_it, &group.handle);
+      if (!s)
+        return s;
+      group.begin = group.end = i;
+      groups.push_back(group);
+    }
+
+    BlockGroup &group = groups.back();
+    if (filter_ && filteredOut(group.handle, key)) {
+      // Drop the key from the group by moving it before the group.
+      std::swap(order[i], order[group.begin]);
+      group.begin++;
+    }
+    group.end = i + 1;
+  }
+
+  // Collect the blocks that are not cached, and read them in a batch.
+  std::vector<BlockHandle> handles;
+  std::vector<size_t> req_groups;
+  for (size_t g = 0; g < groups.size(); g++) {
+    BlockGroup &group = groups[g];
+    if (group.begin == group.end)
+      continue;  // all keys are ruled out by the filter
+    group.block = lookupBlockCache(group.handle);
+    if (group.block)
+      continue;
+    group.block = lookupCompressedBlockCache(group.handle, compression_dict_,
+                                             read_options, &s);
+    if (!s)
+      return s;
+    if (group.block)
+      continue;
+
+    handles.push_back(group.handle);
+    req_groups.push_back(g);
+  }
+
+  std::vector<boost::intrusive_ptr<Block>> blocks(handles.size());
+  s = readBlocks(handles.data(), handles.size(), read_options, blocks.data());
+  if (!s)
+    return s;
+  for (size_t r = 0; r < blocks.size(); r++) {
+    groups[req_groups[r]].block = blocks[r];
+  }
+
+  for (const BlockGroup &group : groups) {
+    if (!group.block)
+      continue;
+    for (size_t i = group.begin; i < group.end; i++) {
+      auto blck_it = group.block->find(keys[order[i]]);
+      if (blck_it == group.block->end()) {
+        if (filter_)
+          RecordTick(options_.statistics, kFilterFalsePositive);
+        continue;
+      }
+      results[order[i]] = TwoLevelIterator(
+          blck_it, group.idx_it, this,
+          group.partition ? group.top_it : BlockConstIterator(),
+          group.partition);
+    }
+  }
+  return s;
+}
+
+Status SSTable::Prefetch(const ReadOptions &options, const Slice *keys,
+                         size_t n) const {
+  Status s;
+  if (!options_.block_cache || !options.fill_cache || n == 0)
+    return s;
+
+  // As in MultiGet, the index is walked forward once over the sorted keys.
+  std::vector<Slice> sorted(keys, keys + n);
+  const Comparator *cmp = options_.comparator;
+  std::sort(sorted.begin(), sorted.end(), [cmp](const Slice &a, const Slice &b) {
+    return cmp->Compare(a, b) < 0;
+  });
+
+  std::vector<BlockHandle> handles;
+  boost::intrusive_ptr<Block> partition;
+  const Block *index = index_block_.get();
+  auto top_it = index_block_->end();
+  auto idx_it = index_block_->end();
+  for (const Slice &key : sorted) {
+    if (!(idx_it == index->end()) && cmp->Compare(idx_it.Key(), key) >= 0)
+      continue;  // in the block of the previous key
+    if (partitioned_index_ &&
+        (!partition || cmp->Compare(top_it.Key(), key) < 0)) {
+      top_it = index_block_->lower_bound(key);
+      if (top_it == index_block_->end())
+        break;
+      partition = obtainIndexPartition(top_it, options, &s);
+      if (!partition)
+        return s;
+      index = partition.get();
+    }
+    idx_it = index->lower_bound(key);
+    if (idx_it == index->end())
+      break;
+
+    BlockHandle handle;
+    s = decodeIndexHandle(idx_it, &handle);
+    if (!s)
+      return s;
+    if (lookupBlockCache(handle))
+      continue;
+    // A block of the compressed block cache is inserted into the block
+    // cache as it is looked up.
+    if (lookupCompressedBlockCache(handle, compression_dict_, options, &s))
+      continue;
+    if (!s)
+      return s;
+    handles.push_back(handle);
+  }
+
+  // The blocks are inserted into the block cache as they are read.
+  std::vector<boost::intrusive_ptr<Block>> blocks(handles.size());
+  return readBlocks(handles.data(), handles.size(), options, blocks.data());
+}
+
+// The number of data blocks WarmUp reads in a batch, which bounds the
+// buffers in flight.
+static const size_t kWarmUpBatchBlocks = 256;
+
+Status SSTable::WarmUp(const ReadOptions &options,
+                       std::vector<uint64_t> offsets) const {
+  Status s;
+  if (!options_.block_cache || !options.fill_cache || offsets.empty())
+    return s;
+  std::sort(offsets.begin(), offsets.end());
+  auto wanted = [&offsets](const BlockHandle &handle) {
+    return std::binary_search(offsets.begin(), offsets.end(), handle.offset);
+  };
+
+  // The index entries are in the order of the offsets of their blocks, so
+  // are the handles collected. Every index partition is read to find the
+  // wanted data blocks, those not wanted are not cached.
+  std::vector<BlockHandle> handles;
+  boost::intrusive_ptr<Block> partition;
+  const Block *index = index_block_.get();
+  for (auto top_it = index_block_->begin(); top_it != index_block_->end();
+       ++top_it) {
+    if (partitioned_index_) {
+      BlockHandle partition_handle;
+      Slice handle_buf = top_it.Value();
+      s = BlockHandle::DecodeFrom(&handle_buf, &partition_handle);
+      if (!s)
+        return s;
+      ReadOptions partition_options = options;
+      partition_options.fill_cache = wanted(partition_handle);
+      partition = obtainIndexPartition(top_it, partition_options, &s);
+      if (!partition)
+        return s;
+      index = partition.get();
+    }
+    for (auto idx_it = index->begin(); idx_it != index->end(); ++idx_it) {
+      BlockHandle handle;
+      s = decodeIndexHandle(idx_it, &handle);
+      if (!s)
+        return s;
+      if (wanted(handle))
+        handles.push_back(handle);
+    }
+    if (!partitioned_index_)
+      break;
+  }
+
+  // The blocks are inserted into the block cache as they are read.
+  std::vector<boost::intrusive_ptr<Block>> blocks;
+  for (size_t i = 0; i < handles.size(); i += kWarmUpBatchBlocks) {
+    const size_t n = std::min(kWarmUpBatchBlocks, handles.size() - i);
+    blocks.assign(n, nullptr);
+    s = readBlocks(handles.data() + i, n, options, blocks.data());
+    if (!s)
+      return s;
+  }
+  return s;
+}
+
+bool SSTable::PrefixMayMatch(const ReadOptions &options,
+                             const Slice &key) const {
+  const PrefixExtractor *extractor = options_.prefix_extractor;
+  if (!prefix_filtered_ || !extractor->InDomain(key))
+    return true;
+  const Slice prefix = extractor->Transform(key);
+  Status s;
+
+  // The keys of the prefix from "key" on start in the data block of the
+  // first index entry not less than "key", and go on in the following blocks
+  // for as long as the index keys, which separate the blocks, have the
+  // prefix: an index key past the prefix is greater than all of its keys.
+  boost::intrusive_ptr<Block> partition;
+  const Block *index = index_block_.get();
+  auto top_it = index_block_->lower_bound(key);
+  auto idx_it = top_it;
+  if (partitioned_index_) {
+    if (top_it == index_block_->end())
+      return false;
+    partition = obtainIndexPartition(top_it, options, &s);
+    if (!partition)
+      return true;
+    index = partition.get();
+    idx_it = index->lower_bound(key);
+  }
+  for (;;) {
+    if (idx_it == index->end()) {
+      if (!partitioned_index_ || ++top_it == index_block_->end())
+        return false;
+      partition = obtainIndexPartition(top_it, options, &s);
+      if (!partition)
+        return true;
+      index = partition.get();
+      idx_it = index->begin();
+      continue;
+    }
+    BlockHandle handle;
+    if (!decodeIndexHandle(idx_it, &handle) || !filteredOut(handle, prefix))
+      return true;
+    const Slice separator = idx_it.Key();
+    if (!extractor->InDomain(separator) ||
+        !(extractor->Transform(separator) == prefix))
+      return false;
+    ++idx_it;
+  }
+}
+
+bool SSTable::filteredOut(const BlockHandle &handle, const Slice &key) const {
+  PERF_TIMER_GUARD(filter_probe_nanos);
+  const bool out = !filter_->MightContain(handle.offset - handle.size, key);
+  RecordTick(options_.statistics, out ? kFilterUseful : kFilterPositive);
+  return out;
+}
+
+boost::intrusive_ptr<Block> SSTable::ObtainBlockByIndexIterator(
+    const BlockConstIterator &it, const ReadOptions &options,
+    Status *s) const {
   // Obtain a block handle that contains index of the data block.
   BlockHandle handle;
-  Slice block_index_buf = it.Value();
-  stat_ = BlockHandle::DecodeFrom(&block_index_buf, &handle);
-  if (!stat_) {
+  *s = decodeIndexHandle(it, &handle);
+  if (!*s) {
     return nullptr;
   }
 
-  boost::intrusive_ptr<Block> block;
-  CacheStrategy *cache = options_.block_cache;
+  return obtainBlock(handle, compression_dict_, options, s);
+}
 
-  if (cache) {
-    // The key of a BlockCache is in format of:
-    // key          := unique_id block_offset
-    // unique_id    := uint64
-    // block_offset := uint64
-    char key_buf[16];
-    (*reinterpret_cast<uint64_t *>(key_buf)) = cache->NewId();
-    (*reinterpret_cast<uint64_t *>(key_buf + 8)) = handle.offset;
-    Slice key(key_buf, sizeof(key_buf));
-
-    CacheStrategy::HANDLE h = cache->Lookup(key);
-    if (h != NULL) {
-      //
-      block = *boost::unsafe_any_cast<decltype(block)>(&cache->Value(h));
-    } else {
-      cache->Insert(key, block);
-    }
+Status SSTable::decodeIndexHandle(const BlockConstIterator &it,
+                                  BlockHandle *handle) const {
+  Slice handle_buf = it.Value();
+  if (!delta_encoded_index_)
+    return BlockHandle::DecodeFrom(&handle_buf, handle);
+
+  // The handle at the restart point is encoded in full, each one after it is
+  // relative to the previous one.
+  Status s;
+  BlockHandle prev;
+  const Block *block = it.GetBlock();
+  for (auto p = block->RestartPointOf(it); p != block->end(); p++) {
+    handle_buf = p.Value();
+    if (!(s = BlockHandle::DecodeDeltaFrom(&handle_buf, prev, handle)))
+      return s;
+    if (p == it)
+      return s;
+    prev = *handle;
+  }
+  return Status::Corruption("SSTable: bad index entry");
+}
+
+boost::intrusive_ptr<Block> SSTable::readAhead(
+    const BlockConstIterator &it, const ReadOptions &options,
+    size_t *num_blocks,
+    std::vector<boost::intrusive_ptr<Block>> *readahead, Status *s) const {
+  if (options.readahead_size == 0)
+    return ObtainBlockByIndexIterator(it, options, s);
+
+  BlockHandle handle;
+  *s = decodeIndexHandle(it, &handle);
+  if (!*s) {
+    return nullptr;
   }
 
-  if (!block) {
-    /// Iff cache is not set or block is not found in cache.
-    ReadOptions read_options;
-    block.reset(ReadBlockFromFile(file_, read_options, options_.comparator,
-                                  handle, stat_));
-    if (!stat_)
+  boost::intrusive_ptr<Block> block = lookupBlockCache(handle);
+  if (block) {
+    return block;
+  }
+  block = lookupCompressedBlockCache(handle, compression_dict_, options, s);
+  if (block || !*s) {
+    return block;
+  }
+
+  // The window is cut short by the first block that's cached, which is
+  // read from cache when the iterator gets there.
+  std::vector<BlockHandle> handles(1, handle);
+  uint64_t bytes = handle.size;
+  bool bounded = false;
+  BlockConstIterator next(it);
+  for (next++; next != it.GetBlock()->end() && handles.size() < *num_blocks;
+       next++) {
+    // The handles are decoded in order, a delta-encoded one follows from
+    // the previous one.
+    BlockHandle next_handle;
+    Slice handle_buf = next.Value();
+    *s = BlockHandle::DecodeDeltaFrom(&handle_buf, handles.back(),
+                                      &next_handle);
+    if (!*s)
       return nullptr;
+    if (bytes + next_handle.size > options.readahead_size) {
+      bounded = true;
+      break;
+    }
+    if (lookupBlockCache(next_handle))
+      break;
+    handles.push_back(next_handle);
+    bytes += next_handle.size;
   }
-  return block.detach();
+
+  std::vector<boost::intrusive_ptr<Block>> blocks(handles.size());
+  *s = readBlocks(handles.data(), handles.size(), options, blocks.data());
+  if (!*s)
+    return nullptr;
+  readahead->assign(blocks.rbegin(), blocks.rend() - 1);
+  if (!bounded && handles.size() == *num_blocks)
+    *num_blocks *= 2;
+  return blocks[0];
 }
 
-TwoLevelIterator::TwoLevelIterator(BlockConstIterator *data_it,
-                                   BlockConstIterator *idx_it,
-                                   const SSTable *table)
-    : data_iter_(data_it),
-      index_iter_(idx_it),
-      block_(data_it->GetBlock()),
-      table_(table) {}
+Status SSTable::readBlocks(const BlockHandle *handles, size_t n,
+                           const ReadOptions &options,
+                           boost::intrusive_ptr<Block> *blocks) const {
+  Status s;
+  if (n == 0)
+    return s;
 
-TwoLevelIterator::TwoLevelIterator(const TwoLevelIterator &rhs) {
-  if (rhs.valid()) {
-    data_iter_.reset(new BlockConstIterator(*rhs.data_iter_));
-    index_iter_.reset(new BlockConstIterator(*rhs.index_iter_));
-    block_ = rhs.block_;
-    table_ = rhs.table_;
+  std::vector<ReadRequest> reqs(n);
+  std::vector<BlockBuffer> bufs(n);
+  bool stable = file_->HasStableContents();
+  for (size_t i = 0; i < n; i++) {
+    reqs[i].offset = handles[i].offset - handles[i].size;
+    reqs[i].len = handles[i].size;
+    if (!stable)
+      bufs[i] = NewBlockBuffer(reqs[i].len, options_.allocator);
+    reqs[i].scratch = bufs[i].get();
+  }
+  {
+    PERF_TIMER_GUARD(block_read_nanos);
+    file_->MultiRead(reqs.data(), n);
   }
+  PERF_COUNTER_ADD(block_read_count, n);
+  if (options_.statistics) {
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < n; i++)
+      bytes += reqs[i].result.Len();
+    options_.statistics->RecordTick(kBlockRead, n);
+    options_.statistics->RecordTick(kBlockReadBytes, bytes);
+  }
+  if (perf_level >= kPerfEnableCount) {
+    for (size_t i = 0; i < n; i++)
+      perf_context.block_read_byte += reqs[i].result.Len();
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    s = reqs[i].status;
+    if (!s)
+      return s;
+
+    BlockContent content;
+    CompressionType type;
+    s = ParseBlockContent(options, handles[i], reqs[i].result, &bufs[i],
+                          &content, Slice(), &type);
+    if (!s)
+      return s;
+    blocks[i] = newBlock(handles[i], &content, type, compression_dict_,
+                         options, &s);
+    if (!blocks[i])
+      return s;
+  }
+  return s;
 }
 
-TwoLevelIterator &TwoLevelIterator::operator=(const TwoLevelIterator &rhs) {
-  TwoLevelIterator tmp(rhs);
-  std::swap(*this, tmp);
-  return *this;
+boost::intrusive_ptr<Block> SSTable::obtainIndexPartition(
+    const BlockConstIterator &top_it, const ReadOptions &options,
+    Status *s) const {
+  BlockHandle handle;
+  Slice handle_buf = top_it.Value();
+  *s = BlockHandle::DecodeFrom(&handle_buf, &handle);
+  if (!*s) {
+    return nullptr;
+  }
+  return obtainBlock(handle, Slice(), options, s);
 }
 
+boost::intrusive_ptr<Block> SSTable::obtainBlock(
+    const BlockHandle &handle, const Slice &dict,
+    const ReadOptions &options, Status *s) const {
+  boost::intrusive_ptr<Block> block = lookupBlockCache(handle);
+  if (block) {
+    return block;
+  }
+  block = lookupCompressedBlockCache(handle, dict, options, s);
+  if (block || !*s) {
+    return block;
+  }
+
+  /// Iff cache is not set or block is not found in cache.
+  BlockContent content;
+  CompressionType type;
+  {
+    StopWatch sw(options_.statistics, kBlockReadMicros);
+    *s = ReadBlockContent(file_, options, handle, &content, Slice(), &type,
+                          options_.allocator);
+  }
+  if (!*s)
+    return nullptr;
+  RecordTick(options_.statistics, kBlockRead);
+  RecordTick(options_.statistics, kBlockReadBytes, handle.size);
+  return newBlock(handle, &content, type, dict, options, s);
+}
+
+// Compressed blocks are kept in options_.block_cache_compressed as is, along
+// with their compression type.
+struct CompressedBlock {
+  CompressionType type;
+  std::string data;
+};
+
+boost::intrusive_ptr<Block> SSTable::newBlock(const BlockHandle &handle,
+                                              BlockContent *content,
+                                              CompressionType type,
+                                              const Slice &dict,
+                                              const ReadOptions &options,
+                                              Status *s) const {
+  if (type != kNoCompression && options.fill_cache) {
+    insertCompressedBlockCache(handle, content->data, type);
+  }
+  *s = UncompressBlockContent(type, dict, content);
+  if (!*s)
+    return nullptr;
+
+  boost::intrusive_ptr<Block> block(new Block(*content, options_.comparator));
+  if (options.fill_cache)
+    insertBlockCache(handle, block);
+  return block;
+}
+
+// The key of a BlockCache is in format of:
+// key          := cache_id block_offset
+// cache_id     := uint64
+// block_offset := uint64
+static const size_t kBlockCacheKeyLength = 16;
+
+static inline void EncodeBlockCacheKey(char *buf, uint64_t cache_id,
+                                       uint64_t offset) {
+  DataView(buf).WriteNum(cache_id);
+  DataView(buf + 8).WriteNum(offset);
+}
+
+bool SSTable::DecodeBlockCacheKey(const Slice &key, uint64_t *cache_id,
+                                  uint64_t *offset) {
+  if (key.Len() != kBlockCacheKeyLength)
+    return false;
+  *cache_id = ConstDataView(key.RawData()).ReadNum<uint64_t>();
+  *offset = ConstDataView(key.RawData() + 8).ReadNum<uint64_t>();
+  return true;
+}
+
+// The deleter of the blocks in options_.block_cache, which drops the
+// reference of the cache.
+static void ReleaseCachedBlock(const Slice &key, void *value) {
+  intrusive_ptr_release(static_cast<Block *>(value));
+}
+
+boost::intrusive_ptr<Block> SSTable::lookupBlockCache(
+    const BlockHandle &handle) const {
+  CacheStrategy *cache = options_.block_cache;
+  if (!cache)
+    return nullptr;
+
+  char key_buf[kBlockCacheKeyLength];
+  EncodeBlockCacheKey(key_buf, cache_id_, handle.offset);
+  CacheStrategy::HANDLE h = cache->Lookup(Slice(key_buf, sizeof(key_buf)));
+  RecordTick(options_.statistics, h ? kBlockCacheHit : kBlockCacheMiss);
+  if (h == NULL)
+    return nullptr;
+  PERF_COUNTER_ADD(block_cache_hit_count, 1);
+  // The block is shared with the cache by its atomic reference count, it
+  // outlives the handle.
+  boost::intrusive_ptr<Block> block(static_cast<Block *>(cache->Value(h)));
+  cache->Release(h);
+  return block;
+}
+
+boost::intrusive_ptr<Block> SSTable::lookupCompressedBlockCache(
+    const BlockHandle &handle, const Slice &dict,
+    const ReadOptions &options, Status *s) const {
+  CacheStrategy *cache = options_.block_cache_compressed;
+  if (!cache)
+    return nullptr;
+
+  char key_buf[kBlockCacheKeyLength];
+  EncodeBlockCacheKey(key_buf, compressed_cache_id_, handle.offset);
+  CacheStrategy::HANDLE h = cache->Lookup(Slice(key_buf, sizeof(key_buf)));
+  RecordTick(options_.statistics,
+             h ? kBlockCacheCompressedHit : kBlockCacheCompressedMiss);
+  if (h == NULL)
+    return nullptr;
+  // The handle pins the compressed block while it's uncompressed.
+  const CompressedBlock *compressed =
+      static_cast<const CompressedBlock *>(cache->Value(h));
+
+  BlockContent content;
+  content.data = compressed->data;
+  *s = UncompressBlockContent(compressed->type, dict, &content);
+  cache->Release(h);
+  if (!*s)
+    return nullptr;
+
+  boost::intrusive_ptr<Block> block(new Block(content, options_.comparator));
+  if (options.fill_cache)
+    insertBlockCache(handle, block);
+  return block;
+}
+
+void SSTable::insertCompressedBlockCache(const BlockHandle &handle,
+                                         const Slice &data,
+                                         CompressionType type) const {
+  CacheStrategy *cache = options_.block_cache_compressed;
+  if (!cache)
+    return;
+
+  CompressedBlock *compressed = new CompressedBlock;
+  compressed->type = type;
+  compressed->data.assign(data.RawData(), data.Len());
+
+  char key_buf[kBlockCacheKeyLength];
+  EncodeBlockCacheKey(key_buf, compressed_cache_id_, handle.offset);
+  cache->Release(cache->Insert(Slice(key_buf, sizeof(key_buf)), compressed,
+                               data.Len(),
+                               &DeleteCacheValue<CompressedBlock>));
+}
+
+void SSTable::insertBlockCache(const BlockHandle &handle,
+                               const boost::intrusive_ptr<Block> &block) const {
+  CacheStrategy *cache = options_.block_cache;
+  if (!cache)
+    return;
+
+  // A cached block is likely to be searched again.
+  block->BuildRestartPrefixes();
+
+  // The cache holds a reference to the block, which is given back by
+  // ReleaseCachedBlock.
+  intrusive_ptr_add_ref(block.get());
+  char key_buf[kBlockCacheKeyLength];
+  EncodeBlockCacheKey(key_buf, cache_id_, handle.offset);
+  cache->Release(cache->Insert(Slice(key_buf, sizeof(key_buf)), block.get(),
+                               block->Size(), &ReleaseCachedBlock));
+  RecordTick(options_.statistics, kBlockCacheAdd);
+}
+
+TwoLevelIterator::TwoLevelIterator(
+    BlockConstIterator data_it, BlockConstIterator idx_it,
+    const SSTable *table, BlockConstIterator top_it,
+    const boost::intrusive_ptr<const Block> &partition,
+    const ReadOptions &options)
+    : data_iter_(std::move(data_it)),
+      index_iter_(std::move(idx_it)),
+      block_(data_iter_.GetBlock()),
+      top_iter_(std::move(top_it)),
+      partition_(partition),
+      table_(table),
+      read_options_(options),
+      readahead_blocks_(2) {}
+
+TwoLevelIterator::TwoLevelIterator(const SSTable *table,
+                                   const ReadOptions &options, const Status &s)
+    : table_(table), read_options_(options), readahead_blocks_(2),
+      status_(s) {}
+
 Slice TwoLevelIterator::Key() const {
   assert(valid());
-  return data_iter_->Key();
+  return data_iter_.Key();
 }
 
 Slice TwoLevelIterator::Value() const {
   assert(valid());
-  return data_iter_->Value();
+  return data_iter_.Value();
 }
 
 bool TwoLevelIterator::equal(const TwoLevelIterator &other) const {
-  if (!data_iter_ || !other.data_iter_) {  // end() == end()
-    return data_iter_.get() == other.data_iter_.get();
+  if (!valid() || !other.valid()) {  // end() == end()
+    return valid() == other.valid();
   }
-  return *data_iter_ == *other.data_iter_;
+  return data_iter_ == other.data_iter_;
 }
 
 void TwoLevelIterator::increment() {
   assert(valid());
 
-  (*data_iter_)++;
-  if ((*data_iter_) == data_iter_->GetBlock()->end()) {
-    (*index_iter_)++;
-    if ((*index_iter_) == index_iter_->GetBlock()->end()) {
-      // Iff the iterator hits the end, swap it with the end() iterator.
-      TwoLevelIterator tmp;
-      std::swap(*this, tmp);
-    } else {
-      auto block = table_->ObtainBlockByIndexIterator(*index_iter_);
-      TwoLevelIterator tmp(new BlockConstIterator(block->begin()),
-                           new BlockConstIterator(*index_iter_), table_);
-      std::swap(*this, tmp);
+  data_iter_++;
+  if (data_iter_ == block_->end())
+    nextBlock();
+}
+
+void TwoLevelIterator::nextBlock() {
+  index_iter_++;
+  if (index_iter_ == index_iter_.GetBlock()->end()) {
+    // Move on to the next index partition, if any.
+    Status s;
+    boost::intrusive_ptr<Block> partition;
+    if (partition_) {
+      top_iter_++;
+      if (top_iter_ != top_iter_.GetBlock()->end())
+        partition =
+            table_->obtainIndexPartition(top_iter_, read_options_, &s);
+    }
+    if (!partition) {
+      invalidate(s);
+      return;
     }
+    // Blocks are never read ahead across index blocks.
+    assert(readahead_.empty());
+    partition_ = partition;
+    index_iter_ = partition->begin();
   }
+
+  Status s;
+  boost::intrusive_ptr<Block> block;
+  if (!readahead_.empty()) {
+    block = std::move(readahead_.back());
+    readahead_.pop_back();
+  } else {
+    block = table_->readAhead(index_iter_, read_options_, &readahead_blocks_,
+                              &readahead_, &s);
+  }
+  if (!block) {
+    invalidate(s);
+    return;
+  }
+  data_iter_ = block->begin();
+  block_ = block;
 }
 
-// @return false iff the data iterator hits the end.
-inline bool TwoLevelIterator::valid() const {
-  return *this != TwoLevelIterator();
+void TwoLevelIterator::invalidate(const Status &s) {
+  if (!s)
+    status_ = s;
+  data_iter_ = BlockConstIterator();
+  index_iter_ = BlockConstIterator();
+  block_.reset();
+  top_iter_ = BlockConstIterator();
+  partition_.reset();
+  readahead_.clear();
+}
+
+void TwoLevelIterator::Seek(const Slice &key) {
+  assert(table_);
+  const Comparator *cmp = table_->options_.comparator;
+
+  // The key falls inside the current data block if it's greater than some
+  // key of the block, and no greater than the separator in the index.
+  if (valid() && cmp->Compare(key, index_iter_.Key()) <= 0) {
+    auto it = block_->lower_bound(key);
+    if (it != block_->begin()) {
+      data_iter_ = std::move(it);
+      if (data_iter_ == block_->end())
+        nextBlock();
+      return;
+    }
+  }
+
+  // Blocks read ahead are of no use after a jump, so is the error of a
+  // previous search.
+  readahead_.clear();
+  readahead_blocks_ = 2;
+  status_ = Status::OK();
+  Status s;
+
+  PerfTimer index_timer(&perf_context.index_seek_nanos);
+  index_timer.Start();
+  if (!table_->partitioned_index_) {
+    index_iter_ = table_->index_block_->lower_bound(key);
+  } else {
+    // The same goes for the current index partition.
+    bool inside = false;
+    if (partition_ && cmp->Compare(key, top_iter_.Key()) <= 0) {
+      index_iter_ = partition_->lower_bound(key);
+      inside = index_iter_ != partition_->begin();
+    }
+    if (!inside) {
+      const Block *top = table_->index_block_.get();
+      top_iter_ = top->lower_bound(key);
+      if (top_iter_ == top->end()) {
+        invalidate();
+        return;
+      }
+      index_timer.Stop();
+      partition_ =
+          table_->obtainIndexPartition(top_iter_, read_options_, &s);
+      if (!partition_) {
+        invalidate(s);
+        return;
+      }
+      index_timer.Start();
+      index_iter_ = partition_->lower_bound(key);
+    }
+  }
+  index_timer.Stop();
+
+  if (index_iter_ == index_iter_.GetBlock()->end()) {
+    // key > the last key of the table.
+    invalidate();
+    return;
+  }
+  block_ = table_->ObtainBlockByIndexIterator(index_iter_, read_options_, &s);
+  if (!block_) {
+    invalidate(s);
+    return;
+  }
+  data_iter_ = block_->lower_bound(key);
+  if (data_iter_ == block_->end())
+    nextBlock();
 }
 
 }  // namespace lessdb
\ No newline at end of file
@@ -23,21 +23,28 @@
 #pragma once
 
 #include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 #include <boost/intrusive_ptr.hpp>
 
+#include "Block.h"
 #include "Disallowcopying.h"
 #include "IteratorFacade.h"
 #include "Options.h"
+#include "RangeTombstone.h"
 #include "Status.h"
 
 namespace lessdb {
 
 class Options;
 class RandomAccessFile;
-class Block;
-class BlockConstIterator;
+class FilterBlockReader;
 class SSTable;
 class TwoLevelIterator;
+struct BlockContent;
+struct BlockHandle;
 
 using TwoLevelIteratorFacade =
     IteratorFacadeNoValueType<TwoLevelIterator, ForwardIteratorTag, true>;
@@ -48,9 +55,12 @@ class TwoLevelIterator : public TwoLevelIteratorFacade {
   friend class IteratorCoreAccess;
 
  public:
-  TwoLevelIterator(const TwoLevelIterator& rhs);
+  // Both of the block iterators live inline, so constructing, copying or
+  // moving a TwoLevelIterator never allocates, except for copying the key
+  // buffer of a BlockConstIterator.
+  TwoLevelIterator(const TwoLevelIterator&) = default;
 
-  TwoLevelIterator& operator=(const TwoLevelIterator& rhs);
+  TwoLevelIterator& operator=(const TwoLevelIterator&) = default;
 
   TwoLevelIterator(TwoLevelIterator&&) = default;
 
@@ -62,11 +72,35 @@ class TwoLevelIterator : public TwoLevelIteratorFacade {
 
   Slice Value() const;
 
- private:
-  TwoLevelIterator(BlockConstIterator* data_iter,
-                   BlockConstIterator* index_iter, const SSTable* table);
+  // Positions the iterator at the first entry with a key >= "key" in the
+  // table, or at the end if there's none. The current data block and index
+  // partition are reused if "key" falls inside them, e.g. when seeking
+  // forward a short distance, otherwise the table is searched all over.
+  // Unlike SSTable::find, the filter is not consulted.
+  // REQUIRES: the iterator is obtained from an SSTable.
+  // An error reading the table is kept in Stat().
+  void Seek(const Slice& key);
+
+  // The error met reading a block of the table, after which the iterator
+  // is at the end. Each iterator keeps its own, so the readers sharing an
+  // SSTable never see each other's errors.
+  Status Stat() const {
+    return status_;
+  }
 
-  TwoLevelIterator() = default;
+ private:
+  // "top_iter" and "partition" are the entry in the top-level index and the
+  // index partition that "index_iter" points into, iff the index of "table"
+  // is partitioned. The following data blocks are read as told by "options".
+  TwoLevelIterator(BlockConstIterator data_iter, BlockConstIterator index_iter,
+                   const SSTable* table,
+                   BlockConstIterator top_iter = BlockConstIterator(),
+                   const boost::intrusive_ptr<const Block>& partition = nullptr,
+                   const ReadOptions& options = ReadOptions());
+
+  // An iterator at the end of "table", failed by "s" if it's not OK.
+  TwoLevelIterator(const SSTable* table, const ReadOptions& options,
+                   const Status& s = Status());
 
   void increment();
 
@@ -74,13 +108,37 @@ class TwoLevelIterator : public TwoLevelIteratorFacade {
 
   bool equal(const TwoLevelIterator& other) const;
 
-  bool valid() const;
+  bool valid() const {
+    return block_ != nullptr;
+  }
+
+  // Moves to the first entry of the data block next to index_iter_.
+  void nextBlock();
+
+  // Moves to the end, while the table and the read options are kept for
+  // Seek. "s" is kept in status_ if it's not OK.
+  void invalidate(const Status& s = Status());
 
  private:
-  std::unique_ptr<BlockConstIterator> data_iter_;
-  std::unique_ptr<BlockConstIterator> index_iter_;
+  BlockConstIterator data_iter_;
+  BlockConstIterator index_iter_;
   boost::intrusive_ptr<const Block> block_;
+  BlockConstIterator top_iter_;
+  boost::intrusive_ptr<const Block> partition_;
   const SSTable* table_;
+
+  ReadOptions read_options_;
+
+  // The data blocks following the one of index_iter_ in the same index
+  // block, which were read ahead, in reverse order so that the next one is
+  // at the back. @see ReadOptions::readahead_size
+  std::vector<boost::intrusive_ptr<Block>> readahead_;
+
+  // Number of data blocks to be read at once, the next time a data block
+  // has to be read from file.
+  size_t readahead_blocks_;
+
+  Status status_;
 };
 
 // SSTable, short for Sorted String Table, is an on-disk storage format
@@ -109,35 +167,242 @@ class SSTable {
   typedef TwoLevelIterator ConstIterator;
 
   // NOTE: begin() != end() when sstable is empty.
-  // @MayGenerateErrorStatus.
+  // An error reading the table is kept in the Stat() of the iterators
+  // returned by begin, find and lower_bound.
   ConstIterator begin() const;
 
+  // The same as begin(), while the blocks are read as told by "options",
+  // e.g. with readahead for a long scan.
+  ConstIterator begin(const ReadOptions& options) const;
+
   ConstIterator end() const;
 
-  // Searches the record with specified key in data blocks.
-  // @MayGenerateErrorStatus.
+  // Searches the record with specified key in data blocks. If the table has a
+  // filter, the data block is not read when the filter rules the key out.
   ConstIterator find(const Slice& key) const;
 
-  Status Stat() const {
-    return stat_;
+  // The same as find(key), while the blocks are read as told by "options".
+  ConstIterator find(const ReadOptions& options, const Slice& key) const;
+
+  // Returns an iterator to the first entry whose key is not less than "key",
+  // e.g. the newest entry of a user key visible to a snapshot, if the table
+  // is keyed by InternalKeys. Like TwoLevelIterator::Seek, the filter is not
+  // consulted.
+  ConstIterator lower_bound(const ReadOptions& options,
+                            const Slice& key) const;
+
+  // Searches keys[0, n-1] at once, and stores results[i] as if by
+  // find(keys[i]). The keys are sorted and grouped by data block, so that
+  // each data block is looked up in the block cache at most once, and all
+  // the blocks missing from the cache are read from file in one batch (see
+  // RandomAccessFile::MultiRead). Returns the error of the first block
+  // failed to read, the results are then left at the end.
+  Status MultiGet(const Slice* keys, size_t n, ConstIterator* results) const;
+
+  // Reads the data blocks lower_bound(options, keys[i]) starts at into the
+  // block cache, those of keys[0, n-1] that are not cached yet in one batch
+  // (see RandomAccessFile::MultiRead), so that the lookups of a batch of keys
+  // cost about one device round trip rather than one each. Like lower_bound,
+  // the filter is not consulted. Does nothing if the table has no block
+  // cache, or options.fill_cache is false.
+  Status Prefetch(const ReadOptions& options, const Slice* keys,
+                  size_t n) const;
+
+  // Reads the blocks of the table ending at "offsets" (BlockHandle::offset),
+  // data blocks or index partitions, e.g. the blocks of this file found in
+  // the block cache before a restart (see DecodeBlockCacheKey), into the
+  // block cache. The data blocks are read in the order of their offsets, in
+  // batches of RandomAccessFile::MultiRead. Offsets of no block are ignored.
+  // Does nothing if the table has no block cache, or options.fill_cache is
+  // false.
+  Status WarmUp(const ReadOptions& options,
+                std::vector<uint64_t> offsets) const;
+
+  // Returns the id the keys of this table's blocks in the block cache are
+  // prefixed with, allocated when the table is opened, 0 if the table has no
+  // block cache.
+  uint64_t BlockCacheId() const {
+    return cache_id_;
   }
 
-  // @MayGenerateErrorStatus.
-  Block* ObtainBlockByIndexIterator(const BlockConstIterator& it) const;
+  // Parses "key", the key of a block in a block cache, into the id of the
+  // table the block is of and the offset of the block. Returns false if
+  // "key" is not in the format of the keys of the tables.
+  static bool DecodeBlockCacheKey(const Slice& key, uint64_t* cache_id,
+                                  uint64_t* offset);
+
+  // Returns false iff the table definitely has no key >= "key" with the
+  // prefix of "key", extracted by options.prefix_extractor: the filters of
+  // the data blocks such keys would be in all rule the prefix out. Returns
+  // true if the table has no filter of the prefixes by that extractor, or
+  // "key" has no prefix. Only the index and the filter are read, an index
+  // partition failed to read is taken as a match, the error is met again by
+  // the search that follows.
+  bool PrefixMayMatch(const ReadOptions& options, const Slice& key) const;
+
+  // The range tombstones of the table, added by
+  // SSTableBuilder::AddRangeTombstone, read when the table is opened.
+  const std::vector<RangeTombstone>& RangeTombstones() const {
+    return range_tombstones_;
+  }
+
+  // The range tombstones fragmented by "user_comparator", the comparator of
+  // the user keys of the table, or NULL if the table has none. Fragmented by
+  // the first call, and shared by the later ones.
+  std::shared_ptr<const FragmentedRangeTombstones> FragmentedTombstones(
+      const Comparator* user_comparator) const;
+
+  // The memory held by the open table: its index block, or top-level index,
+  // its filter and its range tombstones. The blocks in the block cache are
+  // not counted.
+  size_t ApproximateMemoryUsage() const { return memory_usage_; }
+
+  // Appends the keys of the index block to *keys, in increasing order. Each
+  // of them separates a data block (or an index partition, if the index is
+  // partitioned) from the next one, which makes them split points of the
+  // table into ranges of about a block each. Nothing is read from file.
+  void IndexKeys(std::vector<std::string>* keys) const;
 
-  SSTable() = default;
+  // Returns the data block pointed by the index iterator, the block is read
+  // from the block cache if it's cached, otherwise from the compressed block
+  // cache or from file, and then inserted into the block cache unless
+  // options.fill_cache is false. Returns NULL, and stores the error in *s,
+  // if the block fails to be read.
+  boost::intrusive_ptr<Block> ObtainBlockByIndexIterator(
+      const BlockConstIterator& it, const ReadOptions& options,
+      Status* s) const;
+
+  SSTable();
+
+  ~SSTable();
 
  public:
   const Block* TEST_GetIndexBlock() const;
 
+ private:
+  // Read the compression dictionary, the filter block and the range
+  // tombstone block pointed by the meta index block.
+  Status readMetaIndex(const BlockHandle& meta_index_handle);
+
+  // Read the range tombstone block pointed by "it", an entry of the meta
+  // index block, into range_tombstones_.
+  Status readRangeTombstones(const BlockConstIterator& it);
+
+  // Read the filter block pointed by "meta", errors are ignored since the
+  // filter is not necessary for reading the table. Sets prefix_filtered_ if
+  // the filter holds the prefixes by options_.prefix_extractor.
+  void readFilter(const Block* meta);
+
+  // Returns whether the filter rules out "key" from the data block
+  // identified by "handle".
+  bool filteredOut(const BlockHandle& handle, const Slice& key) const;
+
+  // Returns the data block identified by "handle" in the block cache, or NULL
+  // if it's not cached.
+  boost::intrusive_ptr<Block> lookupBlockCache(const BlockHandle& handle) const;
+
+  // Inserts the data block identified by "handle" into the block cache.
+  void insertBlockCache(const BlockHandle& handle,
+                        const boost::intrusive_ptr<Block>& block) const;
+
+  // Returns the data block identified by "handle" uncompressed from the
+  // compressed block cache, which is then inserted into the block cache if
+  // options.fill_cache is set. Returns NULL if it's not cached, or fails to
+  // be uncompressed, with the error stored in *s.
+  boost::intrusive_ptr<Block> lookupCompressedBlockCache(
+      const BlockHandle& handle, const Slice& dict,
+      const ReadOptions& options, Status* s) const;
+
+  // Inserts "data", the stored contents of the data block identified by
+  // "handle", compressed by "type", into the compressed block cache.
+  void insertCompressedBlockCache(const BlockHandle& handle, const Slice& data,
+                                  CompressionType type) const;
+
+  // Returns the block of "*content" read from file, which is stored
+  // compressed by "type" and "dict". Unless options.fill_cache is false, the
+  // block is inserted into the block cache, and into the compressed block
+  // cache if it is compressed. Returns NULL if it fails to be uncompressed,
+  // with the error stored in *s.
+  boost::intrusive_ptr<Block> newBlock(const BlockHandle& handle,
+                                       BlockContent* content,
+                                       CompressionType type, const Slice& dict,
+                                       const ReadOptions& options,
+                                       Status* s) const;
+
+  // Returns the block identified by "handle" from the caches, or from file.
+  // "dict" is the compression dictionary of the block. Returns NULL, and
+  // stores the error in *s, if it fails to be read.
+  boost::intrusive_ptr<Block> obtainBlock(const BlockHandle& handle,
+                                          const Slice& dict,
+                                          const ReadOptions& options,
+                                          Status* s) const;
+
+  // Reads the data blocks identified by handles[0, n-1] from file in one
+  // batch (see RandomAccessFile::MultiRead), and stores them in blocks[i].
+  // Returns the error of the first block failed to read.
+  Status readBlocks(const BlockHandle* handles, size_t n,
+                    const ReadOptions& options,
+                    boost::intrusive_ptr<Block>* blocks) const;
+
+  // Returns the data block pointed by the index iterator as
+  // ObtainBlockByIndexIterator does. If the block has to be read from file
+  // and options.readahead_size is set, up to "*num_blocks" - 1 following
+  // blocks of the same index block, which are not cached, are read along
+  // with it and stored in "*readahead" in reverse order. "*num_blocks" is
+  // then doubled if the window was not bounded by options.readahead_size.
+  // Returns NULL, and stores the error in *s, if the block fails to be read.
+  // REQUIRES: readahead->empty()
+  boost::intrusive_ptr<Block> readAhead(
+      const BlockConstIterator& it, const ReadOptions& options,
+      size_t* num_blocks,
+      std::vector<boost::intrusive_ptr<Block>>* readahead, Status* s) const;
+
+  // Decodes the data block handle of the index entry "it", which is
+  // delta-encoded past its restart point in a table of
+  // kDeltaEncodedIndexKey.
+  Status decodeIndexHandle(const BlockConstIterator& it,
+                           BlockHandle* handle) const;
+
+  // Returns the index partition pointed by the top-level index iterator, or
+  // NULL, with the error stored in *s, if it fails to be read.
+  boost::intrusive_ptr<Block> obtainIndexPartition(
+      const BlockConstIterator& top_it, const ReadOptions& options,
+      Status* s) const;
+
  private:
   // Rather than holding the entire bunch of data blocks, an SSTable only keeps
-  // the index block.
+  // the index block. If partitioned_index_ is set, it's the top-level index
+  // of the index partitions, which are read like the data blocks.
   RandomAccessFile* file_;
   std::unique_ptr<Block> index_block_;
+  bool partitioned_index_;
+  bool delta_encoded_index_;
   Options options_;
 
-  mutable Status stat_;
+  // Filter of the data blocks, NULL if the table has no filter block built by
+  // options_.filter_strategy.
+  std::unique_ptr<FilterBlockReader> filter_;
+  std::unique_ptr<const char[]> filter_data_;  // non-NULL if heap allocated
+  bool prefix_filtered_;
+
+  std::vector<RangeTombstone> range_tombstones_;
+  mutable std::once_flag fragmented_once_;
+  mutable std::shared_ptr<const FragmentedRangeTombstones> fragmented_;
+
+  // The zstd dictionary of the data blocks, empty if they are compressed
+  // without one. @see Options::zstd_max_dict_bytes
+  std::string compression_dict_;
+
+  // Prefix of the keys of this table's blocks in options_.block_cache,
+  // allocated once by CacheStrategy::NewId() when the table is opened.
+  uint64_t cache_id_;
+
+  // Prefix of the keys of this table's blocks in
+  // options_.block_cache_compressed.
+  uint64_t compressed_cache_id_;
+
+  // @see ApproximateMemoryUsage
+  size_t memory_usage_;
 };
 
 }  // namespace lessdb
@@ -22,15 +22,31 @@
 
 #pragma once
 
-#include <boost/crc.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "Disallowcopying.h"
 #include "Status.h"
 #include "Options.h"
 #include "FileUtils.h"
 #include "BlockBuilder.h"
+#include "FilterBlock.h"
+#include "FilterStrategy.h"
+#include "InternalKey.h"
+#include "PrefixExtractor.h"
 #include "TableFormat.h"
 #include "Comparator.h"
+#include "Compression.h"
+#include "Crc32c.h"
+#include "DataView.h"
 
 namespace lessdb {
 
@@ -43,12 +59,34 @@ class SSTableBuilder {
   // building in *file. Does not close the file.  It is up to the
   // caller to close the file after calling Finish().
   SSTableBuilder(const Options *options, WritableFile *file)
-      : data_block_(options),
-        index_block_(options),
+      : data_block_(options, options->block_restart_interval,
+                    options->data_block_hash_ratio),
+        index_block_(options, options->index_block_restart_interval),
         options_(options),
         file_(file),
+        offset_(0),
         pending_index_entry_(false),
-        num_entries_(0) {}
+        num_entries_(0),
+        num_partition_entries_(0),
+        buffering_(options->compression == kZstdCompression &&
+                   options->zstd_max_dict_bytes > 0 &&
+                   compression::IsSupported(kZstdCompression)),
+        buffered_bytes_(0),
+        pipelined_(options->parallel_compression_threads > 0),
+        num_pipelined_(0),
+        pipeline_size_(0),
+        written_any_(false),
+        stopping_(false) {
+    if (options->filter_strategy) {
+      filter_block_.reset(new FilterBlockBuilder(options->filter_strategy,
+                                                 options->prefix_extractor));
+      filter_block_->StartBlock(0);
+    }
+  }
+
+  ~SSTableBuilder() {
+    stopPipeline();
+  }
 
   // Add key,value to the table being constructed.
   // REQUIRES: key is after any previously added key according to comparator.
@@ -58,14 +96,19 @@ class SSTableBuilder {
       // after a flush of data block
       // append new index entry
       options_->comparator->FindShortestSeparator(&last_key_, key);
-      // pending_handle_.offset now points at index block (updated by
-      // writeBlock), with pending_handle_.size indicating the size of the
-      // previous data_block.
-      std::string index_value = pending_handle_.EncodeToString();
-      index_block_.Add(last_key_, index_value);
+      // pending_handle_ now points at the previous data block.
+      addIndexEntry(last_key_);
       pending_index_entry_ = false;
     }
 
+    if (buffering_ || pipelined_) {
+      // The keys are added to the filter and the index once the block is
+      // written.
+      buffered_keys_.push_back(key.ToString());
+    } else if (filter_block_) {
+      filter_block_->AddKey(key);
+    }
+
     num_entries_++;
     data_block_.Add(key, value);
     last_key_.assign(key.RawData(), key.Len());
@@ -76,31 +119,158 @@ class SSTableBuilder {
     return Status::OK();
   }
 
+  // Adds a range tombstone deleting the user keys in [begin, end) older than
+  // "sequence" to the range tombstone block, which is written by Finish().
+  // The tombstones may be added in any order, before or after the keys.
+  // REQUIRES: The table is keyed by InternalKeys.
+  void AddRangeTombstone(const Slice &begin, const Slice &end,
+                         SequenceNumber sequence) {
+    range_tombstones_.emplace_back(
+        InternalKeyBuf(begin, sequence, kTypeRangeDeletion).Data().ToString(),
+        end.ToString());
+  }
+
+  size_t NumRangeTombstones() const {
+    return range_tombstones_.size();
+  }
+
   Status Finish() {
-    // flush the last data block
-    Status s = flush();
-    if (!s)
-      return s;
+    // flush the last data block, unless it has just been flushed by Add.
+    // An empty table still has an empty data block.
+    Status s;
+    if (buffering_) {
+      if (buffered_.empty() || !buffered_keys_.empty()) {
+        s = flush();
+        if (!s)
+          return s;
+      }
+      s = stopBuffering();
+      if (!s)
+        return s;
+    } else if (pipelined_) {
+      if (num_pipelined_ == 0 || !buffered_keys_.empty()) {
+        s = flush();
+        if (!s)
+          return s;
+      }
+    } else if (!pending_index_entry_) {
+      s = flush();
+      if (!s)
+        return s;
+    }
+    if (pipelined_) {
+      // The index entry of the last data block is left pending by the
+      // writer thread.
+      s = drainPipeline();
+      if (!s)
+        return s;
+    }
 
     // recording the index information of the last data block
+    options_->comparator->FindShortSuccessor(&last_key_);
+    addIndexEntry(last_key_);
+
+    Footer footer;
+
+    // write the index partitions, which are pointed by the top-level index
+    // written as the index block.
+    // top-level index := (last key in partition, partition_handle)*
+    bool partitioned = options_->index_partition_size > 0;
+    BlockBuilder top_index_block(options_,
+                                 options_->index_block_restart_interval);
+    if (partitioned) {
+      if (num_partition_entries_ > 0)
+        cutIndexPartition();
+      for (const auto &partition : index_partitions_) {
+        BlockHandle partition_handle;
+        s = writeBlock(partition.second, Slice(), &partition_handle);
+        if (!s)
+          return s;
+        top_index_block.Add(partition.first,
+                            partition_handle.EncodeToString());
+      }
+      index_partitions_.clear();
+    }
 
-    if (!last_key_.empty() &&
-        last_key_.back() < std::numeric_limits<char>::max())
-      last_key_.back() = static_cast<char>(last_key_.back() + 1);
-    else
-      last_key_.push_back('a');
+    // write the range tombstone block, sorted by the begin keys.
+    // rangedel := (InternalKey(begin, sequence, kTypeRangeDeletion), end)*
+    BlockHandle range_del_handle;
+    if (!range_tombstones_.empty()) {
+      const Comparator *cmp = options_->comparator;
+      auto less = [cmp](const std::pair<std::string, std::string> &a,
+                        const std::pair<std::string, std::string> &b) {
+        return cmp->Compare(a.first, b.first) < 0;
+      };
+      std::sort(range_tombstones_.begin(), range_tombstones_.end(), less);
+      BlockBuilder range_del_block(options_);
+      for (size_t i = 0; i < range_tombstones_.size(); i++) {
+        // Tombstones of the same begin key and sequence are the same.
+        if (i > 0 && !less(range_tombstones_[i - 1], range_tombstones_[i]))
+          continue;
+        range_del_block.Add(range_tombstones_[i].first,
+                            range_tombstones_[i].second);
+      }
+      s = writeBlock(range_del_block.Finish(), Slice(), &range_del_handle);
+      if (!s)
+        return s;
+    }
 
-    index_block_.Add(last_key_, pending_handle_.EncodeToString());
+    // write the compression dictionary and the filter block, and the meta
+    // index block that points at them.
+    // metaindex := (kCompressionDictKey, dict_handle)?
+    //              ("filter." filter_strategy->Name(), filter_handle)?
+    //              (kDeltaEncodedIndexKey, "")
+    //              (kPartitionedIndexKey, "")?
+    //              ("prefix." prefix_extractor->Name(), "")?
+    //              (kRangeDelBlockKey, range_del_handle)?
+    BlockBuilder meta_index_block(options_);
+    if (!dict_.empty()) {
+      BlockHandle dict_handle;
+      s = writeRawBlock(dict_, kNoCompression, &dict_handle);
+      if (!s)
+        return s;
+      meta_index_block.Add(kCompressionDictKey, dict_handle.EncodeToString());
+    }
+    if (filter_block_) {
+      BlockHandle filter_handle;
+      s = writeRawBlock(filter_block_->Finish(), kNoCompression,
+                        &filter_handle);
+      if (!s)
+        return s;
+
+      std::string key = "filter.";
+      key.append(options_->filter_strategy->Name());
+      meta_index_block.Add(key, filter_handle.EncodeToString());
+    }
+    meta_index_block.Add(kDeltaEncodedIndexKey, Slice());
+    if (partitioned) {
+      meta_index_block.Add(kPartitionedIndexKey, Slice());
+    }
+    if (filter_block_ && options_->prefix_extractor) {
+      std::string key = "prefix.";
+      key.append(options_->prefix_extractor->Name());
+      meta_index_block.Add(key, Slice());
+    }
+    if (!range_tombstones_.empty()) {
+      meta_index_block.Add(kRangeDelBlockKey,
+                           range_del_handle.EncodeToString());
+    }
+    s = writeBlock(meta_index_block.Finish(), Slice(),
+                   &footer.mataindex_handle);
+    if (!s)
+      return s;
 
     // write index block
-    s = writeBlock(&index_block_);
+    BlockBuilder *index_block = partitioned ? &top_index_block : &index_block_;
+    s = writeBlock(index_block->Finish(), Slice(), &footer.index_handle);
     if (!s)
       return s;
 
     // write footer
-    Footer footer;
-    footer.index_handle = pending_handle_;
-    s = file_->Append(footer.EncodeToString());
+    std::string footer_buf = footer.EncodeToString();
+    s = file_->Append(footer_buf);
+    if (s)
+      offset_ += footer_buf.size();
     return s;
   }
 
@@ -108,60 +278,339 @@ class SSTableBuilder {
     return num_entries_;
   }
 
+  // Size of the file generated so far. If invoked after a successful
+  // Finish() call, returns the size of the final generated file. While the
+  // data blocks are pipelined, the ones not written yet are counted
+  // uncompressed.
+  uint64_t FileSize() const {
+    if (pipelined_)
+      return pipeline_size_.load(std::memory_order_relaxed);
+    return offset_;
+  }
+
  private:
   // Flush the building data block to file.
   // pending_index_entry_ will be updated.
   Status flush() {
-    Status s = writeBlock(&data_block_);
+    if (buffering_) {
+      BufferedBlock block;
+      block.contents = data_block_.Finish().ToString();
+      block.keys.swap(buffered_keys_);
+      buffered_bytes_ += block.contents.size();
+      buffered_.push_back(std::move(block));
+      data_block_.Reset();
+      if (buffered_bytes_ >=
+          options_->zstd_max_dict_bytes * kDictSamplesPerDictByte) {
+        return stopBuffering();
+      }
+      return Status::OK();
+    }
+    if (pipelined_) {
+      Status s = pushBlock(data_block_.Finish().ToString(), &buffered_keys_);
+      data_block_.Reset();
+      return s;
+    }
+
+    Status s = writeBlock(data_block_.Finish(), dict_, &pending_handle_);
     if (!s)
       return s;
     pending_index_entry_ = true;
     data_block_.Reset();
+    if (filter_block_) {
+      filter_block_->StartBlock(offset_);
+    }
     return Status::OK();
   }
 
-  // pending_handle will be updated.
-  Status writeBlock(BlockBuilder *block) {
-    // Each block is followed by a trailer in the format of:
-    //     compression_type: uint8
-    //     crc:              uint32
+  // Adds the index entry of the data block pointed by pending_handle_, and
+  // cuts the index partition once it's full. The data blocks are stored one
+  // after another, so the handle is delta-encoded past a restart point.
+  void addIndexEntry(const std::string &key) {
+    index_block_.Add(key, pending_handle_.EncodeToString(),
+                     pending_handle_.EncodeDeltaToString());
+    if (options_->index_partition_size > 0) {
+      last_index_key_ = key;
+      num_partition_entries_++;
+      if (index_block_.Size() >= options_->index_partition_size)
+        cutIndexPartition();
+    }
+  }
 
-    Status s;
+  // The partitions are kept in memory and written by Finish(), after all the
+  // data blocks, whose offsets are laid out for the filter as they are
+  // written.
+  void cutIndexPartition() {
+    index_partitions_.emplace_back(last_index_key_,
+                                   index_block_.Finish().ToString());
+    index_block_.Reset();
+    num_partition_entries_ = 0;
+  }
 
-    // process block data
-    Slice block_buf = block->Finish();
-    s = file_->Append(block_buf);
-    if (!s)
-      return s;
+  // Trains the compression dictionary on the buffered data blocks, and
+  // writes them out along with their filter and index entries, the index
+  // entry of the last one is left pending.
+  Status stopBuffering() {
+    assert(buffering_);
+    buffering_ = false;
+
+    std::string samples;
+    std::vector<size_t> sizes;
+    samples.reserve(buffered_bytes_);
+    for (const BufferedBlock &block : buffered_) {
+      samples.append(block.contents);
+      sizes.push_back(block.contents.size());
+    }
+    dict_ = compression::TrainDictionary(samples, sizes,
+                                         options_->zstd_max_dict_bytes);
+
+    if (pipelined_) {
+      for (BufferedBlock &block : buffered_) {
+        Status s = pushBlock(std::move(block.contents), &block.keys);
+        if (!s)
+          return s;
+      }
+      buffered_.clear();
+      return Status::OK();
+    }
+
+    for (size_t i = 0; i < buffered_.size(); i++) {
+      const BufferedBlock &block = buffered_[i];
+      if (i > 0) {
+        std::string separator = buffered_[i - 1].keys.back();
+        options_->comparator->FindShortestSeparator(&separator,
+                                                    block.keys.front());
+        addIndexEntry(separator);
+      }
+      if (filter_block_) {
+        for (const std::string &key : block.keys)
+          filter_block_->AddKey(key);
+      }
 
-    // process trailer
+      Status s = writeBlock(block.contents, dict_, &pending_handle_);
+      if (!s)
+        return s;
+      if (filter_block_) {
+        filter_block_->StartBlock(offset_);
+      }
+    }
+    pending_index_entry_ = !buffered_.empty();
+    buffered_.clear();
+    return Status::OK();
+  }
+
+  // Compresses "raw" by options->compression into *compressed, unless it
+  // doesn't save at least 1/8 of the space. Returns the type the block is to
+  // be stored with, kNoCompression if it's to be stored as "raw".
+  static CompressionType compressBlock(const Options *options,
+                                       const Slice &dict, const Slice &raw,
+                                       std::string *compressed) {
+    CompressionType type = options->compression;
+    if (type != kNoCompression &&
+        !(compression::Compress(type, options->compression_level, dict, raw,
+                                compressed) &&
+          compressed->size() < raw.Len() - raw.Len() / 8)) {
+      type = kNoCompression;
+    }
+    return type;
+  }
+
+  // Each block is followed by a trailer in the format of:
+  //     compression_type: uint8
+  //     crc:              uint32
+  static void encodeTrailer(const Slice &block_buf, CompressionType type,
+                            char *trailer) {
+    trailer[0] = static_cast<char>(kBlockTrailerCrc32cFlag | type);
+    DataView(trailer + sizeof(uint8_t))
+        .WriteNum(crc32c::Value(block_buf.RawData(), block_buf.Len()));
+  }
+
+  // Compresses the block by options_->compression and writes it out.
+  Status writeBlock(const Slice &raw, const Slice &dict, BlockHandle *handle) {
+    CompressionType type = compressBlock(options_, dict, raw, &compressed_);
+    return writeRawBlock(type == kNoCompression ? raw : Slice(compressed_),
+                         type, handle);
+  }
+
+  // handle will be updated.
+  Status writeRawBlock(const Slice &block_buf, CompressionType type,
+                       BlockHandle *handle) {
     char trailer[kBlockTrailerSize];
-    boost::crc_32_type crc;
-    crc.process_bytes(block_buf.RawData(), block_buf.Len());
-    DataView(trailer + sizeof(uint8_t)).WriteNum(crc.checksum());
+    encodeTrailer(block_buf, type, trailer);
+    return appendBlock(block_buf, trailer, handle);
+  }
+
+  // Writes out the block and its trailer, handle will be updated.
+  Status appendBlock(const Slice &block_buf, const char *trailer,
+                     BlockHandle *handle) {
+    Status s = file_->Append(block_buf);
+    if (!s)
+      return s;
     s = file_->Append(Slice(trailer, kBlockTrailerSize));
     if (!s)
       return s;
 
+    // handle->offset points at the end of the block.
     uint64_t block_size_with_trailer = block_buf.Len() + kBlockTrailerSize;
-    pending_handle_.size = block_size_with_trailer;
-    pending_handle_.offset += block_size_with_trailer;
-    //    fprintf(stderr, "pending handle size: %llu, offset %llu\n",
-    //            pending_handle_.size, pending_handle_.offset);
+    offset_ += block_size_with_trailer;
+    handle->size = block_size_with_trailer;
+    handle->offset = offset_;
 
     return Status::OK();
   }
 
+  // Hands the data block "contents" of the keys *keys over to the pipeline,
+  // which is started by the first block. Waits while the pipeline is full.
+  // Returns the error of the writer thread, if any.
+  Status pushBlock(std::string contents, std::vector<std::string> *keys) {
+    if (workers_.empty())
+      startPipeline();
+
+    std::unique_ptr<PipelinedBlock> block(new PipelinedBlock);
+    block->contents = std::move(contents);
+    block->keys.swap(*keys);
+    block->compressed_done = false;
+    block->raw_size = block->contents.size() + kBlockTrailerSize;
+    pipeline_size_.fetch_add(block->raw_size, std::memory_order_relaxed);
+    num_pipelined_++;
+
+    std::unique_lock<std::mutex> lock(pipeline_mu_);
+    space_cv_.wait(lock, [this] {
+      return to_write_.size() < 2 * workers_.size() + 2;
+    });
+    to_compress_.push_back(block.get());
+    to_write_.push_back(std::move(block));
+    work_cv_.notify_one();
+    return pipeline_status_;
+  }
+
+  void startPipeline() {
+    const int n = options_->parallel_compression_threads;
+    for (int i = 0; i < n; i++)
+      workers_.emplace_back(&SSTableBuilder::compressWork, this);
+    writer_ = std::thread(&SSTableBuilder::writeWork, this);
+  }
+
+  // Waits until the writer thread has written every block pushed, and stops
+  // the pipeline. Returns the error of the writer thread, if any.
+  Status drainPipeline() {
+    {
+      std::unique_lock<std::mutex> lock(pipeline_mu_);
+      space_cv_.wait(lock, [this] { return to_write_.empty(); });
+    }
+    stopPipeline();
+    pipelined_ = false;
+    pending_index_entry_ = num_pipelined_ > 0;
+    return pipeline_status_;
+  }
+
+  void stopPipeline() {
+    {
+      std::lock_guard<std::mutex> guard(pipeline_mu_);
+      stopping_ = true;
+    }
+    work_cv_.notify_all();
+    write_cv_.notify_all();
+    for (std::thread &t : workers_)
+      t.join();
+    workers_.clear();
+    if (writer_.joinable())
+      writer_.join();
+  }
+
+  // The body of the worker threads.
+  void compressWork() {
+    std::unique_lock<std::mutex> lock(pipeline_mu_);
+    while (true) {
+      work_cv_.wait(lock,
+                    [this] { return stopping_ || !to_compress_.empty(); });
+      if (stopping_)
+        break;
+      PipelinedBlock *block = to_compress_.front();
+      to_compress_.pop_front();
+      lock.unlock();
+
+      block->type = compressBlock(options_, dict_, block->contents,
+                                  &block->compressed);
+      if (block->type == kNoCompression)
+        block->compressed.swap(block->contents);
+      block->contents.clear();
+      encodeTrailer(block->compressed, block->type, block->trailer);
+
+      lock.lock();
+      block->compressed_done = true;
+      write_cv_.notify_one();
+    }
+  }
+
+  // The body of the writer thread, which writes the blocks in the order
+  // they're pushed, and adds the filter and index entries of each once its
+  // handle is known.
+  void writeWork() {
+    std::unique_lock<std::mutex> lock(pipeline_mu_);
+    while (true) {
+      write_cv_.wait(lock, [this] {
+        return stopping_ ||
+               (!to_write_.empty() && to_write_.front()->compressed_done);
+      });
+      if (stopping_)
+        break;
+      PipelinedBlock *block = to_write_.front().get();
+      Status s = pipeline_status_;
+      lock.unlock();
+
+      if (s) {
+        if (written_any_ && !block->keys.empty()) {
+          // pending_handle_ points at the previous data block.
+          std::string separator = written_last_key_;
+          options_->comparator->FindShortestSeparator(&separator,
+                                                      block->keys.front());
+          addIndexEntry(separator);
+        }
+        if (filter_block_) {
+          for (const std::string &key : block->keys)
+            filter_block_->AddKey(key);
+        }
+        s = appendBlock(block->compressed, block->trailer, &pending_handle_);
+        if (s) {
+          if (filter_block_)
+            filter_block_->StartBlock(offset_);
+          if (!block->keys.empty()) {
+            written_last_key_ = block->keys.back();
+            written_any_ = true;
+          }
+          pipeline_size_.fetch_add(
+              block->compressed.size() + kBlockTrailerSize - block->raw_size,
+              std::memory_order_relaxed);
+        }
+      }
+
+      lock.lock();
+      if (!s && pipeline_status_)
+        pipeline_status_ = s;
+      to_write_.pop_front();
+      space_cv_.notify_all();
+    }
+  }
+
  public:
   Block *TEST_GetIndexBlock();
 
  private:
   // In use:
   // Options::block_size
+  // Options::index_block_restart_interval
+  // Options::data_block_hash_ratio
+  // Options::filter_strategy
+  // Options::compression
+  // Options::compression_level
+  // Options::zstd_max_dict_bytes
+  // Options::index_partition_size
   const Options *options_;
   BlockBuilder data_block_;
   BlockBuilder index_block_;
+  std::unique_ptr<FilterBlockBuilder> filter_block_;
   WritableFile *file_;
+  uint64_t offset_;  // Current size of the file.
   std::string last_key_;
 
   // We do not emit the index entry for a block until we have seen the
@@ -176,7 +625,70 @@ class SSTableBuilder {
   bool pending_index_entry_;
   BlockHandle pending_handle_;  // Handle to add to index block
 
+  // With Options::index_partition_size, index_block_ is the partition being
+  // built, the finished ones are kept as (last key, contents).
+  std::vector<std::pair<std::string, std::string>> index_partitions_;
+  std::string last_index_key_;
+  size_t num_partition_entries_;
+
   size_t num_entries_;
+
+  // (InternalKey(begin, sequence, kTypeRangeDeletion), end) of the range
+  // tombstones, in the order they are added.
+  std::vector<std::pair<std::string, std::string>> range_tombstones_;
+
+  // The dictionary is trained on the first data blocks, which are held in
+  // memory until the samples add up to this many times the dictionary size.
+  static const size_t kDictSamplesPerDictByte = 100;
+
+  struct BufferedBlock {
+    std::string contents;
+    std::vector<std::string> keys;
+  };
+
+  // True while the data blocks are buffered to train the dictionary.
+  bool buffering_;
+  size_t buffered_bytes_;
+  std::vector<BufferedBlock> buffered_;
+  std::vector<std::string> buffered_keys_;  // keys of the building block
+
+  std::string dict_;  // compression dictionary of the data blocks
+  std::string compressed_;  // scratch of writeBlock
+
+  // With Options::parallel_compression_threads, the finished data blocks
+  // pass from the caller through to_compress_, served by workers_ in any
+  // order, and to_write_, served by writer_ in order. While pipelined_, the
+  // filter, the index and offset_ belong to the writer thread.
+  struct PipelinedBlock {
+    std::string contents;  // The raw block, cleared once compressed.
+    std::vector<std::string> keys;
+    std::string compressed;  // Or the raw block if type is kNoCompression.
+    CompressionType type;
+    char trailer[kBlockTrailerSize];
+    uint64_t raw_size;  // Counted by pipeline_size_ until it's written.
+    bool compressed_done;
+  };
+
+  bool pipelined_;
+  size_t num_pipelined_;
+  // FileSize() while pipelined_, counting the blocks not written yet
+  // uncompressed.
+  std::atomic<uint64_t> pipeline_size_;
+  // The last key of the last data block written by the writer thread.
+  std::string written_last_key_;
+  bool written_any_;
+
+  // Protects the following states.
+  std::mutex pipeline_mu_;
+  std::deque<PipelinedBlock *> to_compress_;
+  std::deque<std::unique_ptr<PipelinedBlock>> to_write_;
+  std::condition_variable work_cv_;   // to_compress_ is not empty
+  std::condition_variable write_cv_;  // a block is compressed
+  std::condition_variable space_cv_;  // a block is written
+  Status pipeline_status_;  // The error of the writer thread.
+  bool stopping_;
+  std::vector<std::thread> workers_;
+  std::thread writer_;
 };
 
-}  // namespace lessdb
\ No newline at end of file
+}  // namespace lessdb
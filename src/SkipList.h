@@ -24,9 +24,12 @@
 
 #include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <folly/Arena.h>
 #include <functional>
 #include <random>
+#include <type_traits>
+#include <utility>
 
 #include "Disallowcopying.h"
 #include "IteratorFacade.h"
@@ -35,6 +38,25 @@ namespace lessdb {
 
 using folly::SysArena;
 
+namespace detail {
+
+// HasKeyPrefix<Compare, T>::value is true iff Compare has a member function
+// "uint64_t KeyPrefix(const T &) const".
+template <class Compare, class T> class HasKeyPrefix {
+  template <class C>
+  static auto test(int) -> decltype(
+      static_cast<uint64_t>(std::declval<const C &>().KeyPrefix(
+          std::declval<const T &>())),
+      std::true_type());
+
+  template <class C> static std::false_type test(...);
+
+ public:
+  static const bool value = decltype(test<Compare>(0))::value;
+};
+
+}  // namespace detail
+
 /**
  * SkipLists are a probabilistic balanced data structure.
  * This implementation is based on the paper
@@ -50,13 +72,21 @@ using folly::SysArena;
  *  == 0 iff a == b,
  *  > 0 iff a > b
  *
+ * Optionally, Compare may provide "uint64_t KeyPrefix(const T &key) const",
+ * an order-preserving summary of a key: KeyPrefix(a) < KeyPrefix(b) must
+ * imply a < b. Each node caches the prefix of its key next to its forward
+ * pointers, and searches call Compare only when the prefixes tie, so that
+ * most of the nodes visited are resolved without dereferencing their keys.
+ *
  * SkipList is designed to be used in the situations where only single writer is
- * running, with multiple readers reading concurrently.
+ * running, with multiple readers reading concurrently. Alternatively, multiple
+ * writers may insert through InsertConcurrently at the same time, as long as
+ * Insert is not called meanwhile, and Arena::allocate is thread-safe.
  *
  * SkipList is the internal data structure of MemTable.
  *
  */
-template <class T, class Compare> class SkipList {
+template <class T, class Compare, class Arena = SysArena> class SkipList {
   __DISALLOW_COPYING__(SkipList);
 
  public:
@@ -67,6 +97,8 @@ template <class T, class Compare> class SkipList {
 
   static const unsigned kMaxLevel = 12;
 
+  static const bool kHasKeyPrefix = detail::HasKeyPrefix<Compare, T>::value;
+
   using ConstIteratorFacade =
       IteratorFacade<ConstIterator, T, ForwardIteratorTag, true>;
 
@@ -106,13 +138,19 @@ template <class T, class Compare> class SkipList {
   };
 
  public:
-  explicit SkipList(SysArena *arena, const Compare &compare = Compare());
+  explicit SkipList(Arena *arena, const Compare &compare = Compare());
 
   // Insert does not require external synchronization with
   // only single writer running, it's safe with concurrent
   // readers.
   ConstIterator Insert(const T &key);
 
+  // Like Insert, but safe with other writers calling InsertConcurrently at
+  // the same time. Nodes are linked with CAS on their forward pointers, and
+  // a writer losing a race re-searches only the level it lost on.
+  // REQUIRES: No concurrent calls to Insert.
+  ConstIterator InsertConcurrently(const T &key);
+
   bool Empty() const noexcept {
     return Begin() == End();
   }
@@ -144,12 +182,61 @@ template <class T, class Compare> class SkipList {
 
   int random();
 
-  Node *createNode(const T &key, int height) {
+  // Same distribution as randomLevel, with a generator owned by the calling
+  // thread.
+  static int randomLevelConcurrently();
+
+  // Starting from "before", which is less than key, find the last node prev at
+  // level whose key < key, and set *out_prev = prev, *out_next = prev->next.
+  // prefix is keyPrefix(key).
+  void findSpliceForLevel(const T &key, uint64_t prefix, Node *before,
+                          int level, Node **out_prev, Node **out_next) const;
+
+  // Starting from x, which is head_ or less than key, returns the last node
+  // at level whose key < key, and sets *out_next to its successor at level.
+  // prefix is keyPrefix(key).
+  Node *findLessThanAtLevel(Node *x, const T &key, uint64_t prefix, int level,
+                            Node **out_next) const;
+
+  // Returns n->key < key.
+  bool nodeLess(const Node *n, const T &key, uint64_t prefix) const {
+    if (kHasKeyPrefix && n->prefix != prefix)
+      return n->prefix < prefix;
+    return compare_(n->key, key) < 0;
+  }
+
+  // Returns n->key <= key.
+  bool nodeNotGreater(const Node *n, const T &key, uint64_t prefix) const {
+    if (kHasKeyPrefix && n->prefix != prefix)
+      return n->prefix < prefix;
+    return compare_(key, n->key) >= 0;
+  }
+
+  uint64_t keyPrefix(const T &key) const {
+    return keyPrefix(key, std::integral_constant<bool, kHasKeyPrefix>());
+  }
+
+  uint64_t keyPrefix(const T &key, std::true_type) const {
+    return compare_.KeyPrefix(key);
+  }
+
+  uint64_t keyPrefix(const T &, std::false_type) const {
+    return 0;
+  }
+
+  // The successor of n at level is the node the search visits after n, which
+  // is likely a cache miss in a large list. Start loading it while n is being
+  // compared. Prefetching NULL is harmless.
+  static void prefetchNext(const Node *n, int level) {
+    __builtin_prefetch(n->NoSyncNext(level));
+  }
+
+  Node *createNode(const T &key, uint64_t prefix, int height) {
     size_t sz = sizeof(Node) + sizeof(std::atomic<Node *>) * (height - 1);
     void *mem = nullptr;
     mem = arena_->allocate(sz);
     // perform proper initialization
-    return new (mem) Node(key);
+    return new (mem) Node(key, prefix);
   }
 
  private:
@@ -162,14 +249,21 @@ template <class T, class Compare> class SkipList {
   std::default_random_engine gen_;
   std::uniform_int_distribution<int> distrib_;
 
-  SysArena *const arena_;
+  Arena *const arena_;
 };
 
-template <class T, class Compare> struct SkipList<T, Compare>::Node {
+template <class T, class Compare, class Arena>
+struct SkipList<T, Compare, Arena>::Node {
   const T key;
+
+  // Cached Compare::KeyPrefix(key), 0 if Compare doesn't provide KeyPrefix.
+  // It lies next to the forward pointers, i.e usually in the same cache line
+  // the search has loaded for the pointer.
+  const uint64_t prefix;
+
   std::atomic<Node *> forward[1];
 
-  Node(const T &k) : key(k) {}
+  Node(const T &k, uint64_t p) : key(k), prefix(p) {}
 
   Node *Next(int level) const {
     // observe an fully initialized version of the pointer.
@@ -191,32 +285,37 @@ template <class T, class Compare> struct SkipList<T, Compare>::Node {
   void NoSyncSetNext(Node *next, int level) {
     forward[level].store(next, std::memory_order_relaxed);
   }
+
+  // Sets the pointer at level to next iff it's still expected.
+  bool CASNext(Node *expected, Node *next, int level) {
+    return forward[level].compare_exchange_strong(expected, next,
+                                                  std::memory_order_acq_rel);
+  }
 };
 
-template <class T, class Compare>
-inline int SkipList<T, Compare>::randomLevel() {
+template <class T, class Compare, class Arena>
+inline int SkipList<T, Compare, Arena>::randomLevel() {
   int height = 1;
   while (height < kMaxLevel && random() == 0)
     height++;
   return height;
 }
 
-template <class T, class Compare> inline int SkipList<T, Compare>::random() {
+template <class T, class Compare, class Arena>
+inline int SkipList<T, Compare, Arena>::random() {
   return distrib_(gen_);
 }
 
-template <class T, class Compare>
-typename SkipList<T, Compare>::ConstIterator SkipList<T, Compare>::Insert(
+template <class T, class Compare, class Arena>
+typename SkipList<T, Compare, Arena>::ConstIterator SkipList<T, Compare, Arena>::Insert(
     const T &key) {
   Node *update[kMaxLevel];
   Node *x = head_;
+  Node *next = nullptr;
+  const uint64_t prefix = keyPrefix(key);
 
   for (int level = getHeight() - 1; level >= 0; level--) {
-    Node *next = x->Next(level);
-    while (next != nullptr && compare_(next->key, key) < 0) {
-      x = next;
-      next = x->Next(level);
-    }
+    x = findLessThanAtLevel(x, key, prefix, level, &next);
     // next == nullptr or x->key < key <= next->key
     update[level] = x;
   }
@@ -244,7 +343,7 @@ typename SkipList<T, Compare>::ConstIterator SkipList<T, Compare>::Insert(
     height_.store(level, std::memory_order_relaxed);
   }
 
-  x = createNode(key, level);
+  x = createNode(key, prefix, level);
 
   // Intentionally repeat from bottom to top.
   for (int i = 0; i < level; i++) {
@@ -257,53 +356,139 @@ typename SkipList<T, Compare>::ConstIterator SkipList<T, Compare>::Insert(
   return ConstIterator(x);
 }
 
-template <class T, class Compare>
-inline int SkipList<T, Compare>::getHeight() const {
+template <class T, class Compare, class Arena>
+inline int SkipList<T, Compare, Arena>::randomLevelConcurrently() {
+  // Seeded by the address of the thread-local generator, so that threads
+  // don't generate the same sequence of levels.
+  static thread_local std::minstd_rand gen(static_cast<unsigned>(
+      reinterpret_cast<uintptr_t>(&gen) >> 4));
+  int height = 1;
+  while (height < kMaxLevel && (gen() & 3) == 0)
+    height++;
+  return height;
+}
+
+template <class T, class Compare, class Arena>
+inline typename SkipList<T, Compare, Arena>::Node *
+SkipList<T, Compare, Arena>::findLessThanAtLevel(Node *x, const T &key,
+                                                 uint64_t prefix, int level,
+                                                 Node **out_next) const {
+  Node *next = x->Next(level);
+  while (next != nullptr) {
+    prefetchNext(next, level);
+    if (!nodeLess(next, key, prefix))
+      break;
+    x = next;
+    next = x->Next(level);
+  }
+  *out_next = next;
+  return x;
+}
+
+template <class T, class Compare, class Arena>
+inline void SkipList<T, Compare, Arena>::findSpliceForLevel(
+    const T &key, uint64_t prefix, Node *before, int level, Node **out_prev,
+    Node **out_next) const {
+  *out_prev = findLessThanAtLevel(before, key, prefix, level, out_next);
+}
+
+template <class T, class Compare, class Arena>
+typename SkipList<T, Compare, Arena>::ConstIterator
+SkipList<T, Compare, Arena>::InsertConcurrently(const T &key) {
+  int height = randomLevelConcurrently();
+
+  // Raise height_ if necessary. Readers observing the new height see either
+  // NULL or a linked node at the new levels of head_, see Insert.
+  int max_height = getHeight();
+  while (height > max_height) {
+    if (height_.compare_exchange_weak(max_height, height,
+                                      std::memory_order_relaxed)) {
+      max_height = height;
+      break;
+    }
+  }
+
+  // prev[i]->key < key <= next[i]->key at every level.
+  Node *prev[kMaxLevel];
+  Node *next[kMaxLevel];
+  Node *x = head_;
+  const uint64_t prefix = keyPrefix(key);
+  for (int level = max_height - 1; level >= 0; level--) {
+    findSpliceForLevel(key, prefix, x, level, &prev[level], &next[level]);
+    x = prev[level];
+  }
+
+  if (next[0] != nullptr && compare_(key, next[0]->key) == 0) {
+    return ConstIterator(next[0]);
+  }
+
+  x = createNode(key, prefix, height);
+
+  // Link from bottom to top, so that a node reachable at some level is always
+  // reachable at all the levels below.
+  for (int i = 0; i < height; i++) {
+    while (true) {
+      x->NoSyncSetNext(next[i], i);
+      if (prev[i]->CASNext(next[i], x, i))
+        break;
+
+      // Some other writer has linked a node after prev[i], search again from
+      // prev[i], which is still less than key.
+      findSpliceForLevel(key, prefix, prev[i], i, &prev[i], &next[i]);
+      if (i == 0 && next[0] != nullptr && compare_(key, next[0]->key) == 0) {
+        // The same key is inserted by another writer, x is abandoned in the
+        // arena.
+        return ConstIterator(next[0]);
+      }
+    }
+  }
+  return ConstIterator(x);
+}
+
+template <class T, class Compare, class Arena>
+inline int SkipList<T, Compare, Arena>::getHeight() const {
   // It's ok to load height_ without synchronization.
   return height_.load(std::memory_order_relaxed);
 }
 
-template <class T, class Compare>
-typename SkipList<T, Compare>::ConstIterator SkipList<T, Compare>::LowerBound(
+template <class T, class Compare, class Arena>
+typename SkipList<T, Compare, Arena>::ConstIterator SkipList<T, Compare, Arena>::LowerBound(
     const T &key) const {
   Node *x = head_;
-  int height = getHeight() - 1;
+  Node *next = nullptr;
+  const uint64_t prefix = keyPrefix(key);
 
-  for (int level = height; level >= 0; level--) {
-    Node *next = x->Next(level);
-    while (next != nullptr && compare_(next->key, key) < 0) {
-      x = next;
-      next = x->Next(level);
-    }
+  for (int level = getHeight() - 1; level >= 0; level--) {
+    x = findLessThanAtLevel(x, key, prefix, level, &next);
     // x->key < key <= next->key
-    if (level == 0)
-      return ConstIterator(next);
   }
-  assert(0);
+  return ConstIterator(next);
 }
 
-template <class T, class Compare>
-typename SkipList<T, Compare>::ConstIterator SkipList<T, Compare>::UpperBound(
+template <class T, class Compare, class Arena>
+typename SkipList<T, Compare, Arena>::ConstIterator SkipList<T, Compare, Arena>::UpperBound(
     const T &key) const {
   Node *x = head_;
-  int height = getHeight() - 1;
+  Node *next = nullptr;
+  const uint64_t prefix = keyPrefix(key);
 
-  for (int level = height; level >= 0; level--) {
-    Node *next = x->Next(level);
+  for (int level = getHeight() - 1; level >= 0; level--) {
+    next = x->Next(level);
     // key >= next->key
-    while (next != nullptr && compare_(key, next->key) >= 0) {
+    while (next != nullptr) {
+      prefetchNext(next, level);
+      if (!nodeNotGreater(next, key, prefix))
+        break;
       x = next;
       next = x->Next(level);
     }
     // x->key <= key < next->key
-    if (level == 0)
-      return ConstIterator(next);
   }
-  assert(0);
+  return ConstIterator(next);
 }
 
-template <class T, class Compare>
-SkipList<T, Compare>::SkipList(SysArena *arena, const Compare &compare)
+template <class T, class Compare, class Arena>
+SkipList<T, Compare, Arena>::SkipList(Arena *arena, const Compare &compare)
     : compare_(compare),
       height_(1),
       arena_(arena),
@@ -312,26 +497,24 @@ SkipList<T, Compare>::SkipList(SysArena *arena, const Compare &compare)
   // const_cast is safe here.
   // initializer-list does not guarantee that arena_ will be well-initialized
   // before createNode (std::bad_allocation), so we must reinitialize head_.
-  (*const_cast<Node **>(&head_)) = createNode(0, kMaxLevel);
+  (*const_cast<Node **>(&head_)) = createNode(0, 0, kMaxLevel);
   for (int i = 0; i < kMaxLevel; i++)
     head_->SetNext(nullptr, i);
 }
 
-template <class T, class Compare>
-typename SkipList<T, Compare>::ConstIterator SkipList<T, Compare>::Find(
+template <class T, class Compare, class Arena>
+typename SkipList<T, Compare, Arena>::ConstIterator SkipList<T, Compare, Arena>::Find(
     const T &key) const {
   Node *x = head_;
+  Node *next = nullptr;
+  const uint64_t prefix = keyPrefix(key);
 
   for (int level = getHeight() - 1; level >= 0; level--) {
-    Node *next = x->Next(level);
-    while (next != nullptr && compare_(next->key, key) < 0) {
-      x = next;
-      next = x->Next(level);
-    }
+    x = findLessThanAtLevel(x, key, prefix, level, &next);
     // next == nullptr or x->key < key <= next->key
   }
 
-  x = x->Next(0);  // x->key >= key or x == nullptr
+  x = next;  // x->key >= key or x == nullptr
   if (x != nullptr && compare_(key, x->key) < 0)
     return End();
   return ConstIterator(x);
@@ -0,0 +1,126 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <vector>
+
+#include "DBFormat.h"
+#include "Disallowcopying.h"
+
+namespace lessdb {
+
+class SnapshotList;
+
+// A Snapshot is an immutable view of the database as of the moment it was
+// taken, i.e the updates with a sequence number no greater than its
+// sequence(). It's obtained by DB::GetSnapshot and set in
+// ReadOptions::snapshot to read from.
+class Snapshot {
+  __DISALLOW_COPYING__(Snapshot);
+
+ public:
+  SequenceNumber sequence() const {
+    return sequence_;
+  }
+
+ private:
+  friend class SnapshotList;
+
+  explicit Snapshot(SequenceNumber sequence)
+      : sequence_(sequence), prev_(this), next_(this) {}
+
+  ~Snapshot() = default;
+
+ private:
+  const SequenceNumber sequence_;
+
+  // Snapshot is kept in a doubly-linked circular list
+  Snapshot *prev_;
+  Snapshot *next_;
+};
+
+// The live snapshots of a database, in the order they were taken, which is
+// also the order of their sequence numbers. Compactions keep every version
+// of a key that some snapshot can see.
+//
+// Access to a SnapshotList must be externally synchronized, by the mutex of
+// the database.
+class SnapshotList {
+  __DISALLOW_COPYING__(SnapshotList);
+
+ public:
+  SnapshotList() : head_(0) {}
+
+  ~SnapshotList() {
+    assert(empty());
+  }
+
+  bool empty() const {
+    return head_.next_ == &head_;
+  }
+
+  // REQUIRES: !empty()
+  const Snapshot *oldest() const {
+    assert(!empty());
+    return head_.next_;
+  }
+
+  // REQUIRES: !empty()
+  const Snapshot *newest() const {
+    assert(!empty());
+    return head_.prev_;
+  }
+
+  // Stores the sequences of all the snapshots in *sequences, oldest first.
+  void GetAll(std::vector<SequenceNumber> *sequences) const {
+    sequences->clear();
+    for (const Snapshot *s = head_.next_; s != &head_; s = s->next_)
+      sequences->push_back(s->sequence_);
+  }
+
+  // REQUIRES: sequence >= newest()->sequence() if !empty()
+  const Snapshot *New(SequenceNumber sequence) {
+    assert(empty() || newest()->sequence() <= sequence);
+    Snapshot *s = new Snapshot(sequence);
+    s->next_ = &head_;
+    s->prev_ = head_.prev_;
+    s->prev_->next_ = s;
+    s->next_->prev_ = s;
+    return s;
+  }
+
+  // REQUIRES: "s" was returned by New() on this list, and not yet deleted.
+  void Delete(const Snapshot *s) {
+    Snapshot *snapshot = const_cast<Snapshot *>(s);
+    snapshot->prev_->next_ = snapshot->next_;
+    snapshot->next_->prev_ = snapshot->prev_;
+    delete snapshot;
+  }
+
+ private:
+  // Dummy head of doubly-linked list of snapshots
+  Snapshot head_;
+};
+
+}  // namespace lessdb
@@ -0,0 +1,219 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <thread>
+
+#include "Statistics.h"
+
+namespace lessdb {
+
+namespace {
+
+// Bucket i of a histogram counts the values in [limit(i-1), limit(i)).
+struct BucketLimits {
+  uint64_t limits[Statistics::kNumBuckets];
+
+  BucketLimits() {
+    uint64_t limit = 1;
+    for (size_t i = 0; i + 1 < Statistics::kNumBuckets; i++) {
+      limits[i] = limit;
+      limit = std::max(limit + 1, limit + limit / 2);
+    }
+    limits[Statistics::kNumBuckets - 1] = UINT64_MAX;
+  }
+
+  size_t BucketOf(uint64_t value) const {
+    return static_cast<size_t>(
+        std::upper_bound(limits, limits + Statistics::kNumBuckets, value) -
+        limits);
+  }
+};
+
+const BucketLimits kBucketLimits;
+
+const char *const kTickerNames[] = {
+    "lessdb.block.cache.hit",
+    "lessdb.block.cache.miss",
+    "lessdb.block.cache.add",
+    "lessdb.block.cache.compressed.hit",
+    "lessdb.block.cache.compressed.miss",
+    "lessdb.row.cache.hit",
+    "lessdb.row.cache.miss",
+    "lessdb.block.read",
+    "lessdb.block.read.bytes",
+    "lessdb.filter.useful",
+    "lessdb.filter.positive",
+    "lessdb.filter.false.positive",
+    "lessdb.wal.writes",
+    "lessdb.wal.bytes",
+    "lessdb.wal.syncs",
+    "lessdb.memtable.inserts",
+};
+
+const char *const kHistogramNames[] = {
+    "lessdb.get.micros",
+    "lessdb.write.micros",
+    "lessdb.wal.write.micros",
+    "lessdb.wal.sync.micros",
+    "lessdb.memtable.insert.micros",
+    "lessdb.block.read.micros",
+};
+
+static_assert(sizeof(kTickerNames) / sizeof(kTickerNames[0]) == kNumTickers,
+              "every ticker must have a name");
+static_assert(sizeof(kHistogramNames) / sizeof(kHistogramNames[0]) ==
+                  kNumHistograms,
+              "every histogram must have a name");
+
+size_t NumStripes() {
+  size_t n = 1;
+  while (n < std::thread::hardware_concurrency())
+    n *= 2;
+  return n;
+}
+
+}  // namespace
+
+Statistics::Statistics()
+    : num_stripes_(NumStripes()), stripes_(new Stripe[num_stripes_]()) {}
+
+Statistics::~Statistics() = default;
+
+void Statistics::MeasureTime(Histogram histogram, uint64_t micros) {
+  HistogramStripe &h = stripe().histograms[histogram];
+  // The value never falls past the last limit, UINT64_MAX, so BucketOf is
+  // at most kNumBuckets - 1.
+  h.buckets[kBucketLimits.BucketOf(micros)].fetch_add(
+      1, std::memory_order_relaxed);
+  h.sum.fetch_add(micros, std::memory_order_relaxed);
+  uint64_t max = h.max.load(std::memory_order_relaxed);
+  while (micros > max &&
+         !h.max.compare_exchange_weak(max, micros, std::memory_order_relaxed)) {
+  }
+}
+
+uint64_t Statistics::GetTickerCount(Ticker ticker) const {
+  uint64_t count = 0;
+  for (size_t i = 0; i < num_stripes_; i++)
+    count += stripes_[i].tickers[ticker].load(std::memory_order_relaxed);
+  return count;
+}
+
+void Statistics::GetHistogramData(Histogram histogram,
+                                  HistogramData *data) const {
+  uint64_t buckets[kNumBuckets] = {0};
+  data->count = data->sum = data->max = 0;
+  for (size_t i = 0; i < num_stripes_; i++) {
+    const HistogramStripe &h = stripes_[i].histograms[histogram];
+    for (size_t b = 0; b < kNumBuckets; b++) {
+      const uint64_t n = h.buckets[b].load(std::memory_order_relaxed);
+      buckets[b] += n;
+      data->count += n;
+    }
+    data->sum += h.sum.load(std::memory_order_relaxed);
+    data->max = std::max(data->max, h.max.load(std::memory_order_relaxed));
+  }
+  data->average = data->count == 0 ? 0
+                                   : static_cast<double>(data->sum) /
+                                         static_cast<double>(data->count);
+
+  // Interpolates linearly in the bucket the percentile falls into, the
+  // bucket of the largest values is bounded by the max instead of its limit.
+  auto percentile = [&](double p) -> double {
+    const double threshold = static_cast<double>(data->count) * (p / 100);
+    double cumulative = 0;
+    for (size_t b = 0; b < kNumBuckets; b++) {
+      if (buckets[b] == 0)
+        continue;
+      const double prev = cumulative;
+      cumulative += static_cast<double>(buckets[b]);
+      if (cumulative >= threshold) {
+        const double left =
+            b == 0 ? 0 : static_cast<double>(kBucketLimits.limits[b - 1]);
+        const double right =
+            std::min(static_cast<double>(kBucketLimits.limits[b]),
+                     static_cast<double>(data->max));
+        const double pos =
+            (threshold - prev) / static_cast<double>(buckets[b]);
+        return std::max(left, left + (right - left) * pos);
+      }
+    }
+    return static_cast<double>(data->max);
+  };
+  data->median = percentile(50);
+  data->p95 = percentile(95);
+  data->p99 = percentile(99);
+}
+
+void Statistics::Reset() {
+  for (size_t i = 0; i < num_stripes_; i++) {
+    Stripe &s = stripes_[i];
+    for (auto &t : s.tickers)
+      t.store(0, std::memory_order_relaxed);
+    for (auto &h : s.histograms) {
+      for (auto &b : h.buckets)
+        b.store(0, std::memory_order_relaxed);
+      h.sum.store(0, std::memory_order_relaxed);
+      h.max.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+std::string Statistics::ToString() const {
+  std::string r;
+  char buf[256];
+  for (int i = 0; i < kNumTickers; i++) {
+    Ticker t = static_cast<Ticker>(i);
+    snprintf(buf, sizeof(buf), "%s COUNT : %llu\n", TickerName(t),
+             static_cast<unsigned long long>(GetTickerCount(t)));
+    r.append(buf);
+  }
+  for (int i = 0; i < kNumHistograms; i++) {
+    Histogram h = static_cast<Histogram>(i);
+    HistogramData data;
+    GetHistogramData(h, &data);
+    snprintf(buf, sizeof(buf),
+             "%s P50 : %.2f P95 : %.2f P99 : %.2f MAX : %llu COUNT : %llu "
+             "SUM : %llu\n",
+             HistogramName(h), data.median, data.p95, data.p99,
+             static_cast<unsigned long long>(data.max),
+             static_cast<unsigned long long>(data.count),
+             static_cast<unsigned long long>(data.sum));
+    r.append(buf);
+  }
+  return r;
+}
+
+const char *Statistics::TickerName(Ticker ticker) {
+  assert(ticker < kNumTickers);
+  return kTickerNames[ticker];
+}
+
+const char *Statistics::HistogramName(Histogram histogram) {
+  assert(histogram < kNumHistograms);
+  return kHistogramNames[histogram];
+}
+
+}  // namespace lessdb
@@ -0,0 +1,199 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "Disallowcopying.h"
+
+namespace lessdb {
+
+// Tickers count the events of the database, each one is the total number
+// since the Statistics was created or last Reset.
+enum Ticker {
+  // Lookups of Options::block_cache.
+  kBlockCacheHit = 0,
+  kBlockCacheMiss,
+  // Blocks inserted into Options::block_cache.
+  kBlockCacheAdd,
+  // Lookups of Options::block_cache_compressed.
+  kBlockCacheCompressedHit,
+  kBlockCacheCompressedMiss,
+  // Lookups of Options::row_cache.
+  kRowCacheHit,
+  kRowCacheMiss,
+  // Blocks and bytes (including the trailers) read from the sstables.
+  kBlockRead,
+  kBlockReadBytes,
+  // Queries of the filters. Useful are the ones ruling out the key, false
+  // positives the ones passing a key that turns out to be absent.
+  kFilterUseful,
+  kFilterPositive,
+  kFilterFalsePositive,
+  // Records and bytes appended to the log, and syncs of the log.
+  kWalWrites,
+  kWalBytes,
+  kWalSyncs,
+  // Updates inserted into the memtable.
+  kMemtableInserts,
+  kNumTickers
+};
+
+// Histograms record the distribution of the latencies of the operations, in
+// microseconds.
+enum Histogram {
+  kGetMicros = 0,
+  kWriteMicros,
+  kWalWriteMicros,
+  kWalSyncMicros,
+  kMemtableInsertMicros,
+  kBlockReadMicros,
+  kNumHistograms
+};
+
+struct HistogramData {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  double average;
+  double median;
+  double p95;
+  double p99;
+};
+
+// Statistics collects the tickers and histograms of a database, set it in
+// Options::statistics to enable it. A Statistics may be shared by several
+// databases, and is safe to be accessed concurrently.
+//
+// The counters are striped by CPU, so that the threads recording an event
+// mostly touch cache lines of their own, and are only summed up when they're
+// read. The reads are not atomic snapshots of all the counters.
+class Statistics {
+  __DISALLOW_COPYING__(Statistics);
+
+ public:
+  Statistics();
+
+  ~Statistics();
+
+  void RecordTick(Ticker ticker, uint64_t count = 1) {
+    stripe().tickers[ticker].fetch_add(count, std::memory_order_relaxed);
+  }
+
+  void MeasureTime(Histogram histogram, uint64_t micros);
+
+  // The sum of the ticker over all stripes.
+  uint64_t GetTickerCount(Ticker ticker) const;
+
+  void GetHistogramData(Histogram histogram, HistogramData *data) const;
+
+  // Resets all the tickers and histograms to zero.
+  void Reset();
+
+  // A human-readable dump of every ticker and histogram.
+  std::string ToString() const;
+
+  static const char *TickerName(Ticker ticker);
+
+  static const char *HistogramName(Histogram histogram);
+
+  // Number of buckets of a histogram, the bucket limits grow by about 1.5x
+  // from 1 microsecond.
+  static const size_t kNumBuckets = 64;
+
+ private:
+  struct HistogramStripe {
+    std::atomic<uint64_t> buckets[kNumBuckets];
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+  };
+
+  struct Stripe {
+    std::atomic<uint64_t> tickers[kNumTickers];
+    HistogramStripe histograms[kNumHistograms];
+    // Keeps the tickers of the next stripe off the last cache line of ours.
+    char padding[64];
+  };
+
+  // The stripe of the CPU the calling thread's running on.
+  Stripe &stripe() {
+#ifdef __linux__
+    const int cpu = sched_getcpu();
+    const size_t id = cpu < 0 ? 0 : static_cast<size_t>(cpu);
+#else
+    static std::atomic<size_t> next_id(0);
+    static thread_local size_t id =
+        next_id.fetch_add(1, std::memory_order_relaxed);
+#endif
+    return stripes_[id & (num_stripes_ - 1)];
+  }
+
+ private:
+  // A power of 2, no less than the number of CPUs.
+  const size_t num_stripes_;
+  std::unique_ptr<Stripe[]> stripes_;
+};
+
+inline void RecordTick(Statistics *stats, Ticker ticker, uint64_t count = 1) {
+  if (stats)
+    stats->RecordTick(ticker, count);
+}
+
+// StopWatch measures the lifetime of its scope into a histogram, or does
+// nothing at all (not even reading the clock) if stats is NULL.
+class StopWatch {
+  __DISALLOW_COPYING__(StopWatch);
+
+ public:
+  StopWatch(Statistics *stats, Histogram histogram)
+      : stats_(stats), histogram_(histogram) {
+    if (stats_)
+      start_ = std::chrono::steady_clock::now();
+  }
+
+  ~StopWatch() {
+    if (stats_) {
+      stats_->MeasureTime(
+          histogram_,
+          static_cast<uint64_t>(
+              std::chrono::duration_cast<std::chrono::microseconds>(
+                  std::chrono::steady_clock::now() - start_)
+                  .count()));
+    }
+  }
+
+ private:
+  Statistics *stats_;
+  const Histogram histogram_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace lessdb
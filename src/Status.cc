@@ -35,6 +35,15 @@ std::string Status::ToString() const {
     case kIOError:
       ret = "IOError";
       break;
+    case kInvalidArgument:
+      ret = "Invalid argument";
+      break;
+    case kNotSupported:
+      ret = "Not implemented";
+      break;
+    case kNotFound:
+      ret = "NotFound";
+      break;
     default:
       ret = "Unknown ErrorCode";
   }
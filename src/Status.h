@@ -30,7 +30,14 @@ namespace lessdb {
 
 class Status {
  private:
-  enum ErrorCodes { kOK = 0, kCorruption = 1, kIOError = 2 };
+  enum ErrorCodes {
+    kOK = 0,
+    kCorruption = 1,
+    kIOError = 2,
+    kInvalidArgument = 3,
+    kNotSupported = 4,
+    kNotFound = 5
+  };
 
  public:
   // An empty Status will be treated as an OK status.
@@ -81,6 +88,31 @@ class Status {
     return code() == kIOError;
   }
 
+  static Status InvalidArgument(const Slice &msg) {
+    return Status(kInvalidArgument, msg);
+  }
+
+  bool IsInvalidArgument() const {
+    return code() == kInvalidArgument;
+  }
+
+  static Status NotSupported(const Slice &msg) {
+    return Status(kNotSupported, msg);
+  }
+
+  bool IsNotSupported() const {
+    return code() == kNotSupported;
+  }
+
+  // The key looked up is not in the database.
+  static Status NotFound(const Slice &msg) {
+    return Status(kNotFound, msg);
+  }
+
+  bool IsNotFound() const {
+    return code() == kNotFound;
+  }
+
   std::string ToString() const;
 
   Status &operator<<(const char str[]) {
@@ -0,0 +1,178 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <vector>
+
+#include "CacheStrategy.h"
+#include "DataView.h"
+#include "FileName.h"
+#include "FileUtils.h"
+#include "InternalKey.h"
+#include "SSTable.h"
+#include "Statistics.h"
+#include "TableCache.h"
+
+namespace lessdb {
+
+namespace {
+
+// The shards of the cache of "entries" tables. A shard evicts on its own
+// share of the capacity, so small caches aren't sharded, to keep the number of
+// open tables close to "entries".
+int ShardBits(int entries) {
+  int bits = 0;
+  while (bits < 4 && (entries >> (bits + 1)) >= 64)
+    bits++;
+  return bits;
+}
+
+// The key of a row in Options::row_cache is in format of:
+// key          := row_cache_id file_number user_key
+// row_cache_id := uint64
+// file_number  := uint64
+void EncodeRowKey(std::string *buf, uint64_t row_cache_id, uint64_t number,
+                  const Slice &user_key) {
+  buf->resize(16);
+  DataView(&(*buf)[0]).WriteNum(row_cache_id);
+  DataView(&(*buf)[8]).WriteNum(number);
+  buf->append(user_key.RawData(), user_key.Len());
+}
+
+// An open table, owning its file, which is closed after the table.
+struct OpenTable {
+  std::unique_ptr<RandomAccessFile> file;
+  std::unique_ptr<SSTable> table;
+};
+
+}  // anonymous namespace
+
+TableCache::TableCache(const std::string &dbname, const Options &options,
+                       const InternalKeyComparator *icmp,
+                       FileFactory *factory, int entries)
+    : dbname_(dbname),
+      options_(options),
+      prefix_extractor_(options.prefix_extractor),
+      factory_(factory),
+      cache_(CacheStrategy::LRU(entries, ShardBits(entries))),
+      row_cache_id_(options.row_cache ? options.row_cache->NewId() : 0) {
+  options_.comparator = icmp;
+  if (options.prefix_extractor)
+    options_.prefix_extractor = &prefix_extractor_;
+}
+
+TableCache::~TableCache() = default;
+
+std::shared_ptr<SSTable> TableCache::Get(uint64_t number, uint64_t file_size,
+                                         Status *s) {
+  char key_buf[sizeof(number)];
+  DataView(key_buf).WriteNum(number);
+  const Slice key(key_buf, sizeof(key_buf));
+
+  CacheStrategy::HANDLE handle = cache_->Lookup(key);
+  if (handle) {
+    std::shared_ptr<SSTable> table =
+        *static_cast<std::shared_ptr<SSTable> *>(cache_->Value(handle));
+    cache_->Release(handle);
+    return table;
+  }
+
+  // Two threads missing the same table may both open it, the later one
+  // replaces the other in cache_.
+  std::shared_ptr<OpenTable> open = std::make_shared<OpenTable>();
+  open->file.reset(
+      factory_->NewRandomAccessFile(TableFileName(dbname_, number), s));
+  if (!*s)
+    return nullptr;
+  open->table.reset(
+      SSTable::Open(options_, open->file.get(), file_size, *s));
+  if (!*s)
+    return nullptr;
+
+  // Every open table is charged 1, the capacity of cache_ is the number of
+  // tables.
+  std::shared_ptr<SSTable> table(open, open->table.get());
+  cache_->Release(cache_->Insert(key, new std::shared_ptr<SSTable>(table), 1,
+                                 &DeleteCacheValue<std::shared_ptr<SSTable>>));
+  return table;
+}
+
+void TableCache::Evict(uint64_t number) {
+  char key_buf[sizeof(number)];
+  DataView(key_buf).WriteNum(number);
+  cache_->Erase(Slice(key_buf, sizeof(key_buf)));
+}
+
+std::shared_ptr<const CachedRow> TableCache::LookupRow(
+    uint64_t number, const Slice &user_key) const {
+  CacheStrategy *cache = options_.row_cache;
+  if (!cache)
+    return nullptr;
+
+  std::string key;
+  EncodeRowKey(&key, row_cache_id_, number, user_key);
+  CacheStrategy::HANDLE h = cache->Lookup(key);
+  RecordTick(options_.statistics, h ? kRowCacheHit : kRowCacheMiss);
+  if (!h)
+    return nullptr;
+  std::shared_ptr<const CachedRow> row =
+      *static_cast<std::shared_ptr<const CachedRow> *>(cache->Value(h));
+  cache->Release(h);
+  return row;
+}
+
+void TableCache::InsertRow(uint64_t number, const Slice &user_key,
+                           const std::shared_ptr<const CachedRow> &row) const {
+  CacheStrategy *cache = options_.row_cache;
+  if (!cache)
+    return;
+
+  std::string key;
+  EncodeRowKey(&key, row_cache_id_, number, user_key);
+  const size_t charge = sizeof(CachedRow) + key.size() + row->value.size();
+  cache->Release(
+      cache->Insert(key, new std::shared_ptr<const CachedRow>(row), charge,
+                    &DeleteCacheValue<std::shared_ptr<const CachedRow>>));
+}
+
+void TableCache::VisitTables(
+    const std::function<void(uint64_t, const SSTable &)> &fn) const {
+  // The numbers are collected first, as the cache is not to be looked up
+  // while its keys are visited.
+  std::vector<uint64_t> numbers;
+  cache_->VisitKeys([&numbers](const Slice &key) {
+    numbers.push_back(ConstDataView(key.RawData()).ReadNum<uint64_t>());
+  });
+  for (uint64_t number : numbers) {
+    char key_buf[sizeof(number)];
+    DataView(key_buf).WriteNum(number);
+    CacheStrategy::HANDLE handle =
+        cache_->Lookup(Slice(key_buf, sizeof(key_buf)));
+    if (!handle)
+      continue;  // evicted meanwhile
+    std::shared_ptr<SSTable> table =
+        *static_cast<std::shared_ptr<SSTable> *>(cache_->Value(handle));
+    cache_->Release(handle);
+    fn(number, *table);
+  }
+}
+
+}  // namespace lessdb
@@ -0,0 +1,119 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "Disallowcopying.h"
+#include "InternalKey.h"
+#include "Options.h"
+#include "Status.h"
+
+namespace lessdb {
+
+class CacheStrategy;
+class FileFactory;
+class SSTable;
+
+// The newest entry of a user key in a table, as kept in Options::row_cache.
+struct CachedRow {
+  // False if the table has no entry of the user key, the other fields are
+  // then unset.
+  bool found;
+  ValueType type;
+  SequenceNumber sequence;  // as stored in the table
+  std::string value;
+};
+
+// TableCache keeps a bounded set of the sstables of a database open, along
+// with their files, keyed by file number in an LRU CacheStrategy. A table
+// is opened (its file, footer, index and filter read) on the first access,
+// and closed when it's evicted as the coldest of more than "entries" open
+// tables, which bounds the file descriptors (or mmaps) of the database.
+// Whether a table is mmaped or read by pread is up to
+// FileFactory::NewRandomAccessFile, e.g FileFactory::Default() mmaps up to
+// SetMmapLimit files and preads the others.
+//
+// As a table stays open across accesses, its blocks are found again in
+// Options::block_cache under its cache id.
+//
+// Thread-safe.
+class TableCache {
+  __DISALLOW_COPYING__(TableCache);
+
+ public:
+  // The tables are opened with "options", with icmp as their comparator, and
+  // the prefixes of their user keys extracted by options.prefix_extractor.
+  // *icmp and *factory must remain live while this TableCache is in use.
+  TableCache(const std::string &dbname, const Options &options,
+             const InternalKeyComparator *icmp, FileFactory *factory,
+             int entries);
+
+  ~TableCache();
+
+  // Returns the table of file "number" of "file_size" bytes, opening it if
+  // it's not open. The table remains valid as long as the returned pointer
+  // is held, even if it's evicted meanwhile. On failure returns NULL and
+  // stores the error in *s.
+  std::shared_ptr<SSTable> Get(uint64_t number, uint64_t file_size,
+                               Status *s);
+
+  // Closes the table of file "number", e.g once the file is deleted.
+  void Evict(uint64_t number);
+
+  // Calls fn with the number and the table of every open table.
+  void VisitTables(
+      const std::function<void(uint64_t, const SSTable &)> &fn) const;
+
+  // Returns the row of "user_key" in the table of file "number" in
+  // Options::row_cache, or NULL if it's not cached, or there is no row cache.
+  std::shared_ptr<const CachedRow> LookupRow(uint64_t number,
+                                             const Slice &user_key) const;
+
+  // Inserts "row", the row of "user_key" in the table of file "number", into
+  // Options::row_cache, if any. The tables are immutable, a row is never
+  // stale, the rows of a deleted table age out of the cache.
+  void InsertRow(uint64_t number, const Slice &user_key,
+                 const std::shared_ptr<const CachedRow> &row) const;
+
+  // The options the tables are opened with.
+  const Options &TableOptions() const {
+    return options_;
+  }
+
+ private:
+  const std::string dbname_;
+  Options options_;
+  const InternalKeyPrefixExtractor prefix_extractor_;
+  FileFactory *const factory_;
+  std::unique_ptr<CacheStrategy> cache_;
+
+  // Prefix of the keys of the rows of this database in Options::row_cache,
+  // which may be shared by several databases.
+  const uint64_t row_cache_id_;
+};
+
+}  // namespace lessdb
@@ -38,11 +38,32 @@ std::string BlockHandle::EncodeToString() const {
 }
 
 Status BlockHandle::DecodeFrom(Slice *s, BlockHandle *handle) {
-  try {
-    coding::GetVar64(s, &handle->offset);
-    coding::GetVar64(s, &handle->size);
-  } catch (std::exception &e) {
-    return Status::Corruption(e.what());
+  if (!coding::ParseVar64(s, &handle->offset) ||
+      !coding::ParseVar64(s, &handle->size)) {
+    return Status::Corruption("BlockHandle: bad handle");
+  }
+  return Status::OK();
+}
+
+std::string BlockHandle::EncodeDeltaToString() const {
+  std::string r;
+  coding::AppendVar64(&r, size);
+  return r;
+}
+
+Status BlockHandle::DecodeDeltaFrom(Slice *s, const BlockHandle &prev,
+                                    BlockHandle *handle) {
+  // A full handle has the size after the offset.
+  uint64_t first;
+  if (!coding::ParseVar64(s, &first))
+    return Status::Corruption("BlockHandle: bad delta handle");
+  if (s->Len() == 0) {
+    handle->size = first;
+    handle->offset = prev.offset + first;
+  } else {
+    handle->offset = first;
+    if (!coding::ParseVar64(s, &handle->size))
+      return Status::Corruption("BlockHandle: bad delta handle");
   }
   return Status::OK();
 }
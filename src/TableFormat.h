@@ -22,6 +22,9 @@
 
 #pragma once
 
+#include <memory>
+
+#include "Allocator.h"
 #include "Slice.h"
 
 namespace lessdb {
@@ -46,14 +49,56 @@ struct BlockHandle {
 
   static Status DecodeFrom(Slice *s, BlockHandle *handle);
 
+  // Encodes the handle of a block stored right after the block of the
+  // previous handle by its size alone, the offset follows from the previous
+  // one. @see kDeltaEncodedIndexKey
+  std::string EncodeDeltaToString() const;
+
+  // Decodes a handle encoded by either EncodeToString or EncodeDeltaToString,
+  // the latter relative to prev, which are told apart by their lengths.
+  // REQUIRES: *s holds nothing but the handle.
+  static Status DecodeDeltaFrom(Slice *s, const BlockHandle &prev,
+                                BlockHandle *handle);
+
   // Maximum encoding length of a BlockHandle: 2 * sizeof(varint64)
   enum { kMaxEncodedLength = 10 + 10 };
 };
 
 struct BlockContent {
   Slice data;
+
+  // True iff data is allocated by allocator, or by new[] if allocator is
+  // NULL, in which case the Block constructed from this content takes the
+  // ownership of it.
+  bool heap_allocated;
+  Allocator *allocator;
+
+  BlockContent() : heap_allocated(false), allocator(nullptr) {}
+};
+
+// Frees the data of a block allocated by "allocator", or by new[] if NULL.
+struct BlockDeleter {
+  Allocator *allocator;
+
+  explicit BlockDeleter(Allocator *a = nullptr) : allocator(a) {}
+
+  void operator()(const char *p) const {
+    if (allocator)
+      allocator->Deallocate(const_cast<char *>(p));
+    else
+      delete[] p;
+  }
 };
 
+// The buffer a block is read into.
+typedef std::unique_ptr<char[], BlockDeleter> BlockBuffer;
+
+inline BlockBuffer NewBlockBuffer(size_t n, Allocator *allocator) {
+  char *p = allocator ? static_cast<char *>(allocator->Allocate(n))
+                      : new char[n];
+  return BlockBuffer(p, BlockDeleter(allocator));
+}
+
 // kTableMagicNumber was picked by running
 //    echo http://code.google.com/p/leveldb/ | sha1sum
 // and taking the leading 64 bits.
@@ -65,6 +110,35 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 // @see TableBuilder::writeBlock
 static const uint64_t kBlockTrailerSize = 5;
 
+// Set in the compression_type byte of the trailer if crc is the crc32c of
+// the block contents. Blocks written by older versions have it unset, whose
+// crc is LegacyCrc32. @see Crc32c.h
+static const uint8_t kBlockTrailerCrc32cFlag = 0x80;
+
+// The low bits of the compression_type byte are the CompressionType of the
+// block, the crc covers the block as stored, i.e compressed.
+static const uint8_t kBlockTrailerCompressionMask = 0x7f;
+
+// Key in the metaindex block of the zstd dictionary the data blocks are
+// compressed with. @see Options::zstd_max_dict_bytes
+static const char kCompressionDictKey[] = "compression.dict";
+
+// Key in the metaindex block, with an empty value, of a table whose index
+// block is a top-level index of index partitions: each entry maps the last
+// key of a partition to its handle. @see Options::index_partition_size
+static const char kPartitionedIndexKey[] = "index.partitioned";
+
+// Key in the metaindex block, with an empty value, of a table whose index
+// entries store a full block handle only at the restart points, the handles
+// after a restart point are delta-encoded by their sizes.
+// @see BlockHandle::EncodeDeltaToString
+static const char kDeltaEncodedIndexKey[] = "index.delta_encoded";
+
+// Key in the metaindex block of the range tombstone block of a table, whose
+// entries map InternalKey(begin, sequence, kTypeRangeDeletion) to the end
+// key of each tombstone. @see SSTableBuilder::AddRangeTombstone
+static const char kRangeDelBlockKey[] = "rangedel";
+
 // Footer encapsulates the fixed information stored at the tail
 // end of every table file.
 // The information contains the BlockHandle of the metaindex and index blocks as
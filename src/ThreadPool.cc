@@ -0,0 +1,135 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cassert>
+
+#include "ThreadPool.h"
+
+namespace lessdb {
+
+ThreadPool::ThreadPool(int high_threads, int low_threads, int read_threads)
+    : next_id_(1), stopping_(false) {
+  SetBackgroundThreads(kHigh, high_threads);
+  SetBackgroundThreads(kLow, low_threads);
+  SetBackgroundThreads(kRead, read_threads);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stopping_ = true;
+  }
+  for (Queue &q : queues_) {
+    q.cv.notify_all();
+  }
+  for (Queue &q : queues_) {
+    for (std::thread &t : q.threads)
+      t.join();
+  }
+}
+
+uint64_t ThreadPool::Schedule(std::function<void()> job, Priority pri) {
+  Queue &q = queues_[pri];
+  uint64_t id;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    id = next_id_++;
+    q.jobs.push_back(Job{id, std::move(job)});
+  }
+  q.cv.notify_one();
+  return id;
+}
+
+bool ThreadPool::Cancel(uint64_t id) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  for (Queue &q : queues_) {
+    auto it = std::find_if(q.jobs.begin(), q.jobs.end(),
+                           [id](const Job &job) { return job.id == id; });
+    if (it != q.jobs.end()) {
+      q.jobs.erase(it);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::SetBackgroundThreads(Priority pri, int num) {
+  const size_t n = static_cast<size_t>(std::max(num, 1));
+  Queue &q = queues_[pri];
+  std::vector<std::thread> removed;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    // The threads past n see their index out of range and exit.
+    while (q.threads.size() > n) {
+      removed.push_back(std::move(q.threads.back()));
+      q.threads.pop_back();
+    }
+    while (q.threads.size() < n) {
+      q.threads.emplace_back(&ThreadPool::run, this, pri, q.threads.size());
+    }
+  }
+  if (!removed.empty()) {
+    q.cv.notify_all();
+    for (std::thread &t : removed)
+      t.join();
+  }
+}
+
+int ThreadPool::NumThreads(Priority pri) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return static_cast<int>(queues_[pri].threads.size());
+}
+
+size_t ThreadPool::QueueLength(Priority pri) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return queues_[pri].jobs.size();
+}
+
+void ThreadPool::run(Priority pri, size_t index) {
+  Queue &q = queues_[pri];
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    while (!stopping_ && index < q.threads.size() && q.jobs.empty()) {
+      q.cv.wait(lock);
+    }
+    if (stopping_ || index >= q.threads.size())
+      break;
+
+    std::function<void()> fn = std::move(q.jobs.front().fn);
+    q.jobs.pop_front();
+    lock.unlock();
+    fn();
+    // The job's state is released out of mutex_.
+    fn = nullptr;
+    lock.lock();
+  }
+}
+
+ThreadPool *ThreadPool::Default() {
+  static std::once_flag flag;
+  static ThreadPool *instance_ = nullptr;
+  std::call_once(flag, [] { instance_ = new ThreadPool(1, 1); });
+  return instance_;
+}
+
+}  // namespace lessdb
@@ -0,0 +1,109 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Disallowcopying.h"
+
+namespace lessdb {
+
+// ThreadPool runs the background work of the databases sharing it through
+// Options::thread_pool, i.e. their memtable flushes and their compactions,
+// and the lookups of DB::MultiGetAsync that have to read from file.
+// Each priority has its own queue and its own threads: the kHigh threads
+// only run the kHigh jobs, so a flush never waits behind a long compaction
+// on the kLow threads, which would stall the writes, and neither delays the
+// reads on the kRead threads.
+//
+// Thread-safe.
+class ThreadPool {
+  __DISALLOW_COPYING__(ThreadPool);
+
+ public:
+  enum Priority {
+    kHigh = 0,  // Memtable flushes.
+    kLow = 1,   // Compactions.
+    kRead = 2,  // Asynchronous lookups.
+    kNumPriorities = 3
+  };
+
+  // Starts the threads of each priority, at least one each.
+  ThreadPool(int high_threads, int low_threads, int read_threads = 1);
+
+  // Waits for the running jobs, the queued ones are dropped.
+  // REQUIRES: the databases sharing this pool are all closed.
+  ~ThreadPool();
+
+  // Queues "job" to be run by a thread of priority "pri", in FIFO order with
+  // the other jobs of the same priority. Returns the id of the job, which
+  // is never 0.
+  uint64_t Schedule(std::function<void()> job, Priority pri);
+
+  // Removes the job "id" from its queue if it's not started yet. Returns
+  // false if it's running or done already.
+  bool Cancel(uint64_t id);
+
+  // Grows or shrinks the threads of priority "pri" to "num" (at least one).
+  // A thread removed finishes its current job first.
+  void SetBackgroundThreads(Priority pri, int num);
+
+  int NumThreads(Priority pri) const;
+
+  // The number of jobs of priority "pri" waiting for a thread.
+  size_t QueueLength(Priority pri) const;
+
+  // The pool used by the databases with a NULL Options::thread_pool, with
+  // one thread of each priority. Never deleted.
+  static ThreadPool *Default();
+
+ private:
+  struct Job {
+    uint64_t id;
+    std::function<void()> fn;
+  };
+
+  struct Queue {
+    std::deque<Job> jobs;
+    std::vector<std::thread> threads;
+    // Signaled when a job is queued, or a thread has to exit.
+    std::condition_variable cv;
+  };
+
+  // The body of the thread "index" of priority "pri".
+  void run(Priority pri, size_t index);
+
+  mutable std::mutex mutex_;
+  Queue queues_[kNumPriorities];
+  uint64_t next_id_;
+  bool stopping_;
+};
+
+}  // namespace lessdb
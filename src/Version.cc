@@ -0,0 +1,378 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+
+#include "BlobFile.h"
+#include "FileName.h"
+#include "FileUtils.h"
+#include "InternalKey.h"
+#include "Options.h"
+#include "SSTable.h"
+#include "TableCache.h"
+#include "Version.h"
+#include "VersionSet.h"
+
+namespace lessdb {
+
+Version::~Version() {
+  assert(refs_ == 0);
+
+  // Remove from linked list
+  prev_->next_ = next_;
+  next_->prev_ = prev_;
+
+  // Drop references to files
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (FileMetaData *f : files_[level]) {
+      assert(f->refs > 0);
+      f->refs--;
+      if (f->refs <= 0) {
+        delete f;
+      }
+    }
+  }
+}
+
+void Version::Ref() {
+  ++refs_;
+}
+
+void Version::Unref() {
+  assert(this != &vset_->dummy_versions_);
+  assert(refs_ >= 1);
+  --refs_;
+  if (refs_ == 0) {
+    delete this;
+  }
+}
+
+size_t FindFile(const InternalKeyComparator &icmp,
+                const std::vector<FileMetaData *> &files, const Slice &key) {
+  size_t left = 0;
+  size_t right = files.size();
+  while (left < right) {
+    size_t mid = (left + right) / 2;
+    const FileMetaData *f = files[mid];
+    if (icmp.Compare(Slice(f->largest), key) < 0) {
+      // Key at "mid.largest" is < "target".  Therefore all
+      // files at or before "mid" are uninteresting.
+      left = mid + 1;
+    } else {
+      // Key at "mid.largest" is >= "target".  Therefore all files
+      // after "mid" are uninteresting.
+      right = mid;
+    }
+  }
+  return right;
+}
+
+static Slice UserKey(const std::string &internal_key) {
+  assert(internal_key.size() >= 8);
+  return Slice(internal_key.data(), internal_key.size() - 8);
+}
+
+void Version::GetOverlappingInputs(int level, const Slice *begin,
+                                   const Slice *end,
+                                   std::vector<FileMetaData *> *inputs) {
+  assert(level >= 0 && level < config::kNumLevels);
+  inputs->clear();
+  std::string user_begin, user_end;
+  if (begin != nullptr) {
+    user_begin.assign(begin->RawData(), begin->Len() - 8);
+  }
+  if (end != nullptr) {
+    user_end.assign(end->RawData(), end->Len() - 8);
+  }
+
+  const Comparator *ucmp = vset_->icmp_->user_comparator();
+  for (size_t i = 0; i < files_[level].size();) {
+    FileMetaData *f = files_[level][i++];
+    const Slice file_start = UserKey(f->smallest);
+    const Slice file_limit = UserKey(f->largest);
+    if (begin != nullptr && ucmp->Compare(file_limit, user_begin) < 0) {
+      // "f" is completely before specified range; skip it
+    } else if (end != nullptr && ucmp->Compare(file_start, user_end) > 0) {
+      // "f" is completely after specified range; skip it
+    } else {
+      inputs->push_back(f);
+      if (level == 0) {
+        // Level-0 files may overlap each other.  So check if the newly
+        // added file has expanded the range.  If so, restart search.
+        if (begin != nullptr && ucmp->Compare(file_start, user_begin) < 0) {
+          user_begin = file_start.ToString();
+          inputs->clear();
+          i = 0;
+        } else if (end != nullptr &&
+                   ucmp->Compare(file_limit, user_end) > 0) {
+          user_end = file_limit.ToString();
+          inputs->clear();
+          i = 0;
+        }
+      }
+    }
+  }
+}
+
+bool Version::OverlapInLevel(int level, const Slice &smallest_user_key,
+                             const Slice &largest_user_key) const {
+  const Comparator *ucmp = vset_->icmp_->user_comparator();
+  const std::vector<FileMetaData *> &files = files_[level];
+  if (level == 0) {
+    // Need to check against all files
+    for (const FileMetaData *f : files) {
+      if (ucmp->Compare(smallest_user_key, UserKey(f->largest)) <= 0 &&
+          ucmp->Compare(largest_user_key, UserKey(f->smallest)) >= 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Binary search over file list, for the first file whose largest key is
+  // not before smallest_user_key.
+  InternalKeyBuf small_key(smallest_user_key, kMaxSequenceNumber, kTypeValue);
+  size_t index = FindFile(*vset_->icmp_, files, small_key.Data());
+  if (index >= files.size()) {
+    // beginning of range is after all files, so no overlap.
+    return false;
+  }
+  return ucmp->Compare(largest_user_key, UserKey(files[index]->smallest)) >= 0;
+}
+
+Status Version::Get(const ReadOptions &options, const Slice &key,
+                    std::string *value) const {
+  const Comparator *ucmp = vset_->icmp_->user_comparator();
+  const Slice user_key(key.RawData(), key.Len() - 8);
+  Status s;
+
+  // Level-0 files may overlap each other, the newer ones are searched first.
+  std::vector<const FileMetaData *> level0;
+  for (const FileMetaData *f : files_[0]) {
+    if (ucmp->Compare(user_key, UserKey(f->smallest)) >= 0 &&
+        ucmp->Compare(user_key, UserKey(f->largest)) <= 0) {
+      level0.push_back(f);
+    }
+  }
+  std::sort(level0.begin(), level0.end(),
+            [](const FileMetaData *a, const FileMetaData *b) {
+              return a->number > b->number;
+            });
+  for (const FileMetaData *f : level0) {
+    if (getFromTable(options, f, key, value, &s))
+      return s;
+  }
+
+  // The other levels have at most one file that may contain the key.
+  for (int level = 1; level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData *> &files = files_[level];
+    size_t index = FindFile(*vset_->icmp_, files, key);
+    if (index == files.size() ||
+        ucmp->Compare(user_key, UserKey(files[index]->smallest)) < 0)
+      continue;
+    if (getFromTable(options, files[index], key, value, &s))
+      return s;
+  }
+  return Status::NotFound(Slice());
+}
+
+void Version::MultiGet(const ReadOptions &options, const Slice *keys,
+                       size_t n, std::string *values, Status *statuses) const {
+  const Comparator *ucmp = vset_->icmp_->user_comparator();
+  std::vector<bool> found(n, false);
+
+  // Searches the table "f" for keys[pending].
+  std::vector<Slice> batch;
+  auto search = [&](const FileMetaData *f, const std::vector<size_t> &pending) {
+    if (pending.size() > 1) {
+      // The prefetch only fills the block cache, so neither its error nor
+      // that of opening the table is kept: the lookups below meet it again,
+      // each on its own reads, and report it in their own statuses[i].
+      Status s;
+      std::shared_ptr<SSTable> table =
+          vset_->table_cache_->Get(f->number, f->file_size, &s);
+      if (s) {
+        batch.clear();
+        for (size_t i : pending) {
+          if (table->PrefixMayMatch(options, keys[i]))
+            batch.push_back(keys[i]);
+        }
+        table->Prefetch(options, batch.data(), batch.size());
+      }
+    }
+    for (size_t i : pending) {
+      if (getFromTable(options, f, keys[i], &values[i], &statuses[i]))
+        found[i] = true;
+    }
+  };
+
+  std::vector<const FileMetaData *> level0(files_[0].begin(),
+                                           files_[0].end());
+  std::sort(level0.begin(), level0.end(),
+            [](const FileMetaData *a, const FileMetaData *b) {
+              return a->number > b->number;
+            });
+  std::vector<size_t> pending;
+  for (const FileMetaData *f : level0) {
+    pending.clear();
+    for (size_t i = 0; i < n; i++) {
+      const Slice user_key(keys[i].RawData(), keys[i].Len() - 8);
+      if (!found[i] &&
+          ucmp->Compare(user_key, UserKey(f->smallest)) >= 0 &&
+          ucmp->Compare(user_key, UserKey(f->largest)) <= 0)
+        pending.push_back(i);
+    }
+    if (!pending.empty())
+      search(f, pending);
+  }
+
+  // The keys of a level > 0 are grouped by the file that may hold them.
+  std::vector<std::pair<size_t, size_t>> candidates;
+  for (int level = 1; level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData *> &files = files_[level];
+    candidates.clear();
+    for (size_t i = 0; i < n; i++) {
+      if (found[i])
+        continue;
+      const Slice user_key(keys[i].RawData(), keys[i].Len() - 8);
+      size_t index = FindFile(*vset_->icmp_, files, keys[i]);
+      if (index < files.size() &&
+          ucmp->Compare(user_key, UserKey(files[index]->smallest)) >= 0)
+        candidates.emplace_back(index, i);
+    }
+    std::sort(candidates.begin(), candidates.end());
+    for (size_t c = 0; c < candidates.size();) {
+      const size_t index = candidates[c].first;
+      pending.clear();
+      for (; c < candidates.size() && candidates[c].first == index; c++)
+        pending.push_back(candidates[c].second);
+      search(files[index], pending);
+    }
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    if (!found[i])
+      statuses[i] = Status::NotFound(Slice());
+  }
+}
+
+bool Version::getFromTable(const ReadOptions &options, const FileMetaData *f,
+                           const Slice &key, std::string *value,
+                           Status *s) const {
+  TableCache *table_cache = vset_->table_cache_.get();
+  std::shared_ptr<SSTable> table =
+      table_cache->Get(f->number, f->file_size, s);
+  if (!*s)
+    return true;
+
+  // A range tombstone of the table covering the user key deletes it, unless
+  // the table has a newer entry of it. The older tables have none.
+  const Comparator *ucmp = vset_->icmp_->user_comparator();
+  const Slice user_key(key.RawData(), key.Len() - 8);
+  const SequenceNumber sequence = InternalKey(key).sequence;
+  SequenceNumber covering = 0;
+  if (f->num_range_tombstones > 0) {
+    auto tombstones = table->FragmentedTombstones(ucmp);
+    if (tombstones)
+      covering = tombstones->MaxCoveringSequence(user_key, sequence);
+  }
+  auto covered = [&]() {
+    if (covering == 0)
+      return false;
+    *s = Status::NotFound(Slice());
+    return true;
+  };
+  // The entry of the user key visible to "key" is found.
+  auto found = [&](ValueType type, SequenceNumber entry_sequence,
+                   const Slice &entry_value) {
+    if (type == kTypeDeletion || entry_sequence < covering) {
+      *s = Status::NotFound(Slice());
+    } else if (type == kTypeBlobIndex) {
+      BlobIndex index;
+      if (!index.DecodeFrom(entry_value))
+        *s = Status::Corruption("bad blob index in table ") << f->number;
+      else
+        *s = vset_->blob_cache_->Get(options, index, value);
+    } else {
+      value->assign(entry_value.RawData(), entry_value.Len());
+    }
+    return true;
+  };
+
+  // The row cache keeps the newest entry of the user key in the table, which
+  // is the one visible to "key" unless it's newer than "key", e.g. in a read
+  // as of an old snapshot, which then searches the table.
+  std::shared_ptr<const CachedRow> row;
+  if (table_cache->TableOptions().row_cache) {
+    row = table_cache->LookupRow(f->number, user_key);
+    if (!row) {
+      InternalKeyBuf newest(user_key, kMaxSequenceNumber, kTypeValue);
+      std::shared_ptr<CachedRow> read = std::make_shared<CachedRow>();
+      read->found = false;
+      if (table->PrefixMayMatch(options, newest.Data())) {
+        auto it = table->lower_bound(options, newest.Data());
+        if (!(*s = it.Stat()))
+          return true;
+        if (it != table->end()) {
+          InternalKey ikey(it.Key());
+          if (ucmp->Compare(ikey.user_key, user_key) == 0) {
+            read->found = true;
+            read->type = ikey.type;
+            read->sequence = ikey.sequence;
+            read->value.assign(it.Value().RawData(), it.Value().Len());
+          }
+        }
+      }
+      if (options.fill_cache)
+        table_cache->InsertRow(f->number, user_key, read);
+      row = std::move(read);
+    }
+    if (!row->found)
+      return covered();
+    if (f->global_sequence > sequence)
+      return false;
+    if (row->sequence <= sequence)
+      return found(row->type, row->sequence, row->value);
+  }
+
+  // The whole internal keys in the filters never match a lookup key, which
+  // differs in sequence, while the prefixes of the user keys do.
+  if (!table->PrefixMayMatch(options, key))
+    return covered();
+  auto it = table->lower_bound(options, key);
+  if (!(*s = it.Stat()))
+    return true;
+  if (it == table->end())
+    return covered();
+  InternalKey ikey(it.Key());
+  if (ucmp->Compare(ikey.user_key, user_key) != 0)
+    return covered();
+  // The single entry of the user key in an ingested table is stored with
+  // sequence 0, which sorts it after the lookup key whatever the snapshot.
+  if (f->global_sequence > sequence)
+    return false;
+  return found(ikey.type, ikey.sequence, it.Value());
+}
+
+}  // namespace lessdb
@@ -0,0 +1,151 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Config.h"
+#include "Disallowcopying.h"
+#include "FileMetaData.h"
+#include "SliceFwd.h"
+#include "Status.h"
+
+namespace lessdb {
+
+class Compaction;
+class InternalKeyComparator;
+class VersionSet;
+struct ReadOptions;
+
+// A Version is an immutable snapshot of the set of sstables in each level,
+// kept alive by reference counting as long as it's used, e.g by a
+// compaction reading its inputs.
+//
+// Level-0 files may overlap each other, and are sorted by their numbers,
+// i.e the newest file comes last. The files of the other levels are disjoint
+// and sorted by their key ranges.
+class Version {
+  __DISALLOW_COPYING__(Version);
+
+ public:
+  // Reference count management (so Versions do not disappear out from under
+  // live iterators).
+  // REQUIRES: The mutex of the database is held.
+  void Ref();
+  void Unref();
+
+  int NumFiles(int level) const {
+    return static_cast<int>(files_[level].size());
+  }
+
+  const std::vector<FileMetaData *> &Files(int level) const {
+    return files_[level];
+  }
+
+  // The live blob files, keyed by number. @see Options::min_blob_size
+  const std::map<uint64_t, BlobFileMetaData> &BlobFiles() const {
+    return blob_files_;
+  }
+
+  // Stores in "*inputs" all files in "level" that overlap [begin,end], both
+  // encoded internal keys. A NULL begin is before all keys, a NULL end is
+  // after all keys. The range of level-0 is expanded by the overlapping
+  // files, since they may overlap each other.
+  void GetOverlappingInputs(int level, const Slice *begin, const Slice *end,
+                            std::vector<FileMetaData *> *inputs);
+
+  // Returns true iff some file in "level" overlaps some part of
+  // [smallest_user_key,largest_user_key].
+  bool OverlapInLevel(int level, const Slice &smallest_user_key,
+                      const Slice &largest_user_key) const;
+
+  // Looks up the newest entry of the user key of "key", an encoded
+  // InternalKey, with a sequence no greater than that of "key" in the
+  // sstables of this version, searching level-0 from the newest file. Stores
+  // the value in *value if the entry is found, read from its blob file if
+  // it's separated, returns NotFound if it's a deletion, it's older than a
+  // range tombstone covering the user key, or there's no such entry.
+  // REQUIRES: This version is referenced, the mutex of the database needn't
+  // be held.
+  Status Get(const ReadOptions &options, const Slice &key,
+             std::string *value) const;
+
+  // Looks up keys[0, n-1], encoded InternalKeys, as Get does, and stores the
+  // result of keys[i] in values[i] and statuses[i]. The keys are searched
+  // level after level, the level-0 files from the newest, each by those not
+  // found yet, and the data blocks a table is searched for are prefetched in
+  // one batch first (see SSTable::Prefetch).
+  // REQUIRES: the same as Get.
+  void MultiGet(const ReadOptions &options, const Slice *keys, size_t n,
+                std::string *values, Status *statuses) const;
+
+ private:
+  friend class Compaction;
+  friend class VersionSet;
+
+  explicit Version(VersionSet *vset)
+      : vset_(vset),
+        next_(this),
+        prev_(this),
+        refs_(0),
+        compaction_score_(-1),
+        compaction_level_(-1) {}
+
+  ~Version();
+
+  // Looks up "key" in the sstable "f" as Get does. Returns true if the table
+  // has an entry of the user key, or a range tombstone covering it, whose
+  // result is stored in *s.
+  bool getFromTable(const ReadOptions &options, const FileMetaData *f,
+                    const Slice &key, std::string *value, Status *s) const;
+
+ private:
+  VersionSet *vset_;  // VersionSet to which this Version belongs
+  Version *next_;     // Next version in linked list
+  Version *prev_;     // Previous version in linked list
+  int refs_;          // Number of live refs to this version
+
+  // List of files per level
+  std::vector<FileMetaData *> files_[config::kNumLevels];
+
+  // Blob files whose blobs are not all garbage yet.
+  std::map<uint64_t, BlobFileMetaData> blob_files_;
+
+  // Level that should be compacted next and its compaction score.
+  // Score < 1 means compaction is not strictly needed. These fields
+  // are initialized by VersionSet::finalize().
+  double compaction_score_;
+  int compaction_level_;
+};
+
+// Returns the smallest index i such that files[i]->largest >= key.
+// Returns files.size() if there is no such file.
+// REQUIRES: "files" contains a sorted list of non-overlapping files.
+extern size_t FindFile(const InternalKeyComparator &icmp,
+                       const std::vector<FileMetaData *> &files,
+                       const Slice &key);
+
+}  // namespace lessdb
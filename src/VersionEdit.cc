@@ -0,0 +1,234 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <exception>
+#include <stdexcept>
+
+#include "Coding.h"
+#include "Config.h"
+#include "VersionEdit.h"
+
+namespace lessdb {
+
+// Tag numbers for serialized VersionEdit. These numbers are written to
+// disk and should not be changed.
+enum Tag {
+  kComparator = 1,
+  kLogNumber = 2,
+  kNextFileNumber = 3,
+  kLastSequence = 4,
+  kCompactPointer = 5,
+  kDeletedFile = 6,
+  kNewFile = 7,
+  // A kNewFile followed by the global sequence of an ingested file.
+  kIngestedFile = 8,
+  kBlobFile = 9,
+  kBlobGarbage = 10,
+  // A kNewFile followed by the number of range tombstones of the file.
+  kRangeDelFile = 11,
+};
+
+void VersionEdit::Clear() {
+  comparator_.clear();
+  log_number_ = 0;
+  last_sequence_ = 0;
+  next_file_number_ = 0;
+  has_comparator_ = false;
+  has_log_number_ = false;
+  has_next_file_number_ = false;
+  has_last_sequence_ = false;
+  compact_pointers_.clear();
+  deleted_files_.clear();
+  new_files_.clear();
+  new_blob_files_.clear();
+  blob_garbage_.clear();
+}
+
+// edit := (tag field*)*
+// Every tag and integer field is a varint, every key is a varstring.
+void VersionEdit::EncodeTo(std::string *dst) const {
+  if (has_comparator_) {
+    coding::AppendVar32(dst, kComparator);
+    coding::AppendVarString(dst, comparator_);
+  }
+  if (has_log_number_) {
+    coding::AppendVar32(dst, kLogNumber);
+    coding::AppendVar64(dst, log_number_);
+  }
+  if (has_next_file_number_) {
+    coding::AppendVar32(dst, kNextFileNumber);
+    coding::AppendVar64(dst, next_file_number_);
+  }
+  if (has_last_sequence_) {
+    coding::AppendVar32(dst, kLastSequence);
+    coding::AppendVar64(dst, last_sequence_);
+  }
+
+  for (const auto &p : compact_pointers_) {
+    coding::AppendVar32(dst, kCompactPointer);
+    coding::AppendVar32(dst, static_cast<uint32_t>(p.first));
+    coding::AppendVarString(dst, p.second);
+  }
+
+  for (const auto &p : deleted_files_) {
+    coding::AppendVar32(dst, kDeletedFile);
+    coding::AppendVar32(dst, static_cast<uint32_t>(p.first));
+    coding::AppendVar64(dst, p.second);
+  }
+
+  for (const auto &p : new_files_) {
+    const FileMetaData &f = p.second;
+    Tag tag = kNewFile;
+    if (f.global_sequence)
+      tag = kIngestedFile;
+    else if (f.num_range_tombstones)
+      tag = kRangeDelFile;
+    coding::AppendVar32(dst, tag);
+    coding::AppendVar32(dst, static_cast<uint32_t>(p.first));
+    coding::AppendVar64(dst, f.number);
+    coding::AppendVar64(dst, f.file_size);
+    coding::AppendVarString(dst, f.smallest);
+    coding::AppendVarString(dst, f.largest);
+    if (f.global_sequence)
+      coding::AppendVar64(dst, f.global_sequence);
+    else if (f.num_range_tombstones)
+      coding::AppendVar64(dst, f.num_range_tombstones);
+  }
+
+  for (const BlobFileMetaData &f : new_blob_files_) {
+    coding::AppendVar32(dst, kBlobFile);
+    coding::AppendVar64(dst, f.number);
+    coding::AppendVar64(dst, f.total_count);
+    coding::AppendVar64(dst, f.total_bytes);
+  }
+
+  for (const BlobFileMetaData &f : blob_garbage_) {
+    coding::AppendVar32(dst, kBlobGarbage);
+    coding::AppendVar64(dst, f.number);
+    coding::AppendVar64(dst, f.garbage_count);
+    coding::AppendVar64(dst, f.garbage_bytes);
+  }
+}
+
+static int GetLevel(Slice *input) {
+  uint32_t v;
+  coding::GetVar32(input, &v);
+  if (v >= static_cast<uint32_t>(config::kNumLevels)) {
+    throw std::invalid_argument("level larger than kNumLevels");
+  }
+  return static_cast<int>(v);
+}
+
+static std::string GetKey(Slice *input) {
+  Slice str;
+  coding::GetVarString(input, &str);
+  return str.ToString();
+}
+
+Status VersionEdit::DecodeFrom(const Slice &src) {
+  Clear();
+  Slice input = src;
+  try {
+    while (!input.Empty()) {
+      uint32_t tag;
+      coding::GetVar32(&input, &tag);
+      switch (tag) {
+        case kComparator:
+          comparator_ = GetKey(&input);
+          has_comparator_ = true;
+          break;
+
+        case kLogNumber:
+          coding::GetVar64(&input, &log_number_);
+          has_log_number_ = true;
+          break;
+
+        case kNextFileNumber:
+          coding::GetVar64(&input, &next_file_number_);
+          has_next_file_number_ = true;
+          break;
+
+        case kLastSequence:
+          coding::GetVar64(&input, &last_sequence_);
+          has_last_sequence_ = true;
+          break;
+
+        case kCompactPointer: {
+          int level = GetLevel(&input);
+          compact_pointers_.push_back(std::make_pair(level, GetKey(&input)));
+          break;
+        }
+
+        case kDeletedFile: {
+          int level = GetLevel(&input);
+          uint64_t number;
+          coding::GetVar64(&input, &number);
+          deleted_files_.insert(std::make_pair(level, number));
+          break;
+        }
+
+        case kNewFile:
+        case kIngestedFile:
+        case kRangeDelFile: {
+          int level = GetLevel(&input);
+          FileMetaData f;
+          coding::GetVar64(&input, &f.number);
+          coding::GetVar64(&input, &f.file_size);
+          f.smallest = GetKey(&input);
+          f.largest = GetKey(&input);
+          if (tag == kIngestedFile)
+            coding::GetVar64(&input, &f.global_sequence);
+          if (tag == kRangeDelFile)
+            coding::GetVar64(&input, &f.num_range_tombstones);
+          new_files_.push_back(std::make_pair(level, f));
+          break;
+        }
+
+        case kBlobFile: {
+          BlobFileMetaData f;
+          coding::GetVar64(&input, &f.number);
+          coding::GetVar64(&input, &f.total_count);
+          coding::GetVar64(&input, &f.total_bytes);
+          new_blob_files_.push_back(f);
+          break;
+        }
+
+        case kBlobGarbage: {
+          BlobFileMetaData f;
+          coding::GetVar64(&input, &f.number);
+          coding::GetVar64(&input, &f.garbage_count);
+          coding::GetVar64(&input, &f.garbage_bytes);
+          blob_garbage_.push_back(f);
+          break;
+        }
+
+        default:
+          return Status::Corruption("VersionEdit: unknown tag");
+      }
+    }
+  } catch (std::exception &e) {
+    return Status::Corruption("VersionEdit: ") << e.what();
+  }
+  return Status::OK();
+}
+
+}  // namespace lessdb
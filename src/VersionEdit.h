@@ -0,0 +1,147 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "DBFormat.h"
+#include "FileMetaData.h"
+#include "Slice.h"
+#include "Status.h"
+
+namespace lessdb {
+
+class VersionSet;
+
+// A VersionEdit is a change to the set of files in the database, along with
+// the states that must be persisted with it. The edits are appended to the
+// manifest as log records, and replayed in order on recovery.
+class VersionEdit {
+ public:
+  VersionEdit() {
+    Clear();
+  }
+
+  void Clear();
+
+  void SetComparatorName(const Slice &name) {
+    has_comparator_ = true;
+    comparator_ = name.ToString();
+  }
+
+  // The logs numbered less than "num" are no longer needed.
+  void SetLogNumber(uint64_t num) {
+    has_log_number_ = true;
+    log_number_ = num;
+  }
+
+  void SetNextFile(uint64_t num) {
+    has_next_file_number_ = true;
+    next_file_number_ = num;
+  }
+
+  void SetLastSequence(SequenceNumber seq) {
+    has_last_sequence_ = true;
+    last_sequence_ = seq;
+  }
+
+  // The next compaction of "level" starts after the encoded internal "key".
+  void SetCompactPointer(int level, const Slice &key) {
+    compact_pointers_.push_back(std::make_pair(level, key.ToString()));
+  }
+
+  // Adds the specified file at the specified level.
+  // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
+  // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
+  // @see FileMetaData::global_sequence, FileMetaData::num_range_tombstones
+  // REQUIRES: An ingested file has no range tombstones.
+  void AddFile(int level, uint64_t file, uint64_t file_size,
+               const Slice &smallest, const Slice &largest,
+               SequenceNumber global_sequence = 0,
+               uint64_t num_range_tombstones = 0) {
+    assert(global_sequence == 0 || num_range_tombstones == 0);
+    FileMetaData f;
+    f.number = file;
+    f.file_size = file_size;
+    f.smallest = smallest.ToString();
+    f.largest = largest.ToString();
+    f.global_sequence = global_sequence;
+    f.num_range_tombstones = num_range_tombstones;
+    new_files_.push_back(std::make_pair(level, f));
+  }
+
+  // Removes the specified file from the specified level.
+  void RemoveFile(int level, uint64_t file) {
+    deleted_files_.insert(std::make_pair(level, file));
+  }
+
+  // Adds the blob file "file" holding "count" blobs of "bytes" in total.
+  void AddBlobFile(uint64_t file, uint64_t count, uint64_t bytes) {
+    BlobFileMetaData f;
+    f.number = file;
+    f.total_count = count;
+    f.total_bytes = bytes;
+    new_blob_files_.push_back(f);
+  }
+
+  // Records that "count" blobs of "bytes" in total of the blob file "file" are
+  // no longer referenced, i.e their index entries were dropped or relocated
+  // by a compaction.
+  void AddBlobGarbage(uint64_t file, uint64_t count, uint64_t bytes) {
+    BlobFileMetaData f;
+    f.number = file;
+    f.garbage_count = count;
+    f.garbage_bytes = bytes;
+    blob_garbage_.push_back(f);
+  }
+
+  void EncodeTo(std::string *dst) const;
+
+  Status DecodeFrom(const Slice &src);
+
+ private:
+  friend class VersionSet;
+
+  typedef std::set<std::pair<int, uint64_t>> DeletedFileSet;
+
+  std::string comparator_;
+  uint64_t log_number_;
+  uint64_t next_file_number_;
+  SequenceNumber last_sequence_;
+  bool has_comparator_;
+  bool has_log_number_;
+  bool has_next_file_number_;
+  bool has_last_sequence_;
+
+  std::vector<std::pair<int, std::string>> compact_pointers_;
+  DeletedFileSet deleted_files_;
+  std::vector<std::pair<int, FileMetaData>> new_files_;
+  std::vector<BlobFileMetaData> new_blob_files_;
+  std::vector<BlobFileMetaData> blob_garbage_;
+};
+
+}  // namespace lessdb
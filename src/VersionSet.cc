@@ -0,0 +1,810 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "Comparator.h"
+#include "Compaction.h"
+#include "FileName.h"
+#include "FileUtils.h"
+#include "InternalKey.h"
+#include "LogReader.h"
+#include "LogWriter.h"
+#include "VersionEdit.h"
+#include "VersionSet.h"
+
+namespace lessdb {
+
+static uint64_t TotalFileSize(const std::vector<FileMetaData *> &files) {
+  uint64_t sum = 0;
+  for (const FileMetaData *f : files) {
+    sum += f->file_size;
+  }
+  return sum;
+}
+
+// Adds to *inputs the files of "level_files" that the entries of the
+// largest user key of *inputs spill over into. The versions of a user key
+// kept for the snapshots may be split between adjacent files of a level, a
+// compaction that pushes down the newer ones alone would leave the older
+// ones above them, to be found first by lookups.
+static void AddBoundaryInputs(const InternalKeyComparator &icmp,
+                              const std::vector<FileMetaData *> &level_files,
+                              std::vector<FileMetaData *> *inputs) {
+  if (inputs->empty())
+    return;
+  std::string largest = (*inputs)[0]->largest;
+  for (const FileMetaData *f : *inputs) {
+    if (icmp.Compare(Slice(f->largest), Slice(largest)) > 0)
+      largest = f->largest;
+  }
+
+  const Comparator *ucmp = icmp.user_comparator();
+  while (true) {
+    // The file that comes right after "largest", starting with the same
+    // user key.
+    FileMetaData *boundary = nullptr;
+    const Slice user_key(largest.data(), largest.size() - 8);
+    for (FileMetaData *f : level_files) {
+      const Slice smallest(f->smallest);
+      if (icmp.Compare(smallest, Slice(largest)) > 0 &&
+          ucmp->Compare(Slice(smallest.RawData(), smallest.Len() - 8),
+                        user_key) == 0 &&
+          (boundary == nullptr ||
+           icmp.Compare(smallest, Slice(boundary->smallest)) < 0)) {
+        boundary = f;
+      }
+    }
+    if (boundary == nullptr)
+      break;
+    inputs->push_back(boundary);
+    largest = boundary->largest;
+  }
+}
+
+// A helper class so we can efficiently apply a whole sequence
+// of edits to a particular state without creating intermediate
+// Versions that contain full copies of the intermediate state.
+class VersionSet::Builder {
+ private:
+  // Helper to sort by v->files_[file_number].smallest
+  struct BySmallestKey {
+    const InternalKeyComparator *internal_comparator;
+
+    bool operator()(FileMetaData *f1, FileMetaData *f2) const {
+      int r = internal_comparator->Compare(Slice(f1->smallest),
+                                           Slice(f2->smallest));
+      if (r != 0) {
+        return (r < 0);
+      } else {
+        // Break ties by file number
+        return (f1->number < f2->number);
+      }
+    }
+  };
+
+  typedef std::set<FileMetaData *, BySmallestKey> FileSet;
+  struct LevelState {
+    std::set<uint64_t> deleted_files;
+    FileSet *added_files;
+  };
+
+  VersionSet *vset_;
+  Version *base_;
+  LevelState levels_[config::kNumLevels];
+  std::map<uint64_t, BlobFileMetaData> blob_files_;
+
+ public:
+  // Initialize a builder with the files from *base and other info from *vset
+  Builder(VersionSet *vset, Version *base)
+      : vset_(vset), base_(base), blob_files_(base->blob_files_) {
+    base_->Ref();
+    BySmallestKey cmp;
+    cmp.internal_comparator = vset_->icmp_;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      levels_[level].added_files = new FileSet(cmp);
+    }
+  }
+
+  ~Builder() {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      const FileSet *added = levels_[level].added_files;
+      std::vector<FileMetaData *> to_unref(added->begin(), added->end());
+      delete added;
+      for (FileMetaData *f : to_unref) {
+        f->refs--;
+        if (f->refs <= 0) {
+          delete f;
+        }
+      }
+    }
+    base_->Unref();
+  }
+
+  // Apply all of the edits in *edit to the current state.
+  void Apply(const VersionEdit *edit) {
+    // Update compaction pointers
+    for (const auto &p : edit->compact_pointers_) {
+      vset_->compact_pointer_[p.first] = p.second;
+    }
+
+    // Delete files
+    for (const auto &p : edit->deleted_files_) {
+      levels_[p.first].deleted_files.insert(p.second);
+    }
+
+    // Add new files
+    for (const auto &p : edit->new_files_) {
+      const int level = p.first;
+      FileMetaData *f = new FileMetaData(p.second);
+      f->refs = 1;
+      levels_[level].deleted_files.erase(f->number);
+      levels_[level].added_files->insert(f);
+    }
+
+    for (const BlobFileMetaData &f : edit->new_blob_files_) {
+      blob_files_[f.number] = f;
+    }
+
+    // Garbage of a blob file accumulates until the whole file is garbage.
+    for (const BlobFileMetaData &g : edit->blob_garbage_) {
+      auto it = blob_files_.find(g.number);
+      if (it != blob_files_.end()) {
+        it->second.garbage_count += g.garbage_count;
+        it->second.garbage_bytes += g.garbage_bytes;
+      }
+    }
+  }
+
+  // Save the current state in *v.
+  void SaveTo(Version *v) {
+    BySmallestKey cmp;
+    cmp.internal_comparator = vset_->icmp_;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      // Merge the set of added files with the set of pre-existing files.
+      // Drop any deleted files.  Store the result in *v.
+      const std::vector<FileMetaData *> &base_files = base_->files_[level];
+      auto base_iter = base_files.begin();
+      auto base_end = base_files.end();
+      const FileSet *added = levels_[level].added_files;
+      v->files_[level].reserve(base_files.size() + added->size());
+      for (FileMetaData *added_file : *added) {
+        // Add all smaller files listed in base_
+        for (auto bpos = std::upper_bound(base_iter, base_end, added_file, cmp);
+             base_iter != bpos; ++base_iter) {
+          maybeAddFile(v, level, *base_iter);
+        }
+        maybeAddFile(v, level, added_file);
+      }
+
+      // Add remaining base files
+      for (; base_iter != base_end; ++base_iter) {
+        maybeAddFile(v, level, *base_iter);
+      }
+
+#ifndef NDEBUG
+      // Make sure there is no overlap in levels > 0
+      if (level > 0) {
+        for (size_t i = 1; i < v->files_[level].size(); i++) {
+          const std::string &prev_end = v->files_[level][i - 1]->largest;
+          const std::string &this_begin = v->files_[level][i]->smallest;
+          assert(vset_->icmp_->Compare(Slice(prev_end), Slice(this_begin)) <
+                 0);
+        }
+      }
+#endif
+    }
+
+    for (const auto &p : blob_files_) {
+      if (!p.second.IsObsolete()) {
+        v->blob_files_.insert(p);
+      }
+    }
+  }
+
+ private:
+  void maybeAddFile(Version *v, int level, FileMetaData *f) {
+    if (levels_[level].deleted_files.count(f->number) > 0) {
+      // File is deleted: do nothing
+    } else {
+      f->refs++;
+      v->files_[level].push_back(f);
+    }
+  }
+};
+
+VersionSet::VersionSet(const std::string &dbname, const Options *options,
+                       const InternalKeyComparator *icmp,
+                       FileFactory *factory)
+    : dbname_(dbname),
+      options_(options),
+      icmp_(icmp),
+      file_factory_(factory),
+      table_cache_(new TableCache(
+          dbname, *options, icmp, factory,
+          std::max(options->max_open_files - config::kNumNonTableCacheFiles,
+                   1))),
+      blob_cache_(new BlobFileCache(
+          dbname, factory,
+          std::max(options->max_open_files - config::kNumNonTableCacheFiles,
+                   1))),
+      next_file_number_(2),
+      manifest_file_number_(0),  // Filled by Recover()
+      last_sequence_(0),
+      log_number_(0),
+      writing_manifest_(false),
+      dummy_versions_(this),
+      current_(nullptr) {
+  appendVersion(new Version(this));
+}
+
+VersionSet::~VersionSet() {
+  current_->Unref();
+  assert(dummy_versions_.next_ == &dummy_versions_);  // List must be empty
+  descriptor_log_.reset();
+  if (descriptor_file_) {
+    descriptor_file_->Close();
+  }
+}
+
+void VersionSet::appendVersion(Version *v) {
+  // Make "v" current
+  assert(v->refs_ == 0);
+  assert(v != current_);
+  if (current_ != nullptr) {
+    current_->Unref();
+  }
+  current_ = v;
+  v->Ref();
+
+  // Append to linked list
+  v->prev_ = dummy_versions_.prev_;
+  v->next_ = &dummy_versions_;
+  v->prev_->next_ = v;
+  v->next_->prev_ = v;
+}
+
+Status VersionSet::LogAndApply(VersionEdit *edit,
+                               std::unique_lock<std::mutex> *lock) {
+  while (writing_manifest_) {
+    manifest_cv_.wait(*lock);
+  }
+  writing_manifest_ = true;
+
+  if (edit->has_log_number_) {
+    assert(edit->log_number_ >= log_number_);
+    assert(edit->log_number_ < next_file_number_);
+  } else {
+    edit->SetLogNumber(log_number_);
+  }
+  edit->SetNextFile(next_file_number_);
+  edit->SetLastSequence(last_sequence_);
+
+  Version *v = new Version(this);
+  {
+    Builder builder(this, current_);
+    builder.Apply(edit);
+    builder.SaveTo(v);
+  }
+  finalize(v);
+
+  // Initialize new descriptor log file if necessary by creating
+  // a temporary file that contains a snapshot of the current version.
+  std::string new_manifest_file;
+  Status s;
+  if (!descriptor_log_) {
+    new_manifest_file = DescriptorFileName(dbname_, manifest_file_number_);
+    descriptor_file_.reset(
+        file_factory_->NewWritableFile(new_manifest_file, &s));
+    if (s) {
+      descriptor_log_.reset(new log::Writer(descriptor_file_.get()));
+      s = writeSnapshot(descriptor_log_.get());
+    }
+  }
+
+  // Unlock during expensive MANIFEST log write
+  {
+    std::string record;
+    edit->EncodeTo(&record);
+    lock->unlock();
+
+    // Write new record to MANIFEST log
+    if (s) {
+      s = descriptor_log_->WriteRecord(record);
+      if (s) {
+        s = descriptor_log_->Sync();
+      }
+    }
+
+    // If we just created a new descriptor file, install it by writing a
+    // new CURRENT file that points to it.
+    if (s && !new_manifest_file.empty()) {
+      s = SetCurrentFile(file_factory_, dbname_, manifest_file_number_);
+    }
+
+    lock->lock();
+  }
+
+  // Install the new version
+  if (s) {
+    appendVersion(v);
+    log_number_ = edit->log_number_;
+  } else {
+    delete v;
+    if (!new_manifest_file.empty()) {
+      descriptor_log_.reset();
+      if (descriptor_file_) {
+        descriptor_file_->Close();
+        descriptor_file_.reset();
+      }
+      file_factory_->DeleteFile(new_manifest_file);
+    }
+  }
+  writing_manifest_ = false;
+  manifest_cv_.notify_all();
+  return s;
+}
+
+Status VersionSet::Recover() {
+  struct LogReporter : public log::Reader::Reporter {
+    Status *status;
+
+    void Corruption(size_t bytes, const Status &s) override {
+      if (*status)
+        *status = s;
+    }
+  };
+
+  // Read "CURRENT" file, which contains a pointer to the current manifest
+  // file
+  std::string current;
+  Status s = file_factory_->ReadFileToString(CurrentFileName(dbname_),
+                                             &current);
+  if (!s) {
+    return s;
+  }
+  if (current.empty() || current.back() != '\n') {
+    return Status::Corruption("CURRENT file does not end with newline");
+  }
+  current.pop_back();
+
+  std::string dscname = dbname_ + "/" + current;
+  std::unique_ptr<SequentialFile> file(
+      file_factory_->NewSequentialFile(dscname, &s));
+  if (!s) {
+    return s;
+  }
+
+  bool have_log_number = false;
+  bool have_next_file = false;
+  bool have_last_sequence = false;
+  uint64_t next_file = 0;
+  uint64_t last_sequence = 0;
+  uint64_t log_number = 0;
+  Builder builder(this, current_);
+
+  {
+    LogReporter reporter;
+    reporter.status = &s;
+    log::Reader reader(file.get(), &reporter, true);
+    Slice record;
+    std::string scratch;
+    while (reader.ReadRecord(&record, &scratch) && s) {
+      VersionEdit edit;
+      s = edit.DecodeFrom(record);
+      if (s && edit.has_comparator_ &&
+          edit.comparator_ != icmp_->user_comparator()->Name()) {
+        s = Status::InvalidArgument(edit.comparator_ +
+                                    " does not match existing comparator ") <<
+            icmp_->user_comparator()->Name();
+      }
+
+      if (s) {
+        builder.Apply(&edit);
+      }
+
+      if (edit.has_log_number_) {
+        log_number = edit.log_number_;
+        have_log_number = true;
+      }
+
+      if (edit.has_next_file_number_) {
+        next_file = edit.next_file_number_;
+        have_next_file = true;
+      }
+
+      if (edit.has_last_sequence_) {
+        last_sequence = edit.last_sequence_;
+        have_last_sequence = true;
+      }
+    }
+  }
+  file.reset();
+
+  if (s) {
+    if (!have_next_file) {
+      s = Status::Corruption("no meta-nextfile entry in descriptor");
+    } else if (!have_log_number) {
+      s = Status::Corruption("no meta-lognumber entry in descriptor");
+    } else if (!have_last_sequence) {
+      s = Status::Corruption("no last-sequence-number entry in descriptor");
+    }
+  }
+  if (!s) {
+    return s;
+  }
+
+  Version *v = new Version(this);
+  builder.SaveTo(v);
+  finalize(v);
+  appendVersion(v);
+
+  // A new manifest is started by the next LogAndApply.
+  manifest_file_number_ = next_file;
+  next_file_number_ = next_file + 1;
+  last_sequence_ = last_sequence;
+  log_number_ = log_number;
+  MarkFileNumberUsed(log_number);
+  return s;
+}
+
+double VersionSet::maxBytesForLevel(int level) const {
+  // Note: the result for level zero is not really used since we set
+  // the level-0 compaction threshold based on number of files.
+
+  // Result for both level-0 and level-1
+  double result = static_cast<double>(options_->max_bytes_for_level_base);
+  while (level > 1) {
+    result *= config::kLevelSizeMultiplier;
+    level--;
+  }
+  return result;
+}
+
+void VersionSet::finalize(Version *v) {
+  // Precomputed best level for next compaction
+  int best_level = -1;
+  double best_score = -1;
+
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    double score;
+    if (level == 0) {
+      // We treat level-0 specially by bounding the number of files
+      // instead of number of bytes for two reasons:
+      //
+      // (1) With larger write-buffer sizes, it is nice not to do too
+      // many level-0 compactions.
+      //
+      // (2) The files in level-0 are merged on every read and
+      // therefore we wish to avoid too many files when the individual
+      // file size is small (perhaps because of a small write-buffer
+      // setting, or very high compression ratios, or lots of
+      // overwrites/deletions).
+      score = static_cast<double>(v->files_[level].size()) /
+              static_cast<double>(config::kL0_CompactionTrigger);
+    } else {
+      // Compute the ratio of current size to size limit.
+      const uint64_t level_bytes = TotalFileSize(v->files_[level]);
+      score = static_cast<double>(level_bytes) / maxBytesForLevel(level);
+    }
+
+    if (score > best_score) {
+      best_level = level;
+      best_score = score;
+    }
+  }
+
+  v->compaction_level_ = best_level;
+  v->compaction_score_ = best_score;
+}
+
+Status VersionSet::writeSnapshot(log::Writer *log) {
+  // Save metadata
+  VersionEdit edit;
+  edit.SetComparatorName(icmp_->user_comparator()->Name());
+
+  // Save compaction pointers
+  for (int level = 0; level < config::kNumLevels; level++) {
+    if (!compact_pointer_[level].empty()) {
+      edit.SetCompactPointer(level, compact_pointer_[level]);
+    }
+  }
+
+  // Save files
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (const FileMetaData *f : current_->files_[level]) {
+      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest,
+                   f->global_sequence, f->num_range_tombstones);
+    }
+  }
+
+  // Save blob files, along with their garbage so far
+  for (const auto &p : current_->blob_files_) {
+    const BlobFileMetaData &f = p.second;
+    edit.AddBlobFile(f.number, f.total_count, f.total_bytes);
+    if (f.garbage_count > 0) {
+      edit.AddBlobGarbage(f.number, f.garbage_count, f.garbage_bytes);
+    }
+  }
+
+  std::string record;
+  edit.EncodeTo(&record);
+  return log->WriteRecord(record);
+}
+
+uint64_t VersionSet::NumLevelBytes(int level) const {
+  assert(level >= 0);
+  assert(level < config::kNumLevels);
+  return TotalFileSize(current_->files_[level]);
+}
+
+void VersionSet::AddLiveFiles(std::set<uint64_t> *live) {
+  for (Version *v = dummy_versions_.next_; v != &dummy_versions_;
+       v = v->next_) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      for (const FileMetaData *f : v->files_[level]) {
+        live->insert(f->number);
+      }
+    }
+    for (const auto &p : v->blob_files_) {
+      live->insert(p.first);
+    }
+  }
+}
+
+void VersionSet::getRange(const std::vector<FileMetaData *> &inputs,
+                          std::string *smallest, std::string *largest) {
+  assert(!inputs.empty());
+  smallest->clear();
+  largest->clear();
+  for (size_t i = 0; i < inputs.size(); i++) {
+    const FileMetaData *f = inputs[i];
+    if (i == 0) {
+      *smallest = f->smallest;
+      *largest = f->largest;
+    } else {
+      if (icmp_->Compare(Slice(f->smallest), Slice(*smallest)) < 0) {
+        *smallest = f->smallest;
+      }
+      if (icmp_->Compare(Slice(f->largest), Slice(*largest)) > 0) {
+        *largest = f->largest;
+      }
+    }
+  }
+}
+
+void VersionSet::getRange2(const std::vector<FileMetaData *> &inputs1,
+                           const std::vector<FileMetaData *> &inputs2,
+                           std::string *smallest, std::string *largest) {
+  std::vector<FileMetaData *> all = inputs1;
+  all.insert(all.end(), inputs2.begin(), inputs2.end());
+  getRange(all, smallest, largest);
+}
+
+Compaction *VersionSet::PickCompaction() {
+  // We prefer compactions triggered by too much data in a level over
+  // the compactions triggered by seeks.
+  if (!NeedsCompaction()) {
+    return nullptr;
+  }
+
+  const int level = current_->compaction_level_;
+  assert(level >= 0);
+  assert(level + 1 < config::kNumLevels);
+  Compaction *c = new Compaction(options_, level);
+
+  // Pick the first file that comes after compact_pointer_[level]
+  for (FileMetaData *f : current_->files_[level]) {
+    if (compact_pointer_[level].empty() ||
+        icmp_->Compare(Slice(f->largest), Slice(compact_pointer_[level])) >
+            0) {
+      c->inputs_[0].push_back(f);
+      break;
+    }
+  }
+  if (c->inputs_[0].empty()) {
+    // Wrap-around to the beginning of the key space
+    c->inputs_[0].push_back(current_->files_[level][0]);
+  }
+
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+
+  // Files in level 0 may overlap each other, so pick up all overlapping ones
+  if (level == 0) {
+    std::string smallest, largest;
+    getRange(c->inputs_[0], &smallest, &largest);
+    Slice begin(smallest), end(largest);
+    // Note that the next call will discard the file we placed in
+    // c->inputs_[0] earlier and replace it with an overlapping set
+    // which will include the picked file.
+    current_->GetOverlappingInputs(0, &begin, &end, &c->inputs_[0]);
+    assert(!c->inputs_[0].empty());
+  }
+
+  setupOtherInputs(c);
+  return c;
+}
+
+void VersionSet::setupOtherInputs(Compaction *c) {
+  const int level = c->level();
+  AddBoundaryInputs(*icmp_, current_->files_[level], &c->inputs_[0]);
+  std::string smallest, largest;
+  getRange(c->inputs_[0], &smallest, &largest);
+
+  {
+    Slice begin(smallest), end(largest);
+    current_->GetOverlappingInputs(level + 1, &begin, &end, &c->inputs_[1]);
+  }
+
+  // Get entire range covered by compaction
+  std::string all_start, all_limit;
+  getRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
+
+  // See if we can grow the number of inputs in "level" without
+  // changing the number of "level+1" files we pick up.
+  if (!c->inputs_[1].empty()) {
+    std::vector<FileMetaData *> expanded0;
+    Slice begin(all_start), end(all_limit);
+    current_->GetOverlappingInputs(level, &begin, &end, &expanded0);
+    AddBoundaryInputs(*icmp_, current_->files_[level], &expanded0);
+    const uint64_t inputs1_size = TotalFileSize(c->inputs_[1]);
+    const uint64_t expanded0_size = TotalFileSize(expanded0);
+    if (expanded0.size() > c->inputs_[0].size() &&
+        inputs1_size + expanded0_size < 25 * options_->max_file_size) {
+      std::string new_start, new_limit;
+      getRange(expanded0, &new_start, &new_limit);
+      std::vector<FileMetaData *> expanded1;
+      Slice new_begin(new_start), new_end(new_limit);
+      current_->GetOverlappingInputs(level + 1, &new_begin, &new_end,
+                                     &expanded1);
+      if (expanded1.size() == c->inputs_[1].size()) {
+        smallest = new_start;
+        largest = new_limit;
+        c->inputs_[0] = expanded0;
+        c->inputs_[1] = expanded1;
+        getRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
+      }
+    }
+  }
+
+  // Compute the set of grandparent files that overlap this compaction
+  // (parent == level+1; grandparent == level+2)
+  if (level + 2 < config::kNumLevels) {
+    Slice begin(all_start), end(all_limit);
+    current_->GetOverlappingInputs(level + 2, &begin, &end,
+                                   &c->grandparents_);
+  }
+
+  // Update the place where we will do the next compaction for this level.
+  // We update this immediately instead of waiting for the VersionEdit
+  // to be applied so that if the compaction fails, we will try a different
+  // key range next time.
+  compact_pointer_[level] = largest;
+  c->edit_.SetCompactPointer(level, largest);
+}
+
+/// Compaction
+
+Compaction::Compaction(const Options *options, int level)
+    : level_(level),
+      max_output_file_size_(options->max_file_size),
+      max_grandparent_overlap_bytes_(10 * options->max_file_size),
+      input_version_(nullptr) {}
+
+Compaction::Cursor::Cursor()
+    : grandparent_index(0), seen_key(false), overlapped_bytes(0) {
+  for (int i = 0; i < config::kNumLevels; i++) {
+    level_ptrs[i] = 0;
+  }
+}
+
+Compaction::~Compaction() {
+  if (input_version_ != nullptr) {
+    input_version_->Unref();
+  }
+}
+
+bool Compaction::IsTrivialMove() const {
+  // Avoid a move if there is lots of overlapping grandparent data.
+  // Otherwise, the move could create a parent file that will require
+  // a very expensive merge later on.
+  return (num_input_files(0) == 1 && num_input_files(1) == 0 &&
+          TotalFileSize(grandparents_) <= max_grandparent_overlap_bytes_);
+}
+
+void Compaction::AddInputDeletions(VersionEdit *edit) {
+  for (int which = 0; which < 2; which++) {
+    for (const FileMetaData *f : inputs_[which]) {
+      edit->RemoveFile(level_ + which, f->number);
+    }
+  }
+}
+
+bool Compaction::IsBaseLevelForKey(const Slice &user_key,
+                                   Cursor *cursor) const {
+  // Maybe use binary search to find right entry instead of linear search?
+  const Comparator *user_cmp = input_version_->vset_->icmp_->user_comparator();
+  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+    const std::vector<FileMetaData *> &files = input_version_->files_[lvl];
+    while (cursor->level_ptrs[lvl] < files.size()) {
+      const FileMetaData *f = files[cursor->level_ptrs[lvl]];
+      Slice largest(f->largest.data(), f->largest.size() - 8);
+      if (user_cmp->Compare(user_key, largest) <= 0) {
+        // We've advanced far enough
+        Slice smallest(f->smallest.data(), f->smallest.size() - 8);
+        if (user_cmp->Compare(user_key, smallest) >= 0) {
+          // Key falls in this file's range, so definitely not base level
+          return false;
+        }
+        break;
+      }
+      cursor->level_ptrs[lvl]++;
+    }
+  }
+  return true;
+}
+
+bool Compaction::IsBaseLevelForRange(const Slice &begin,
+                                     const Slice &end) const {
+  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, begin, end))
+      return false;
+  }
+  return true;
+}
+
+bool Compaction::ShouldStopBefore(const Slice &internal_key,
+                                  Cursor *cursor) const {
+  const InternalKeyComparator *icmp = input_version_->vset_->icmp_;
+  // Scan to find earliest grandparent file that contains key.
+  while (cursor->grandparent_index < grandparents_.size() &&
+         icmp->Compare(
+             internal_key,
+             Slice(grandparents_[cursor->grandparent_index]->largest)) > 0) {
+    if (cursor->seen_key) {
+      cursor->overlapped_bytes +=
+          grandparents_[cursor->grandparent_index]->file_size;
+    }
+    cursor->grandparent_index++;
+  }
+  cursor->seen_key = true;
+
+  if (cursor->overlapped_bytes > max_grandparent_overlap_bytes_) {
+    // Too much overlap for current output; start new output
+    cursor->overlapped_bytes = 0;
+    return true;
+  } else {
+    return false;
+  }
+}
+
+void Compaction::ReleaseInputs() {
+  if (input_version_ != nullptr) {
+    input_version_->Unref();
+    input_version_ = nullptr;
+  }
+}
+
+}  // namespace lessdb
@@ -0,0 +1,232 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "BlobFile.h"
+#include "Config.h"
+#include "DBFormat.h"
+#include "Disallowcopying.h"
+#include "Options.h"
+#include "Status.h"
+#include "TableCache.h"
+#include "Version.h"
+
+namespace lessdb {
+
+class Compaction;
+class FileFactory;
+class InternalKeyComparator;
+class VersionEdit;
+class WritableFile;
+
+namespace log {
+class Writer;
+}  // namespace log
+
+// VersionSet is the set of the Versions of the database, the newest of which
+// is current(). Every change of the current version is described by a
+// VersionEdit, which is appended to the manifest (descriptor) file in the
+// log format before the change takes effect. The manifest is named by the
+// CURRENT file.
+//
+// Access to a VersionSet must be externally synchronized, by the mutex of the
+// database.
+class VersionSet {
+  __DISALLOW_COPYING__(VersionSet);
+
+ public:
+  // *options, *icmp and *factory must remain live while this VersionSet is in
+  // use.
+  VersionSet(const std::string &dbname, const Options *options,
+             const InternalKeyComparator *icmp, FileFactory *factory);
+
+  ~VersionSet();
+
+  // Apply *edit to the current version to form a new descriptor that
+  // is both saved to persistent state and installed as the new
+  // current version. Releases the mutex held by "*lock" while actually
+  // writing to the file. Concurrent calls, e.g a flush and a compaction,
+  // are applied one after another.
+  // REQUIRES: *lock holds the mutex of the database on entry.
+  Status LogAndApply(VersionEdit *edit, std::unique_lock<std::mutex> *lock);
+
+  // Recover the last saved descriptor from persistent storage.
+  Status Recover();
+
+  // Return the current version.
+  Version *current() const {
+    return current_;
+  }
+
+  // The open tables of the database, thread-safe.
+  TableCache *table_cache() const {
+    return table_cache_.get();
+  }
+
+  // The open blob files of the database, thread-safe.
+  BlobFileCache *blob_cache() const {
+    return blob_cache_.get();
+  }
+
+  // Return the current manifest file number
+  uint64_t ManifestFileNumber() const {
+    return manifest_file_number_;
+  }
+
+  // The number the next NewFileNumber() will return. The files numbered
+  // from it on are yet to be created.
+  uint64_t NextFileNumber() const {
+    return next_file_number_;
+  }
+
+  // Allocate and return a new file number
+  uint64_t NewFileNumber() {
+    return next_file_number_++;
+  }
+
+  // Arrange to reuse "file_number" unless a newer file number has
+  // already been allocated.
+  // REQUIRES: "file_number" was returned by a call to NewFileNumber().
+  void ReuseFileNumber(uint64_t file_number) {
+    if (next_file_number_ == file_number + 1) {
+      next_file_number_ = file_number;
+    }
+  }
+
+  // Mark the specified file number as used.
+  void MarkFileNumberUsed(uint64_t number) {
+    if (next_file_number_ <= number) {
+      next_file_number_ = number + 1;
+    }
+  }
+
+  // Return the number of Table files at the specified level.
+  int NumLevelFiles(int level) const {
+    return current_->NumFiles(level);
+  }
+
+  // Return the combined file size of all files at the specified level.
+  uint64_t NumLevelBytes(int level) const;
+
+  // Return the last sequence number.
+  SequenceNumber LastSequence() const {
+    return last_sequence_;
+  }
+
+  // Set the last sequence number to s.
+  void SetLastSequence(SequenceNumber s) {
+    assert(s >= last_sequence_);
+    last_sequence_ = s;
+  }
+
+  // Return the current log file number. The logs numbered less than it are
+  // not needed by recovery.
+  uint64_t LogNumber() const {
+    return log_number_;
+  }
+
+  // Pick level and inputs for a new compaction.
+  // Returns NULL if there is no compaction to be done.
+  // Otherwise returns a pointer to a heap-allocated object that
+  // describes the compaction. Caller should delete the result.
+  Compaction *PickCompaction();
+
+  // Returns true iff some level needs a compaction.
+  bool NeedsCompaction() const {
+    return current_->compaction_score_ >= 1;
+  }
+
+  // Add all files listed in any live version to *live, the blob files
+  // included.
+  void AddLiveFiles(std::set<uint64_t> *live);
+
+ private:
+  class Builder;
+
+  friend class Compaction;
+  friend class Version;
+
+  // Computes the level to be compacted next for "v".
+  void finalize(Version *v);
+
+  // Stores the smallest and largest keys of "inputs".
+  // REQUIRES: inputs is not empty
+  void getRange(const std::vector<FileMetaData *> &inputs,
+                std::string *smallest, std::string *largest);
+
+  // Stores the smallest and largest keys of inputs1 and inputs2.
+  void getRange2(const std::vector<FileMetaData *> &inputs1,
+                 const std::vector<FileMetaData *> &inputs2,
+                 std::string *smallest, std::string *largest);
+
+  // Adds the overlapping files of level+1 to c, and adds more files of level
+  // if that doesn't bring in more files of level+1.
+  void setupOtherInputs(Compaction *c);
+
+  // Save current contents to *log
+  Status writeSnapshot(log::Writer *log);
+
+  // Makes v the current version.
+  void appendVersion(Version *v);
+
+  // The size target of "level".
+  double maxBytesForLevel(int level) const;
+
+ private:
+  const std::string dbname_;
+  const Options *const options_;
+  const InternalKeyComparator *const icmp_;
+  FileFactory *const file_factory_;
+  std::unique_ptr<TableCache> table_cache_;
+  std::unique_ptr<BlobFileCache> blob_cache_;
+
+  uint64_t next_file_number_;
+  uint64_t manifest_file_number_;
+  SequenceNumber last_sequence_;
+  uint64_t log_number_;
+
+  // Opened lazily
+  std::unique_ptr<WritableFile> descriptor_file_;
+  std::unique_ptr<log::Writer> descriptor_log_;
+  // Set while a LogAndApply writes the manifest, the following ones wait on
+  // manifest_cv_.
+  bool writing_manifest_;
+  std::condition_variable manifest_cv_;
+
+  Version dummy_versions_;  // Head of circular doubly-linked list of versions.
+  Version *current_;        // == dummy_versions_.prev_
+
+  // Per-level key at which the next compaction at that level should start.
+  // Either an empty string, or a valid encoded InternalKey.
+  std::string compact_pointer_[config::kNumLevels];
+};
+
+}  // namespace lessdb
@@ -20,6 +20,8 @@
  * SOFTWARE.
  */
 
+#include <vector>
+
 #include "WriteBatch.h"
 #include "MemTable.h"
 #include "Status.h"
@@ -29,6 +31,28 @@ namespace lessdb {
 
 WriteBatch::WriteBatch() : pImpl_(new WriteBatchImpl()) {}
 
+WriteBatch::~WriteBatch() = default;
+
+void WriteBatch::Clear() {
+  pImpl_->Clear();
+}
+
+void WriteBatch::Reserve(size_t bytes) {
+  pImpl_->Reserve(bytes);
+}
+
+void WriteBatch::Append(const WriteBatch &src) {
+  pImpl_->Append(*src.pImpl_);
+}
+
+int WriteBatch::Count() const {
+  return pImpl_->Count();
+}
+
+size_t WriteBatch::ByteSize() const {
+  return pImpl_->ByteSize();
+}
+
 void WriteBatch::Put(const Slice &key, const Slice &value) {
   pImpl_->PutRecord(key, value);
 }
@@ -37,31 +61,83 @@ void WriteBatch::Delete(const Slice &key) {
   pImpl_->DeleteRecord(key);
 }
 
+void WriteBatch::DeleteRange(const Slice &begin, const Slice &end) {
+  pImpl_->DeleteRangeRecord(begin, end);
+}
+
 Status WriteBatch::Iterate(WriteBatch::Handler *handler) const {
   return pImpl_->Iterate(handler);
 }
 
-// used for WriteBatch::InsertInto
-class MemTableInserter : public WriteBatch::Handler {
+// used for WriteBatch::InsertInto, records are streamed from the batch into
+// the memtable without virtual dispatch.
+class MemTableInserter {
  public:
-  MemTableInserter(MemTable *table) : table_(table), seq_(0) {}
+  MemTableInserter(MemTable *table, SequenceNumber seq, bool concurrently)
+      : table_(table), seq_(seq), concurrently_(concurrently) {}
+
+  void Put(const Slice &key, const Slice &value) {
+    add(kTypeValue, key, value);
+  }
 
-  void Put(const Slice &key, const Slice &value) override {
-    table_->Add(seq_++, kTypeValue, key, value);
+  void Delete(const Slice &key) {
+    add(kTypeDeletion, key, Slice());
   }
 
-  void Delete(const Slice &key) override {
-    table_->Add(seq_++, kTypeDeletion, key, Slice());
+  void DeleteRange(const Slice &begin, const Slice &end) {
+    add(kTypeRangeDeletion, begin, end);
+  }
+
+ private:
+  void add(ValueType type, const Slice &key, const Slice &value) {
+    if (concurrently_) {
+      table_->AddConcurrently(seq_++, type, key, value);
+    } else {
+      table_->Add(seq_++, type, key, value);
+    }
   }
 
  private:
-  SequenceNumber seq_;
   MemTable *table_;
+  SequenceNumber seq_;
+  bool concurrently_;
 };
 
-Status WriteBatch::InsertInto(MemTable *table) {
-  MemTableInserter inserter(table);
+Status WriteBatch::InsertInto(MemTable *table, bool concurrently) {
+  MemTableInserter inserter(table, pImpl_->Sequence(), concurrently);
   return pImpl_->Iterate(&inserter);
 }
 
+namespace {
+
+// Batches kept by a thread, and the largest buffer a pooled batch may keep.
+const size_t kMaxPooledBatches = 16;
+const size_t kMaxPooledCapacity = 1 << 20;
+
+// The pool of a thread frees its batches when the thread exits.
+struct WriteBatchPool {
+  std::vector<std::unique_ptr<WriteBatch>> batches;
+};
+
+thread_local WriteBatchPool pool;
+
+}  // namespace
+
+void WriteBatchRecycler::operator()(WriteBatch *batch) const {
+  std::unique_ptr<WriteBatch> b(batch);
+  if (pool.batches.size() < kMaxPooledBatches &&
+      b->pImpl_->Capacity() <= kMaxPooledCapacity) {
+    b->Clear();
+    pool.batches.push_back(std::move(b));
+  }
+}
+
+PooledWriteBatch NewPooledWriteBatch() {
+  if (pool.batches.empty())
+    return PooledWriteBatch(new WriteBatch());
+  PooledWriteBatch b(pool.batches.back().release());
+  pool.batches.pop_back();
+  return b;
+}
+
 }  // namespace lessdb
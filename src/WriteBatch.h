@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <memory>
 
 #include "Disallowcopying.h"
@@ -42,6 +43,8 @@ class WriteBatch {
  public:
   WriteBatch();
 
+  ~WriteBatch();
+
   // Store the element (key, value) into database.
   void Put(const Slice &key, const Slice &value);
 
@@ -49,6 +52,27 @@ class WriteBatch {
   // Internally, a "tombstone" record is appended for deletes.
   void Delete(const Slice &key);
 
+  // Erases every key in ["begin", "end"), with a single record however many
+  // keys the range holds. Nothing is erased if "end" isn't after "begin".
+  void DeleteRange(const Slice &begin, const Slice &end);
+
+  // Removes all the updates. The buffer of the batch keeps its capacity, so
+  // that a batch reused for the next updates doesn't grow it again.
+  void Clear();
+
+  // Reserves room for "bytes" bytes of encoded updates, each update takes
+  // its key and value plus a few bytes.
+  void Reserve(size_t bytes);
+
+  // Appends the updates of src to this batch.
+  void Append(const WriteBatch &src);
+
+  // Number of updates in the batch.
+  int Count() const;
+
+  // Size of the batch as written into the log.
+  size_t ByteSize() const;
+
   // WriteBatch::Handler provides interfaces to iterate the
   // contents of WriteBatch, and for each of the updates, do
   // the corresponding operation.
@@ -57,17 +81,44 @@ class WriteBatch {
     virtual ~Handler() = default;
     virtual void Put(const Slice &key, const Slice &value) = 0;
     virtual void Delete(const Slice &key) = 0;
+    // Handlers without range deletions needn't override it.
+    virtual void DeleteRange(const Slice &begin, const Slice &end) {}
   };
 
   // Possible error status:
   // Status::Corruptions
   Status Iterate(Handler *handler) const;
 
-  // Insert contents of this WriteBatch into MemTable.
-  Status InsertInto(MemTable *table);
+  // Insert contents of this WriteBatch into MemTable. The records are
+  // assigned with consecutive sequence numbers starting from the sequence
+  // number of this batch.
+  // If concurrently is true, the records are inserted by
+  // MemTable::AddConcurrently, so that batches can be inserted into the same
+  // table by multiple threads in parallel.
+  Status InsertInto(MemTable *table, bool concurrently = false);
 
  private:
+  // DBImpl accesses the internal representation for group commit.
+  friend class DBImpl;
+  friend struct WriteBatchRecycler;
+
   std::unique_ptr<WriteBatchImpl> pImpl_;
 };
 
+// Returns the batches of PooledWriteBatch to the pool of the calling thread.
+struct WriteBatchRecycler {
+  void operator()(WriteBatch *batch) const;
+};
+
+// A batch taken from a thread-local pool, which returns to the pool of the
+// thread destroying it, cleared but with its buffer kept. Clients issuing
+// many small batches save the allocation of each batch and the regrowth of
+// its buffer. A thread pools a few batches at most, the others and the ones
+// grown too large are freed.
+using PooledWriteBatch = std::unique_ptr<WriteBatch, WriteBatchRecycler>;
+
+// Returns an empty batch from the pool of the calling thread, or a new one
+// if the pool is empty.
+PooledWriteBatch NewPooledWriteBatch();
+
 }  // namespace lessdb
\ No newline at end of file
@@ -20,6 +20,7 @@
  * SOFTWARE.
  */
 
+#include <cstring>
 #include <folly/Likely.h>
 #include <folly/Varint.h>
 
@@ -40,7 +41,8 @@ namespace lessdb {
 //    data: record[count]
 // record :=
 //    kTypeValue varstring varstring  |
-//    kTypeDeletion varstring
+//    kTypeDeletion varstring |
+//    kTypeRangeDeletion varstring varstring
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
@@ -54,32 +56,123 @@ class WriteBatchImpl {
   static constexpr size_t kHeaderSize = kSeqSize + kCountSize;
 
  public:
-  WriteBatchImpl() {
+  WriteBatchImpl() : count_(0) {
     bytes_.resize(kHeaderSize);
   }
 
+  // The count is kept aside from the header, records only store it, so that
+  // appending a record doesn't read the header back.
   int Count() const {
-    return ConstDataView(&bytes_[kSeqSize]).ReadNum<int>();
+    return count_;
   }
 
   void SetCount(int count) {
+    count_ = count;
     DataView(&bytes_[kSeqSize]).WriteNum(count);
   }
 
+  // The sequence number assigned to the first record of this batch.
+  SequenceNumber Sequence() const {
+    return ConstDataView(&bytes_[0]).ReadNum<SequenceNumber>();
+  }
+
+  void SetSequence(SequenceNumber seq) {
+    DataView(&bytes_[0]).WriteNum(seq);
+  }
+
+  // The serialized representation of this batch, which is written into the
+  // log as a single record.
+  Slice Contents() const {
+    return Slice(bytes_);
+  }
+
+  // Replaces the batch with the serialized representation "contents", e.g a
+  // record read from the log.
+  // REQUIRES: contents.Len() >= kHeaderSize
+  void SetContents(const Slice &contents) {
+    assert(contents.Len() >= kHeaderSize);
+    bytes_.assign(contents.RawData(), contents.Len());
+    count_ = ConstDataView(&bytes_[kSeqSize]).ReadNum<int>();
+  }
+
+  static constexpr size_t HeaderSize() {
+    return kHeaderSize;
+  }
+
+  // The records of this batch without the header. A header followed by the
+  // records of several batches is a valid batch, which is how a write group
+  // is logged without merging its batches.
+  Slice Records() const {
+    return Slice(bytes_.data() + kHeaderSize, bytes_.size() - kHeaderSize);
+  }
+
+  // Encodes a batch header into buf, which has HeaderSize() bytes.
+  static void EncodeHeader(char *buf, SequenceNumber seq, int count) {
+    DataView(buf).WriteNum(seq);
+    DataView(buf + kSeqSize).WriteNum(count);
+  }
+
+  size_t ByteSize() const {
+    return bytes_.size();
+  }
+
+  // Reserves room for "bytes" bytes of records besides the header.
+  void Reserve(size_t bytes) {
+    bytes_.reserve(kHeaderSize + bytes);
+  }
+
+  // The number of bytes the batch holds without reallocating its buffer.
+  size_t Capacity() const {
+    return bytes_.capacity();
+  }
+
+  // Appends the records of src to this batch, the sequence number of this
+  // batch remains unchanged.
+  void Append(const WriteBatchImpl &src) {
+    assert(src.bytes_.size() >= kHeaderSize);
+    SetCount(Count() + src.Count());
+    bytes_.append(src.bytes_.data() + kHeaderSize,
+                  src.bytes_.size() - kHeaderSize);
+  }
+
+  // Removes all the records, the buffer keeps its capacity.
+  void Clear() {
+    bytes_.resize(kHeaderSize);
+    SetSequence(0);
+    SetCount(0);
+  }
+
   void PutRecord(const Slice &key, const Slice &value) {
-    SetCount(Count() + 1);  // count++
-    bytes_.push_back(static_cast<char>(kTypeValue));
-    coding::AppendVarString(&bytes_, key);
-    coding::AppendVarString(&bytes_, value);
+    SetCount(count_ + 1);  // count++
+    // The record is encoded at once into the grown buffer.
+    char *p = grow(1 + coding::VarintLength(key.Len()) + key.Len() +
+                   coding::VarintLength(value.Len()) + value.Len());
+    *(p++) = static_cast<char>(kTypeValue);
+    p = encodeVarString(p, key);
+    encodeVarString(p, value);
   }
 
   void DeleteRecord(const Slice &key) {
-    SetCount(Count() + 1);  // count++
-    bytes_.push_back(static_cast<char>(kTypeDeletion));
-    coding::AppendVarString(&bytes_, key);
+    SetCount(count_ + 1);  // count++
+    char *p = grow(1 + coding::VarintLength(key.Len()) + key.Len());
+    *(p++) = static_cast<char>(kTypeDeletion);
+    encodeVarString(p, key);
   }
 
-  Status Iterate(WriteBatch::Handler *handler) const {
+  void DeleteRangeRecord(const Slice &begin, const Slice &end) {
+    SetCount(count_ + 1);  // count++
+    char *p = grow(1 + coding::VarintLength(begin.Len()) + begin.Len() +
+                   coding::VarintLength(end.Len()) + end.Len());
+    *(p++) = static_cast<char>(kTypeRangeDeletion);
+    p = encodeVarString(p, begin);
+    encodeVarString(p, end);
+  }
+
+  // Calls handler->Put/Delete/DeleteRange on each record, with key and value pointing
+  // into the batch. A Handler type with non-virtual (or final) methods gets
+  // the calls inlined.
+  template <class Handler>
+  Status Iterate(Handler *handler) const {
     Slice s(bytes_);
     if (UNLIKELY(s.Len() < kHeaderSize)) {  // fast path
       return Status::Corruption("malformed WriteBatch (too small)");
@@ -94,22 +187,25 @@ class WriteBatchImpl {
 
       switch (type) {
         case kTypeValue:
-          try {
-            coding::GetVarString(&s, &key);
-            coding::GetVarString(&s, &value);
-          } catch (std::invalid_argument &e) {
-            return Status::Corruption("Bad WriteBatch put") << e.what();
+          if (UNLIKELY(!coding::ParseVarString(&s, &key) ||
+                       !coding::ParseVarString(&s, &value))) {
+            return Status::Corruption("Bad WriteBatch put");
           }
           handler->Put(key, value);
           break;
         case kTypeDeletion:
-          try {
-            coding::GetVarString(&s, &key);
-          } catch (std::invalid_argument &e) {
-            return Status::Corruption("Bad WriteBatch delete") << e.what();
+          if (UNLIKELY(!coding::ParseVarString(&s, &key))) {
+            return Status::Corruption("Bad WriteBatch delete");
           }
           handler->Delete(key);
           break;
+        case kTypeRangeDeletion:
+          if (UNLIKELY(!coding::ParseVarString(&s, &key) ||
+                       !coding::ParseVarString(&s, &value))) {
+            return Status::Corruption("Bad WriteBatch range deletion");
+          }
+          handler->DeleteRange(key, value);
+          break;
         default:
           return Status::Corruption("Undefined ValueType");
       }
@@ -117,8 +213,23 @@ class WriteBatchImpl {
     return Status::OK();
   }
 
+ private:
+  // Extends bytes_ by n bytes, returns the first of them.
+  char *grow(size_t n) {
+    const size_t size = bytes_.size();
+    bytes_.resize(size + n);
+    return &bytes_[size];
+  }
+
+  static char *encodeVarString(char *p, const Slice &s) {
+    p = coding::EncodeVar32(p, static_cast<uint32_t>(s.Len()));
+    memcpy(p, s.RawData(), s.Len());
+    return p + s.Len();
+  }
+
  private:
   std::string bytes_;
+  int count_;
 };
 
 }  // namespace lessdb
\ No newline at end of file
@@ -0,0 +1,128 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "WriteBufferManager.h"
+#include "CacheStrategy.h"
+
+namespace lessdb {
+
+// The reservation in the cache is made in steps of this size.
+static constexpr size_t kCacheReservationUnit = 256 << 10;
+
+WriteBufferManager::WriteBufferManager(size_t buffer_size,
+                                       CacheStrategy *cache, bool allow_stall)
+    : buffer_size_(buffer_size),
+      cache_(cache),
+      allow_stall_(allow_stall),
+      memtable_usage_(0),
+      mutable_usage_(0),
+      table_usage_(0),
+      cache_reserved_(0) {}
+
+WriteBufferManager::~WriteBufferManager() {
+  if (cache_ && cache_reserved_ > 0)
+    cache_->Unreserve(cache_reserved_);
+}
+
+size_t WriteBufferManager::CacheUsage() const {
+  return cache_ ? cache_->TotalCharge() : 0;
+}
+
+bool WriteBufferManager::ShouldFlush() const {
+  if (buffer_size_ == 0)
+    return false;
+  const size_t mutable_usage = MutableMemtableUsage();
+  if (mutable_usage >= buffer_size_ / 8 * 7)
+    return true;
+  // Memory is already being freed by the flushes, unless the mutable
+  // memtables hold much of it.
+  return MemtableUsage() >= buffer_size_ && mutable_usage >= buffer_size_ / 2;
+}
+
+bool WriteBufferManager::ShouldStall() const {
+  if (!allow_stall_ || buffer_size_ == 0)
+    return false;
+  // Stalling is only of use while some memtables are being flushed, which
+  // wakes the writers up on FreeMem.
+  const size_t usage = MemtableUsage();
+  return usage >= buffer_size_ && usage > MutableMemtableUsage();
+}
+
+void WriteBufferManager::MaybeStall() {
+  if (!ShouldStall())
+    return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  stall_cv_.wait(lock, [this] { return !ShouldStall(); });
+}
+
+void WriteBufferManager::ReserveMem(size_t bytes) {
+  memtable_usage_.fetch_add(bytes, std::memory_order_relaxed);
+  mutable_usage_.fetch_add(bytes, std::memory_order_relaxed);
+  updateCacheReservation();
+}
+
+void WriteBufferManager::ScheduleFreeMem(size_t bytes) {
+  mutable_usage_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void WriteBufferManager::FreeMem(size_t bytes) {
+  memtable_usage_.fetch_sub(bytes, std::memory_order_relaxed);
+  updateCacheReservation();
+  if (allow_stall_) {
+    // Taking the lock orders the notification after the check of a writer
+    // about to wait.
+    std::lock_guard<std::mutex> guard(mutex_);
+    stall_cv_.notify_all();
+  }
+}
+
+void WriteBufferManager::ReserveTableMem(size_t bytes) {
+  table_usage_.fetch_add(bytes, std::memory_order_relaxed);
+  updateCacheReservation();
+}
+
+void WriteBufferManager::FreeTableMem(size_t bytes) {
+  table_usage_.fetch_sub(bytes, std::memory_order_relaxed);
+  updateCacheReservation();
+}
+
+void WriteBufferManager::updateCacheReservation() {
+  if (cache_ == nullptr)
+    return;
+  std::lock_guard<std::mutex> guard(mutex_);
+  const size_t usage = MemtableUsage() + TableUsage();
+  if (usage > cache_reserved_) {
+    // Round up, so that the next few reservations are free.
+    const size_t target = (usage / kCacheReservationUnit + 1) *
+                          kCacheReservationUnit;
+    cache_->Reserve(target - cache_reserved_);
+    cache_reserved_ = target;
+  } else if (usage + 2 * kCacheReservationUnit <= cache_reserved_) {
+    // Keep a unit of slack, not to bounce around a unit boundary.
+    const size_t target = (usage / kCacheReservationUnit + 1) *
+                          kCacheReservationUnit;
+    cache_->Unreserve(cache_reserved_ - target);
+    cache_reserved_ = target;
+  }
+}
+
+}  // namespace lessdb
@@ -0,0 +1,135 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+#include "Disallowcopying.h"
+
+namespace lessdb {
+
+class CacheStrategy;
+
+// WriteBufferManager accounts for the memory held by one or more databases
+// sharing it through Options::write_buffer_manager: their memtables, and the
+// index and filter blocks of their open sstables. It bounds the memtables of
+// all the databases together, in addition to the write_buffer_size of each:
+//
+// - A database flushes its memtable once ShouldFlush() tells so, i.e. the
+//   mutable memtables of all the databases reach 7/8 of buffer_size, or all
+//   the memtables reach buffer_size while the mutable ones hold half of it.
+// - If allow_stall is set, the writes of all the databases wait while the
+//   memtables hold more than buffer_size and some of them are being
+//   flushed, until the flushes free their memory.
+//
+// If "cache" is non-NULL, all the memory accounted here is reserved in the
+// cache too (see CacheStrategy::Reserve), which evicts cached blocks to make
+// room for it. The capacity of the cache then caps the memory of the
+// memtables, the tables and the cached blocks altogether.
+//
+// Thread-safe.
+class WriteBufferManager {
+  __DISALLOW_COPYING__(WriteBufferManager);
+
+ public:
+  // A zero buffer_size disables the flushes and the stalls, the memory is
+  // only accounted for.
+  explicit WriteBufferManager(size_t buffer_size,
+                              CacheStrategy *cache = nullptr,
+                              bool allow_stall = false);
+
+  // REQUIRES: the databases sharing this manager are all closed.
+  ~WriteBufferManager();
+
+  size_t BufferSize() const {
+    return buffer_size_;
+  }
+
+  // The memory of all the memtables, mutable or being flushed.
+  size_t MemtableUsage() const {
+    return memtable_usage_.load(std::memory_order_relaxed);
+  }
+
+  // The memory of the mutable memtables.
+  size_t MutableMemtableUsage() const {
+    return mutable_usage_.load(std::memory_order_relaxed);
+  }
+
+  // The memory of the index and filter blocks held by the open sstables.
+  size_t TableUsage() const {
+    return table_usage_.load(std::memory_order_relaxed);
+  }
+
+  // The charge of the blocks in the cache, not counting the reservation of
+  // this manager. 0 without a cache.
+  size_t CacheUsage() const;
+
+  // The memory of the memtables, the tables and the cached blocks.
+  size_t MemoryUsage() const {
+    return MemtableUsage() + TableUsage() + CacheUsage();
+  }
+
+  // Whether the database being written should flush its memtable.
+  bool ShouldFlush() const;
+
+  // Whether the writes should wait for the memtables being flushed.
+  bool ShouldStall() const;
+
+  // Blocks the calling writer while ShouldStall().
+  void MaybeStall();
+
+  // Accounting of the memtables. A memtable grows by ReserveMem, stops
+  // growing by ScheduleFreeMem once it becomes immutable, and releases its
+  // memory by FreeMem once flushed (or dropped).
+  void ReserveMem(size_t bytes);
+  void ScheduleFreeMem(size_t bytes);
+  void FreeMem(size_t bytes);
+
+  // Accounting of the tables, on open and on close.
+  void ReserveTableMem(size_t bytes);
+  void FreeTableMem(size_t bytes);
+
+ private:
+  // Adjusts the reservation in cache_ to the accounted memory, in steps of
+  // kCacheReservationUnit to keep cache_ out of the write path.
+  void updateCacheReservation();
+
+ private:
+  const size_t buffer_size_;
+  CacheStrategy *const cache_;
+  const bool allow_stall_;
+
+  std::atomic<size_t> memtable_usage_;
+  std::atomic<size_t> mutable_usage_;
+  std::atomic<size_t> table_usage_;
+
+  // Guards cache_reserved_, and the stalls.
+  std::mutex mutex_;
+  std::condition_variable stall_cv_;
+  size_t cache_reserved_;
+};
+
+}  // namespace lessdb
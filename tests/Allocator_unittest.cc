@@ -0,0 +1,130 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include "Allocator.h"
+#include "ConcurrentArena.h"
+#include "MemTable.h"
+
+using namespace lessdb;
+
+namespace {
+
+// Allocates from the heap, counting the chunks outstanding.
+class CountingAllocator final : public Allocator {
+ public:
+  void *Allocate(size_t size) override {
+    allocs++;
+    outstanding++;
+    return malloc(size);
+  }
+
+  void Deallocate(void *p) override {
+    outstanding--;
+    free(p);
+  }
+
+  const char *Name() const override {
+    return "CountingAllocator";
+  }
+
+  std::atomic<int> allocs{0};
+  std::atomic<int> outstanding{0};
+};
+
+bool IsAligned(const void *p) {
+  return reinterpret_cast<uintptr_t>(p) % alignof(std::max_align_t) == 0;
+}
+
+}  // namespace
+
+TEST(NumaAllocator, AllocateAndFree) {
+  // Bound to node 0, which exists on every machine (or mbind fails, on a
+  // kernel without NUMA, and the memory is still usable), and unbound.
+  for (int node : {0, -1}) {
+    std::unique_ptr<Allocator> allocator(NewNumaAllocator(node, true));
+    for (size_t size : {1, 100, 4096, 65536, 3 << 20}) {
+      char *p = static_cast<char *>(allocator->Allocate(size));
+      ASSERT_TRUE(p != nullptr);
+      ASSERT_TRUE(IsAligned(p));
+      memset(p, 'x', size);
+      ASSERT_EQ(p[size - 1], 'x');
+      allocator->Deallocate(p);
+    }
+    allocator->Deallocate(nullptr);
+  }
+}
+
+TEST(ConcurrentArena, Blocks) {
+  CountingAllocator allocator;
+  {
+    ConcurrentArena arena(&allocator, 4096);
+    size_t used = 0;
+    for (size_t size : {1, 7, 16, 100, 33}) {
+      void *p = arena.allocate(size);
+      ASSERT_TRUE(IsAligned(p));
+      memset(p, 0, size);
+      used += size;
+    }
+    // The small allocations share a block.
+    ASSERT_EQ(allocator.allocs, 1);
+    ASSERT_GE(arena.bytesUsed(), used);
+
+    // One not fitting in the block gets its own, the current block is kept.
+    memset(arena.allocate(5000), 0, 5000);
+    ASSERT_EQ(allocator.allocs, 2);
+    arena.allocate(8);
+    ASSERT_EQ(allocator.allocs, 2);
+
+    for (int i = 0; i < 100; i++)
+      arena.allocate(1000);
+    ASSERT_GT(allocator.allocs, 2);
+  }
+  ASSERT_EQ(allocator.outstanding, 0);
+}
+
+TEST(MemTable, Allocator) {
+  CountingAllocator allocator;
+  {
+    InternalKeyComparator cmp(NewBytewiseComparator());
+    MemTable table(cmp, &allocator);
+    for (int i = 0; i < 1000; i++) {
+      table.Add(i + 1, kTypeValue, "k" + std::to_string(i),
+                std::string(100, 'v'));
+    }
+    ASSERT_GE(allocator.allocs, 1);
+    ASSERT_GE(table.BytesUsed(), 100000u);
+
+    std::string value;
+    Status s;
+    ASSERT_TRUE(table.Get("k500", 1000, &value, &s));
+    ASSERT_TRUE(s);
+    ASSERT_EQ(value, std::string(100, 'v'));
+  }
+  ASSERT_EQ(allocator.outstanding, 0);
+}
@@ -21,7 +21,10 @@
  */
 
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <map>
+#include <string>
+#include <vector>
 
 #include "BlockBuilder.h"
 #include "Options.h"
@@ -29,6 +32,7 @@
 #include "TestUtils.h"
 #include "TableFormat.h"
 #include "Comparator.h"
+#include "InternalKey.h"
 
 using namespace lessdb;
 using namespace test;
@@ -90,4 +94,312 @@ TEST(Basic, Build) {
       }
     }
   }
-}
\ No newline at end of file
+}
+
+TEST(Basic, SharedPrefix) {
+  Options options;
+  options.block_restart_interval = 4;
+  BlockBuilder builder(&options);
+
+  std::vector<std::string> keys;
+  for (int i = 0; i < 100; ++i) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "user%08d", i * 7);
+    keys.push_back(buf);
+    builder.Add(keys.back(), std::to_string(i));
+  }
+
+  BlockContent content;
+  content.data = builder.Finish();
+  Block block(content, options.comparator);
+
+  // Keys are reconstructed correctly across restart points.
+  auto it = block.begin();
+  for (size_t i = 0; i < keys.size(); i++, it++) {
+    ASSERT_TRUE(it != block.end());
+    ASSERT_EQ(it.Key().ToString(), keys[i]);
+    ASSERT_EQ(it.Value().ToString(), std::to_string(i));
+
+    // A copy owns its key independently of the original.
+    auto copy = it;
+    copy++;
+    ASSERT_EQ(it.Key().ToString(), keys[i]);
+    if (i + 1 < keys.size())
+      ASSERT_EQ(copy.Key().ToString(), keys[i + 1]);
+  }
+  ASSERT_TRUE(it == block.end());
+
+  for (size_t i = 0; i < keys.size(); i++) {
+    auto found = block.find(keys[i]);
+    ASSERT_TRUE(found != block.end());
+    ASSERT_EQ(found.Key().ToString(), keys[i]);
+    auto next = block.lower_bound(keys[i] + "0");
+    if (i + 1 < keys.size()) {
+      ASSERT_EQ(next.Key().ToString(), keys[i + 1]);
+    } else {
+      ASSERT_TRUE(next == block.end());
+    }
+  }
+}
+
+// Keys diverging at every offset around the 16 and 8-byte steps of the shared
+// prefix computation.
+TEST(Basic, LongSharedPrefix) {
+  Options options;
+  options.block_restart_interval = 1 << 10;
+  BlockBuilder builder(&options);
+
+  std::vector<std::string> keys;
+  const std::string prefix(40, 'p');
+  for (size_t len = 0; len <= prefix.size(); len++)
+    keys.push_back(prefix.substr(0, len) + "q" + std::to_string(len));
+  std::sort(keys.begin(), keys.end());
+
+  size_t key_bytes = 0;
+  for (const auto& key : keys) {
+    builder.Add(key, "v");
+    key_bytes += key.size();
+  }
+  BlockContent content;
+  content.data = builder.Finish();
+  Block block(content, options.comparator);
+
+  auto it = block.begin();
+  for (const auto& key : keys) {
+    ASSERT_TRUE(it != block.end());
+    ASSERT_EQ(it.Key().ToString(), key);
+    ASSERT_EQ(it.Value().ToString(), "v");
+    it++;
+  }
+  ASSERT_TRUE(it == block.end());
+  // The prefixes are shared rather than stored in every entry.
+  ASSERT_LT(content.data.Len(), key_bytes / 2);
+}
+
+TEST(Basic, RestartPrefixes) {
+  Options options;
+  options.block_restart_interval = 2;
+  KVMap table;
+  BlockBuilder builder(&options);
+
+  // Keys sharing long prefixes make the 8-byte prefixes tie frequently.
+  for (int i = 0; i < 500; ++i) {
+    std::string key = RandomString(RandomIn(0, 1) ? 1 : 8);
+    key += RandomString(RandomIn(0, 1 << 3));
+    table.emplace(std::move(key), RandomString(RandomIn(0, 1 << 3)));
+  }
+  for (const auto& it : table) {
+    builder.Add(it.first, it.second);
+  }
+
+  BlockContent content;
+  content.data = builder.Finish();
+  Block plain(content, options.comparator);
+  Block block(content, options.comparator);
+  block.BuildRestartPrefixes();
+
+  for (const auto& it : table) {
+    auto found = block.find(it.first);
+    ASSERT_TRUE(found != block.end());
+    ASSERT_EQ(found.Value().ToString(), it.second);
+  }
+
+  // Compare with the search without prefixes on keys not in the block.
+  for (int i = 0; i < 500; ++i) {
+    std::string target = RandomString(RandomIn(0, 1 << 4));
+    auto expected = plain.lower_bound(target);
+    auto actual = block.lower_bound(target);
+    ASSERT_EQ(expected == plain.end(), actual == block.end());
+    if (expected != plain.end()) {
+      ASSERT_EQ(expected.Key().ToString(), actual.Key().ToString());
+    }
+  }
+}
+
+TEST(Basic, HashIndex) {
+  Options options;
+  options.block_restart_interval = 4;
+  KVMap table;
+  for (int i = 0; i < 200; ++i) {
+    table.emplace(RandomString(RandomIn(1, 1 << 4)),
+                  RandomString(RandomIn(0, 1 << 3)));
+  }
+  BlockBuilder plain_builder(&options);
+  BlockBuilder builder(&options, options.block_restart_interval, 0.75);
+  for (const auto& it : table) {
+    plain_builder.Add(it.first, it.second);
+    builder.Add(it.first, it.second);
+  }
+  const size_t size = builder.Size();
+  ASSERT_GT(size, plain_builder.Size());
+
+  BlockContent plain_content, content;
+  plain_content.data = plain_builder.Finish();
+  content.data = builder.Finish();
+  ASSERT_EQ(content.data.Len(), size);
+  Block plain(plain_content, options.comparator);
+  Block block(content, options.comparator);
+
+  // The hash index leaves the entries and the search as they are.
+  auto it = block.begin();
+  for (const auto& expected : table) {
+    ASSERT_TRUE(it != block.end());
+    ASSERT_EQ(it.Key().ToString(), expected.first);
+    ASSERT_EQ(it.Value().ToString(), expected.second);
+    ASSERT_EQ(block.lower_bound(expected.first).Key().ToString(),
+              expected.first);
+    auto found = block.find(expected.first);
+    ASSERT_TRUE(found != block.end());
+    ASSERT_EQ(found.Value().ToString(), expected.second);
+    it++;
+  }
+  ASSERT_TRUE(it == block.end());
+
+  for (int i = 0; i < 500; ++i) {
+    std::string target = RandomString(RandomIn(1, 1 << 4));
+    ASSERT_EQ(plain.find(target) == plain.end(),
+              block.find(target) == block.end());
+  }
+}
+
+namespace {
+
+class ReverseBytewiseComparator : public Comparator {
+ public:
+  const char* Name() const override {
+    return "test.ReverseBytewiseComparator";
+  }
+
+  int Compare(const Slice& lhs, const Slice& rhs) const override {
+    return NewBytewiseComparator()->Compare(rhs, lhs);
+  }
+
+  void FindShortestSeparator(std::string* start,
+                             const Slice& limit) const override {}
+
+  void FindShortSuccessor(std::string* key) const override {}
+};
+
+// Orders keys as "comparator" does, while hiding its type from the block.
+class ForwardingComparator : public Comparator {
+ public:
+  explicit ForwardingComparator(const Comparator* comparator)
+      : comparator_(comparator) {}
+
+  const char* Name() const override {
+    return "test.ForwardingComparator";
+  }
+
+  int Compare(const Slice& lhs, const Slice& rhs) const override {
+    return comparator_->Compare(lhs, rhs);
+  }
+
+  void FindShortestSeparator(std::string* start,
+                             const Slice& limit) const override {}
+
+  void FindShortSuccessor(std::string* key) const override {}
+
+ private:
+  const Comparator* comparator_;
+};
+
+}  // namespace
+
+TEST(Basic, CustomComparator) {
+  // Block search falls back to the virtual comparator for a comparator
+  // other than the builtin bytewise one.
+  ReverseBytewiseComparator reverse;
+  Options options;
+  options.comparator = &reverse;
+  options.block_restart_interval = 4;
+  std::map<std::string, std::string, std::greater<std::string>> table;
+  BlockBuilder builder(&options);
+
+  for (int i = 0; i < 500; ++i) {
+    table.emplace(RandomString(RandomIn(0, 1 << 4)),
+                  RandomString(RandomIn(0, 1 << 3)));
+  }
+  for (const auto& it : table) {
+    builder.Add(it.first, it.second);
+  }
+
+  BlockContent content;
+  content.data = builder.Finish();
+  Block block(content, options.comparator);
+
+  for (const auto& it : table) {
+    auto found = block.find(it.first);
+    ASSERT_TRUE(found != block.end());
+    ASSERT_EQ(found.Value().ToString(), it.second);
+  }
+
+  for (int i = 0; i < 500; ++i) {
+    std::string target = RandomString(RandomIn(0, 1 << 4));
+    auto expected = table.lower_bound(target);
+    auto actual = block.lower_bound(target);
+    ASSERT_EQ(expected == table.end(), actual == block.end());
+    if (expected != table.end()) {
+      ASSERT_EQ(expected->first, actual.Key().ToString());
+    }
+  }
+}
+
+TEST(Basic, InternalKeyComparator) {
+  // A block of internal keys of bytewise user keys is searched by the
+  // inlined internal key comparison, which agrees with the virtual one.
+  InternalKeyComparator icmp(NewBytewiseComparator());
+  ForwardingComparator forwarding(&icmp);
+  Options options;
+  options.comparator = &icmp;
+  options.block_restart_interval = 2;
+
+  // Several versions of the same user key, whose 8-byte prefixes often tie.
+  std::vector<std::string> keys;
+  for (int i = 0; i < 200; ++i) {
+    std::string user_key = RandomString(RandomIn(0, 1) ? 1 : 8);
+    user_key += RandomString(RandomIn(0, 1 << 3));
+    for (int j = 0, n = RandomIn(1, 3); j < n; ++j) {
+      InternalKeyBuf key(user_key, RandomIn(0, 1 << 10), kTypeValue);
+      keys.push_back(key.Data().ToString());
+    }
+  }
+  std::sort(keys.begin(), keys.end(),
+            [&](const std::string& a, const std::string& b) {
+              return icmp.Compare(a, b) < 0;
+            });
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+  BlockBuilder builder(&options);
+  for (const auto& key : keys) {
+    builder.Add(key, key);
+  }
+  BlockContent content;
+  content.data = builder.Finish();
+  Block plain(content, &forwarding);
+  Block block(content, options.comparator);
+  block.BuildRestartPrefixes();
+  ASSERT_FALSE(plain.TEST_HasRestartPrefixes());
+  ASSERT_TRUE(block.TEST_HasRestartPrefixes());
+
+  for (const auto& key : keys) {
+    auto found = block.find(key);
+    ASSERT_TRUE(found != block.end());
+    ASSERT_EQ(found.Value().ToString(), key);
+  }
+
+  for (int i = 0; i < 500; ++i) {
+    const int n = static_cast<int>(keys.size());
+    const std::string& key = keys[RandomIn(0, n - 1)];
+    std::string user_key = RandomIn(0, 1) ? key.substr(0, key.size() - 8)
+                                          : RandomString(RandomIn(0, 1 << 4));
+    InternalKeyBuf target(user_key, RandomIn(0, 1 << 10), kTypeValue);
+    auto expected = plain.lower_bound(target.Data());
+    auto actual = block.lower_bound(target.Data());
+    ASSERT_EQ(expected == plain.end(), actual == block.end());
+    if (expected != plain.end()) {
+      ASSERT_EQ(expected.Key().ToString(), actual.Key().ToString());
+    }
+    ASSERT_EQ(plain.find(target.Data()) == plain.end(),
+              block.find(target.Data()) == block.end());
+  }
+}
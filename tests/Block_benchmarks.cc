@@ -0,0 +1,155 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Block.h"
+#include "BlockBuilder.h"
+#include "Options.h"
+#include "TableFormat.h"
+
+using namespace lessdb;
+
+namespace {
+
+// Keys share a long prefix and are 16 bytes each, with 100-byte values,
+// which makes a 4KB block hold about 35 entries. With a non-zero prefix_len,
+// every key starts with the same prefix_len bytes, e.g a table or column
+// name.
+std::vector<std::string> sortedKeys(size_t n, size_t prefix_len = 0) {
+  std::vector<std::string> keys;
+  const std::string prefix(prefix_len, 'p');
+  for (size_t i = 0; i < n; i++) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "user%012zu", i * 7);
+    keys.push_back(prefix + buf);
+  }
+  return keys;
+}
+
+const std::string kValue(100, 'v');
+
+}  // namespace
+
+// Fills blocks of Options::block_size with range(0) as restart interval,
+// the keys share a common prefix of range(1) bytes.
+static void BlockBuilder_Add(benchmark::State &state) {
+  Options options;
+  options.block_restart_interval = static_cast<int>(state.range(0));
+  BlockBuilder builder(&options);
+  const std::vector<std::string> keys =
+      sortedKeys(1 << 12, static_cast<size_t>(state.range(1)));
+
+  size_t i = 0, bytes = 0;
+  for (auto _ : state) {
+    builder.Add(keys[i], kValue);
+    bytes += keys[i].size() + kValue.size();
+    if (++i == keys.size() || builder.Size() >= options.block_size) {
+      benchmark::DoNotOptimize(builder.Finish());
+      builder.Reset();
+      i = 0;
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+  state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+
+// Block::lower_bound on a block of range(1) entries with range(0) as restart
+// interval. range(2) is whether the restart prefixes are built.
+static void Block_LowerBound(benchmark::State &state) {
+  Options options;
+  options.block_restart_interval = static_cast<int>(state.range(0));
+  BlockBuilder builder(&options);
+  const std::vector<std::string> keys =
+      sortedKeys(static_cast<size_t>(state.range(1)));
+  for (const std::string &key : keys)
+    builder.Add(key, kValue);
+
+  BlockContent content;
+  content.data = builder.Finish();
+  Block block(content, options.comparator);
+  if (state.range(2))
+    block.BuildRestartPrefixes();
+
+  std::mt19937 gen(301);
+  std::uniform_int_distribution<size_t> dis(0, keys.size() - 1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(block.lower_bound(keys[dis(gen)]));
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+// Block::find on a block of 256 entries with range(0) as restart interval,
+// and a hash index of range(1)/100 hash ratio if range(1) is not 0.
+static void Block_Find(benchmark::State &state) {
+  Options options;
+  options.block_restart_interval = static_cast<int>(state.range(0));
+  BlockBuilder builder(&options, options.block_restart_interval,
+                       static_cast<double>(state.range(1)) / 100);
+  const std::vector<std::string> keys = sortedKeys(256);
+  for (const std::string &key : keys)
+    builder.Add(key, kValue);
+
+  BlockContent content;
+  content.data = builder.Finish();
+  Block block(content, options.comparator);
+
+  std::mt19937 gen(301);
+  std::uniform_int_distribution<size_t> dis(0, keys.size() - 1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(block.find(keys[dis(gen)]));
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+/**
+ * Baseline, to be compared against by changes to BlockBuilder and Block.
+ *
+ * Benchmark environment:
+ * Intel Xeon @ 2.10GHz, 1 core, g++ (Debian 12.2.0-14) 12.2.0, -O2 -DNDEBUG.
+ *
+ * Benchmark                           Time   Iterations
+ * -----------------------------------------------------
+ * BlockBuilder_Add/1/0             29.8 ns      2489930
+ * BlockBuilder_Add/16/0            29.7 ns      2306348
+ * Block_LowerBound/1/256/0          182 ns       387451
+ * Block_LowerBound/16/256/0         513 ns       100000
+ * Block_LowerBound/16/2048/0        573 ns       105783
+ * Block_LowerBound/16/2048/1        569 ns       125059
+ * Block_Find/16/0                   537 ns       136009
+ * Block_Find/16/75                  484 ns       144445
+ *
+ * Comparing the shared prefix 16 bytes at a time took BlockBuilder_Add/16/64
+ * (a 64-byte common key prefix) from 83 ns to 35 ns, on the same kind of
+ * machine; keys with short prefixes are unchanged.
+ */
+
+BENCHMARK(BlockBuilder_Add)->ArgsProduct({{1, 4, 16, 32}, {0, 64}});
+BENCHMARK(Block_LowerBound)
+    ->ArgsProduct({{1, 4, 16, 32}, {32, 256, 2048}, {0, 1}});
+BENCHMARK(Block_Find)->ArgsProduct({{4, 16, 32}, {0, 75}});
+
+BENCHMARK_MAIN();
@@ -0,0 +1,146 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "CacheStrategy.h"
+#include "Slice.h"
+
+using namespace lessdb;
+
+namespace {
+
+const size_t kNumKeys = 1 << 16;
+
+std::vector<std::string> cacheKeys(size_t n) {
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < n; i++)
+    keys.push_back("block" + std::to_string(i));
+  return keys;
+}
+
+// range(0) is the number of shard bits, range(1) selects the LRU (0) or
+// the CLOCK (1) cache.
+CacheStrategy *newCache(const benchmark::State &state, size_t capacity) {
+  const int shard_bits = static_cast<int>(state.range(0));
+  if (state.range(1) == 1)
+    return CacheStrategy::Clock(capacity, 1, shard_bits);
+  return CacheStrategy::LRU(capacity, shard_bits);
+}
+
+}  // namespace
+
+// Threads look up the entries of a cache holding kNumKeys entries, all of
+// which hit. The capacity is doubled so that no shard has to evict.
+static void CacheStrategy_Lookup(benchmark::State &state) {
+  static std::unique_ptr<CacheStrategy> cache;
+  static std::vector<std::string> keys;
+  if (state.thread_index() == 0) {
+    cache.reset(newCache(state, kNumKeys * 2));
+    keys = cacheKeys(kNumKeys);
+    for (const std::string &key : keys)
+      cache->Release(cache->Insert(key, nullptr, 1, nullptr));
+  }
+
+  std::mt19937 gen(static_cast<unsigned>(state.thread_index()));
+  for (auto _ : state) {
+    CacheStrategy::HANDLE h = cache->Lookup(keys[gen() % kNumKeys]);
+    benchmark::DoNotOptimize(h);
+    if (h)
+      cache->Release(h);
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0)
+    cache.reset();
+}
+
+// Threads insert into a cache of half the capacity of the key space and look
+// up the keys, so that about half of the lookups miss and insert, evicting an
+// entry.
+static void CacheStrategy_LookupInsert(benchmark::State &state) {
+  static std::unique_ptr<CacheStrategy> cache;
+  static std::vector<std::string> keys;
+  if (state.thread_index() == 0) {
+    cache.reset(newCache(state, kNumKeys / 2));
+    keys = cacheKeys(kNumKeys);
+  }
+
+  std::mt19937 gen(static_cast<unsigned>(state.thread_index()));
+  int64_t hits = 0;
+  for (auto _ : state) {
+    const std::string &key = keys[gen() % kNumKeys];
+    CacheStrategy::HANDLE h = cache->Lookup(key);
+    if (h) {
+      hits++;
+    } else {
+      h = cache->Insert(key, nullptr, 1, nullptr);
+    }
+    cache->Release(h);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["hit_rate"] = benchmark::Counter(
+      static_cast<double>(hits) / static_cast<double>(state.iterations()),
+      benchmark::Counter::kAvgThreads);
+
+  if (state.thread_index() == 0)
+    cache.reset();
+}
+
+/**
+ * Baseline, to be compared against by changes to the caches. With a single
+ * core the thread counts measure the overhead of contention, not the scaling.
+ *
+ * Benchmark environment:
+ * Intel Xeon, 1 core, g++ (Debian 12.2.0-14) 12.2.0, -O2 -DNDEBUG.
+ *
+ * Benchmark                                                 Time   Iterations
+ * ---------------------------------------------------------------------------
+ * CacheStrategy_Lookup/0/0/real_time/threads:1            352 ns      1168885
+ * CacheStrategy_Lookup/0/0/real_time/threads:16           456 ns      1133280
+ * CacheStrategy_Lookup/4/0/real_time/threads:1            648 ns       509784
+ * CacheStrategy_Lookup/4/0/real_time/threads:16           442 ns      1578896
+ * CacheStrategy_Lookup/4/1/real_time/threads:1            121 ns      3875341
+ * CacheStrategy_Lookup/4/1/real_time/threads:16           114 ns      4646672
+ * CacheStrategy_LookupInsert/0/0/real_time/threads:1      375 ns      1080349
+ * CacheStrategy_LookupInsert/4/0/real_time/threads:16     457 ns      1204960
+ * CacheStrategy_LookupInsert/4/1/real_time/threads:16     272 ns      1600000
+ */
+
+BENCHMARK(CacheStrategy_Lookup)
+    ->Args({0, 0})
+    ->Args({4, 0})
+    ->Args({4, 1})
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK(CacheStrategy_LookupInsert)
+    ->Args({0, 0})
+    ->Args({4, 0})
+    ->Args({4, 1})
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
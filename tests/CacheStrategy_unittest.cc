@@ -21,35 +21,54 @@
  * SOFTWARE.
  */
 
-#include <boost/any.hpp>
 #include <gtest/gtest.h>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "CacheStrategy.h"
 #include "Slice.h"
 
 using namespace lessdb;
 
+// Inserts a copy of "value" allocated by new T.
+template <typename T>
+static CacheStrategy::HANDLE InsertValue(CacheStrategy *cache, const Slice &key,
+                                         const T &value, size_t charge) {
+  return cache->Insert(key, new T(value), charge, &DeleteCacheValue<T>);
+}
+
+template <typename T>
+static const T &ValueOf(CacheStrategy *cache, CacheStrategy::HANDLE h) {
+  return *static_cast<const T *>(cache->Value(h));
+}
+
 TEST(Correctness, T1) {
   CacheStrategy::HANDLE look;
   int val;
 
-  std::unique_ptr<CacheStrategy> lru_strategy(CacheStrategy::Default(2));
-  lru_strategy->Insert("1", 1);
-  lru_strategy->Insert("2", 1);
+  // single shard, so that the eviction order is deterministic.
+  std::unique_ptr<CacheStrategy> lru_strategy(CacheStrategy::LRU(2, 0));
+  lru_strategy->Release(InsertValue(lru_strategy.get(), "1", 1, 1));
+  lru_strategy->Release(InsertValue(lru_strategy.get(), "2", 1, 1));
 
   // look up an entry that already exists
   look = lru_strategy->Lookup("1");
-  val = boost::any_cast<int>(lru_strategy->Value(look));
+  val = ValueOf<int>(lru_strategy.get(), look);
   ASSERT_EQ(val, 1);
+  lru_strategy->Release(look);
 
   // look up an entry that are discarded
-  lru_strategy->Insert("3", 2);
+  lru_strategy->Release(InsertValue(lru_strategy.get(), "3", 2, 1));
   look = lru_strategy->Lookup("2");
   ASSERT_TRUE(look == NULL);
 
   look = lru_strategy->Lookup("3");
-  val = boost::any_cast<int>(lru_strategy->Value(look));
+  val = ValueOf<int>(lru_strategy.get(), look);
   ASSERT_EQ(val, 2);
+  lru_strategy->Release(look);
 
   // look up an entry that are erased.
   lru_strategy->Erase("1");
@@ -57,7 +76,343 @@ TEST(Correctness, T1) {
   ASSERT_TRUE(look == NULL);
 
   // update the value of an existing entry
-  look = lru_strategy->Insert("3", 3);
-  val = boost::any_cast<int>(lru_strategy->Value(look));
+  look = InsertValue(lru_strategy.get(), "3", 3, 1);
+  val = ValueOf<int>(lru_strategy.get(), look);
   ASSERT_EQ(val, 3);
+  lru_strategy->Release(look);
+}
+
+TEST(Correctness, Charge) {
+  std::unique_ptr<CacheStrategy> lru_strategy(CacheStrategy::LRU(100, 0));
+
+  lru_strategy->Release(InsertValue(lru_strategy.get(), "a", 1, 40));
+  lru_strategy->Release(InsertValue(lru_strategy.get(), "b", 2, 40));
+  ASSERT_EQ(lru_strategy->TotalCharge(), 80);
+
+  // "a" is the least recently used entry after "b" is looked up.
+  CacheStrategy::HANDLE h = lru_strategy->Lookup("b");
+  ASSERT_TRUE(h != NULL);
+  lru_strategy->Release(h);
+  lru_strategy->Release(InsertValue(lru_strategy.get(), "c", 3, 40));
+  ASSERT_TRUE(lru_strategy->Lookup("a") == NULL);
+  for (const char *key : {"b", "c"}) {
+    h = lru_strategy->Lookup(key);
+    ASSERT_TRUE(h != NULL);
+    lru_strategy->Release(h);
+  }
+  ASSERT_EQ(lru_strategy->TotalCharge(), 80);
+
+  // An entry that is larger than the capacity is kept until the next insert.
+  h = InsertValue(lru_strategy.get(), "d", 4, 200);
+  ASSERT_EQ(ValueOf<int>(lru_strategy.get(), h), 4);
+  ASSERT_EQ(lru_strategy->TotalCharge(), 200);
+
+  lru_strategy->Erase("d");
+  ASSERT_EQ(lru_strategy->TotalCharge(), 0);
+  lru_strategy->Release(h);
+}
+
+TEST(Correctness, Reserve) {
+  std::unique_ptr<CacheStrategy> lru_strategy(CacheStrategy::LRU(100, 0));
+  for (const char *key : {"a", "b", "c"}) {
+    lru_strategy->Release(InsertValue(lru_strategy.get(), key, 1, 30));
+  }
+
+  // The reservation evicts the least recently used entries to fit in.
+  lru_strategy->Reserve(50);
+  ASSERT_TRUE(lru_strategy->Lookup("a") == NULL);
+  ASSERT_TRUE(lru_strategy->Lookup("b") == NULL);
+  ASSERT_EQ(lru_strategy->TotalCharge(), 30);
+
+  // And is left out of the entries' capacity until it's given back.
+  lru_strategy->Release(InsertValue(lru_strategy.get(), "d", 1, 30));
+  ASSERT_TRUE(lru_strategy->Lookup("c") == NULL);
+  lru_strategy->Unreserve(50);
+  lru_strategy->Release(InsertValue(lru_strategy.get(), "e", 1, 30));
+  lru_strategy->Release(InsertValue(lru_strategy.get(), "f", 1, 30));
+  ASSERT_EQ(lru_strategy->TotalCharge(), 90);
+}
+
+TEST(Correctness, Pinned) {
+  std::unique_ptr<CacheStrategy> lru_strategy(CacheStrategy::LRU(2, 0));
+  auto value = std::make_shared<std::string>("v1");
+
+  // A handle keeps its value alive after the entry is replaced, evicted or
+  // erased, until it's released.
+  CacheStrategy::HANDLE h1 = InsertValue(lru_strategy.get(), "1", value, 1);
+  CacheStrategy::HANDLE h2 = lru_strategy->Lookup("1");
+  lru_strategy->Release(
+      InsertValue(lru_strategy.get(), "1", std::string("v2"), 1));
+  ASSERT_EQ(value.use_count(), 2);
+  ASSERT_EQ(*ValueOf<std::shared_ptr<std::string>>(lru_strategy.get(), h2),
+            "v1");
+  lru_strategy->Release(h1);
+  ASSERT_EQ(value.use_count(), 2);
+
+  h1 = lru_strategy->Lookup("1");
+  ASSERT_EQ(ValueOf<std::string>(lru_strategy.get(), h1), "v2");
+  lru_strategy->Release(InsertValue(lru_strategy.get(), "2", 2, 1));
+  lru_strategy->Release(InsertValue(lru_strategy.get(), "3", 3, 1));
+  ASSERT_TRUE(lru_strategy->Lookup("1") == NULL);
+  ASSERT_EQ(ValueOf<std::string>(lru_strategy.get(), h1), "v2");
+  lru_strategy->Erase("3");
+  ASSERT_EQ(lru_strategy->TotalCharge(), 1);
+  lru_strategy->Release(h1);
+
+  lru_strategy->Release(h2);
+  ASSERT_EQ(value.use_count(), 1);
+}
+
+TEST(Correctness, Concurrent) {
+  const int kThreads = 8;
+  const int kKeys = 64;
+  // Smaller than the working set, so that entries are evicted while other
+  // threads hold them.
+  std::unique_ptr<CacheStrategy> lru_strategy(CacheStrategy::LRU(kKeys / 2, 1));
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&lru_strategy, t] {
+      for (int i = 0; i < 10000; i++) {
+        int k = (i * 7 + t) % kKeys;
+        std::string key = std::to_string(k);
+        CacheStrategy::HANDLE h = lru_strategy->Lookup(key);
+        if (h == NULL)
+          h = InsertValue(lru_strategy.get(), key, std::make_shared<int>(k),
+                          1);
+        ASSERT_EQ(*ValueOf<std::shared_ptr<int>>(lru_strategy.get(), h), k);
+        lru_strategy->Release(h);
+      }
+    });
+  }
+  for (auto &t : threads)
+    t.join();
+  ASSERT_LE(lru_strategy->TotalCharge(), kKeys / 2);
+}
+
+TEST(Correctness, Sharded) {
+  const int kNumEntries = 1000;
+  std::unique_ptr<CacheStrategy> lru_strategy(
+      CacheStrategy::Default(kNumEntries * 16));
+
+  for (int i = 0; i < kNumEntries; i++) {
+    lru_strategy->Release(
+        InsertValue(lru_strategy.get(), std::to_string(i), i, 1));
+  }
+  ASSERT_EQ(lru_strategy->TotalCharge(), kNumEntries);
+
+  for (int i = 0; i < kNumEntries; i++) {
+    CacheStrategy::HANDLE h = lru_strategy->Lookup(std::to_string(i));
+    ASSERT_TRUE(h != NULL);
+    ASSERT_EQ(ValueOf<int>(lru_strategy.get(), h), i);
+    lru_strategy->Release(h);
+  }
+
+  ASSERT_NE(lru_strategy->NewId(), lru_strategy->NewId());
 }
+
+TEST(Correctness, VisitKeys) {
+  std::unique_ptr<CacheStrategy> lru_strategy(CacheStrategy::Default(100));
+  for (int i = 0; i < 200; i++) {
+    lru_strategy->Release(
+        InsertValue(lru_strategy.get(), std::to_string(i), i, 1));
+  }
+  lru_strategy->Erase("199");
+
+  // Every key stored is visited once, the evicted and erased ones are not.
+  std::set<std::string> keys;
+  size_t visits = 0;
+  lru_strategy->VisitKeys([&](const Slice &key) {
+    keys.insert(key.ToString());
+    visits++;
+  });
+  ASSERT_EQ(visits, keys.size());
+  ASSERT_EQ(visits, lru_strategy->TotalCharge());
+  ASSERT_EQ(keys.count("199"), 0);
+  for (const std::string &key : keys) {
+    CacheStrategy::HANDLE h = lru_strategy->Lookup(key);
+    ASSERT_TRUE(h != NULL);
+    lru_strategy->Release(h);
+  }
+}
+
+TEST(Clock, Basic) {
+  std::unique_ptr<CacheStrategy> clock(CacheStrategy::Clock(100, 1, 0));
+  for (int i = 0; i < 50; i++) {
+    clock->Release(InsertValue(clock.get(), std::to_string(i), i, 1));
+  }
+  ASSERT_EQ(clock->TotalCharge(), 50);
+  for (int i = 0; i < 50; i++) {
+    CacheStrategy::HANDLE h = clock->Lookup(std::to_string(i));
+    ASSERT_TRUE(h != NULL);
+    ASSERT_EQ(ValueOf<int>(clock.get(), h), i);
+    clock->Release(h);
+  }
+  ASSERT_TRUE(clock->Lookup("50") == NULL);
+
+  // update the value of an existing entry
+  CacheStrategy::HANDLE h = InsertValue(clock.get(), "7", 70, 2);
+  ASSERT_EQ(ValueOf<int>(clock.get(), h), 70);
+  clock->Release(h);
+  h = clock->Lookup("7");
+  ASSERT_EQ(ValueOf<int>(clock.get(), h), 70);
+  clock->Release(h);
+  ASSERT_EQ(clock->TotalCharge(), 51);
+
+  // The erased entries are missing, and their slots are reused.
+  for (int i = 0; i < 50; i += 2) {
+    clock->Erase(std::to_string(i));
+    ASSERT_TRUE(clock->Lookup(std::to_string(i)) == NULL);
+  }
+  for (int i = 1; i < 50; i += 2) {
+    h = clock->Lookup(std::to_string(i));
+    ASSERT_TRUE(h != NULL);
+    clock->Release(h);
+  }
+  for (int i = 50; i < 70; i++) {
+    clock->Release(InsertValue(clock.get(), std::to_string(i), i, 1));
+  }
+  ASSERT_EQ(clock->TotalCharge(), 46);
+}
+
+TEST(Clock, SecondChance) {
+  // single shard, so that the evictions depend on this thread only.
+  std::unique_ptr<CacheStrategy> clock(CacheStrategy::Clock(3, 1, 0));
+  for (const char *key : {"a", "b", "c"}) {
+    clock->Release(InsertValue(clock.get(), key, 1, 1));
+  }
+
+  // "a" has been hit since inserted, one of the others is evicted first.
+  CacheStrategy::HANDLE h = clock->Lookup("a");
+  clock->Release(h);
+  clock->Release(InsertValue(clock.get(), "d", 1, 1));
+  ASSERT_EQ(clock->TotalCharge(), 3);
+  int found = 0;
+  for (const char *key : {"a", "b", "c", "d"}) {
+    h = clock->Lookup(key);
+    if (h == NULL) {
+      ASSERT_TRUE(key[0] == 'b' || key[0] == 'c') << key;
+      continue;
+    }
+    found++;
+    clock->Release(h);
+  }
+  ASSERT_EQ(found, 3);
+}
+
+TEST(Clock, Pinned) {
+  std::unique_ptr<CacheStrategy> clock(CacheStrategy::Clock(2, 1, 0));
+  auto value = std::make_shared<std::string>("v1");
+
+  // A handle keeps its value alive after the entry is replaced, evicted or
+  // erased, until it's released.
+  CacheStrategy::HANDLE h1 = InsertValue(clock.get(), "1", value, 1);
+  CacheStrategy::HANDLE h2 = clock->Lookup("1");
+  clock->Release(InsertValue(clock.get(), "1", std::string("v2"), 1));
+  ASSERT_EQ(value.use_count(), 2);
+  ASSERT_EQ(*ValueOf<std::shared_ptr<std::string>>(clock.get(), h2), "v1");
+  clock->Release(h1);
+  ASSERT_EQ(value.use_count(), 2);
+  clock->Release(h2);
+  ASSERT_EQ(value.use_count(), 1);
+
+  h1 = clock->Lookup("1");
+  ASSERT_EQ(ValueOf<std::string>(clock.get(), h1), "v2");
+  for (int i = 0; i < 10; i++) {
+    clock->Release(InsertValue(clock.get(), std::to_string(i + 2), i, 1));
+  }
+  ASSERT_TRUE(clock->Lookup("1") == NULL);
+  ASSERT_EQ(ValueOf<std::string>(clock.get(), h1), "v2");
+  ASSERT_LE(clock->TotalCharge(), 2);
+  clock->Release(h1);
+}
+
+TEST(Clock, Full) {
+  // The table of a shard has 16 slots, of which 14 may be filled.
+  std::unique_ptr<CacheStrategy> clock(CacheStrategy::Clock(1000, 1000, 0));
+  std::vector<CacheStrategy::HANDLE> handles;
+  for (int i = 0; i < 20; i++) {
+    handles.push_back(InsertValue(clock.get(), std::to_string(i), i, 1));
+  }
+
+  // The entries inserted while every slot is taken by a pinned entry are
+  // never in the cache, and still readable by their handles.
+  ASSERT_EQ(clock->TotalCharge(), 14);
+  for (int i = 0; i < 20; i++) {
+    ASSERT_EQ(ValueOf<int>(clock.get(), handles[i]), i);
+    clock->Release(handles[i]);
+  }
+  for (int i = 0; i < 20; i++) {
+    clock->Release(InsertValue(clock.get(), std::to_string(i + 100), i, 1));
+  }
+  ASSERT_EQ(clock->TotalCharge(), 14);
+}
+
+TEST(Clock, Reserve) {
+  std::unique_ptr<CacheStrategy> clock(CacheStrategy::Clock(100, 10, 0));
+  for (const char *key : {"a", "b", "c"}) {
+    clock->Release(InsertValue(clock.get(), key, 1, 30));
+  }
+
+  // The reservation evicts entries to fit in, and is left out of the
+  // entries' capacity until it's given back.
+  clock->Reserve(50);
+  ASSERT_EQ(clock->TotalCharge(), 30);
+  clock->Release(InsertValue(clock.get(), "d", 1, 30));
+  ASSERT_EQ(clock->TotalCharge(), 30);
+  clock->Unreserve(50);
+  clock->Release(InsertValue(clock.get(), "e", 1, 30));
+  clock->Release(InsertValue(clock.get(), "f", 1, 30));
+  ASSERT_EQ(clock->TotalCharge(), 90);
+}
+
+TEST(Clock, Concurrent) {
+  const int kThreads = 8;
+  const int kKeys = 64;
+  auto counted = std::make_shared<int>(0);
+  {
+    // Smaller than the working set, so that entries are evicted while other
+    // threads look them up and hold them.
+    std::unique_ptr<CacheStrategy> clock(CacheStrategy::Clock(kKeys / 2, 1, 1));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+      threads.emplace_back([&clock, &counted, t] {
+        for (int i = 0; i < 20000; i++) {
+          int k = (i * 7 + t) % kKeys;
+          std::string key = std::to_string(k);
+          if (i % 100 == t) {
+            clock->Erase(key);
+            continue;
+          }
+          CacheStrategy::HANDLE h = clock->Lookup(key);
+          if (h == NULL) {
+            h = InsertValue(clock.get(), key,
+                            std::make_pair(k, std::shared_ptr<int>(counted)),
+                            1);
+          }
+          typedef std::pair<int, std::shared_ptr<int>> Value;
+          ASSERT_EQ(ValueOf<Value>(clock.get(), h).first, k);
+          clock->Release(h);
+        }
+      });
+    }
+    for (auto &t : threads)
+      t.join();
+    ASSERT_LE(clock->TotalCharge(), kKeys / 2);
+  }
+  // Every value has been freed with the cache.
+  ASSERT_EQ(counted.use_count(), 1);
+}
+
+TEST(Clock, VisitKeys) {
+  std::unique_ptr<CacheStrategy> clock(CacheStrategy::Clock(100, 1));
+  for (int i = 0; i < 50; i++) {
+    clock->Release(InsertValue(clock.get(), std::to_string(i), i, 1));
+  }
+  clock->Erase("7");
+  std::set<std::string> keys;
+  clock->VisitKeys([&keys](const Slice &key) { keys.insert(key.ToString()); });
+  ASSERT_EQ(keys.size(), 49);
+  ASSERT_EQ(keys.count("7"), 0);
+}
+
@@ -0,0 +1,114 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <benchmark/benchmark.h>
+#include <random>
+#include <string>
+
+#include "Coding.h"
+
+using namespace lessdb;
+
+namespace {
+
+// 4096 varints, of which range(0) percent take more than 1 byte, like the
+// shared, unshared and value lengths of block entries, which are mostly
+// below 128.
+std::string encodedVarints(int multibyte_percent, size_t *count) {
+  std::mt19937 gen(301);
+  std::uniform_int_distribution<int> percent(0, 99);
+  std::uniform_int_distribution<uint32_t> small(0, 127);
+  std::uniform_int_distribution<uint32_t> large(128, 1 << 20);
+  std::string buf;
+  *count = 4096;
+  for (size_t i = 0; i < *count; i++) {
+    coding::AppendVar32(&buf, percent(gen) < multibyte_percent ? large(gen)
+                                                               : small(gen));
+  }
+  return buf;
+}
+
+}  // namespace
+
+// silly::coding::GetVar32, which throws std::invalid_argument on a malformed
+// varint, and is called in a try block.
+static void Coding_SillyGetVar32(benchmark::State &state) {
+  size_t count;
+  const std::string buf =
+      encodedVarints(static_cast<int>(state.range(0)), &count);
+  for (auto _ : state) {
+    Slice input(buf);
+    uint32_t sum = 0, v;
+    try {
+      for (size_t i = 0; i < count; i++) {
+        coding::GetVar32(&input, &v);
+        sum += v;
+      }
+    } catch (std::exception &e) {
+      state.SkipWithError(e.what());
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+
+// coding::ParseVar32, which returns false on a malformed varint.
+static void Coding_ParseVar32(benchmark::State &state) {
+  size_t count;
+  const std::string buf =
+      encodedVarints(static_cast<int>(state.range(0)), &count);
+  for (auto _ : state) {
+    Slice input(buf);
+    uint32_t sum = 0, v;
+    for (size_t i = 0; i < count; i++) {
+      if (!coding::ParseVar32(&input, &v)) {
+        state.SkipWithError("malformed varint");
+        break;
+      }
+      sum += v;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+
+// coding::ParseVarString over the records of a WriteBatch-like buffer.
+static void Coding_ParseVarString(benchmark::State &state) {
+  std::string buf;
+  const size_t count = 4096;
+  for (size_t i = 0; i < count; i++)
+    coding::AppendVarString(&buf, std::string(16 + i % 100, 'k'));
+  for (auto _ : state) {
+    Slice input(buf), str;
+    size_t bytes = 0;
+    while (coding::ParseVarString(&input, &str))
+      bytes += str.Len();
+    benchmark::DoNotOptimize(bytes);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * count));
+}
+
+BENCHMARK(Coding_SillyGetVar32)->Arg(0)->Arg(10)->Arg(50);
+BENCHMARK(Coding_ParseVar32)->Arg(0)->Arg(10)->Arg(50);
+BENCHMARK(Coding_ParseVarString);
+
+BENCHMARK_MAIN();
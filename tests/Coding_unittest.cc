@@ -0,0 +1,97 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "Coding.h"
+
+using namespace lessdb;
+
+TEST(Varint, RoundTrip) {
+  std::vector<uint64_t> values = {0, 1, 127, 128, 255, 16383, 16384,
+                                  UINT32_MAX, UINT64_MAX};
+  for (int shift = 0; shift < 64; shift += 7)
+    values.push_back((1ull << shift) + 1);
+
+  std::string buf;
+  for (uint64_t v : values) {
+    coding::AppendVar64(&buf, v);
+    coding::AppendVar32(&buf, static_cast<uint32_t>(v));
+  }
+
+  Slice input(buf);
+  for (uint64_t v : values) {
+    uint64_t v64;
+    uint32_t v32;
+    ASSERT_TRUE(coding::ParseVar64(&input, &v64));
+    ASSERT_EQ(v64, v);
+    ASSERT_TRUE(coding::ParseVar32(&input, &v32));
+    ASSERT_EQ(v32, static_cast<uint32_t>(v));
+  }
+  ASSERT_TRUE(input.Empty());
+}
+
+TEST(Varint, Malformed) {
+  std::string buf;
+  coding::AppendVar32(&buf, UINT32_MAX);
+
+  // Every proper prefix of the varint is truncated.
+  for (size_t n = 0; n < buf.size(); n++) {
+    Slice input(buf.data(), n);
+    uint32_t v;
+    ASSERT_FALSE(coding::ParseVar32(&input, &v));
+    ASSERT_EQ(input.Len(), n);
+  }
+
+  // A varint32 spans at most 5 bytes.
+  const std::string too_long(6, '\x80');
+  uint32_t v32;
+  ASSERT_EQ(coding::GetVar32Ptr(too_long.data(),
+                                too_long.data() + too_long.size(), &v32),
+            nullptr);
+  uint64_t v64;
+  Slice input(too_long);
+  ASSERT_FALSE(coding::ParseVar64(&input, &v64));
+}
+
+TEST(VarString, Parse) {
+  std::string buf;
+  coding::AppendVarString(&buf, "");
+  coding::AppendVarString(&buf, "key");
+  coding::AppendVarString(&buf, std::string(300, 'v'));
+
+  Slice input(buf), str;
+  ASSERT_TRUE(coding::ParseVarString(&input, &str));
+  ASSERT_EQ(str.Len(), 0);
+  ASSERT_TRUE(coding::ParseVarString(&input, &str));
+  ASSERT_EQ(str.ToString(), "key");
+  ASSERT_TRUE(coding::ParseVarString(&input, &str));
+  ASSERT_EQ(str.ToString(), std::string(300, 'v'));
+  ASSERT_TRUE(input.Empty());
+
+  // The length runs past the end of the input.
+  Slice truncated(buf.data() + 1, 3);
+  ASSERT_FALSE(coding::ParseVarString(&truncated, &str));
+  ASSERT_EQ(truncated.Len(), 3);
+}
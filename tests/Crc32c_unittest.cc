@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+
+#include "Crc32c.h"
+#include "TestUtils.h"
+
+using namespace lessdb;
+using namespace test;
+
+TEST(Crc32c, StandardResults) {
+  // From rfc3720 section B.4.
+  char buf[32];
+
+  memset(buf, 0, sizeof(buf));
+  ASSERT_EQ(0x8a9136aau, crc32c::Value(buf, sizeof(buf)));
+
+  memset(buf, 0xff, sizeof(buf));
+  ASSERT_EQ(0x62a8ab43u, crc32c::Value(buf, sizeof(buf)));
+
+  for (int i = 0; i < 32; i++) {
+    buf[i] = static_cast<char>(i);
+  }
+  ASSERT_EQ(0x46dd794eu, crc32c::Value(buf, sizeof(buf)));
+
+  for (int i = 0; i < 32; i++) {
+    buf[i] = static_cast<char>(31 - i);
+  }
+  ASSERT_EQ(0x113fdb5cu, crc32c::Value(buf, sizeof(buf)));
+
+  ASSERT_EQ(0xe3069283u, crc32c::Value("123456789", 9));
+}
+
+TEST(Crc32c, Extend) {
+  ASSERT_EQ(crc32c::Value("hello world", 11),
+            crc32c::Extend(crc32c::Value("hello ", 6), "world", 5));
+}
+
+TEST(Crc32c, PortableMatchesHardware) {
+  // Every length and alignment around the 8-byte steps.
+  std::string data = RandomString(1000);
+  for (size_t offset = 0; offset < 8; offset++) {
+    for (size_t n = 0; n + offset <= data.size(); n += (n < 64 ? 1 : 37)) {
+      ASSERT_EQ(crc32c::TEST_ExtendPortable(0, data.data() + offset, n),
+                crc32c::Value(data.data() + offset, n))
+          << offset << " " << n;
+    }
+  }
+}
+
+TEST(Crc32c, Legacy) {
+  // The crc32 (IEEE) check value.
+  ASSERT_EQ(0xcbf43926u, LegacyCrc32("123456789", 9));
+}
@@ -0,0 +1,1711 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "Block.h"
+#include "CacheStrategy.h"
+#include "Config.h"
+#include "DB.h"
+#include "DBImpl.h"
+#include "DBIterator.h"
+#include "FileName.h"
+#include "FileUtils.h"
+#include "FilterStrategy.h"
+#include "MemTable.h"
+#include "PrefixExtractor.h"
+#include "RateLimiter.h"
+#include "SSTable.h"
+#include "SSTableBuilder.h"
+#include "Statistics.h"
+#include "TestUtils.h"
+#include "ThreadPool.h"
+#include "Version.h"
+#include "VersionSet.h"
+#include "WriteBatch.h"
+#include "WriteBufferManager.h"
+
+using namespace lessdb;
+using namespace test;
+
+TEST(Write, Single) {
+  Options options;
+  StringSink sink;
+  DBImpl db(options, &sink);
+
+  WriteBatch batch;
+  batch.Put("k1", "v1");
+  batch.Delete("k2");
+  ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+  ASSERT_EQ(db.TEST_GetLastSequence(), 2);
+  ASSERT_FALSE(sink.Content().empty());
+
+  MemTable *mem = db.TEST_GetMemTable();
+  auto it = mem->find(InternalKeyBuf("k1", 1, kTypeValue).Data());
+  ASSERT_TRUE(it != mem->end());
+  ASSERT_EQ(it->second, Slice("v1"));
+  ASSERT_TRUE(mem->find(InternalKeyBuf("k2", 2, kTypeDeletion).Data()) !=
+              mem->end());
+}
+
+TEST(Write, LogError) {
+  Options options;
+  StringSink sink;
+  DBImpl db(options, &sink);
+  auto put = [&db](const std::string &key) {
+    WriteBatch batch;
+    batch.Put(key, "v");
+    return db.Write(WriteOptions(), &batch);
+  };
+  ASSERT_TRUE(put("k1"));
+
+  // The failed group is not visible, and its error fails the later writes,
+  // even though the log could be appended to again.
+  sink.SetFailAppends(true);
+  Status s = put("k2");
+  ASSERT_TRUE(!s && s.IsIOError()) << s.ToString();
+  sink.SetFailAppends(false);
+  s = put("k3");
+  ASSERT_TRUE(!s && s.IsIOError()) << s.ToString();
+  ASSERT_EQ(db.TEST_GetLastSequence(), 1);
+
+  MemTable *mem = db.TEST_GetMemTable();
+  size_t count = 0;
+  for (auto it = mem->begin(); it != mem->end(); it++)
+    count++;
+  ASSERT_EQ(count, 1);
+}
+
+TEST(Write, Statistics) {
+  Statistics stats;
+  Options options;
+  options.statistics = &stats;
+  StringSink sink;
+  DBImpl db(options, &sink);
+
+  WriteBatch batch;
+  batch.Put("k1", "v1");
+  batch.Delete("k2");
+  WriteOptions write_options;
+  write_options.sync = true;
+  ASSERT_TRUE(db.Write(write_options, &batch));
+  ASSERT_EQ(stats.GetTickerCount(kWalWrites), 1);
+  ASSERT_EQ(stats.GetTickerCount(kWalSyncs), 1);
+  ASSERT_EQ(stats.GetTickerCount(kMemtableInserts), 2);
+  ASSERT_GT(stats.GetTickerCount(kWalBytes), 0);
+  ASSERT_LE(stats.GetTickerCount(kWalBytes), sink.Content().size());
+
+  std::string value;
+  ASSERT_TRUE(db.Get(ReadOptions(), "k1", &value));
+  HistogramData data;
+  stats.GetHistogramData(kWriteMicros, &data);
+  ASSERT_EQ(data.count, 1);
+  stats.GetHistogramData(kWalSyncMicros, &data);
+  ASSERT_EQ(data.count, 1);
+  stats.GetHistogramData(kGetMicros, &data);
+  ASSERT_EQ(data.count, 1);
+}
+
+static void TestConcurrentGroupCommit(bool concurrent_memtable_write) {
+  Options options;
+  options.allow_concurrent_memtable_write = concurrent_memtable_write;
+  StringSink sink;
+  DBImpl db(options, &sink);
+
+  const int kThreads = 16;
+  const int kWritesPerThread = 200;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&db, t] {
+      WriteOptions write_options;
+      write_options.sync = (t % 2 == 0);
+      for (int i = 0; i < kWritesPerThread; i++) {
+        WriteBatch batch;
+        batch.Put(std::to_string(t) + "." + std::to_string(i), "v");
+        ASSERT_TRUE(db.Write(write_options, &batch));
+      }
+    });
+  }
+  for (auto &th : threads)
+    th.join();
+
+  ASSERT_EQ(db.TEST_GetLastSequence(), kThreads * kWritesPerThread);
+
+  // Every update must be visible with a unique sequence number.
+  std::set<SequenceNumber> sequences;
+  size_t count = 0;
+  MemTable *mem = db.TEST_GetMemTable();
+  for (auto it = mem->begin(); it != mem->end(); it++) {
+    InternalKey ikey(it->first);
+    ASSERT_TRUE(sequences.insert(ikey.sequence).second);
+    count++;
+  }
+  ASSERT_EQ(count, kThreads * kWritesPerThread);
+  ASSERT_EQ(*sequences.begin(), 1);
+  ASSERT_EQ(*sequences.rbegin(), kThreads * kWritesPerThread);
+}
+
+TEST(Write, ConcurrentGroupCommit) {
+  TestConcurrentGroupCommit(false);
+}
+
+TEST(Write, ConcurrentMemTableWrite) {
+  TestConcurrentGroupCommit(true);
+}
+
+TEST(Read, Snapshot) {
+  Options options;
+  StringSink sink;
+  DBImpl db(options, &sink);
+  std::string value;
+
+  ASSERT_TRUE(db.Get(ReadOptions(), "k1", &value).IsNotFound());
+  WriteBatch batch;
+  batch.Put("k1", "v1");
+  batch.Put("k2", "v2");
+  ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+  const Snapshot *snapshot = db.GetSnapshot();
+  ASSERT_EQ(snapshot->sequence(), 2);
+
+  WriteBatch batch2;
+  batch2.Put("k1", "v1'");
+  batch2.Delete("k2");
+  batch2.Put("k3", "v3");
+  ASSERT_TRUE(db.Write(WriteOptions(), &batch2));
+
+  ASSERT_TRUE(db.Get(ReadOptions(), "k1", &value));
+  ASSERT_EQ(value, "v1'");
+  ASSERT_TRUE(db.Get(ReadOptions(), "k2", &value).IsNotFound());
+  ASSERT_TRUE(db.Get(ReadOptions(), "k3", &value));
+  ASSERT_EQ(value, "v3");
+
+  ReadOptions read_options;
+  read_options.snapshot = snapshot;
+  ASSERT_TRUE(db.Get(read_options, "k1", &value));
+  ASSERT_EQ(value, "v1");
+  ASSERT_TRUE(db.Get(read_options, "k2", &value));
+  ASSERT_EQ(value, "v2");
+  ASSERT_TRUE(db.Get(read_options, "k3", &value).IsNotFound());
+  db.ReleaseSnapshot(snapshot);
+}
+
+class RecoverTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dbname_ = (boost::filesystem::temp_directory_path() /
+               boost::filesystem::unique_path("lessdb-%%%%-%%%%"))
+                  .string();
+    options_.create_if_missing = true;
+  }
+
+  void TearDown() override {
+    boost::filesystem::remove_all(dbname_);
+  }
+
+  // Returns the user keys and values in the memtable of db, in order.
+  static std::vector<std::pair<std::string, std::string>> Dump(
+      const DBImpl &db) {
+    std::vector<std::pair<std::string, std::string>> result;
+    MemTable *mem = db.TEST_GetMemTable();
+    for (auto it = mem->begin(); it != mem->end(); it++) {
+      InternalKey ikey(it->first);
+      result.emplace_back(ikey.user_key.ToString() + "@" +
+                              std::to_string(ikey.sequence),
+                          it->second.ToString());
+    }
+    return result;
+  }
+
+  std::string dbname_;
+  Options options_;
+};
+
+TEST_F(RecoverTest, Missing) {
+  options_.create_if_missing = false;
+  DBImpl db(options_, dbname_);
+  ASSERT_FALSE(db.Recover());
+  ASSERT_FALSE(boost::filesystem::exists(dbname_));
+}
+
+TEST_F(RecoverTest, Reopen) {
+  std::vector<std::pair<std::string, std::string>> expected;
+  {
+    DBImpl db(options_, dbname_);
+    ASSERT_TRUE(db.Recover());
+    WriteBatch batch;
+    batch.Put("k1", "v1");
+    batch.Put("k2", "v2");
+    ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+    expected = Dump(db);
+  }
+
+  for (int i = 0; i < 3; i++) {
+    DBImpl db(options_, dbname_);
+    Status s = db.Recover();
+    ASSERT_TRUE(s) << s.ToString();
+    ASSERT_EQ(Dump(db), expected);
+    ASSERT_EQ(db.TEST_GetLastSequence(), 2 + i);
+
+    // Updates after recovery go to a new log, which is replayed after the
+    // old ones.
+    WriteBatch batch;
+    batch.Delete("k1");
+    ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+    expected = Dump(db);
+  }
+}
+
+TEST_F(RecoverTest, LargeLog) {
+  const int kBatches = 3000;
+  // Keeps all the updates in the memtable and its log.
+  options_.write_buffer_size = 64 << 20;
+  std::vector<std::pair<std::string, std::string>> expected;
+  {
+    DB *db = nullptr;
+    ASSERT_TRUE(DB::Open(options_, dbname_, &db));
+    std::unique_ptr<DB> guard(db);
+    for (int i = 0; i < kBatches; i++) {
+      // Values of a few KB make the log span hundreds of blocks, some
+      // records cross the block boundaries.
+      std::string value = RandomString(RandomIn(0, 4096));
+      ASSERT_TRUE(db->Put(WriteOptions(), std::to_string(i), value));
+    }
+  }
+
+  for (int num_threads : {1, 4}) {
+    options_.wal_recovery_threads = num_threads;
+    options_.paranoid_checks = true;
+    DBImpl db(options_, dbname_);
+    ASSERT_TRUE(db.Recover());
+    ASSERT_EQ(db.TEST_GetLastSequence(), kBatches);
+    if (expected.empty()) {
+      expected = Dump(db);
+      ASSERT_EQ(expected.size(), kBatches);
+    } else {
+      ASSERT_EQ(Dump(db), expected);
+    }
+  }
+}
+
+// Returns the user keys, sequences and values in the sstables of "level" in
+// db, checking that they're sorted in each file, and for a level > 0, across
+// the files.
+static std::vector<std::pair<std::string, std::string>> DumpLevel(
+    const DBImpl &db, const std::string &dbname, const Options &options,
+    int level) {
+  InternalKeyComparator icmp(options.comparator);
+  Options table_options = options;
+  table_options.comparator = &icmp;
+
+  std::vector<std::pair<std::string, std::string>> result;
+  std::string last;
+  for (const FileMetaData *f :
+       db.TEST_GetVersionSet()->current()->Files(level)) {
+    if (level == 0)
+      last.clear();
+    std::string fname = TableFileName(dbname, f->number);
+    Status s;
+    std::unique_ptr<RandomAccessFile> file(
+        FileFactory::Default()->NewRandomAccessFile(fname, &s));
+    EXPECT_TRUE(s) << s.ToString();
+    std::unique_ptr<SSTable> table(
+        SSTable::Open(table_options, file.get(), f->file_size, s));
+    EXPECT_TRUE(s) << s.ToString();
+    if (!s)
+      return result;
+
+    EXPECT_EQ(table->begin().Key(), Slice(f->smallest));
+    for (auto it = table->begin(); it != table->end(); it++) {
+      if (!last.empty())
+        EXPECT_LT(icmp.Compare(Slice(last), it.Key()), 0);
+      last = it.Key().ToString();
+      InternalKey ikey(it.Key());
+      result.emplace_back(ikey.user_key.ToString() + "@" +
+                              std::to_string(ikey.sequence),
+                          it.Value().ToString());
+    }
+    EXPECT_EQ(last, f->largest);
+  }
+  return result;
+}
+
+TEST_F(RecoverTest, FlushMemTable) {
+  const int kBatches = 3000;
+  options_.write_buffer_size = 64 << 10;
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Recover());
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&db, t] {
+      for (int i = t; i < kBatches; i += 4) {
+        WriteBatch batch;
+        batch.Put(std::to_string(i), std::string(100, 'v'));
+        ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+      }
+    });
+  }
+  for (auto &t : threads)
+    t.join();
+  ASSERT_TRUE(db.TEST_WaitForCompaction());
+  ASSERT_TRUE(db.TEST_GetImmutableMemTable() == nullptr);
+
+  // Every update is either flushed to a table, or still in the memtable.
+  std::set<std::string> keys;
+  int num_tables = 0;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    num_tables += db.TEST_GetVersionSet()->NumLevelFiles(level);
+    for (const auto &entry : DumpLevel(db, dbname_, options_, level)) {
+      ASSERT_TRUE(keys.insert(entry.first).second);
+    }
+  }
+  ASSERT_GT(num_tables, 0);
+  ASSERT_LT(db.TEST_GetVersionSet()->NumLevelFiles(0),
+            config::kL0_CompactionTrigger);
+  MemTable *mem = db.TEST_GetMemTable();
+  for (auto it = mem->begin(); it != mem->end(); it++) {
+    InternalKey ikey(it->first);
+    ASSERT_TRUE(keys.insert(ikey.user_key.ToString() + "@" +
+                            std::to_string(ikey.sequence))
+                    .second);
+  }
+  ASSERT_EQ(keys.size(), kBatches);
+
+  std::vector<std::string> filenames;
+  ASSERT_TRUE(FileFactory::Default()->GetChildren(dbname_, &filenames));
+  int tables = 0, logs = 0;
+  for (const std::string &filename : filenames) {
+    uint64_t number;
+    FileType type;
+    ASSERT_TRUE(ParseFileName(filename, &number, &type));
+    if (type == FileType::kTableFile)
+      tables++;
+    else if (type == FileType::kLogFile)
+      logs++;
+  }
+  // Only the live tables, and the log of the current memtable are left.
+  ASSERT_EQ(tables, num_tables);
+  ASSERT_EQ(logs, 1);
+}
+
+TEST_F(RecoverTest, VectorMemTable) {
+  const int kKeys = 2000;
+  options_.memtable_rep = kVectorRep;
+  options_.allow_concurrent_memtable_write = true;
+  options_.write_buffer_size = 64 << 10;
+  {
+    DBImpl db(options_, dbname_);
+    ASSERT_TRUE(db.Recover());
+
+    // Bulk load in reverse order, which the memtable sorts when flushed.
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+      threads.emplace_back([&db, t] {
+        for (int i = kKeys - 1 - t; i >= 0; i -= 4) {
+          WriteBatch batch;
+          batch.Put(std::to_string(i), std::string(100, 'v'));
+          ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+        }
+      });
+    }
+    for (auto &t : threads)
+      t.join();
+    ASSERT_TRUE(db.TEST_WaitForCompaction());
+    ASSERT_GT(db.TEST_GetVersionSet()->NumLevelFiles(0) +
+                  db.TEST_GetVersionSet()->NumLevelFiles(1),
+              0);
+
+    std::string value;
+    ASSERT_TRUE(db.Get(ReadOptions(), "1999", &value));
+    ASSERT_EQ(value, std::string(100, 'v'));
+  }
+
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Recover());
+  for (int i = 0; i < kKeys; i++) {
+    std::string value;
+    Status s = db.Get(ReadOptions(), std::to_string(i), &value);
+    ASSERT_TRUE(s) << i << ": " << s.ToString();
+  }
+  // The recovered memtable is a vector too.
+  MemTable *mem = db.TEST_GetMemTable();
+  for (auto it = mem->begin(), prev = it; it != mem->end(); prev = it++) {
+    if (prev != it)
+      ASSERT_LT(NewBytewiseComparator()->Compare(
+                    InternalKey(prev->first).user_key,
+                    InternalKey(it->first).user_key),
+                0);
+  }
+}
+
+TEST_F(RecoverTest, WriteBufferManager) {
+  // Two databases share a budget below their own write buffers, which they
+  // flush to stay within.
+  std::unique_ptr<CacheStrategy> cache(CacheStrategy::Default(8 << 20));
+  WriteBufferManager manager(256 << 10, cache.get(), true);
+  options_.write_buffer_size = 1 << 20;
+  options_.write_buffer_manager = &manager;
+  options_.block_cache = cache.get();
+  const std::string dbname2 = dbname_ + "-2";
+  {
+    DBImpl db1(options_, dbname_);
+    DBImpl db2(options_, dbname2);
+    ASSERT_TRUE(db1.Recover());
+    ASSERT_TRUE(db2.Recover());
+
+    for (int i = 0; i < 3000; i++) {
+      WriteBatch batch;
+      batch.Put(std::to_string(i), std::string(100, 'v'));
+      ASSERT_TRUE((i % 2 ? db1 : db2).Write(WriteOptions(), &batch));
+      ASSERT_LE(manager.MemtableUsage(), 2 * manager.BufferSize());
+    }
+    ASSERT_TRUE(db1.TEST_WaitForCompaction());
+    ASSERT_TRUE(db2.TEST_WaitForCompaction());
+    ASSERT_GT(db1.TEST_GetVersionSet()->NumLevelFiles(0), 0);
+    ASSERT_GT(db2.TEST_GetVersionSet()->NumLevelFiles(0), 0);
+    ASSERT_GT(manager.MemtableUsage(), 0);
+    ASSERT_EQ(manager.MemtableUsage(), manager.MutableMemtableUsage());
+  }
+  ASSERT_EQ(manager.MemtableUsage(), 0);
+  ASSERT_EQ(manager.TableUsage(), 0);
+  boost::filesystem::remove_all(dbname2);
+}
+
+TEST_F(RecoverTest, SharedThreadPool) {
+  // Two databases flush and compact on the same threads.
+  ThreadPool pool(1, 2);
+  options_.thread_pool = &pool;
+  options_.write_buffer_size = 32 << 10;
+  options_.max_file_size = 16 << 10;
+  options_.max_bytes_for_level_base = 64 << 10;
+  const std::string dbname2 = dbname_ + "-2";
+  {
+    DBImpl db1(options_, dbname_);
+    DBImpl db2(options_, dbname2);
+    ASSERT_TRUE(db1.Recover());
+    ASSERT_TRUE(db2.Recover());
+
+    std::vector<std::thread> threads;
+    for (DBImpl *db : {&db1, &db2}) {
+      threads.emplace_back([db] {
+        for (int i = 0; i < 5000; i++) {
+          WriteBatch batch;
+          batch.Put(std::to_string(i % 1000), std::to_string(i));
+          ASSERT_TRUE(db->Write(WriteOptions(), &batch));
+        }
+      });
+    }
+    for (auto &t : threads)
+      t.join();
+
+    for (DBImpl *db : {&db1, &db2}) {
+      ASSERT_TRUE(db->TEST_WaitForCompaction());
+      int deeper = 0;
+      for (int level = 1; level < config::kNumLevels; level++)
+        deeper += db->TEST_GetVersionSet()->NumLevelFiles(level);
+      ASSERT_GT(deeper, 0);
+      for (int i = 4000; i < 5000; i++) {
+        std::string value;
+        ASSERT_TRUE(db->Get(ReadOptions(), std::to_string(i % 1000), &value));
+        ASSERT_EQ(value, std::to_string(i));
+      }
+    }
+  }
+  ASSERT_EQ(pool.QueueLength(ThreadPool::kHigh), 0);
+  ASSERT_EQ(pool.QueueLength(ThreadPool::kLow), 0);
+  boost::filesystem::remove_all(dbname2);
+}
+
+TEST_F(RecoverTest, RateLimiter) {
+  // Flushes and compactions write through the limiter, the log doesn't.
+  RateLimiter limiter(64 << 20, 10 * 1000, true);
+  options_.rate_limiter = &limiter;
+  options_.write_buffer_size = 32 << 10;
+  options_.max_file_size = 16 << 10;
+  options_.max_bytes_for_level_base = 64 << 10;
+  {
+    DBImpl db(options_, dbname_);
+    ASSERT_TRUE(db.Recover());
+    for (int i = 0; i < 5000; i++) {
+      WriteBatch batch;
+      batch.Put(std::to_string(i % 1000), std::to_string(i));
+      ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+    }
+    ASSERT_TRUE(db.TEST_WaitForCompaction());
+    ASSERT_GT(limiter.GetTotalBytesThrough(RateLimiter::kHigh), 0);
+    ASSERT_GT(limiter.GetTotalBytesThrough(RateLimiter::kLow), 0);
+    for (int i = 4000; i < 5000; i++) {
+      std::string value;
+      ASSERT_TRUE(db.Get(ReadOptions(), std::to_string(i % 1000), &value));
+      ASSERT_EQ(value, std::to_string(i));
+    }
+  }
+}
+
+// Builds the external sstable "fname" of "entries", in which an empty value
+// is a deletion, as DB::IngestExternalFile expects it.
+static void BuildExternalFile(
+    const std::string &fname,
+    const std::vector<std::pair<std::string, std::string>> &entries,
+    SequenceNumber sequence = 0) {
+  InternalKeyComparator icmp(NewBytewiseComparator());
+  Options options;
+  options.comparator = &icmp;
+  Status s;
+  std::unique_ptr<WritableFile> file(
+      FileFactory::Default()->NewWritableFile(fname, &s));
+  ASSERT_TRUE(s);
+  SSTableBuilder builder(&options, file.get());
+  for (const auto &entry : entries) {
+    InternalKeyBuf key(entry.first, sequence,
+                       entry.second.empty() ? kTypeDeletion : kTypeValue);
+    ASSERT_TRUE(builder.Add(key.Data(), entry.second));
+  }
+  ASSERT_TRUE(builder.Finish());
+  ASSERT_TRUE(file->Close());
+}
+
+TEST_F(RecoverTest, IngestExternalFile) {
+  const std::string dir = dbname_ + "-external";
+  ASSERT_TRUE(boost::filesystem::create_directories(dir));
+  std::vector<std::pair<std::string, std::string>> a, b;
+  for (int i = 50; i < 60; i++)
+    a.emplace_back("a" + std::to_string(i), "new" + std::to_string(i));
+  a.emplace_back("a60", "");
+  for (int i = 10; i < 20; i++)
+    b.emplace_back("b" + std::to_string(i), "new" + std::to_string(i));
+  BuildExternalFile(dir + "/a.sst", a);
+  BuildExternalFile(dir + "/b.sst", b);
+
+  {
+    DBImpl db(options_, dbname_);
+    ASSERT_TRUE(db.Recover());
+    for (int i = 10; i < 100; i++) {
+      WriteBatch batch;
+      batch.Put("a" + std::to_string(i), "old" + std::to_string(i));
+      ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+    }
+    const Snapshot *snapshot = db.GetSnapshot();
+    const SequenceNumber last = db.TEST_GetLastSequence();
+
+    IngestExternalFileOptions ingest_options;
+    ingest_options.move_files = true;
+    ASSERT_TRUE(
+        db.IngestExternalFile(ingest_options, {dir + "/b.sst", dir + "/a.sst"}));
+    ASSERT_FALSE(boost::filesystem::exists(dir + "/a.sst"));
+    ASSERT_EQ(db.TEST_GetLastSequence(), last + 1);
+
+    // The memtable overlapping a.sst was flushed to level 0 first, a.sst
+    // lands on top of it, while b.sst overlaps nothing.
+    Version *current = db.TEST_GetVersionSet()->current();
+    ASSERT_EQ(current->NumFiles(0), 2);
+    ASSERT_EQ(current->NumFiles(config::kNumLevels - 1), 1);
+    ASSERT_EQ(current->Files(config::kNumLevels - 1)[0]->global_sequence,
+              last + 1);
+
+    std::string value;
+    ASSERT_TRUE(db.Get(ReadOptions(), "a55", &value));
+    ASSERT_EQ(value, "new55");
+    ASSERT_TRUE(db.Get(ReadOptions(), "a40", &value));
+    ASSERT_EQ(value, "old40");
+    ASSERT_TRUE(db.Get(ReadOptions(), "a60", &value).IsNotFound());
+    ASSERT_TRUE(db.Get(ReadOptions(), "b15", &value));
+    ASSERT_EQ(value, "new15");
+
+    // The files are newer than the snapshot.
+    ReadOptions read_options;
+    read_options.snapshot = snapshot;
+    ASSERT_TRUE(db.Get(read_options, "a55", &value));
+    ASSERT_EQ(value, "old55");
+    ASSERT_TRUE(db.Get(read_options, "a60", &value));
+    ASSERT_EQ(value, "old60");
+    ASSERT_TRUE(db.Get(read_options, "b15", &value).IsNotFound());
+    {
+      std::unique_ptr<DBIterator> iter(db.NewIterator(read_options, "a"));
+      int n = 0;
+      for (; iter->Valid(); iter->Next(), n++)
+        ASSERT_EQ(iter->Value().ToString().substr(0, 3), "old");
+      ASSERT_TRUE(iter->Stat());
+      ASSERT_EQ(n, 90);
+    }
+    db.ReleaseSnapshot(snapshot);
+
+    {
+      std::unique_ptr<DBIterator> iter(db.NewIterator(ReadOptions(), "a"));
+      std::map<std::string, std::string> seen;
+      for (; iter->Valid(); iter->Next())
+        seen[iter->Key().ToString()] = iter->Value().ToString();
+      ASSERT_TRUE(iter->Stat());
+      ASSERT_EQ(seen.size(), 89 + 10);
+      ASSERT_EQ(seen["a59"], "new59");
+      ASSERT_EQ(seen["a61"], "old61");
+      ASSERT_EQ(seen.count("a60"), 0);
+      ASSERT_EQ(seen["b10"], "new10");
+    }
+
+    // Later writes are newer than the files.
+    WriteBatch batch;
+    batch.Put("a51", "newer");
+    ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+    ASSERT_TRUE(db.Get(ReadOptions(), "a51", &value));
+    ASSERT_EQ(value, "newer");
+  }
+
+  // The global sequences are recovered from the manifest, and kept through
+  // compactions.
+  options_.write_buffer_size = 4 << 10;
+  options_.max_file_size = 4 << 10;
+  options_.max_bytes_for_level_base = 8 << 10;
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Recover());
+  for (int i = 0; i < 2000; i++) {
+    WriteBatch batch;
+    batch.Put("c" + std::to_string(i), std::string(50, 'c'));
+    batch.Put("a" + std::to_string(i % 3 + 70), "newest");
+    ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+  }
+  ASSERT_TRUE(db.TEST_WaitForCompaction());
+  std::string value;
+  ASSERT_TRUE(db.Get(ReadOptions(), "a51", &value));
+  ASSERT_EQ(value, "newer");
+  ASSERT_TRUE(db.Get(ReadOptions(), "a52", &value));
+  ASSERT_EQ(value, "new52");
+  ASSERT_TRUE(db.Get(ReadOptions(), "a60", &value).IsNotFound());
+  ASSERT_TRUE(db.Get(ReadOptions(), "a61", &value));
+  ASSERT_EQ(value, "old61");
+  ASSERT_TRUE(db.Get(ReadOptions(), "a71", &value));
+  ASSERT_EQ(value, "newest");
+  ASSERT_TRUE(db.Get(ReadOptions(), "b19", &value));
+  ASSERT_EQ(value, "new19");
+  boost::filesystem::remove_all(dir);
+}
+
+TEST_F(RecoverTest, IngestInvalidExternalFile) {
+  const std::string dir = dbname_ + "-external";
+  ASSERT_TRUE(boost::filesystem::create_directories(dir));
+  BuildExternalFile(dir + "/seq.sst", {{"a", "1"}}, 7);
+  BuildExternalFile(dir + "/a.sst", {{"a", "1"}, {"c", "1"}});
+  BuildExternalFile(dir + "/b.sst", {{"b", "1"}, {"d", "1"}});
+
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Recover());
+  IngestExternalFileOptions options;
+  ASSERT_TRUE(
+      db.IngestExternalFile(options, {dir + "/seq.sst"}).IsInvalidArgument());
+  ASSERT_TRUE(db.IngestExternalFile(options, {dir + "/a.sst", dir + "/b.sst"})
+                  .IsInvalidArgument());
+  ASSERT_FALSE(db.IngestExternalFile(options, {dir + "/missing.sst"}));
+  std::string value;
+  ASSERT_TRUE(db.Get(ReadOptions(), "a", &value).IsNotFound());
+  ASSERT_EQ(db.TEST_GetLastSequence(), 0);
+
+  // Copied, the file is left in place.
+  ASSERT_TRUE(db.IngestExternalFile(options, {dir + "/a.sst"}));
+  ASSERT_TRUE(boost::filesystem::exists(dir + "/a.sst"));
+  ASSERT_TRUE(db.Get(ReadOptions(), "c", &value));
+  ASSERT_EQ(value, "1");
+  boost::filesystem::remove_all(dir);
+}
+
+TEST_F(RecoverTest, Subcompactions) {
+  const int kKeys = 2000;
+  const int kRounds = 4;
+  options_.write_buffer_size = 64 << 10;
+  options_.max_file_size = 16 << 10;
+  options_.max_bytes_for_level_base = 128 << 10;
+  options_.max_subcompactions = 4;
+
+  std::map<std::string, std::string> latest;
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Recover());
+  for (int round = 0; round < kRounds; round++) {
+    for (int i = 0; i < kKeys; i++) {
+      char key[16];
+      snprintf(key, sizeof(key), "%06d", (i * 7919) % kKeys);
+      WriteBatch batch;
+      if (round == kRounds - 1 && i % 5 == 0) {
+        batch.Delete(key);
+        latest.erase(key);
+      } else {
+        std::string value = std::to_string(round) + RandomString(100);
+        batch.Put(key, value);
+        latest[key] = value;
+      }
+      ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+    }
+  }
+  Status s = db.TEST_WaitForCompaction();
+  ASSERT_TRUE(s) << s.ToString();
+
+  // The outputs of the key ranges make up sorted and disjoint levels, which
+  // DumpLevel checks, with only the newest entry of a user key each.
+  VersionSet *versions = db.TEST_GetVersionSet();
+  ASSERT_GT(versions->NumLevelFiles(1) + versions->NumLevelFiles(2), 1);
+  for (int level = 1; level < config::kNumLevels; level++) {
+    auto entries = DumpLevel(db, dbname_, options_, level);
+    for (size_t i = 1; i < entries.size(); i++) {
+      const std::string &prev = entries[i - 1].first;
+      const std::string &cur = entries[i].first;
+      ASSERT_NE(prev.substr(0, prev.find('@')), cur.substr(0, cur.find('@')));
+    }
+  }
+
+  for (int i = 0; i < kKeys; i++) {
+    char key[16];
+    snprintf(key, sizeof(key), "%06d", i);
+    std::string value;
+    s = db.Get(ReadOptions(), key, &value);
+    auto it = latest.find(key);
+    if (it == latest.end()) {
+      ASSERT_TRUE(s.IsNotFound()) << key;
+    } else {
+      ASSERT_TRUE(s) << s.ToString();
+      ASSERT_EQ(value, it->second);
+    }
+  }
+}
+
+TEST_F(RecoverTest, SubcompactionReadError) {
+  const int kKeys = 2000;
+  FaultInjectionFileFactory factory(FileFactory::Default());
+  options_.file_factory = &factory;
+  options_.write_buffer_size = 64 << 10;
+  options_.max_subcompactions = 4;
+
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Recover());
+  VersionSet *versions = db.TEST_GetVersionSet();
+  auto put = [&](int i) {
+    char key[16];
+    snprintf(key, sizeof(key), "%06d", (i * 7919) % kKeys);
+    WriteBatch batch;
+    batch.Put(key, RandomString(100));
+    return db.Write(WriteOptions(), &batch);
+  };
+
+  // Level 0 is filled up to a file short of a compaction. The versions are
+  // read only while no flush runs.
+  for (int i = 0;; i++) {
+    ASSERT_TRUE(put(i));
+    if (i % 100 == 0) {
+      ASSERT_TRUE(db.TEST_WaitForFlush());
+      if (versions->NumLevelFiles(0) == config::kL0_CompactionTrigger - 1)
+        break;
+    }
+  }
+  // The level-0 tables all overlap the key, which opens them, and then they
+  // fail to be read.
+  std::string value;
+  ASSERT_TRUE(db.Get(ReadOptions(), "000500x", &value).IsNotFound());
+  factory.FailOpenedReads();
+
+  // The error of a key range merged on another thread fails the compaction,
+  // rather than leaving the entries out of its outputs.
+  Status s;
+  for (int i = 0; s && i < kKeys; i++)
+    s = put(i);
+  s = db.TEST_WaitForCompaction();
+  ASSERT_TRUE(!s && s.IsIOError()) << s.ToString();
+  ASSERT_EQ(versions->NumLevelFiles(1), 0);
+}
+
+TEST_F(RecoverTest, Compaction) {
+  const int kKeys = 500;
+  const int kRounds = 10;
+  options_.write_buffer_size = 32 << 10;
+  options_.max_file_size = 16 << 10;
+  options_.max_bytes_for_level_base = 64 << 10;
+
+  std::map<std::string, std::string> latest;
+  std::vector<std::vector<std::pair<std::string, std::string>>> levels;
+  {
+    DBImpl db(options_, dbname_);
+    ASSERT_TRUE(db.Recover());
+    for (int round = 0; round < kRounds; round++) {
+      for (int i = 0; i < kKeys; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "%06d", i);
+        WriteBatch batch;
+        if (round == kRounds - 1 && i % 3 == 0) {
+          batch.Delete(key);
+          latest.erase(key);
+        } else {
+          std::string value = std::to_string(round) + RandomString(200);
+          batch.Put(key, value);
+          latest[key] = value;
+        }
+        ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+      }
+    }
+    Status s = db.TEST_WaitForCompaction();
+    ASSERT_TRUE(s) << s.ToString();
+    ASSERT_EQ(db.TEST_GetLastSequence(), kKeys * kRounds);
+
+    // The data has been pushed down below level-1.
+    VersionSet *versions = db.TEST_GetVersionSet();
+    ASSERT_GT(versions->NumLevelFiles(2), 0);
+
+    for (int level = 0; level < config::kNumLevels; level++) {
+      levels.push_back(DumpLevel(db, dbname_, options_, level));
+      if (level == 0)
+        continue;
+      // Only the newest entry of a user key is kept in a level > 0.
+      for (size_t i = 1; i < levels[level].size(); i++) {
+        const std::string &prev = levels[level][i - 1].first;
+        const std::string &cur = levels[level][i].first;
+        ASSERT_NE(prev.substr(0, prev.find('@')), cur.substr(0, cur.find('@')));
+      }
+    }
+
+    // The newest entry of every key is either in the memtable or in the
+    // shallowest level that has the key.
+    std::map<std::string, std::string> found;
+    MemTable *mem = db.TEST_GetMemTable();
+    std::set<std::string> in_mem;
+    for (auto it = mem->begin(); it != mem->end(); it++) {
+      InternalKey ikey(it->first);
+      std::string key = ikey.user_key.ToString();
+      if (in_mem.insert(key).second && ikey.type == kTypeValue)
+        found[key] = it->second.ToString();
+    }
+    std::set<std::string> seen = in_mem;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      // Level-0 files are newer than the ones before them.
+      auto entries = levels[level];
+      std::set<std::string> in_level;
+      std::map<std::string, SequenceNumber> newest;
+      for (const auto &entry : entries) {
+        std::string key = entry.first.substr(0, entry.first.find('@'));
+        SequenceNumber seq = std::stoull(entry.first.substr(key.size() + 1));
+        if (seen.count(key) || (newest.count(key) && newest[key] > seq))
+          continue;
+        newest[key] = seq;
+        in_level.insert(key);
+        found[key] = entry.second;
+      }
+      seen.insert(in_level.begin(), in_level.end());
+    }
+    for (auto it = found.begin(); it != found.end();) {
+      // Deleted keys, whose values come from older entries.
+      if (!latest.count(it->first))
+        it = found.erase(it);
+      else
+        ++it;
+    }
+    ASSERT_EQ(found, latest);
+  }
+
+  // The sstables are recovered from the manifest.
+  DBImpl db(options_, dbname_);
+  Status s = db.Recover();
+  ASSERT_TRUE(s) << s.ToString();
+  ASSERT_EQ(db.TEST_GetLastSequence(), kKeys * kRounds);
+  for (int level = 0; level < config::kNumLevels; level++) {
+    ASSERT_EQ(DumpLevel(db, dbname_, options_, level), levels[level]);
+  }
+}
+
+TEST_F(RecoverTest, SnapshotReads) {
+  const int kKeys = 500;
+  const int kRounds = 10;
+  options_.write_buffer_size = 32 << 10;
+  options_.max_file_size = 16 << 10;
+  options_.max_bytes_for_level_base = 64 << 10;
+
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Recover());
+  std::map<std::string, std::string> latest;
+  std::vector<std::pair<const Snapshot *, std::map<std::string, std::string>>>
+      snapshots;
+  for (int round = 0; round < kRounds; round++) {
+    for (int i = 0; i < kKeys; i++) {
+      char key[16];
+      snprintf(key, sizeof(key), "%06d", i);
+      WriteBatch batch;
+      if (i % 7 == round % 7) {
+        batch.Delete(key);
+        latest.erase(key);
+      } else {
+        std::string value = std::to_string(round) + RandomString(200);
+        batch.Put(key, value);
+        latest[key] = value;
+      }
+      ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+    }
+    if (round % 3 == 0)
+      snapshots.emplace_back(db.GetSnapshot(), latest);
+  }
+  Status s = db.TEST_WaitForCompaction();
+  ASSERT_TRUE(s) << s.ToString();
+  ASSERT_GT(db.TEST_GetVersionSet()->NumLevelFiles(1) +
+                db.TEST_GetVersionSet()->NumLevelFiles(2),
+            0);
+
+  // The compactions have kept every version seen by a live snapshot.
+  auto check = [&](const ReadOptions &read_options,
+                   const std::map<std::string, std::string> &expected) {
+    for (int i = 0; i < kKeys; i++) {
+      char key[16];
+      snprintf(key, sizeof(key), "%06d", i);
+      std::string value;
+      Status s = db.Get(read_options, key, &value);
+      auto it = expected.find(key);
+      if (it == expected.end()) {
+        ASSERT_TRUE(!s && s.IsNotFound()) << key << ": " << s.ToString();
+      } else {
+        ASSERT_TRUE(s) << key << ": " << s.ToString();
+        ASSERT_EQ(value, it->second);
+      }
+    }
+  };
+  check(ReadOptions(), latest);
+  for (const auto &snapshot : snapshots) {
+    SCOPED_TRACE(snapshot.first->sequence());
+    ReadOptions read_options;
+    read_options.snapshot = snapshot.first;
+    check(read_options, snapshot.second);
+  }
+  for (const auto &snapshot : snapshots)
+    db.ReleaseSnapshot(snapshot.first);
+}
+
+TEST_F(RecoverTest, RowCache) {
+  const int kKeys = 500;
+  std::unique_ptr<CacheStrategy> block_cache(CacheStrategy::Default(8 << 20));
+  std::unique_ptr<CacheStrategy> row_cache(CacheStrategy::Default(8 << 20));
+  Statistics stats;
+  options_.block_cache = block_cache.get();
+  options_.row_cache = row_cache.get();
+  options_.statistics = &stats;
+  options_.write_buffer_size = 32 << 10;
+  options_.max_file_size = 16 << 10;
+
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Recover());
+  std::map<std::string, std::string> latest;
+  std::vector<std::pair<const Snapshot *, std::map<std::string, std::string>>>
+      snapshots;
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < kKeys; i++) {
+      char key[16];
+      snprintf(key, sizeof(key), "%06d", i);
+      WriteBatch batch;
+      if (i % 5 == round) {
+        batch.Delete(key);
+        latest.erase(key);
+      } else {
+        std::string value = std::to_string(round) + RandomString(100);
+        batch.Put(key, value);
+        latest[key] = value;
+      }
+      ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+    }
+    snapshots.emplace_back(db.GetSnapshot(), latest);
+  }
+  ASSERT_TRUE(db.TEST_WaitForCompaction());
+
+  auto check = [&](const ReadOptions &read_options,
+                   const std::map<std::string, std::string> &expected) {
+    for (int i = 0; i < kKeys; i++) {
+      char key[16];
+      snprintf(key, sizeof(key), "%06d", i);
+      std::string value;
+      Status s = db.Get(read_options, key, &value);
+      auto it = expected.find(key);
+      if (it == expected.end()) {
+        ASSERT_TRUE(!s && s.IsNotFound()) << key << ": " << s.ToString();
+      } else {
+        ASSERT_TRUE(s) << key << ": " << s.ToString();
+        ASSERT_EQ(value, it->second);
+      }
+    }
+  };
+
+  // The rows cached by the first reads serve the second ones without
+  // looking up the blocks.
+  check(ReadOptions(), latest);
+  ASSERT_GT(row_cache->TotalCharge(), 0);
+  const uint64_t hits = stats.GetTickerCount(kRowCacheHit);
+  const uint64_t block_lookups = stats.GetTickerCount(kBlockCacheHit) +
+                                 stats.GetTickerCount(kBlockCacheMiss);
+  check(ReadOptions(), latest);
+  ASSERT_GT(stats.GetTickerCount(kRowCacheHit), hits);
+  ASSERT_EQ(stats.GetTickerCount(kBlockCacheHit) +
+                stats.GetTickerCount(kBlockCacheMiss),
+            block_lookups);
+
+  // The reads as of the snapshots, older than the cached rows, search the
+  // tables.
+  for (const auto &snapshot : snapshots) {
+    SCOPED_TRACE(snapshot.first->sequence());
+    ReadOptions read_options;
+    read_options.snapshot = snapshot.first;
+    check(read_options, snapshot.second);
+    check(read_options, snapshot.second);
+  }
+  for (const auto &snapshot : snapshots)
+    db.ReleaseSnapshot(snapshot.first);
+}
+
+TEST_F(RecoverTest, Iterator) {
+  const int kKeys = 500;
+  options_.write_buffer_size = 32 << 10;
+  options_.max_file_size = 16 << 10;
+  options_.max_bytes_for_level_base = 64 << 10;
+
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Recover());
+  std::map<std::string, std::string> latest, old;
+  const Snapshot *snapshot = nullptr;
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < kKeys; i++) {
+      char key[16];
+      snprintf(key, sizeof(key), "%06d", i);
+      WriteBatch batch;
+      if (i % 5 == round) {
+        batch.Delete(key);
+        latest.erase(key);
+      } else {
+        std::string value = std::to_string(round) + RandomString(200);
+        batch.Put(key, value);
+        latest[key] = value;
+      }
+      ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+    }
+    if (round == 1) {
+      snapshot = db.GetSnapshot();
+      old = latest;
+    }
+    if (round == 2) {
+      Status s = db.TEST_WaitForCompaction();
+      ASSERT_TRUE(s) << s.ToString();
+    }
+  }
+  ASSERT_GT(db.TEST_GetVersionSet()->NumLevelFiles(1) +
+                db.TEST_GetVersionSet()->NumLevelFiles(2),
+            0);
+
+  // The entries of the memtable and the sstables are merged into the view
+  // as of the snapshot, from any start key.
+  auto check = [&](const ReadOptions &read_options, const std::string &start,
+                   const std::map<std::string, std::string> &expected) {
+    std::unique_ptr<DBIterator> it(db.NewIterator(read_options, start));
+    auto e = expected.lower_bound(start);
+    for (; it->Valid(); it->Next(), e++) {
+      ASSERT_TRUE(e != expected.end());
+      ASSERT_EQ(it->Key().ToString(), e->first);
+      ASSERT_EQ(it->Value().ToString(), e->second);
+    }
+    ASSERT_TRUE(it->Stat()) << it->Stat().ToString();
+    ASSERT_TRUE(e == expected.end());
+  };
+  ReadOptions at_snapshot;
+  at_snapshot.snapshot = snapshot;
+  for (const std::string start : {"", "000250", "000250x", "zzz"}) {
+    SCOPED_TRACE(start);
+    check(ReadOptions(), start, latest);
+    check(at_snapshot, start, old);
+  }
+  db.ReleaseSnapshot(snapshot);
+}
+
+TEST_F(RecoverTest, DeleteRange) {
+  const int kKeys = 500;
+  const int kRounds = 6;
+  options_.write_buffer_size = 32 << 10;
+  options_.max_file_size = 16 << 10;
+  options_.max_bytes_for_level_base = 64 << 10;
+
+  auto key_of = [](int i) {
+    char key[16];
+    snprintf(key, sizeof(key), "%06d", i);
+    return std::string(key);
+  };
+  std::map<std::string, std::string> latest;
+  std::vector<std::pair<const Snapshot *, std::map<std::string, std::string>>>
+      snapshots;
+  std::unique_ptr<DBImpl> db(new DBImpl(options_, dbname_));
+  ASSERT_TRUE(db->Recover());
+  for (int round = 0; round < kRounds; round++) {
+    for (int i = 0; i < kKeys; i++) {
+      std::string value = std::to_string(round) + RandomString(200);
+      WriteBatch batch;
+      batch.Put(key_of(i), value);
+      latest[key_of(i)] = value;
+      ASSERT_TRUE(db->Write(WriteOptions(), &batch));
+
+      // Deletes a range written over since the previous rounds, so that its
+      // tombstone lands in the memtable along with newer entries.
+      if (i % 100 == 99) {
+        const int begin = i - 90 + round * 7, end = begin + 20 + round;
+        WriteBatch del;
+        del.DeleteRange(key_of(begin), key_of(end));
+        ASSERT_TRUE(db->Write(WriteOptions(), &del));
+        latest.erase(latest.lower_bound(key_of(begin)),
+                     latest.lower_bound(key_of(end)));
+      }
+    }
+    if (round % 2 == 0)
+      snapshots.emplace_back(db->GetSnapshot(), latest);
+  }
+
+  // A range spanning the levels, deleted by a tombstone flushed on its own.
+  ASSERT_TRUE(db->TEST_WaitForCompaction());
+  WriteBatch del;
+  del.DeleteRange(key_of(400), key_of(450));
+  ASSERT_TRUE(db->Write(WriteOptions(), &del));
+  latest.erase(latest.lower_bound(key_of(400)),
+               latest.lower_bound(key_of(450)));
+  snapshots.emplace_back(db->GetSnapshot(), latest);
+  for (int i = 0; i < 2 * kKeys; i++) {
+    std::string value = RandomString(200);
+    WriteBatch batch;
+    batch.Put(key_of(1000 + i), value);
+    latest[key_of(1000 + i)] = value;
+    ASSERT_TRUE(db->Write(WriteOptions(), &batch));
+  }
+  Status s = db->TEST_WaitForCompaction();
+  ASSERT_TRUE(s) << s.ToString();
+  ASSERT_GT(db->TEST_GetVersionSet()->NumLevelFiles(1) +
+                db->TEST_GetVersionSet()->NumLevelFiles(2),
+            0);
+
+  auto check = [&](const ReadOptions &read_options,
+                   const std::map<std::string, std::string> &expected) {
+    for (int i = 0; i < kKeys; i++) {
+      std::string value;
+      Status s = db->Get(read_options, key_of(i), &value);
+      auto it = expected.find(key_of(i));
+      if (it == expected.end()) {
+        ASSERT_TRUE(!s && s.IsNotFound()) << key_of(i) << ": " << s.ToString();
+      } else {
+        ASSERT_TRUE(s) << key_of(i) << ": " << s.ToString();
+        ASSERT_EQ(value, it->second);
+      }
+    }
+    std::unique_ptr<DBIterator> it(db->NewIterator(read_options, ""));
+    auto e = expected.begin();
+    for (; it->Valid(); it->Next(), e++) {
+      ASSERT_TRUE(e != expected.end());
+      ASSERT_EQ(it->Key().ToString(), e->first);
+      ASSERT_EQ(it->Value().ToString(), e->second);
+    }
+    ASSERT_TRUE(it->Stat()) << it->Stat().ToString();
+    ASSERT_TRUE(e == expected.end());
+  };
+  check(ReadOptions(), latest);
+  for (const auto &snapshot : snapshots) {
+    SCOPED_TRACE(snapshot.first->sequence());
+    ReadOptions read_options;
+    read_options.snapshot = snapshot.first;
+    check(read_options, snapshot.second);
+    db->ReleaseSnapshot(snapshot.first);
+  }
+
+  // Once no snapshot holds them, the deleted entries and the tombstones are
+  // compacted away, and the ones left are recovered from the manifest.
+  for (int i = 0; i < 2 * kKeys; i++) {
+    WriteBatch batch;
+    batch.Put(key_of(2000 + i), "x");
+    latest[key_of(2000 + i)] = "x";
+    ASSERT_TRUE(db->Write(WriteOptions(), &batch));
+  }
+  ASSERT_TRUE(db->TEST_WaitForCompaction());
+  check(ReadOptions(), latest);
+  db.reset(new DBImpl(options_, dbname_));
+  s = db->Recover();
+  ASSERT_TRUE(s) << s.ToString();
+  check(ReadOptions(), latest);
+}
+
+TEST_F(RecoverTest, MultiGet) {
+  const int kKeys = 500;
+  std::unique_ptr<CacheStrategy> cache(CacheStrategy::Default(8 << 20));
+  options_.block_cache = cache.get();
+  options_.write_buffer_size = 32 << 10;
+  options_.max_file_size = 16 << 10;
+  options_.max_bytes_for_level_base = 64 << 10;
+  std::unique_ptr<ThreadPool> pool(new ThreadPool(1, 1, 2));
+  options_.thread_pool = pool.get();
+
+  auto key_of = [](int i) {
+    char key[16];
+    snprintf(key, sizeof(key), "%06d", i);
+    return std::string(key);
+  };
+  std::unique_ptr<DBImpl> db(new DBImpl(options_, dbname_));
+  ASSERT_TRUE(db->Recover());
+  std::map<std::string, std::string> latest, old;
+  const Snapshot *snapshot = nullptr;
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < kKeys; i++) {
+      WriteBatch batch;
+      if (i % 5 == round) {
+        batch.Delete(key_of(i));
+        latest.erase(key_of(i));
+      } else {
+        std::string value = std::to_string(round) + RandomString(200);
+        batch.Put(key_of(i), value);
+        latest[key_of(i)] = value;
+      }
+      ASSERT_TRUE(db->Write(WriteOptions(), &batch));
+    }
+    if (round == 1) {
+      snapshot = db->GetSnapshot();
+      old = latest;
+    }
+  }
+  ASSERT_TRUE(db->TEST_WaitForCompaction());
+  ASSERT_GT(db->TEST_GetVersionSet()->NumLevelFiles(1) +
+                db->TEST_GetVersionSet()->NumLevelFiles(2),
+            0);
+
+  // Every key, and a missing one, as of the latest state and the snapshot.
+  std::vector<std::string> keys;
+  for (int i = 0; i <= kKeys; i++)
+    keys.push_back(key_of(i));
+  std::vector<Slice> slices(keys.begin(), keys.end());
+  auto check = [&](const std::map<std::string, std::string> &expected,
+                   const std::vector<Status> &statuses,
+                   const std::vector<std::string> &values) {
+    ASSERT_EQ(statuses.size(), keys.size());
+    ASSERT_EQ(values.size(), keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      auto it = expected.find(keys[i]);
+      if (it == expected.end()) {
+        ASSERT_TRUE(statuses[i].IsNotFound()) << keys[i];
+      } else {
+        ASSERT_TRUE(statuses[i]) << keys[i] << ": " << statuses[i].ToString();
+        ASSERT_EQ(values[i], it->second);
+      }
+    }
+  };
+  ReadOptions at_snapshot;
+  at_snapshot.snapshot = snapshot;
+  std::vector<std::string> values;
+  std::vector<Status> statuses = db->MultiGet(ReadOptions(), slices, &values);
+  check(latest, statuses, values);
+  statuses = db->MultiGet(at_snapshot, slices, &values);
+  check(old, statuses, values);
+
+  // The asynchronous lookups complete on the read threads, or at once for
+  // the keys of the memtable.
+  std::mutex mu;
+  std::condition_variable cv;
+  int done = 0;
+  std::vector<std::string> async_values(keys.size());
+  std::vector<Status> async_statuses(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    db->GetAsync(ReadOptions(), keys[i],
+                 [&, i](const Status &s, const std::string &value) {
+                   std::lock_guard<std::mutex> guard(mu);
+                   async_statuses[i] = s;
+                   async_values[i] = value;
+                   done++;
+                   cv.notify_all();
+                 });
+  }
+  db->MultiGetAsync(at_snapshot, slices,
+                    [&](const std::vector<Status> &statuses,
+                        const std::vector<std::string> &values) {
+                      check(old, statuses, values);
+                      std::lock_guard<std::mutex> guard(mu);
+                      done++;
+                      cv.notify_all();
+                    });
+  {
+    std::unique_lock<std::mutex> lock(mu);
+    while (done < static_cast<int>(keys.size()) + 1)
+      cv.wait(lock);
+  }
+  check(latest, async_statuses, async_values);
+
+  WriteBatch batch;
+  batch.Put("in-memtable", "v");
+  ASSERT_TRUE(db->Write(WriteOptions(), &batch));
+  bool called = false;
+  db->GetAsync(ReadOptions(), "in-memtable",
+               [&](const Status &s, const std::string &value) {
+                 ASSERT_TRUE(s);
+                 ASSERT_EQ(value, "v");
+                 called = true;
+               });
+  ASSERT_TRUE(called);
+  db->ReleaseSnapshot(snapshot);
+
+  // The database waits for the pending lookups as it's deleted.
+  std::atomic<int> pending(0);
+  for (size_t i = 0; i < keys.size(); i++) {
+    pending++;
+    db->GetAsync(ReadOptions(), keys[i],
+                 [&](const Status &s, const std::string &) { pending--; });
+  }
+  db.reset();
+  ASSERT_EQ(pending.load(), 0);
+}
+
+TEST_F(RecoverTest, AsyncReadError) {
+  std::unique_ptr<CacheStrategy> cache(CacheStrategy::Default(8 << 20));
+  FaultInjectionFileFactory factory(FileFactory::Default());
+  options_.file_factory = &factory;
+  options_.block_cache = cache.get();
+  options_.write_buffer_size = 32 << 10;
+  std::unique_ptr<ThreadPool> pool(new ThreadPool(1, 1, 2));
+  options_.thread_pool = pool.get();
+
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Recover());
+  VersionSet *versions = db.TEST_GetVersionSet();
+  std::map<std::string, std::string> latest;
+  // The versions are read only while no flush runs.
+  auto fill = [&](char prefix, int num_files) {
+    for (int i = 0;; i++) {
+      char key[16];
+      snprintf(key, sizeof(key), "%c%06d", prefix, i);
+      std::string value = RandomString(100);
+      WriteBatch batch;
+      batch.Put(key, value);
+      ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+      latest[key] = value;
+      if (i % 50 == 0) {
+        ASSERT_TRUE(db.TEST_WaitForFlush());
+        if (versions->NumLevelFiles(0) == num_files)
+          break;
+      }
+    }
+  };
+
+  // The first table holds the "a" keys up to "last", and is open as its
+  // reads start to fail. The second one, opened afterwards, reads fine.
+  fill('a', 1);
+  const std::string &largest = versions->current()->Files(0)[0]->largest;
+  const std::string last = largest.substr(0, largest.size() - 8);
+  ReadOptions no_fill;
+  no_fill.fill_cache = false;
+  std::string value;
+  ASSERT_TRUE(db.Get(no_fill, last, &value));
+  factory.FailOpenedReads();
+  fill('b', 2);
+
+  std::vector<std::string> keys;
+  for (const auto &kv : latest)
+    keys.push_back(kv.first);
+  std::vector<Slice> slices(keys.begin(), keys.end());
+  auto check = [&](const std::string &key, const Status &s,
+                   const std::string &value) {
+    if (key <= last) {
+      ASSERT_TRUE(!s && s.IsIOError()) << key << ": " << s.ToString();
+    } else {
+      ASSERT_TRUE(s) << key << ": " << s.ToString();
+      ASSERT_EQ(value, latest.at(key));
+    }
+  };
+
+  // The read threads look the keys up in the same tables as the foreground
+  // reads, and each lookup reports the errors of its own reads only.
+  const int kRounds = 8;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 2; t++) {
+    threads.emplace_back([&] {
+      for (int round = 0; round < kRounds; round++) {
+        std::mutex mu;
+        std::condition_variable cv;
+        bool done = false;
+        db.MultiGetAsync(ReadOptions(), slices,
+                         [&](const std::vector<Status> &statuses,
+                             const std::vector<std::string> &values) {
+                           for (size_t i = 0; i < keys.size(); i++)
+                             check(keys[i], statuses[i], values[i]);
+                           std::lock_guard<std::mutex> guard(mu);
+                           done = true;
+                           cv.notify_all();
+                         });
+        std::unique_lock<std::mutex> lock(mu);
+        while (!done)
+          cv.wait(lock);
+      }
+    });
+    threads.emplace_back([&] {
+      for (int round = 0; round < kRounds; round++) {
+        for (const std::string &key : keys) {
+          std::string value;
+          Status s = db.Get(ReadOptions(), key, &value);
+          check(key, s, value);
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+}
+
+// Returns the number of the files of "type" in the database "dbname".
+static int CountFiles(const std::string &dbname, FileType type) {
+  std::vector<std::string> filenames;
+  EXPECT_TRUE(FileFactory::Default()->GetChildren(dbname, &filenames));
+  int n = 0;
+  for (const std::string &filename : filenames) {
+    uint64_t number;
+    FileType t;
+    if (ParseFileName(filename, &number, &t) && t == type)
+      n++;
+  }
+  return n;
+}
+
+TEST_F(RecoverTest, BlobFiles) {
+  // The even keys have values large enough to be separated.
+  options_.min_blob_size = 100;
+  options_.write_buffer_size = 64 << 10;
+  auto value_of = [](int i) {
+    return std::string(i % 2 == 0 ? 300 : 10, 'a' + i % 26) +
+           std::to_string(i);
+  };
+  const int kKeys = 2000;
+  {
+    DBImpl db(options_, dbname_);
+    ASSERT_TRUE(db.Recover());
+    for (int i = 0; i < kKeys; i++) {
+      WriteBatch batch;
+      batch.Put(std::to_string(i), value_of(i));
+      ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+    }
+    ASSERT_TRUE(db.TEST_WaitForCompaction());
+    const size_t num_blob_files =
+        db.TEST_GetVersionSet()->current()->BlobFiles().size();
+    ASSERT_GT(num_blob_files, 0);
+    ASSERT_EQ(CountFiles(dbname_, FileType::kBlobFile), num_blob_files);
+
+    // The tables hold the small values, and the indexes of the large ones.
+    int num_entries = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      for (const auto &entry : DumpLevel(db, dbname_, options_, level)) {
+        ASSERT_LT(entry.second.size(), options_.min_blob_size);
+        num_entries++;
+      }
+    }
+    ASSERT_GT(num_entries, 0);
+  }
+
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Recover());
+  for (int i = 0; i < kKeys; i++) {
+    std::string value;
+    ASSERT_TRUE(db.Get(ReadOptions(), std::to_string(i), &value));
+    ASSERT_EQ(value, value_of(i));
+  }
+  std::unique_ptr<DBIterator> iter(db.NewIterator(ReadOptions(), ""));
+  int n = 0;
+  for (; iter->Valid(); iter->Next(), n++) {
+    ASSERT_EQ(iter->Value().ToString(),
+              value_of(std::stoi(iter->Key().ToString())));
+  }
+  ASSERT_TRUE(iter->Stat());
+  ASSERT_EQ(n, kKeys);
+}
+
+TEST_F(RecoverTest, BlobGarbageCollection) {
+  // Every compaction relocates the blobs of all the older blob files.
+  options_.min_blob_size = 100;
+  options_.blob_garbage_collection_age_cutoff = 1.0;
+  options_.write_buffer_size = 32 << 10;
+  options_.max_file_size = 16 << 10;
+  options_.max_bytes_for_level_base = 64 << 10;
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Recover());
+  const int kKeys = 300;
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < kKeys; i++) {
+      WriteBatch batch;
+      batch.Put(std::to_string(i),
+                std::to_string(round) + std::string(200, 'a' + i % 26));
+      ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+    }
+  }
+  ASSERT_TRUE(db.TEST_WaitForCompaction());
+
+  // The blob files whose blobs are all overwritten or relocated are gone.
+  const auto &blob_files = db.TEST_GetVersionSet()->current()->BlobFiles();
+  ASSERT_EQ(CountFiles(dbname_, FileType::kBlobFile), blob_files.size());
+  uint64_t live_blobs = 0;
+  for (const auto &p : blob_files) {
+    ASSERT_LT(p.second.garbage_count, p.second.total_count);
+    live_blobs += p.second.total_count - p.second.garbage_count;
+  }
+  ASSERT_LT(live_blobs, 3 * kKeys);
+  for (int i = 0; i < kKeys; i++) {
+    std::string value;
+    ASSERT_TRUE(db.Get(ReadOptions(), std::to_string(i), &value));
+    ASSERT_EQ(value, "9" + std::string(200, 'a' + i % 26));
+  }
+}
+
+TEST_F(RecoverTest, PrefixSeek) {
+  std::unique_ptr<FilterStrategy> filter(FilterStrategy::Default(10));
+  std::unique_ptr<PrefixExtractor> extractor(PrefixExtractor::Fixed(4));
+  Statistics stats;
+  options_.filter_strategy = filter.get();
+  options_.prefix_extractor = extractor.get();
+  options_.statistics = &stats;
+  options_.write_buffer_size = 32 << 10;
+  options_.max_file_size = 16 << 10;
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Recover());
+
+  // The even tenants, each with a run of keys.
+  auto tenant = [](int t) {
+    char buf[8];
+    snprintf(buf, sizeof(buf), "t%03d", t);
+    return std::string(buf);
+  };
+  for (int i = 0; i < 20; i++) {
+    for (int t = 0; t < 100; t += 2) {
+      WriteBatch batch;
+      batch.Put(tenant(t) + std::to_string(i), std::string(50, 'v'));
+      ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+    }
+  }
+  ASSERT_TRUE(db.TEST_WaitForCompaction());
+
+  ReadOptions read_options;
+  read_options.prefix_same_as_start = true;
+  const uint64_t useful = stats.GetTickerCount(kFilterUseful);
+  for (int t = 0; t < 100; t++) {
+    std::unique_ptr<DBIterator> iter(db.NewIterator(read_options, tenant(t)));
+    int n = 0;
+    for (; iter->Valid(); iter->Next(), n++)
+      ASSERT_EQ(iter->Key().ToString().substr(0, 4), tenant(t));
+    ASSERT_TRUE(iter->Stat());
+    ASSERT_EQ(n, t % 2 == 0 ? 20 : 0);
+  }
+  // The tables of the missing tenants were skipped by their filters.
+  ASSERT_GT(stats.GetTickerCount(kFilterUseful), useful);
+
+  // Without prefix_same_as_start the iteration goes on past the prefix.
+  std::unique_ptr<DBIterator> iter(db.NewIterator(ReadOptions(), tenant(1)));
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(iter->Key().ToString().substr(0, 4), tenant(2));
+
+  for (int t = 0; t < 100; t++) {
+    std::string value;
+    Status s = db.Get(ReadOptions(), tenant(t) + "3", &value);
+    ASSERT_EQ(static_cast<bool>(s), t % 2 == 0) << s.ToString();
+  }
+}
+
+TEST_F(RecoverTest, BlockCacheWarmUp) {
+  options_.write_buffer_size = 32 << 10;
+  options_.block_cache_dump_period_sec = 3600;
+  size_t charge;
+  {
+    std::unique_ptr<CacheStrategy> cache(CacheStrategy::Default(8 << 20));
+    options_.block_cache = cache.get();
+    DBImpl db(options_, dbname_);
+    ASSERT_TRUE(db.Recover());
+    for (int i = 0; i < 2000; i++) {
+      WriteBatch batch;
+      batch.Put("k" + std::to_string(i), std::string(50, 'v'));
+      ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+    }
+    ASSERT_TRUE(db.TEST_WaitForCompaction());
+    for (int i = 0; i < 2000; i += 10) {
+      std::string value;
+      ASSERT_TRUE(db.Get(ReadOptions(), "k" + std::to_string(i), &value));
+    }
+    charge = cache->TotalCharge();
+    ASSERT_GT(charge, 0);
+    ASSERT_TRUE(db.DumpBlockCache());
+    ASSERT_TRUE(boost::filesystem::exists(BlockCacheDumpFileName(dbname_)));
+  }
+
+  // The blocks listed as the database was closed are read back into a new
+  // cache as it's opened, the same keys are then found without reading.
+  std::unique_ptr<CacheStrategy> cache(CacheStrategy::Default(8 << 20));
+  Statistics stats;
+  options_.block_cache = cache.get();
+  options_.statistics = &stats;
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Recover());
+  ASSERT_EQ(cache->TotalCharge(), charge);
+  const uint64_t block_reads = stats.GetTickerCount(kBlockRead);
+  ASSERT_GT(block_reads, 0);
+  for (int i = 0; i < 2000; i += 10) {
+    std::string value;
+    ASSERT_TRUE(db.Get(ReadOptions(), "k" + std::to_string(i), &value));
+  }
+  ASSERT_EQ(stats.GetTickerCount(kBlockRead), block_reads);
+}
+
+TEST_F(RecoverTest, TableLoading) {
+  options_.write_buffer_size = 32 << 10;
+  size_t num_tables = 0;
+  {
+    DBImpl db(options_, dbname_);
+    ASSERT_TRUE(db.Recover());
+    for (int i = 0; i < 2000; i++) {
+      WriteBatch batch;
+      batch.Put("k" + std::to_string(i), std::string(50, 'v'));
+      ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+    }
+    ASSERT_TRUE(db.TEST_WaitForCompaction());
+    const Version *current = db.TEST_GetVersionSet()->current();
+    for (int level = 0; level < config::kNumLevels; level++)
+      num_tables += current->NumFiles(level);
+    ASSERT_GT(num_tables, 1);
+  }
+
+  auto num_open = [](DBImpl &db) {
+    size_t n = 0;
+    db.TEST_GetVersionSet()->table_cache()->VisitTables(
+        [&](uint64_t, const SSTable &) { n++; });
+    return n;
+  };
+
+  // Nothing is opened ahead by default.
+  {
+    DBImpl db(options_, dbname_);
+    ASSERT_TRUE(db.Recover());
+    ASSERT_EQ(num_open(db), 0);
+  }
+
+  // Every table is opened, up to the capacity of the table cache.
+  for (int threads : {1, 4}) {
+    options_.table_loading_threads = threads;
+    DBImpl db(options_, dbname_);
+    ASSERT_TRUE(db.Recover());
+    ASSERT_EQ(num_open(db), num_tables);
+    std::string value;
+    ASSERT_TRUE(db.Get(ReadOptions(), "k1000", &value));
+  }
+  options_.max_open_files = config::kNumNonTableCacheFiles + 1;
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Recover());
+  ASSERT_EQ(num_open(db), 1);
+}
@@ -0,0 +1,499 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// lessdb_bench runs db_bench-style workloads against a database on disk and
+// reports the throughput and latency percentiles of each one, e.g.
+//
+//   lessdb_bench --benchmarks=fillrandom,readrandom,readrandom:8 --num=1000000
+//
+// A benchmark named "name:N" runs "name" in N threads, otherwise --threads
+// threads are used. Every thread performs the full count of operations.
+
+#include <algorithm>
+#include <atomic>
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CacheStrategy.h"
+#include "DB.h"
+#include "DBIterator.h"
+#include "FilterStrategy.h"
+#include "Options.h"
+#include "Slice.h"
+#include "Statistics.h"
+#include "Status.h"
+#include "WriteBatch.h"
+
+using namespace lessdb;
+
+namespace {
+
+// Comma-separated list of the benchmarks to run in order:
+//   fillseq     -- write num values in sequential key order
+//   fillrandom  -- write num values in random key order
+//   overwrite   -- overwrite num values in random key order
+//   readrandom  -- read reads keys in random order
+//   readmissing -- read reads missing keys in random order
+//   readseq     -- scan reads entries in key order
+//   seekrandom  -- seek to reads random keys, and scan seek_nexts entries
+std::string FLAGS_benchmarks =
+    "fillseq,fillrandom,overwrite,readrandom,readmissing,readseq,seekrandom";
+
+int FLAGS_num = 1000000;       // Number of key-values to place in database
+int FLAGS_reads = -1;          // Number of reads, FLAGS_num if negative
+int FLAGS_threads = 1;         // Number of concurrent threads to run
+int FLAGS_key_size = 16;       // Size of each key
+int FLAGS_value_size = 100;    // Size of each value
+int FLAGS_seek_nexts = 10;     // Entries scanned after each seek
+int FLAGS_batch_size = 1;      // Updates per write batch
+bool FLAGS_sync = false;       // Sync every write batch
+int FLAGS_bloom_bits = -1;     // Bloom filter bits per key, none if negative
+long FLAGS_cache_size = -1;    // Block cache bytes, none if negative
+int FLAGS_write_buffer_size = 0;      // Options default if 0
+int FLAGS_block_size = 0;             // Options default if 0
+std::string FLAGS_compression = "none";  // none, lz4 or zstd
+bool FLAGS_use_existing_db = false;   // Keep the database from a previous run
+bool FLAGS_statistics = false;        // Print the statistics of each benchmark
+std::string FLAGS_db = "/tmp/lessdb_bench";
+unsigned FLAGS_seed = 301;
+
+bool ParseFlag(const char *arg, const char *name, std::string *value) {
+  size_t len = strlen(name);
+  if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, len) != 0 ||
+      arg[2 + len] != '=')
+    return false;
+  *value = arg + 3 + len;
+  return true;
+}
+
+void ParseFlags(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string v;
+    if (ParseFlag(argv[i], "benchmarks", &v)) {
+      FLAGS_benchmarks = v;
+    } else if (ParseFlag(argv[i], "num", &v)) {
+      FLAGS_num = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "reads", &v)) {
+      FLAGS_reads = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "threads", &v)) {
+      FLAGS_threads = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "key_size", &v)) {
+      FLAGS_key_size = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "value_size", &v)) {
+      FLAGS_value_size = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "seek_nexts", &v)) {
+      FLAGS_seek_nexts = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "batch_size", &v)) {
+      FLAGS_batch_size = std::max(1, atoi(v.c_str()));
+    } else if (ParseFlag(argv[i], "sync", &v)) {
+      FLAGS_sync = atoi(v.c_str()) != 0;
+    } else if (ParseFlag(argv[i], "bloom_bits", &v)) {
+      FLAGS_bloom_bits = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "cache_size", &v)) {
+      FLAGS_cache_size = atol(v.c_str());
+    } else if (ParseFlag(argv[i], "write_buffer_size", &v)) {
+      FLAGS_write_buffer_size = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "block_size", &v)) {
+      FLAGS_block_size = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "compression", &v)) {
+      FLAGS_compression = v;
+    } else if (ParseFlag(argv[i], "use_existing_db", &v)) {
+      FLAGS_use_existing_db = atoi(v.c_str()) != 0;
+    } else if (ParseFlag(argv[i], "statistics", &v)) {
+      FLAGS_statistics = atoi(v.c_str()) != 0;
+    } else if (ParseFlag(argv[i], "db", &v)) {
+      FLAGS_db = v;
+    } else if (ParseFlag(argv[i], "seed", &v)) {
+      FLAGS_seed = static_cast<unsigned>(atoi(v.c_str()));
+    } else {
+      fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      exit(1);
+    }
+  }
+  if (FLAGS_reads < 0)
+    FLAGS_reads = FLAGS_num;
+}
+
+using Clock = std::chrono::steady_clock;
+
+double MicrosSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(Clock::now() - start)
+      .count();
+}
+
+// The values are cut from a buffer of random bytes, so the blocks compress
+// about as well as random data does.
+class ValueGenerator {
+ public:
+  explicit ValueGenerator(unsigned seed) : pos_(0) {
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> dis(' ', '~');
+    data_.resize(std::max(1 << 20, FLAGS_value_size * 2));
+    for (char &c : data_)
+      c = static_cast<char>(dis(gen));
+  }
+
+  Slice Next(size_t len) {
+    if (pos_ + len > data_.size())
+      pos_ = 0;
+    pos_ += len;
+    return Slice(data_.data() + pos_ - len, len);
+  }
+
+ private:
+  std::string data_;
+  size_t pos_;
+};
+
+// Per-thread state and results of a benchmark.
+struct ThreadState {
+  explicit ThreadState(int index)
+      : gen(FLAGS_seed + static_cast<unsigned>(index)),
+        values(FLAGS_seed + static_cast<unsigned>(index)),
+        done(0),
+        found(0),
+        bytes(0) {}
+
+  // Records the latency of an operation started at "start".
+  void Finished(Clock::time_point start) {
+    latencies.push_back(MicrosSince(start));
+    done++;
+  }
+
+  std::mt19937 gen;
+  ValueGenerator values;
+  std::vector<double> latencies;  // micros of each operation
+  long done;
+  long found;
+  long bytes;
+  Status status;
+};
+
+class Benchmark {
+ public:
+  Benchmark() : db_(nullptr), total_thread_count_(0) {}
+
+  ~Benchmark() {
+    delete db_;
+  }
+
+  void Run() {
+    printHeader();
+    if (!FLAGS_use_existing_db)
+      boost::filesystem::remove_all(FLAGS_db);
+    open();
+
+    size_t begin = 0;
+    while (begin <= FLAGS_benchmarks.size()) {
+      size_t end = FLAGS_benchmarks.find(',', begin);
+      if (end == std::string::npos)
+        end = FLAGS_benchmarks.size();
+      std::string name = FLAGS_benchmarks.substr(begin, end - begin);
+      begin = end + 1;
+      if (name.empty())
+        continue;
+
+      int threads = FLAGS_threads;
+      size_t colon = name.find(':');
+      if (colon != std::string::npos) {
+        threads = std::max(1, atoi(name.c_str() + colon + 1));
+        name.resize(colon);
+      }
+
+      void (Benchmark::*method)(ThreadState *) = nullptr;
+      if (name == "fillseq") {
+        method = &Benchmark::fillSeq;
+      } else if (name == "fillrandom" || name == "overwrite") {
+        method = &Benchmark::fillRandom;
+      } else if (name == "readrandom") {
+        method = &Benchmark::readRandom;
+      } else if (name == "readmissing") {
+        method = &Benchmark::readMissing;
+      } else if (name == "readseq") {
+        method = &Benchmark::readSeq;
+      } else if (name == "seekrandom") {
+        method = &Benchmark::seekRandom;
+      } else {
+        fprintf(stderr, "unknown benchmark '%s'\n", name.c_str());
+        continue;
+      }
+      if (name == "fillseq" || name == "fillrandom") {
+        // Starts from an empty database, unless it's kept on purpose.
+        if (!FLAGS_use_existing_db) {
+          delete db_;
+          db_ = nullptr;
+          boost::filesystem::remove_all(FLAGS_db);
+          open();
+        }
+      }
+      runBenchmark(threads, name, method);
+    }
+  }
+
+ private:
+  void printHeader() {
+    fprintf(stdout, "Keys:       %d bytes each\n", FLAGS_key_size);
+    fprintf(stdout, "Values:     %d bytes each\n", FLAGS_value_size);
+    fprintf(stdout, "Entries:    %d\n", FLAGS_num);
+    fprintf(stdout, "Compression: %s\n", FLAGS_compression.c_str());
+#ifndef NDEBUG
+    fprintf(stdout, "WARNING: Assertions are enabled; benchmarks unnecessarily slow\n");
+#endif
+    fprintf(stdout, "------------------------------------------------\n");
+  }
+
+  void open() {
+    options_.create_if_missing = true;
+    if (FLAGS_write_buffer_size > 0)
+      options_.write_buffer_size = static_cast<size_t>(FLAGS_write_buffer_size);
+    if (FLAGS_block_size > 0)
+      options_.block_size = static_cast<size_t>(FLAGS_block_size);
+    if (FLAGS_compression == "lz4") {
+      options_.compression = kLZ4Compression;
+    } else if (FLAGS_compression == "zstd") {
+      options_.compression = kZstdCompression;
+    }
+    if (FLAGS_bloom_bits >= 0 && !filter_) {
+      filter_.reset(
+          FilterStrategy::Default(static_cast<size_t>(FLAGS_bloom_bits)));
+      options_.filter_strategy = filter_.get();
+    }
+    if (FLAGS_cache_size >= 0 && !cache_) {
+      cache_.reset(
+          CacheStrategy::Default(static_cast<size_t>(FLAGS_cache_size)));
+      options_.block_cache = cache_.get();
+    }
+    if (FLAGS_statistics)
+      options_.statistics = &stats_;
+
+    Status s = DB::Open(options_, FLAGS_db, &db_);
+    if (!s) {
+      fprintf(stderr, "open error: %s\n", s.ToString().c_str());
+      exit(1);
+    }
+  }
+
+  void runBenchmark(int n, const std::string &name,
+                    void (Benchmark::*method)(ThreadState *)) {
+    stats_.Reset();
+    std::vector<std::unique_ptr<ThreadState>> states;
+    // Every thread of every benchmark gets its own seed, so that the reads
+    // don't simply replay the keys of the preceding random writes.
+    for (int i = 0; i < n; i++)
+      states.emplace_back(new ThreadState(++total_thread_count_));
+
+    // The threads are started together once they are all created.
+    std::mutex mu;
+    std::condition_variable cv;
+    bool go = false;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < n; i++) {
+      ThreadState *state = states[i].get();
+      threads.emplace_back([&, state]() {
+        {
+          std::unique_lock<std::mutex> lock(mu);
+          cv.wait(lock, [&]() { return go; });
+        }
+        (this->*method)(state);
+      });
+    }
+    const Clock::time_point start = Clock::now();
+    {
+      std::lock_guard<std::mutex> guard(mu);
+      go = true;
+    }
+    cv.notify_all();
+    for (std::thread &t : threads)
+      t.join();
+    const double elapsed = MicrosSince(start);
+
+    std::vector<double> latencies;
+    long done = 0, found = 0, bytes = 0;
+    for (const auto &state : states) {
+      if (!state->status) {
+        fprintf(stderr, "%s error: %s\n", name.c_str(),
+                state->status.ToString().c_str());
+        exit(1);
+      }
+      latencies.insert(latencies.end(), state->latencies.begin(),
+                       state->latencies.end());
+      done += state->done;
+      found += state->found;
+      bytes += state->bytes;
+    }
+    if (done == 0)
+      done = 1;
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+      if (latencies.empty())
+        return 0.0;
+      size_t i = static_cast<size_t>(p * static_cast<double>(latencies.size()));
+      return latencies[std::min(i, latencies.size() - 1)];
+    };
+
+    std::string extra;
+    char buf[100];
+    if (bytes > 0) {
+      snprintf(buf, sizeof(buf), " %6.1f MB/s;",
+               static_cast<double>(bytes) / 1048576.0 / (elapsed * 1e-6));
+      extra += buf;
+    }
+    if (method == &Benchmark::readRandom ||
+        method == &Benchmark::readMissing ||
+        method == &Benchmark::seekRandom) {
+      snprintf(buf, sizeof(buf), " (%ld of %ld found);", found, done);
+      extra += buf;
+    }
+    fprintf(stdout,
+            "%-12s : %11.3f micros/op; %9.0f ops/sec;%s "
+            "p50 %.1f p99 %.1f p999 %.1f micros/op\n",
+            (n > 1 ? name + ":" + std::to_string(n) : name).c_str(),
+            elapsed * n / static_cast<double>(done),
+            static_cast<double>(done) / (elapsed * 1e-6), extra.c_str(),
+            percentile(0.5), percentile(0.99), percentile(0.999));
+    if (FLAGS_statistics)
+      fprintf(stdout, "\n%s\n", stats_.ToString().c_str());
+    fflush(stdout);
+  }
+
+  // Keys are decimal numbers zero-padded to --key_size bytes, so the order
+  // of the keys follows the order of the numbers.
+  std::string key(long k) const {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%ld", k);
+    std::string r(buf);
+    if (r.size() < static_cast<size_t>(FLAGS_key_size))
+      r.insert(0, static_cast<size_t>(FLAGS_key_size) - r.size(), '0');
+    return r;
+  }
+
+  long randomKey(ThreadState *state) const {
+    return std::uniform_int_distribution<long>(0, FLAGS_num - 1)(state->gen);
+  }
+
+  void write(ThreadState *state, bool seq) {
+    WriteOptions write_options;
+    write_options.sync = FLAGS_sync;
+    for (long i = 0; i < FLAGS_num; i += FLAGS_batch_size) {
+      const Clock::time_point start = Clock::now();
+      WriteBatch batch;
+      for (int j = 0; j < FLAGS_batch_size; j++) {
+        const std::string k = key(seq ? i + j : randomKey(state));
+        batch.Put(k, state->values.Next(static_cast<size_t>(FLAGS_value_size)));
+        state->bytes += FLAGS_key_size + FLAGS_value_size;
+      }
+      state->status = db_->Write(write_options, &batch);
+      if (!state->status)
+        return;
+      state->Finished(start);
+    }
+  }
+
+  void fillSeq(ThreadState *state) {
+    write(state, true);
+  }
+
+  void fillRandom(ThreadState *state) {
+    write(state, false);
+  }
+
+  void read(ThreadState *state, const char *suffix) {
+    ReadOptions read_options;
+    std::string value;
+    for (int i = 0; i < FLAGS_reads; i++) {
+      const std::string k = key(randomKey(state)) + suffix;
+      const Clock::time_point start = Clock::now();
+      Status s = db_->Get(read_options, k, &value);
+      if (s) {
+        state->found++;
+      } else if (!s.IsNotFound()) {
+        state->status = s;
+        return;
+      }
+      state->Finished(start);
+    }
+  }
+
+  void readRandom(ThreadState *state) {
+    read(state, "");
+  }
+
+  void readMissing(ThreadState *state) {
+    read(state, ".");
+  }
+
+  void readSeq(ThreadState *state) {
+    ReadOptions read_options;
+    std::unique_ptr<DBIterator> it(db_->NewIterator(read_options, Slice()));
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < FLAGS_reads && it->Valid(); i++) {
+      state->bytes += static_cast<long>(it->Key().Len() + it->Value().Len());
+      it->Next();
+      state->Finished(start);
+      start = Clock::now();
+    }
+    state->status = it->Stat();
+  }
+
+  void seekRandom(ThreadState *state) {
+    ReadOptions read_options;
+    for (int i = 0; i < FLAGS_reads; i++) {
+      const std::string k = key(randomKey(state));
+      const Clock::time_point start = Clock::now();
+      std::unique_ptr<DBIterator> it(db_->NewIterator(read_options, k));
+      if (it->Valid() && it->Key() == Slice(k))
+        state->found++;
+      for (int j = 0; j < FLAGS_seek_nexts && it->Valid(); j++)
+        it->Next();
+      state->status = it->Stat();
+      if (!state->status)
+        return;
+      state->Finished(start);
+    }
+  }
+
+  Options options_;
+  std::unique_ptr<CacheStrategy> cache_;
+  std::unique_ptr<FilterStrategy> filter_;
+  Statistics stats_;
+  DB *db_;
+  int total_thread_count_;
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ParseFlags(argc, argv);
+  Benchmark benchmark;
+  benchmark.Run();
+  return 0;
+}
@@ -0,0 +1,123 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Coding.h"
+#include "FilterStrategy.h"
+#include "Slice.h"
+
+using namespace lessdb;
+
+namespace {
+
+// The keys are the fixed32 encodings of their indices, the keys from
+// kNumKeys onwards are not in the filter.
+const size_t kNumKeys = 10000;
+
+std::string key(uint32_t i) {
+  std::string r;
+  coding::AppendFixed32(&r, i);
+  return r;
+}
+
+FilterStrategy* newStrategy(int64_t blocked, size_t bits_per_key) {
+  return blocked ? FilterStrategy::Blocked(bits_per_key)
+                 : FilterStrategy::Default(bits_per_key);
+}
+
+}  // namespace
+
+// Builds a filter of kNumKeys keys, range(0) is whether it's the blocked
+// bloom filter and range(1) the bits per key.
+static void FilterStrategy_CreateFilter(benchmark::State& state) {
+  std::unique_ptr<FilterStrategy> strategy(
+      newStrategy(state.range(0), static_cast<size_t>(state.range(1))));
+  std::vector<std::string> keys;
+  for (uint32_t i = 0; i < kNumKeys; i++)
+    keys.push_back(key(i));
+  std::vector<Slice> slices(keys.begin(), keys.end());
+
+  std::string filter;
+  for (auto _ : state) {
+    filter.clear();
+    strategy->CreateFilter(slices.data(), slices.size(), &filter);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * kNumKeys));
+}
+
+// Queries a filter of kNumKeys keys, range(0) and range(1) are as above and
+// range(2) is whether the queried keys are in the filter. A miss reports the
+// false positive rate.
+static void FilterStrategy_MightContain(benchmark::State& state) {
+  std::unique_ptr<FilterStrategy> strategy(
+      newStrategy(state.range(0), static_cast<size_t>(state.range(1))));
+  std::vector<std::string> keys;
+  for (uint32_t i = 0; i < kNumKeys; i++)
+    keys.push_back(key(i));
+  std::vector<Slice> slices(keys.begin(), keys.end());
+  std::string filter;
+  strategy->CreateFilter(slices.data(), slices.size(), &filter);
+
+  const bool hit = state.range(2) != 0;
+  std::vector<std::string> queries;
+  for (uint32_t i = 0; i < kNumKeys; i++)
+    queries.push_back(key(hit ? i : static_cast<uint32_t>(i + 1000000000)));
+
+  size_t i = 0;
+  int64_t positives = 0;
+  for (auto _ : state) {
+    positives += strategy->MightContain(queries[i], filter);
+    if (++i == queries.size())
+      i = 0;
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+  state.counters["positive_rate"] = static_cast<double>(positives) /
+                                    static_cast<double>(state.iterations());
+  state.counters["bits_per_key"] =
+      static_cast<double>(filter.size() * 8) / kNumKeys;
+}
+
+/**
+ * Baseline, to be compared against by changes to the bloom filters.
+ *
+ * Benchmark environment:
+ * Intel Xeon @ 2.10GHz, 1 core, g++ (Debian 12.2.0-14) 12.2.0, -O2 -DNDEBUG.
+ *
+ * Benchmark                                Time   Iterations  positive_rate
+ * -------------------------------------------------------------------------
+ * FilterStrategy_CreateFilter/0/10    206084 ns          346
+ * FilterStrategy_CreateFilter/1/10    213206 ns          338
+ * FilterStrategy_MightContain/0/10/0    14.5 ns      4008658        0.0081
+ * FilterStrategy_MightContain/1/10/0    30.7 ns      2419497        0.0096
+ * FilterStrategy_MightContain/0/10/1    22.1 ns      3304478        1
+ * FilterStrategy_MightContain/1/10/1    21.7 ns      3214265        1
+ */
+
+BENCHMARK(FilterStrategy_CreateFilter)->ArgsProduct({{0, 1}, {10, 16}});
+BENCHMARK(FilterStrategy_MightContain)
+    ->ArgsProduct({{0, 1}, {5, 10, 16}, {0, 1}});
+
+BENCHMARK_MAIN();
@@ -0,0 +1,158 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+#include "FilterBlock.h"
+#include "FilterStrategy.h"
+#include "Slice.h"
+
+using namespace lessdb;
+
+static std::string Key(int i) {
+  char buf[sizeof(int)];
+  memcpy(buf, &i, sizeof(int));
+  return std::string(buf, sizeof(int));
+}
+
+static std::string BuildFilter(const FilterStrategy *strategy, int n) {
+  std::vector<std::string> keys;
+  for (int i = 0; i < n; i++)
+    keys.push_back(Key(i));
+  std::vector<Slice> slices(keys.begin(), keys.end());
+
+  std::string filter;
+  strategy->CreateFilter(slices.data(), slices.size(), &filter);
+  return filter;
+}
+
+TEST(BloomFilter, Empty) {
+  std::unique_ptr<FilterStrategy> strategy(FilterStrategy::Default(10));
+  std::string filter = BuildFilter(strategy.get(), 0);
+  ASSERT_FALSE(strategy->MightContain("hello", filter));
+  ASSERT_FALSE(strategy->MightContain("world", filter));
+}
+
+TEST(BloomFilter, VaryingLengths) {
+  std::unique_ptr<FilterStrategy> strategy(FilterStrategy::Default(10));
+
+  for (int n = 1; n < 10000; n = (n < 100 ? n + 1 : n * 10)) {
+    std::string filter = BuildFilter(strategy.get(), n);
+    ASSERT_LE(filter.size(), static_cast<size_t>((n * 10 / 8) + 40)) << n;
+
+    // All added keys must match
+    for (int i = 0; i < n; i++) {
+      ASSERT_TRUE(strategy->MightContain(Key(i), filter)) << i;
+    }
+
+    // Check false positive rate
+    int hits = 0;
+    for (int i = 0; i < 10000; i++) {
+      if (strategy->MightContain(Key(i + 1000000000), filter))
+        hits++;
+    }
+    ASSERT_LE(hits, 10000 * 0.03) << n;
+  }
+}
+
+TEST(BlockedBloomFilter, Empty) {
+  std::unique_ptr<FilterStrategy> strategy(FilterStrategy::Blocked(10));
+  std::string filter = BuildFilter(strategy.get(), 0);
+  ASSERT_FALSE(strategy->MightContain("hello", filter));
+  ASSERT_FALSE(strategy->MightContain("world", filter));
+}
+
+TEST(BlockedBloomFilter, VaryingLengths) {
+  std::unique_ptr<FilterStrategy> strategy(FilterStrategy::Blocked(10));
+
+  for (int n = 1; n < 10000; n = (n < 100 ? n + 1 : n * 10)) {
+    std::string filter = BuildFilter(strategy.get(), n);
+    ASSERT_LE(filter.size(), static_cast<size_t>((n * 10 / 8) + 65)) << n;
+
+    for (int i = 0; i < n; i++) {
+      ASSERT_TRUE(strategy->MightContain(Key(i), filter)) << i;
+    }
+
+    // Confining probes to a cache line costs some accuracy.
+    int hits = 0;
+    for (int i = 0; i < 10000; i++) {
+      if (strategy->MightContain(Key(i + 1000000000), filter))
+        hits++;
+    }
+    ASSERT_LE(hits, 10000 * 0.03) << n;
+  }
+}
+
+TEST(BlockedBloomFilter, NotInterchangeable) {
+  std::unique_ptr<FilterStrategy> bloom(FilterStrategy::Default(10));
+  std::unique_ptr<FilterStrategy> blocked(FilterStrategy::Blocked(10));
+  ASSERT_STRNE(bloom->Name(), blocked->Name());
+}
+
+TEST(FilterBlock, MultiBlocks) {
+  std::unique_ptr<FilterStrategy> strategy(FilterStrategy::Default(10));
+  FilterBlockBuilder builder(strategy.get());
+
+  // First filter
+  builder.StartBlock(0);
+  builder.AddKey("foo");
+  builder.StartBlock(2000);
+  builder.AddKey("bar");
+
+  // Second filter
+  builder.StartBlock(3100);
+  builder.AddKey("box");
+
+  // Third filter is empty
+
+  // Last filter
+  builder.StartBlock(9000);
+  builder.AddKey("box");
+  builder.AddKey("hello");
+
+  std::string block = builder.Finish().ToString();
+  FilterBlockReader reader(strategy.get(), block);
+
+  // Check first filter
+  ASSERT_TRUE(reader.MightContain(0, "foo"));
+  ASSERT_TRUE(reader.MightContain(2000, "bar"));
+  ASSERT_TRUE(!reader.MightContain(0, "box"));
+  ASSERT_TRUE(!reader.MightContain(0, "hello"));
+
+  // Check second filter
+  ASSERT_TRUE(reader.MightContain(3100, "box"));
+  ASSERT_TRUE(!reader.MightContain(3100, "foo"));
+  ASSERT_TRUE(!reader.MightContain(3100, "bar"));
+  ASSERT_TRUE(!reader.MightContain(3100, "hello"));
+
+  // Check third filter (empty)
+  ASSERT_TRUE(!reader.MightContain(4100, "foo"));
+  ASSERT_TRUE(!reader.MightContain(4100, "box"));
+
+  // Check last filter
+  ASSERT_TRUE(reader.MightContain(9000, "box"));
+  ASSERT_TRUE(reader.MightContain(9000, "hello"));
+  ASSERT_TRUE(!reader.MightContain(9000, "foo"));
+  ASSERT_TRUE(!reader.MightContain(9000, "bar"));
+}
@@ -63,3 +63,84 @@ TEST(InternalKey, Init) {
   ASSERT_EQ(ikey.sequence, 10);
   ASSERT_EQ(ikey.type, kTypeDeletion);
 }
+
+namespace {
+
+class ReverseBytewiseComparator : public Comparator {
+ public:
+  const char *Name() const override {
+    return "test.ReverseBytewiseComparator";
+  }
+
+  int Compare(const Slice &lhs, const Slice &rhs) const override {
+    return NewBytewiseComparator()->Compare(rhs, lhs);
+  }
+
+  void FindShortestSeparator(std::string *start,
+                             const Slice &limit) const override {}
+
+  void FindShortSuccessor(std::string *key) const override {}
+};
+
+}  // namespace
+
+TEST(InternalKeyComparator, CustomComparator) {
+  ReverseBytewiseComparator reverse;
+  InternalKeyComparator bytewise(NewBytewiseComparator());
+  InternalKeyComparator comparator(&reverse);
+  ASSERT_TRUE(bytewise.IsBytewise());
+  ASSERT_FALSE(comparator.IsBytewise());
+
+  InternalKeyBuf ibuf1("abc", 1, kTypeValue);
+  InternalKeyBuf ibuf2("abd", 1, kTypeValue);
+  InternalKeyBuf ibuf3("abd", 2, kTypeValue);
+
+  ASSERT_TRUE(bytewise.Compare(ibuf1.Data(), ibuf2.Data()) < 0);
+  ASSERT_TRUE(comparator.Compare(ibuf1.Data(), ibuf2.Data()) > 0);
+
+  // The sequence number orders equal user keys regardless of the user
+  // comparator.
+  ASSERT_TRUE(comparator.Compare(ibuf3.Data(), ibuf2.Data()) < 0);
+  ASSERT_TRUE(bytewise.Compare(ibuf3.Data(), ibuf2.Data()) < 0);
+
+  // Agrees with the comparison on decoded InternalKeys.
+  ASSERT_EQ(comparator.Compare(ibuf1.Data(), ibuf3.Data()),
+            comparator.Compare(InternalKey(ibuf1.Data()),
+                               InternalKey(ibuf3.Data())));
+}
+
+TEST(InternalKeyComparator, FindShortestSeparator) {
+  InternalKeyComparator comparator(NewBytewiseComparator());
+
+  // The user key is shortened, with the tag that sorts first.
+  std::string start = InternalKeyBuf("foo", 100, kTypeValue).Data().ToString();
+  comparator.FindShortestSeparator(
+      &start, InternalKeyBuf("hello", 200, kTypeValue).Data());
+  ASSERT_EQ(start, InternalKeyBuf("g", kMaxSequenceNumber, kTypeValue)
+                       .Data()
+                       .ToString());
+
+  // Nothing shorter between the same user keys, or when one user key is a
+  // prefix of the other.
+  for (const char *limit : {"foo", "foobar"}) {
+    std::string key = InternalKeyBuf("foo", 100, kTypeValue).Data().ToString();
+    comparator.FindShortestSeparator(
+        &key, InternalKeyBuf(limit, 99, kTypeValue).Data());
+    ASSERT_EQ(key, InternalKeyBuf("foo", 100, kTypeValue).Data().ToString());
+  }
+}
+
+TEST(InternalKeyComparator, FindShortSuccessor) {
+  InternalKeyComparator comparator(NewBytewiseComparator());
+
+  std::string key = InternalKeyBuf("foo", 100, kTypeValue).Data().ToString();
+  comparator.FindShortSuccessor(&key);
+  ASSERT_EQ(key, InternalKeyBuf("g", kMaxSequenceNumber, kTypeValue)
+                     .Data()
+                     .ToString());
+
+  // A run of 0xffs has no shorter successor.
+  std::string ff = InternalKeyBuf("\xff\xff", 100, kTypeValue).Data().ToString();
+  comparator.FindShortSuccessor(&ff);
+  ASSERT_EQ(ff, InternalKeyBuf("\xff\xff", 100, kTypeValue).Data().ToString());
+}
@@ -0,0 +1,330 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "Crc32c.h"
+#include "DataView.h"
+#include "LogReader.h"
+#include "LogWriter.h"
+#include "Status.h"
+#include "TestUtils.h"
+
+using namespace lessdb;
+using namespace test;
+
+namespace {
+
+struct CountingReporter : public log::Reader::Reporter {
+  size_t dropped_bytes = 0;
+  int count = 0;
+
+  void Corruption(size_t bytes, const Status &status) override {
+    ASSERT_TRUE(status.IsCorruption()) << status.ToString();
+    dropped_bytes += bytes;
+    count++;
+  }
+};
+
+// Counts the calls on the file, keeping the contents.
+class CountingSink final : public WritableFile {
+ public:
+  Status Append(const Slice &data) override {
+    appends++;
+    return sink.Append(data);
+  }
+
+  Status Appendv(const Slice *data, size_t n) override {
+    appends++;
+    return sink.Appendv(data, n);
+  }
+
+  Status Flush() override {
+    flushes++;
+    return sink.Flush();
+  }
+
+  Status Sync() override {
+    syncs++;
+    return sink.Sync();
+  }
+
+  Status Close() override {
+    return sink.Close();
+  }
+
+  StringSink sink;
+  int appends = 0;
+  int flushes = 0;
+  int syncs = 0;
+};
+
+std::string WriteRecords(const std::vector<std::string> &records) {
+  StringSink sink;
+  log::Writer writer(&sink);
+  for (const auto &r : records) {
+    EXPECT_TRUE(writer.WriteRecord(r));
+  }
+  return sink.Content();
+}
+
+std::vector<std::string> ReadRecords(const std::string &content,
+                                     int num_threads,
+                                     CountingReporter *reporter) {
+  StringSequentialFile file(content);
+  log::Reader reader(&file, reporter, true, num_threads);
+  std::vector<std::string> result;
+  std::string scratch;
+  Slice record;
+  while (reader.ReadRecord(&record, &scratch)) {
+    result.push_back(record.ToString());
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(Reader, Empty) {
+  CountingReporter reporter;
+  ASSERT_TRUE(ReadRecords("", 1, &reporter).empty());
+  ASSERT_TRUE(ReadRecords("", 4, &reporter).empty());
+  ASSERT_EQ(reporter.count, 0);
+}
+
+TEST(Reader, ReadWrite) {
+  std::vector<std::string> records;
+  for (int i = 0; i < 5000; i++) {
+    // Mostly small records, with some spanning several blocks.
+    int len = (i % 100 == 0) ? RandomIn(0, 3 * log::kBlockSize)
+                             : RandomIn(0, 1 << 10);
+    records.push_back(RandomString(len));
+  }
+  std::string content = WriteRecords(records);
+  // More than one batch of blocks verified in parallel.
+  ASSERT_GT(content.size(), 128u * log::kBlockSize);
+
+  for (int num_threads : {1, 2, 4}) {
+    CountingReporter reporter;
+    ASSERT_EQ(ReadRecords(content, num_threads, &reporter), records);
+    ASSERT_EQ(reporter.count, 0);
+  }
+}
+
+TEST(Reader, BlockTrailer) {
+  // Leaves less than a header at the end of the first block, which is
+  // padded by the writer and skipped by the reader.
+  std::vector<std::string> records;
+  records.push_back(std::string(log::kBlockSize - 2 * log::kHeaderSize - 3,
+                                'a'));
+  records.push_back("");
+  records.push_back("bcd");
+  std::string content = WriteRecords(records);
+  ASSERT_EQ(content.size(), log::kBlockSize + log::kHeaderSize + 3);
+
+  for (int num_threads : {1, 4}) {
+    CountingReporter reporter;
+    ASSERT_EQ(ReadRecords(content, num_threads, &reporter), records);
+    ASSERT_EQ(reporter.count, 0);
+  }
+}
+
+TEST(Reader, ChecksumMismatch) {
+  std::vector<std::string> records;
+  for (int i = 0; i < 200; i++) {
+    records.push_back(std::to_string(i) + RandomString(1000));
+  }
+  std::string content = WriteRecords(records);
+
+  // Corrupts a record in the third block, the rest of that block is dropped,
+  // along with the record continued in the next block.
+  const size_t pos = 2 * log::kBlockSize + 100;
+  content[pos] ^= 1;
+
+  CountingReporter sequential_reporter;
+  std::vector<std::string> expected =
+      ReadRecords(content, 1, &sequential_reporter);
+  ASSERT_GE(sequential_reporter.count, 1);
+  ASSERT_LT(expected.size(), records.size());
+  ASSERT_EQ(expected.front(), records.front());
+  ASSERT_EQ(expected.back(), records.back());
+
+  // The parallel verification finds the same corruption.
+  CountingReporter reporter;
+  ASSERT_EQ(ReadRecords(content, 4, &reporter), expected);
+  ASSERT_EQ(reporter.count, sequential_reporter.count);
+  ASSERT_EQ(reporter.dropped_bytes, sequential_reporter.dropped_bytes);
+}
+
+TEST(Reader, TruncatedRecord) {
+  std::vector<std::string> records = {"abc", std::string(50000, 'x')};
+  std::string content = WriteRecords(records);
+
+  // The writer died in the middle of the last record, which is not a
+  // corruption.
+  content.resize(content.size() - 10);
+  for (int num_threads : {1, 4}) {
+    CountingReporter reporter;
+    std::vector<std::string> result = ReadRecords(content, num_threads,
+                                                  &reporter);
+    ASSERT_EQ(result, std::vector<std::string>{"abc"});
+    ASSERT_EQ(reporter.count, 0);
+  }
+}
+
+TEST(Reader, ZeroPadding) {
+  std::vector<std::string> records = {"abc", std::string(50000, 'x'), "de"};
+  std::string content = WriteRecords(records);
+
+  // Left by a crashed writer on a direct I/O or preallocated file.
+  content.append(2 * log::kBlockSize - content.size() % log::kBlockSize,
+                 '\0');
+  for (int num_threads : {1, 4}) {
+    CountingReporter reporter;
+    ASSERT_EQ(ReadRecords(content, num_threads, &reporter), records);
+    ASSERT_EQ(reporter.count, 0);
+  }
+}
+
+TEST(Writer, OneWritePerRecord) {
+  CountingSink file;
+  log::Writer writer(&file);
+
+  // A record of several fragments, and one leaving a trailer in the block.
+  std::vector<std::string> records = {
+      std::string(3 * log::kBlockSize, 'a'),
+      std::string(log::kBlockSize - 3 * log::kHeaderSize - 3, 'b'), "c"};
+  for (const auto &r : records) {
+    ASSERT_TRUE(writer.WriteRecord(r));
+  }
+  ASSERT_EQ(file.appends, 3);
+  ASSERT_EQ(file.flushes, 3);
+  ASSERT_EQ(file.syncs, 0);
+
+  CountingReporter reporter;
+  ASSERT_EQ(ReadRecords(file.sink.Content(), 1, &reporter), records);
+  ASSERT_EQ(reporter.count, 0);
+}
+
+TEST(Writer, ScatteredRecord) {
+  CountingSink file;
+  log::Writer writer(&file);
+
+  // The pieces of a record spanning blocks, empty ones included, read back
+  // as their concatenation.
+  std::string big(log::kBlockSize, 'b');
+  std::vector<Slice> pieces = {Slice("head"), Slice(), Slice(big),
+                               Slice("tail"), Slice()};
+  ASSERT_TRUE(writer.WriteRecord(pieces.data(), pieces.size()));
+  ASSERT_TRUE(writer.WriteRecord(pieces.data(), 0));
+  ASSERT_EQ(file.appends, 2);
+
+  CountingReporter reporter;
+  std::vector<std::string> expected = {"head" + big + "tail", ""};
+  ASSERT_EQ(ReadRecords(file.sink.Content(), 1, &reporter), expected);
+  ASSERT_EQ(reporter.count, 0);
+}
+
+TEST(Writer, BytesPerSync) {
+  CountingSink file;
+  log::Writer writer(&file, 1000);
+
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(writer.WriteRecord(std::string(393, 'x')));
+  }
+  // Every 3 records (400 bytes each) reach 1000 bytes.
+  ASSERT_EQ(file.syncs, 3);
+
+  // An explicit sync starts counting again.
+  ASSERT_TRUE(writer.Sync());
+  ASSERT_TRUE(writer.WriteRecord(std::string(393, 'x')));
+  ASSERT_TRUE(writer.WriteRecord(std::string(393, 'x')));
+  ASSERT_EQ(file.syncs, 4);
+}
+
+TEST(Reader, LegacyChecksum) {
+  // A log written by older versions, whose records are checksummed by the
+  // legacy crc without kRecordTypeCrc32cFlag. An empty record isn't included,
+  // its header is all zeroes, which the reader skips as padding.
+  std::vector<std::string> records = {"abc", "defg"};
+  std::string content;
+  for (const auto &r : records) {
+    char header[log::kHeaderSize];
+    DataView(header).WriteNum(LegacyCrc32(r.data(), r.size()));
+    DataView(header + 4).WriteNum(static_cast<uint16_t>(r.size()));
+    DataView(header + 6).WriteNum(static_cast<uint8_t>(log::RecordType::kFull));
+    content.append(header, sizeof(header));
+    content.append(r);
+  }
+
+  for (int num_threads : {1, 4}) {
+    CountingReporter reporter;
+    ASSERT_EQ(ReadRecords(content, num_threads, &reporter), records);
+    ASSERT_EQ(reporter.count, 0);
+  }
+}
+
+TEST(Reader, ReadRecordAt) {
+  // Records at every position within a block, some spanning several blocks.
+  std::vector<std::string> records;
+  for (int i = 0; i < 300; i++) {
+    int len = (i % 30 == 0) ? RandomIn(0, 3 * log::kBlockSize)
+                            : RandomIn(0, 1 << 10);
+    records.push_back(RandomString(len));
+  }
+  // To be corrupted below.
+  records[30] = RandomString(2 * log::kBlockSize);
+  StringSink sink;
+  log::Writer writer(&sink);
+  std::vector<uint64_t> offsets;
+  for (const auto &r : records) {
+    offsets.push_back(writer.Offset());
+    ASSERT_TRUE(writer.WriteRecord(r));
+  }
+  offsets.push_back(writer.Offset());
+  std::string content = sink.Content();
+  ASSERT_EQ(offsets.back(), content.size());
+
+  std::string scratch;
+  Slice record;
+  for (size_t i = 0; i < records.size(); i++) {
+    const uint64_t n = offsets[i + 1] - offsets[i];
+    ASSERT_TRUE(log::ReadRecordAt(content.data() + offsets[i], n, offsets[i],
+                                  true, &record, &scratch));
+    ASSERT_EQ(record.ToString(), records[i]);
+  }
+
+  // A corrupted extent.
+  const size_t i = 30;
+  content[offsets[i] + log::kHeaderSize + 10] ^= 1;
+  Status s = log::ReadRecordAt(content.data() + offsets[i],
+                               offsets[i + 1] - offsets[i], offsets[i], true,
+                               &record, &scratch);
+  ASSERT_TRUE(s.IsCorruption()) << s.ToString();
+
+  // A truncated one.
+  s = log::ReadRecordAt(content.data() + offsets[i + 1],
+                        offsets[i + 2] - offsets[i + 1] - 1, offsets[i + 1],
+                        true, &record, &scratch);
+  ASSERT_TRUE(s.IsCorruption()) << s.ToString();
+}
@@ -21,7 +21,11 @@
  */
 
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "MemTable.h"
 #include "Status.h"
@@ -42,7 +46,8 @@ TEST(Basic, Add) {
   MemTable table(cmp);
   table.Add(1, kTypeValue, "abc", "def");
 
-  Slice key = InternalKeyBuf("abc", 1, kTypeValue).Data();
+  InternalKeyBuf key_buf("abc", 1, kTypeValue);
+  Slice key = key_buf.Data();
   ASSERT_TRUE(table.find(key) != table.end());
 
   auto iter = table.find(key);
@@ -71,4 +76,231 @@ TEST(Basic, WriteBatchInsert) {
     std::string key(it1->first.RawData(), it1->first.Len() - 8);
     ASSERT_EQ(table[key], it1->second.ToString());
   }
-}
\ No newline at end of file
+}
+
+TEST(Basic, AddEncoding) {
+  InternalKeyComparator cmp(NewBytewiseComparator());
+  MemTable table(cmp);
+
+  // Lengths around the boundaries of varint encoding.
+  std::string long_key(200, 'k'), long_value(20000, 'v');
+  table.Add(7, kTypeValue, long_key, long_value);
+  table.Add(8, kTypeDeletion, "a", Slice());
+  table.Add(9, kTypeValue, "", "x");
+
+  auto it = table.begin();
+  ASSERT_EQ(InternalKey(it->first).user_key, Slice(""));
+  ASSERT_EQ(InternalKey(it->first).sequence, 9);
+  ASSERT_EQ(it->second, Slice("x"));
+  it++;
+  ASSERT_EQ(InternalKey(it->first).user_key, Slice("a"));
+  ASSERT_EQ(InternalKey(it->first).type, kTypeDeletion);
+  ASSERT_EQ(it->second, Slice());
+  it++;
+  ASSERT_EQ(InternalKey(it->first).user_key, Slice(long_key));
+  ASSERT_EQ(InternalKey(it->first).sequence, 7);
+  ASSERT_EQ(it->second, Slice(long_value));
+  it++;
+  ASSERT_TRUE(it == table.end());
+}
+
+TEST(Basic, Ordering) {
+  InternalKeyComparator cmp(NewBytewiseComparator());
+  MemTable table(cmp);
+
+  // User keys sharing 8-byte prefixes, and keys that differ only by trailing
+  // zero bytes, must be ordered by the full comparison.
+  std::vector<std::string> keys = {
+      "",          std::string(1, '\0'), "a",        std::string("a\0", 2),
+      "abcdefgh",  "abcdefgh1",          "abcdefgh2", "abcdefg",
+      "abcdefgi",  "b"};
+  SequenceNumber seq = 1;
+  for (int round = 0; round < 2; round++) {
+    for (const auto& key : keys) {
+      table.Add(seq++, kTypeValue, key, key);
+    }
+  }
+
+  std::sort(keys.begin(), keys.end());
+  auto it = table.begin();
+  for (const auto& key : keys) {
+    // The newer entry comes first.
+    for (int round = 1; round >= 0; round--) {
+      ASSERT_TRUE(it != table.end());
+      InternalKey ikey(it->first);
+      ASSERT_EQ(ikey.user_key, Slice(key));
+      it++;
+    }
+  }
+  ASSERT_TRUE(it == table.end());
+
+  InternalKeyBuf target("abcdefgh1", seq, kTypeValue);
+  it = table.find(target.Data());
+  ASSERT_TRUE(it == table.end());
+}
+
+TEST(Basic, GetAtSequence) {
+  InternalKeyComparator cmp(NewBytewiseComparator());
+  MemTable table(cmp);
+  table.Add(1, kTypeValue, "abc", "v1");
+  table.Add(3, kTypeDeletion, "abc", "");
+  table.Add(5, kTypeValue, "abc", "v5");
+  table.Add(2, kTypeValue, "abd", "d2");
+
+  std::string value;
+  Status s;
+  ASSERT_FALSE(table.Get("abc", 0, &value, &s));
+  ASSERT_TRUE(table.Get("abc", 1, &value, &s));
+  ASSERT_TRUE(s);
+  ASSERT_EQ(value, "v1");
+  ASSERT_TRUE(table.Get("abc", 2, &value, &s));
+  ASSERT_EQ(value, "v1");
+  ASSERT_TRUE(table.Get("abc", 4, &value, &s));
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_TRUE(table.Get("abc", kMaxSequenceNumber, &value, &s));
+  ASSERT_TRUE(s);
+  ASSERT_EQ(value, "v5");
+
+  // Neither a prefix nor a missing key is found.
+  ASSERT_FALSE(table.Get("ab", kMaxSequenceNumber, &value, &s));
+  ASSERT_FALSE(table.Get("abe", kMaxSequenceNumber, &value, &s));
+  ASSERT_FALSE(table.Get("abd", 1, &value, &s));
+  ASSERT_TRUE(table.Get("abd", 2, &value, &s));
+  ASSERT_EQ(value, "d2");
+}
+
+TEST(Basic, RangeTombstones) {
+  InternalKeyComparator cmp(NewBytewiseComparator());
+  MemTable table(cmp);
+  table.Add(1, kTypeValue, "abc", "v1");
+  table.Add(2, kTypeRangeDeletion, "ab", "abd");
+  table.Add(3, kTypeValue, "abc", "v3");
+  table.Add(4, kTypeValue, "abd", "d4");
+  table.Add(5, kTypeRangeDeletion, "abd", "abe");
+  ASSERT_EQ(table.NumRangeTombstones(), 2);
+
+  // The tombstones aren't entries of the table.
+  size_t n = 0;
+  for (auto it = table.begin(); it != table.end(); it++)
+    n++;
+  ASSERT_EQ(n, 3);
+
+  std::string value;
+  Status s;
+  ASSERT_TRUE(table.Get("abc", 1, &value, &s));
+  ASSERT_EQ(value, "v1");
+  ASSERT_TRUE(table.Get("abc", 2, &value, &s));
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_TRUE(table.Get("abc", 3, &value, &s));
+  ASSERT_TRUE(s);
+  ASSERT_EQ(value, "v3");
+
+  // Covered with no entry, the key is deleted as of the tombstone, while the
+  // end key is not covered.
+  ASSERT_TRUE(table.Get("abb", kMaxSequenceNumber, &value, &s));
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_FALSE(table.Get("abb", 1, &value, &s));
+  ASSERT_TRUE(table.Get("abd", 4, &value, &s));
+  ASSERT_EQ(value, "d4");
+  ASSERT_TRUE(table.Get("abd", 5, &value, &s));
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_FALSE(table.Get("abe", kMaxSequenceNumber, &value, &s));
+
+  std::shared_ptr<const FragmentedRangeTombstones> tombstones =
+      table.RangeTombstones();
+  ASSERT_EQ(tombstones->Fragments().size(), 2);
+  ASSERT_EQ(tombstones->MaxCoveringSequence("abd", kMaxSequenceNumber), 5);
+}
+
+TEST(Vector, OrderingAndGet) {
+  InternalKeyComparator cmp(NewBytewiseComparator());
+  MemTable table(cmp, nullptr, kVectorRep);
+  ASSERT_TRUE(table.begin() == table.end());
+
+  table.Add(5, kTypeValue, "abc", "v5");
+  table.Add(1, kTypeValue, "abc", "v1");
+  table.Add(2, kTypeValue, "abd", "d2");
+  table.Add(3, kTypeDeletion, "abc", "");
+
+  std::string value;
+  Status s;
+  ASSERT_FALSE(table.Get("abc", 0, &value, &s));
+  ASSERT_TRUE(table.Get("abc", 2, &value, &s));
+  ASSERT_EQ(value, "v1");
+  ASSERT_TRUE(table.Get("abc", 4, &value, &s));
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_TRUE(table.Get("abc", kMaxSequenceNumber, &value, &s));
+  ASSERT_EQ(value, "v5");
+  ASSERT_FALSE(table.Get("abe", kMaxSequenceNumber, &value, &s));
+
+  // Entries added after a read are merged into the next one.
+  table.Add(4, kTypeValue, "abb", "b4");
+  ASSERT_TRUE(table.Get("abb", kMaxSequenceNumber, &value, &s));
+  ASSERT_EQ(value, "b4");
+
+  std::vector<std::pair<std::string, SequenceNumber>> expected = {
+      {"abb", 4}, {"abc", 5}, {"abc", 3}, {"abc", 1}, {"abd", 2}};
+  auto it = table.begin();
+  for (const auto& e : expected) {
+    ASSERT_TRUE(it != table.end());
+    ASSERT_EQ(InternalKey(it.Key()).user_key, Slice(e.first));
+    ASSERT_EQ(InternalKey(it.Key()).sequence, e.second);
+    it++;
+  }
+  ASSERT_TRUE(it == table.end());
+
+  InternalKeyBuf key("abd", 2, kTypeValue);
+  ASSERT_TRUE(table.find(key.Data()) != table.end());
+  InternalKeyBuf missing("abd", 3, kTypeValue);
+  ASSERT_TRUE(table.find(missing.Data()) == table.end());
+}
+
+TEST(Vector, IteratorOutlivesLaterAdds) {
+  InternalKeyComparator cmp(NewBytewiseComparator());
+  MemTable table(cmp, nullptr, kVectorRep);
+  table.Add(1, kTypeValue, "b", "b");
+  auto it = table.begin();
+  table.Add(2, kTypeValue, "a", "a");
+
+  // The iterator sees the entries sorted when it was created.
+  ASSERT_EQ(it->second, Slice("b"));
+  it++;
+  ASSERT_TRUE(it == table.end());
+  ASSERT_EQ(table.begin()->second, Slice("a"));
+}
+
+// Enough entries for the entries to be sorted by several threads.
+TEST(Vector, ConcurrentAddsAndParallelSort) {
+  InternalKeyComparator cmp(NewBytewiseComparator());
+  MemTable vec(cmp, nullptr, kVectorRep);
+  MemTable list(cmp);
+
+  const int kThreads = 4, kPerThread = 50000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t]() {
+      std::mt19937 rnd(t);
+      for (int i = 0; i < kPerThread; i++) {
+        std::string key = std::to_string(rnd() % 100000);
+        vec.AddConcurrently(t * kPerThread + i + 1, kTypeValue, key, key);
+      }
+    });
+  }
+  for (std::thread& t : threads)
+    t.join();
+  for (int t = 0; t < kThreads; t++) {
+    std::mt19937 rnd(t);
+    for (int i = 0; i < kPerThread; i++) {
+      std::string key = std::to_string(rnd() % 100000);
+      list.Add(t * kPerThread + i + 1, kTypeValue, key, key);
+    }
+  }
+  ASSERT_GT(vec.BytesUsed(), list.BytesUsed() / 2);
+
+  auto it = vec.begin();
+  for (auto it2 = list.begin(); it2 != list.end(); it2++, it++) {
+    ASSERT_TRUE(it != vec.end());
+    ASSERT_EQ(it.Key(), it2.Key());
+  }
+  ASSERT_TRUE(it == vec.end());
+}
@@ -0,0 +1,179 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "Block.h"
+#include "InternalKey.h"
+#include "MemTable.h"
+#include "MergingIterator.h"
+#include "SSTable.h"
+#include "SSTableBuilder.h"
+#include "TestUtils.h"
+
+using namespace lessdb;
+using namespace test;
+
+namespace {
+
+struct Entry {
+  std::string key;  // InternalKey
+  std::string value;
+};
+
+// Entries of user keys "k000" to "k099" at increasing sequences, spread
+// over "num_memtables" memtables and "num_tables" sstables.
+class MergeTest : public ::testing::Test {
+ protected:
+  MergeTest() : icmp_(NewBytewiseComparator()) {
+    options_.comparator = &icmp_;
+    options_.block_size = 256;
+  }
+
+  void Build(int num_memtables, int num_tables, int num_entries) {
+    const int num_sources = num_memtables + num_tables;
+    std::vector<std::vector<Entry>> table_entries(num_tables);
+    for (int i = 0; i < num_memtables; i++)
+      memtables_.emplace_back(new MemTable(icmp_));
+
+    for (int i = 0; i < num_entries; i++) {
+      char user_key[8];
+      snprintf(user_key, sizeof(user_key), "k%03d", RandomIn(0, 99));
+      SequenceNumber sequence = static_cast<SequenceNumber>(i + 1);
+      ValueType type = RandomIn(0, 3) == 0 ? kTypeDeletion : kTypeValue;
+      std::string value = type == kTypeValue ? RandomString(20) : "";
+      InternalKeyBuf key(user_key, sequence, type);
+      entries_.push_back(Entry{key.Data().ToString(), value});
+
+      int source = RandomIn(0, num_sources - 1);
+      if (source < num_memtables)
+        memtables_[source]->Add(sequence, type, user_key, value);
+      else
+        table_entries[source - num_memtables].push_back(entries_.back());
+    }
+    auto less = [this](const Entry &a, const Entry &b) {
+      return icmp_.Compare(a.key, b.key) < 0;
+    };
+    std::sort(entries_.begin(), entries_.end(), less);
+
+    for (std::vector<Entry> &entries : table_entries) {
+      std::sort(entries.begin(), entries.end(), less);
+      StringSink sink;
+      SSTableBuilder builder(&options_, &sink);
+      for (const Entry &e : entries)
+        builder.Add(e.key, e.value);
+      builder.Finish();
+
+      sources_.emplace_back(new StringSource(sink.Content()));
+      Status s;
+      tables_.emplace_back(SSTable::Open(options_, sources_.back().get(),
+                                         sink.Content().size(), s));
+      ASSERT_TRUE(s) << s.ToString();
+    }
+  }
+
+  std::vector<std::unique_ptr<MergeSource>> Children() const {
+    std::vector<std::unique_ptr<MergeSource>> children;
+    for (const auto &mem : memtables_)
+      children.push_back(NewRangeSource(mem->begin(), mem->end()));
+    for (const auto &table : tables_)
+      children.push_back(NewRangeSource(table->begin(), table->end()));
+    return children;
+  }
+
+  // The newest value of each user key as of "snapshot".
+  std::map<std::string, std::string> Visible(SequenceNumber snapshot) const {
+    std::map<std::string, std::string> visible;
+    std::string last;
+    for (const Entry &e : entries_) {
+      InternalKey ikey(e.key);
+      if (ikey.sequence > snapshot)
+        continue;
+      std::string user_key = ikey.user_key.ToString();
+      if (user_key == last)
+        continue;
+      last = user_key;
+      if (ikey.type == kTypeValue)
+        visible[user_key] = e.value;
+    }
+    return visible;
+  }
+
+  InternalKeyComparator icmp_;
+  Options options_;
+  std::vector<Entry> entries_;
+  std::vector<std::unique_ptr<MemTable>> memtables_;
+  std::vector<std::unique_ptr<StringSource>> sources_;
+  std::vector<std::unique_ptr<SSTable>> tables_;
+};
+
+}  // namespace
+
+TEST_F(MergeTest, Empty) {
+  MergingIterator none(&icmp_, {});
+  ASSERT_FALSE(none.Valid());
+
+  Build(2, 0, 0);
+  MergingIterator empty(&icmp_, Children());
+  ASSERT_FALSE(empty.Valid());
+}
+
+TEST_F(MergeTest, AllEntries) {
+  for (int num_sources : {1, 2, 3, 5, 8}) {
+    SCOPED_TRACE(num_sources);
+    memtables_.clear();
+    tables_.clear();
+    entries_.clear();
+    Build(num_sources / 2, num_sources - num_sources / 2, 2000);
+
+    MergingIterator it(&icmp_, Children());
+    for (const Entry &e : entries_) {
+      ASSERT_TRUE(it.Valid());
+      ASSERT_EQ(it.Key().ToString(), e.key);
+      ASSERT_EQ(it.Value().ToString(), e.value);
+      it.Next();
+    }
+    ASSERT_FALSE(it.Valid());
+  }
+}
+
+TEST_F(MergeTest, NewestVisible) {
+  Build(3, 4, 2000);
+  for (SequenceNumber snapshot : {0, 1, 500, 1999, 2000, 5000}) {
+    SCOPED_TRACE(snapshot);
+    std::map<std::string, std::string> visible = Visible(snapshot);
+    MergingIterator it(&icmp_, Children(), snapshot);
+    for (const auto &kv : visible) {
+      ASSERT_TRUE(it.Valid());
+      InternalKey ikey(it.Key());
+      ASSERT_EQ(ikey.user_key.ToString(), kv.first);
+      ASSERT_EQ(ikey.type, kTypeValue);
+      ASSERT_LE(ikey.sequence, snapshot);
+      ASSERT_EQ(it.Value().ToString(), kv.second);
+      it.Next();
+    }
+    ASSERT_FALSE(it.Valid());
+  }
+}
@@ -0,0 +1,206 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <boost/filesystem.hpp>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "FileUtils.h"
+#include "Status.h"
+
+using namespace lessdb;
+
+// Reads go through pread (or io_uring) rather than mmap, which must be set
+// before the first call to FileFactory::Default().
+static const bool kNoMmap = (FileFactory::TEST_SetMmapLimit(0), true);
+
+class RandomAccessFileTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    fname_ = (boost::filesystem::temp_directory_path() /
+              boost::filesystem::unique_path("lessdb-%%%%-%%%%"))
+                 .string();
+    for (int i = 0; i < 100000; i++)
+      content_.push_back(static_cast<char>('a' + i % 26));
+
+    FILE *f = fopen(fname_.c_str(), "w");
+    ASSERT_TRUE(f != nullptr);
+    ASSERT_EQ(fwrite(content_.data(), 1, content_.size(), f), content_.size());
+    fclose(f);
+
+    Status s;
+    file_.reset(FileFactory::Default()->NewRandomAccessFile(fname_, &s));
+    ASSERT_TRUE(s) << s.ToString();
+  }
+
+  void TearDown() override {
+    file_.reset();
+    boost::filesystem::remove(fname_);
+  }
+
+  std::string fname_;
+  std::string content_;
+  std::unique_ptr<RandomAccessFile> file_;
+};
+
+TEST_F(RandomAccessFileTest, Read) {
+  char buf[100];
+  Slice result;
+  ASSERT_TRUE(file_->Read(sizeof(buf), 1000, buf, &result));
+  ASSERT_EQ(result.ToString(), content_.substr(1000, sizeof(buf)));
+
+  // Reads across the end of file are truncated.
+  ASSERT_TRUE(file_->Read(sizeof(buf), content_.size() - 10, buf, &result));
+  ASSERT_EQ(result.ToString(), content_.substr(content_.size() - 10));
+}
+
+TEST_F(RandomAccessFileTest, MultiRead) {
+  // More requests than a single io_uring submission holds.
+  const size_t n = 200;
+  std::vector<ReadRequest> reqs(n);
+  std::vector<std::unique_ptr<char[]>> bufs;
+  for (size_t i = 0; i < n; i++) {
+    reqs[i].offset = (i * 7919) % content_.size();
+    reqs[i].len = 1 + i;
+    bufs.emplace_back(new char[reqs[i].len]);
+    reqs[i].scratch = bufs.back().get();
+  }
+  file_->MultiRead(reqs.data(), n);
+
+  for (size_t i = 0; i < n; i++) {
+    ASSERT_TRUE(reqs[i].status) << reqs[i].status.ToString();
+    ASSERT_EQ(reqs[i].result.ToString(),
+              content_.substr(reqs[i].offset, reqs[i].len))
+        << i;
+  }
+}
+
+class FdWritableFileTest : public ::testing::TestWithParam<bool> {
+ protected:
+  void SetUp() override {
+    // Under the test binary's working directory rather than /tmp, which may
+    // be a tmpfs without O_DIRECT.
+    fname_ = boost::filesystem::unique_path("lessdb-%%%%-%%%%").string();
+  }
+
+  void TearDown() override {
+    boost::filesystem::remove(fname_);
+  }
+
+  std::string readAll() {
+    std::string result;
+    FILE *f = fopen(fname_.c_str(), "r");
+    if (f == nullptr)
+      return result;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+      result.append(buf, n);
+    fclose(f);
+    return result;
+  }
+
+  std::string fname_;
+};
+
+TEST_P(FdWritableFileTest, Append) {
+  FdWriteOptions options;
+  options.use_direct_writes = GetParam();
+  options.buffer_size = 10000;  // rounded up to 3 pages
+  options.preallocation_size = 64 << 10;
+  options.bytes_per_sync = 32 << 10;
+  std::unique_ptr<FileFactory> factory(FileFactory::NewFdWriteFactory(options));
+
+  Status s;
+  std::unique_ptr<WritableFile> file(factory->NewWritableFile(fname_, &s));
+  ASSERT_TRUE(s) << s.ToString();
+
+  std::string expected;
+  for (int i = 0; i < 500; i++) {
+    // Appends both smaller and larger than the buffer.
+    std::string data((i * 37) % (i % 10 == 0 ? 30000 : 1000),
+                     static_cast<char>('a' + i % 26));
+    ASSERT_TRUE(file->Append(data));
+    expected += data;
+    if (i % 7 == 0)
+      ASSERT_TRUE(file->Flush());
+    if (i % 50 == 0) {
+      ASSERT_TRUE(file->Sync());
+      // Flushed data is visible, and the direct I/O padding is not part of
+      // the content.
+      ASSERT_EQ(readAll().substr(0, expected.size()), expected);
+    }
+  }
+  ASSERT_TRUE(file->Close());
+  ASSERT_EQ(boost::filesystem::file_size(fname_), expected.size());
+  ASSERT_TRUE(readAll() == expected);
+}
+
+TEST_P(FdWritableFileTest, Appendv) {
+  FdWriteOptions options;
+  options.use_direct_writes = GetParam();
+  options.buffer_size = 10000;
+  std::unique_ptr<FileFactory> factory(FileFactory::NewFdWriteFactory(options));
+
+  Status s;
+  std::unique_ptr<WritableFile> file(factory->NewWritableFile(fname_, &s));
+  ASSERT_TRUE(s) << s.ToString();
+
+  std::string expected;
+  for (int i = 0; i < 100; i++) {
+    // Scatter lists both fitting in the buffer and spilling over it, after
+    // some buffered data.
+    std::vector<std::string> pieces;
+    for (int j = 0; j < i % 5 + 1; j++) {
+      pieces.push_back(std::string((i * 131 + j * 17) % (i % 3 ? 500 : 9000),
+                                   static_cast<char>('a' + (i + j) % 26)));
+    }
+    std::vector<Slice> slices(pieces.begin(), pieces.end());
+    ASSERT_TRUE(file->Appendv(slices.data(), slices.size()));
+    for (const auto &p : pieces)
+      expected += p;
+    ASSERT_TRUE(file->Append("|"));
+    expected += "|";
+    if (i % 9 == 0)
+      ASSERT_TRUE(file->Flush());
+  }
+  ASSERT_TRUE(file->Close());
+  ASSERT_TRUE(readAll() == expected);
+}
+
+TEST_P(FdWritableFileTest, Empty) {
+  FdWriteOptions options;
+  options.use_direct_writes = GetParam();
+  std::unique_ptr<FileFactory> factory(FileFactory::NewFdWriteFactory(options));
+
+  Status s;
+  std::unique_ptr<WritableFile> file(factory->NewWritableFile(fname_, &s));
+  ASSERT_TRUE(s) << s.ToString();
+  ASSERT_TRUE(file->Sync());
+  file.reset();  // closed by the destructor
+  ASSERT_EQ(boost::filesystem::file_size(fname_), 0u);
+}
+
+INSTANTIATE_TEST_CASE_P(DirectIO, FdWritableFileTest,
+                        ::testing::Values(false, true));
@@ -0,0 +1,87 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <gtest/gtest.h>
+
+#include "Comparator.h"
+#include "RangeTombstone.h"
+
+using namespace lessdb;
+
+// Prints the fragments as "[begin,end):seq,seq".
+static std::string Print(const FragmentedRangeTombstones &tombstones) {
+  std::string result;
+  for (const auto &f : tombstones.Fragments()) {
+    result += "[" + f.begin + "," + f.end + "):";
+    for (size_t i = 0; i < f.sequences.size(); i++) {
+      if (i > 0)
+        result += ",";
+      result += std::to_string(f.sequences[i]);
+    }
+    result += " ";
+  }
+  return result;
+}
+
+TEST(Fragment, Empty) {
+  FragmentedRangeTombstones tombstones(NewBytewiseComparator(), {});
+  ASSERT_TRUE(tombstones.Empty());
+  ASSERT_TRUE(tombstones.Find("a") == nullptr);
+  ASSERT_EQ(tombstones.MaxCoveringSequence("a", kMaxSequenceNumber), 0);
+
+  // Empty ranges delete nothing.
+  FragmentedRangeTombstones empty(
+      NewBytewiseComparator(),
+      {RangeTombstone("b", "b", 1), RangeTombstone("c", "a", 2)});
+  ASSERT_TRUE(empty.Empty());
+}
+
+TEST(Fragment, Overlapping) {
+  FragmentedRangeTombstones tombstones(
+      NewBytewiseComparator(),
+      {RangeTombstone("c", "g", 5), RangeTombstone("a", "e", 3),
+       RangeTombstone("d", "e", 7), RangeTombstone("k", "m", 2),
+       RangeTombstone("a", "e", 3)});
+  ASSERT_EQ(Print(tombstones),
+            "[a,c):3 [c,d):5,3 [d,e):7,5,3 [e,g):5 [k,m):2 ");
+
+  ASSERT_TRUE(tombstones.Find("0") == nullptr);
+  ASSERT_TRUE(tombstones.Find("g") == nullptr);
+  ASSERT_TRUE(tombstones.Find("h") == nullptr);
+  ASSERT_TRUE(tombstones.Find("m") == nullptr);
+  ASSERT_EQ(tombstones.Find("dz")->begin, "d");
+  ASSERT_EQ(tombstones.Find("k")->end, "m");
+
+  ASSERT_EQ(tombstones.MaxCoveringSequence("d", kMaxSequenceNumber), 7);
+  ASSERT_EQ(tombstones.MaxCoveringSequence("d", 6), 5);
+  ASSERT_EQ(tombstones.MaxCoveringSequence("d", 4), 3);
+  ASSERT_EQ(tombstones.MaxCoveringSequence("d", 2), 0);
+  ASSERT_EQ(tombstones.MaxCoveringSequence("f", 4), 0);
+
+  // The fragments cover what the tombstones do.
+  std::vector<RangeTombstone> fragments;
+  tombstones.AppendTo(&fragments);
+  ASSERT_EQ(fragments.size(), 8);
+  FragmentedRangeTombstones again(NewBytewiseComparator(), fragments);
+  ASSERT_EQ(Print(again), Print(tombstones));
+}
@@ -0,0 +1,150 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "RateLimiter.h"
+#include "utils/FileMocks.h"
+
+using namespace lessdb;
+
+namespace {
+
+int64_t ElapsedMicros(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+}  // anonymous namespace
+
+TEST(RateLimiter, SingleBurst) {
+  RateLimiter limiter(1 << 20, 100 * 1000);
+  ASSERT_EQ(limiter.GetBytesPerSecond(), 1 << 20);
+  ASSERT_EQ(limiter.GetSingleBurstBytes(), (1 << 20) / 10);
+
+  limiter.SetBytesPerSecond(2 << 20);
+  ASSERT_EQ(limiter.GetBytesPerSecond(), 2 << 20);
+  ASSERT_EQ(limiter.GetCurrentBytesPerSecond(), 2 << 20);
+  ASSERT_EQ(limiter.GetSingleBurstBytes(), (2 << 20) / 10);
+  ASSERT_FALSE(limiter.IsAutoTuned());
+}
+
+TEST(RateLimiter, Throughput) {
+  // 100KB/s in bursts of 10KB: 50KB can't be granted in less than 0.4s,
+  // the first burst being available immediately.
+  RateLimiter limiter(100 << 10, 100 * 1000);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 50; i++)
+    limiter.Request(1 << 10, RateLimiter::kLow);
+  ASSERT_GE(ElapsedMicros(start), 350 * 1000);
+  ASSERT_EQ(limiter.GetTotalBytesThrough(RateLimiter::kLow), 50 << 10);
+  ASSERT_EQ(limiter.GetTotalBytesThrough(RateLimiter::kHigh), 0);
+
+  // A request larger than a burst is split instead of waiting forever.
+  start = std::chrono::steady_clock::now();
+  limiter.Request(30 << 10, RateLimiter::kHigh);
+  ASSERT_GE(ElapsedMicros(start), 150 * 1000);
+  ASSERT_EQ(limiter.GetTotalBytesThrough(RateLimiter::kHigh), 30 << 10);
+}
+
+TEST(RateLimiter, Priorities) {
+  RateLimiter limiter(200 << 10, 10 * 1000);
+  std::vector<std::thread> threads;
+  for (int pri = 0; pri < RateLimiter::kNumPriorities; pri++) {
+    for (int t = 0; t < 2; t++) {
+      threads.emplace_back([&limiter, pri] {
+        for (int i = 0; i < 20; i++)
+          limiter.Request(1 << 10, static_cast<RateLimiter::Priority>(pri));
+      });
+    }
+  }
+  for (auto &t : threads)
+    t.join();
+  ASSERT_EQ(limiter.GetTotalBytesThrough(RateLimiter::kHigh), 40 << 10);
+  ASSERT_EQ(limiter.GetTotalBytesThrough(RateLimiter::kLow), 40 << 10);
+}
+
+TEST(RateLimiter, AutoTune) {
+  const int64_t kRate = 20 << 20;
+  RateLimiter limiter(kRate, 100 * 1000, true);
+  ASSERT_TRUE(limiter.IsAutoTuned());
+
+  // The first window sets the baseline.
+  for (int i = 0; i < RateLimiter::kTuneSamples; i++)
+    limiter.ReportForegroundLatency(100);
+  ASSERT_EQ(limiter.GetCurrentBytesPerSecond(), kRate);
+
+  // Backs off while the latency is high, not below 1/20 of the rate.
+  int64_t last = kRate;
+  for (int w = 0; w < 3; w++) {
+    for (int i = 0; i < RateLimiter::kTuneSamples; i++)
+      limiter.ReportForegroundLatency(1000);
+    ASSERT_LT(limiter.GetCurrentBytesPerSecond(), last);
+    last = limiter.GetCurrentBytesPerSecond();
+  }
+  for (int w = 0; w < 50; w++) {
+    for (int i = 0; i < RateLimiter::kTuneSamples; i++)
+      limiter.ReportForegroundLatency(1000);
+  }
+  ASSERT_EQ(limiter.GetCurrentBytesPerSecond(), kRate / 20);
+  ASSERT_EQ(limiter.GetSingleBurstBytes(), kRate / 20 / 10);
+
+  // Goes back up once the latency is back to normal, not above the rate.
+  last = limiter.GetCurrentBytesPerSecond();
+  for (int i = 0; i < RateLimiter::kTuneSamples; i++)
+    limiter.ReportForegroundLatency(100);
+  ASSERT_GT(limiter.GetCurrentBytesPerSecond(), last);
+  for (int w = 0; w < 50; w++) {
+    for (int i = 0; i < RateLimiter::kTuneSamples; i++)
+      limiter.ReportForegroundLatency(100);
+  }
+  ASSERT_EQ(limiter.GetCurrentBytesPerSecond(), kRate);
+  ASSERT_EQ(limiter.GetBytesPerSecond(), kRate);
+}
+
+TEST(RateLimiter, NotAutoTuned) {
+  RateLimiter limiter(1 << 20);
+  for (int i = 0; i < 10 * RateLimiter::kTuneSamples; i++)
+    limiter.ReportForegroundLatency(i % 2 ? 10 : 100000);
+  ASSERT_EQ(limiter.GetCurrentBytesPerSecond(), 1 << 20);
+}
+
+TEST(RateLimiter, RateLimitedFile) {
+  RateLimiter limiter(1 << 20);
+  test::StringSink *sink = new test::StringSink;
+  std::unique_ptr<WritableFile> file(
+      NewRateLimitedFile(sink, &limiter, RateLimiter::kLow));
+  ASSERT_TRUE(file->Append("hello "));
+  Slice parts[] = {"rate ", "limited"};
+  ASSERT_TRUE(file->Appendv(parts, 2));
+  ASSERT_TRUE(file->Flush());
+  ASSERT_TRUE(file->Sync());
+  ASSERT_TRUE(file->Close());
+  ASSERT_EQ(sink->Content(), "hello rate limited");
+  ASSERT_EQ(limiter.GetTotalBytesThrough(RateLimiter::kLow), 18);
+  ASSERT_EQ(limiter.GetTotalBytesThrough(RateLimiter::kHigh), 0);
+}
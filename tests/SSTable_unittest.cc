@@ -22,11 +22,25 @@
 
 #include <glog/logging.h>
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 #include "SSTableBuilder.h"
 #include "TestUtils.h"
 #include "SSTable.h"
+#include "PerfContext.h"
+#include "Statistics.h"
+#include "Allocator.h"
 #include "Block.h"
+#include "BlockUtils.h"
+#include "CacheStrategy.h"
+#include "Compression.h"
+#include "Config.h"
+#include "FilterStrategy.h"
+#include "InternalKey.h"
+#include "PrefixExtractor.h"
 // Must include Block.h or compiler will warn that Block is an incomplete type.
 
 using namespace lessdb;
@@ -116,4 +130,1250 @@ TEST(Basic, Random) {
 
     ASSERT_TRUE(sst->end() == it);
   }
-}
\ No newline at end of file
+}
+
+TEST(Cache, BlockReuse) {
+  Options options;
+  std::unique_ptr<CacheStrategy> cache(CacheStrategy::Default(8 << 20));
+  Statistics stats;
+  options.block_cache = cache.get();
+  options.block_size = 256;
+  options.statistics = &stats;
+
+  KVMap table;
+  StringSink sink;
+  SSTableBuilder builder(&options, &sink);
+  for (int i = 0; i < 1000; ++i) {
+    table.emplace(RandomString(RandomIn(1, 1 << 4)), RandomString(1 << 5));
+  }
+  for (const auto& it : table) {
+    builder.Add(it.first, it.second);
+  }
+  builder.Finish();
+
+  StringSource source(sink.Content());
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &source, sink.Content().size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+
+  // The first pass reads every data block from file and fills the cache.
+  for (auto it = sst->begin(); it != sst->end(); it++) {
+  }
+  int reads = source.NumReads();
+  ASSERT_GT(cache->TotalCharge(), 0);
+  const uint64_t blocks = stats.GetTickerCount(kBlockRead);
+  ASSERT_GT(blocks, 0);
+  ASSERT_GT(stats.GetTickerCount(kBlockReadBytes), blocks);
+  ASSERT_EQ(stats.GetTickerCount(kBlockCacheMiss), blocks);
+  ASSERT_EQ(stats.GetTickerCount(kBlockCacheAdd), blocks);
+  ASSERT_EQ(stats.GetTickerCount(kBlockCacheHit), 0);
+
+  // Lookups afterwards are all served by the block cache.
+  for (const auto& it : table) {
+    auto found = sst->find(it.first);
+    ASSERT_TRUE(found != sst->end());
+    ASSERT_EQ(found.Value().ToString(), it.second);
+  }
+  ASSERT_EQ(source.NumReads(), reads);
+  ASSERT_EQ(stats.GetTickerCount(kBlockCacheHit), table.size());
+  ASSERT_EQ(stats.GetTickerCount(kBlockRead), blocks);
+}
+
+TEST(PerfContext, Find) {
+  Options options;
+  std::unique_ptr<CacheStrategy> cache(CacheStrategy::Default(8 << 20));
+  options.block_cache = cache.get();
+
+  StringSink sink;
+  SSTableBuilder builder(&options, &sink);
+  for (int i = 0; i < 1000; ++i) {
+    char key[16];
+    snprintf(key, sizeof(key), "k%06d", i);
+    builder.Add(key, RandomString(1 << 5));
+  }
+  builder.Finish();
+
+  StringSource source(sink.Content());
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &source, sink.Content().size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+
+  // Nothing is collected while the perf level is disabled.
+  GetPerfContext()->Reset();
+  ASSERT_TRUE(sst->find("k000500") != sst->end());
+  ASSERT_EQ(GetPerfContext()->user_key_comparison_count, 0);
+  ASSERT_EQ(GetPerfContext()->block_read_count, 0);
+
+  SetPerfLevel(kPerfEnableTime);
+  GetPerfContext()->Reset();
+  ASSERT_TRUE(sst->find("k000100") != sst->end());
+  const PerfContext first = *GetPerfContext();
+  ASSERT_EQ(first.block_read_count, 1);
+  ASSERT_GT(first.block_read_byte, 0);
+  ASSERT_EQ(first.block_cache_hit_count, 0);
+  ASSERT_GT(first.user_key_comparison_count, 0);
+  ASSERT_GT(first.block_read_nanos, 0);
+  ASSERT_GT(first.index_seek_nanos, 0);
+
+  // The same block is found in the cache the second time.
+  GetPerfContext()->Reset();
+  ASSERT_TRUE(sst->find("k000100") != sst->end());
+  ASSERT_EQ(GetPerfContext()->block_read_count, 0);
+  ASSERT_EQ(GetPerfContext()->block_cache_hit_count, 1);
+  ASSERT_EQ(GetPerfContext()->block_read_nanos, 0);
+  SetPerfLevel(kPerfDisable);
+}
+
+TEST(Filter, SkipMissingKeys) {
+  Options options;
+  std::unique_ptr<FilterStrategy> filter(FilterStrategy::Default(10));
+  Statistics stats;
+  options.filter_strategy = filter.get();
+  options.statistics = &stats;
+
+  KVMap table;
+  StringSink sink;
+  SSTableBuilder builder(&options, &sink);
+  for (int i = 0; i < 1000; ++i) {
+    table.emplace("k" + std::to_string(i), RandomString(1 << 5));
+  }
+  for (const auto& it : table) {
+    builder.Add(it.first, it.second);
+  }
+  builder.Finish();
+
+  StringSource source(sink.Content());
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &source, sink.Content().size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+
+  for (const auto& it : table) {
+    auto found = sst->find(it.first);
+    ASSERT_TRUE(found != sst->end());
+    ASSERT_EQ(found.Value().ToString(), it.second);
+  }
+
+  // Most of the lookups of missing keys are ruled out by the filter without
+  // reading any data block.
+  int reads = source.NumReads();
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(sst->find("k" + std::to_string(i) + "x") == sst->end());
+  }
+  ASSERT_LE(source.NumReads() - reads, 1000 * 0.05);
+  const uint64_t useful = stats.GetTickerCount(kFilterUseful);
+  const uint64_t positive = stats.GetTickerCount(kFilterPositive);
+  ASSERT_GE(useful, 1000 * 0.95);
+  ASSERT_EQ(useful + positive, 2000);
+  ASSERT_EQ(stats.GetTickerCount(kFilterFalsePositive), positive - 1000);
+
+  // A table opened without a filter strategy still reads normally.
+  Options no_filter;
+  std::unique_ptr<SSTable> sst2(
+      SSTable::Open(no_filter, &source, sink.Content().size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+  ASSERT_TRUE(sst2->find(table.begin()->first) != sst2->end());
+}
+
+namespace {
+
+// Allocates from the heap, counting the chunks outstanding.
+class CountingAllocator final : public Allocator {
+ public:
+  void* Allocate(size_t size) override {
+    allocs++;
+    outstanding++;
+    return new char[size];
+  }
+
+  void Deallocate(void* p) override {
+    outstanding--;
+    delete[] static_cast<char*>(p);
+  }
+
+  const char* Name() const override { return "CountingAllocator"; }
+
+  int allocs = 0;
+  int outstanding = 0;
+};
+
+}  // namespace
+
+TEST(Read, Allocator) {
+  CountingAllocator allocator;
+  Options options;
+  options.allocator = &allocator;
+  options.block_size = 256;
+
+  KVMap table;
+  StringSink sink;
+  SSTableBuilder builder(&options, &sink);
+  for (int i = 0; i < 1000; ++i) {
+    table.emplace("k" + std::to_string(i), RandomString(1 << 5));
+  }
+  for (const auto& it : table) {
+    builder.Add(it.first, it.second);
+  }
+  builder.Finish();
+
+  StringSource source(sink.Content());
+  Status s;
+  {
+    std::unique_ptr<CacheStrategy> cache(CacheStrategy::Default(8 << 20));
+    options.block_cache = cache.get();
+    std::unique_ptr<SSTable> sst(
+        SSTable::Open(options, &source, sink.Content().size(), s));
+    ASSERT_TRUE(s) << s.ToString();
+    ASSERT_EQ(allocator.allocs, 1);  // the index block
+
+    // Point lookups and scans read their blocks into the allocator's memory.
+    for (const auto& it : table) {
+      auto found = sst->find(it.first);
+      ASSERT_TRUE(found != sst->end());
+      ASSERT_EQ(found.Value().ToString(), it.second);
+    }
+    ReadOptions read_options;
+    read_options.readahead_size = 4096;
+    read_options.fill_cache = false;
+    auto it2 = table.begin();
+    for (auto it = sst->begin(read_options); it != sst->end(); ++it, ++it2) {
+      ASSERT_EQ(it.Key().ToString(), it2->first);
+    }
+    ASSERT_GT(allocator.allocs, 1);
+    ASSERT_GT(allocator.outstanding, 1);  // the cached blocks
+  }
+  ASSERT_EQ(allocator.outstanding, 0);
+}
+
+TEST(Read, StableContents) {
+  Options options;
+  options.block_size = 256;
+
+  KVMap table;
+  StringSink sink;
+  SSTableBuilder builder(&options, &sink);
+  for (int i = 0; i < 1000; ++i) {
+    table.emplace(RandomString(RandomIn(1, 1 << 4)), RandomString(1 << 5));
+  }
+  for (const auto& it : table) {
+    builder.Add(it.first, it.second);
+  }
+  builder.Finish();
+
+  StringSource source(sink.Content(), true);
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &source, sink.Content().size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+
+  // Blocks are used in-place, without being copied out of the file.
+  BlockContent content;
+  auto index_it = sst->TEST_GetIndexBlock()->begin();
+  Slice hbuf = index_it.Value();
+  BlockHandle handle;
+  ASSERT_TRUE(BlockHandle::DecodeFrom(&hbuf, &handle));
+  ReadOptions read_options;
+  read_options.verify_checksums = true;
+  ASSERT_TRUE(ReadBlockContent(&source, read_options, handle, &content));
+  ASSERT_FALSE(content.heap_allocated);
+
+  for (const auto& it : table) {
+    auto found = sst->find(it.first);
+    ASSERT_TRUE(found != sst->end());
+    ASSERT_EQ(found.Value().ToString(), it.second);
+  }
+}
+
+TEST(Read, Checksums) {
+  Options options;
+  StringSink sink;
+  SSTableBuilder builder(&options, &sink);
+  builder.Add("a", "1");
+  builder.Add("b", "2");
+  builder.Finish();
+
+  std::unique_ptr<SSTable> sst;
+  {
+    StringSource source(sink.Content());
+    Status s;
+    sst.reset(SSTable::Open(options, &source, sink.Content().size(), s));
+    ASSERT_TRUE(s) << s.ToString();
+  }
+  auto index_it = sst->TEST_GetIndexBlock()->begin();
+  Slice hbuf = index_it.Value();
+  BlockHandle handle;
+  ASSERT_TRUE(BlockHandle::DecodeFrom(&hbuf, &handle));
+
+  ReadOptions read_options;
+  read_options.verify_checksums = true;
+  const size_t start = handle.offset - handle.size;
+  const size_t trailer = handle.offset - kBlockTrailerSize;
+  BlockContent content;
+  ASSERT_NE(sink.Content()[trailer] & kBlockTrailerCrc32cFlag, 0);
+  {
+    StringSource source(sink.Content());
+    ASSERT_TRUE(ReadBlockContent(&source, read_options, handle, &content));
+    delete[] content.data.RawData();
+  }
+
+  // A block written by older versions is checked by the legacy crc.
+  std::string legacy = sink.Content();
+  legacy[trailer] = 0;
+  DataView(&legacy[trailer + 1])
+      .WriteNum(LegacyCrc32(legacy.data() + start, trailer - start));
+  {
+    StringSource source(legacy);
+    ASSERT_TRUE(ReadBlockContent(&source, read_options, handle, &content));
+    delete[] content.data.RawData();
+  }
+
+  std::string corrupted = sink.Content();
+  corrupted[start] ^= 1;
+  {
+    StringSource source(corrupted);
+    Status s = ReadBlockContent(&source, read_options, handle, &content);
+    ASSERT_TRUE(s.IsCorruption());
+  }
+}
+
+TEST(MultiGet, Basic) {
+  Options options;
+  std::unique_ptr<FilterStrategy> filter(FilterStrategy::Default(10));
+  options.filter_strategy = filter.get();
+  options.block_size = 256;
+
+  KVMap table;
+  StringSink sink;
+  SSTableBuilder builder(&options, &sink);
+  for (int i = 0; i < 1000; ++i) {
+    table.emplace("k" + std::to_string(i), RandomString(1 << 5));
+  }
+  for (const auto& it : table) {
+    builder.Add(it.first, it.second);
+  }
+  builder.Finish();
+
+  StringSource source(sink.Content());
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &source, sink.Content().size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+
+  size_t num_blocks = 0;
+  const Block* index = sst->TEST_GetIndexBlock();
+  for (auto it = index->begin(); it != index->end(); it++) {
+    num_blocks++;
+  }
+
+  // Unsorted keys, with duplicates and keys not in the table.
+  std::vector<std::string> keys;
+  for (const auto& it : table) {
+    keys.push_back(it.first + "x");
+    keys.push_back(it.first);
+  }
+  keys.push_back(table.begin()->first);
+  keys.push_back("zzz");
+  std::reverse(keys.begin(), keys.end());
+  std::vector<Slice> slices(keys.begin(), keys.end());
+
+  int reads = source.NumReads();
+  std::vector<SSTable::ConstIterator> results(slices.size(), sst->end());
+  s = sst->MultiGet(slices.data(), slices.size(), results.data());
+  ASSERT_TRUE(s) << s.ToString();
+
+  // Every data block is read exactly once.
+  ASSERT_EQ(source.NumReads() - reads, num_blocks);
+  for (size_t i = 0; i < keys.size(); i++) {
+    auto expected = table.find(keys[i]);
+    if (expected == table.end()) {
+      ASSERT_TRUE(results[i] == sst->end()) << keys[i];
+    } else {
+      ASSERT_TRUE(results[i] != sst->end()) << keys[i];
+      ASSERT_EQ(results[i].Key().ToString(), keys[i]);
+      ASSERT_EQ(results[i].Value().ToString(), expected->second);
+    }
+  }
+}
+
+// JSON-ish values, which compress well.
+static std::string JsonValue(int i) {
+  return "{\"id\":" + std::to_string(i) + ",\"name\":\"user" +
+         std::to_string(i % 97) + "\",\"tags\":[\"lessdb\",\"sstable\"]," +
+         "\"score\":" + std::to_string(i * 7 % 1000) + "}";
+}
+
+static std::string BuildTable(const Options& options, const KVMap& table) {
+  StringSink sink;
+  SSTableBuilder builder(&options, &sink);
+  for (const auto& it : table) {
+    EXPECT_TRUE(builder.Add(it.first, it.second));
+  }
+  EXPECT_TRUE(builder.Finish());
+  return sink.Content();
+}
+
+// Reads back every entry of "table" from "contents" by iteration, find and
+// MultiGet.
+static void CheckTable(const Options& options, const std::string& contents,
+                       const KVMap& table) {
+  StringSource source(contents);
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &source, contents.size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+
+  auto expected = table.begin();
+  auto scan = sst->begin();
+  for (; scan != sst->end(); scan++, expected++) {
+    ASSERT_TRUE(expected != table.end());
+    ASSERT_EQ(scan.Key().ToString(), expected->first);
+    ASSERT_EQ(scan.Value().ToString(), expected->second);
+  }
+  ASSERT_TRUE(scan.Stat()) << scan.Stat().ToString();
+  ASSERT_TRUE(expected == table.end());
+
+  std::vector<Slice> keys;
+  for (const auto& it : table) {
+    auto found = sst->find(it.first);
+    ASSERT_TRUE(found != sst->end()) << it.first;
+    ASSERT_EQ(found.Value().ToString(), it.second);
+    keys.push_back(it.first);
+  }
+
+  std::vector<SSTable::ConstIterator> results(keys.size(), sst->end());
+  s = sst->MultiGet(keys.data(), keys.size(), results.data());
+  ASSERT_TRUE(s) << s.ToString();
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_TRUE(results[i] != sst->end()) << keys[i].ToString();
+    ASSERT_EQ(results[i].Value().ToString(), table.at(keys[i].ToString()));
+  }
+}
+
+// Returns the compression type in the trailer of the first data block.
+static int FirstBlockCompression(const Options& options,
+                                 const std::string& contents) {
+  StringSource source(contents);
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &source, contents.size(), s));
+  EXPECT_TRUE(s) << s.ToString();
+  Slice hbuf = sst->TEST_GetIndexBlock()->begin().Value();
+  BlockHandle handle;
+  EXPECT_TRUE(BlockHandle::DecodeFrom(&hbuf, &handle));
+  return contents[handle.offset - kBlockTrailerSize] &
+         kBlockTrailerCompressionMask;
+}
+
+TEST(Compression, Blocks) {
+  KVMap table;
+  for (int i = 0; i < 2000; ++i) {
+    table.emplace("k" + std::to_string(i), JsonValue(i));
+  }
+  Options options;
+  const std::string uncompressed = BuildTable(options, table);
+  ASSERT_EQ(FirstBlockCompression(options, uncompressed), kNoCompression);
+
+  for (CompressionType type : {kLZ4Compression, kZstdCompression}) {
+    if (!compression::IsSupported(type))
+      continue;
+    SCOPED_TRACE(type);
+    options.compression = type;
+    std::string contents = BuildTable(options, table);
+    ASSERT_LT(contents.size(), uncompressed.size() / 2);
+    ASSERT_EQ(FirstBlockCompression(options, contents), type);
+    CheckTable(options, contents, table);
+
+    // The blocks are uncompressed regardless of the options of the reader.
+    Options reader;
+    CheckTable(reader, contents, table);
+
+    // Compressed blocks are checked by the crc of what is stored.
+    std::string corrupted = contents;
+    corrupted[10] ^= 1;
+    StringSource source(corrupted);
+    Status s;
+    std::unique_ptr<SSTable> sst(
+        SSTable::Open(options, &source, corrupted.size(), s));
+    ASSERT_TRUE(s) << s.ToString();
+    Slice hbuf = sst->TEST_GetIndexBlock()->begin().Value();
+    BlockHandle handle;
+    ASSERT_TRUE(BlockHandle::DecodeFrom(&hbuf, &handle));
+    BlockContent content;
+    ReadOptions read_options;
+    read_options.verify_checksums = true;
+    ASSERT_TRUE(
+        ReadBlockContent(&source, read_options, handle, &content).IsCorruption());
+  }
+}
+
+TEST(Compression, Incompressible) {
+  KVMap table;
+  for (int i = 0; i < 1000; ++i) {
+    std::string value(100, 0);
+    for (char& c : value)
+      c = static_cast<char>(RandomIn(0, 255));
+    table.emplace(RandomString(16), value);
+  }
+  for (CompressionType type : {kLZ4Compression, kZstdCompression}) {
+    if (!compression::IsSupported(type))
+      continue;
+    SCOPED_TRACE(type);
+    Options options;
+    options.compression = type;
+    std::string contents = BuildTable(options, table);
+    // The blocks that don't shrink enough are stored as is.
+    ASSERT_EQ(FirstBlockCompression(options, contents), kNoCompression);
+    CheckTable(options, contents, table);
+  }
+}
+
+TEST(Compression, Pipelined) {
+  KVMap table;
+  for (int i = 0; i < 5000; ++i) {
+    table.emplace("k" + std::to_string(i), JsonValue(i));
+  }
+  std::unique_ptr<FilterStrategy> filter(FilterStrategy::Default(10));
+  for (CompressionType type :
+       {kNoCompression, kLZ4Compression, kZstdCompression}) {
+    if (!compression::IsSupported(type))
+      continue;
+    SCOPED_TRACE(type);
+    for (int variant = 0; variant < 3; variant++) {
+      SCOPED_TRACE(variant);
+      Options options;
+      options.compression = type;
+      options.filter_strategy = variant >= 1 ? filter.get() : nullptr;
+      options.index_partition_size = variant == 2 ? 256 : 0;
+      options.zstd_max_dict_bytes =
+          variant == 2 && type == kZstdCompression ? 2048 : 0;
+      const std::string serial = BuildTable(options, table);
+
+      // The blocks compressed out of order are written in order, the table
+      // is the same byte for byte.
+      options.parallel_compression_threads = 3;
+      ASSERT_EQ(BuildTable(options, table), serial);
+      CheckTable(options, serial, table);
+    }
+  }
+
+  // An empty table, and a builder dropped before Finish.
+  Options options;
+  options.parallel_compression_threads = 2;
+  ASSERT_EQ(BuildTable(options, KVMap()), BuildTable(Options(), KVMap()));
+  StringSink sink;
+  SSTableBuilder builder(&options, &sink);
+  for (const auto& it : table) {
+    ASSERT_TRUE(builder.Add(it.first, it.second));
+  }
+  ASSERT_GT(builder.FileSize(), 0);
+}
+
+TEST(Compression, Dictionary) {
+  if (!compression::IsSupported(kZstdCompression))
+    return;
+
+  KVMap table;
+  for (int i = 0; i < 5000; ++i) {
+    table.emplace("k" + std::to_string(i), JsonValue(i));
+  }
+  std::unique_ptr<FilterStrategy> filter(FilterStrategy::Default(10));
+  Options options;
+  options.block_size = 256;
+  options.filter_strategy = filter.get();
+  options.compression = kZstdCompression;
+  const std::string no_dict = BuildTable(options, table);
+
+  // The dictionary is trained on about the first half of the blocks.
+  options.zstd_max_dict_bytes = 2048;
+  const std::string contents = BuildTable(options, table);
+  ASSERT_LT(contents.size(), no_dict.size());
+  CheckTable(options, contents, table);
+
+  // A table with fewer data than the samples has its dictionary trained at
+  // Finish.
+  KVMap small;
+  for (int i = 0; i < 500; ++i) {
+    small.emplace("k" + std::to_string(i), JsonValue(i));
+  }
+  CheckTable(options, BuildTable(options, small), small);
+
+  const std::string empty = BuildTable(options, KVMap());
+  StringSource source(empty);
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &source, empty.size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+  ASSERT_TRUE(sst->find("k1") == sst->end());
+}
+
+TEST(Compression, CompressedBlockCache) {
+  CompressionType type = compression::IsSupported(kLZ4Compression)
+                             ? kLZ4Compression
+                             : kZstdCompression;
+  if (!compression::IsSupported(type))
+    return;
+
+  KVMap table;
+  for (int i = 0; i < 2000; ++i) {
+    table.emplace("k" + std::to_string(i), JsonValue(i));
+  }
+  Options options;
+  options.compression = type;
+  const std::string contents = BuildTable(options, table);
+
+  // The data blocks are only cached compressed.
+  std::unique_ptr<CacheStrategy> compressed(CacheStrategy::Default(1 << 20));
+  options.block_cache_compressed = compressed.get();
+  StringSource source(contents);
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &source, contents.size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+
+  int reads = source.NumReads();
+  size_t num_blocks = 0;
+  for (auto it = sst->begin(); it != sst->end(); it++) {
+    ASSERT_EQ(it.Value().ToString(), table[it.Key().ToString()]);
+  }
+  const Block* index = sst->TEST_GetIndexBlock();
+  for (auto it = index->begin(); it != index->end(); it++) {
+    num_blocks++;
+  }
+  ASSERT_EQ(source.NumReads() - reads, num_blocks);
+  ASSERT_GT(compressed->TotalCharge(), 0);
+  ASSERT_LT(compressed->TotalCharge(), contents.size());
+
+  // All the blocks are found in the compressed cache afterwards.
+  reads = source.NumReads();
+  std::vector<Slice> keys;
+  for (const auto& it : table) {
+    auto found = sst->find(it.first);
+    ASSERT_TRUE(found != sst->end());
+    ASSERT_EQ(found.Value().ToString(), it.second);
+    keys.push_back(it.first);
+  }
+  std::vector<SSTable::ConstIterator> results(keys.size(), sst->end());
+  s = sst->MultiGet(keys.data(), keys.size(), results.data());
+  ASSERT_TRUE(s) << s.ToString();
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_TRUE(results[i] != sst->end());
+  }
+  ASSERT_EQ(source.NumReads(), reads);
+
+  // A block missing from the block cache is filled from the compressed one.
+  std::unique_ptr<CacheStrategy> cache(CacheStrategy::Default(1 << 20));
+  options.block_cache = cache.get();
+  std::unique_ptr<SSTable> sst2(
+      SSTable::Open(options, &source, contents.size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+  reads = source.NumReads();
+  for (const auto& it : table) {
+    ASSERT_TRUE(sst2->find(it.first) != sst2->end());
+  }
+  ASSERT_EQ(source.NumReads() - reads, num_blocks);
+  ASSERT_GT(cache->TotalCharge(), compressed->TotalCharge());
+}
+
+TEST(Filter, PrefixMayMatch) {
+  // Tenants "t000" to "t198" of even numbers, each with a run of keys that
+  // spans several blocks.
+  KVMap table;
+  for (int t = 0; t < 200; t += 2) {
+    char tenant[8];
+    snprintf(tenant, sizeof(tenant), "t%03d", t);
+    for (int i = 0; i < 50; ++i) {
+      table.emplace(tenant + std::to_string(i), RandomString(1 << 5));
+    }
+  }
+  std::unique_ptr<FilterStrategy> filter(FilterStrategy::Default(10));
+  std::unique_ptr<PrefixExtractor> extractor(PrefixExtractor::Fixed(4));
+  Options options;
+  options.block_size = 256;
+  options.filter_strategy = filter.get();
+  options.prefix_extractor = extractor.get();
+
+  for (size_t partition_size : {0, 256}) {
+    SCOPED_TRACE(partition_size);
+    options.index_partition_size = partition_size;
+    const std::string contents = BuildTable(options, table);
+    StringSource source(contents);
+    Status s;
+    std::unique_ptr<SSTable> sst(
+        SSTable::Open(options, &source, contents.size(), s));
+    ASSERT_TRUE(s) << s.ToString();
+
+    int ruled_out = 0;
+    for (int t = 0; t < 200; ++t) {
+      char tenant[8];
+      snprintf(tenant, sizeof(tenant), "t%03d", t);
+      const bool match = sst->PrefixMayMatch(ReadOptions(), tenant);
+      if (t % 2 == 0)
+        ASSERT_TRUE(match) << tenant;
+      else if (!match)
+        ruled_out++;
+    }
+    ASSERT_GE(ruled_out, 100 * 0.9);
+    // Keys without a prefix, and keys past the table.
+    ASSERT_TRUE(sst->PrefixMayMatch(ReadOptions(), "t"));
+    ASSERT_FALSE(sst->PrefixMayMatch(ReadOptions(), "zzzz"));
+
+    // Without the extractor recorded in the table, nothing is ruled out.
+    std::unique_ptr<PrefixExtractor> other(PrefixExtractor::Fixed(3));
+    Options other_options = options;
+    other_options.prefix_extractor = other.get();
+    std::unique_ptr<SSTable> sst2(
+        SSTable::Open(other_options, &source, contents.size(), s));
+    ASSERT_TRUE(s) << s.ToString();
+    ASSERT_TRUE(sst2->PrefixMayMatch(ReadOptions(), "t001"));
+  }
+}
+
+TEST(Read, PartitionedIndex) {
+  KVMap table;
+  for (int i = 0; i < 3000; ++i) {
+    table.emplace("k" + std::to_string(i), JsonValue(i));
+  }
+  std::unique_ptr<FilterStrategy> filter(FilterStrategy::Default(10));
+  Options options;
+  options.block_size = 256;
+  options.filter_strategy = filter.get();
+  const std::string single = BuildTable(options, table);
+  size_t num_blocks = 0;
+  {
+    StringSource source(single);
+    Status s;
+    std::unique_ptr<SSTable> sst(
+        SSTable::Open(options, &source, single.size(), s));
+    ASSERT_TRUE(s) << s.ToString();
+    const Block* index = sst->TEST_GetIndexBlock();
+    for (auto it = index->begin(); it != index->end(); it++)
+      num_blocks++;
+  }
+
+  options.index_partition_size = 256;
+  for (CompressionType type : {kNoCompression, kZstdCompression}) {
+    if (!compression::IsSupported(type))
+      continue;
+    SCOPED_TRACE(type);
+    options.compression = type;
+    options.zstd_max_dict_bytes = type == kZstdCompression ? 2048 : 0;
+    const std::string contents = BuildTable(options, table);
+    CheckTable(options, contents, table);
+
+    // Only the top-level index is held by the opened table.
+    std::unique_ptr<CacheStrategy> cache(CacheStrategy::Default(1 << 20));
+    options.block_cache = cache.get();
+    StringSource source(contents);
+    Status s;
+    std::unique_ptr<SSTable> sst(
+        SSTable::Open(options, &source, contents.size(), s));
+    ASSERT_TRUE(s) << s.ToString();
+    size_t num_partitions = 0;
+    const Block* index = sst->TEST_GetIndexBlock();
+    for (auto it = index->begin(); it != index->end(); it++)
+      num_partitions++;
+    ASSERT_GT(num_partitions, 1);
+    ASSERT_LT(num_partitions * 4, num_blocks);
+
+    // The partitions are read on demand, and then cached along with the
+    // data blocks.
+    int reads = source.NumReads();
+    ASSERT_TRUE(sst->find("k1") != sst->end());
+    ASSERT_EQ(source.NumReads() - reads, 2);
+    ASSERT_TRUE(sst->find("k1") != sst->end());
+    ASSERT_EQ(source.NumReads() - reads, 2);
+    ASSERT_TRUE(sst->find("k0x") == sst->end());
+    ASSERT_TRUE(sst->find("zzz") == sst->end());
+    ASSERT_TRUE(sst->find("zzz").Stat());
+
+    reads = source.NumReads();
+    size_t n = 0;
+    for (auto it = sst->begin(); it != sst->end(); it++)
+      n++;
+    ASSERT_EQ(n, table.size());
+    // Every block but the cached ones is read once.
+    ASSERT_EQ(source.NumReads() - reads, num_partitions + num_blocks - 2);
+    options.block_cache = nullptr;
+  }
+}
+
+TEST(Read, ErrorPerIterator) {
+  KVMap table;
+  for (int i = 0; i < 1000; ++i) {
+    table.emplace("k" + std::to_string(i), JsonValue(i));
+  }
+  Options options;
+  options.block_size = 256;
+  std::string contents = BuildTable(options, table);
+  contents[0] ^= 1;  // the first data block
+
+  StringSource source(contents);
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &source, contents.size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+  ReadOptions read_options;
+  read_options.verify_checksums = true;
+  const std::string bad = table.begin()->first;
+  const std::string good = table.rbegin()->first;
+
+  // The readers sharing the table each see the errors of their own reads.
+  std::vector<std::thread> threads;
+  std::atomic<int> failures(0);
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < 200; i++) {
+        const bool corrupted = (i + t) % 2 == 0;
+        auto it = sst->find(read_options, corrupted ? bad : good);
+        const Status st = it.Stat();
+        if (corrupted ? st || !st.IsCorruption() || it != sst->end()
+                      : !st || it == sst->end())
+          failures++;
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(failures.load(), 0);
+
+  // A failed iterator ends, and is cleared by the next search.
+  auto it = sst->begin(read_options);
+  ASSERT_TRUE(it == sst->end());
+  ASSERT_TRUE(it.Stat().IsCorruption());
+  it.Seek(good);
+  ASSERT_TRUE(it != sst->end());
+  ASSERT_TRUE(it.Stat());
+}
+
+TEST(Read, OpenTail) {
+  KVMap table;
+  for (int i = 0; i < 3000; ++i) {
+    table.emplace("k" + std::to_string(i), JsonValue(i));
+  }
+  std::unique_ptr<FilterStrategy> filter(FilterStrategy::Default(10));
+  Options options;
+  options.block_size = 256;
+  options.filter_strategy = filter.get();
+  options.index_partition_size = 256;
+  const std::string contents = BuildTable(options, table);
+
+  // The footer, the index, the meta index and the filter are read at once.
+  {
+    StringSource source(contents);
+    Status s;
+    std::unique_ptr<SSTable> sst(
+        SSTable::Open(options, &source, contents.size(), s));
+    ASSERT_TRUE(s) << s.ToString();
+    ASSERT_EQ(source.NumReads(), 1);
+    ASSERT_TRUE(sst->find("k1") != sst->end());
+    ASSERT_TRUE(sst->find("k0x") == sst->end());
+  }
+
+  // The blocks out of the tail are read as usual.
+  for (int i = 0; i < 50000; ++i) {
+    table.emplace("x" + std::to_string(i), JsonValue(i));
+  }
+  const std::string large = BuildTable(options, table);
+  ASSERT_GT(large.size(), config::kTableTailPrefetchSize * 4);
+  StringSource source(large);
+  Status s;
+  std::unique_ptr<SSTable> sst(SSTable::Open(options, &source, large.size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+  ASSERT_GT(source.NumReads(), 1);
+  CheckTable(options, large, table);
+}
+
+TEST(Read, Readahead) {
+  KVMap table;
+  for (int i = 0; i < 3000; ++i) {
+    table.emplace("k" + std::to_string(i), JsonValue(i));
+  }
+  Options options;
+  options.block_size = 256;
+
+  for (size_t partition_size : {0, 256}) {
+    SCOPED_TRACE(partition_size);
+    options.index_partition_size = partition_size;
+    const std::string contents = BuildTable(options, table);
+    size_t num_partitions = 0;
+    size_t num_blocks = 0;
+    {
+      StringSource source(contents);
+      Status s;
+      std::unique_ptr<SSTable> sst(
+          SSTable::Open(options, &source, contents.size(), s));
+      ASSERT_TRUE(s) << s.ToString();
+      const Block* index = sst->TEST_GetIndexBlock();
+      for (auto it = index->begin(); it != index->end(); it++) {
+        if (partition_size == 0) {
+          num_blocks++;
+          continue;
+        }
+        num_partitions++;
+        auto partition =
+            sst->ObtainBlockByIndexIterator(it, ReadOptions(), &s);
+        ASSERT_TRUE(partition) << s.ToString();
+        for (auto p = partition->begin(); p != partition->end(); p++)
+          num_blocks++;
+      }
+    }
+
+    std::unique_ptr<CacheStrategy> cache(CacheStrategy::Default(8 << 20));
+    options.block_cache = cache.get();
+    StringSource source(contents);
+    Status s;
+    std::unique_ptr<SSTable> sst(
+        SSTable::Open(options, &source, contents.size(), s));
+    ASSERT_TRUE(s) << s.ToString();
+
+    // A scan that reads ahead goes through every block once, in much fewer
+    // batches than blocks, and leaves the cache untouched.
+    ReadOptions scan;
+    scan.fill_cache = false;
+    scan.readahead_size = 64 << 10;
+    int reads = source.NumReads();
+    int batches = source.NumBatches();
+    auto it2 = table.begin();
+    auto it = sst->begin(scan);
+    for (; it != sst->end(); it++, it2++) {
+      ASSERT_TRUE(it2 != table.end());
+      ASSERT_EQ(it.Key().ToString(), it2->first);
+      ASSERT_EQ(it.Value().ToString(), it2->second);
+    }
+    ASSERT_TRUE(it2 == table.end());
+    ASSERT_TRUE(it.Stat()) << it.Stat().ToString();
+    ASSERT_EQ(source.NumReads() - reads, num_partitions + num_blocks);
+    ASSERT_LE((source.NumBatches() - batches) * 4, num_blocks);
+    ASSERT_EQ(cache->TotalCharge(), 0);
+
+    // Blocks found in cache are not read again.
+    reads = source.NumReads();
+    for (int i = 0; i < 3000; i += 100) {
+      ASSERT_TRUE(sst->find("k" + std::to_string(i)) != sst->end());
+    }
+    int cached = source.NumReads() - reads;
+    ASSERT_GT(cached, 0);
+    reads = source.NumReads();
+    size_t n = 0;
+    for (auto it = sst->begin(scan); it != sst->end(); it++)
+      n++;
+    ASSERT_EQ(n, table.size());
+    ASSERT_EQ(source.NumReads() - reads,
+              num_partitions + num_blocks - cached);
+    options.block_cache = nullptr;
+  }
+}
+
+TEST(Read, Prefetch) {
+  KVMap table;
+  for (int i = 0; i < 3000; ++i) {
+    table.emplace("k" + std::to_string(i), JsonValue(i));
+  }
+  Options options;
+  options.block_size = 256;
+
+  for (size_t partition_size : {0, 256}) {
+    SCOPED_TRACE(partition_size);
+    options.index_partition_size = partition_size;
+    const std::string contents = BuildTable(options, table);
+    std::unique_ptr<CacheStrategy> cache(CacheStrategy::Default(8 << 20));
+    options.block_cache = cache.get();
+    StringSource source(contents);
+    Status s;
+    std::unique_ptr<SSTable> sst(
+        SSTable::Open(options, &source, contents.size(), s));
+    ASSERT_TRUE(s) << s.ToString();
+
+    // The blocks of the keys are read in one batch, but for the one already
+    // cached, then found in cache.
+    std::vector<std::string> keys;
+    for (int i = 0; i < 3000; i += 100)
+      keys.push_back("k" + std::to_string(i));
+    ASSERT_TRUE(sst->find(keys[3]) != sst->end());
+    std::vector<Slice> slices(keys.begin(), keys.end());
+    int reads = source.NumReads();
+    int batches = source.NumBatches();
+    s = sst->Prefetch(ReadOptions(), slices.data(), slices.size());
+    ASSERT_TRUE(s) << s.ToString();
+    ASSERT_GT(source.NumReads() - reads, 1);
+    ASSERT_EQ(source.NumBatches() - batches, 1);
+
+    reads = source.NumReads();
+    for (const std::string& key : keys) {
+      auto it = sst->lower_bound(ReadOptions(), key);
+      ASSERT_TRUE(it != sst->end());
+      ASSERT_EQ(it.Key().ToString(), key);
+    }
+    ASSERT_EQ(source.NumReads(), reads);
+
+    // Nothing is read without filling the cache.
+    ReadOptions no_fill;
+    no_fill.fill_cache = false;
+    slices.assign(1, Slice("k999"));
+    sst->Prefetch(no_fill, slices.data(), slices.size());
+    ASSERT_EQ(source.NumReads(), reads);
+    options.block_cache = nullptr;
+  }
+}
+
+TEST(Read, WarmUp) {
+  KVMap table;
+  for (int i = 0; i < 3000; ++i) {
+    table.emplace("k" + std::to_string(i), JsonValue(i));
+  }
+  Options options;
+  options.block_size = 256;
+
+  for (size_t partition_size : {0, 256}) {
+    SCOPED_TRACE(partition_size);
+    options.index_partition_size = partition_size;
+    const std::string contents = BuildTable(options, table);
+    std::unique_ptr<CacheStrategy> cache(CacheStrategy::Default(8 << 20));
+    options.block_cache = cache.get();
+    StringSource source(contents);
+    Status s;
+    std::unique_ptr<SSTable> sst(
+        SSTable::Open(options, &source, contents.size(), s));
+    ASSERT_TRUE(s) << s.ToString();
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < 3000; i += 100)
+      keys.push_back("k" + std::to_string(i));
+    for (const std::string& key : keys)
+      ASSERT_TRUE(sst->find(key) != sst->end());
+
+    // The offsets of the cached blocks of the table, as a dump lists them.
+    std::vector<uint64_t> offsets;
+    cache->VisitKeys([&](const Slice& key) {
+      uint64_t cache_id, offset;
+      ASSERT_TRUE(SSTable::DecodeBlockCacheKey(key, &cache_id, &offset));
+      ASSERT_EQ(cache_id, sst->BlockCacheId());
+      offsets.push_back(offset);
+    });
+    ASSERT_FALSE(offsets.empty());
+
+    // Opened again with a cold cache, the table reads the blocks back in a
+    // batch, after which the keys are found without reading.
+    std::unique_ptr<CacheStrategy> cold(CacheStrategy::Default(8 << 20));
+    options.block_cache = cold.get();
+    sst.reset(SSTable::Open(options, &source, contents.size(), s));
+    ASSERT_TRUE(s) << s.ToString();
+    int batches = source.NumBatches();
+    offsets.push_back(contents.size() + 1);  // of no block
+    s = sst->WarmUp(ReadOptions(), offsets);
+    ASSERT_TRUE(s) << s.ToString();
+    ASSERT_EQ(source.NumBatches() - batches, 1);
+    ASSERT_EQ(cold->TotalCharge(), cache->TotalCharge());
+
+    const int reads = source.NumReads();
+    for (const std::string& key : keys) {
+      auto it = sst->find(key);
+      ASSERT_TRUE(it != sst->end());
+      ASSERT_EQ(it.Key().ToString(), key);
+    }
+    ASSERT_EQ(source.NumReads(), reads);
+    options.block_cache = nullptr;
+  }
+}
+
+TEST(Read, Seek) {
+  KVMap table;
+  for (int i = 0; i < 3000; i += 2) {
+    table.emplace("k" + std::to_string(i), JsonValue(i));
+  }
+  Options options;
+  options.block_size = 256;
+
+  for (size_t partition_size : {0, 256}) {
+    SCOPED_TRACE(partition_size);
+    options.index_partition_size = partition_size;
+    const std::string contents = BuildTable(options, table);
+    StringSource source(contents);
+    Status s;
+    std::unique_ptr<SSTable> sst(
+        SSTable::Open(options, &source, contents.size(), s));
+    ASSERT_TRUE(s) << s.ToString();
+
+    // Seeks to keys in and out of the table, forward and backward, and past
+    // the end.
+    auto it = sst->begin();
+    for (int i = 0; i < 2000; i++) {
+      std::string key = "k" + std::to_string(RandomIn(0, 3100));
+      it.Seek(key);
+      auto expected = table.lower_bound(key);
+      if (expected == table.end()) {
+        ASSERT_TRUE(it == sst->end()) << key;
+        continue;
+      }
+      ASSERT_TRUE(it != sst->end()) << key;
+      ASSERT_EQ(it.Key().ToString(), expected->first);
+      ASSERT_EQ(it.Value().ToString(), expected->second);
+      // Scanning goes on from the new position.
+      it++;
+      expected++;
+      ASSERT_EQ(it == sst->end(), expected == table.end());
+    }
+    ASSERT_TRUE(it.Stat()) << it.Stat().ToString();
+
+    // Seeking forward a short distance reads no more than a scan does.
+    int reads = source.NumReads();
+    for (it = sst->begin(); it != sst->end(); it++) {
+    }
+    int scan_reads = source.NumReads() - reads;
+    reads = source.NumReads();
+    size_t n = 0;
+    for (auto expected = table.begin(); expected != table.end(); n++) {
+      it.Seek(expected->first);
+      ASSERT_EQ(it.Key().ToString(), expected->first);
+      if (++expected != table.end())
+        ++expected;
+    }
+    ASSERT_EQ(n, (table.size() + 1) / 2);
+    ASSERT_EQ(source.NumReads() - reads, scan_reads);
+
+    // An iterator at the end can be sought back into the table.
+    it = sst->find("zzz");
+    ASSERT_TRUE(it == sst->end());
+    it.Seek("");
+    ASSERT_TRUE(it != sst->end());
+    ASSERT_EQ(it.Key().ToString(), table.begin()->first);
+  }
+}
+
+TEST(Build, IndexRestartInterval) {
+  KVMap table;
+  for (int i = 0; i < 3000; ++i) {
+    table.emplace("k" + std::to_string(i), JsonValue(i));
+  }
+  Options options;
+  options.block_size = 256;
+
+  // The last index key is a short successor of the last key.
+  const std::string contents = BuildTable(options, table);
+  size_t index_size = 0;
+  {
+    StringSource source(contents);
+    Status s;
+    std::unique_ptr<SSTable> sst(
+        SSTable::Open(options, &source, contents.size(), s));
+    ASSERT_TRUE(s) << s.ToString();
+    const Block* index = sst->TEST_GetIndexBlock();
+    std::string last;
+    for (auto it = index->begin(); it != index->end(); it++)
+      last = it.Key().ToString();
+    ASSERT_EQ(last, "l");
+    index_size = index->Size();
+  }
+
+  // With fewer restart points, the index keys are prefix-compressed and the
+  // handles delta-encoded, which are decoded from any entry on.
+  options.index_block_restart_interval = 16;
+  for (size_t partition_size : {0, 256}) {
+    SCOPED_TRACE(partition_size);
+    options.index_partition_size = partition_size;
+    const std::string compact = BuildTable(options, table);
+    CheckTable(options, compact, table);
+    ASSERT_LT(compact.size(), contents.size());
+
+    StringSource source(compact);
+    Status s;
+    std::unique_ptr<SSTable> sst(
+        SSTable::Open(options, &source, compact.size(), s));
+    ASSERT_TRUE(s) << s.ToString();
+    if (partition_size == 0)
+      ASSERT_LT(sst->TEST_GetIndexBlock()->Size() * 2, index_size);
+
+    ReadOptions read_options;
+    read_options.readahead_size = 4096;
+    size_t n = 0;
+    auto it = sst->begin(read_options);
+    for (; it != sst->end(); it++)
+      n++;
+    ASSERT_EQ(n, table.size());
+    ASSERT_TRUE(it.Stat()) << it.Stat().ToString();
+  }
+}
+
+TEST(Build, DataBlockHashIndex) {
+  KVMap table;
+  for (int i = 0; i < 3000; ++i) {
+    table.emplace("k" + std::to_string(i), JsonValue(i));
+  }
+  Options options;
+  options.data_block_hash_ratio = 0.75;
+  const std::string contents = BuildTable(options, table);
+  CheckTable(options, contents, table);
+
+  StringSource source(contents);
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &source, contents.size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+  for (int i = 0; i < 3000; ++i) {
+    auto it = sst->find("k" + std::to_string(i) + "x");
+    ASSERT_TRUE(it == sst->end());
+    ASSERT_TRUE(it.Stat()) << it.Stat().ToString();
+  }
+}
+
+TEST(Read, InternalKeyRestartPrefixes) {
+  // A table built from a memtable, keyed by internal keys of bytewise user
+  // keys, the versions of a user key are ordered by decreasing sequence.
+  InternalKeyComparator icmp(NewBytewiseComparator());
+  Options options;
+  options.comparator = &icmp;
+  options.block_size = 256;
+
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1000; ++i) {
+    std::string user_key = "k" + std::to_string(i * 7);
+    for (SequenceNumber seq : {2 * i + 1, 2 * i}) {
+      InternalKeyBuf key(user_key, seq, kTypeValue);
+      keys.push_back(key.Data().ToString());
+    }
+  }
+  std::sort(keys.begin(), keys.end(),
+            [&](const std::string& a, const std::string& b) {
+              return icmp.Compare(a, b) < 0;
+            });
+
+  StringSink sink;
+  SSTableBuilder builder(&options, &sink);
+  for (const auto& key : keys)
+    ASSERT_TRUE(builder.Add(key, key));
+  ASSERT_TRUE(builder.Finish());
+
+  StringSource source(sink.Content());
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &source, sink.Content().size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+
+  // The index is searched by the prefixes of its user keys.
+  const Block* index = sst->TEST_GetIndexBlock();
+  ASSERT_TRUE(index->TEST_HasRestartPrefixes());
+
+  for (size_t i = 0; i < keys.size(); i++) {
+    auto it = sst->find(keys[i]);
+    ASSERT_TRUE(it != sst->end()) << i;
+    ASSERT_EQ(it.Value().ToString(), keys[i]);
+
+    // The newest version of a user key is the lower bound of the key at the
+    // largest sequence.
+    InternalKey ikey(keys[i]);
+    InternalKeyBuf latest(ikey.user_key, kMaxSequenceNumber, kTypeValue);
+    it = sst->lower_bound(ReadOptions(), latest.Data());
+    ASSERT_TRUE(it != sst->end()) << i;
+    ASSERT_EQ(it.Key().ToString(), keys[i - i % 2]);
+  }
+
+  // Lookups of missing user keys between the existing ones.
+  for (int i = 0; i < 1000; ++i) {
+    InternalKeyBuf missing("k" + std::to_string(i * 7) + "x",
+                           kMaxSequenceNumber, kTypeValue);
+    ASSERT_TRUE(sst->find(missing.Data()) == sst->end());
+  }
+}
@@ -0,0 +1,152 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "ConcurrentArena.h"
+#include "SkipList.h"
+
+using namespace lessdb;
+
+namespace {
+
+struct IntComparator {
+  int operator()(const int &a, const int &b) const {
+    return a < b ? -1 : (a > b ? 1 : 0);
+  }
+};
+
+typedef SkipList<int, IntComparator> IntSkipList;
+typedef SkipList<int, IntComparator, ConcurrentArena> ConcurrentSkipList;
+
+std::vector<int> randomKeys(size_t n, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::vector<int> keys(n);
+  for (int &k : keys)
+    k = static_cast<int>(gen() >> 1);
+  return keys;
+}
+
+}  // namespace
+
+// Builds a list of range(0) random keys from scratch in every iteration.
+static void SkipList_Insert(benchmark::State &state) {
+  const std::vector<int> keys =
+      randomKeys(static_cast<size_t>(state.range(0)), 301);
+  for (auto _ : state) {
+    SysArena arena;
+    IntSkipList l(&arena);
+    for (int k : keys)
+      l.Insert(k);
+    benchmark::DoNotOptimize(l.Begin());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Threads insert disjoint keys into one list with InsertConcurrently, which
+// is how the memtable is written to by concurrent writers.
+static void SkipList_InsertConcurrently(benchmark::State &state) {
+  static std::unique_ptr<ConcurrentArena> arena;
+  static std::unique_ptr<ConcurrentSkipList> l;
+  if (state.thread_index() == 0) {
+    arena.reset(new ConcurrentArena);
+    l.reset(new ConcurrentSkipList(arena.get()));
+  }
+
+  std::mt19937 gen(static_cast<unsigned>(state.thread_index()));
+  for (auto _ : state) {
+    int k = static_cast<int>(gen() >> 1);
+    // Keeps the keys of different threads disjoint.
+    k = k - k % state.threads() + state.thread_index();
+    benchmark::DoNotOptimize(l->InsertConcurrently(k));
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0) {
+    l.reset();
+    arena.reset();
+  }
+}
+
+// Looks up the keys of a list of range(0) keys in random order, half of them
+// present. The list is shared by the threads.
+static void SkipList_Find(benchmark::State &state) {
+  static std::unique_ptr<SysArena> arena;
+  static std::unique_ptr<IntSkipList> l;
+  const size_t n = static_cast<size_t>(state.range(0));
+  const std::vector<int> keys = randomKeys(n * 2, 301);
+  if (state.thread_index() == 0) {
+    arena.reset(new SysArena);
+    l.reset(new IntSkipList(arena.get()));
+    for (size_t i = 0; i < n; i++)
+      l->Insert(keys[i]);
+  }
+
+  std::mt19937 gen(static_cast<unsigned>(state.thread_index()));
+  std::uniform_int_distribution<size_t> dis(0, keys.size() - 1);
+  int64_t found = 0;
+  for (auto _ : state) {
+    found += l->Find(keys[dis(gen)]) != l->End();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["hit_rate"] = benchmark::Counter(
+      static_cast<double>(found) / static_cast<double>(state.iterations()),
+      benchmark::Counter::kAvgThreads);
+
+  if (state.thread_index() == 0) {
+    l.reset();
+    arena.reset();
+  }
+}
+
+/**
+ * Baseline, to be compared against by changes to SkipList. With a single core
+ * the thread counts measure the overhead of contention, not the scaling.
+ *
+ * Benchmark environment:
+ * Intel Xeon @ 2.10GHz, 1 core, g++ (Debian 12.2.0-14) 12.2.0, -O2 -DNDEBUG.
+ *
+ * Benchmark                                              Time   Iterations
+ * ------------------------------------------------------------------------
+ * SkipList_Insert/1024                             123870 ns          745
+ * SkipList_Insert/32768                          10735014 ns            6
+ * SkipList_Insert/524288                        452863553 ns            1
+ * SkipList_InsertConcurrently/real_time/threads:1     498 ns       160724
+ * SkipList_InsertConcurrently/real_time/threads:8    1389 ns       819952
+ * SkipList_Find/1024/real_time/threads:1             88.7 ns       630344
+ * SkipList_Find/32768/real_time/threads:1             223 ns       322385
+ * SkipList_Find/524288/real_time/threads:1           1085 ns        61295
+ * SkipList_Find/524288/real_time/threads:8            857 ns        80000
+ */
+
+BENCHMARK(SkipList_Insert)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+BENCHMARK(SkipList_InsertConcurrently)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(SkipList_Find)
+    ->RangeMultiplier(8)
+    ->Range(1 << 10, 1 << 19)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -26,6 +26,7 @@
 #include <gtest/gtest.h>
 #include <thread>
 
+#include "ConcurrentArena.h"
 #include "SkipList.h"
 
 using namespace lessdb;
@@ -91,8 +92,50 @@ TEST(Basic, LookUp) {
   ASSERT_EQ(it, l.End());
 }
 
+// Prefixes tie among every 16 consecutive keys, so that both the prefix and
+// the comparator are exercised.
+struct PrefixIntComparator : IntComparator {
+  uint64_t KeyPrefix(const int &a) const {
+    return static_cast<uint64_t>(static_cast<int64_t>(a) + (1LL << 31)) >> 4;
+  }
+};
+
+TEST(Basic, KeyPrefix) {
+  SysArena arena;
+  SkipList<int, PrefixIntComparator> l(&arena);
+  std::set<int> s;
+  for (int i = 0; i < 5000; i++) {
+    int key = std::rand() % 4000 - 2000;
+    l.Insert(key);
+    s.insert(key);
+  }
+
+  auto it1 = l.Begin();
+  for (auto it2 = s.begin(); it2 != s.end(); it1++, it2++) {
+    ASSERT_EQ(*it1, *it2);
+  }
+  ASSERT_EQ(it1, l.End());
+
+  for (int key = -2100; key < 2100; key++) {
+    auto lower = s.lower_bound(key);
+    auto upper = s.upper_bound(key);
+    if (lower == s.end()) {
+      ASSERT_EQ(l.LowerBound(key), l.End());
+    } else {
+      ASSERT_EQ(*l.LowerBound(key), *lower);
+    }
+    if (upper == s.end()) {
+      ASSERT_EQ(l.UpperBound(key), l.End());
+    } else {
+      ASSERT_EQ(*l.UpperBound(key), *upper);
+    }
+    ASSERT_EQ(l.Find(key) != l.End(), s.count(key) == 1);
+  }
+}
+
+template <class Arena>
 void verifyEqual(const std::set<int> &s,
-                 const SkipList<int, IntComparator> &l) {
+                 const SkipList<int, IntComparator, Arena> &l) {
   auto it1 = l.Begin();
   auto it2 = s.begin();
   for (; it1 != l.End(); it1++, it2++) {
@@ -171,6 +214,48 @@ TEST(Concurrent, Add) {
   testConcurrentAdd(50);
 }
 
+typedef SkipList<int, IntComparator, ConcurrentArena> ConcurrentSkipList;
+
+void randomInsertConcurrently(boost::latch *latch, int ndata,
+                              ConcurrentSkipList *l, std::vector<int> *s) {
+  latch->count_down_and_wait();
+
+  for (int i = 0; i < ndata; i++) {
+    int val = (*s)[i];
+    ASSERT_EQ(*l->InsertConcurrently(val), val);
+  }
+}
+
+TEST(Concurrent, InsertConcurrently) {
+  // multi-writer without external synchronization
+  const int nthreads = 8, ndata = 2000;
+  ConcurrentArena arena;
+  ConcurrentSkipList l(&arena);
+  std::vector<std::vector<int>> s(nthreads);
+  std::set<int> all;
+  for (int i = 0; i < nthreads; i++) {
+    for (int k = 0; k < ndata; k++) {
+      // Values overlap between threads.
+      s[i].push_back(std::rand() % 10000);
+      all.insert(s[i].back());
+    }
+  }
+
+  boost::thread_group group;
+  boost::latch latch(nthreads);
+  for (int i = 0; i < nthreads; i++) {
+    group.create_thread(
+        std::bind(randomInsertConcurrently, &latch, ndata, &l, &s[i]));
+  }
+  group.join_all();
+
+  verifyEqual(all, l);
+  size_t count = 0;
+  for (auto it = l.Begin(); it != l.End(); it++)
+    count++;
+  ASSERT_EQ(count, all.size());
+}
+
 void randomAccess(boost::latch *latch, SkipList<int, IntComparator> *l,
                   std::set<int> *s) {
   latch->count_down_and_wait();
@@ -0,0 +1,100 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+#include "Statistics.h"
+
+using namespace lessdb;
+
+TEST(Statistics, Tickers) {
+  Statistics stats;
+  ASSERT_EQ(stats.GetTickerCount(kBlockCacheHit), 0);
+  stats.RecordTick(kBlockCacheHit);
+  stats.RecordTick(kBlockCacheHit, 10);
+  RecordTick(&stats, kBlockCacheMiss, 3);
+  RecordTick(nullptr, kBlockCacheMiss, 3);
+  ASSERT_EQ(stats.GetTickerCount(kBlockCacheHit), 11);
+  ASSERT_EQ(stats.GetTickerCount(kBlockCacheMiss), 3);
+  ASSERT_EQ(stats.GetTickerCount(kBlockCacheAdd), 0);
+
+  stats.Reset();
+  ASSERT_EQ(stats.GetTickerCount(kBlockCacheHit), 0);
+  ASSERT_EQ(stats.GetTickerCount(kBlockCacheMiss), 0);
+}
+
+TEST(Statistics, ConcurrentTickers) {
+  Statistics stats;
+  const int kThreads = 8, kTicks = 10000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < kTicks; i++) {
+        stats.RecordTick(kWalBytes, 2);
+        stats.MeasureTime(kWriteMicros, 5);
+      }
+    });
+  }
+  for (auto &t : threads)
+    t.join();
+
+  ASSERT_EQ(stats.GetTickerCount(kWalBytes), 2 * kThreads * kTicks);
+  HistogramData data;
+  stats.GetHistogramData(kWriteMicros, &data);
+  ASSERT_EQ(data.count, kThreads * kTicks);
+  ASSERT_EQ(data.sum, 5 * kThreads * kTicks);
+  ASSERT_EQ(data.max, 5);
+}
+
+TEST(Statistics, Histogram) {
+  Statistics stats;
+  HistogramData data;
+  stats.GetHistogramData(kGetMicros, &data);
+  ASSERT_EQ(data.count, 0);
+  ASSERT_EQ(data.median, 0);
+
+  for (uint64_t i = 1; i <= 1000; i++)
+    stats.MeasureTime(kGetMicros, i);
+  stats.GetHistogramData(kGetMicros, &data);
+  ASSERT_EQ(data.count, 1000);
+  ASSERT_EQ(data.sum, 500500);
+  ASSERT_EQ(data.max, 1000);
+  ASSERT_DOUBLE_EQ(data.average, 500.5);
+
+  // The buckets are about 1.5x wide, percentiles are within a bucket.
+  ASSERT_GT(data.median, 500 / 1.5);
+  ASSERT_LT(data.median, 500 * 1.5);
+  ASSERT_GT(data.p99, 990 / 1.5);
+  ASSERT_LE(data.p99, 1000);
+  ASSERT_LE(data.median, data.p95);
+  ASSERT_LE(data.p95, data.p99);
+
+  // A histogram is independent from the others.
+  stats.GetHistogramData(kWriteMicros, &data);
+  ASSERT_EQ(data.count, 0);
+
+  const std::string dump = stats.ToString();
+  ASSERT_NE(dump.find("lessdb.get.micros"), std::string::npos);
+  ASSERT_NE(dump.find("lessdb.block.cache.hit COUNT : 0"), std::string::npos);
+}
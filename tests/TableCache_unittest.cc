@@ -0,0 +1,201 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "FileName.h"
+#include "FileUtils.h"
+#include "InternalKey.h"
+#include "Options.h"
+#include "SSTable.h"
+#include "SSTableBuilder.h"
+#include "TableCache.h"
+
+using namespace lessdb;
+
+namespace {
+
+// Counts the files opened for random access through the default factory.
+class CountingFactory final : public FileFactory {
+ public:
+  RandomAccessFile *NewRandomAccessFile(const std::string &fname,
+                                        Status *s) override {
+    opened++;
+    return base()->NewRandomAccessFile(fname, s);
+  }
+  SequentialFile *NewSequentialFile(const std::string &fname,
+                                    Status *s) override {
+    return base()->NewSequentialFile(fname, s);
+  }
+  WritableFile *NewWritableFile(const std::string &fname,
+                                Status *s) override {
+    return base()->NewWritableFile(fname, s);
+  }
+  Status GetChildren(const std::string &dir,
+                     std::vector<std::string> *result) override {
+    return base()->GetChildren(dir, result);
+  }
+  Status CreateDirIfMissing(const std::string &dirname) override {
+    return base()->CreateDirIfMissing(dirname);
+  }
+  bool FileExists(const std::string &fname) override {
+    return base()->FileExists(fname);
+  }
+  Status DeleteFile(const std::string &fname) override {
+    return base()->DeleteFile(fname);
+  }
+  Status GetFileSize(const std::string &fname, uint64_t *size) override {
+    return base()->GetFileSize(fname, size);
+  }
+  Status RenameFile(const std::string &src,
+                    const std::string &target) override {
+    return base()->RenameFile(src, target);
+  }
+
+  std::atomic<int> opened{0};
+
+ private:
+  static FileFactory *base() {
+    return FileFactory::Default();
+  }
+};
+
+}  // anonymous namespace
+
+class TableCacheTest : public ::testing::Test {
+ protected:
+  TableCacheTest() : icmp_(options_.comparator) {}
+
+  void SetUp() override {
+    dbname_ = (boost::filesystem::temp_directory_path() /
+               boost::filesystem::unique_path("lessdb-%%%%-%%%%"))
+                  .string();
+    ASSERT_TRUE(factory_.CreateDirIfMissing(dbname_));
+  }
+
+  void TearDown() override {
+    boost::filesystem::remove_all(dbname_);
+  }
+
+  // Writes table file "number" holding the single key "key", returns its
+  // size.
+  uint64_t BuildTable(uint64_t number, const std::string &key) {
+    Options table_options = options_;
+    table_options.comparator = &icmp_;
+    Status s;
+    std::unique_ptr<WritableFile> file(
+        factory_.NewWritableFile(TableFileName(dbname_, number), &s));
+    EXPECT_TRUE(s) << s.ToString();
+    SSTableBuilder builder(&table_options, file.get());
+    builder.Add(InternalKeyBuf(key, 1, kTypeValue).Data(), "v");
+    EXPECT_TRUE(builder.Finish());
+    EXPECT_TRUE(file->Close());
+    return builder.FileSize();
+  }
+
+  std::string dbname_;
+  Options options_;
+  InternalKeyComparator icmp_;
+  CountingFactory factory_;
+};
+
+TEST_F(TableCacheTest, ReusesOpenTables) {
+  uint64_t size = BuildTable(5, "a");
+  TableCache cache(dbname_, options_, &icmp_, &factory_, 10);
+
+  Status s;
+  std::shared_ptr<SSTable> t1 = cache.Get(5, size, &s);
+  ASSERT_TRUE(s) << s.ToString();
+  std::shared_ptr<SSTable> t2 = cache.Get(5, size, &s);
+  ASSERT_TRUE(s) << s.ToString();
+  ASSERT_EQ(t1.get(), t2.get());
+  ASSERT_EQ(factory_.opened, 1);
+
+  auto it = t1->begin();
+  ASSERT_TRUE(it != t1->end());
+  ASSERT_EQ(it.Key(), InternalKeyBuf("a", 1, kTypeValue).Data());
+}
+
+TEST_F(TableCacheTest, EvictsColdTables) {
+  uint64_t size5 = BuildTable(5, "a");
+  uint64_t size6 = BuildTable(6, "b");
+  TableCache cache(dbname_, options_, &icmp_, &factory_, 1);
+
+  Status s;
+  std::shared_ptr<SSTable> t5 = cache.Get(5, size5, &s);
+  ASSERT_TRUE(s) << s.ToString();
+  ASSERT_TRUE(cache.Get(6, size6, &s)) << s.ToString();
+  ASSERT_EQ(factory_.opened, 2);
+
+  // Table 5 was evicted by table 6, but remains readable while held.
+  auto it = t5->begin();
+  ASSERT_TRUE(it != t5->end());
+  ASSERT_EQ(it.Key(), InternalKeyBuf("a", 1, kTypeValue).Data());
+
+  ASSERT_TRUE(cache.Get(5, size5, &s)) << s.ToString();
+  ASSERT_EQ(factory_.opened, 3);
+}
+
+TEST_F(TableCacheTest, Evict) {
+  uint64_t size = BuildTable(5, "a");
+  TableCache cache(dbname_, options_, &icmp_, &factory_, 10);
+
+  Status s;
+  ASSERT_TRUE(cache.Get(5, size, &s)) << s.ToString();
+  cache.Evict(5);
+  ASSERT_TRUE(cache.Get(5, size, &s)) << s.ToString();
+  ASSERT_EQ(factory_.opened, 2);
+}
+
+TEST_F(TableCacheTest, VisitTables) {
+  uint64_t size5 = BuildTable(5, "a");
+  uint64_t size6 = BuildTable(6, "b");
+  TableCache cache(dbname_, options_, &icmp_, &factory_, 10);
+
+  Status s;
+  std::shared_ptr<SSTable> t5 = cache.Get(5, size5, &s);
+  ASSERT_TRUE(t5) << s.ToString();
+  std::shared_ptr<SSTable> t6 = cache.Get(6, size6, &s);
+  ASSERT_TRUE(t6) << s.ToString();
+  cache.Evict(6);
+
+  std::vector<std::pair<uint64_t, const SSTable *>> visited;
+  cache.VisitTables([&visited](uint64_t number, const SSTable &table) {
+    visited.emplace_back(number, &table);
+  });
+  ASSERT_EQ(visited.size(), 1);
+  ASSERT_EQ(visited[0].first, 5);
+  ASSERT_EQ(visited[0].second, t5.get());
+}
+
+TEST_F(TableCacheTest, MissingFile) {
+  TableCache cache(dbname_, options_, &icmp_, &factory_, 10);
+
+  Status s;
+  ASSERT_FALSE(cache.Get(7, 100, &s));
+  ASSERT_FALSE(s);
+}
@@ -0,0 +1,151 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+
+#include "ThreadPool.h"
+
+using namespace lessdb;
+
+namespace {
+
+// Counts the finished jobs, and waits for them.
+class Counter {
+ public:
+  void Done() {
+    std::lock_guard<std::mutex> guard(mu_);
+    n_++;
+    cv_.notify_all();
+  }
+
+  void WaitFor(int n) {
+    std::unique_lock<std::mutex> lock(mu_);
+    cv_.wait(lock, [&] { return n_ >= n; });
+  }
+
+  int Count() {
+    std::lock_guard<std::mutex> guard(mu_);
+    return n_;
+  }
+
+ private:
+  std::mutex mu_;
+  std::condition_variable cv_;
+  int n_ = 0;
+};
+
+}  // anonymous namespace
+
+TEST(ThreadPool, RunsJobs) {
+  ThreadPool pool(2, 3, 4);
+  ASSERT_EQ(pool.NumThreads(ThreadPool::kHigh), 2);
+  ASSERT_EQ(pool.NumThreads(ThreadPool::kLow), 3);
+  ASSERT_EQ(pool.NumThreads(ThreadPool::kRead), 4);
+
+  Counter counter;
+  for (int i = 0; i < 150; i++) {
+    uint64_t id = pool.Schedule([&] { counter.Done(); },
+                                static_cast<ThreadPool::Priority>(i % 3));
+    ASSERT_NE(id, 0);
+  }
+  counter.WaitFor(150);
+}
+
+TEST(ThreadPool, HighPriorityNotBehindLow) {
+  ThreadPool pool(1, 1);
+  std::promise<void> release;
+  std::shared_future<void> released(release.get_future());
+  Counter low;
+  pool.Schedule([&] {
+    released.wait();
+    low.Done();
+  }, ThreadPool::kLow);
+
+  // The low-priority thread is busy, a high-priority job still runs.
+  Counter high;
+  pool.Schedule([&] { high.Done(); }, ThreadPool::kHigh);
+  high.WaitFor(1);
+  ASSERT_EQ(low.Count(), 0);
+
+  release.set_value();
+  low.WaitFor(1);
+}
+
+TEST(ThreadPool, Cancel) {
+  ThreadPool pool(1, 1);
+  std::promise<void> started, release;
+  std::shared_future<void> released(release.get_future());
+  Counter counter;
+  uint64_t running = pool.Schedule([&] {
+    started.set_value();
+    released.wait();
+    counter.Done();
+  }, ThreadPool::kLow);
+  started.get_future().wait();
+
+  std::atomic<bool> canceled_ran(false);
+  uint64_t queued =
+      pool.Schedule([&] { canceled_ran = true; }, ThreadPool::kLow);
+  ASSERT_EQ(pool.QueueLength(ThreadPool::kLow), 1);
+  ASSERT_FALSE(pool.Cancel(running));
+  ASSERT_TRUE(pool.Cancel(queued));
+  ASSERT_FALSE(pool.Cancel(queued));
+  ASSERT_EQ(pool.QueueLength(ThreadPool::kLow), 0);
+
+  pool.Schedule([&] { counter.Done(); }, ThreadPool::kLow);
+  release.set_value();
+  counter.WaitFor(2);
+  ASSERT_FALSE(canceled_ran);
+}
+
+TEST(ThreadPool, SetBackgroundThreads) {
+  ThreadPool pool(1, 1);
+  pool.SetBackgroundThreads(ThreadPool::kLow, 4);
+  ASSERT_EQ(pool.NumThreads(ThreadPool::kLow), 4);
+
+  // The 4 jobs only finish if they all run at the same time.
+  std::mutex mu;
+  std::condition_variable cv;
+  int arrived = 0;
+  Counter counter;
+  for (int i = 0; i < 4; i++) {
+    pool.Schedule([&] {
+      std::unique_lock<std::mutex> lock(mu);
+      arrived++;
+      cv.notify_all();
+      cv.wait(lock, [&] { return arrived == 4; });
+      counter.Done();
+    }, ThreadPool::kLow);
+  }
+  counter.WaitFor(4);
+
+  pool.SetBackgroundThreads(ThreadPool::kLow, 1);
+  ASSERT_EQ(pool.NumThreads(ThreadPool::kLow), 1);
+  pool.SetBackgroundThreads(ThreadPool::kHigh, 0);
+  ASSERT_EQ(pool.NumThreads(ThreadPool::kHigh), 1);
+  pool.Schedule([&] { counter.Done(); }, ThreadPool::kLow);
+  counter.WaitFor(5);
+}
@@ -0,0 +1,198 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include <memory>
+#include <mutex>
+
+#include "Comparator.h"
+#include "Compaction.h"
+#include "Config.h"
+#include "FileName.h"
+#include "FileUtils.h"
+#include "InternalKey.h"
+#include "LogWriter.h"
+#include "Options.h"
+#include "Version.h"
+#include "VersionEdit.h"
+#include "VersionSet.h"
+
+using namespace lessdb;
+
+static std::string IKey(const std::string &user_key, SequenceNumber seq) {
+  return InternalKeyBuf(user_key, seq, kTypeValue).Data().ToString();
+}
+
+TEST(VersionEdit, EncodeDecode) {
+  VersionEdit edit;
+  edit.SetComparatorName("foo");
+  edit.SetLogNumber(100);
+  edit.SetNextFile(200);
+  edit.SetLastSequence(1000);
+  for (int i = 0; i < 4; i++) {
+    edit.AddFile(3, 300 + i, 400 + i, IKey("foo", 500 + i),
+                 IKey("zoo", 600 + i));
+    edit.RemoveFile(4, 700 + i);
+    edit.SetCompactPointer(i, IKey("x", 900 + i));
+  }
+
+  std::string encoded, encoded2;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  Status s = parsed.DecodeFrom(encoded);
+  ASSERT_TRUE(s) << s.ToString();
+  parsed.EncodeTo(&encoded2);
+  ASSERT_EQ(encoded, encoded2);
+
+  // Truncated edits are rejected.
+  for (size_t n = 1; n < encoded.size(); n += 7) {
+    ASSERT_FALSE(parsed.DecodeFrom(Slice(encoded.data(), n)));
+  }
+}
+
+class VersionSetTest : public ::testing::Test {
+ protected:
+  VersionSetTest() : icmp_(options_.comparator) {}
+
+  void SetUp() override {
+    dbname_ = (boost::filesystem::temp_directory_path() /
+               boost::filesystem::unique_path("lessdb-%%%%-%%%%"))
+                  .string();
+    FileFactory *factory = FileFactory::Default();
+    ASSERT_TRUE(factory->CreateDirIfMissing(dbname_));
+
+    // The manifest of an empty database, as DBImpl creates it.
+    VersionEdit new_db;
+    new_db.SetComparatorName(options_.comparator->Name());
+    new_db.SetLogNumber(0);
+    new_db.SetNextFile(2);
+    new_db.SetLastSequence(0);
+    Status s;
+    std::unique_ptr<WritableFile> file(
+        factory->NewWritableFile(DescriptorFileName(dbname_, 1), &s));
+    ASSERT_TRUE(s) << s.ToString();
+    log::Writer log(file.get());
+    std::string record;
+    new_db.EncodeTo(&record);
+    ASSERT_TRUE(log.WriteRecord(record));
+    ASSERT_TRUE(file->Close());
+    ASSERT_TRUE(SetCurrentFile(factory, dbname_, 1));
+  }
+
+  void TearDown() override {
+    boost::filesystem::remove_all(dbname_);
+  }
+
+  std::unique_ptr<VersionSet> Open() {
+    std::unique_ptr<VersionSet> versions(
+        new VersionSet(dbname_, &options_, &icmp_, FileFactory::Default()));
+    Status s = versions->Recover();
+    EXPECT_TRUE(s) << s.ToString();
+    return versions;
+  }
+
+  std::string dbname_;
+  Options options_;
+  InternalKeyComparator icmp_;
+  std::mutex mutex_;
+};
+
+TEST_F(VersionSetTest, Recover) {
+  {
+    std::unique_ptr<VersionSet> versions = Open();
+    ASSERT_EQ(versions->NumLevelFiles(0), 0);
+    ASSERT_FALSE(versions->NeedsCompaction());
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (int i = 0; i < config::kL0_CompactionTrigger; i++) {
+      VersionEdit edit;
+      uint64_t number = versions->NewFileNumber();
+      edit.AddFile(0, number, 1000, IKey("a", 10 * i + 1),
+                   IKey(std::string(1, 'b' + i), 10 * i + 2));
+      versions->SetLastSequence(10 * i + 2);
+      Status s = versions->LogAndApply(&edit, &lock);
+      ASSERT_TRUE(s) << s.ToString();
+    }
+    VersionEdit edit;
+    edit.AddFile(1, versions->NewFileNumber(), 1000, IKey("x", 1),
+                 IKey("y", 1));
+    edit.AddFile(1, versions->NewFileNumber(), 1000, IKey("c", 1),
+                 IKey("d", 1));
+    ASSERT_TRUE(versions->LogAndApply(&edit, &lock));
+  }
+
+  for (int i = 0; i < 2; i++) {
+    std::unique_ptr<VersionSet> versions = Open();
+    ASSERT_EQ(versions->NumLevelFiles(0), config::kL0_CompactionTrigger);
+    ASSERT_EQ(versions->NumLevelFiles(1), 2);
+    ASSERT_EQ(versions->NumLevelBytes(1), 2000);
+    ASSERT_EQ(versions->LastSequence(),
+              10 * (config::kL0_CompactionTrigger - 1) + 2);
+
+    // Level-1 files are sorted by their smallest keys.
+    const std::vector<FileMetaData *> &files = versions->current()->Files(1);
+    ASSERT_EQ(files[0]->smallest, IKey("c", 1));
+    ASSERT_EQ(files[1]->smallest, IKey("x", 1));
+
+    // Level-0 reached the compaction trigger, all of its files overlap, and
+    // so does the first file of level-1.
+    ASSERT_TRUE(versions->NeedsCompaction());
+    std::unique_ptr<Compaction> c(versions->PickCompaction());
+    ASSERT_TRUE(c != nullptr);
+    ASSERT_EQ(c->level(), 0);
+    ASSERT_EQ(c->num_input_files(0), config::kL0_CompactionTrigger);
+    ASSERT_EQ(c->num_input_files(1), 1);
+    ASSERT_EQ(c->input(1, 0), files[0]);
+    ASSERT_FALSE(c->IsTrivialMove());
+    ASSERT_TRUE(c->IsBaseLevelForKey("a"));
+
+    // An empty edit starts a new manifest in the next recovery.
+    std::unique_lock<std::mutex> lock(mutex_);
+    VersionEdit edit;
+    ASSERT_TRUE(versions->LogAndApply(&edit, &lock));
+  }
+}
+
+TEST_F(VersionSetTest, ComparatorMismatch) {
+  class ReverseComparator : public Comparator {
+   public:
+    int Compare(const Slice &a, const Slice &b) const override {
+      return -bytewise_->Compare(a, b);
+    }
+    const char *Name() const override {
+      return "lessdb.ReverseComparator";
+    }
+    void FindShortestSeparator(std::string *,
+                               const Slice &) const override {}
+    void FindShortSuccessor(std::string *) const override {}
+
+   private:
+    const Comparator *bytewise_ = NewBytewiseComparator();
+  } reverse;
+
+  options_.comparator = &reverse;
+  InternalKeyComparator icmp(&reverse);
+  VersionSet versions(dbname_, &options_, &icmp, FileFactory::Default());
+  Status s = versions.Recover();
+  ASSERT_TRUE(s.IsInvalidArgument()) << s.ToString();
+}
@@ -44,6 +44,14 @@ class WriteBatchPrinter : public WriteBatch::Handler {
     state_.append(")");
   }
 
+  void DeleteRange(const Slice &begin, const Slice &end) override {
+    state_.append("DeleteRange(");
+    state_.append(begin.RawData(), begin.Len());
+    state_.append(", ");
+    state_.append(end.RawData(), end.Len());
+    state_.append(")");
+  }
+
   std::string ToString() const {
     return state_;
   }
@@ -73,4 +81,60 @@ TEST(Basic, MultipleElements) {
   ASSERT_TRUE(stat.IsOK()) << stat.ToString();
   ASSERT_EQ(printer.ToString(), "Put(foo, bar)Delete(box)Put(baz, boo)");
   ASSERT_EQ(batch.Count(), 3);
-}
\ No newline at end of file
+}
+TEST(Batch, DeleteRange) {
+  WriteBatch batch;
+  batch.Put("foo", "bar");
+  batch.DeleteRange("a", "f");
+  batch.Delete("box");
+  ASSERT_EQ(batch.Count(), 3);
+
+  WriteBatchPrinter printer;
+  ASSERT_TRUE(batch.Iterate(&printer));
+  ASSERT_EQ(printer.ToString(), "Put(foo, bar)DeleteRange(a, f)Delete(box)");
+}
+
+TEST(Batch, ClearAndAppend) {
+  WriteBatch batch;
+  batch.Reserve(1 << 10);
+  batch.Put("foo", "bar");
+  batch.Delete("box");
+  ASSERT_EQ(batch.Count(), 2);
+  const size_t size = batch.ByteSize();
+
+  WriteBatch group;
+  group.Append(batch);
+  group.Append(batch);
+  ASSERT_EQ(group.Count(), 4);
+  WriteBatchPrinter printer;
+  ASSERT_TRUE(group.Iterate(&printer));
+  ASSERT_EQ(printer.ToString(),
+            "Put(foo, bar)Delete(box)Put(foo, bar)Delete(box)");
+
+  batch.Clear();
+  ASSERT_EQ(batch.Count(), 0);
+  ASSERT_LT(batch.ByteSize(), size);
+  batch.Put("baz", "boo");
+  ASSERT_EQ(batch.Count(), 1);
+  ASSERT_EQ(batch.ByteSize(), size - 5);
+}
+
+TEST(Batch, Pool) {
+  WriteBatch *first;
+  {
+    PooledWriteBatch batch = NewPooledWriteBatch();
+    batch->Put("foo", "bar");
+    first = batch.get();
+  }
+
+  // The batch is back in the pool of this thread, cleared.
+  PooledWriteBatch batch = NewPooledWriteBatch();
+  ASSERT_EQ(batch.get(), first);
+  ASSERT_EQ(batch->Count(), 0);
+  WriteBatchPrinter printer;
+  ASSERT_TRUE(batch->Iterate(&printer));
+  ASSERT_EQ(printer.ToString(), "");
+
+  PooledWriteBatch other = NewPooledWriteBatch();
+  ASSERT_NE(other.get(), first);
+}
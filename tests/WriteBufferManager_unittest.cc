@@ -0,0 +1,118 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "CacheStrategy.h"
+#include "Slice.h"
+#include "WriteBufferManager.h"
+
+using namespace lessdb;
+
+TEST(WriteBufferManager, ShouldFlush) {
+  WriteBufferManager manager(1000);
+  manager.ReserveMem(800);
+  ASSERT_FALSE(manager.ShouldFlush());
+  manager.ReserveMem(100);
+  ASSERT_TRUE(manager.ShouldFlush());  // 7/8 of the budget is mutable
+
+  // Being flushed, the memory is still used, but no more mutable.
+  manager.ScheduleFreeMem(900);
+  ASSERT_EQ(manager.MemtableUsage(), 900);
+  ASSERT_EQ(manager.MutableMemtableUsage(), 0);
+  ASSERT_FALSE(manager.ShouldFlush());
+
+  // Over the budget, the mutable memtables are flushed once they hold half
+  // of it.
+  manager.ReserveMem(400);
+  ASSERT_FALSE(manager.ShouldFlush());
+  manager.ReserveMem(100);
+  ASSERT_TRUE(manager.ShouldFlush());
+
+  manager.FreeMem(900);
+  ASSERT_EQ(manager.MemtableUsage(), 500);
+  ASSERT_FALSE(manager.ShouldFlush());
+  ASSERT_FALSE(manager.ShouldStall());  // stalls are not allowed
+
+  // Without a budget the memory is only accounted for.
+  WriteBufferManager unlimited(0);
+  unlimited.ReserveMem(1 << 30);
+  unlimited.ReserveTableMem(100);
+  ASSERT_FALSE(unlimited.ShouldFlush());
+  ASSERT_EQ(unlimited.MemoryUsage(), (1 << 30) + 100);
+}
+
+TEST(WriteBufferManager, Stall) {
+  WriteBufferManager manager(1000, nullptr, true);
+  manager.ReserveMem(1200);
+  // Nothing being flushed would free the memory.
+  ASSERT_FALSE(manager.ShouldStall());
+
+  manager.ScheduleFreeMem(600);
+  ASSERT_TRUE(manager.ShouldStall());
+
+  std::atomic<bool> stalled(true);
+  std::thread writer([&] {
+    manager.MaybeStall();
+    stalled = false;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_TRUE(stalled);
+  manager.FreeMem(600);  // the flush is done
+  writer.join();
+  ASSERT_FALSE(stalled);
+}
+
+TEST(WriteBufferManager, CacheReservation) {
+  std::unique_ptr<CacheStrategy> cache(CacheStrategy::LRU(4 << 20, 0));
+  for (int i = 0; i < 4; i++) {
+    const std::string key = std::to_string(i);
+    cache->Release(cache->Insert(key, nullptr, 1 << 20, nullptr));
+  }
+  ASSERT_EQ(cache->TotalCharge(), 4 << 20);
+
+  {
+    WriteBufferManager manager(0, cache.get());
+    // The memtables and tables push the cached blocks out.
+    manager.ReserveMem(1 << 20);
+    manager.ReserveTableMem(500 << 10);
+    ASSERT_LE(cache->TotalCharge(), 2 << 20);
+    ASSERT_EQ(manager.MemoryUsage(),
+              (1 << 20) + (500 << 10) + cache->TotalCharge());
+
+    manager.FreeTableMem(500 << 10);
+    manager.ScheduleFreeMem(1 << 20);
+    manager.FreeMem(1 << 20);
+    ASSERT_EQ(manager.MemoryUsage(), cache->TotalCharge());
+  }
+
+  // The reservation is given back, the cache takes its whole capacity again.
+  for (int i = 0; i < 4; i++) {
+    const std::string key = std::to_string(i);
+    cache->Release(cache->Insert(key, nullptr, 1 << 20, nullptr));
+  }
+  ASSERT_EQ(cache->TotalCharge(), 4 << 20);
+}
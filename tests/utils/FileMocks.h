@@ -22,7 +22,12 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "Comparator.h"
 #include "FileUtils.h"
@@ -34,25 +39,83 @@ using namespace lessdb;
 
 class StringSource final : public RandomAccessFile {
  public:
-  explicit StringSource(const std::string &content) : content_(content) {}
+  // A StringSource with stable contents hands out pointers into its own
+  // content instead of copying into "dst", like a mmaped file does.
+  explicit StringSource(const std::string &content, bool stable = false)
+      : content_(content), num_reads_(0), num_batches_(0), stable_(stable) {}
 
   Status Read(size_t n, uint64_t offset, char *dst, Slice *result) override {
     assert(offset < content_.length());
+    num_reads_++;
 
     n = (offset + n < content_.length() ? n : content_.length() - offset);
-    memcpy(dst, content_.data() + offset, n);
+    if (stable_) {
+      (*result) = Slice(content_.data() + offset, n);
+    } else {
+      memcpy(dst, content_.data() + offset, n);
+      (*result) = Slice(dst, n);
+    }
+
+    return Status::OK();
+  }
+
+  bool HasStableContents() const override {
+    return stable_;
+  }
+
+  void MultiRead(ReadRequest *reqs, size_t n) override {
+    num_batches_++;
+    RandomAccessFile::MultiRead(reqs, n);
+  }
+
+  // Number of calls to Read.
+  int NumReads() const {
+    return num_reads_;
+  }
+
+  // Number of calls to MultiRead.
+  int NumBatches() const {
+    return num_batches_;
+  }
+
+ private:
+  std::string content_;
+  std::atomic<int> num_reads_;
+  std::atomic<int> num_batches_;
+  bool stable_;
+};
+
+class StringSequentialFile final : public SequentialFile {
+ public:
+  explicit StringSequentialFile(const std::string &content)
+      : content_(content), pos_(0) {}
+
+  Status Read(size_t n, char *dst, Slice *result) override {
+    n = std::min(n, content_.length() - pos_);
+    memcpy(dst, content_.data() + pos_, n);
+    pos_ += n;
     (*result) = Slice(dst, n);
+    return Status::OK();
+  }
 
+  Status Skip(uint64_t n) override {
+    pos_ += std::min(static_cast<size_t>(n), content_.length() - pos_);
     return Status::OK();
   }
 
  private:
   std::string content_;
+  size_t pos_;
 };
 
 class StringSink final : public WritableFile {
  public:
-  StringSink() : closed_(false) {}
+  StringSink() : closed_(false), fail_appends_(false) {}
+
+  // Appends fail while "fail" is true, e.g to test a failed log write.
+  void SetFailAppends(bool fail) {
+    fail_appends_ = fail;
+  }
 
   Status Flush() override {
     assert(!closed_);
@@ -72,6 +135,8 @@ class StringSink final : public WritableFile {
 
   Status Append(const Slice &data) override {
     assert(!closed_);
+    if (fail_appends_)
+      return Status::IOError("injected append error");
     content_.append(data.RawData(), data.Len());
     return Status::OK();
   }
@@ -83,6 +148,106 @@ class StringSink final : public WritableFile {
  private:
   std::string content_;
   bool closed_;
+  bool fail_appends_;
+};
+
+// A FileFactory of the files of "base", into which the errors of a failing
+// device are injected: the reads of the random access files opened so far
+// fail after FailOpenedReads().
+class FaultInjectionFileFactory final : public FileFactory {
+ public:
+  explicit FaultInjectionFileFactory(FileFactory *base)
+      : base_(base), generation_(0), read_barrier_(0) {}
+
+  void FailOpenedReads() {
+    read_barrier_ = generation_.load();
+  }
+
+  RandomAccessFile *NewRandomAccessFile(const std::string &fname,
+                                        Status *s) override {
+    RandomAccessFile *file = base_->NewRandomAccessFile(fname, s);
+    if (!file)
+      return nullptr;
+    return new FaultyRandomAccessFile(file, ++generation_, &read_barrier_);
+  }
+
+  SequentialFile *NewSequentialFile(const std::string &fname,
+                                    Status *s) override {
+    return base_->NewSequentialFile(fname, s);
+  }
+
+  WritableFile *NewWritableFile(const std::string &fname,
+                                Status *s) override {
+    return base_->NewWritableFile(fname, s);
+  }
+
+  Status GetChildren(const std::string &dir,
+                     std::vector<std::string> *result) override {
+    return base_->GetChildren(dir, result);
+  }
+
+  Status CreateDirIfMissing(const std::string &dirname) override {
+    return base_->CreateDirIfMissing(dirname);
+  }
+
+  bool FileExists(const std::string &fname) override {
+    return base_->FileExists(fname);
+  }
+
+  Status DeleteFile(const std::string &fname) override {
+    return base_->DeleteFile(fname);
+  }
+
+  Status GetFileSize(const std::string &fname, uint64_t *size) override {
+    return base_->GetFileSize(fname, size);
+  }
+
+  Status RenameFile(const std::string &src,
+                    const std::string &target) override {
+    return base_->RenameFile(src, target);
+  }
+
+ private:
+  // Fails once the files up to its generation are failed.
+  class FaultyRandomAccessFile final : public RandomAccessFile {
+   public:
+    FaultyRandomAccessFile(RandomAccessFile *file, uint64_t generation,
+                           const std::atomic<uint64_t> *barrier)
+        : file_(file), generation_(generation), barrier_(barrier) {}
+
+    Status Read(size_t n, uint64_t offset, char *dst,
+                Slice *result) override {
+      if (failed())
+        return Status::IOError("injected read error");
+      return file_->Read(n, offset, dst, result);
+    }
+
+    bool HasStableContents() const override {
+      return file_->HasStableContents();
+    }
+
+    void MultiRead(ReadRequest *reqs, size_t n) override {
+      if (!failed()) {
+        file_->MultiRead(reqs, n);
+        return;
+      }
+      for (size_t i = 0; i < n; i++)
+        reqs[i].status = Status::IOError("injected read error");
+    }
+
+   private:
+    bool failed() const {
+      return generation_ <= barrier_->load();
+    }
+
+    std::unique_ptr<RandomAccessFile> file_;
+    const uint64_t generation_;
+    const std::atomic<uint64_t> *barrier_;
+  };
+
+  FileFactory *base_;
+  std::atomic<uint64_t> generation_;
+  std::atomic<uint64_t> read_barrier_;
 };
 
 // An STL comparator that uses a Comparator